@@ -0,0 +1,279 @@
+/**
+ * bucketperf: main.cpp
+ * Copyright (c) Torr Vision Group, University of Oxford, 2019. All rights reserved.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifdef WITH_OPENMP
+#include <omp.h>
+#endif
+
+#include <boost/lexical_cast.hpp>
+
+#include <grove/relocalisation/shared/ScoreNetRelocaliser_Shared.h>
+using namespace grove;
+
+#include <tvgutil/numbers/RandomNumberGenerator.h>
+#include <tvgutil/timing/AverageTimer.h>
+using namespace tvgutil;
+
+//#################### TYPEDEFS ####################
+
+typedef AverageTimer<boost::chrono::microseconds> AverageTimer_US;
+
+//#################### FUNCTIONS ####################
+
+/**
+ * \brief Makes the bucket indices for a sequence of synthetic frames, as they would be computed by a network-based SCoRe relocaliser.
+ *
+ * \note  Each frame sees a patch of a (planar) scene surface around a randomly-chosen point, so many pixels fall into the same
+ *        buckets (this is what makes the per-pixel lookups contend with each other).
+ *
+ * \param frameCount        The number of frames.
+ * \param pixelCount        The number of keypoints (pixels) in each frame.
+ * \param sceneSizeBuckets  The size of the scene (in buckets) along each axis.
+ * \param rng               The random number generator to use.
+ * \return                  The bucket indices (frame by frame).
+ */
+std::vector<int> make_synthetic_bucket_indices(int frameCount, int pixelCount, int sceneSizeBuckets, RandomNumberGenerator& rng)
+{
+  const int patchSizeBuckets = 30;
+
+  std::vector<int> bucketIndices(static_cast<size_t>(frameCount) * pixelCount);
+  for(int frameIdx = 0; frameIdx < frameCount; ++frameIdx)
+  {
+    // Choose the centre of the patch of scene seen in the frame (in a room-sized region in the middle of the scene).
+    int centre[3];
+    for(int i = 0; i < 3; ++i) centre[i] = sceneSizeBuckets / 2 + rng.generate_int_from_uniform(-20, 20);
+
+    for(int pixelIdx = 0; pixelIdx < pixelCount; ++pixelIdx)
+    {
+      // Pick a point on a sloping surface through the centre of the patch, and find the bucket that contains it.
+      const int u = rng.generate_int_from_uniform(-patchSizeBuckets / 2, patchSizeBuckets / 2);
+      const int v = rng.generate_int_from_uniform(-patchSizeBuckets / 2, patchSizeBuckets / 2);
+      const int offsets[] = { u, v, (u + v) / 4 };
+
+      int bucket[3];
+      for(int i = 0; i < 3; ++i) bucket[i] = std::min(std::max(centre[i] + offsets[i], 0), sceneSizeBuckets - 1);
+
+      bucketIndices[static_cast<size_t>(frameIdx) * pixelCount + pixelIdx] = (bucket[2] * sceneSizeBuckets + bucket[1]) * sceneSizeBuckets + bucket[0];
+    }
+  }
+
+  return bucketIndices;
+}
+
+/**
+ * \brief Remaps the specified bucket indices to reservoir indices frame by frame using a std::map guarded by an OpenMP critical section
+ *        (the way ScoreNetRelocaliser used to do it).
+ *
+ * \param bucketIndices     The bucket indices.
+ * \param pixelCount        The number of keypoints (pixels) in each frame.
+ * \param reservoirCount    The number of example reservoirs.
+ * \param reservoirIndices  An array in which to store the reservoir indices.
+ * \return                  The number of buckets in the map.
+ */
+size_t remap_with_critical_section(const std::vector<int>& bucketIndices, int pixelCount, uint32_t reservoirCount, std::vector<int>& reservoirIndices)
+{
+  std::map<int,int> bucketRemapper;
+
+  const int frameCount = static_cast<int>(bucketIndices.size() / pixelCount);
+  for(int frameIdx = 0; frameIdx < frameCount; ++frameIdx)
+  {
+    const int frameOffset = frameIdx * pixelCount;
+
+#ifdef WITH_OPENMP
+    #pragma omp parallel for
+#endif
+    for(int pixelIdx = 0; pixelIdx < pixelCount; ++pixelIdx)
+    {
+      const int bucketIndex = bucketIndices[frameOffset + pixelIdx];
+      int remappedBucketIndex = 0;
+
+    #ifdef WITH_OPENMP
+      #pragma omp critical
+    #endif
+      {
+        std::map<int,int>::const_iterator it = bucketRemapper.find(bucketIndex);
+        if(it != bucketRemapper.end())
+        {
+          remappedBucketIndex = it->second;
+        }
+        else
+        {
+          remappedBucketIndex = static_cast<int>(bucketRemapper.size() % reservoirCount);
+          bucketRemapper.insert(std::make_pair(bucketIndex, remappedBucketIndex));
+        }
+      }
+
+      reservoirIndices[frameOffset + pixelIdx] = remappedBucketIndex;
+    }
+  }
+
+  return bucketRemapper.size();
+}
+
+/**
+ * \brief Remaps the specified bucket indices to reservoir indices frame by frame using the lock-free bucket remapper.
+ *
+ * \param bucketIndices     The bucket indices.
+ * \param pixelCount        The number of keypoints (pixels) in each frame.
+ * \param reservoirCount    The number of example reservoirs.
+ * \param slotBuckets       The bucket index stored in each slot of the bucket remapper (these must initially all be EMPTY_BUCKET_SLOT).
+ * \param slotReservoirs    The reservoir index stored in each slot of the bucket remapper (these must initially all be -1).
+ * \param reservoirIndices  An array in which to store the reservoir indices.
+ * \return                  The number of buckets in the bucket remapper.
+ */
+int remap_lock_free(const std::vector<int>& bucketIndices, int pixelCount, uint32_t reservoirCount,
+                    std::vector<int>& slotBuckets, std::vector<int>& slotReservoirs, std::vector<int>& reservoirIndices)
+{
+  int bucketCount = 0;
+
+  const int frameCount = static_cast<int>(bucketIndices.size() / pixelCount);
+  for(int frameIdx = 0; frameIdx < frameCount; ++frameIdx)
+  {
+    const int frameOffset = frameIdx * pixelCount;
+
+#ifdef WITH_OPENMP
+    #pragma omp parallel for
+#endif
+    for(int pixelIdx = 0; pixelIdx < pixelCount; ++pixelIdx)
+    {
+      reservoirIndices[frameOffset + pixelIdx] = remap_bucket_index(
+        bucketIndices[frameOffset + pixelIdx], &slotBuckets[0], &slotReservoirs[0], static_cast<uint32_t>(slotBuckets.size()),
+        &bucketCount, reservoirCount, true, false, 0
+      );
+    }
+  }
+
+  return bucketCount;
+}
+
+/**
+ * \brief Checks that a remapping of bucket indices to reservoir indices is consistent, i.e. that each bucket was always mapped to the
+ *        same reservoir, and that (while reservoirs remained available) no two buckets were mapped to the same reservoir.
+ *
+ * \param bucketIndices     The bucket indices.
+ * \param reservoirIndices  The reservoir indices to which they were mapped.
+ * \param reservoirCount    The number of example reservoirs.
+ * \return                  true, if the remapping is consistent, or false otherwise.
+ */
+bool check_remapping(const std::vector<int>& bucketIndices, const std::vector<int>& reservoirIndices, uint32_t reservoirCount)
+{
+  std::map<int,int> bucketToReservoir;
+  std::vector<int> reservoirBucketCounts(reservoirCount, 0);
+
+  for(size_t i = 0, size = bucketIndices.size(); i < size; ++i)
+  {
+    const int reservoirIdx = reservoirIndices[i];
+    if(reservoirIdx < 0 || reservoirIdx >= static_cast<int>(reservoirCount)) return false;
+
+    std::map<int,int>::const_iterator it = bucketToReservoir.find(bucketIndices[i]);
+    if(it == bucketToReservoir.end())
+    {
+      bucketToReservoir.insert(std::make_pair(bucketIndices[i], reservoirIdx));
+      ++reservoirBucketCounts[reservoirIdx];
+    }
+    else if(it->second != reservoirIdx) return false;
+  }
+
+  // If there were no more buckets than reservoirs, each reservoir should have been used for at most one bucket.
+  if(bucketToReservoir.size() <= reservoirCount)
+  {
+    for(uint32_t i = 0; i < reservoirCount; ++i)
+    {
+      if(reservoirBucketCounts[i] > 1) return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * \brief Compares remapping bucket indices using the lock-free bucket remapper with remapping them using a std::map guarded by
+ *        an OpenMP critical section, for each number of threads from 1 up to the number of available cores, and prints the results.
+ *
+ * \param bucketIndices   The bucket indices.
+ * \param pixelCount      The number of keypoints (pixels) in each frame.
+ * \param reservoirCount  The number of example reservoirs.
+ * \return                true, if both approaches yielded consistent remappings with the same number of buckets for every number of threads, or false otherwise.
+ */
+bool compare_remappers(const std::vector<int>& bucketIndices, int pixelCount, uint32_t reservoirCount)
+{
+  const int runCount = 5;
+
+  size_t slotCount = 1;
+  while(slotCount < 2 * static_cast<size_t>(reservoirCount)) slotCount *= 2;
+
+#ifdef WITH_OPENMP
+  const int maxThreadCount = omp_get_num_procs();
+#else
+  const int maxThreadCount = 1;
+#endif
+
+  bool succeeded = true;
+  std::vector<int> criticalReservoirIndices(bucketIndices.size()), lockFreeReservoirIndices(bucketIndices.size());
+
+  std::cout << "Remapping " << bucketIndices.size() << " bucket indices to " << reservoirCount << " reservoirs\n";
+  for(int threadCount = 1; threadCount <= maxThreadCount; ++threadCount)
+  {
+#ifdef WITH_OPENMP
+    omp_set_num_threads(threadCount);
+#endif
+
+    AverageTimer_US criticalTimer("Critical"), lockFreeTimer("Lock-Free");
+    size_t criticalBucketCount = 0;
+    int lockFreeBucketCount = 0;
+
+    for(int run = 0; run < runCount; ++run)
+    {
+      criticalTimer.start_nosync();
+      criticalBucketCount = remap_with_critical_section(bucketIndices, pixelCount, reservoirCount, criticalReservoirIndices);
+      criticalTimer.stop_nosync();
+
+      std::vector<int> slotBuckets(slotCount, EMPTY_BUCKET_SLOT), slotReservoirs(slotCount, -1);
+      lockFreeTimer.start_nosync();
+      lockFreeBucketCount = remap_lock_free(bucketIndices, pixelCount, reservoirCount, slotBuckets, slotReservoirs, lockFreeReservoirIndices);
+      lockFreeTimer.stop_nosync();
+    }
+
+    // Note that once the lock-free remapper is as full as it is allowed to get (which threads racing to add buckets can overshoot slightly),
+    // it stops adding new buckets, so the bucket counts only need to match if that did not happen.
+    const bool consistent = check_remapping(bucketIndices, criticalReservoirIndices, reservoirCount) && check_remapping(bucketIndices, lockFreeReservoirIndices, reservoirCount);
+    const bool countsMatch = criticalBucketCount < slotCount / 2
+      ? static_cast<size_t>(lockFreeBucketCount) == criticalBucketCount
+      : static_cast<size_t>(lockFreeBucketCount) >= slotCount / 2;
+    if(!consistent || !countsMatch) succeeded = false;
+
+    std::cout << threadCount << " thread(s): critical section " << criticalTimer.average_duration().count() / 1000.0
+              << "ms, lock-free " << lockFreeTimer.average_duration().count() / 1000.0 << "ms, buckets "
+              << criticalBucketCount << '/' << lockFreeBucketCount << (consistent && countsMatch ? "" : " (MISMATCH)") << '\n';
+  }
+
+  return succeeded;
+}
+
+int main(int argc, char *argv[])
+{
+  const int frameCount = argc > 1 ? boost::lexical_cast<int>(argv[1]) : 100;
+  const int pixelCount = 80 * 60;       // The number of keypoints produced for a 640x480 image with a feature step of 8.
+  const int sceneSizeBuckets = 1000;    // The default scene size (10000cm) divided by the default bucket size (10cm).
+
+  RandomNumberGenerator rng(12345);
+  const std::vector<int> bucketIndices = make_synthetic_bucket_indices(frameCount, pixelCount, sceneSizeBuckets, rng);
+
+  bool succeeded = true;
+
+  // Compare the remappers with the default number of reservoirs, and with few enough reservoirs that they all get allocated.
+  succeeded = compare_remappers(bucketIndices, pixelCount, 40000) && succeeded;
+  std::cout << '\n';
+  succeeded = compare_remappers(bucketIndices, pixelCount, 1000) && succeeded;
+
+  return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,280 @@
+/**
+ * clustererperf: main.cpp
+ * Copyright (c) Torr Vision Group, University of Oxford, 2019. All rights reserved.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <boost/lexical_cast.hpp>
+
+#include <grove/clustering/ExampleClustererFactory.h>
+#include <grove/scoreforests/Keypoint3DColourCluster.h>
+#include <grove/scoreforests/ScorePrediction.h>
+using namespace grove;
+
+#include <tvgutil/numbers/RandomNumberGenerator.h>
+#include <tvgutil/timing/AverageTimer.h>
+using namespace tvgutil;
+
+//#################### TYPEDEFS ####################
+
+typedef ExampleClustererFactory<Keypoint3DColour,Keypoint3DColourCluster,ScorePrediction::Capacity> ClustererFactory;
+typedef ClustererFactory::Clusterer_Ptr Clusterer_Ptr;
+typedef AverageTimer<boost::chrono::microseconds> AverageTimer_US;
+
+//#################### FUNCTIONS ####################
+
+/**
+ * \brief Makes a set of synthetic example reservoirs, each of which is filled with examples drawn from a few compact
+ *        modes scattered around a room-sized volume, together with some uniformly-distributed outliers.
+ *
+ * \note This mimics the contents of the reservoirs of a relocalisation forest, whose leaves tend to collect examples
+ *       from a handful of places in the scene that look alike.
+ *
+ * \param reservoirCount    The number of reservoirs to make.
+ * \param reservoirCapacity The capacity of each reservoir (all of the reservoirs are filled to capacity).
+ * \param reservoirs        An image in which to store the reservoirs (one per row).
+ * \param reservoirSizes    A memory block in which to store the number of examples in each reservoir.
+ */
+void make_synthetic_reservoirs(int reservoirCount, int reservoirCapacity, Keypoint3DColourImage& reservoirs, ORUtils::MemoryBlock<int>& reservoirSizes)
+{
+  const float roomSize = 4.0f;
+  const float modeSigma = 0.05f;
+  const float outlierRatio = 0.1f;
+
+  Keypoint3DColour *reservoirsPtr = reservoirs.GetData(MEMORYDEVICE_CPU);
+  int *reservoirSizesPtr = reservoirSizes.GetData(MEMORYDEVICE_CPU);
+
+  RandomNumberGenerator rng(12345);
+  for(int reservoirIdx = 0; reservoirIdx < reservoirCount; ++reservoirIdx)
+  {
+    // Choose the modes for the reservoir.
+    const int modeCount = rng.generate_int_from_uniform(1, 5);
+    Vector3f modeCentres[5];
+    for(int modeIdx = 0; modeIdx < modeCount; ++modeIdx)
+    {
+      for(int i = 0; i < 3; ++i) modeCentres[modeIdx][i] = rng.generate_real_from_uniform(0.0f, roomSize);
+    }
+
+    // Fill the reservoir.
+    for(int exampleIdx = 0; exampleIdx < reservoirCapacity; ++exampleIdx)
+    {
+      Keypoint3DColour& example = reservoirsPtr[reservoirIdx * reservoirCapacity + exampleIdx];
+      if(rng.generate_real_from_uniform(0.0f, 1.0f) < outlierRatio)
+      {
+        for(int i = 0; i < 3; ++i) example.position[i] = rng.generate_real_from_uniform(0.0f, roomSize);
+      }
+      else
+      {
+        const Vector3f& modeCentre = modeCentres[rng.generate_int_from_uniform(0, modeCount - 1)];
+        for(int i = 0; i < 3; ++i) example.position[i] = rng.generate_from_gaussian(modeCentre[i], modeSigma);
+      }
+
+      for(int i = 0; i < 3; ++i) example.colour[i] = static_cast<unsigned char>(rng.generate_int_from_uniform(0, 255));
+      example.valid = true;
+    }
+
+    reservoirSizesPtr[reservoirIdx] = reservoirCapacity;
+  }
+}
+
+/**
+ * \brief Clusters the specified reservoirs a number of times using the specified clusterer, and returns the average time taken.
+ *
+ * \param clusterer         The clusterer.
+ * \param reservoirs        The reservoirs to cluster.
+ * \param reservoirSizes    The number of examples in each reservoir.
+ * \param clusterContainers The containers in which to store the clusters computed for each reservoir.
+ * \param iterationCount    The number of times to cluster the reservoirs.
+ * \return                  The average time taken to cluster the reservoirs (in milliseconds).
+ */
+double time_clustering(const Clusterer_Ptr& clusterer, const Keypoint3DColourImage_CPtr& reservoirs, const ORIntMemoryBlock_CPtr& reservoirSizes,
+                       ScorePredictionsMemoryBlock_Ptr& clusterContainers, int iterationCount)
+{
+  const uint32_t reservoirCount = static_cast<uint32_t>(reservoirs->noDims.y);
+
+  // Cluster the reservoirs once to warm up the clusterer (e.g. allocate its temporaries).
+  clusterer->cluster_examples(reservoirs, reservoirSizes, 0, reservoirCount, clusterContainers);
+
+  AverageTimer_US timer("clustering");
+  for(int i = 0; i < iterationCount; ++i)
+  {
+    timer.start_nosync();
+    clusterer->cluster_examples(reservoirs, reservoirSizes, 0, reservoirCount, clusterContainers);
+    timer.stop_nosync();
+  }
+
+  return timer.average_duration().count() / 1000.0;
+}
+
+/**
+ * \brief Checks that two sets of cluster containers contain the same modes (up to a tolerance on the cluster parameters).
+ *
+ * \param expected        The expected cluster containers.
+ * \param actual          The cluster containers to check.
+ * \param containerCount  The number of containers to check.
+ * \return                The number of containers whose modes differ.
+ */
+int count_mismatched_containers(const ScorePredictionsMemoryBlock& expected, const ScorePredictionsMemoryBlock& actual, int containerCount)
+{
+  const float positionTolerance = 1e-4f;
+  const ScorePrediction *expectedPtr = expected.GetData(MEMORYDEVICE_CPU);
+  const ScorePrediction *actualPtr = actual.GetData(MEMORYDEVICE_CPU);
+
+  int mismatchCount = 0;
+  for(int containerIdx = 0; containerIdx < containerCount; ++containerIdx)
+  {
+    const ScorePrediction& e = expectedPtr[containerIdx];
+    const ScorePrediction& a = actualPtr[containerIdx];
+
+    bool match = e.size == a.size;
+    for(int clusterIdx = 0; match && clusterIdx < e.size; ++clusterIdx)
+    {
+      const Keypoint3DColourCluster& ec = e.elts[clusterIdx];
+      const Keypoint3DColourCluster& ac = a.elts[clusterIdx];
+      const Vector3f diff = ec.position - ac.position;
+      match = ec.nbInliers == ac.nbInliers && ec.colour == ac.colour && dot(diff, diff) < positionTolerance * positionTolerance;
+    }
+
+    if(!match) ++mismatchCount;
+  }
+
+  return mismatchCount;
+}
+
+/**
+ * \brief Compares the modes obtained by incrementally updating the modes of a set of reservoirs with some newly-added examples
+ *        to the modes obtained by re-clustering the reservoirs from scratch, and prints the results.
+ *
+ * \param clusterer         The clusterer.
+ * \param reservoirCount    The number of reservoirs to use.
+ * \param reservoirCapacity The capacity of each reservoir.
+ * \param insertionCount    The number of examples to add to each reservoir after it has first been clustered.
+ */
+void compare_incremental_updates(const Clusterer_Ptr& clusterer, int reservoirCount, int reservoirCapacity, int insertionCount)
+{
+  // The maximum squared Mahalanobis distance there can be between a new example and its closest mode (as in ScoreRelocaliser).
+  const float maxMahalanobisSq = 11.34f;
+
+  // The maximum distance there can be between an incrementally-updated mode and the corresponding re-clustered one.
+  const float positionTolerance = 0.005f;
+
+  // Make the reservoirs, and initially hide the last insertionCount examples in each of them.
+  Keypoint3DColourImage *reservoirs = new Keypoint3DColourImage(Vector2i(reservoirCapacity, reservoirCount), true, false);
+  ORUtils::MemoryBlock<int> *reservoirSizes = new ORUtils::MemoryBlock<int>(reservoirCount, true, false);
+  make_synthetic_reservoirs(reservoirCount, reservoirCapacity, *reservoirs, *reservoirSizes);
+  std::fill_n(reservoirSizes->GetData(MEMORYDEVICE_CPU), reservoirCount, reservoirCapacity - insertionCount);
+
+  const Keypoint3DColourImage_CPtr reservoirsPtr(reservoirs);
+  const ORIntMemoryBlock_CPtr reservoirSizesPtr(reservoirSizes);
+
+  // Cluster the reservoirs without the hidden examples.
+  ScorePredictionsMemoryBlock_Ptr incrementalClusters(new ScorePredictionsMemoryBlock(reservoirCount, true, false));
+  clusterer->cluster_examples(reservoirsPtr, reservoirSizesPtr, 0, reservoirCount, incrementalClusters);
+
+  // Reveal the hidden examples, and try to add them to the existing modes of each reservoir.
+  std::fill_n(reservoirSizes->GetData(MEMORYDEVICE_CPU), reservoirCount, reservoirCapacity);
+
+  AverageTimer_US incrementalTimer("incremental");
+  incrementalTimer.start_nosync();
+  std::vector<bool> updated(reservoirCount);
+  for(int reservoirIdx = 0; reservoirIdx < reservoirCount; ++reservoirIdx)
+  {
+    const Keypoint3DColour *newExamples = reservoirs->GetData(MEMORYDEVICE_CPU) + (reservoirIdx + 1) * reservoirCapacity - insertionCount;
+    ScorePrediction& prediction = incrementalClusters->GetData(MEMORYDEVICE_CPU)[reservoirIdx];
+    updated[reservoirIdx] = update_prediction_incrementally(newExamples, insertionCount, maxMahalanobisSq, prediction);
+  }
+  incrementalTimer.stop_nosync();
+
+  // Re-cluster all of the reservoirs from scratch.
+  ScorePredictionsMemoryBlock_Ptr fullClusters(new ScorePredictionsMemoryBlock(reservoirCount, true, false));
+  AverageTimer_US fullTimer("full");
+  fullTimer.start_nosync();
+  clusterer->cluster_examples(reservoirsPtr, reservoirSizesPtr, 0, reservoirCount, fullClusters);
+  fullTimer.stop_nosync();
+
+  // Compare the incrementally-updated modes to the re-clustered ones. Since the incremental update only approximates a full
+  // re-clustering, we check that each re-clustered mode has an incrementally-updated mode close to it, rather than that the
+  // modes are identical.
+  int updatedCount = 0, mismatchCount = 0;
+  float maxPositionError = 0.0f;
+  for(int reservoirIdx = 0; reservoirIdx < reservoirCount; ++reservoirIdx)
+  {
+    if(!updated[reservoirIdx]) continue;
+    ++updatedCount;
+
+    const ScorePrediction& e = fullClusters->GetData(MEMORYDEVICE_CPU)[reservoirIdx];
+    const ScorePrediction& a = incrementalClusters->GetData(MEMORYDEVICE_CPU)[reservoirIdx];
+
+    bool match = e.size == a.size;
+    for(int i = 0; match && i < e.size; ++i)
+    {
+      float minDistSq = INFINITY;
+      for(int j = 0; j < a.size; ++j)
+      {
+        const Vector3f diff = e.elts[i].position - a.elts[j].position;
+        minDistSq = std::min(minDistSq, dot(diff, diff));
+      }
+
+      maxPositionError = std::max(maxPositionError, sqrtf(minDistSq));
+      match = minDistSq <= positionTolerance * positionTolerance;
+    }
+
+    if(!match) ++mismatchCount;
+  }
+
+  std::cout << "Adding " << insertionCount << " examples to reservoirs of capacity " << reservoirCapacity
+            << ": updated " << updatedCount << '/' << reservoirCount << " reservoirs incrementally in "
+            << incrementalTimer.average_duration().count() / 1000.0 << "ms (full re-clustering: "
+            << fullTimer.average_duration().count() / 1000.0 << "ms), mismatched reservoirs: " << mismatchCount
+            << ", max position error: " << maxPositionError << "m\n";
+}
+
+int main(int argc, char *argv[])
+{
+  // Note: These defaults match the ones used by ScoreRelocaliser.
+  const int iterationCount = argc > 1 ? boost::lexical_cast<int>(argv[1]) : 5;
+  const int reservoirCount = argc > 2 ? boost::lexical_cast<int>(argv[2]) : 256;
+  const float sigma = 0.1f, tau = 0.05f;
+  const uint32_t maxClusterCount = ScorePrediction::Capacity, minClusterSize = 20;
+
+  Clusterer_Ptr bruteForceClusterer = ClustererFactory::make_clusterer(sigma, tau, maxClusterCount, minClusterSize, ORUtils::DEVICE_CPU, false);
+  Clusterer_Ptr gridClusterer = ClustererFactory::make_clusterer(sigma, tau, maxClusterCount, minClusterSize, ORUtils::DEVICE_CPU, true);
+
+  ScorePredictionsMemoryBlock_Ptr bruteForceClusters(new ScorePredictionsMemoryBlock(reservoirCount, true, false));
+  ScorePredictionsMemoryBlock_Ptr gridClusters(new ScorePredictionsMemoryBlock(reservoirCount, true, false));
+
+  bool succeeded = true;
+
+  std::cout << "Clustering " << reservoirCount << " reservoirs (sigma = " << sigma << ", tau = " << tau << ")\n";
+  for(int reservoirCapacity = 64; reservoirCapacity <= 4096; reservoirCapacity *= 2)
+  {
+    Keypoint3DColourImage *reservoirs = new Keypoint3DColourImage(Vector2i(reservoirCapacity, reservoirCount), true, false);
+    ORUtils::MemoryBlock<int> *reservoirSizes = new ORUtils::MemoryBlock<int>(reservoirCount, true, false);
+    make_synthetic_reservoirs(reservoirCount, reservoirCapacity, *reservoirs, *reservoirSizes);
+
+    const Keypoint3DColourImage_CPtr reservoirsPtr(reservoirs);
+    const ORIntMemoryBlock_CPtr reservoirSizesPtr(reservoirSizes);
+    const double bruteForceTime = time_clustering(bruteForceClusterer, reservoirsPtr, reservoirSizesPtr, bruteForceClusters, iterationCount);
+    const double gridTime = time_clustering(gridClusterer, reservoirsPtr, reservoirSizesPtr, gridClusters, iterationCount);
+    const int mismatchCount = count_mismatched_containers(*bruteForceClusters, *gridClusters, reservoirCount);
+
+    std::cout << "Capacity " << reservoirCapacity
+              << ": brute force " << bruteForceTime << "ms, grid " << gridTime << "ms"
+              << " (" << bruteForceTime / gridTime << "x), mismatched reservoirs: " << mismatchCount << '\n';
+
+    if(mismatchCount != 0) succeeded = false;
+  }
+
+  std::cout << "\nComparing incremental updates to full re-clustering\n";
+  for(int insertionCount = 1; insertionCount <= 16; insertionCount *= 2)
+  {
+    compare_incremental_updates(gridClusterer, reservoirCount, 1024, insertionCount);
+  }
+
+  return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,89 @@
+/**
+ * forestconverter: main.cpp
+ * Copyright (c) Torr Vision Group, University of Oxford, 2019. All rights reserved.
+ */
+
+#include <cstdlib>
+#include <iostream>
+
+#include <boost/lexical_cast.hpp>
+
+#include <grove/features/interface/RGBDPatchFeatureCalculator.h>
+#include <grove/forests/DecisionForestFactory.h>
+#include <grove/relocalisation/interface/ScoreForestRelocaliser.h>
+using namespace grove;
+
+#include <tvgutil/timing/AverageTimer.h>
+using namespace tvgutil;
+
+//#################### TYPEDEFS ####################
+
+typedef DecisionForestFactory<RGBDPatchDescriptor,ScoreForestRelocaliser::FOREST_TREE_COUNT> ForestFactory;
+typedef AverageTimer<boost::chrono::microseconds> AverageTimer_US;
+
+//#################### FUNCTIONS ####################
+
+/**
+ * \brief Repeatedly loads a forest from the specified file, and measures the average time taken per load.
+ *
+ * \param filename        The path to the file containing the forest.
+ * \param iterationCount  The number of times to load the forest.
+ * \param timer           The timer to use to time the loads.
+ */
+void time_loading(const std::string& filename, int iterationCount, AverageTimer_US& timer)
+{
+  for(int i = 0; i < iterationCount; ++i)
+  {
+    timer.start_nosync();
+    ForestFactory::make_forest(filename, ORUtils::DEVICE_CPU);
+    timer.stop_nosync();
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc < 3)
+  {
+    std::cerr << "Usage: " << argv[0] << " \"input forest filename\" \"output forest filename\" [\"benchmark iterations\"]\n"
+              << "\n"
+              << "Converts a relocalisation forest (in either text or binary format) to binary format.\n"
+              << "If a number of benchmark iterations is specified, the load times of the two files are also compared.\n";
+    return EXIT_FAILURE;
+  }
+
+  const std::string inputFilename = argv[1];
+  const std::string outputFilename = argv[2];
+  const int iterationCount = argc > 3 ? boost::lexical_cast<int>(argv[3]) : 0;
+
+  try
+  {
+    // Load the input forest, and save it in binary format.
+    std::cout << "Loading forest from: " << inputFilename << '\n';
+    ForestFactory::Forest_Ptr forest = ForestFactory::make_forest(inputFilename, ORUtils::DEVICE_CPU);
+
+    std::cout << "Saving forest in: " << outputFilename << '\n';
+    forest->save_structure_to_binary_file(outputFilename);
+
+    // If requested, compare the time taken to load the input forest with that taken to load the converted one.
+    if(iterationCount > 0)
+    {
+      AverageTimer_US inputTimer("Input"), outputTimer("Output");
+      time_loading(inputFilename, iterationCount, inputTimer);
+      time_loading(outputFilename, iterationCount, outputTimer);
+
+      const double inputMs = inputTimer.average_duration().count() / 1000.0;
+      const double outputMs = outputTimer.average_duration().count() / 1000.0;
+      std::cout << "\nAverage load time over " << iterationCount << " iterations:\n"
+                << "\tInput forest: " << inputMs << "ms\n"
+                << "\tBinary forest: " << outputMs << "ms\n"
+                << "\tSpeedup: " << inputMs / outputMs << "x\n";
+    }
+  }
+  catch(std::exception& e)
+  {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
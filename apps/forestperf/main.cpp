@@ -0,0 +1,412 @@
+/**
+ * forestperf: main.cpp
+ * Copyright (c) Torr Vision Group, University of Oxford, 2019. All rights reserved.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include <boost/lexical_cast.hpp>
+
+#include <grove/features/FeatureCalculatorFactory.h>
+#include <grove/features/cpu/RGBDPatchFeatureCalculator_CPU.h>
+#include <grove/forests/DecisionForestFactory.h>
+#include <grove/forests/cpu/DecisionForest_CPU.h>
+#include <grove/relocalisation/interface/ScoreForestRelocaliser.h>
+#include <grove/relocalisation/shared/ScoreForestRelocaliser_Shared.h>
+using namespace grove;
+
+#include <tvgutil/numbers/RandomNumberGenerator.h>
+#include <tvgutil/timing/AverageTimer.h>
+using namespace tvgutil;
+
+//#################### TYPEDEFS ####################
+
+typedef DecisionForestFactory<RGBDPatchDescriptor,ScoreForestRelocaliser::FOREST_TREE_COUNT> ForestFactory;
+typedef RGBDPatchFeatureCalculator_CPU<Keypoint3DColour,RGBDPatchDescriptor> FeatureCalculator_CPU;
+typedef DecisionForest_CPU<RGBDPatchDescriptor,ScoreForestRelocaliser::FOREST_TREE_COUNT> Forest_CPU;
+typedef AverageTimer<boost::chrono::microseconds> AverageTimer_US;
+
+//#################### FUNCTIONS ####################
+
+/**
+ * \brief Makes an image of random descriptors, whose features follow the distributions used to generate the thresholds of random forests.
+ *
+ * \param imgSize The size of the image.
+ * \return        The image of random descriptors.
+ */
+Forest_CPU::DescriptorImage_Ptr make_random_descriptors(const Vector2i& imgSize)
+{
+  Forest_CPU::DescriptorImage_Ptr descriptors(new Forest_CPU::DescriptorImage(imgSize, true, false));
+  RGBDPatchDescriptor *descriptorsPtr = descriptors->GetData(MEMORYDEVICE_CPU);
+
+  // Note: These parameters match the ones used by DecisionForest to generate random thresholds for the depth and colour features.
+  RandomNumberGenerator rng(12345);
+  for(int i = 0, count = imgSize.x * imgSize.y; i < count; ++i)
+  {
+    for(int j = 0; j < RGBDPatchDescriptor::FEATURE_COUNT; ++j)
+    {
+      descriptorsPtr[i].data[j] = j < 128 ? rng.generate_from_gaussian(20.09f, 947.24f) : rng.generate_from_gaussian(-2.85f, 72.98f);
+    }
+  }
+
+  return descriptors;
+}
+
+/**
+ * \brief Makes a block of random SCoRe predictions (one per forest leaf), whose modes are sorted in non-increasing order of size.
+ *
+ * \param predictionCount The number of predictions to make.
+ * \param maxModeCount    The maximum number of modes in each prediction.
+ * \return                The block of random SCoRe predictions.
+ */
+ScorePredictionsMemoryBlock_Ptr make_random_predictions(int predictionCount, int maxModeCount)
+{
+  ScorePredictionsMemoryBlock_Ptr predictions(new ScorePredictionsMemoryBlock(predictionCount, true, false));
+  ScorePrediction *predictionsPtr = predictions->GetData(MEMORYDEVICE_CPU);
+
+  RandomNumberGenerator rng(12345);
+  for(int i = 0; i < predictionCount; ++i)
+  {
+    ScorePrediction& prediction = predictionsPtr[i];
+    prediction.size = rng.generate_int_from_uniform(0, maxModeCount);
+
+    int nbInliers = 1000;
+    for(int j = 0; j < prediction.size; ++j)
+    {
+      Keypoint3DColourCluster& mode = prediction.elts[j];
+      const float sigma = rng.generate_real_from_uniform(0.01f, 0.1f);
+      mode.position = Vector3f(rng.generate_real_from_uniform(-1.0f, 1.0f), rng.generate_real_from_uniform(-1.0f, 1.0f), rng.generate_real_from_uniform(-1.0f, 1.0f));
+      mode.colour = Vector3u(0, 0, 0);
+      mode.positionInvCovariance.setZeros();
+      for(int k = 0; k < 3; ++k) mode.positionInvCovariance.m[k * 4] = 1.0f / (sigma * sigma);
+      mode.determinant = powf(sigma, 6.0f);
+      mode.nbInliers = nbInliers;
+      nbInliers -= rng.generate_int_from_uniform(0, nbInliers / 2);
+    }
+  }
+
+  return predictions;
+}
+
+/**
+ * \brief Makes a synthetic RGB-D image pair of a bumpy, tilted surface with a textured colour pattern and a few holes in the depth.
+ *
+ * \param imgSize     The size of the images.
+ * \param colourImage An image in which to store the colour image.
+ * \param depthImage  An image in which to store the depth image (in metres).
+ */
+void make_synthetic_rgbd_images(const Vector2i& imgSize, ORUChar4Image& colourImage, ORFloatImage& depthImage)
+{
+  Vector4u *colours = colourImage.GetData(MEMORYDEVICE_CPU);
+  float *depths = depthImage.GetData(MEMORYDEVICE_CPU);
+
+  RandomNumberGenerator rng(12345);
+  for(int y = 0; y < imgSize.y; ++y)
+  {
+    for(int x = 0; x < imgSize.x; ++x)
+    {
+      const int i = y * imgSize.x + x;
+      const bool hole = rng.generate_int_from_uniform(0, 19) == 0;
+      depths[i] = hole ? 0.0f : 1.0f + 2.0f * x / imgSize.x + 0.2f * sinf(x * 0.05f) * cosf(y * 0.07f) + rng.generate_from_gaussian(0.0f, 0.005f);
+
+      const int noise = rng.generate_int_from_uniform(0, 15);
+      colours[i] = Vector4u(
+        static_cast<uchar>((x * 255) / imgSize.x),
+        static_cast<uchar>(((x / 16 + y / 16) % 2) * 128 + noise),
+        static_cast<uchar>(128 + 100 * sinf(y * 0.03f)),
+        255
+      );
+    }
+  }
+}
+
+/**
+ * \brief Repeatedly finds the leaves of an image of descriptors, and measures the average time taken to do so.
+ *
+ * \param forest          The forest.
+ * \param descriptors     The image of descriptors.
+ * \param leafIndices     An image in which to store the leaf indices.
+ * \param iterationCount  The number of times to find the leaves.
+ * \return                The average number of descriptors processed per second.
+ */
+double time_find_leaves(const Forest_CPU& forest, const Forest_CPU::DescriptorImage_CPtr& descriptors, Forest_CPU::LeafIndicesImage_Ptr& leafIndices, int iterationCount)
+{
+  AverageTimer_US timer("Find Leaves");
+  for(int i = 0; i < iterationCount; ++i)
+  {
+    timer.start_nosync();
+    forest.find_leaves(descriptors, leafIndices);
+    timer.stop_nosync();
+  }
+
+  return descriptors->dataSize / (timer.average_duration().count() / 1000000.0);
+}
+
+/**
+ * \brief Compares the speed of finding the leaves for the keypoints in an RGB-D image by first computing their full descriptors
+ *        and by evaluating only the features that the forest needs, for forests of various depths.
+ *
+ * \param iterationCount  The number of times to find the leaves for each forest.
+ * \return                true, if the two approaches found exactly the same leaves for every valid keypoint for every forest, or false otherwise.
+ */
+bool benchmark_lazy_feature_evaluation(int iterationCount)
+{
+  const Vector2i imgSize(640, 480);
+  const int treeDepths[] = { 8, 10, 12, 14, 16 };
+
+  std::cout << "Making a synthetic " << imgSize.x << "x" << imgSize.y << " RGB-D image...\n";
+  ORUChar4Image colourImage(imgSize, true, false);
+  ORFloatImage depthImage(imgSize, true, false);
+  make_synthetic_rgbd_images(imgSize, colourImage, depthImage);
+  const Vector4f depthIntrinsics(585.0f, 585.0f, 320.0f, 240.0f);
+
+  // Make the feature calculator used by the relocaliser, and the images in which to store its outputs.
+  boost::shared_ptr<FeatureCalculator_CPU> featureCalculator = boost::dynamic_pointer_cast<FeatureCalculator_CPU>(
+    FeatureCalculatorFactory::make_da_rgbd_patch_feature_calculator(ORUtils::DEVICE_CPU)
+  );
+
+  Matrix4f identity;
+  identity.setIdentity();
+
+  Keypoint3DColourImage_Ptr keypoints(new Keypoint3DColourImage(Vector2i(0, 0), true, false));
+  Forest_CPU::DescriptorImage_Ptr descriptors(new Forest_CPU::DescriptorImage(Vector2i(0, 0), true, false));
+  Forest_CPU::LeafIndicesImage_Ptr eagerLeafIndices(new Forest_CPU::LeafIndicesImage(Vector2i(0, 0), true, false));
+  Forest_CPU::LeafIndicesImage_Ptr lazyLeafIndices(new Forest_CPU::LeafIndicesImage(Vector2i(0, 0), true, false));
+
+  bool allMatched = true;
+  for(size_t i = 0; i < sizeof(treeDepths) / sizeof(int); ++i)
+  {
+    // Make a random forest of the specified depth.
+    SettingsContainer_Ptr settings(new SettingsContainer);
+    settings->add_value("DecisionForest.treeDepth", boost::lexical_cast<std::string>(treeDepths[i]));
+    settings->add_value("DecisionForest.useFixedThresholds", "false");
+    boost::shared_ptr<Forest_CPU> forest = boost::dynamic_pointer_cast<Forest_CPU>(ForestFactory::make_randomly_generated_forest(settings, ORUtils::DEVICE_CPU));
+
+    // Time computing the full descriptors and then finding the leaves for them.
+    AverageTimer_US eagerTimer("Eager");
+    for(int j = 0; j < iterationCount; ++j)
+    {
+      eagerTimer.start_nosync();
+      featureCalculator->compute_keypoints_and_features(&colourImage, &depthImage, identity, depthIntrinsics, keypoints.get(), descriptors.get());
+      forest->find_leaves(descriptors, eagerLeafIndices);
+      eagerTimer.stop_nosync();
+    }
+
+    // Time finding the leaves while evaluating only the features that the forest needs.
+    AverageTimer_US lazyTimer("Lazy");
+    size_t evaluatedCount = 0;
+    for(int j = 0; j < iterationCount; ++j)
+    {
+      lazyTimer.start_nosync();
+      featureCalculator->compute_keypoints(&colourImage, &depthImage, identity, depthIntrinsics, keypoints.get());
+      const FeatureCalculator_CPU::FeatureEvaluator featureEvaluator(*featureCalculator, &colourImage, &depthImage, keypoints.get());
+      evaluatedCount = forest->find_leaves_lazily(featureEvaluator, keypoints->noDims, lazyLeafIndices);
+      lazyTimer.stop_nosync();
+    }
+
+    // Check that the two sets of leaf indices match exactly for all of the valid keypoints (the leaves for invalid keypoints are not meaningful).
+    const Keypoint3DColour *keypointsPtr = keypoints->GetData(MEMORYDEVICE_CPU);
+    const Forest_CPU::LeafIndices *eagerPtr = eagerLeafIndices->GetData(MEMORYDEVICE_CPU);
+    const Forest_CPU::LeafIndices *lazyPtr = lazyLeafIndices->GetData(MEMORYDEVICE_CPU);
+    int mismatchCount = 0;
+    for(size_t j = 0; j < keypoints->dataSize; ++j)
+    {
+      if(!keypointsPtr[j].valid) continue;
+      for(int k = 0; k < Forest_CPU::TREE_COUNT; ++k)
+      {
+        if(eagerPtr[j][k] != lazyPtr[j][k]) ++mismatchCount;
+      }
+    }
+
+    allMatched = allMatched && mismatchCount == 0;
+
+    // Note: The eager approach writes every descriptor once and then reads the parts of them that the forest needs, whereas the lazy approach
+    //       never materialises them, so the descriptors image (at least) is the memory traffic that the lazy approach avoids.
+    const double eagerMs = eagerTimer.average_duration().count() / 1000.0;
+    const double lazyMs = lazyTimer.average_duration().count() / 1000.0;
+    const double featuresPerKeypoint = static_cast<double>(evaluatedCount) / keypoints->dataSize;
+    const double descriptorMegabytes = descriptors->dataSize * sizeof(RGBDPatchDescriptor) / (1024.0 * 1024.0);
+
+    std::cout << "Depth " << treeDepths[i] << ": eager " << eagerMs << " ms, lazy " << lazyMs << " ms (speedup " << eagerMs / lazyMs << "x), "
+              << featuresPerKeypoint << "/" << RGBDPatchDescriptor::FEATURE_COUNT << " features evaluated per keypoint, "
+              << descriptorMegabytes << " MB descriptors image avoided, " << mismatchCount << " mismatched leaf indices\n";
+  }
+
+  return allMatched;
+}
+
+/**
+ * \brief Compares the speed of finding leaves one descriptor at a time and using the packet traversal engine, for forests of various depths.
+ *
+ * \param iterationCount  The number of times to find the leaves for each forest.
+ * \return                true, if the two approaches found exactly the same leaves for every forest, or false otherwise.
+ */
+bool benchmark_packet_traversal(int iterationCount)
+{
+  const Vector2i imgSize(640, 480);
+  const int treeDepths[] = { 8, 10, 12, 14, 16 };
+
+  std::cout << "Making " << imgSize.x << "x" << imgSize.y << " random descriptors...\n";
+  Forest_CPU::DescriptorImage_CPtr descriptors = make_random_descriptors(imgSize);
+  Forest_CPU::LeafIndicesImage_Ptr referenceLeafIndices(new Forest_CPU::LeafIndicesImage(imgSize, true, false));
+  Forest_CPU::LeafIndicesImage_Ptr packetLeafIndices(new Forest_CPU::LeafIndicesImage(imgSize, true, false));
+
+  bool allMatched = true;
+  for(size_t i = 0; i < sizeof(treeDepths) / sizeof(int); ++i)
+  {
+    // Make a random forest of the specified depth.
+    SettingsContainer_Ptr settings(new SettingsContainer);
+    settings->add_value("DecisionForest.treeDepth", boost::lexical_cast<std::string>(treeDepths[i]));
+    settings->add_value("DecisionForest.useFixedThresholds", "false");
+    boost::shared_ptr<Forest_CPU> forest = boost::dynamic_pointer_cast<Forest_CPU>(ForestFactory::make_randomly_generated_forest(settings, ORUtils::DEVICE_CPU));
+
+    // Time walking the descriptors down the trees one at a time, and then using the packet traversal engine.
+    forest->set_use_packet_traversal(false);
+    const double referenceRate = time_find_leaves(*forest, descriptors, referenceLeafIndices, iterationCount);
+
+    forest->set_use_packet_traversal(true);
+    const double packetRate = time_find_leaves(*forest, descriptors, packetLeafIndices, iterationCount);
+
+    // Check that the two sets of leaf indices match exactly.
+    const Forest_CPU::LeafIndices *referencePtr = referenceLeafIndices->GetData(MEMORYDEVICE_CPU);
+    const Forest_CPU::LeafIndices *packetPtr = packetLeafIndices->GetData(MEMORYDEVICE_CPU);
+    int mismatchCount = 0;
+    for(size_t j = 0; j < descriptors->dataSize; ++j)
+    {
+      for(int k = 0; k < Forest_CPU::TREE_COUNT; ++k)
+      {
+        if(referencePtr[j][k] != packetPtr[j][k]) ++mismatchCount;
+      }
+    }
+
+    allMatched = allMatched && mismatchCount == 0;
+
+    std::cout << "Depth " << treeDepths[i] << ": one at a time " << referenceRate << " keypoints/s, packets " << packetRate
+              << " keypoints/s (speedup " << packetRate / referenceRate << "x, " << mismatchCount << " mismatched leaf indices)\n";
+  }
+
+  return allMatched;
+}
+
+/**
+ * \brief Compares the per-keypoint mode storage used by the relocaliser (indices into the leaf predictions) with storing a copy of the merged
+ *        modes for each keypoint, in terms of memory footprint, the time taken to build the storage, and the time taken to look up the closest
+ *        mode to a point for every keypoint (as preemptive RANSAC does when scoring a pose candidate).
+ *
+ * \param iterationCount  The number of times to build and query each kind of storage.
+ * \return                true, if the two kinds of storage yielded exactly the same closest modes for every keypoint, or false otherwise.
+ */
+bool benchmark_mode_storage(int iterationCount)
+{
+  const Vector2i imgSize(160, 120);
+  const int maxClusterCount = 50;
+  const int pixelCount = imgSize.x * imgSize.y;
+
+  // Make a random forest, find the leaves for some random descriptors, and make a random prediction for each leaf.
+  SettingsContainer_Ptr settings(new SettingsContainer);
+  settings->add_value("DecisionForest.treeDepth", "12");
+  settings->add_value("DecisionForest.useFixedThresholds", "false");
+  boost::shared_ptr<Forest_CPU> forest = boost::dynamic_pointer_cast<Forest_CPU>(ForestFactory::make_randomly_generated_forest(settings, ORUtils::DEVICE_CPU));
+
+  Forest_CPU::DescriptorImage_CPtr descriptors = make_random_descriptors(imgSize);
+  Forest_CPU::LeafIndicesImage_Ptr leafIndices(new Forest_CPU::LeafIndicesImage(imgSize, true, false));
+  forest->find_leaves(descriptors, leafIndices);
+
+  ScorePredictionsMemoryBlock_CPtr predictionsBlock = make_random_predictions(static_cast<int>(forest->get_nb_leaves()), maxClusterCount);
+
+  const Forest_CPU::LeafIndices *leafIndicesPtr = leafIndices->GetData(MEMORYDEVICE_CPU);
+  const ScorePrediction *predictionsBlockPtr = predictionsBlock->GetData(MEMORYDEVICE_CPU);
+
+  // Time building the mode indices for the keypoints.
+  ScoreModeIndicesImage modeIndices(imgSize, true, false);
+  ScoreModeIndices *modeIndicesPtr = modeIndices.GetData(MEMORYDEVICE_CPU);
+
+  AverageTimer_US indicesBuildTimer("Build Indices");
+  for(int i = 0; i < iterationCount; ++i)
+  {
+    indicesBuildTimer.start_nosync();
+    for(int y = 0; y < imgSize.y; ++y)
+    {
+      for(int x = 0; x < imgSize.x; ++x)
+      {
+        merge_predictions_for_keypoint(x, y, leafIndicesPtr, predictionsBlockPtr, imgSize, maxClusterCount, modeIndicesPtr);
+      }
+    }
+    indicesBuildTimer.stop_nosync();
+  }
+
+  // Time building a copy of the merged modes for each keypoint (this is what the relocaliser used to store). Note that
+  // the merge order is the same in both cases, so we can simply copy the modes to which the indices refer, which makes
+  // this an underestimate of the true cost of copying.
+  ScorePredictionsImage copies(imgSize, true, false);
+  ScorePrediction *copiesPtr = copies.GetData(MEMORYDEVICE_CPU);
+
+  AverageTimer_US copiesBuildTimer("Build Copies");
+  for(int i = 0; i < iterationCount; ++i)
+  {
+    copiesBuildTimer.start_nosync();
+    for(int j = 0; j < pixelCount; ++j)
+    {
+      copiesPtr[j].size = modeIndicesPtr[j].size;
+      for(int k = 0; k < modeIndicesPtr[j].size; ++k)
+      {
+        copiesPtr[j].elts[k] = get_pooled_mode(predictionsBlockPtr, modeIndicesPtr[j].elts[k]);
+      }
+    }
+    copiesBuildTimer.stop_nosync();
+  }
+
+  // Make a random query point for each keypoint.
+  std::vector<Vector3f> points(pixelCount);
+  RandomNumberGenerator rng(23456);
+  for(int j = 0; j < pixelCount; ++j)
+  {
+    points[j] = Vector3f(rng.generate_real_from_uniform(-1.0f, 1.0f), rng.generate_real_from_uniform(-1.0f, 1.0f), rng.generate_real_from_uniform(-1.0f, 1.0f));
+  }
+
+  // Time finding the closest mode to the query point for each keypoint using each kind of storage, and check that the results match.
+  std::vector<int> indicesResults(pixelCount), copiesResults(pixelCount);
+
+  AverageTimer_US indicesQueryTimer("Query Indices");
+  AverageTimer_US copiesQueryTimer("Query Copies");
+  for(int i = 0; i < iterationCount; ++i)
+  {
+    indicesQueryTimer.start_nosync();
+    for(int j = 0; j < pixelCount; ++j) indicesResults[j] = find_closest_mode(points[j], modeIndicesPtr[j], predictionsBlockPtr);
+    indicesQueryTimer.stop_nosync();
+
+    copiesQueryTimer.start_nosync();
+    for(int j = 0; j < pixelCount; ++j) copiesResults[j] = find_closest_mode(points[j], copiesPtr[j]);
+    copiesQueryTimer.stop_nosync();
+  }
+
+  int mismatchCount = 0;
+  for(int j = 0; j < pixelCount; ++j)
+  {
+    if(indicesResults[j] != copiesResults[j]) ++mismatchCount;
+  }
+
+  const double indicesKilobytes = pixelCount * sizeof(ScoreModeIndices) / 1024.0;
+  const double copiesKilobytes = pixelCount * sizeof(ScorePrediction) / 1024.0;
+
+  std::cout << "Mode storage for " << pixelCount << " keypoints: indices " << indicesKilobytes << " KB, copies " << copiesKilobytes << " KB ("
+            << copiesKilobytes / indicesKilobytes << "x smaller)\n"
+            << "  build: indices " << indicesBuildTimer.average_duration().count() << " us, copies " << copiesBuildTimer.average_duration().count() << " us\n"
+            << "  query: indices " << indicesQueryTimer.average_duration().count() << " us, copies " << copiesQueryTimer.average_duration().count() << " us ("
+            << mismatchCount << " mismatched closest modes)\n";
+
+  return mismatchCount == 0;
+}
+
+int main(int argc, char *argv[])
+{
+  const int iterationCount = argc > 1 ? boost::lexical_cast<int>(argv[1]) : 10;
+
+  const bool packetTraversalMatched = benchmark_packet_traversal(iterationCount);
+  const bool lazyFeatureEvaluationMatched = benchmark_lazy_feature_evaluation(iterationCount);
+  const bool modeStorageMatched = benchmark_mode_storage(iterationCount);
+
+  return packetTraversalMatched && lazyFeatureEvaluationMatched && modeStorageMatched ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,496 @@
+/**
+ * ransacperf: main.cpp
+ * Copyright (c) Torr Vision Group, University of Oxford, 2019. All rights reserved.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/lexical_cast.hpp>
+
+#include <Eigen/Geometry>
+
+#include <grove/ransac/base/BatchKabschSolver.h>
+#include <grove/ransac/cpu/PreemptiveRansac_CPU.h>
+using namespace grove;
+
+#include <orx/geometry/GeometryUtil.h>
+using namespace orx;
+
+#include <tvgutil/numbers/RandomNumberGenerator.h>
+#include <tvgutil/timing/AverageTimer.h>
+using namespace tvgutil;
+
+//#################### TYPEDEFS ####################
+
+typedef AverageTimer<boost::chrono::microseconds> AverageTimer_US;
+
+//#################### TYPES ####################
+
+/**
+ * \brief An instance of this struct holds a synthetic frame on which to run preemptive RANSAC.
+ */
+struct SyntheticFrame
+{
+  /** The ground truth camera -> world transformation. */
+  Matrix4f cameraPose;
+
+  /** The keypoints (in camera space). */
+  Keypoint3DColourImage_CPtr keypointsImage;
+
+  /** The indices (in the mode pool) of the modes associated with each keypoint. */
+  ScoreModeIndicesImage_CPtr modeIndicesImage;
+
+  /** The mode pool (one prediction per keypoint). */
+  ScorePredictionsMemoryBlock_CPtr modePool;
+};
+
+/**
+ * \brief An instance of this class can be used to compare the ALGLIB and native pose optimisers on the inlier sets recorded
+ *        during the preemptive RANSAC iterations of a CPU-based preemptive RANSAC instance.
+ *
+ * Whenever the candidates need to be optimised, the inlier sets prepared for the candidates are optimised first using ALGLIB
+ * and then, starting from the same initial poses, using the native solver. The native results are the ones that are kept,
+ * so that preemptive RANSAC itself proceeds exactly as it would if it were only using the native solver.
+ */
+class ComparingPreemptiveRansac : public PreemptiveRansac_CPU
+{
+  //#################### PUBLIC VARIABLES ####################
+public:
+  /** The sum of the final energies reached by the ALGLIB optimiser on the recorded inlier sets. */
+  double m_alglibEnergySum;
+
+  /** The timer for the ALGLIB optimisations. */
+  AverageTimer_US m_alglibTimer;
+
+  /** The sum of the final energies reached by the native solver on the recorded inlier sets. */
+  double m_nativeEnergySum;
+
+  /** The timer for the native optimisations. */
+  AverageTimer_US m_nativeTimer;
+
+  /** The number of inlier sets on which the native solver reached a (significantly) higher energy than ALGLIB. */
+  int m_nativeWorseCount;
+
+  /** The number of recorded inlier sets. */
+  int m_recordedCount;
+
+  //#################### CONSTRUCTORS ####################
+public:
+  ComparingPreemptiveRansac(const SettingsContainer_CPtr& settings, const std::string& settingsNamespace)
+  : PreemptiveRansac_CPU(settings, settingsNamespace),
+    m_alglibEnergySum(0.0),
+    m_alglibTimer("ALGLIB"),
+    m_nativeEnergySum(0.0),
+    m_nativeTimer("Native"),
+    m_nativeWorseCount(0),
+    m_recordedCount(0)
+  {}
+
+  //#################### PROTECTED MEMBER FUNCTIONS ####################
+protected:
+  /** Override */
+  virtual void update_candidate_poses()
+  {
+    const int nbPoseCandidates = static_cast<int>(m_poseCandidates->dataSize);
+    PoseCandidate *poseCandidates = m_poseCandidates->GetData(MEMORYDEVICE_CPU);
+    const std::vector<PoseCandidate> initialCandidates(poseCandidates, poseCandidates + nbPoseCandidates);
+
+    // Optimise the candidates using ALGLIB, and record the energies they reach.
+    m_useNativePoseOptimiser = false;
+    m_alglibTimer.start_nosync();
+    PreemptiveRansac_CPU::update_candidate_poses();
+    m_alglibTimer.stop_nosync();
+
+    std::vector<double> alglibEnergies(nbPoseCandidates);
+    for(int i = 0; i < nbPoseCandidates; ++i) alglibEnergies[i] = compute_energy(i);
+
+    // Optimise the candidates again using the native solver, starting from the same initial poses.
+    std::copy(initialCandidates.begin(), initialCandidates.end(), poseCandidates);
+
+    m_useNativePoseOptimiser = true;
+    m_nativeTimer.start_nosync();
+    PreemptiveRansac_CPU::update_candidate_poses();
+    m_nativeTimer.stop_nosync();
+
+    // Compare the energies reached by the two optimisers.
+    for(int i = 0; i < nbPoseCandidates; ++i)
+    {
+      const double nativeEnergy = compute_energy(i);
+      m_alglibEnergySum += alglibEnergies[i];
+      m_nativeEnergySum += nativeEnergy;
+      if(nativeEnergy > alglibEnergies[i] * 1.01 + 1e-6) ++m_nativeWorseCount;
+      ++m_recordedCount;
+    }
+  }
+
+  //#################### PRIVATE MEMBER FUNCTIONS ####################
+private:
+  /**
+   * \brief Computes the (Mahalanobis) energy of the specified candidate's current pose on the candidate's inlier set.
+   *
+   * \param candidateIdx  The index of the candidate.
+   * \return              The energy.
+   */
+  double compute_energy(int candidateIdx) const
+  {
+    const uint32_t nbPoints = static_cast<uint32_t>(m_inlierRasterIndicesBlock->dataSize);
+    const Vector4f *cameraPoints = m_poseOptimisationCameraPoints->GetData(MEMORYDEVICE_CPU) + nbPoints * candidateIdx;
+    const Keypoint3DColourCluster *modes = m_poseOptimisationPredictedModes->GetData(MEMORYDEVICE_CPU) + nbPoints * candidateIdx;
+    const Matrix4f& cameraPose = m_poseCandidates->GetData(MEMORYDEVICE_CPU)[candidateIdx].cameraPose;
+
+    double energy = 0.0;
+    for(uint32_t i = 0; i < nbPoints; ++i)
+    {
+      if(cameraPoints[i].w == 0.0f) continue;
+      const Vector3f diff = cameraPose * cameraPoints[i].toVector3() - modes[i].position;
+      energy += dot(diff, modes[i].positionInvCovariance * diff);
+    }
+
+    return energy;
+  }
+};
+
+//#################### FUNCTIONS ####################
+
+/**
+ * \brief Makes a synthetic frame, in which the keypoints are back-projected from a random depth image and each keypoint has a single mode,
+ *        which is either (for inliers) a noisy version of the keypoint's ground truth position in world space, or (for outliers) a random
+ *        point in a room-sized volume.
+ *
+ * \param imgSize       The size of the keypoints image.
+ * \param outlierRatio  The fraction of keypoints whose modes should be outliers.
+ * \param rng           The random number generator to use.
+ * \return              The synthetic frame.
+ */
+SyntheticFrame make_synthetic_frame(const Vector2i& imgSize, float outlierRatio, RandomNumberGenerator& rng)
+{
+  const float roomSize = 4.0f;
+  const float focalLength = 525.0f * imgSize.x / 640.0f;
+  const float modeNoiseSigma = 0.02f, modeSigma = 0.03f;
+  const int pixelCount = imgSize.x * imgSize.y;
+
+  SyntheticFrame frame;
+
+  // Choose a random ground truth camera pose.
+  Eigen::Vector3f axis;
+  for(int i = 0; i < 3; ++i) axis[i] = rng.generate_from_gaussian(0.0f, 1.0f);
+  Eigen::Matrix4f cameraPose = Eigen::Matrix4f::Identity();
+  cameraPose.block<3,3>(0,0) = Eigen::AngleAxisf(rng.generate_real_from_uniform(0.0f, static_cast<float>(M_PI)), axis.normalized()).toRotationMatrix();
+  for(int i = 0; i < 3; ++i) cameraPose(i,3) = rng.generate_real_from_uniform(0.0f, roomSize);
+  Eigen::Map<Eigen::Matrix4f>(frame.cameraPose.m) = cameraPose;
+
+  // Make the keypoints and their modes.
+  Keypoint3DColourImage *keypointsImage = new Keypoint3DColourImage(imgSize, true, false);
+  ScoreModeIndicesImage *modeIndicesImage = new ScoreModeIndicesImage(imgSize, true, false);
+  ScorePredictionsMemoryBlock *modePool = new ScorePredictionsMemoryBlock(pixelCount, true, false);
+
+  Keypoint3DColour *keypoints = keypointsImage->GetData(MEMORYDEVICE_CPU);
+  ScoreModeIndices *modeIndices = modeIndicesImage->GetData(MEMORYDEVICE_CPU);
+  ScorePrediction *predictions = modePool->GetData(MEMORYDEVICE_CPU);
+
+  for(int y = 0; y < imgSize.y; ++y)
+  {
+    for(int x = 0; x < imgSize.x; ++x)
+    {
+      const int pixelIdx = y * imgSize.x + x;
+
+      Keypoint3DColour& keypoint = keypoints[pixelIdx];
+      const float depth = rng.generate_real_from_uniform(1.0f, 4.0f);
+      keypoint.position = Vector3f((x - imgSize.x / 2.0f) * depth / focalLength, (y - imgSize.y / 2.0f) * depth / focalLength, depth);
+      for(int i = 0; i < 3; ++i) keypoint.colour[i] = static_cast<unsigned char>(rng.generate_int_from_uniform(0, 255));
+      keypoint.valid = true;
+
+      Keypoint3DColourCluster& mode = predictions[pixelIdx].elts[0];
+      if(rng.generate_real_from_uniform(0.0f, 1.0f) < outlierRatio)
+      {
+        for(int i = 0; i < 3; ++i) mode.position[i] = rng.generate_real_from_uniform(0.0f, roomSize);
+      }
+      else
+      {
+        mode.position = frame.cameraPose * keypoint.position;
+        for(int i = 0; i < 3; ++i) mode.position[i] += rng.generate_from_gaussian(0.0f, modeNoiseSigma);
+      }
+
+      mode.colour = keypoint.colour;
+      mode.determinant = powf(modeSigma, 6.0f);
+      mode.nbInliers = 50;
+      mode.positionInvCovariance.setZeros();
+      for(int i = 0; i < 3; ++i) mode.positionInvCovariance.m[i * 4] = 1.0f / (modeSigma * modeSigma);
+      predictions[pixelIdx].size = 1;
+
+      modeIndices[pixelIdx].elts[0] = make_pooled_mode_index(pixelIdx, 0);
+      modeIndices[pixelIdx].size = 1;
+    }
+  }
+
+  frame.keypointsImage.reset(keypointsImage);
+  frame.modeIndicesImage.reset(modeIndicesImage);
+  frame.modePool.reset(modePool);
+  return frame;
+}
+
+/**
+ * \brief Runs preemptive RANSAC on the specified frames, and prints the time taken and the accuracy of the estimated poses.
+ *
+ * \param name      The name of the configuration being benchmarked.
+ * \param ransac    The preemptive RANSAC instance to use.
+ * \param frames    The frames.
+ * \return          The fraction of the frames for which the estimated pose was within 5cm/5 degrees of the ground truth.
+ */
+double benchmark_ransac(const std::string& name, PreemptiveRansac& ransac, const std::vector<SyntheticFrame>& frames)
+{
+  AverageTimer_US timer(name);
+  int correctCount = 0;
+  double translationErrorSum = 0.0, angularErrorSum = 0.0;
+
+  for(size_t i = 0, size = frames.size(); i < size; ++i)
+  {
+    const SyntheticFrame& frame = frames[i];
+
+    timer.start_nosync();
+    boost::optional<PoseCandidate> candidate = ransac.estimate_pose(frame.keypointsImage, frame.modeIndicesImage, frame.modePool);
+    timer.stop_nosync();
+
+    if(!candidate) continue;
+
+    const Eigen::Matrix4f estimatedPose = Eigen::Map<const Eigen::Matrix4f>(candidate->cameraPose.m);
+    const Eigen::Matrix4f groundTruthPose = Eigen::Map<const Eigen::Matrix4f>(frame.cameraPose.m);
+    const float translationError = (estimatedPose.block<3,1>(0,3) - groundTruthPose.block<3,1>(0,3)).norm();
+    const Eigen::Matrix3f relativeRotation = estimatedPose.block<3,3>(0,0).transpose() * groundTruthPose.block<3,3>(0,0);
+    const float angularError = Eigen::AngleAxisf(relativeRotation).angle() * 180.0f / static_cast<float>(M_PI);
+
+    translationErrorSum += translationError;
+    angularErrorSum += angularError;
+    if(translationError <= 0.05f && angularError <= 5.0f) ++correctCount;
+  }
+
+  const double frameCount = static_cast<double>(frames.size());
+  std::cout << name << ": " << timer.average_duration().count() / 1000.0 << "ms per frame, "
+            << correctCount << '/' << frames.size() << " poses within 5cm/5deg, mean errors "
+            << translationErrorSum / frameCount << "m/" << angularErrorSum / frameCount << "deg\n";
+
+  return correctCount / frameCount;
+}
+
+/**
+ * \brief Makes the settings for a preemptive RANSAC instance.
+ *
+ * \param poseOptimiser The pose optimiser to use.
+ * \param robustLoss    The robust loss to use (for the native pose optimiser).
+ * \return              The settings.
+ */
+SettingsContainer_Ptr make_settings(const std::string& poseOptimiser, const std::string& robustLoss)
+{
+  SettingsContainer_Ptr settings(new SettingsContainer);
+  settings->add_value("PreemptiveRansac.poseOptimiser", poseOptimiser);
+  settings->add_value("PreemptiveRansac.poseOptimisationRobustLoss", robustLoss);
+  return settings;
+}
+
+/**
+ * \brief Compares culling the pose candidates using partial selection and bound-based early termination with fully sorting them,
+ *        and prints the results. Each preemptive RANSAC instance also prints the timings of its stages when it is destroyed.
+ *
+ * \param poseUpdate  Whether or not to optimise the candidates' poses (if not, the candidates' energies can be reused across rounds).
+ * \param frames      The frames on which to run preemptive RANSAC.
+ * \return            true, if the two culling approaches yielded the same pose for every frame, or false otherwise.
+ */
+bool compare_culling(bool poseUpdate, const std::vector<SyntheticFrame>& frames)
+{
+  const float tolerance = 1e-4f;
+
+  SettingsContainer_Ptr sortingSettings = make_settings("native", "none");
+  sortingSettings->add_value("PreemptiveRansac.poseUpdate", poseUpdate ? "true" : "false");
+  sortingSettings->add_value("PreemptiveRansac.printTimers", "true");
+  sortingSettings->add_value("PreemptiveRansac.usePartialSelectionCulling", "false");
+
+  SettingsContainer_Ptr selectionSettings = make_settings("native", "none");
+  selectionSettings->add_value("PreemptiveRansac.poseUpdate", poseUpdate ? "true" : "false");
+  selectionSettings->add_value("PreemptiveRansac.printTimers", "true");
+  selectionSettings->add_value("PreemptiveRansac.usePartialSelectionCulling", "true");
+
+  PreemptiveRansac_CPU sortingRansac(sortingSettings, "PreemptiveRansac.");
+  PreemptiveRansac_CPU selectionRansac(selectionSettings, "PreemptiveRansac.");
+
+  AverageTimer_US sortingTimer("Sorting"), selectionTimer("Selection");
+  int mismatchCount = 0;
+  for(size_t i = 0, size = frames.size(); i < size; ++i)
+  {
+    const SyntheticFrame& frame = frames[i];
+
+    sortingTimer.start_nosync();
+    boost::optional<PoseCandidate> sortingCandidate = sortingRansac.estimate_pose(frame.keypointsImage, frame.modeIndicesImage, frame.modePool);
+    sortingTimer.stop_nosync();
+
+    selectionTimer.start_nosync();
+    boost::optional<PoseCandidate> selectionCandidate = selectionRansac.estimate_pose(frame.keypointsImage, frame.modeIndicesImage, frame.modePool);
+    selectionTimer.stop_nosync();
+
+    bool match = static_cast<bool>(sortingCandidate) == static_cast<bool>(selectionCandidate);
+    for(int j = 0; match && sortingCandidate && j < 16; ++j)
+    {
+      match = fabs(sortingCandidate->cameraPose.m[j] - selectionCandidate->cameraPose.m[j]) <= tolerance;
+    }
+
+    if(!match) ++mismatchCount;
+  }
+
+  std::cout << "Culling (poseUpdate = " << poseUpdate << "): sorting " << sortingTimer.average_duration().count() / 1000.0
+            << "ms per frame, partial selection " << selectionTimer.average_duration().count() / 1000.0
+            << "ms per frame, mismatched poses: " << mismatchCount << '\n';
+
+  return mismatchCount == 0;
+}
+
+/**
+ * \brief Compares estimating the poses of some random pose candidates using the batch Kabsch solver with estimating them
+ *        one at a time using the SVD-based implementation in GeometryUtil, and prints the results.
+ *
+ * \param candidateCount  The number of pose candidates to generate.
+ * \param rng             The random number generator to use.
+ * \return                true, if the two approaches yielded the same pose for every candidate, or false otherwise.
+ */
+bool compare_kabsch(int candidateCount, RandomNumberGenerator& rng)
+{
+  const float tolerance = 1e-3f;
+  const int runCount = 20;
+
+  // Make random candidates whose world points are noisy rigid transformations of their camera points.
+  std::vector<PoseCandidate> candidates(candidateCount);
+  for(int i = 0; i < candidateCount; ++i)
+  {
+    Eigen::Vector3f axis;
+    for(int j = 0; j < 3; ++j) axis[j] = rng.generate_from_gaussian(0.0f, 1.0f);
+    const Eigen::Matrix3f R = Eigen::AngleAxisf(rng.generate_real_from_uniform(0.0f, static_cast<float>(M_PI)), axis.normalized()).toRotationMatrix();
+
+    Eigen::Vector3f t;
+    for(int j = 0; j < 3; ++j) t[j] = rng.generate_real_from_uniform(0.0f, 4.0f);
+
+    for(int j = 0; j < PoseCandidate::KABSCH_CORRESPONDENCES_NEEDED; ++j)
+    {
+      Eigen::Vector3f cameraPoint(rng.generate_real_from_uniform(-1.0f, 1.0f), rng.generate_real_from_uniform(-1.0f, 1.0f), rng.generate_real_from_uniform(1.0f, 4.0f));
+      Eigen::Vector3f worldPoint = R * cameraPoint + t;
+      for(int k = 0; k < 3; ++k) worldPoint[k] += rng.generate_from_gaussian(0.0f, 0.02f);
+
+      Eigen::Map<Eigen::Vector3f>(candidates[i].pointsCamera[j].v) = cameraPoint;
+      Eigen::Map<Eigen::Vector3f>(candidates[i].pointsWorld[j].v) = worldPoint;
+    }
+  }
+
+  // Estimate the candidates' poses using both approaches.
+  std::vector<PoseCandidate> batchCandidates, svdCandidates;
+  BatchKabschSolver solver;
+  AverageTimer_US batchTimer("Batch"), svdTimer("SVD");
+  for(int run = 0; run < runCount; ++run)
+  {
+    batchCandidates = candidates;
+    batchTimer.start_nosync();
+    solver.solve(&batchCandidates[0], candidateCount);
+    batchTimer.stop_nosync();
+
+    svdCandidates = candidates;
+    svdTimer.start_nosync();
+    for(int i = 0; i < candidateCount; ++i)
+    {
+      Eigen::Matrix3f cameraPoints, worldPoints;
+      for(int j = 0; j < PoseCandidate::KABSCH_CORRESPONDENCES_NEEDED; ++j)
+      {
+        cameraPoints.col(j) = Eigen::Map<const Eigen::Vector3f>(svdCandidates[i].pointsCamera[j].v);
+        worldPoints.col(j) = Eigen::Map<const Eigen::Vector3f>(svdCandidates[i].pointsWorld[j].v);
+      }
+
+      Eigen::Map<Eigen::Matrix4f>(svdCandidates[i].cameraPose.m) = GeometryUtil::estimate_rigid_transform(cameraPoints, worldPoints);
+    }
+    svdTimer.stop_nosync();
+  }
+
+  // Compare the resulting poses.
+  int mismatchCount = 0;
+  float maxDifference = 0.0f;
+  for(int i = 0; i < candidateCount; ++i)
+  {
+    float difference = 0.0f;
+    for(int j = 0; j < 16; ++j)
+    {
+      difference = std::max(difference, fabsf(batchCandidates[i].cameraPose.m[j] - svdCandidates[i].cameraPose.m[j]));
+    }
+
+    maxDifference = std::max(maxDifference, difference);
+    if(difference > tolerance) ++mismatchCount;
+  }
+
+  std::cout << "Kabsch (" << candidateCount << " candidates): SVD " << svdTimer.average_duration().count() / 1000.0
+            << "ms per batch, batch solver " << batchTimer.average_duration().count() / 1000.0
+            << "ms per batch, max pose difference " << maxDifference << ", mismatched poses: " << mismatchCount << '\n';
+
+  return mismatchCount == 0;
+}
+
+int main(int argc, char *argv[])
+{
+  const int frameCount = argc > 1 ? boost::lexical_cast<int>(argv[1]) : 20;
+  const float outlierRatio = argc > 2 ? boost::lexical_cast<float>(argv[2]) : 0.5f;
+  const Vector2i imgSize(160, 120);
+
+  // Make the frames.
+  RandomNumberGenerator rng(12345);
+  std::vector<SyntheticFrame> frames;
+  for(int i = 0; i < frameCount; ++i)
+  {
+    frames.push_back(make_synthetic_frame(imgSize, outlierRatio, rng));
+  }
+
+  bool succeeded = true;
+
+  // Benchmark the whole of preemptive RANSAC with the available pose optimisers and robust losses.
+  std::cout << "Running preemptive RANSAC on " << frameCount << " frames (outlier ratio " << outlierRatio << ")\n";
+
+  const std::string robustLosses[] = { "none", "huber", "cauchy" };
+  for(size_t i = 0; i < sizeof(robustLosses) / sizeof(std::string); ++i)
+  {
+    PreemptiveRansac_CPU ransac(make_settings("native", robustLosses[i]), "PreemptiveRansac.");
+    benchmark_ransac("Native (" + robustLosses[i] + ")", ransac, frames);
+  }
+
+  // Compare the two approaches to culling the candidates.
+  std::cout << '\n';
+  succeeded = compare_culling(false, frames) && succeeded;
+  succeeded = compare_culling(true, frames) && succeeded;
+
+  // Compare the batch Kabsch solver with the SVD-based implementation.
+  std::cout << '\n';
+  succeeded = compare_kabsch(1024, rng) && succeeded;
+
+#ifdef WITH_ALGLIB
+  std::cout << '\n';
+  {
+    PreemptiveRansac_CPU ransac(make_settings("alglib", "none"), "PreemptiveRansac.");
+    benchmark_ransac("ALGLIB", ransac, frames);
+  }
+
+  // Compare the two pose optimisers on the inlier sets recorded during preemptive RANSAC.
+  ComparingPreemptiveRansac comparingRansac(make_settings("native", "none"), "PreemptiveRansac.");
+  for(size_t i = 0, size = frames.size(); i < size; ++i)
+  {
+    comparingRansac.estimate_pose(frames[i].keypointsImage, frames[i].modeIndicesImage, frames[i].modePool);
+  }
+
+  const double recordedCount = static_cast<double>(comparingRansac.m_recordedCount);
+  std::cout << "\nOptimised " << comparingRansac.m_recordedCount << " recorded inlier sets"
+            << ": ALGLIB " << comparingRansac.m_alglibTimer.average_duration().count() / 1000.0 << "ms per batch, mean energy " << comparingRansac.m_alglibEnergySum / recordedCount
+            << "; native " << comparingRansac.m_nativeTimer.average_duration().count() / 1000.0 << "ms per batch, mean energy " << comparingRansac.m_nativeEnergySum / recordedCount
+            << "; native worse on " << comparingRansac.m_nativeWorseCount << " sets\n";
+
+  // The native solver should converge at least as well as ALGLIB on the vast majority of the inlier sets.
+  if(comparingRansac.m_nativeWorseCount > 0.05 * recordedCount) succeeded = false;
+#else
+  std::cout << "\nALGLIB is not available, so the native pose optimiser cannot be compared to it.\n";
+#endif
+
+  return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
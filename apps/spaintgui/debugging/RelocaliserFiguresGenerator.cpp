@@ -300,7 +300,15 @@ void RelocaliserFiguresGenerator::show_ransac_correspondences(const Model_Ptr& m
       ptCamera[i] = project(candidate.pointsCamera[i], depthIntrinsics);
       ptCameraInt[i] = ptCamera[i].toInt();
       linearIdxDownsampled[i] = (view->depth->noDims.width / 4) * (ptCameraInt[i].y / 4) + ptCameraInt[i].x / 4;
-      predictions[i] = scoreRelocaliser->get_predictions_image()->GetData(MEMORYDEVICE_CPU)[linearIdxDownsampled[i]];
+
+      // Gather the modes associated with the keypoint from the relocaliser's mode pool.
+      const ScoreModeIndices& modeIndices = scoreRelocaliser->get_mode_indices_image()->GetData(MEMORYDEVICE_CPU)[linearIdxDownsampled[i]];
+      const ScorePrediction *modePool = scoreRelocaliser->get_mode_pool()->GetData(MEMORYDEVICE_CPU);
+      predictions[i].size = modeIndices.size;
+      for(int modeIdx = 0; modeIdx < modeIndices.size; ++modeIdx)
+      {
+        predictions[i].elts[modeIdx] = get_pooled_mode(modePool, modeIndices.elts[modeIdx]);
+      }
     }
 
     for (int i = 0; i < 3; ++i)
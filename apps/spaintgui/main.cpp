@@ -54,6 +54,7 @@
 #include <orx/geometry/GeometryUtil.h>
 
 #include <tvgutil/filesystem/PathFinder.h>
+#include <tvgutil/misc/TaskScheduler.h>
 
 #include "core/CollaborativePipeline.h"
 #include "core/ObjectivePipeline.h"
@@ -839,6 +840,9 @@ try
   // Pass the device type to the memory block factory.
   MemoryBlockFactory::instance().set_device_type(settings->deviceType);
 
+  // Configure the global task scheduler (this must be done before anything uses it).
+  TaskScheduler::initialise(settings->get_first_value<size_t>("TaskScheduler.threadCount", 0), settings->get_values<int>("TaskScheduler.cpuAffinities"));
+
   // Run a remote mapping server if requested.
   MappingServer_Ptr mappingServer;
   if(args.runServer)
@@ -959,7 +963,9 @@ try
   {
     std::cout << "Setting mapping client for host '" << args.host << "' and port '" << args.port << "'\n";
     const pooled_queue::PoolEmptyStrategy poolEmptyStrategy = settings->get_first_value<pooled_queue::PoolEmptyStrategy>("MappingClient.poolEmptyStrategy", pooled_queue::PES_DISCARD);
-    pipeline->set_mapping_client(Model::get_world_scene_id(), MappingClient_Ptr(new MappingClient(args.host, args.port, poolEmptyStrategy)));
+    const size_t frameWindowSize = settings->get_first_value<size_t>("MappingClient.frameWindowSize", 4);
+    const bool useLockFreeQueue = settings->get_first_value<bool>("MappingClient.useLockFreeQueue", false);
+    pipeline->set_mapping_client(Model::get_world_scene_id(), MappingClient_Ptr(new MappingClient(args.host, args.port, poolEmptyStrategy, frameWindowSize, useLockFreeQueue)));
   }
 
 #ifdef WITH_LEAP
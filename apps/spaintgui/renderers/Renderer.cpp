@@ -268,29 +268,34 @@ void Renderer::render_client_images() const
     const boost::optional<RenderingRequestMessage> request = mappingServer->get_rendering_request(clients[i]);
     if(!request) continue;
 
-    // Get a handle to the image into which to write.
-    ExclusiveHandle_Ptr<ORUChar4Image_Ptr>::Type imageHandle = mappingServer->get_rendered_image(clients[i]);
-    if(!imageHandle) continue;
-
-    // Make sure the image exists and is of the right size to store the response to the request.
-    ORUChar4Image_Ptr& image = imageHandle->get();
-    if(!image) image.reset(new ORUChar4Image(request->extract_image_size(), true, true));
-    image->ChangeDims(request->extract_image_size());
-
-    // Render the requested image for the client.
-    // FIXME: The camera intrinsics shouldn't be hard-coded.
-    // FIXME: The render states should be cached unless the size changes.
-    std::string primarySceneID = mappingServer->get_scene_id(clients[i]);
-    if(primarySceneID == "") primarySceneID = Model::get_world_scene_id();
-    ITMIntrinsics intrinsics(image->noDims);
-    VoxelRenderState_Ptr voxelRenderState;
-    SurfelRenderState_Ptr surfelRenderState;
-    const bool surfelFlag = false;
-
-    render_all_reconstructed_scenes(
-      request->extract_pose(), primarySceneID, static_cast<VisualisationGenerator::VisualisationType>(request->extract_visualisation_type()),
-      voxelRenderState, surfelRenderState, intrinsics, surfelFlag, image
-    );
+    {
+      // Get a handle to the image into which to write.
+      ExclusiveHandle_Ptr<ORUChar4Image_Ptr>::Type imageHandle = mappingServer->get_rendered_image(clients[i]);
+      if(!imageHandle) continue;
+
+      // Make sure the image exists and is of the right size to store the response to the request.
+      ORUChar4Image_Ptr& image = imageHandle->get();
+      if(!image) image.reset(new ORUChar4Image(request->extract_image_size(), true, true));
+      image->ChangeDims(request->extract_image_size());
+
+      // Render the requested image for the client.
+      // FIXME: The camera intrinsics shouldn't be hard-coded.
+      // FIXME: The render states should be cached unless the size changes.
+      std::string primarySceneID = mappingServer->get_scene_id(clients[i]);
+      if(primarySceneID == "") primarySceneID = Model::get_world_scene_id();
+      ITMIntrinsics intrinsics(image->noDims);
+      VoxelRenderState_Ptr voxelRenderState;
+      SurfelRenderState_Ptr surfelRenderState;
+      const bool surfelFlag = false;
+
+      render_all_reconstructed_scenes(
+        request->extract_pose(), primarySceneID, static_cast<VisualisationGenerator::VisualisationType>(request->extract_visualisation_type()),
+        voxelRenderState, surfelRenderState, intrinsics, surfelFlag, image
+      );
+    }
+
+    // Now that the image has been rendered (and we've released our handle to it), let the server know that it can be pushed across to the client.
+    mappingServer->notify_rendered_image(clients[i]);
   }
 }
 
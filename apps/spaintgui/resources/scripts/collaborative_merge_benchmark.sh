@@ -0,0 +1,22 @@
+#! /usr/bin/env bash
+
+# Replays two recorded sub-maps through the collaborative pipeline in batch mode with increasing numbers of relocalisation
+# workers (see CollaborativeComponent), stopping at the first consistent reconstruction, so that the time-to-first-merge
+# printed for each run can be compared. For a CPU-only benchmark, build with WITH_CUDA turned off. The second set of runs
+# uses live collaboration with adaptive scheduling, in which relocalisations are scheduled whenever a worker is free.
+
+set -e
+
+seq_a='heads'
+seq_b='office'
+
+for mode in batch live; do
+  for workers in 1 2 4; do
+    config_file=$(mktemp --suffix=.ini)
+    printf '[CollaborativeComponent]\nadaptiveScheduling = %s\nrelocalisationWorkerCount = %s\nstopAtFirstConsistentReconstruction = true\ntimeCollaboration = true\n' \
+      "$([ "$mode" = live ] && echo true || echo false)" "$workers" > "$config_file"
+    echo "Mode: $mode, Workers: $workers"
+    ../../spaintgui -s "$seq_a" "$seq_b" --pipelineType collaborative --collaborationMode "$mode" --headless -f "$config_file" | grep -E 'consistent|collaborating'
+    rm "$config_file"
+  done
+done
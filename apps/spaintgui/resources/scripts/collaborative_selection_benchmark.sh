@@ -0,0 +1,19 @@
+#! /usr/bin/env bash
+
+# Replays pairs of recorded sub-maps through the collaborative pipeline in batch mode, first with random candidate selection
+# and then with informed candidate selection (see CollaborativeCandidateSampler), stopping at the first consistent reconstruction,
+# so that the number of relocalisation attempts needed to merge the sub-maps (and per verified relocalisation) can be compared.
+
+set -e
+
+pairs='heads:office chess:fire pumpkin:redkitchen'
+
+for pair in $pairs; do
+  for informed in false true; do
+    config_file=$(mktemp --suffix=.ini)
+    printf '[CollaborativeComponent]\ninformedCandidateSelection = %s\nstopAtFirstConsistentReconstruction = true\ntimeCollaboration = true\n' "$informed" > "$config_file"
+    echo "Sequences: ${pair%%:*} ${pair##*:}, Informed: $informed"
+    ../../spaintgui -s "${pair%%:*}" "${pair##*:}" --pipelineType collaborative --collaborationMode batch --headless -f "$config_file" | grep -E 'consistent|attempts'
+    rm "$config_file"
+  done
+done
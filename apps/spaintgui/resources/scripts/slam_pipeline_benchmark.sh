@@ -0,0 +1,20 @@
+#! /usr/bin/env bash
+
+# Replays a disk sequence through the SLAM pipeline in batch mode, first serially and then pipelined (see SLAMComponent),
+# so that the per-stage latencies and throughputs printed on exit can be compared. For a CPU-only benchmark, build with
+# WITH_CUDA turned off.
+
+set -e
+
+seq='heads'
+dataset_root='/media/data/7scenes'
+depth_mask='frame-%06d.depth.png'
+color_mask='frame-%06d.color.png'
+pose_mask='frame-%06d.pose.txt'
+
+for pipelined in false true; do
+  config_file=$(mktemp --suffix=.ini)
+  printf '[SLAMComponent]\npipelined = %s\ntimersEnabled = true\n' "$pipelined" > "$config_file"
+  time ../../spaintgui -c "$dataset_root/calib.txt" -d "$dataset_root/$seq/train/$depth_mask" -r "$dataset_root/$seq/train/$color_mask" -p "$dataset_root/$seq/train/$pose_mask" -t Disk --pipelineType slam --batch --noRelocaliser -f "$config_file"
+  rm "$config_file"
+done
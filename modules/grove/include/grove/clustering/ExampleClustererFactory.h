@@ -34,11 +34,15 @@ struct ExampleClustererFactory
    *                         but only the maxClusterCount largest ones are returned). Must be <= MaxClusters.
    * \param minClusterSize   The minimum size of cluster to keep.
    * \param deviceType       The device on which the example clusterer should operate.
+   * \param useGrid          Whether or not to accelerate the clustering with a uniform spatial grid (only supported on the CPU,
+   *                         and only for example types that have a 3D position).
    * \return                 The example clusterer.
    *
    * \throws std::invalid_argument If maxClusterCount > MaxClusters.
+   * \throws std::runtime_error     If useGrid is true and the example clusterer should operate on the GPU.
    */
-  static Clusterer_Ptr make_clusterer(float sigma, float tau, uint32_t maxClusterCount, uint32_t minClusterSize, ORUtils::DeviceType deviceType);
+  static Clusterer_Ptr make_clusterer(float sigma, float tau, uint32_t maxClusterCount, uint32_t minClusterSize, ORUtils::DeviceType deviceType,
+                                      bool useGrid = false);
 };
 
 }
@@ -6,6 +6,7 @@
 #include "ExampleClustererFactory.h"
 
 #include "cpu/ExampleClusterer_CPU.h"
+#include "cpu/GridExampleClusterer_CPU.h"
 
 #ifdef WITH_CUDA
 #include "cuda/ExampleClusterer_CUDA.h"
@@ -18,19 +19,25 @@ namespace grove {
 template <typename ExampleType, typename ClusterType, int MaxClusters>
 typename ExampleClustererFactory<ExampleType,ClusterType,MaxClusters>::Clusterer_Ptr
 ExampleClustererFactory<ExampleType,ClusterType,MaxClusters>::make_clusterer(
-  float sigma, float tau, uint32_t maxClusterCount, uint32_t minClusterSize, ORUtils::DeviceType deviceType
+  float sigma, float tau, uint32_t maxClusterCount, uint32_t minClusterSize, ORUtils::DeviceType deviceType, bool useGrid
 )
 {
   Clusterer_Ptr clusterer;
 
   if(deviceType == ORUtils::DEVICE_CUDA)
   {
+    if(useGrid) throw std::runtime_error("Error: Grid-accelerated clustering is currently only supported on the CPU.");
+
 #ifdef WITH_CUDA
     clusterer.reset(new ExampleClusterer_CUDA<ExampleType,ClusterType,MaxClusters>(sigma, tau, maxClusterCount, minClusterSize));
 #else
     throw std::runtime_error("Error: CUDA support not currently available. Reconfigure in CMake with the WITH_CUDA option set to on.");
 #endif
   }
+  else if(useGrid)
+  {
+    clusterer.reset(new GridExampleClusterer_CPU<ExampleType,ClusterType,MaxClusters>(sigma, tau, maxClusterCount, minClusterSize));
+  }
   else
   {
     clusterer.reset(new ExampleClusterer_CPU<ExampleType,ClusterType,MaxClusters>(sigma, tau, maxClusterCount, minClusterSize));
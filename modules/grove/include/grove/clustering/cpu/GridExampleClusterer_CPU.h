@@ -0,0 +1,111 @@
+/**
+ * grove: GridExampleClusterer_CPU.h
+ * Copyright (c) Torr Vision Group, University of Oxford, 2019. All rights reserved.
+ */
+
+#ifndef H_GROVE_GRIDEXAMPLECLUSTERER_CPU
+#define H_GROVE_GRIDEXAMPLECLUSTERER_CPU
+
+#include <vector>
+
+#include "ExampleClusterer_CPU.h"
+
+namespace grove {
+
+/**
+ * \brief An instance of this class can be used to cluster sets of examples using the CPU, with the help of a uniform spatial grid.
+ *
+ * The default CPU clusterer computes the density and parent of each example by comparing it against every other example in its set,
+ * which is quadratic in the reservoir capacity. This clusterer instead bins the examples in each set into a uniform 3D hash grid
+ * whose cells are large enough to contain both the density support (3 * sigma) and the linking radius (tau), and then only compares
+ * each example against the examples in its own cell and the 26 cells around it. The two clusterers consider exactly the same pairs
+ * of examples, so the clusters they produce are the same up to the order in which the density contributions are summed.
+ *
+ * \note ExampleType must have a Vector3f position member, and distance_squared must be the squared Euclidean distance between
+ *       the positions of the examples (this is the case for Keypoint3DColour).
+ *
+ * \param ExampleType  The type of example to cluster.
+ * \param ClusterType  The type of cluster being generated.
+ * \param MaxClusters  The maximum number of clusters being generated for each set of examples.
+ */
+template <typename ExampleType, typename ClusterType, int MaxClusters>
+class GridExampleClusterer_CPU : public ExampleClusterer_CPU<ExampleType,ClusterType,MaxClusters>
+{
+  //#################### TYPEDEFS AND USINGS ####################
+public:
+  typedef ExampleClusterer_CPU<ExampleType,ClusterType,MaxClusters> Base;
+
+  //#################### PRIVATE VARIABLES ####################
+private:
+  /** The number of hash buckets used for each example set (a power of two). */
+  uint32_t m_bucketCount;
+
+  /**
+   * The bucket offsets for each example set (m_bucketCount + 2 entries per set). After the grid has been built, the examples
+   * in bucket b of a set are those whose indices are stored in [m_bucketOffsets[b], m_bucketOffsets[b+1]) of its sorted examples.
+   */
+  std::vector<int> m_bucketOffsets;
+
+  /** The side length of each grid cell. */
+  float m_cellSize;
+
+  /** The grid cell containing each example (one example set per row). */
+  std::vector<Vector3i> m_exampleCells;
+
+  /** The indices of the examples in each set, sorted by hash bucket (and by example index within each bucket). */
+  std::vector<int> m_sortedExampleIndices;
+
+  //#################### CONSTRUCTORS ####################
+public:
+  /**
+   * \brief Constructs a grid-accelerated CPU-based example clusterer.
+   *
+   * \param sigma            The sigma of the Gaussian used when computing the example densities.
+   * \param tau              The maximum distance there can be between two examples that are part of the same cluster.
+   * \param maxClusterCount  The maximum number of clusters retained for each set of examples (all clusters are estimated
+   *                         but only the maxClusterCount largest ones are returned). Must be <= MaxClusters.
+   * \param minClusterSize   The minimum size of cluster to keep.
+   *
+   * \throws std::invalid_argument If maxClusterCount > MaxClusters.
+   */
+  GridExampleClusterer_CPU(float sigma, float tau, uint32_t maxClusterCount, uint32_t minClusterSize);
+
+  //#################### PRIVATE MEMBER FUNCTIONS ####################
+private:
+  /**
+   * \brief Bins the valid examples in the specified example set into the set's hash grid.
+   *
+   * \param exampleSetIdx       The index of the example set.
+   * \param exampleSets         An image containing the sets of examples to be clustered (one set per row).
+   * \param exampleSetSizes     The number of valid examples in each example set.
+   * \param exampleSetCapacity  The maximum size of each example set.
+   */
+  void build_grid(int exampleSetIdx, const ExampleType *exampleSets, const int *exampleSetSizes, uint32_t exampleSetCapacity);
+
+  /**
+   * \brief Computes the hash bucket associated with the specified grid cell.
+   *
+   * \param cell  The grid cell.
+   * \return      The index of the hash bucket to which the cell belongs.
+   */
+  uint32_t compute_bucket(const Vector3i& cell) const;
+
+  /**
+   * \brief Computes the grid cell containing the specified example.
+   *
+   * \param example The example.
+   * \return        The grid cell containing the example.
+   */
+  Vector3i compute_cell(const ExampleType& example) const;
+
+  /** Override */
+  virtual void compute_densities(const ExampleType *exampleSets, const int *exampleSetSizes, uint32_t exampleSetCapacity, uint32_t exampleSetCount);
+
+  /** Override */
+  virtual void compute_parents(const ExampleType *exampleSets, const int *exampleSetSizes, uint32_t exampleSetCapacity,
+                               uint32_t exampleSetCount, float tauSq);
+};
+
+}
+
+#endif
@@ -0,0 +1,222 @@
+/**
+ * grove: GridExampleClusterer_CPU.tpp
+ * Copyright (c) Torr Vision Group, University of Oxford, 2019. All rights reserved.
+ */
+
+#include "GridExampleClusterer_CPU.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace grove {
+
+//#################### CONSTRUCTORS ####################
+
+template <typename ExampleType, typename ClusterType, int MaxClusters>
+GridExampleClusterer_CPU<ExampleType,ClusterType,MaxClusters>::GridExampleClusterer_CPU(float sigma, float tau, uint32_t maxClusterCount, uint32_t minClusterSize)
+: ExampleClusterer_CPU<ExampleType,ClusterType,MaxClusters>(sigma, tau, maxClusterCount, minClusterSize),
+  m_bucketCount(0),
+  m_cellSize(std::max(3.0f * sigma, tau))
+{}
+
+//#################### PRIVATE MEMBER FUNCTIONS ####################
+
+template <typename ExampleType, typename ClusterType, int MaxClusters>
+void GridExampleClusterer_CPU<ExampleType,ClusterType,MaxClusters>::build_grid(int exampleSetIdx, const ExampleType *exampleSets,
+                                                                              const int *exampleSetSizes, uint32_t exampleSetCapacity)
+{
+  const int exampleSetOffset = exampleSetIdx * exampleSetCapacity;
+  const int exampleSetSize = exampleSetSizes[exampleSetIdx];
+
+  int *bucketOffsets = &m_bucketOffsets[exampleSetIdx * (m_bucketCount + 2)];
+  Vector3i *exampleCells = &m_exampleCells[exampleSetOffset];
+  int *sortedExampleIndices = &m_sortedExampleIndices[exampleSetOffset];
+
+  // Count the examples in each bucket, storing the count for bucket b in bucketOffsets[b+2].
+  std::fill(bucketOffsets, bucketOffsets + m_bucketCount + 2, 0);
+  for(int exampleIdx = 0; exampleIdx < exampleSetSize; ++exampleIdx)
+  {
+    exampleCells[exampleIdx] = compute_cell(exampleSets[exampleSetOffset + exampleIdx]);
+    ++bucketOffsets[compute_bucket(exampleCells[exampleIdx]) + 2];
+  }
+
+  // Accumulate the counts, so that bucketOffsets[b+1] holds the offset at which bucket b starts.
+  for(uint32_t i = 2; i < m_bucketCount + 2; ++i)
+  {
+    bucketOffsets[i] += bucketOffsets[i - 1];
+  }
+
+  // Scatter the example indices into their buckets, using bucketOffsets[b+1] as the insertion point for bucket b.
+  // Once this is done, bucketOffsets[b+1] holds the offset at which bucket b ends, and bucketOffsets[b] the offset at which it starts.
+  for(int exampleIdx = 0; exampleIdx < exampleSetSize; ++exampleIdx)
+  {
+    sortedExampleIndices[bucketOffsets[compute_bucket(exampleCells[exampleIdx]) + 1]++] = exampleIdx;
+  }
+}
+
+template <typename ExampleType, typename ClusterType, int MaxClusters>
+uint32_t GridExampleClusterer_CPU<ExampleType,ClusterType,MaxClusters>::compute_bucket(const Vector3i& cell) const
+{
+  // Note: This is the spatial hash function of Teschner et al., as also used by InfiniTAM for its voxel blocks.
+  return ((static_cast<uint32_t>(cell.x) * 73856093u) ^ (static_cast<uint32_t>(cell.y) * 19349669u) ^ (static_cast<uint32_t>(cell.z) * 83492791u)) & (m_bucketCount - 1);
+}
+
+template <typename ExampleType, typename ClusterType, int MaxClusters>
+Vector3i GridExampleClusterer_CPU<ExampleType,ClusterType,MaxClusters>::compute_cell(const ExampleType& example) const
+{
+  return Vector3i(
+    static_cast<int>(floorf(example.position.x / m_cellSize)),
+    static_cast<int>(floorf(example.position.y / m_cellSize)),
+    static_cast<int>(floorf(example.position.z / m_cellSize))
+  );
+}
+
+template <typename ExampleType, typename ClusterType, int MaxClusters>
+void GridExampleClusterer_CPU<ExampleType,ClusterType,MaxClusters>::compute_densities(const ExampleType *exampleSets, const int *exampleSetSizes,
+                                                                                      uint32_t exampleSetCapacity, uint32_t exampleSetCount)
+{
+  float *densities = this->m_densities->GetData(MEMORYDEVICE_CPU);
+
+  // Use at least twice as many buckets as there can be examples in a set, to keep the number of collisions low.
+  m_bucketCount = 1;
+  while(m_bucketCount < 2 * exampleSetCapacity) m_bucketCount <<= 1;
+
+  // Make sure that the grid storage is large enough for the example sets. The grids built here are
+  // reused by compute_parents, which cluster_examples always calls next on the same example sets.
+  m_bucketOffsets.resize(exampleSetCount * (m_bucketCount + 2));
+  m_exampleCells.resize(exampleSetCount * exampleSetCapacity);
+  m_sortedExampleIndices.resize(exampleSetCount * exampleSetCapacity);
+
+  const float threeSigmaSq = (3.0f * this->m_sigma) * (3.0f * this->m_sigma);
+  const float minusOneOverTwoSigmaSq = -1.0f / (2.0f * this->m_sigma * this->m_sigma);
+
+#ifdef WITH_OPENMP
+  #pragma omp parallel for
+#endif
+  for(int exampleSetIdx = 0; exampleSetIdx < static_cast<int>(exampleSetCount); ++exampleSetIdx)
+  {
+    build_grid(exampleSetIdx, exampleSets, exampleSetSizes, exampleSetCapacity);
+
+    const int exampleSetOffset = exampleSetIdx * exampleSetCapacity;
+    const int exampleSetSize = exampleSetSizes[exampleSetIdx];
+    const int *bucketOffsets = &m_bucketOffsets[exampleSetIdx * (m_bucketCount + 2)];
+    const Vector3i *exampleCells = &m_exampleCells[exampleSetOffset];
+    const int *sortedExampleIndices = &m_sortedExampleIndices[exampleSetOffset];
+
+    for(uint32_t exampleIdx = 0; exampleIdx < exampleSetCapacity; ++exampleIdx)
+    {
+      float density = 0.0f;
+
+      // As in compute_density, only valid examples have a density, and only the examples within 3 * sigma contribute to it.
+      // Since the cells are at least 3 * sigma wide, all such examples lie in the 3x3x3 block of cells around the example.
+      if(static_cast<int>(exampleIdx) < exampleSetSize)
+      {
+        const ExampleType& centreExample = exampleSets[exampleSetOffset + exampleIdx];
+        const Vector3i& centreCell = exampleCells[exampleIdx];
+
+        for(int dz = -1; dz <= 1; ++dz)
+        {
+          for(int dy = -1; dy <= 1; ++dy)
+          {
+            for(int dx = -1; dx <= 1; ++dx)
+            {
+              const Vector3i cell(centreCell.x + dx, centreCell.y + dy, centreCell.z + dz);
+              const uint32_t bucket = compute_bucket(cell);
+              for(int j = bucketOffsets[bucket], end = bucketOffsets[bucket + 1]; j < end; ++j)
+              {
+                // Skip any examples that share the bucket but belong to a different cell.
+                const int otherIdx = sortedExampleIndices[j];
+                if(exampleCells[otherIdx] != cell) continue;
+
+                const float normSq = distance_squared(centreExample, exampleSets[exampleSetOffset + otherIdx]);
+                if(normSq < threeSigmaSq)
+                {
+                  density += expf(normSq * minusOneOverTwoSigmaSq);
+                }
+              }
+            }
+          }
+        }
+      }
+
+      densities[exampleSetOffset + exampleIdx] = density;
+    }
+  }
+}
+
+template <typename ExampleType, typename ClusterType, int MaxClusters>
+void GridExampleClusterer_CPU<ExampleType,ClusterType,MaxClusters>::compute_parents(const ExampleType *exampleSets, const int *exampleSetSizes,
+                                                                                    uint32_t exampleSetCapacity, uint32_t exampleSetCount, float tauSq)
+{
+  int *clusterIndices = this->m_clusterIndices->GetData(MEMORYDEVICE_CPU);
+  const float *densities = this->m_densities->GetData(MEMORYDEVICE_CPU);
+  int *nbClustersPerExampleSet = this->m_nbClustersPerExampleSet->GetData(MEMORYDEVICE_CPU);
+  int *parents = this->m_parents->GetData(MEMORYDEVICE_CPU);
+
+#ifdef WITH_OPENMP
+  #pragma omp parallel for
+#endif
+  for(int exampleSetIdx = 0; exampleSetIdx < static_cast<int>(exampleSetCount); ++exampleSetIdx)
+  {
+    const int exampleSetOffset = exampleSetIdx * exampleSetCapacity;
+    const int exampleSetSize = exampleSetSizes[exampleSetIdx];
+    const int *bucketOffsets = &m_bucketOffsets[exampleSetIdx * (m_bucketCount + 2)];
+    const Vector3i *exampleCells = &m_exampleCells[exampleSetOffset];
+    const int *sortedExampleIndices = &m_sortedExampleIndices[exampleSetOffset];
+
+    for(uint32_t exampleIdx = 0; exampleIdx < exampleSetCapacity; ++exampleIdx)
+    {
+      // As in compute_parent, each example starts as its own parent, and only subtree roots get a cluster index.
+      int parentIdx = exampleIdx;
+      int clusterIdx = -1;
+
+      if(static_cast<int>(exampleIdx) < exampleSetSize)
+      {
+        const ExampleType& centreExample = exampleSets[exampleSetOffset + exampleIdx];
+        const float centreDensity = densities[exampleSetOffset + exampleIdx];
+        const Vector3i& centreCell = exampleCells[exampleIdx];
+        float minDistanceSq = tauSq;
+
+        // Look for the closest example with a higher density within tau of the example. Since the cells are at least tau wide,
+        // it must lie in the 3x3x3 block of cells around the example. The cells are not visited in example order, so ties are
+        // explicitly broken in favour of the lowest example index, which is the example compute_parent would have picked.
+        for(int dz = -1; dz <= 1; ++dz)
+        {
+          for(int dy = -1; dy <= 1; ++dy)
+          {
+            for(int dx = -1; dx <= 1; ++dx)
+            {
+              const Vector3i cell(centreCell.x + dx, centreCell.y + dy, centreCell.z + dz);
+              const uint32_t bucket = compute_bucket(cell);
+              for(int j = bucketOffsets[bucket], end = bucketOffsets[bucket + 1]; j < end; ++j)
+              {
+                const int otherIdx = sortedExampleIndices[j];
+                if(otherIdx == static_cast<int>(exampleIdx) || exampleCells[otherIdx] != cell) continue;
+                if(densities[exampleSetOffset + otherIdx] <= centreDensity) continue;
+
+                const float otherDistSq = distance_squared(centreExample, exampleSets[exampleSetOffset + otherIdx]);
+                if(otherDistSq < minDistanceSq || (otherDistSq == minDistanceSq && parentIdx != static_cast<int>(exampleIdx) && otherIdx < parentIdx))
+                {
+                  minDistanceSq = otherDistSq;
+                  parentIdx = otherIdx;
+                }
+              }
+            }
+          }
+        }
+
+        // If the example is a subtree root, give it the next cluster index for its set. Each set is
+        // processed by a single thread, so unlike in compute_parent there is no need for an atomic.
+        if(parentIdx == static_cast<int>(exampleIdx))
+        {
+          clusterIdx = nbClustersPerExampleSet[exampleSetIdx]++;
+        }
+      }
+
+      parents[exampleSetOffset + exampleIdx] = parentIdx;
+      clusterIndices[exampleSetOffset + exampleIdx] = clusterIdx;
+    }
+  }
+}
+
+}
@@ -6,6 +6,8 @@
 #ifndef H_GROVE_RGBDPATCHFEATURECALCULATOR_CPU
 #define H_GROVE_RGBDPATCHFEATURECALCULATOR_CPU
 
+#include <vector>
+
 #include "../interface/RGBDPatchFeatureCalculator.h"
 
 namespace grove {
@@ -30,6 +32,89 @@ public:
   using typename Base::DescriptorsImage;
   using typename Base::KeypointsImage;
 
+  //#################### NESTED TYPES ####################
+public:
+  /**
+   * \brief An instance of this class can be used to evaluate individual features of the descriptors for an RGBD image on demand.
+   *
+   * This makes it possible to evaluate only those features that are actually needed (e.g. the ones tested by the split nodes
+   * that a descriptor visits in a decision forest), rather than computing every descriptor in full. Each feature evaluated
+   * has exactly the same value as the corresponding feature computed by compute_keypoints_and_features.
+   */
+  class FeatureEvaluator
+  {
+    //~~~~~~~~~~~~~~~~~~~~ PRIVATE VARIABLES ~~~~~~~~~~~~~~~~~~~~
+  private:
+    /** The calculator whose features are being evaluated. */
+    const RGBDPatchFeatureCalculator_CPU *m_calculator;
+
+    /** The offsets used to sample the depth values used in the depth features. */
+    const Vector4i *m_depthOffsets;
+
+    /** The ratio by which to scale the depth offsets to account for the size of the depth image. */
+    Vector2f m_depthOffsetRatio;
+
+    /** A pointer to the depth image (if available), or NULL otherwise. */
+    const float *m_depths;
+
+    /** The size of the depth image. */
+    Vector2i m_depthSize;
+
+    /** A pointer to the keypoints image. */
+    const KeypointType *m_keypoints;
+
+    /** A pointer to the colour image (if available), or NULL otherwise. */
+    const Vector4u *m_rgb;
+
+    /** The colour channels associated with the colour features. */
+    const uchar *m_rgbChannels;
+
+    /** The offsets used to sample the colour pixels used in the colour features. */
+    const Vector4i *m_rgbOffsets;
+
+    /** The ratio by which to scale the colour offsets to account for the size of the colour image. */
+    Vector2f m_rgbOffsetRatio;
+
+    /** The size of the colour image. */
+    Vector2i m_rgbSize;
+
+    /** The coordinates of the pixel in the depth image corresponding to each keypoint (precomputed, since every feature needs them). */
+    std::vector<Vector2i> m_xyDepths;
+
+    /** The coordinates of the pixel in the colour image corresponding to each keypoint (precomputed, since every feature needs them). */
+    std::vector<Vector2i> m_xyRgbs;
+
+    //~~~~~~~~~~~~~~~~~~~~ CONSTRUCTORS ~~~~~~~~~~~~~~~~~~~~
+  public:
+    /**
+     * \brief Constructs a feature evaluator.
+     *
+     * \pre   The keypoints for the RGBD image must already have been computed (see compute_keypoints).
+     * \note  The evaluator refers to the images rather than copying them, so they must outlive it.
+     *
+     * \param calculator      The calculator whose features are to be evaluated.
+     * \param rgbImage        The colour image.
+     * \param depthImage      The depth image.
+     * \param keypointsImage  The image containing the keypoints for the RGBD image.
+     */
+    FeatureEvaluator(const RGBDPatchFeatureCalculator_CPU& calculator, const ORUChar4Image *rgbImage, const ORFloatImage *depthImage,
+                     const KeypointsImage *keypointsImage);
+
+    //~~~~~~~~~~~~~~~~~~~~ PUBLIC OPERATORS ~~~~~~~~~~~~~~~~~~~~
+  public:
+    /**
+     * \brief Evaluates the specified feature of the descriptor with the specified raster index.
+     *
+     * \note  Features of descriptors whose keypoints are invalid, and features that the calculator does not compute,
+     *        are left unset by compute_keypoints_and_features; for determinism, we evaluate them as 0.
+     *
+     * \param rasterIdx   The raster index of the descriptor in the notional descriptors image.
+     * \param featureIdx  The index of the feature in the descriptor.
+     * \return            The value of the feature.
+     */
+    float operator()(int rasterIdx, uint32_t featureIdx) const;
+  };
+
   //#################### CONSTRUCTORS ####################
 private:
   /**
@@ -58,6 +143,21 @@ private:
 
   //#################### PUBLIC MEMBER FUNCTIONS ####################
 public:
+  /**
+   * \brief Extracts keypoints from an RGBD image without computing feature descriptors for them.
+   *
+   * \note  This is intended to be used in conjunction with a FeatureEvaluator, which can then evaluate just those
+   *        features of the descriptors that are actually needed.
+   *
+   * \param rgbImage         The colour image.
+   * \param depthImage       The depth image.
+   * \param cameraPose       A transformation from the camera's reference frame to the world reference frame.
+   * \param intrinsics       The intrinsic parameters of the depth camera.
+   * \param keypointsImage   The output image that will contain the keypoints. Will be resized as necessary.
+   */
+  void compute_keypoints(const ORUChar4Image *rgbImage, const ORFloatImage *depthImage, const Matrix4f& cameraPose,
+                         const Vector4f& intrinsics, KeypointsImage *keypointsImage) const;
+
   /** Override */
   virtual void compute_keypoints_and_features(const ORUChar4Image *rgbImage, const ORFloatImage *depthImage,
                                               const Matrix4f& cameraPose, const Vector4f& intrinsics,
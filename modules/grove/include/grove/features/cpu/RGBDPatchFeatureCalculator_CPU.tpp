@@ -24,6 +24,39 @@ RGBDPatchFeatureCalculator_CPU<KeypointType,DescriptorType>::RGBDPatchFeatureCal
 
 //#################### PUBLIC MEMBER FUNCTIONS ####################
 
+template <typename KeypointType, typename DescriptorType>
+void RGBDPatchFeatureCalculator_CPU<KeypointType,DescriptorType>::compute_keypoints(const ORUChar4Image *rgbImage, const ORFloatImage *depthImage,
+                                                                                    const Matrix4f& cameraPose, const Vector4f& intrinsics,
+                                                                                    KeypointsImage *keypointsImage) const
+{
+  const float *depths = depthImage ? depthImage->GetData(MEMORYDEVICE_CPU) : NULL;
+  const Vector2i depthSize = depthImage ? depthImage->noDims : Vector2i(0, 0);
+  const Vector4u *rgb = rgbImage ? rgbImage->GetData(MEMORYDEVICE_CPU) : NULL;
+  const Vector2i rgbSize = rgbImage ? rgbImage->noDims : Vector2i(0, 0);
+
+  // Check that the input images are valid and compute the output dimensions.
+  const Vector2i outSize = this->compute_output_dims(rgbImage, depthImage);
+
+  // Ensure the keypoints image is the right size.
+  keypointsImage->ChangeDims(outSize);
+  KeypointType *keypoints = keypointsImage->GetData(MEMORYDEVICE_CPU);
+
+  // Compute the keypoint for each pixel in the output image.
+#ifdef WITH_OPENMP
+  #pragma omp parallel for
+#endif
+  for(int yOut = 0; yOut < outSize.height; ++yOut)
+  {
+    for(int xOut = 0; xOut < outSize.width; ++xOut)
+    {
+      const Vector2i xyOut(xOut, yOut);
+      const Vector2i xyDepth = map_pixel_coordinates(xyOut, outSize, depthSize);
+      const Vector2i xyRgb = map_pixel_coordinates(xyOut, outSize, rgbSize);
+      compute_keypoint(xyDepth, xyRgb, xyOut, depthSize, rgbSize, outSize, depths, rgb, cameraPose, intrinsics, keypoints);
+    }
+  }
+}
+
 template <typename KeypointType, typename DescriptorType>
 void RGBDPatchFeatureCalculator_CPU<KeypointType,DescriptorType>::compute_keypoints_and_features(const ORUChar4Image *rgbImage, const ORFloatImage *depthImage,
                                                                                                  const Matrix4f& cameraPose, const Vector4f& intrinsics,
@@ -108,4 +141,100 @@ void RGBDPatchFeatureCalculator_CPU<KeypointType,DescriptorType>::compute_keypoi
   }
 }
 
+//#################### NESTED TYPES ####################
+
+template <typename KeypointType, typename DescriptorType>
+RGBDPatchFeatureCalculator_CPU<KeypointType,DescriptorType>::FeatureEvaluator::FeatureEvaluator(const RGBDPatchFeatureCalculator_CPU& calculator,
+                                                                                                const ORUChar4Image *rgbImage, const ORFloatImage *depthImage,
+                                                                                                const KeypointsImage *keypointsImage)
+: m_calculator(&calculator),
+  m_depthOffsets(calculator.m_depthOffsets->GetData(MEMORYDEVICE_CPU)),
+  m_depths(depthImage ? depthImage->GetData(MEMORYDEVICE_CPU) : NULL),
+  m_depthSize(depthImage ? depthImage->noDims : Vector2i(0, 0)),
+  m_keypoints(keypointsImage->GetData(MEMORYDEVICE_CPU)),
+  m_rgb(rgbImage ? rgbImage->GetData(MEMORYDEVICE_CPU) : NULL),
+  m_rgbChannels(calculator.m_rgbChannels->GetData(MEMORYDEVICE_CPU)),
+  m_rgbOffsets(calculator.m_rgbOffsets->GetData(MEMORYDEVICE_CPU)),
+  m_rgbSize(rgbImage ? rgbImage->noDims : Vector2i(0, 0))
+{
+  // Compute the ratios used to scale the offsets, exactly as in compute_depth_features and compute_colour_features.
+  // FIXME: The training image size should be passed in, not hard-coded (see the FIXMEs in the shared code).
+  const Vector2f trainSize(640.0f, 480.0f);
+  m_depthOffsetRatio = Vector2f(m_depthSize.x / trainSize.x, m_depthSize.y / trainSize.y);
+  m_rgbOffsetRatio = Vector2f(m_rgbSize.x / trainSize.x, m_rgbSize.y / trainSize.y);
+
+  // Precompute the coordinates of the pixels in the depth and colour images that correspond to each keypoint.
+  const Vector2i& outSize = keypointsImage->noDims;
+  m_xyDepths.resize(keypointsImage->dataSize);
+  m_xyRgbs.resize(keypointsImage->dataSize);
+  for(int yOut = 0; yOut < outSize.height; ++yOut)
+  {
+    for(int xOut = 0; xOut < outSize.width; ++xOut)
+    {
+      const Vector2i xyOut(xOut, yOut);
+      const int rasterIdx = yOut * outSize.width + xOut;
+      m_xyDepths[rasterIdx] = map_pixel_coordinates(xyOut, outSize, m_depthSize);
+      m_xyRgbs[rasterIdx] = map_pixel_coordinates(xyOut, outSize, m_rgbSize);
+    }
+  }
+}
+
+template <typename KeypointType, typename DescriptorType>
+float RGBDPatchFeatureCalculator_CPU<KeypointType,DescriptorType>::FeatureEvaluator::operator()(int rasterIdx, uint32_t featureIdx) const
+{
+  // If the keypoint is invalid, early out (compute_keypoints_and_features would not compute its descriptor).
+  if(!m_keypoints[rasterIdx].valid) return 0.0f;
+
+  const RGBDPatchFeatureCalculator_CPU& c = *m_calculator;
+
+  // If the feature is a colour feature, evaluate it. Note that we check this first because compute_keypoints_and_features
+  // computes the colour features after the depth features, so a colour feature takes precedence if the two ranges overlap.
+  if(m_rgb && featureIdx - c.m_rgbFeatureOffset < c.m_rgbFeatureCount)
+  {
+    const uint32_t rgbFeatureIdx = featureIdx - c.m_rgbFeatureOffset;
+    const Vector2i& xyRgb = m_xyRgbs[rasterIdx];
+    const int rasterIdxRgb = xyRgb.y * m_rgbSize.width + xyRgb.x;
+
+    // As in compute_colour_features, we only normalise the offsets by depth if depth information is available.
+    float depth = 1.0f;
+    if(c.m_normaliseRgb && m_depths)
+    {
+      const Vector2i& xyDepth = m_xyDepths[rasterIdx];
+      depth = m_depths[xyDepth.y * m_depthSize.width + xyDepth.x];
+    }
+
+    if(c.m_rgbDifferenceType == PAIRWISE_DIFFERENCE)
+    {
+      return compute_colour_feature<PAIRWISE_DIFFERENCE>(
+        xyRgb, rasterIdxRgb, m_rgbSize, m_rgb, m_rgbOffsets[rgbFeatureIdx], m_rgbChannels[rgbFeatureIdx], m_rgbOffsetRatio, c.m_normaliseRgb, depth
+      );
+    }
+    else
+    {
+      return compute_colour_feature<CENTRAL_DIFFERENCE>(
+        xyRgb, rasterIdxRgb, m_rgbSize, m_rgb, m_rgbOffsets[rgbFeatureIdx], m_rgbChannels[rgbFeatureIdx], m_rgbOffsetRatio, c.m_normaliseRgb, depth
+      );
+    }
+  }
+
+  // Otherwise, if the feature is a depth feature, evaluate it.
+  if(m_depths && featureIdx - c.m_depthFeatureOffset < c.m_depthFeatureCount)
+  {
+    const uint32_t depthFeatureIdx = featureIdx - c.m_depthFeatureOffset;
+    const Vector2i& xyDepth = m_xyDepths[rasterIdx];
+    const float depth = m_depths[xyDepth.y * m_depthSize.width + xyDepth.x];
+    if(c.m_depthDifferenceType == PAIRWISE_DIFFERENCE)
+    {
+      return compute_depth_feature<PAIRWISE_DIFFERENCE>(xyDepth, m_depthSize, m_depths, m_depthOffsets[depthFeatureIdx], m_depthOffsetRatio, c.m_normaliseDepth, depth);
+    }
+    else
+    {
+      return compute_depth_feature<CENTRAL_DIFFERENCE>(xyDepth, m_depthSize, m_depths, m_depthOffsets[depthFeatureIdx], m_depthOffsetRatio, c.m_normaliseDepth, depth);
+    }
+  }
+
+  // Otherwise, the calculator does not compute the feature.
+  return 0.0f;
+}
+
 }
@@ -73,6 +73,49 @@ inline void calculate_secondary_points(const Vector2i& xyIn, const Vector4i& off
   raster2 = y2 * imgSize.width + x2;
 }
 
+/**
+ * \brief Computes a single colour feature for a pixel in the RGBD image.
+ *
+ * \param xyRgb         The coordinates of the pixel in the colour image.
+ * \param rasterIdxRgb  The raster index of the pixel in the colour image.
+ * \param rgbSize       The size of the colour image.
+ * \param rgb           A pointer to the colour image.
+ * \param rgbOffsets    The unscaled offsets of the secondary point(s) used to compute the feature.
+ * \param channel       The colour channel used to compute the feature.
+ * \param offsetRatio   The ratio by which to scale the offsets to account for the size of the colour image.
+ * \param normalise     Whether or not to normalise the offsets by the pixel's depth value.
+ * \param depth         The pixel's depth value (or 1 if the offsets are not being normalised).
+ * \return              The value of the feature.
+ */
+template <RGBDPatchFeatureDifferenceType DifferenceType>
+_CPU_AND_GPU_CODE_TEMPLATE_
+inline float compute_colour_feature(const Vector2i& xyRgb, int rasterIdxRgb, const Vector2i& rgbSize, const Vector4u *rgb,
+                                    const Vector4i& rgbOffsets, int channel, const Vector2f& offsetRatio, bool normalise, float depth)
+{
+  // Rescale the offsets using the offset ratio.
+  Vector4i offsets;
+  offsets[0] = static_cast<int>(rgbOffsets[0] * offsetRatio.x);
+  offsets[1] = static_cast<int>(rgbOffsets[1] * offsetRatio.y);
+  offsets[2] = static_cast<int>(rgbOffsets[2] * offsetRatio.x);
+  offsets[3] = static_cast<int>(rgbOffsets[3] * offsetRatio.y);
+
+  // Calculate the raster position(s) of the secondary point(s) to use when computing the feature.
+  int raster1, raster2;
+  calculate_secondary_points<DifferenceType>(xyRgb, offsets, rgbSize, normalise, depth, raster1, raster2);
+
+  // Compute the feature.
+  if(DifferenceType == PAIRWISE_DIFFERENCE)
+  {
+    // This is the "correct" definition, but the SCoRe Forests code uses the other one.
+    return static_cast<float>(rgb[raster1][channel] - rgb[raster2][channel]);
+  }
+  else
+  {
+    // This is the definition used in the SCoRe Forests code.
+    return static_cast<float>(rgb[raster1][channel] - rgb[rasterIdxRgb][channel]);
+  }
+}
+
 /**
  * \brief Computes colour features for a pixel in the RGBD image and writes them into the relevant descriptor.
  *
@@ -124,30 +167,57 @@ inline void compute_colour_features(const Vector2i& xyDepth, const Vector2i& xyR
   const int rasterIdxRgb = xyRgb.y * rgbSize.width + xyRgb.x;
   for(uint32_t featIdx = 0; featIdx < rgbFeatureCount; ++featIdx)
   {
-    const int channel = rgbChannels[featIdx];
-    Vector4i offsets = rgbOffsets[featIdx];
+    descriptor.data[rgbFeatureOffset + featIdx] = compute_colour_feature<DifferenceType>(
+      xyRgb, rasterIdxRgb, rgbSize, rgb, rgbOffsets[featIdx], rgbChannels[featIdx], offsetRatio, normalise, depth
+    );
+  }
+}
+
+/**
+ * \brief Computes a single depth feature for a pixel in the RGBD image.
+ *
+ * \param xyDepth       The coordinates of the pixel in the depth image.
+ * \param depthSize     The size of the depth image.
+ * \param depths        A pointer to the depth image.
+ * \param depthOffsets  The unscaled offsets of the secondary point(s) used to compute the feature.
+ * \param offsetRatio   The ratio by which to scale the offsets to account for the size of the depth image.
+ * \param normalise     Whether or not to normalise the offsets by the pixel's depth value.
+ * \param depth         The pixel's depth value.
+ * \return              The value of the feature.
+ */
+template <RGBDPatchFeatureDifferenceType DifferenceType>
+_CPU_AND_GPU_CODE_TEMPLATE_
+inline float compute_depth_feature(const Vector2i& xyDepth, const Vector2i& depthSize, const float *depths,
+                                   const Vector4i& depthOffsets, const Vector2f& offsetRatio, bool normalise, float depth)
+{
+  // Rescale the offsets using the offset ratio.
+  Vector4i offsets;
+  offsets[0] = static_cast<int>(depthOffsets[0] * offsetRatio.x);
+  offsets[1] = static_cast<int>(depthOffsets[1] * offsetRatio.y);
+  offsets[2] = static_cast<int>(depthOffsets[2] * offsetRatio.x);
+  offsets[3] = static_cast<int>(depthOffsets[3] * offsetRatio.y);
 
-    // Rescale the offsets using the offset ratio.
-    offsets[0] = static_cast<int>(offsets[0] * offsetRatio.x);
-    offsets[1] = static_cast<int>(offsets[1] * offsetRatio.y);
-    offsets[2] = static_cast<int>(offsets[2] * offsetRatio.x);
-    offsets[3] = static_cast<int>(offsets[3] * offsetRatio.y);
+  // Calculate the raster position(s) of the secondary point(s) to use when computing the feature.
+  int raster1, raster2;
+  calculate_secondary_points<DifferenceType>(xyDepth, offsets, depthSize, normalise, depth, raster1, raster2);
 
-    // Calculate the raster position(s) of the secondary point(s) to use when computing the feature.
-    int raster1, raster2;
-    calculate_secondary_points<DifferenceType>(xyRgb, offsets, rgbSize, normalise, depth, raster1, raster2);
+  // Convert the depth of the first secondary point to millimetres.
+  const float depth1Mm = fmaxf(depths[raster1] * 1000.f, 0.0f);  // we use max because InfiniTAM sometimes has invalid depths stored as -1
 
-    // Compute the feature and write it into the descriptor.
-    if(DifferenceType == PAIRWISE_DIFFERENCE)
-    {
-      // This is the "correct" definition, but the SCoRe Forests code uses the other one.
-      descriptor.data[rgbFeatureOffset + featIdx] = static_cast<float>(rgb[raster1][channel] - rgb[raster2][channel]);
-    }
-    else
-    {
-      // This is the definition used in the SCoRe Forests code.
-      descriptor.data[rgbFeatureOffset + featIdx] = static_cast<float>(rgb[raster1][channel] - rgb[rasterIdxRgb][channel]);
-    }
+  // Compute the feature.
+  if(DifferenceType == PAIRWISE_DIFFERENCE)
+  {
+    // This is the "correct" definition, but the SCoRe Forests code uses the other one.
+    const float depth2Mm = fmaxf(depths[raster2] * 1000.0f, 0.0f);
+    return depth1Mm - depth2Mm;
+  }
+  else
+  {
+    // Convert the depth of the central point to millimetres.
+    const float depthMm = depth * 1000.0f;
+
+    // This is the definition used in the SCoRe Forests code.
+    return depth1Mm - depthMm;
   }
 }
 
@@ -190,36 +260,9 @@ inline void compute_depth_features(const Vector2i& xyDepth, const Vector2i& xyOu
   DescriptorType& descriptor = descriptors[rasterIdxOut];
   for(uint32_t featIdx = 0; featIdx < depthFeatureCount; ++featIdx)
   {
-    Vector4i offsets = depthOffsets[featIdx];
-
-    // Rescale the offsets using the offset ratio.
-    offsets[0] = static_cast<int>(offsets[0] * offsetRatio.x);
-    offsets[1] = static_cast<int>(offsets[1] * offsetRatio.y);
-    offsets[2] = static_cast<int>(offsets[2] * offsetRatio.x);
-    offsets[3] = static_cast<int>(offsets[3] * offsetRatio.y);
-
-    // Calculate the raster position(s) of the secondary point(s) to use when computing the feature.
-    int raster1, raster2;
-    calculate_secondary_points<DifferenceType>(xyDepth, offsets, depthSize, normalise, depth, raster1, raster2);
-
-    // Convert the depth of the first secondary point to millimetres.
-    const float depth1Mm = fmaxf(depths[raster1] * 1000.f, 0.0f);  // we use max because InfiniTAM sometimes has invalid depths stored as -1
-
-    // Compute the feature and write it into the descriptor.
-    if(DifferenceType == PAIRWISE_DIFFERENCE)
-    {
-      // This is the "correct" definition, but the SCoRe Forests code uses the other one.
-      const float depth2Mm = fmaxf(depths[raster2] * 1000.0f, 0.0f);
-      descriptor.data[depthFeatureOffset + featIdx] = depth1Mm - depth2Mm;
-    }
-    else
-    {
-      // Convert the depth of the central point to millimetres.
-      const float depthMm = depth * 1000.0f;
-
-      // This is the definition used in the SCoRe Forests code.
-      descriptor.data[depthFeatureOffset + featIdx] = depth1Mm - depthMm;
-    }
+    descriptor.data[depthFeatureOffset + featIdx] = compute_depth_feature<DifferenceType>(
+      xyDepth, depthSize, depths, depthOffsets[featIdx], offsetRatio, normalise, depth
+    );
   }
 }
 
@@ -6,6 +6,13 @@
 #ifndef H_GROVE_DECISIONFOREST_CPU
 #define H_GROVE_DECISIONFOREST_CPU
 
+#include <cstring>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/weak_ptr.hpp>
+
 #include "../interface/DecisionForest.h"
 
 namespace grove {
@@ -17,6 +24,15 @@ namespace grove {
  * \note  Training is not performed by this class. We use the node indexing technique described in:
  *        "Implementing Decision Trees and Forests on a GPU" (Toby Sharp, 2008).
  *
+ * By default, the leaves are found by a packet traversal engine, which walks packets of descriptors down each tree together, one
+ * level at a time, rather than walking a single descriptor all the way down before starting the next. The node and feature lookups
+ * for the descriptors in a packet are independent of each other, so the CPU can overlap their cache misses, and the engine uses a
+ * copy of the forest whose nodes are reordered into a breadth-first, cache-blocked layout (see build_traversal_layout). The leaf
+ * indices found are identical to those found by walking one descriptor at a time.
+ *
+ * The same engine can also find the leaves without a descriptors image (see find_leaves_lazily), evaluating each feature only
+ * when a split node first tests it. Since each descriptor only visits a few nodes per tree, most of its features are never needed.
+ *
  * \tparam DescriptorType The type of descriptor used to find the leaves. Must have a floating-point member array named "data".
  * \tparam TreeCount      The number of trees in the forest. Fixed at compilation time to allow the definition of a data type
  *                        representing the leaf indices.
@@ -38,6 +54,88 @@ public:
   using typename Base::LeafIndicesImage_CPtr;
   using typename Base::NodeEntry;
 
+  //#################### ENUMERATIONS ####################
+private:
+  enum
+  {
+    /** The number of levels of a tree that are stored contiguously in each block of the traversal layout. */
+    BLOCK_DEPTH = 4,
+
+    /** The number of descriptors that are walked down each tree together by the packet traversal engine. */
+    PACKET_SIZE = 16
+  };
+
+  //#################### NESTED TYPES ####################
+private:
+  /**
+   * \brief An instance of this struct represents a block of the traversal layout that is waiting to be laid out.
+   */
+  struct PendingBlock
+  {
+    /** The index of the first root of the block in the node image (the roots of a block are either the root of the tree or a pair of siblings). */
+    int firstRootIdx;
+
+    /** The index in the traversal layout of the parent of the block's roots, or -1 if the block contains the root of the tree. */
+    int parentIdx;
+
+    /** The number of roots the block has (1 or 2). */
+    int rootCount;
+
+    PendingBlock(int firstRootIdx_, int parentIdx_, int rootCount_)
+    : firstRootIdx(firstRootIdx_), parentIdx(parentIdx_), rootCount(rootCount_)
+    {}
+  };
+
+  /**
+   * \brief An instance of this struct stores the features that have been evaluated so far for the descriptors in a packet
+   *        when finding leaves lazily.
+   */
+  struct PacketFeatureCache
+  {
+    enum { FLAG_WORD_COUNT = (DescriptorType::FEATURE_COUNT + 31) / 32 };
+
+    /** A bit mask for each descriptor in the packet, indicating which of its features have been evaluated so far. */
+    uint32_t evaluatedFlags[PACKET_SIZE][FLAG_WORD_COUNT];
+
+    /** The descriptors in the packet (only the features that have been evaluated are valid). */
+    DescriptorType features[PACKET_SIZE];
+
+    PacketFeatureCache()
+    {
+      memset(evaluatedFlags, 0, sizeof(evaluatedFlags));
+    }
+  };
+
+  /**
+   * \brief An instance of this struct represents a copy of the forest whose nodes have been reordered into the traversal layout.
+   *
+   * Once built, a layout is never modified, so threads that hold a pointer to it can keep using it even if it is replaced.
+   */
+  struct TraversalLayout
+  {
+    /** The nodes of the trees in the forest, reordered into the traversal layout (one tree after another). */
+    std::vector<NodeEntry> nodes;
+
+    /** The node image from which the layout was built (used to detect when the structure of the forest changes). */
+    boost::weak_ptr<const ORUtils::Image<NodeEntry> > source;
+
+    /** The offset of the first node of each tree in nodes. */
+    std::vector<size_t> treeOffsets;
+  };
+
+  typedef boost::shared_ptr<const TraversalLayout> TraversalLayout_CPtr;
+
+  //#################### PRIVATE VARIABLES ####################
+private:
+  /** The most recently built traversal layout (if any). This must only be read or replaced while holding m_traversalLayoutMutex. */
+  mutable TraversalLayout_CPtr m_traversalLayout;
+
+  /** The mutex used to synchronise access to the traversal layout, in case find_leaves is called from several threads at once. */
+  mutable boost::mutex m_traversalLayoutMutex;
+
+  /** Whether or not to use the packet traversal engine to find the leaves. */
+  bool m_usePacketTraversal;
+
   //#################### CONSTRUCTORS ####################
 public:
   /**
@@ -71,6 +169,86 @@ public:
 public:
   /** Override */
   virtual void find_leaves(const DescriptorImage_CPtr& descriptors, LeafIndicesImage_Ptr& leafIndices) const;
+
+  /**
+   * \brief Finds the leaves associated with the descriptors for an image, evaluating the features of the descriptors on demand.
+   *
+   * Rather than reading the features from a descriptors image that has been computed in advance, this evaluates each feature
+   * of a descriptor the first time a split node tests it, and reuses the value for any other nodes (in any tree) that test it.
+   * The leaf indices found are identical to those that find_leaves would find if passed the fully-computed descriptors.
+   *
+   * \param evaluator   A function object such that evaluator(rasterIdx, featureIdx) evaluates the specified feature of the descriptor
+   *                    with the specified raster index. It will be called concurrently from several threads if OpenMP is enabled.
+   * \param imgSize     The size of the (notional) descriptors image.
+   * \param leafIndices An image in which to store the leaf indices (this will be resized as necessary).
+   * \return            The total number of features that were evaluated.
+   */
+  template <typename FeatureEvaluator>
+  size_t find_leaves_lazily(const FeatureEvaluator& evaluator, const Vector2i& imgSize, LeafIndicesImage_Ptr& leafIndices) const;
+
+  /**
+   * \brief Sets whether or not to use the packet traversal engine to find the leaves.
+   *
+   * If the packet traversal engine is disabled, the leaves are found by walking one descriptor down each tree at a time
+   * (this is primarily useful as a reference against which to check and benchmark the packet traversal engine).
+   *
+   * \param usePacketTraversal Whether or not to use the packet traversal engine to find the leaves.
+   */
+  void set_use_packet_traversal(bool usePacketTraversal);
+
+  //#################### PRIVATE MEMBER FUNCTIONS ####################
+private:
+  /**
+   * \brief Builds the traversal layout used by the packet traversal engine from the node image.
+   *
+   * The nodes of each tree are divided into blocks, each of which consists of a set of roots (either the root of the tree or
+   * a pair of siblings) together with their descendants down to a fixed depth. The nodes in each block are stored contiguously
+   * in breadth-first order, so that the first few levels beneath any node usually share a few cache lines, and the blocks themselves
+   * are also laid out in breadth-first order, so that the top levels of the tree (which every descriptor visits) are stored together.
+   * As in the node image, the two children of each branch node are stored next to each other.
+   *
+   * \return The traversal layout.
+   */
+  TraversalLayout_CPtr build_traversal_layout() const;
+
+  /**
+   * \brief Ensures that the traversal layout is up to date with the node image, (re)building it if necessary.
+   *
+   * A rebuilt layout replaces the old one without modifying it, so callers can safely keep using the layout
+   * returned to them while another thread rebuilds it.
+   *
+   * \return The up-to-date traversal layout.
+   */
+  TraversalLayout_CPtr ensure_traversal_layout() const;
+
+  //#################### PRIVATE STATIC MEMBER FUNCTIONS ####################
+private:
+  /**
+   * \brief Walks a packet of descriptors down a tree together, and writes the indices of the leaves they reach into the leaf indices image.
+   *
+   * \param descriptors The descriptors in the packet (PACKET_SIZE descriptors, stored contiguously).
+   * \param treeNodes   The nodes of the tree, in the traversal layout.
+   * \param treeIdx     The index of the tree.
+   * \param leafIndices The locations in the leaf indices image corresponding to the descriptors in the packet.
+   */
+  static void find_packet_leaves(const DescriptorType *descriptors, const NodeEntry *treeNodes, int treeIdx, LeafIndices *leafIndices);
+
+  /**
+   * \brief Walks a packet of descriptors down a tree together, evaluating their features on demand, and writes the indices of the
+   *        leaves they reach into the leaf indices image.
+   *
+   * \param evaluator      The function object used to evaluate the features (see find_leaves_lazily).
+   * \param firstRasterIdx The raster index of the first descriptor in the packet.
+   * \param packetSize     The number of descriptors in the packet (at most PACKET_SIZE).
+   * \param treeNodes      The nodes of the tree, in the traversal layout.
+   * \param treeIdx        The index of the tree.
+   * \param cache          The features of the descriptors in the packet that have been evaluated so far (updated as features are evaluated).
+   * \param leafIndices    The locations in the leaf indices image corresponding to the descriptors in the packet.
+   * \return               The number of features that were evaluated.
+   */
+  template <typename FeatureEvaluator>
+  static size_t find_packet_leaves_lazily(const FeatureEvaluator& evaluator, int firstRasterIdx, int packetSize, const NodeEntry *treeNodes,
+                                          int treeIdx, PacketFeatureCache& cache, LeafIndices *leafIndices);
 };
 
 }
@@ -5,6 +5,9 @@
 
 #include "DecisionForest_CPU.h"
 
+#include <algorithm>
+#include <deque>
+
 #include "../shared/DecisionForest_Shared.h"
 
 namespace grove {
@@ -13,18 +16,18 @@ namespace grove {
 
 template <typename DescriptorType, int TreeCount>
 DecisionForest_CPU<DescriptorType,TreeCount>::DecisionForest_CPU(const std::string& filename)
-: Base(filename)
+: Base(filename), m_usePacketTraversal(true)
 {}
 
 template <typename DescriptorType, int TreeCount>
 DecisionForest_CPU<DescriptorType,TreeCount>::DecisionForest_CPU(const tvgutil::SettingsContainer_CPtr& settings)
-: Base(settings)
+: Base(settings), m_usePacketTraversal(true)
 {}
 
 #ifdef WITH_SCOREFORESTS
 template <typename DescriptorType, int TreeCount>
 DecisionForest_CPU<DescriptorType,TreeCount>::DecisionForest_CPU(const EnsembleLearner& pretrainedForest)
-: Base(pretrainedForest)
+: Base(pretrainedForest), m_usePacketTraversal(true)
 {}
 #endif
 
@@ -42,16 +45,247 @@ void DecisionForest_CPU<DescriptorType,TreeCount>::find_leaves(const DescriptorI
   const NodeEntry *nodeImage = this->m_nodeImage->GetData(MEMORYDEVICE_CPU);
   LeafIndices *leafIndicesPtr = leafIndices->GetData(MEMORYDEVICE_CPU);
 
+  // If the packet traversal engine is disabled, walk one descriptor down each tree at a time.
+  if(!m_usePacketTraversal)
+  {
+#ifdef WITH_OPENMP
+    #pragma omp parallel for
+#endif
+    for(int y = 0; y < imgSize.y; ++y)
+    {
+      for(int x = 0; x < imgSize.x; ++x)
+      {
+        compute_leaf_indices(x, y, descriptorsPtr, imgSize, nodeImage, leafIndicesPtr);
+      }
+    }
+
+    return;
+  }
+
+  // Otherwise, (re)build the traversal layout if the structure of the forest has changed since it was last built.
+  const TraversalLayout_CPtr layout = ensure_traversal_layout();
+
+  // Walk complete packets of descriptors down the trees using the packet traversal engine.
+  const int descriptorCount = imgSize.x * imgSize.y;
+  const int packetCount = descriptorCount / PACKET_SIZE;
+
 #ifdef WITH_OPENMP
   #pragma omp parallel for
 #endif
-  for(int y = 0; y < imgSize.y; ++y)
+  for(int packetIdx = 0; packetIdx < packetCount; ++packetIdx)
+  {
+    const int offset = packetIdx * PACKET_SIZE;
+    for(int treeIdx = 0; treeIdx < TREE_COUNT; ++treeIdx)
+    {
+      find_packet_leaves(descriptorsPtr + offset, &layout->nodes[layout->treeOffsets[treeIdx]], treeIdx, leafIndicesPtr + offset);
+    }
+  }
+
+  // Walk any remaining descriptors down the trees individually.
+  for(int i = packetCount * PACKET_SIZE; i < descriptorCount; ++i)
+  {
+    compute_leaf_indices(i % imgSize.x, i / imgSize.x, descriptorsPtr, imgSize, nodeImage, leafIndicesPtr);
+  }
+}
+
+template <typename DescriptorType, int TreeCount>
+template <typename FeatureEvaluator>
+size_t DecisionForest_CPU<DescriptorType,TreeCount>::find_leaves_lazily(const FeatureEvaluator& evaluator, const Vector2i& imgSize, LeafIndicesImage_Ptr& leafIndices) const
+{
+  // Ensure that the leaf indices image has the right size, and that the traversal layout is up to date.
+  leafIndices->ChangeDims(imgSize);
+  LeafIndices *leafIndicesPtr = leafIndices->GetData(MEMORYDEVICE_CPU);
+  const TraversalLayout_CPtr layout = ensure_traversal_layout();
+
+  // Walk packets of descriptors down the trees, keeping the features evaluated for each packet so that they can be reused
+  // by later trees. Note that the last packet may be incomplete.
+  const int descriptorCount = imgSize.x * imgSize.y;
+  const int packetCount = (descriptorCount + PACKET_SIZE - 1) / PACKET_SIZE;
+  long evaluatedCount = 0;
+
+#ifdef WITH_OPENMP
+  #pragma omp parallel for reduction(+:evaluatedCount)
+#endif
+  for(int packetIdx = 0; packetIdx < packetCount; ++packetIdx)
   {
-    for(int x = 0; x < imgSize.x; ++x)
+    const int offset = packetIdx * PACKET_SIZE;
+    const int packetSize = std::min<int>(PACKET_SIZE, descriptorCount - offset);
+    PacketFeatureCache cache;
+    for(int treeIdx = 0; treeIdx < TREE_COUNT; ++treeIdx)
     {
-      compute_leaf_indices(x, y, descriptorsPtr, imgSize, nodeImage, leafIndicesPtr);
+      evaluatedCount += static_cast<long>(find_packet_leaves_lazily(
+        evaluator, offset, packetSize, &layout->nodes[layout->treeOffsets[treeIdx]], treeIdx, cache, leafIndicesPtr + offset
+      ));
     }
   }
+
+  return static_cast<size_t>(evaluatedCount);
+}
+
+template <typename DescriptorType, int TreeCount>
+void DecisionForest_CPU<DescriptorType,TreeCount>::set_use_packet_traversal(bool usePacketTraversal)
+{
+  m_usePacketTraversal = usePacketTraversal;
+}
+
+//#################### PRIVATE MEMBER FUNCTIONS ####################
+
+template <typename DescriptorType, int TreeCount>
+typename DecisionForest_CPU<DescriptorType,TreeCount>::TraversalLayout_CPtr
+DecisionForest_CPU<DescriptorType,TreeCount>::build_traversal_layout() const
+{
+  const NodeEntry *nodeImage = this->m_nodeImage->GetData(MEMORYDEVICE_CPU);
+
+  boost::shared_ptr<TraversalLayout> layout(new TraversalLayout);
+  layout->source = this->m_nodeImage;
+  std::vector<NodeEntry>& traversalNodes = layout->nodes;
+
+  for(int treeIdx = 0; treeIdx < TREE_COUNT; ++treeIdx)
+  {
+    // Allocate space for the nodes of the tree.
+    const size_t treeOffset = traversalNodes.size();
+    layout->treeOffsets.push_back(treeOffset);
+    traversalNodes.resize(treeOffset + this->m_nbNodesPerTree[treeIdx]);
+    NodeEntry *outputNodes = &traversalNodes[treeOffset];
+    int firstFreeIdx = 0;
+
+    // Lay out the blocks of the tree in breadth-first order, starting from the block containing the root.
+    std::deque<PendingBlock> pendingBlocks;
+    pendingBlocks.push_back(PendingBlock(0, -1, 1));
+
+    // Note: Each element of this queue is a pair containing the index of a node in the traversal layout and its depth within its block.
+    std::deque<std::pair<int,int> > blockNodes;
+
+    while(!pendingBlocks.empty())
+    {
+      const PendingBlock block = pendingBlocks.front();
+      pendingBlocks.pop_front();
+
+      // Copy the roots of the block into the next free entries, and point their parent (if any) at them.
+      if(block.parentIdx >= 0) outputNodes[block.parentIdx].leftChildIdx = firstFreeIdx;
+      for(int i = 0; i < block.rootCount; ++i)
+      {
+        outputNodes[firstFreeIdx] = nodeImage[(block.firstRootIdx + i) * TREE_COUNT + treeIdx];
+        blockNodes.push_back(std::make_pair(firstFreeIdx++, 0));
+      }
+
+      // Lay out the rest of the block in breadth-first order. The children of nodes at the bottom of the block become the roots of new blocks.
+      while(!blockNodes.empty())
+      {
+        const int nodeIdx = blockNodes.front().first, depth = blockNodes.front().second;
+        blockNodes.pop_front();
+
+        NodeEntry& node = outputNodes[nodeIdx];
+        if(node.leafIdx >= 0) continue;
+
+        const int originalLeftChildIdx = node.leftChildIdx;
+        if(depth + 1 < BLOCK_DEPTH)
+        {
+          node.leftChildIdx = firstFreeIdx;
+          for(int i = 0; i < 2; ++i)
+          {
+            outputNodes[firstFreeIdx] = nodeImage[(originalLeftChildIdx + i) * TREE_COUNT + treeIdx];
+            blockNodes.push_back(std::make_pair(firstFreeIdx++, depth + 1));
+          }
+        }
+        else pendingBlocks.push_back(PendingBlock(originalLeftChildIdx, nodeIdx, 2));
+      }
+    }
+
+    // Discard the space allocated for any nodes that are not reachable from the root (e.g. unused entries in the node image).
+    traversalNodes.resize(treeOffset + firstFreeIdx);
+  }
+
+  return layout;
+}
+
+template <typename DescriptorType, int TreeCount>
+typename DecisionForest_CPU<DescriptorType,TreeCount>::TraversalLayout_CPtr
+DecisionForest_CPU<DescriptorType,TreeCount>::ensure_traversal_layout() const
+{
+  boost::lock_guard<boost::mutex> lock(m_traversalLayoutMutex);
+
+  // If the structure of the forest has changed since the layout was last built, build a fresh layout and swap it in.
+  // Note that the old layout is left untouched, since other threads may still be walking descriptors down it.
+  if(!m_traversalLayout || m_traversalLayout->source.lock() != this->m_nodeImage)
+  {
+    m_traversalLayout = build_traversal_layout();
+  }
+
+  // Return a copy of the pointer to the layout, which keeps the layout alive for as long as the caller needs it.
+  return m_traversalLayout;
+}
+
+//#################### PRIVATE STATIC MEMBER FUNCTIONS ####################
+
+template <typename DescriptorType, int TreeCount>
+void DecisionForest_CPU<DescriptorType,TreeCount>::find_packet_leaves(const DescriptorType *descriptors, const NodeEntry *treeNodes, int treeIdx, LeafIndices *leafIndices)
+{
+  // Start all of the descriptors at the root, and walk them down the tree one level at a time until they have all reached a leaf.
+  // Interleaving the descriptors in this way lets the memory accesses for the different descriptors proceed in parallel.
+  int nodeIndices[PACKET_SIZE] = {0};
+  bool active = true;
+  while(active)
+  {
+    active = false;
+    for(int i = 0; i < PACKET_SIZE; ++i)
+    {
+      const NodeEntry& node = treeNodes[nodeIndices[i]];
+      if(node.leafIdx < 0)
+      {
+        nodeIndices[i] = node.leftChildIdx + static_cast<int>(descriptors[i].data[node.featureIdx] > node.featureThreshold);
+        active = true;
+      }
+    }
+  }
+
+  for(int i = 0; i < PACKET_SIZE; ++i)
+  {
+    leafIndices[i][treeIdx] = treeNodes[nodeIndices[i]].leafIdx;
+  }
+}
+
+template <typename DescriptorType, int TreeCount>
+template <typename FeatureEvaluator>
+size_t DecisionForest_CPU<DescriptorType,TreeCount>::find_packet_leaves_lazily(const FeatureEvaluator& evaluator, int firstRasterIdx, int packetSize,
+                                                                               const NodeEntry *treeNodes, int treeIdx, PacketFeatureCache& cache,
+                                                                               LeafIndices *leafIndices)
+{
+  // As in find_packet_leaves, walk the descriptors down the tree one level at a time, but evaluate each feature the first time
+  // it is needed for a descriptor (and record it in the cache so that it can be reused by later nodes and trees).
+  size_t evaluatedCount = 0;
+  int nodeIndices[PACKET_SIZE] = {0};
+  bool active = true;
+  while(active)
+  {
+    active = false;
+    for(int i = 0; i < packetSize; ++i)
+    {
+      const NodeEntry& node = treeNodes[nodeIndices[i]];
+      if(node.leafIdx < 0)
+      {
+        const uint32_t featureIdx = node.featureIdx;
+        uint32_t& flagWord = cache.evaluatedFlags[i][featureIdx >> 5];
+        const uint32_t flagBit = 1u << (featureIdx & 31);
+        if(!(flagWord & flagBit))
+        {
+          cache.features[i].data[featureIdx] = evaluator(firstRasterIdx + i, featureIdx);
+          flagWord |= flagBit;
+          ++evaluatedCount;
+        }
+
+        nodeIndices[i] = node.leftChildIdx + static_cast<int>(cache.features[i].data[featureIdx] > node.featureThreshold);
+        active = true;
+      }
+    }
+  }
+
+  for(int i = 0; i < packetSize; ++i)
+  {
+    leafIndices[i][treeIdx] = treeNodes[nodeIndices[i]].leafIdx;
+  }
+
+  return evaluatedCount;
 }
 
 }
@@ -74,6 +74,50 @@ public:
     int leftChildIdx;
   };
 
+private:
+  /**
+   * \brief An instance of this struct represents the header of a forest file in binary format.
+   *
+   * \note File format (binary mode), with all values stored in native byte order:
+   *
+   * header (this struct)
+   * tree1_nbNodes tree1_nbLeaves ... treeN_nbNodes treeN_nbLeaves (uint32_t each)
+   * padding up to nodeDataOffset
+   * the node image (maxNbNodes * nbTrees NodeEntry structs, in the in-memory layout, i.e. node nodeIdx of tree treeIdx at nodeIdx * nbTrees + treeIdx)
+   */
+  struct BinaryFileHeader
+  {
+    /** The magic bytes that identify the file as a binary forest file. */
+    char magic[8];
+
+    /** The version of the binary format. */
+    uint32_t version;
+
+    /** A marker used to detect files written on a machine with a different byte order. */
+    uint32_t byteOrderMarker;
+
+    /** The number of trees in the forest. */
+    uint32_t nbTrees;
+
+    /** The maximum number of nodes in any tree of the forest (i.e. the height of the node image). */
+    uint32_t maxNbNodes;
+
+    /** The size (in bytes) of a single node entry. */
+    uint32_t nodeEntrySize;
+
+    /** The offset (in bytes) of the node image from the start of the file. */
+    uint32_t nodeDataOffset;
+
+    /** A CRC-32 checksum of the per-tree node and leaf counts. */
+    uint32_t treeTableChecksum;
+
+    /** A CRC-32 checksum of the node image. */
+    uint32_t nodeDataChecksum;
+
+    /** A CRC-32 checksum of all of the preceding fields of the header. */
+    uint32_t headerChecksum;
+  };
+
   //#################### TYPEDEFS ####################
 public:
   typedef ORUtils::Image<DescriptorType> DescriptorImage;
@@ -194,6 +238,8 @@ public:
   /**
    * \brief Loads the branching structure of a pre-trained decision forest from a file on disk.
    *
+   * The file can be either in binary format (see save_structure_to_binary_file) or in text format: the format is detected automatically.
+   *
    * \param filename  The path to the file containing the forest.
    *
    * \throws std::runtime_error If the forest cannot be loaded.
@@ -214,6 +260,19 @@ public:
    */
   void load_structure_from_file(const std::string& filename);
 
+  /**
+   * \brief Saves the branching structure of the decision forest to a file on disk in binary format.
+   *
+   * The binary format stores the node image exactly as it is laid out in memory, together with checksums that are verified
+   * on loading. Forests in this format can be loaded by memory-mapping the file and copying the node image across as a
+   * single block, which is much faster than parsing the equivalent text file.
+   *
+   * \param filename  The path to the file to which to save the forest.
+   *
+   * \throws std::runtime_error If the forest cannot be saved.
+   */
+  void save_structure_to_binary_file(const std::string& filename) const;
+
   /**
    * \brief Saves the branching structure of the decision forest to a file on disk.
    *
@@ -261,6 +320,59 @@ private:
    */
   int create_node(uint32_t treeIdx, uint32_t nbTrees, uint32_t depthLeft, uint32_t outputIdx,
                   uint32_t outputFirstFreeIdx, NodeEntry *outputNodes, uint32_t& outputNbLeaves);
+
+  /**
+   * \brief Loads the branching structure of a pre-trained decision forest from a file on disk in binary format.
+   *
+   * \param filename  The path to the file containing the forest.
+   *
+   * \throws std::runtime_error If the forest cannot be loaded.
+   */
+  void load_structure_from_binary_file(const std::string& filename);
+
+  /**
+   * \brief Loads the branching structure of a pre-trained decision forest from a file on disk in text format.
+   *
+   * \param filename  The path to the file containing the forest.
+   *
+   * \throws std::runtime_error If the forest cannot be loaded.
+   */
+  void load_structure_from_text_file(const std::string& filename);
+
+  /**
+   * \brief Replaces the feature indices and thresholds of all of the nodes in the forest with random ones.
+   *
+   * \note  This is only used when the forest is loaded with RANDOM_FEATURES enabled, and is applied in the same way
+   *        whether the forest was loaded from a text file or a binary one.
+   */
+  void randomise_features();
+
+  //#################### PRIVATE STATIC MEMBER FUNCTIONS ####################
+private:
+  /**
+   * \brief Computes the CRC-32 checksum of a block of memory.
+   *
+   * \param data The block of memory.
+   * \param size The size of the block of memory (in bytes).
+   * \return     The CRC-32 checksum of the block of memory.
+   */
+  static uint32_t compute_checksum(const void *data, size_t size);
+
+  /**
+   * \brief Gets whether or not the specified file is a forest file in binary format.
+   *
+   * \param filename The path to the file.
+   * \return         true, if the file starts with the magic bytes of the binary format, or false otherwise.
+   */
+  static bool is_binary_file(const std::string& filename);
+
+  /**
+   * \brief Makes a header for a forest file in binary format (all fields except the checksums are filled in).
+   *
+   * \param maxNbNodes The maximum number of nodes in any tree of the forest.
+   * \return           The header.
+   */
+  static BinaryFileHeader make_binary_file_header(uint32_t maxNbNodes);
 };
 
 }
@@ -5,8 +5,13 @@
 
 #include "DecisionForest.h"
 
+#include <cstddef>
+#include <cstring>
 #include <fstream>
 
+#include <boost/crc.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include <boost/lexical_cast.hpp>
 
 #ifdef WITH_SCOREFORESTS
@@ -221,117 +226,44 @@ uint32_t DecisionForest<DescriptorType,TreeCount>::get_nb_trees() const
 template <typename DescriptorType, int TreeCount>
 void DecisionForest<DescriptorType,TreeCount>::load_structure_from_file(const std::string& filename)
 {
-  // Clear the current forest.
-  m_nodeImage.reset();
-  m_nbNodesPerTree.clear();
-  m_nbLeavesPerTree.clear();
-  m_nbTotalLeaves = 0;
-
-  std::ifstream in(filename.c_str());
-  if(!in) throw std::runtime_error("Couldn't load a forest from: " + filename);
-
-  // Check that the number of trees is the same as the template instantiation.
-  uint32_t nbTrees;
-  in >> nbTrees;
-  if(!in || nbTrees != get_nb_trees())
-  {
-    throw std::runtime_error(
-      "Number of trees of the loaded forest is incorrect. Should be " +
-      boost::lexical_cast<std::string>(get_nb_trees()) + " - Read: " +
-      boost::lexical_cast<std::string>(nbTrees)
-    );
-  }
-
-  // Used to allocate the indexing texture (height = the maximum number of nodes, width = nbTrees).
-  uint32_t maxNbNodes = 0;
-
-  // For each tree, first read the number of nodes, then the number of leaves.
-  for(uint32_t i = 0; i < nbTrees; ++i)
-  {
-    uint32_t nbNodes, nbLeaves;
-    in >> nbNodes >> nbLeaves;
-
-    if(!in) throw std::runtime_error("Error reading the dimensions of tree: " + boost::lexical_cast<std::string>(i));
-
-    m_nbNodesPerTree.push_back(nbNodes);
-    m_nbLeavesPerTree.push_back(nbLeaves);
+  if(is_binary_file(filename)) load_structure_from_binary_file(filename);
+  else load_structure_from_text_file(filename);
+}
 
-    maxNbNodes = std::max(nbNodes, maxNbNodes);
-    m_nbTotalLeaves += nbLeaves;
-  }
+template <typename DescriptorType, int TreeCount>
+void DecisionForest<DescriptorType,TreeCount>::save_structure_to_binary_file(const std::string& filename) const
+{
+  const uint32_t nbTrees = get_nb_trees();
+  const uint32_t maxNbNodes = static_cast<uint32_t>(m_nodeImage->noDims.y);
+  BinaryFileHeader header = make_binary_file_header(maxNbNodes);
 
-  std::cout << "Loading a forest with " << nbTrees << " trees.\n";
+  // Make the table containing the number of nodes and the number of leaves in each tree.
+  std::vector<uint32_t> treeTable;
   for(uint32_t i = 0; i < nbTrees; ++i)
   {
-    std::cout << "\tTree " << i << ": " << m_nbNodesPerTree[i] << " nodes and " << m_nbLeavesPerTree[i] << " leaves.\n";
+    treeTable.push_back(m_nbNodesPerTree[i]);
+    treeTable.push_back(m_nbLeavesPerTree[i]);
   }
 
-  // Allocate and clear the node image.
-  const orx::MemoryBlockFactory& mbf = orx::MemoryBlockFactory::instance();
-  m_nodeImage = mbf.make_image<NodeEntry>(Vector2i(nbTrees, maxNbNodes));
-  m_nodeImage->Clear();
-
-#if RANDOM_FEATURES
-  tvgutil::RandomNumberGenerator rng(42);
-#endif
-
-  // Read all the nodes from the file.
-  NodeEntry *forestNodes = m_nodeImage->GetData(MEMORYDEVICE_CPU);
-  for(uint32_t treeIdx = 0; treeIdx < nbTrees; ++treeIdx)
-  {
-    for(uint32_t nodeIdx = 0; nodeIdx < m_nbNodesPerTree[treeIdx]; ++nodeIdx)
-    {
-      NodeEntry &node = forestNodes[nodeIdx * nbTrees + treeIdx];
-      in >> node.leftChildIdx >> node.leafIdx >> node.featureIdx >> node.featureThreshold;
+  // Compute the checksums.
+  const size_t treeTableSize = treeTable.size() * sizeof(uint32_t);
+  const size_t nodeDataSize = static_cast<size_t>(maxNbNodes) * nbTrees * sizeof(NodeEntry);
+  const NodeEntry *forestNodes = m_nodeImage->GetData(MEMORYDEVICE_CPU);
+  header.treeTableChecksum = compute_checksum(&treeTable[0], treeTableSize);
+  header.nodeDataChecksum = compute_checksum(forestNodes, nodeDataSize);
+  header.headerChecksum = compute_checksum(&header, offsetof(BinaryFileHeader, headerChecksum));
 
-      if(!in)
-      {
-        throw std::runtime_error(
-          "Error reading node " + boost::lexical_cast<std::string>(nodeIdx) + " of tree " +
-          boost::lexical_cast<std::string>(treeIdx)
-        );
-      }
+  // Write the header, the tree table and the node image (padded so that the node image starts at the specified offset).
+  std::ofstream out(filename.c_str(), std::ios::binary);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(BinaryFileHeader));
+  out.write(reinterpret_cast<const char*>(&treeTable[0]), treeTableSize);
 
-#if RANDOM_FEATURES
-      // The magic numbers mimic the distribution found in the pre-trained office forest.
-      bool depthFeature = rng.generate_real_from_uniform(0.f, 1.f) < 0.3886f;
+  const std::vector<char> padding(header.nodeDataOffset - sizeof(BinaryFileHeader) - treeTableSize, 0);
+  if(!padding.empty()) out.write(&padding[0], padding.size());
 
-      if(depthFeature)
-      {
-        node.featureIdx = rng.generate_int_from_uniform(0, 127);
+  out.write(reinterpret_cast<const char*>(forestNodes), nodeDataSize);
 
-        float depthMu = 20.09f;
-        float depthSigma = 947.24f;
-        node.featureThreshold = rng.generate_from_gaussian(depthMu, depthSigma);
-      }
-      else
-      {
-        node.featureIdx = rng.generate_int_from_uniform(128, 255);
-
-        float rgbMu = -2.85f;
-        float rgbSigma = 72.98f;
-        node.featureThreshold = rng.generate_from_gaussian(rgbMu, rgbSigma);
-      }
-
-//      int minRGBFeature = -100;
-//      int maxRGBFeature = 100;
-//      int minDepthFeature = -600;
-//      int maxDepthFeature = 600;
-//      node.featureIdx = rng.generate_int_from_uniform(0, RGBDPatchFeature::FEATURE_SIZE - 1);
-//      if(node.featureIdx < RGBDPatchFeature::RGB_OFFSET)
-//      {
-//        node.featureThreshold = rng.generate_int_from_uniform(minDepthFeature, maxDepthFeature);
-//      }
-//      else
-//      {
-//        node.featureThreshold = rng.generate_int_from_uniform(minRGBFeature, maxRGBFeature);
-//      }
-#endif
-    }
-  }
-
-  // Ensure that the node image is available on the GPU (if we're using it).
-  m_nodeImage->UpdateDeviceFromHost();
+  if(!out) throw std::runtime_error("Error saving the forest to a file: " + filename);
 }
 
 template <typename DescriptorType, int TreeCount>
@@ -467,4 +399,286 @@ int DecisionForest<DescriptorType,TreeCount>::create_node(uint32_t treeIdx, uint
   return outputFirstFreeIdx;
 }
 
+template <typename DescriptorType, int TreeCount>
+void DecisionForest<DescriptorType,TreeCount>::load_structure_from_binary_file(const std::string& filename)
+{
+  // Clear the current forest.
+  m_nodeImage.reset();
+  m_nbNodesPerTree.clear();
+  m_nbLeavesPerTree.clear();
+  m_nbTotalLeaves = 0;
+
+  // Memory-map the file.
+  boost::interprocess::mapped_region region;
+  try
+  {
+    boost::interprocess::file_mapping mapping(filename.c_str(), boost::interprocess::read_only);
+    boost::interprocess::mapped_region(mapping, boost::interprocess::read_only).swap(region);
+  }
+  catch(boost::interprocess::interprocess_exception&)
+  {
+    throw std::runtime_error("Couldn't load a forest from: " + filename);
+  }
+
+  const char *fileData = static_cast<const char*>(region.get_address());
+  const size_t fileSize = region.get_size();
+
+  // Read the header, and check that it is intact and compatible with the template instantiation.
+  BinaryFileHeader header;
+  if(fileSize < sizeof(BinaryFileHeader)) throw std::runtime_error("The forest file is truncated: " + filename);
+  memcpy(&header, fileData, sizeof(BinaryFileHeader));
+
+  if(header.headerChecksum != compute_checksum(&header, offsetof(BinaryFileHeader, headerChecksum)))
+  {
+    throw std::runtime_error("The header of the forest file is corrupt: " + filename);
+  }
+
+  const BinaryFileHeader expectedHeader = make_binary_file_header(header.maxNbNodes);
+  if(header.version != expectedHeader.version)
+  {
+    throw std::runtime_error(
+      "Unsupported forest file version. Should be " + boost::lexical_cast<std::string>(expectedHeader.version) +
+      " - Read: " + boost::lexical_cast<std::string>(header.version)
+    );
+  }
+
+  if(header.byteOrderMarker != expectedHeader.byteOrderMarker || header.nodeEntrySize != expectedHeader.nodeEntrySize)
+  {
+    throw std::runtime_error("The forest file was written on an incompatible platform: " + filename);
+  }
+
+  if(header.nbTrees != get_nb_trees())
+  {
+    throw std::runtime_error(
+      "Number of trees of the loaded forest is incorrect. Should be " +
+      boost::lexical_cast<std::string>(get_nb_trees()) + " - Read: " +
+      boost::lexical_cast<std::string>(header.nbTrees)
+    );
+  }
+
+  // Check that the file is large enough to contain the tree table and the node image.
+  const uint32_t nbTrees = header.nbTrees;
+  const size_t treeTableSize = 2 * nbTrees * sizeof(uint32_t);
+  const boost::uint64_t nodeDataSize = static_cast<boost::uint64_t>(header.maxNbNodes) * nbTrees * sizeof(NodeEntry);
+  if(header.nodeDataOffset < sizeof(BinaryFileHeader) + treeTableSize || header.nodeDataOffset + nodeDataSize > fileSize)
+  {
+    throw std::runtime_error("The forest file is truncated: " + filename);
+  }
+
+  // Read the number of nodes and the number of leaves in each tree.
+  const uint32_t *treeTable = reinterpret_cast<const uint32_t*>(fileData + sizeof(BinaryFileHeader));
+  if(header.treeTableChecksum != compute_checksum(treeTable, treeTableSize))
+  {
+    throw std::runtime_error("The tree table of the forest file is corrupt: " + filename);
+  }
+
+  for(uint32_t i = 0; i < nbTrees; ++i)
+  {
+    const uint32_t nbNodes = treeTable[2 * i], nbLeaves = treeTable[2 * i + 1];
+    if(nbNodes > header.maxNbNodes) throw std::runtime_error("Error reading the dimensions of tree: " + boost::lexical_cast<std::string>(i));
+
+    m_nbNodesPerTree.push_back(nbNodes);
+    m_nbLeavesPerTree.push_back(nbLeaves);
+    m_nbTotalLeaves += nbLeaves;
+  }
+
+  std::cout << "Loading a forest with " << nbTrees << " trees.\n";
+  for(uint32_t i = 0; i < nbTrees; ++i)
+  {
+    std::cout << "\tTree " << i << ": " << m_nbNodesPerTree[i] << " nodes and " << m_nbLeavesPerTree[i] << " leaves.\n";
+  }
+
+  // Check the node image, and copy it across as a single block (it is already in the in-memory layout, so no parsing is needed).
+  const char *nodeData = fileData + header.nodeDataOffset;
+  if(header.nodeDataChecksum != compute_checksum(nodeData, nodeDataSize))
+  {
+    throw std::runtime_error("The nodes of the forest file are corrupt: " + filename);
+  }
+
+  const orx::MemoryBlockFactory& mbf = orx::MemoryBlockFactory::instance();
+  m_nodeImage = mbf.make_image<NodeEntry>(Vector2i(nbTrees, header.maxNbNodes));
+  memcpy(m_nodeImage->GetData(MEMORYDEVICE_CPU), nodeData, nodeDataSize);
+
+#if RANDOM_FEATURES
+  // Replace the loaded feature indices and thresholds with random ones (exactly as for a forest loaded from a text file).
+  randomise_features();
+#endif
+
+  // Ensure that the node image is available on the GPU (if we're using it).
+  m_nodeImage->UpdateDeviceFromHost();
+}
+
+template <typename DescriptorType, int TreeCount>
+void DecisionForest<DescriptorType,TreeCount>::load_structure_from_text_file(const std::string& filename)
+{
+  // Clear the current forest.
+  m_nodeImage.reset();
+  m_nbNodesPerTree.clear();
+  m_nbLeavesPerTree.clear();
+  m_nbTotalLeaves = 0;
+
+  std::ifstream in(filename.c_str());
+  if(!in) throw std::runtime_error("Couldn't load a forest from: " + filename);
+
+  // Check that the number of trees is the same as the template instantiation.
+  uint32_t nbTrees;
+  in >> nbTrees;
+  if(!in || nbTrees != get_nb_trees())
+  {
+    throw std::runtime_error(
+      "Number of trees of the loaded forest is incorrect. Should be " +
+      boost::lexical_cast<std::string>(get_nb_trees()) + " - Read: " +
+      boost::lexical_cast<std::string>(nbTrees)
+    );
+  }
+
+  // Used to allocate the indexing texture (height = the maximum number of nodes, width = nbTrees).
+  uint32_t maxNbNodes = 0;
+
+  // For each tree, first read the number of nodes, then the number of leaves.
+  for(uint32_t i = 0; i < nbTrees; ++i)
+  {
+    uint32_t nbNodes, nbLeaves;
+    in >> nbNodes >> nbLeaves;
+
+    if(!in) throw std::runtime_error("Error reading the dimensions of tree: " + boost::lexical_cast<std::string>(i));
+
+    m_nbNodesPerTree.push_back(nbNodes);
+    m_nbLeavesPerTree.push_back(nbLeaves);
+
+    maxNbNodes = std::max(nbNodes, maxNbNodes);
+    m_nbTotalLeaves += nbLeaves;
+  }
+
+  std::cout << "Loading a forest with " << nbTrees << " trees.\n";
+  for(uint32_t i = 0; i < nbTrees; ++i)
+  {
+    std::cout << "\tTree " << i << ": " << m_nbNodesPerTree[i] << " nodes and " << m_nbLeavesPerTree[i] << " leaves.\n";
+  }
+
+  // Allocate and clear the node image.
+  const orx::MemoryBlockFactory& mbf = orx::MemoryBlockFactory::instance();
+  m_nodeImage = mbf.make_image<NodeEntry>(Vector2i(nbTrees, maxNbNodes));
+  m_nodeImage->Clear();
+
+  // Read all the nodes from the file.
+  NodeEntry *forestNodes = m_nodeImage->GetData(MEMORYDEVICE_CPU);
+  for(uint32_t treeIdx = 0; treeIdx < nbTrees; ++treeIdx)
+  {
+    for(uint32_t nodeIdx = 0; nodeIdx < m_nbNodesPerTree[treeIdx]; ++nodeIdx)
+    {
+      NodeEntry &node = forestNodes[nodeIdx * nbTrees + treeIdx];
+      in >> node.leftChildIdx >> node.leafIdx >> node.featureIdx >> node.featureThreshold;
+
+      if(!in)
+      {
+        throw std::runtime_error(
+          "Error reading node " + boost::lexical_cast<std::string>(nodeIdx) + " of tree " +
+          boost::lexical_cast<std::string>(treeIdx)
+        );
+      }
+    }
+  }
+
+#if RANDOM_FEATURES
+  // Replace the loaded feature indices and thresholds with random ones.
+  randomise_features();
+#endif
+
+  // Ensure that the node image is available on the GPU (if we're using it).
+  m_nodeImage->UpdateDeviceFromHost();
+}
+
+template <typename DescriptorType, int TreeCount>
+void DecisionForest<DescriptorType,TreeCount>::randomise_features()
+{
+  tvgutil::RandomNumberGenerator rng(42);
+
+  const uint32_t nbTrees = get_nb_trees();
+  NodeEntry *forestNodes = m_nodeImage->GetData(MEMORYDEVICE_CPU);
+  for(uint32_t treeIdx = 0; treeIdx < nbTrees; ++treeIdx)
+  {
+    for(uint32_t nodeIdx = 0; nodeIdx < m_nbNodesPerTree[treeIdx]; ++nodeIdx)
+    {
+      NodeEntry &node = forestNodes[nodeIdx * nbTrees + treeIdx];
+
+      // The magic numbers mimic the distribution found in the pre-trained office forest.
+      bool depthFeature = rng.generate_real_from_uniform(0.f, 1.f) < 0.3886f;
+
+      if(depthFeature)
+      {
+        node.featureIdx = rng.generate_int_from_uniform(0, 127);
+
+        float depthMu = 20.09f;
+        float depthSigma = 947.24f;
+        node.featureThreshold = rng.generate_from_gaussian(depthMu, depthSigma);
+      }
+      else
+      {
+        node.featureIdx = rng.generate_int_from_uniform(128, 255);
+
+        float rgbMu = -2.85f;
+        float rgbSigma = 72.98f;
+        node.featureThreshold = rng.generate_from_gaussian(rgbMu, rgbSigma);
+      }
+
+//      int minRGBFeature = -100;
+//      int maxRGBFeature = 100;
+//      int minDepthFeature = -600;
+//      int maxDepthFeature = 600;
+//      node.featureIdx = rng.generate_int_from_uniform(0, RGBDPatchFeature::FEATURE_SIZE - 1);
+//      if(node.featureIdx < RGBDPatchFeature::RGB_OFFSET)
+//      {
+//        node.featureThreshold = rng.generate_int_from_uniform(minDepthFeature, maxDepthFeature);
+//      }
+//      else
+//      {
+//        node.featureThreshold = rng.generate_int_from_uniform(minRGBFeature, maxRGBFeature);
+//      }
+    }
+  }
+}
+
+//#################### PRIVATE STATIC MEMBER FUNCTIONS ####################
+
+template <typename DescriptorType, int TreeCount>
+uint32_t DecisionForest<DescriptorType,TreeCount>::compute_checksum(const void *data, size_t size)
+{
+  boost::crc_32_type crc;
+  crc.process_bytes(data, size);
+  return crc.checksum();
+}
+
+template <typename DescriptorType, int TreeCount>
+bool DecisionForest<DescriptorType,TreeCount>::is_binary_file(const std::string& filename)
+{
+  const BinaryFileHeader expectedHeader = make_binary_file_header(0);
+  char magic[sizeof(expectedHeader.magic)];
+
+  std::ifstream in(filename.c_str(), std::ios::binary);
+  return in.read(magic, sizeof(magic)) && memcmp(magic, expectedHeader.magic, sizeof(magic)) == 0;
+}
+
+template <typename DescriptorType, int TreeCount>
+typename DecisionForest<DescriptorType,TreeCount>::BinaryFileHeader
+DecisionForest<DescriptorType,TreeCount>::make_binary_file_header(uint32_t maxNbNodes)
+{
+  BinaryFileHeader header;
+  memset(&header, 0, sizeof(BinaryFileHeader));
+
+  memcpy(header.magic, "GROVEDF", sizeof(header.magic));
+  header.version = 1;
+  header.byteOrderMarker = 0x01020304;
+  header.nbTrees = TREE_COUNT;
+  header.maxNbNodes = maxNbNodes;
+  header.nodeEntrySize = sizeof(NodeEntry);
+
+  // Align the node image to a 64-byte boundary, so that it's suitably aligned for direct access when the file is memory-mapped.
+  const uint32_t alignment = 64;
+  const uint32_t treeTableEnd = static_cast<uint32_t>(sizeof(BinaryFileHeader) + 2 * TREE_COUNT * sizeof(uint32_t));
+  header.nodeDataOffset = (treeTableEnd + alignment - 1) / alignment * alignment;
+
+  return header;
+}
+
 }
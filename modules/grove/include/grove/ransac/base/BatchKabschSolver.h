@@ -0,0 +1,98 @@
+/**
+ * grove: BatchKabschSolver.h
+ * Copyright (c) Torr Vision Group, University of Oxford, 2019. All rights reserved.
+ */
+
+#ifndef H_GROVE_BATCHKABSCHSOLVER
+#define H_GROVE_BATCHKABSCHSOLVER
+
+#include <vector>
+
+#include "../shared/PoseCandidate.h"
+
+namespace grove {
+
+/**
+ * \brief An instance of this class can be used to estimate the poses of a batch of pose candidates from their camera/world point
+ *        correspondences, by solving the Kabsch problems for many candidates simultaneously.
+ *
+ * Rather than computing an SVD for each candidate, the solver uses Horn's closed-form quaternion method: the rotation corresponds
+ * to the eigenvector associated with the largest eigenvalue of a 4x4 key matrix built from the cross-covariance of the centred
+ * points. As in the QCP method, the eigenvalue is found using Newton-Raphson on the key matrix's characteristic polynomial,
+ * and the eigenvector is read off the adjugate of the shifted key matrix. See:
+ *
+ * "Closed-form solution of absolute orientation using unit quaternions" (Horn, JOSA A, 1987)
+ * "Rapid calculation of RMSDs using a quaternion-based characteristic polynomial" (Theobald, Acta Crystallographica A, 2005)
+ *
+ * The correspondences are gathered into a structure-of-arrays layout and processed in fixed-size blocks, so that the compiler
+ * can vectorise most of the computation across candidates. The Newton-Raphson iterations are run until they converge (up to a
+ * maximum number of iterations). The (rare) candidates for which the largest eigenvalue does not converge, or is not simple
+ * (e.g. those with collinear points), are handed to the SVD-based implementation in orx::GeometryUtil instead.
+ *
+ * Before solving, the solver can also apply a geometric pre-filter that rejects the candidates whose camera or world triangles
+ * are too close to being degenerate for the poses estimated from them to be meaningful.
+ */
+class BatchKabschSolver
+{
+  //#################### CONSTANTS ####################
+private:
+  /** The number of candidates processed together by the vectorised loops. */
+  enum { BLOCK_SIZE = 64 };
+
+  /** The number of coordinates in the three correspondences of a candidate (in each space). */
+  enum { COORD_COUNT = 3 * PoseCandidate::KABSCH_CORRESPONDENCES_NEEDED };
+
+  //#################### PRIVATE VARIABLES ####################
+private:
+  /** The camera-space coordinates of the candidates' correspondences (one array per point coordinate, padded to a whole number of blocks). */
+  std::vector<float> m_cameraCoords[COORD_COUNT];
+
+  /** Flags indicating whether the pose of each candidate needs to be estimated using the SVD-based fallback. */
+  std::vector<unsigned char> m_fallbackFlags;
+
+  /** The minimum area (in m^2) that the camera and world triangles of a candidate must have for it to pass the pre-filter. */
+  float m_minTriangleArea;
+
+  /** The estimated poses (one array per element of the top three rows of the pose matrices, in row-major order). */
+  std::vector<float> m_poses[12];
+
+  /** Flags indicating whether each candidate passed the geometric pre-filter. */
+  std::vector<unsigned char> m_validFlags;
+
+  /** The world-space coordinates of the candidates' correspondences (one array per point coordinate, padded to a whole number of blocks). */
+  std::vector<float> m_worldCoords[COORD_COUNT];
+
+  //#################### CONSTRUCTORS ####################
+public:
+  /**
+   * \brief Constructs a batch Kabsch solver.
+   *
+   * \param minTriangleArea The minimum area (in m^2) that the camera and world triangles of a candidate must have for it to pass
+   *                        the geometric pre-filter (a value of zero disables the pre-filter).
+   */
+  explicit BatchKabschSolver(float minTriangleArea = 0.0f);
+
+  //#################### PUBLIC MEMBER FUNCTIONS ####################
+public:
+  /**
+   * \brief Estimates the poses of a batch of pose candidates from their correspondences, and removes any candidates that fail the geometric pre-filter.
+   *
+   * \param candidates      The pose candidates. The surviving candidates are compacted to the front of the array (in their original order).
+   * \param candidateCount  The number of pose candidates.
+   * \return                The number of candidates that survived the pre-filter.
+   */
+  int solve(PoseCandidate *candidates, int candidateCount);
+
+  //#################### PRIVATE MEMBER FUNCTIONS ####################
+private:
+  /**
+   * \brief Applies the geometric pre-filter to, and estimates the poses for, a block of candidates.
+   *
+   * \param blockStart  The index of the first candidate in the block.
+   */
+  void solve_block(int blockStart);
+};
+
+}
+
+#endif
@@ -6,6 +6,8 @@
 #ifndef H_GROVE_PREEMPTIVERANSAC_CPU
 #define H_GROVE_PREEMPTIVERANSAC_CPU
 
+#include <vector>
+
 #include "../interface/PreemptiveRansac.h"
 #include "../../numbers/CPURNG.h"
 
@@ -24,12 +26,30 @@ class PreemptiveRansac_CPU : public PreemptiveRansac
 {
   //#################### PRIVATE VARIABLES ####################
 private:
+  /** The number of inliers over which to accumulate the energy of a candidate between checks of whether it can be culled early. */
+  uint32_t m_energyChunkSize;
+
+  /**
+   * Lower bounds on the energies that can be contributed by the suffixes of the inlier set over which the candidates' energies are
+   * being computed. The i-th element bounds the energy contributed by the inliers from m_nbInliersWithValidEnergies + i onwards.
+   */
+  std::vector<float> m_inlierEnergySuffixBounds;
+
+  /**
+   * For each position in the candidates array, the number of inliers over which the energy of the candidate in that position
+   * was averaged if that energy is only a lower bound (because the candidate was culled early), or 0 if its energy is exact.
+   */
+  std::vector<uint32_t> m_nbInliersForBoundedEnergies;
+
   /** The random number generators used during the P-RANSAC process. */
   CPURNGMemoryBlock_Ptr m_rngs;
 
   /** The seed used to initialise the random number generators. */
   uint32_t m_rngSeed;
 
+  /** Whether or not to cull the candidates using partial selection and bound-based early termination (rather than by fully sorting them). */
+  bool m_usePartialSelectionCulling;
+
   //#################### CONSTRUCTORS ####################
 public:
   /**
@@ -48,7 +68,10 @@ public:
   //#################### PROTECTED MEMBER FUNCTIONS ####################
 protected:
   /** Override */
-  virtual void compute_energies_and_sort();
+  virtual void complete_bounded_energies(std::vector<PoseCandidate>& poseCandidates) const;
+
+  /** Override */
+  virtual void compute_energies_and_cull(uint32_t keepCount);
 
   /** Override */
   virtual void generate_pose_candidates();
@@ -64,6 +87,30 @@ protected:
 
   //#################### PRIVATE MEMBER FUNCTIONS ####################
 private:
+  /**
+   * \brief Computes the energy of each pose candidate over all of the inliers, and then fully sorts the candidates.
+   *
+   * \note  This is the original culling approach, which is kept for comparison purposes.
+   */
+  void compute_energies_and_sort();
+
+  /**
+   * \brief Computes the sum of the energies contributed by a contiguous range of the inliers to the energy of a pose candidate.
+   *
+   * \param candidate      The pose candidate.
+   * \param inlierStartIdx The index (in the inlier set) of the first inlier in the range.
+   * \param inlierEndIdx   The index (in the inlier set) one past the last inlier in the range.
+   * \return               The sum of the energies contributed by the inliers in the range.
+   */
+  float compute_inlier_energy_sum(const PoseCandidate& candidate, uint32_t inlierStartIdx, uint32_t inlierEndIdx) const;
+
+  /**
+   * \brief Computes lower bounds on the energies that can be contributed by the suffixes of the inlier set that start at or after the specified inlier.
+   *
+   * \param firstInlierIdx The index (in the inlier set) of the first inlier to consider.
+   */
+  void compute_inlier_energy_suffix_bounds(uint32_t firstInlierIdx);
+
   /**
    * \brief Computes the energy of a single pose candidate.
    *
@@ -54,7 +54,7 @@ public:
   //#################### PROTECTED MEMBER FUNCTIONS ####################
 protected:
   /** Override */
-  virtual void compute_energies_and_sort();
+  virtual void compute_energies_and_cull(uint32_t keepCount);
 
   /** Override */
   virtual void generate_pose_candidates();
@@ -16,9 +16,10 @@
 #include <tvgutil/misc/SettingsContainer.h>
 #include <tvgutil/timing/AverageTimer.h>
 
+#include "../base/BatchKabschSolver.h"
 #include "../shared/PoseCandidate.h"
 #include "../../keypoints/Keypoint3DColour.h"
-#include "../../scoreforests/ScorePrediction.h"
+#include "../../scoreforests/ScoreModeIndices.h"
 
 //#################### FORWARD DECLARATIONS ####################
 
@@ -45,6 +46,24 @@ namespace grove {
  */
 class PreemptiveRansac
 {
+  //#################### ENUMERATIONS ####################
+public:
+  /**
+   * \brief The values of this enumeration denote the robust losses that can be applied to the point-to-mode error terms
+   *        when the surviving pose candidates are optimised using the native solver.
+   */
+  enum RobustLoss
+  {
+    /** A Cauchy loss, which strongly down-weights the error terms of points that are far from their modes. */
+    RL_CAUCHY,
+
+    /** A Huber loss, which is quadratic near the modes and linear beyond the loss scale. */
+    RL_HUBER,
+
+    /** No robust loss (i.e. the energy is simply the sum of the squared distances between the points and their modes). */
+    RL_NONE
+  };
+
   //#################### TYPEDEFS ####################
 public:
   typedef tvgutil::AverageTimer<boost::chrono::nanoseconds> AverageTimer;
@@ -68,6 +87,9 @@ private:
 
   //#################### PRIVATE VARIABLES ####################
 private:
+  /** The solver used to estimate the poses of the generated candidates in batches (if enabled). */
+  boost::shared_ptr<BatchKabschSolver> m_batchKabschSolver;
+
   /** Whether or not to print a summary of the timings of the various steps of preemptive RANSAC on destruction. */
   bool m_printTimers;
 
@@ -133,6 +155,19 @@ protected:
   /** The minimum distance (squared) between sampled modes (if m_checkMinDistanceBetweenSampledModes is enabled). */
   float m_minSquaredDistanceBetweenSampledModes;
 
+  /** An image storing the indices (in m_modePool) of the modes associated with the keypoints in m_keypointsImage. Not owned by this class. */
+  ScoreModeIndicesImage_CPtr m_modeIndicesImage;
+
+  /** The pool of modes into which the indices in m_modeIndicesImage point. Not owned by this class. */
+  ScorePredictionsMemoryBlock_CPtr m_modePool;
+
+  /**
+   * The number of (leading) inliers in m_inlierRasterIndicesBlock over which the energies currently stored in the pose candidates
+   * were computed. Since the inlier set only grows between resets, and the energy of a candidate is an average over the inliers,
+   * these energies can be reused as long as the candidates' poses have not been changed (e.g. by pose optimisation).
+   */
+  uint32_t m_nbInliersWithValidEnergies;
+
   /**
    * The maximum number of points that will be used as inliers during the preemptive RANSAC phase.
    * The actual number of inliers in use starts from m_ransacInliersPerIteration and increases by
@@ -167,15 +202,18 @@ protected:
   /** The modes used for the pose optimisation step. Each row represents the modes for a pose candidate. */
   Keypoint3DColourClusterMemoryBlock_Ptr m_poseOptimisationPredictedModes;
 
+  /** The robust loss to apply to the point-to-mode error terms during pose optimisation (native solver only). */
+  RobustLoss m_poseOptimisationRobustLoss;
+
+  /** The (unsquared) distance beyond which the robust loss starts to down-weight error terms (in m for L2, or in standard deviations for Mahalanobis). */
+  float m_poseOptimisationRobustLossScale;
+
   /** The value of the step norm that, if reached, will cause the pose optimisation to terminate. */
   double m_poseOptimisationStepThreshold;
 
   /** Whether or not to optimise the surviving poses after each preemptive RANSAC iteration. */
   bool m_poseUpdate;
 
-  /** An image storing the forest predictions associated with the keypoints in m_keypointsImage. Not owned by this class. */
-  ScorePredictionsImage_CPtr m_predictionsImage;
-
   /** The number of points to add to the inlier set after each preemptive RANSAC iteration. */
   uint32_t m_ransacInliersPerIteration;
 
@@ -185,6 +223,9 @@ protected:
   /** Whether or not to use every modal cluster in the leaves when generating pose hypotheses. */
   bool m_useAllModesPerLeafInPoseHypothesisGeneration;
 
+  /** Whether or not to optimise the poses using the native Levenberg-Marquardt solver (rather than ALGLIB). */
+  bool m_useNativePoseOptimiser;
+
   /** Whether or not to use Mahalanobis (rather than L2) distances to compute the energies during the pose optimisation step. */
   bool m_usePredictionCovarianceForPoseOptimization;
 
@@ -219,9 +260,16 @@ public:
   //#################### PROTECTED ABSTRACT MEMBER FUNCTIONS ####################
 protected:
   /**
-   * \brief Computes the energy associated with each remaining pose candidate and reranks them in non-decreasing energy order.
+   * \brief Computes the energy associated with each remaining pose candidate, and moves the keepCount candidates with the lowest
+   *        energies to the front of the candidates array (in no particular order, except that the best candidate comes first).
+   *
+   * \note  Implementations are free to compute only a lower bound on the energy of a candidate that cannot be among the best
+   *        keepCount candidates (provided that they also override complete_bounded_energies), and to reuse the energies
+   *        computed for the first m_nbInliersWithValidEnergies inliers.
+   *
+   * \param keepCount The number of candidates to keep.
    */
-  virtual void compute_energies_and_sort() = 0;
+  virtual void compute_energies_and_cull(uint32_t keepCount) = 0;
 
   /**
    * \brief Generates a certain number of camera pose hypotheses using the method described in the paper.
@@ -252,11 +300,16 @@ public:
   /**
    * \brief Attempts to estimate a 6DOF pose from a set of 3D keypoints and their associated SCoRe forest predictions using a preemptive RANSAC approach.
    *
+   * \note  The modes associated with each keypoint are not copied into a per-keypoint prediction, but are instead referred to by their indices
+   *        in a pool of modes (typically the predictions associated with the leaves of the forest).
+   *
    * \param keypointsImage    An image containing 3D keypoints computed from an RGB-D input image pair.
-   * \param predictionsImage  An image containing SCoRe forest predictions for each keypoint in the keypoints image.
+   * \param modeIndicesImage  An image containing the indices (in the mode pool) of the modes associated with each keypoint in the keypoints image.
+   * \param modePool          The pool of modes into which the mode indices point.
    * \return                  An estimated pose, if possible, or boost::none otherwise.
    */
-  boost::optional<PoseCandidate> estimate_pose(const Keypoint3DColourImage_CPtr& keypointsImage, const ScorePredictionsImage_CPtr& predictionsImage);
+  boost::optional<PoseCandidate> estimate_pose(const Keypoint3DColourImage_CPtr& keypointsImage, const ScoreModeIndicesImage_CPtr& modeIndicesImage,
+                                               const ScorePredictionsMemoryBlock_CPtr& modePool);
 
   /**
    * \brief Gets all of the candidate poses that survived the initial culling process, sorted in non-increasing order
@@ -264,6 +317,7 @@ public:
    *
    * \pre   This function should only be called after a prior call to estimate_pose.
    * \note  The first entry of the vector will be the candidate (if any) returned by estimate_pose.
+   * \note  The energies of the candidates are always exact, even if only lower bounds were needed to cull them.
    *
    * \param poseCandidates An output array that will be filled with the candidate poses that survived the initial culling process.
    */
@@ -278,10 +332,23 @@ public:
 
   //#################### PROTECTED MEMBER FUNCTIONS ####################
 protected:
+  /**
+   * \brief Replaces any lower-bound energies in a set of pose candidates copied out of the candidates array with their exact energies.
+   *
+   * \note  compute_energies_and_cull is allowed to store only a lower bound on the energy of a culled candidate. Culled candidates
+   *        can still be returned by get_best_poses, which uses this to make sure that the energies it returns are exact.
+   * \note  The default implementation does nothing (it is suitable for implementations that always compute exact energies).
+   *
+   * \param poseCandidates The pose candidates, in the same order as (and starting from the first element of) the candidates array.
+   */
+  virtual void complete_bounded_energies(std::vector<PoseCandidate>& poseCandidates) const;
+
   /**
    * \brief Runs the Kabsch algorithm on the three camera/world point correspondences of each generated pose candidate
    *        to obtain an estimate of the camera pose (a rigid transformation matrix from camera space to world space).
    *
+   * \note  If the batch Kabsch solver is enabled, any candidates that fail its geometric pre-filter are removed, and
+   *        m_poseCandidates->dataSize is updated accordingly.
    * \note  This will probably go away as soon as we implement a proper SVD solver that can run on both the CPU and GPU.
    */
   void compute_candidate_poses_kabsch();
@@ -305,6 +372,30 @@ protected:
 
   //#################### PRIVATE MEMBER FUNCTIONS ####################
 private:
+  /**
+   * \brief Attempts to update the pose of a candidate by minimising a non-linear energy using ALGLIB's Levenberg-Marquardt optimiser.
+   *
+   * \note  ALGLIB differentiates the energy numerically, which needs several extra energy evaluations per iteration.
+   *
+   * \param poseCandidate The pose candidate whose pose we want to optimise.
+   * \param pts           The inlier points to use for the energy computation.
+   * \return              true, if the optimisation succeeded, or false otherwise.
+   */
+  bool update_candidate_pose_alglib(PoseCandidate& poseCandidate, const PointsForLM& pts) const;
+
+  /**
+   * \brief Attempts to update the pose of a candidate by minimising a non-linear energy using a native Levenberg-Marquardt solver on SE(3).
+   *
+   * The solver uses the analytic Jacobians of the point-to-mode error terms to build the Gauss-Newton approximation of the Hessian
+   * at each iteration, and applies the configured robust loss via iteratively-reweighted least squares. Poses are updated by
+   * left-multiplying them by the rigid transformation corresponding to the computed step.
+   *
+   * \param poseCandidate The pose candidate whose pose we want to optimise.
+   * \param pts           The inlier points to use for the energy computation.
+   * \return              true, if the optimisation succeeded, or false otherwise.
+   */
+  bool update_candidate_pose_native(PoseCandidate& poseCandidate, const PointsForLM& pts) const;
+
   /**
    * \brief Makes sure that the host version of the pose candidates memory block contains up-to-date values.
    */
@@ -389,6 +480,24 @@ private:
    */
   static double compute_energy_mahalanobis(const ORUtils::SE3Pose& candidateCameraPose, const PointsForLM& pts, double *jac = NULL);
 
+  /**
+   * \brief Computes a robust energy for the specified candidate camera pose, together with (optionally) the corresponding normal equations.
+   *
+   * \note  The normal equations are those of the Gauss-Newton approximation of the reweighted problem (see update_candidate_pose_native).
+   *        To avoid a factor of two everywhere, the gradient and Hessian are those of half the energy.
+   *
+   * \param candidateCameraPose The candidate camera pose.
+   * \param pts                 The points.
+   * \param useMahalanobis      Whether to use Mahalanobis (rather than L2) distances to compute the error terms.
+   * \param robustLoss          The robust loss to apply to the error terms.
+   * \param robustLossScale     The scale of the robust loss.
+   * \param gradient            An optional location in which to store the 6D gradient of the energy with respect to a left-multiplied pose update.
+   * \param hessian             An optional location in which to store the corresponding 6x6 (row-major) Gauss-Newton Hessian.
+   * \return                    The energy.
+   */
+  static double compute_energy_robust(const Matrix4f& candidateCameraPose, const PointsForLM& pts, bool useMahalanobis, RobustLoss robustLoss,
+                                      float robustLossScale, double *gradient = NULL, double *hessian = NULL);
+
 #ifdef WITH_ALGLIB
   /**
    * \brief Makes an SE3 pose that corresponds to the specified 6D twist vector.
@@ -10,7 +10,7 @@
 
 #include "PoseCandidate.h"
 #include "../../keypoints/Keypoint3DColour.h"
-#include "../../scoreforests/ScorePrediction.h"
+#include "../../scoreforests/ScoreModeIndices.h"
 
 namespace grove {
 
@@ -32,7 +32,8 @@ enum
  *
  * \param candidatePose       The candidate camera pose (a rigid transformation from camera -> world coordinates).
  * \param keypoints           The 3D keypoints extracted from an RGB-D image pair.
- * \param predictions         The SCoRe forest predictions associated with the keypoints.
+ * \param modeIndices         The indices (in the mode pool) of the modes associated with the keypoints.
+ * \param modePool            The mode pool.
  * \param inlierRasterIndices The raster indices of the overall set of "inlier" keypoints.
  * \param nbInliers           The overall number of "inlier" keypoints.
  * \param inlierStartIdx      The array index of the first "inlier" keypoint in inlierIndices to use when computing the energy sum.
@@ -40,8 +41,8 @@ enum
  * \return                    The sum of the energies contributed by the "inlier" keypoints in the strided subset.
  */
 _CPU_AND_GPU_CODE_
-inline float compute_energy_sum_for_inlier_subset(const Matrix4f& candidatePose, const Keypoint3DColour *keypoints, const ScorePrediction *predictions,
-                                                  const int *inlierRasterIndices, uint32_t nbInliers, uint32_t inlierStartIdx, uint32_t inlierStep)
+inline float compute_energy_sum_for_inlier_subset(const Matrix4f& candidatePose, const Keypoint3DColour *keypoints, const ScoreModeIndices *modeIndices,
+                                                  const ScorePrediction *modePool, const int *inlierRasterIndices, uint32_t nbInliers, uint32_t inlierStartIdx, uint32_t inlierStep)
 {
   float energySum = 0.0f;
 
@@ -55,13 +56,13 @@ inline float compute_energy_sum_for_inlier_subset(const Matrix4f& candidatePose,
     // Compute the hypothesised position of the inlier in world space.
     const Vector3f inlierWorldCoordinates = candidatePose * inlierCameraCoordinates;
 
-    // Get the prediction associated with the inlier.
-    const ScorePrediction& pred = predictions[inlierRasterIdx];
+    // Get the indices of the modes associated with the inlier.
+    const ScoreModeIndices& inlierModeIndices = modeIndices[inlierRasterIdx];
 
     // Compute the energy for the inlier, which is based on the Mahalanobis distance between the hypothesised
     // position of the inlier (in world space) and the position of the closest predicted mode.
     float energy;
-    int argmax = find_closest_mode(inlierWorldCoordinates, pred, energy);
+    int argmax = find_closest_mode(inlierWorldCoordinates, inlierModeIndices, modePool, energy);
 
     // We expect the inlier to have had at least one valid mode (this is guaranteed by the inlier sampling process).
     // If this isn't the case for some reason, defensively throw.
@@ -77,7 +78,8 @@ inline float compute_energy_sum_for_inlier_subset(const Matrix4f& candidatePose,
 
     // We expect the best mode to have at least some inliers (this is guaranteed by the clustering process).
     // If this isn't the case for some reason, defensively throw.
-    if(pred.elts[argmax].nbInliers == 0)
+    const Keypoint3DColourCluster& bestMode = get_pooled_mode(modePool, inlierModeIndices.elts[argmax]);
+    if(bestMode.nbInliers == 0)
     {
 #if defined(__CUDACC__) && defined(__CUDA_ARCH__)
       printf("mode has no inliers\n");
@@ -88,8 +90,8 @@ inline float compute_energy_sum_for_inlier_subset(const Matrix4f& candidatePose,
     }
 
     // Assuming we have found a best mode and it has at least some inliers, appropriately normalise the energy.
-    energy /= static_cast<float>(pred.size);
-    energy /= static_cast<float>(pred.elts[argmax].nbInliers);
+    energy /= static_cast<float>(inlierModeIndices.size);
+    energy /= static_cast<float>(bestMode.nbInliers);
 
     // Compute the negative log of the energy (after first ensuring that it isn't too small for this to work).
     if(energy < 1e-6f) energy = 1e-6f;
@@ -107,30 +109,66 @@ inline float compute_energy_sum_for_inlier_subset(const Matrix4f& candidatePose,
  *
  * \param candidatePose       The candidate camera pose (a rigid transformation from camera -> world coordinates).
  * \param keypoints           The 3D keypoints extracted from an RGB-D image pair.
- * \param predictions         The SCoRe forest predictions associated with the keypoints.
+ * \param modeIndices         The indices (in the mode pool) of the modes associated with the keypoints.
+ * \param modePool            The mode pool.
  * \param inlierRasterIndices The raster indices of the "inlier" keypoints that we will use to compute the energy sum.
  * \param nbInliers           The number of "inlier" keypoints.
  * \return                    The sum of the energies contributed by the "inlier" keypoints.
  */
 _CPU_AND_GPU_CODE_
-inline float compute_energy_sum_for_inliers(const Matrix4f& candidatePose, const Keypoint3DColour *keypoints, const ScorePrediction *predictions,
-                                            const int *inlierRasterIndices, uint32_t nbInliers)
+inline float compute_energy_sum_for_inliers(const Matrix4f& candidatePose, const Keypoint3DColour *keypoints, const ScoreModeIndices *modeIndices,
+                                            const ScorePrediction *modePool, const int *inlierRasterIndices, uint32_t nbInliers)
 {
   const uint32_t inlierStartIdx = 0;
   const uint32_t inlierStep = 1;
-  return compute_energy_sum_for_inlier_subset(candidatePose, keypoints, predictions, inlierRasterIndices, nbInliers, inlierStartIdx, inlierStep);
+  return compute_energy_sum_for_inlier_subset(candidatePose, keypoints, modeIndices, modePool, inlierRasterIndices, nbInliers, inlierStartIdx, inlierStep);
+}
+
+/**
+ * \brief Computes a lower bound on the energy that an "inlier" keypoint can contribute to the energy sum of any candidate camera pose.
+ *
+ * \note  The energy contributed by an inlier is the negative log of the normalised density of its closest mode at its hypothesised position
+ *        (see compute_energy_sum_for_inlier_subset). This density is at most the Gaussian normalisation factor of the mode divided by the
+ *        number of modes, so the energy is bounded below by the negative log of the largest such value among the inlier's modes.
+ *
+ * \param inlierRasterIdx The raster index of the "inlier" keypoint.
+ * \param modeIndices     The indices (in the mode pool) of the modes associated with the keypoints.
+ * \param modePool        The mode pool.
+ * \return                A lower bound on the energy that the "inlier" keypoint can contribute to the energy sum of any candidate camera pose.
+ */
+_CPU_AND_GPU_CODE_
+inline float compute_energy_lower_bound_for_inlier(int inlierRasterIdx, const ScoreModeIndices *modeIndices, const ScorePrediction *modePool)
+{
+  const float exponent = powf(2.0f * static_cast<float>(M_PI), 3);
+  const ScoreModeIndices& inlierModeIndices = modeIndices[inlierRasterIdx];
+
+  // Find the largest normalisation factor among the inlier's modes.
+  float maxEnergy = 0.0f;
+  for(int i = 0; i < inlierModeIndices.size; ++i)
+  {
+    const Keypoint3DColourCluster& mode = get_pooled_mode(modePool, inlierModeIndices.elts[i]);
+    maxEnergy = fmaxf(maxEnergy, 1.0f / sqrtf(mode.determinant * exponent));
+  }
+
+  // Normalise it as the energy itself would be normalised, and clamp it in the same way.
+  maxEnergy /= static_cast<float>(inlierModeIndices.size);
+  if(maxEnergy < 1e-6f) maxEnergy = 1e-6f;
+
+  // Slightly loosen the bound to make sure that rounding errors cannot make it exceed the actual energy.
+  return -log10f(maxEnergy) - 1e-4f;
 }
 
 /**
  * \brief Tries to generate a camera pose candidate using the method described in the paper.
  *
  * \param keypointsData                                 The 3D keypoints extracted from an RGB-D image pair.
- * \param predictionsData                               The SCoRe predictions associated with the keypoints.
- * \param imgSize                                       The size of the input keypoints and predictions images.
+ * \param modeIndicesData                               The indices (in the mode pool) of the modes associated with the keypoints.
+ * \param modePool                                      The mode pool.
+ * \param imgSize                                       The size of the input keypoints and mode indices images.
  * \param rng                                           Either a CPURNG or a CUDARNG, depending on the current device type.
  * \param poseCandidate                                 The variable in which the generated pose candidate (if any) will be stored.
  * \param maxCandidateGenerationIterations              The maximum number of iterations in the candidate generation step.
- * \param useAllModesPerLeafInPoseHypothesisGeneration  Whether or not to use all modes in the predictions when generating the pose hypothesis, rather than just the first one.
+ * \param useAllModesPerLeafInPoseHypothesisGeneration  Whether or not to use all modes of each keypoint when generating the pose hypothesis, rather than just the first one.
  * \param checkMinDistanceBetweenSampledModes           Whether or not to check that sampled modes have a minimum distance between each other.
  * \param minSqDistanceBetweenSampledModes              The minimum squared distance between sampled modes if the above parameter is true.
  * \param checkRigidTransformationConstraint            Whether or not to check that the selected modes define a quasi-rigid transformation.
@@ -141,7 +179,7 @@ inline float compute_energy_sum_for_inliers(const Matrix4f& candidatePose, const
  */
 template <typename RNG>
 _CPU_AND_GPU_CODE_TEMPLATE_
-inline bool generate_pose_candidate(const Keypoint3DColour *keypointsData, const ScorePrediction *predictionsData, const Vector2i& imgSize,
+inline bool generate_pose_candidate(const Keypoint3DColour *keypointsData, const ScoreModeIndices *modeIndicesData, const ScorePrediction *modePool, const Vector2i& imgSize,
                                     RNG& rng, PoseCandidate& poseCandidate, uint32_t maxCandidateGenerationIterations,
                                     bool useAllModesPerLeafInPoseHypothesisGeneration, bool checkMinDistanceBetweenSampledModes,
                                     float minSqDistanceBetweenSampledModes, bool checkRigidTransformationConstraint,
@@ -163,21 +201,23 @@ inline bool generate_pose_candidate(const Keypoint3DColour *keypointsData, const
     const Keypoint3DColour& keypoint = keypointsData[rasterIdx];
     if(!keypoint.valid) continue;
 
-    // Look up the SCoRe prediction associated with the pixel and check whether it has any modes. If not, skip this iteration of the loop and try again.
-    const ScorePrediction& prediction = predictionsData[rasterIdx];
-    if(prediction.size == 0) continue;
+    // Look up the modes associated with the pixel and check whether there are any. If not, skip this iteration of the loop and try again.
+    const ScoreModeIndices& modeIndices = modeIndicesData[rasterIdx];
+    if(modeIndices.size == 0) continue;
 
     // Choose which mode to use, depending on the parameters specified. This will either be the first mode, or a randomly-chosen one.
-    const int modeIdx = useAllModesPerLeafInPoseHypothesisGeneration ? rng.generate_int_from_uniform(0, prediction.size - 1) : 0;
+    // Note that we record the mode's index in the pool, rather than its position in the keypoint's list of modes.
+    const int modeIdx = modeIndices.elts[useAllModesPerLeafInPoseHypothesisGeneration ? rng.generate_int_from_uniform(0, modeIndices.size - 1) : 0];
+    const Keypoint3DColourCluster& mode = get_pooled_mode(modePool, modeIdx);
 
     // Cache the camera and world points to avoid repeated global reads (these are used multiple times in the following checks).
     const Vector3f cameraPt = keypoint.position;
-    const Vector3f worldPt = prediction.elts[modeIdx].position;
+    const Vector3f worldPt = mode.position;
 
     // If this is the first correspondence, check that the keypoint's colour is consistent with the mode's colour.
     if(correspondencesFound == 0)
     {
-      const Vector3i colourDiff = keypoint.colour.toInt() - prediction.elts[modeIdx].colour.toInt();
+      const Vector3i colourDiff = keypoint.colour.toInt() - mode.colour.toInt();
       const bool consistentColour = abs(colourDiff.x) <= MAX_COLOUR_DELTA && abs(colourDiff.y) <= MAX_COLOUR_DELTA && abs(colourDiff.z) <= MAX_COLOUR_DELTA;
 
       // If not, skip this iteration of the loop and try again.
@@ -191,10 +231,7 @@ inline bool generate_pose_candidate(const Keypoint3DColour *keypointsData, const
 
       for(int j = 0; j < correspondencesFound; ++j)
       {
-        const int otherRasterIdx = selectedRasterIndices[j];
-        const int otherModeIdx = selectedModeIndices[j];
-        const ScorePrediction& otherPrediction = predictionsData[otherRasterIdx];
-        const Vector3f otherWorldPt = otherPrediction.elts[otherModeIdx].position;
+        const Vector3f otherWorldPt = get_pooled_mode(modePool, selectedModeIndices[j]).position;
 
         const Vector3f diff = otherWorldPt - worldPt;
         const float distSq = dot(diff, diff);
@@ -224,7 +261,6 @@ inline bool generate_pose_candidate(const Keypoint3DColour *keypointsData, const
       {
         // (i) Check that the current keypoint is far enough (in camera coordinates) from the other keypoint.
         const int otherRasterIdx = selectedRasterIndices[j];
-        const ScorePrediction& otherPrediction = predictionsData[otherRasterIdx];
         const Vector3f otherCameraPt = keypointsData[otherRasterIdx].position;
 
         const Vector3f diffCamera = otherCameraPt - cameraPt;
@@ -237,8 +273,7 @@ inline bool generate_pose_candidate(const Keypoint3DColour *keypointsData, const
 
         // (ii) Check that the distance between the current keypoint and the other keypoint is similar enough to the distance
         //      between the current mode and the other mode.
-        const int otherModeIdx = selectedModeIndices[j];
-        const Vector3f otherWorldPt = otherPrediction.elts[otherModeIdx].position;
+        const Vector3f otherWorldPt = get_pooled_mode(modePool, selectedModeIndices[j]).position;
 
         const Vector3f diffWorld = otherWorldPt - worldPt;
         const float distWorld = length(diffWorld);
@@ -269,15 +304,8 @@ inline bool generate_pose_candidate(const Keypoint3DColour *keypointsData, const
   // Copy the corresponding camera and world points into the pose candidate.
   for(int i = 0; i < correspondencesFound; ++i)
   {
-    const int rasterIdx = selectedRasterIndices[i];
-    const int modeIdx = selectedModeIndices[i];
-
-    const Keypoint3DColour& keypoint = keypointsData[rasterIdx];
-    const ScorePrediction& prediction = predictionsData[rasterIdx];
-    const Keypoint3DColourCluster& mode = prediction.elts[modeIdx];
-
-    poseCandidate.pointsCamera[i] = keypoint.position;
-    poseCandidate.pointsWorld[i] = mode.position;
+    poseCandidate.pointsCamera[i] = keypointsData[selectedRasterIndices[i]].position;
+    poseCandidate.pointsWorld[i] = get_pooled_mode(modePool, selectedModeIndices[i]).position;
   }
 
   return true;
@@ -290,7 +318,8 @@ inline bool generate_pose_candidate(const Keypoint3DColour *keypointsData, const
  * \param candidateIdx        The array index of the pose candidate being considered (in the pose candidates array).
  * \param inlierIdx           The array index of the "inlier" keypoint being considered (in the inlier raster indices array).
  * \param keypoints           The 3D keypoints extracted from an RGB-D image pair.
- * \param predictions         The SCoRe forest predictions associated with the keypoints.
+ * \param modeIndices         The indices (in the mode pool) of the modes associated with the keypoints.
+ * \param modePool            The mode pool.
  * \param inlierRasterIndices The raster indices of the "inlier" keypoints that we will use to compute the energy sum.
  * \param nbInliers           The overall number of "inlier" keypoints.
  * \param poseCandidates      The pose candidates.
@@ -299,23 +328,24 @@ inline bool generate_pose_candidate(const Keypoint3DColour *keypointsData, const
  * \param inlierModes         The array into which to write the best mode for the specified candidate pose and inlier.
  */
 _CPU_AND_GPU_CODE_
-inline void prepare_inlier_for_optimisation(uint32_t candidateIdx, uint32_t inlierIdx, const Keypoint3DColour *keypoints, const ScorePrediction *predictions, const int *inlierRasterIndices,
-                                            uint32_t nbInliers, const PoseCandidate *poseCandidates, const float inlierThreshold, Vector4f *inlierCameraPoints, Keypoint3DColourCluster *inlierModes)
+inline void prepare_inlier_for_optimisation(uint32_t candidateIdx, uint32_t inlierIdx, const Keypoint3DColour *keypoints, const ScoreModeIndices *modeIndices,
+                                            const ScorePrediction *modePool, const int *inlierRasterIndices, uint32_t nbInliers, const PoseCandidate *poseCandidates,
+                                            const float inlierThreshold, Vector4f *inlierCameraPoints, Keypoint3DColourCluster *inlierModes)
 {
   const int inlierRasterIdx = inlierRasterIndices[inlierIdx];
   const PoseCandidate& poseCandidate = poseCandidates[candidateIdx];
   const Vector3f inlierCameraPosition = keypoints[inlierRasterIdx].position;
-  const ScorePrediction& prediction = predictions[inlierRasterIdx];
+  const ScoreModeIndices& inlierModeIndices = modeIndices[inlierRasterIdx];
 
   // Try to find the index of the mode associated with the inlier whose position is closest to the position of the
   // inlier in world space as predicted by the specified candidate pose. (We assume the inlier itself is valid and
   // has at least one mode, since we checked that when we selected it.)
   const Vector3f inlierWorldPosition = poseCandidate.cameraPose * inlierCameraPosition;
-  const int bestModeIdx = find_closest_mode(inlierWorldPosition, prediction);
+  const int bestModeIdx = find_closest_mode(inlierWorldPosition, inlierModeIndices, modePool);
 
   // If we cannot find such a mode, it means that the inlier should never have been selected, so throw.
   // This is purely defensive, and should never happen in practice.
-  if(bestModeIdx < 0 || bestModeIdx >= prediction.size)
+  if(bestModeIdx < 0 || bestModeIdx >= inlierModeIndices.size)
   {
 #if defined(__CUDACC__) && defined(__CUDA_ARCH__)
     printf("Error: Could not find a best mode for the specified candidate pose and inlier keypoint\n");
@@ -325,7 +355,7 @@ inline void prepare_inlier_for_optimisation(uint32_t candidateIdx, uint32_t inli
 #endif
   }
 
-  const Keypoint3DColourCluster& bestMode = prediction.elts[bestModeIdx];
+  const Keypoint3DColourCluster& bestMode = get_pooled_mode(modePool, inlierModeIndices.elts[bestModeIdx]);
 
   // Determine the location in the output arrays into which to write the inlier's camera position and the best mode.
   const uint32_t outputIdx = candidateIdx * nbInliers + inlierIdx;
@@ -350,8 +380,8 @@ inline void prepare_inlier_for_optimisation(uint32_t candidateIdx, uint32_t inli
  * \tparam RNG        The type of random number generator use for sampling (e.g. CPURNG or CUDARNG).
  *
  * \param keypoints   The 3D keypoints extracted from an RGB-D image pair.
- * \param predictions The SCoRe forest predictions associated with the keypoints.
- * \param imgSize     The size of the input keypoints and predictions images.
+ * \param modeIndices The indices (in the mode pool) of the modes associated with the keypoints.
+ * \param imgSize     The size of the input keypoints and mode indices images.
  * \param rng         The random number generator to use for sampling.
  * \param inliersMask The mask used to avoid sampling keypoint indices twice. Can be NULL if useMask is false.
  *
@@ -359,7 +389,7 @@ inline void prepare_inlier_for_optimisation(uint32_t candidateIdx, uint32_t inli
  */
 template <bool useMask, typename RNG>
 _CPU_AND_GPU_CODE_TEMPLATE_
-inline int sample_inlier(const Keypoint3DColour *keypoints, const ScorePrediction *predictions, const Vector2i& imgSize, RNG& rng, int *inliersMask = NULL)
+inline int sample_inlier(const Keypoint3DColour *keypoints, const ScoreModeIndices *modeIndices, const Vector2i& imgSize, RNG& rng, int *inliersMask = NULL)
 {
   int inlierRasterIdx = -1;
 
@@ -370,7 +400,7 @@ inline int sample_inlier(const Keypoint3DColour *keypoints, const ScorePredictio
     const int rasterIdx = rng.generate_int_from_uniform(0, imgSize.width * imgSize.height - 1);
 
     // Check whether the corresponding keypoint is valid and has at least one modal cluster. If not, early out.
-    if(!keypoints[rasterIdx].valid || predictions[rasterIdx].size == 0) continue;
+    if(!keypoints[rasterIdx].valid || modeIndices[rasterIdx].size == 0) continue;
 
     // If we're using the mask, check whether or not the keypoint has already been sampled.
     bool valid = !useMask;
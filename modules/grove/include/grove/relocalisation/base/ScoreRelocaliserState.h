@@ -6,6 +6,8 @@
 #ifndef H_GROVE_SCORERELOCALISERSTATE
 #define H_GROVE_SCORERELOCALISERSTATE
 
+#include <vector>
+
 #include <ORUtils/DeviceType.h>
 
 #include "../../keypoints/Keypoint3DColour.h"
@@ -48,13 +50,13 @@ public:
   /** The example reservoirs associated with each leaf in the forest. */
   Reservoirs_Ptr exampleReservoirs;
 
-  /** The index of the first reservoir that was clustered when the train function was last called. */
-  uint32_t lastExamplesAddedStartIdx;
-
   /** A memory block storing the 3D modal clusters associated with each leaf in the forest. */
   ScorePredictionsMemoryBlock_Ptr predictionsBlock;
 
-  /** The index of the first reservoir to cluster when the relocaliser is updated. */
+  /** The number of times each batch of reservoirs has been passed over for updating since it last changed (not saved to disk). */
+  std::vector<uint32_t> reservoirBatchSkipCounts;
+
+  /** The index of the first reservoir in the batch from which to start looking for the stalest batch of reservoirs when the relocaliser is next updated. */
   uint32_t reservoirUpdateStartIdx;
 
   //#################### CONSTRUCTORS ####################
@@ -16,6 +16,14 @@ namespace grove {
  */
 class ScoreForestRelocaliser_CPU : public ScoreForestRelocaliser
 {
+  //#################### PRIVATE VARIABLES ####################
+private:
+  /**
+   * Whether or not to find the leaves for the keypoints without computing their full descriptors when relocalising. If this is enabled,
+   * each feature of a keypoint's descriptor is only evaluated if a split node in the forest tests it (see DecisionForest_CPU::find_leaves_lazily).
+   */
+  bool m_useLazyFeatureEvaluation;
+
   //#################### CONSTRUCTORS ####################
 public:
   /**
@@ -31,7 +39,10 @@ public:
   //#################### PROTECTED MEMBER FUNCTIONS ####################
 protected:
   /** Override */
-  virtual void merge_predictions_for_keypoints(const LeafIndicesImage_CPtr& leafIndices, ScorePredictionsImage_Ptr& outputPredictions) const;
+  virtual void compute_keypoints_and_predictions(const ORUChar4Image *colourImage, const ORFloatImage *depthImage, const Vector4f& depthIntrinsics) const;
+
+  /** Override */
+  virtual void merge_predictions_for_keypoints(const LeafIndicesImage_CPtr& leafIndices, ScoreModeIndicesImage_Ptr& outputModeIndices) const;
 };
 
 }
@@ -31,11 +31,11 @@ public:
   //#################### PROTECTED MEMBER FUNCTIONS ####################
 protected:
   /** Override */
-  virtual void set_bucket_predictions_for_keypoints(const BucketIndicesImage_CPtr& bucketIndices, ScorePredictionsImage_Ptr& outputPredictions) const;
+  virtual void set_bucket_predictions_for_keypoints(const BucketIndicesImage_CPtr& bucketIndices, ScoreModeIndicesImage_Ptr& outputModeIndices) const;
 
   /** Override */
   virtual void set_net_predictions_for_keypoints(const Keypoint3DColourImage_CPtr& keypointsImage, const ScoreNetOutput_CPtr& scoreNetOutput,
-                                                 ScorePredictionsImage_Ptr& outputPredictions) const;
+                                                 ScorePredictionsImage_Ptr& outputPredictions, ScoreModeIndicesImage_Ptr& outputModeIndices) const;
 };
 
 }
@@ -29,7 +29,7 @@ public:
 protected:
   /** Override */
   virtual void set_ground_truth_predictions_for_keypoints(const Keypoint3DColourImage_CPtr& keypointsImage, const Matrix4f& cameraToWorld,
-                                                          ScorePredictionsImage_Ptr& outputPredictions) const;
+                                                          ScorePredictionsImage_Ptr& outputPredictions, ScoreModeIndicesImage_Ptr& outputModeIndices) const;
 };
 
 }
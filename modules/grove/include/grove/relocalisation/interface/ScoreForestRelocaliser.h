@@ -32,12 +32,14 @@ public:
 
   //#################### PRIVATE VARIABLES ####################
 private:
-  /** The image containing the indices of the forest leaves associated with the keypoint/descriptor pairs. */
-  mutable LeafIndicesImage_Ptr m_leafIndicesImage;
-
   /** An image in which to store a visualisation of the mapping from pixels to forest leaves (for debugging purposes). */
   mutable ORUChar4Image_Ptr m_pixelsToLeavesImage;
 
+  //#################### PROTECTED VARIABLES ####################
+protected:
+  /** The image containing the indices of the forest leaves associated with the keypoint/descriptor pairs. */
+  mutable LeafIndicesImage_Ptr m_leafIndicesImage;
+
   /** The SCoRe forest on which the relocaliser is based. */
   ScoreForest_Ptr m_scoreForest;
 
@@ -58,7 +60,7 @@ protected:
 protected:
   /**
    * \brief Merges the SCoRe predictions (sets of clusters) associated with each keypoint to create a single
-   *        SCoRe prediction (a single set of clusters) for each keypoint.
+   *        set of clusters for each keypoint, represented by the indices of the clusters in the predictions block.
    *
    * \note  Each keypoint/descriptor pair extracted from the input RGB-D image pairs determines a leaf in a tree of the
    *        forest. Each such leaf contains a set of 3D modal clusters, which together constitute a SCoRe prediction.
@@ -66,9 +68,9 @@ protected:
    *        which each keypoint/descriptor pair is associated, thereby yielding a single SCoRe prediction for each pair.
    *
    * \param leafIndices       An image containing the indices of the leaves (in the different trees) associated with each keypoint/descriptor pair.
-   * \param outputPredictions An image into which to store the merged SCoRe predictions.
+   * \param outputModeIndices An image into which to store the indices (in the predictions block) of the merged clusters for each keypoint.
    */
-  virtual void merge_predictions_for_keypoints(const LeafIndicesImage_CPtr& leafIndices, ScorePredictionsImage_Ptr& outputPredictions) const = 0;
+  virtual void merge_predictions_for_keypoints(const LeafIndicesImage_CPtr& leafIndices, ScoreModeIndicesImage_Ptr& outputModeIndices) const = 0;
 
   //#################### PUBLIC MEMBER FUNCTIONS ####################
 public:
@@ -50,13 +50,29 @@ private:
   /** An image containing the bucket (example reservoir) indices associated with the keypoints. */
   BucketIndicesImage_Ptr m_bucketIndicesImage;
 
-  /** A mapping from indices of cells in the grid placed over the training scene to example reservoir indices. */
+  /**
+   * The bucket remapper, which maps indices of cells in the grid placed over the training scene to example reservoir indices.
+   * This is a lock-free hash table (see remap_bucket_index), stored as separate arrays of bucket indices and reservoir indices,
+   * together with a count of the buckets that have been added to it.
+   */
   // FIXME: This should be in the relocaliser state, not in the relocaliser itself.
-  mutable std::map<int,int> m_bucketRemapper;
+  mutable int m_bucketRemapperBucketCount;
+
+  /** The bucket index stored in each slot of the bucket remapper (or EMPTY_BUCKET_SLOT, if the slot is unoccupied). */
+  mutable std::vector<int> m_bucketRemapperBuckets;
+
+  /** The reservoir index stored in each slot of the bucket remapper. */
+  mutable std::vector<int> m_bucketRemapperReservoirs;
+
+  /** The seed used to choose reservoirs to reuse pseudo-randomly once all of the reservoirs have been allocated. */
+  uint32_t m_bucketRemapperReuseSeed;
 
   /** The size of each bucket (in cm). */
   int m_bucketSizeCm;
 
+  /** An image containing the single-cluster SCoRe predictions made from the raw network output (used as the mode pool when not using the bucket predictions). */
+  mutable ScorePredictionsImage_Ptr m_netPredictionsImage;
+
   /** The type of network being used (dsac|vgg). */
   std::string m_netType;
 
@@ -99,13 +115,15 @@ public:
   //#################### PROTECTED ABSTRACT MEMBER FUNCTIONS ####################
 protected:
   /**
-   * \brief Sets a SCoRe prediction for each keypoint that contains all of the clusters in the bucket (example reservoir)
+   * \brief Sets the modes associated with each keypoint to all of the clusters in the bucket (example reservoir)
    *        addressed by the world space point predicted by the network for the keypoint.
    *
+   * \note  The clusters are referred to by their indices in the predictions block, which thus serves as the mode pool.
+   *
    * \param bucketIndices     An image containing the bucket (example reservoir) indices associated with the keypoints.
-   * \param outputPredictions An image into which to store the SCoRe predictions.
+   * \param outputModeIndices An image into which to store the indices (in the predictions block) of the modes associated with the keypoints.
    */
-  virtual void set_bucket_predictions_for_keypoints(const BucketIndicesImage_CPtr& bucketIndices, ScorePredictionsImage_Ptr& outputPredictions) const = 0;
+  virtual void set_bucket_predictions_for_keypoints(const BucketIndicesImage_CPtr& bucketIndices, ScoreModeIndicesImage_Ptr& outputModeIndices) const = 0;
 
   /**
    * \brief Sets a SCoRe prediction for each keypoint that contains a single cluster consisting of the world space point
@@ -113,10 +131,11 @@ protected:
    *
    * \param keypointsImage    The image containing the keypoints extracted from the RGB-D image.
    * \param scoreNetOutput    A memory block containing the output tensor produced by the SCoRe network.
-   * \param outputPredictions An image into which to store the SCoRe predictions.
+   * \param outputPredictions An image into which to store the SCoRe predictions (this serves as the mode pool for the output mode indices).
+   * \param outputModeIndices An image into which to store the indices (in the output predictions) of the modes associated with the keypoints.
    */
   virtual void set_net_predictions_for_keypoints(const Keypoint3DColourImage_CPtr& keypointsImage, const ScoreNetOutput_CPtr& scoreNetOutput,
-                                                 ScorePredictionsImage_Ptr& outputPredictions) const = 0;
+                                                 ScorePredictionsImage_Ptr& outputPredictions, ScoreModeIndicesImage_Ptr& outputModeIndices) const = 0;
 
   //#################### PROTECTED MEMBER FUNCTIONS ####################
 protected:
@@ -18,6 +18,7 @@
 #include "../../ransac/interface/PreemptiveRansac.h"
 #include "../../reservoirs/interface/ExampleReservoirs.h"
 #include "../../scoreforests/Keypoint3DColourCluster.h"
+#include "../../scoreforests/ScoreModeIndices.h"
 #include "../../scoreforests/ScorePrediction.h"
 
 namespace grove {
@@ -59,6 +60,9 @@ protected:
   /** The maximum distance there can be between two examples that are part of the same cluster (used during clustering). */
   float m_clustererTau;
 
+  /** Whether or not to accelerate the clustering with a uniform spatial grid (only supported on the CPU). */
+  bool m_clustererUseGrid;
+
   /** The image containing the descriptors extracted from the RGB-D image. */
   RGBDPatchDescriptorImage_Ptr m_descriptorsImage;
 
@@ -80,6 +84,9 @@ protected:
   /** An image in which to store a visualisation of the ground truth mapping from pixels to world-space points (if available). */
   mutable ORUChar4Image_Ptr m_groundTruthPixelsToPointsImage;
 
+  /** The image containing the indices (in m_groundTruthPredictionsImage) of the ground truth modes associated with the keypoint/descriptor pairs (if available). */
+  mutable ScoreModeIndicesImage_Ptr m_groundTruthModeIndicesImage;
+
   /** The image containing the ground truth SCoRe predictions associated with the keypoint/descriptor pairs (if available). */
   mutable ScorePredictionsImage_Ptr m_groundTruthPredictionsImage;
 
@@ -89,13 +96,25 @@ protected:
   /** The image containing the keypoints extracted from the RGB-D image. */
   Keypoint3DColourImage_Ptr m_keypointsImage;
 
+  /**
+   * The maximum number of examples that can have been added to a reservoir since it was last clustered for its clusters to be updated
+   * incrementally rather than by re-clustering the reservoir from scratch (0 disables incremental updates, which are only supported on the CPU).
+   */
+  uint32_t m_maxIncrementalInsertions;
+
   /** The maximum number of clusters to store in each reservoir (used during clustering). */
   uint32_t m_maxClusterCount;
 
   /** The maximum number of relocalisations to output for each call to the relocalise function. */
   uint32_t m_maxRelocalisationsToOutput;
 
-  /** The maximum number of reservoirs to subject to clustering for each call to the update function. */
+  /**
+   * The maximum number of times a batch of reservoirs that has changed since it was last clustered can be passed over in favour of
+   * a batch into which more examples have been written before it must be updated (0 updates the changed batches in round-robin order).
+   */
+  uint32_t m_maxReservoirBatchSkips;
+
+  /** The number of reservoirs in each batch of reservoirs that can be subjected to clustering by a train/update call. */
   uint32_t m_maxReservoirsToUpdate;
 
   /** The maximum x, y and z coordinates visited by the camera during training. */
@@ -107,12 +126,18 @@ protected:
   /** The minimum x, y and z coordinates visited by the camera during training. */
   float m_minX, m_minY, m_minZ;
 
+  /** The image containing the indices (in m_modePool) of the modes associated with the keypoint/descriptor pairs. */
+  mutable ScoreModeIndicesImage_Ptr m_modeIndicesImage;
+
+  /**
+   * The pool of modes into which the indices in m_modeIndicesImage point. This is set by make_predictions, and is typically the block
+   * of SCoRe predictions in the relocaliser's state (so that the modes associated with each keypoint never need to be copied).
+   */
+  mutable ScorePredictionsMemoryBlock_CPtr m_modePool;
+
   /** An image in which to store a visualisation of the mapping from pixels to world-space points (for debugging purposes). */
   mutable ORUChar4Image_Ptr m_pixelsToPointsImage;
 
-  /** The image containing the SCoRe predictions associated with the keypoint/descriptor pairs. */
-  mutable ScorePredictionsImage_Ptr m_predictionsImage;
-
   /** The Preemptive RANSAC instance, used to estimate the 6DOF camera pose from a set of 3D keypoints and their associated SCoRe predictions. */
   PreemptiveRansac_Ptr m_preemptiveRansac;
 
@@ -157,7 +182,8 @@ public:
   //#################### PROTECTED ABSTRACT MEMBER FUNCTIONS ####################
 protected:
   /**
-   * \brief Fills the SCoRe predictions image with a set of clusters for each keypoint extracted from the RGB-D image.
+   * \brief Fills the mode indices image with the indices of a set of clusters for each keypoint extracted from the RGB-D image,
+   *        and points the mode pool at the storage containing those clusters.
    *
    * \param colourImage The colour image.
    */
@@ -199,11 +225,18 @@ public:
   Keypoint3DColourImage_CPtr get_keypoints_image() const;
 
   /**
-   * \brief Gets the image containing the SCoRe predictions associated with the keypoint/descriptor pairs.
+   * \brief Gets the image containing the indices (in the mode pool) of the modes associated with the keypoint/descriptor pairs.
+   *
+   * \return  The image containing the indices (in the mode pool) of the modes associated with the keypoint/descriptor pairs.
+   */
+  ScoreModeIndicesImage_CPtr get_mode_indices_image() const;
+
+  /**
+   * \brief Gets the pool of modes into which the indices in the mode indices image point.
    *
-   * \return  The image containing the SCoRe predictions associated with the keypoint/descriptor pairs.
+   * \return  The pool of modes into which the indices in the mode indices image point.
    */
-  ScorePredictionsImage_CPtr get_predictions_image() const;
+  ScorePredictionsMemoryBlock_CPtr get_mode_pool() const;
 
   /** Override */
   virtual ORUChar4Image_CPtr get_visualisation_image(const std::string& key) const;
@@ -243,14 +276,26 @@ public:
   virtual void update();
 
   /**
-   * \brief Forcibly updates the contents of every cluster in the example reservoirs.
+   * \brief Forcibly updates the contents of every cluster in the example reservoirs that has changed since it was last clustered.
    *
-   * \note  This is computationally intensive, and can require a few hundred milliseconds to terminate.
+   * \note  This can be computationally intensive, and can require a few hundred milliseconds to terminate.
    */
   void update_all_clusters();
 
   //#################### PROTECTED MEMBER FUNCTIONS ####################
 protected:
+  /**
+   * \brief Extracts keypoints from an RGB-D image and fills the mode indices image with the indices of a set of clusters for each of them.
+   *
+   * \note  By default, this computes a full descriptor for each keypoint and then calls make_predictions. Derived classes that
+   *        do not need the full descriptors can override it to avoid computing them.
+   *
+   * \param colourImage     The colour image.
+   * \param depthImage      The depth image.
+   * \param depthIntrinsics The intrinsic parameters of the depth sensor.
+   */
+  virtual void compute_keypoints_and_predictions(const ORUChar4Image *colourImage, const ORFloatImage *depthImage, const Vector4f& depthIntrinsics) const;
+
   /**
    * \brief Makes debug visualisation images to help the user better understand what happened during the most recent attempt to relocalise the camera.
    *
@@ -264,33 +309,50 @@ protected:
    *
    * \param keypointsImage    The image containing the keypoints extracted from the RGB-D image.
    * \param cameraToWorld     The ground truth transformation from camera space to world space.
-   * \param outputPredictions An image into which to store the SCoRe predictions.
+   * \param outputPredictions An image into which to store the SCoRe predictions (this serves as the mode pool for the output mode indices).
+   * \param outputModeIndices An image into which to store the indices (in the output predictions) of the modes associated with the keypoints.
    */
   virtual void set_ground_truth_predictions_for_keypoints(const Keypoint3DColourImage_CPtr& keypointsImage, const Matrix4f& cameraToWorld,
-                                                          ScorePredictionsImage_Ptr& outputPredictions) const;
+                                                          ScorePredictionsImage_Ptr& outputPredictions, ScoreModeIndicesImage_Ptr& outputModeIndices) const;
 
   //#################### PRIVATE MEMBER FUNCTIONS ####################
 private:
   /**
-   * \brief Computes the number of reservoirs to subject to clustering during a train/update call.
+   * \brief Attempts to update the clusters of a batch of reservoirs incrementally, using the examples that have been added to them since they were last clustered.
    *
-   * \return  The number of reservoirs to subject to clustering during a train/update call.
+   * \note  This only succeeds if every reservoir in the batch that has changed since it was last clustered has had only a few examples added to it
+   *        (and none replaced), and each of those examples is close to one of the reservoir's existing clusters. If it fails, the whole batch must
+   *        be re-clustered from scratch.
+   *
+   * \param batchStart  The index of the first reservoir in the batch.
+   * \param batchSize   The number of reservoirs in the batch.
+   * \return            true, if the clusters of the batch were successfully updated, or false otherwise.
    */
-  uint32_t compute_nb_reservoirs_to_update() const;
+  bool update_clusters_incrementally(uint32_t batchStart, uint32_t batchSize);
 
   /**
    * \brief Updates one of the pixels to points images (for debugging purposes).
    *
    * \param worldToCamera       The transformation to use from world to camera space.
-   * \param predictionsImage    An image containing SCoRe predictions associated with the keypoint/descriptor pairs.
+   * \param modeIndicesImage    An image containing the indices (in the mode pool) of the modes associated with the keypoint/descriptor pairs.
+   * \param modePool            The pool of modes into which the mode indices point.
    * \param pixelsToPointsImage An image in which to store a visualisation of a mapping from pixels to world-space points.
    */
-  void update_pixels_to_points_image(const ORUtils::SE3Pose& worldToCamera, const ScorePredictionsImage_Ptr& predictionsImage, ORUChar4Image_Ptr& pixelsToPointsImage) const;
+  void update_pixels_to_points_image(const ORUtils::SE3Pose& worldToCamera, const ScoreModeIndicesImage_CPtr& modeIndicesImage,
+                                     const ScorePredictionsMemoryBlock_CPtr& modePool, ORUChar4Image_Ptr& pixelsToPointsImage) const;
 
   /**
-   * \brief Updates the index of the first reservoir to subject to clustering during the next train/update call.
+   * \brief Brings the clusters of the stalest batch of reservoirs up to date.
+   *
+   * \note  The reservoirs are divided into consecutive batches of m_maxReservoirsToUpdate reservoirs. The stalest batch is the one into whose
+   *        reservoirs the most examples have been written since they were last clustered (ties are broken in round-robin order). Batches
+   *        that have not changed since they were last clustered are never chosen, so no clustering is done when nothing has changed.
+   * \note  To stop batches that only receive a few examples from being starved, a changed batch that has been passed over more than
+   *        m_maxReservoirBatchSkips times is updated in preference to the stalest batch (the one passed over most often goes first).
+   *
+   * \return  true, if a batch of reservoirs was updated, or false if all of the reservoirs were already up to date.
    */
-  void update_reservoir_start_idx();
+  bool update_stalest_reservoirs();
 };
 
 //#################### TYPEDEFS ####################
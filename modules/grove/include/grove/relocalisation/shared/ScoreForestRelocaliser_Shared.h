@@ -6,7 +6,7 @@
 #ifndef H_GROVE_SCOREFORESTRELOCALISER_SHARED
 #define H_GROVE_SCOREFORESTRELOCALISER_SHARED
 
-#include "../../scoreforests/ScorePrediction.h"
+#include "../../scoreforests/ScoreModeIndices.h"
 
 namespace grove {
 
@@ -17,19 +17,21 @@ namespace grove {
  *        the keypoint's descriptor down each tree and collecting a SCoRe prediction from each resulting leaf.
  * \note  Merging is performed by taking the largest clusters from each leaf. The assumption is that the modal clusters in
  *        each leaf are already sorted in non-increasing order of size.
+ * \note  The clusters are not copied: instead, the merged prediction is represented by the indices of the chosen clusters
+ *        in the predictions block, which thus serves as the mode pool for the output mode indices.
  *
  * \param x                 The x coordinate of the keypoint.
  * \param y                 The y coordinate of the keypoint.
  * \param leafIndices       A pointer to the image containing the indices of the leaves (in the different trees) associated with each keypoint/descriptor pair.
  * \param predictionsBlock  A pointer to the storage area holding all of the SCoRe predictions associated with the forest leaves.
- * \param imgSize           The dimensions of the leafIndices and outputPredictions images.
- * \param maxClusterCount   The maximum number of clusters to keep for each output prediction.
- * \param outputPredictions A pointer to the image into which to store the merged SCoRe predictions.
+ * \param imgSize           The dimensions of the leafIndices and outputModeIndices images.
+ * \param maxClusterCount   The maximum number of clusters to keep for each keypoint.
+ * \param outputModeIndices A pointer to the image into which to store the indices (in the predictions block) of the merged clusters.
  */
 template <int TREE_COUNT>
 _CPU_AND_GPU_CODE_TEMPLATE_
 inline void merge_predictions_for_keypoint(int x, int y, const ORUtils::VectorX<int,TREE_COUNT> *leafIndices, const ScorePrediction *predictionsBlock,
-                                           Vector2i imgSize, int maxClusterCount, ScorePrediction *outputPredictions)
+                                           Vector2i imgSize, int maxClusterCount, ScoreModeIndices *outputModeIndices)
 {
   typedef ORUtils::VectorX<int,TREE_COUNT> LeafIndices;
 
@@ -56,12 +58,12 @@ inline void merge_predictions_for_keypoint(int x, int y, const ORUtils::VectorX<
     currentModeIndices[treeIdx] = 0;
   }
 
-  // Grab a reference to the output prediction, and set its initial size to zero.
-  ScorePrediction& outputPrediction = outputPredictions[keypointRasterIdx];
-  outputPrediction.size = 0;
+  // Grab a reference to the output mode indices, and set their initial size to zero.
+  ScoreModeIndices& outputModeIndicesForKeypoint = outputModeIndices[keypointRasterIdx];
+  outputModeIndicesForKeypoint.size = 0;
 
-  // While the output prediction is not yet full:
-  while(outputPrediction.size < maxClusterCount)
+  // While the output mode indices are not yet full:
+  while(outputModeIndicesForKeypoint.size < maxClusterCount)
   {
     int bestTreeIdx = 0;
     int bestNbInliers = 0;
@@ -89,8 +91,8 @@ inline void merge_predictions_for_keypoint(int x, int y, const ORUtils::VectorX<
     // If there were no valid modes remaining in any input prediction, early out.
     if(bestNbInliers == 0) break;
 
-    // Otherwise, copy the chosen mode into the output prediction, and increment the current mode index for the associated input prediction.
-    outputPrediction.elts[outputPrediction.size++] = inputPredictions[bestTreeIdx]->elts[currentModeIndices[bestTreeIdx]];
+    // Otherwise, record the index of the chosen mode in the predictions block, and increment the current mode index for the associated input prediction.
+    outputModeIndicesForKeypoint.elts[outputModeIndicesForKeypoint.size++] = make_pooled_mode_index(leafIndicesForKeypoint[bestTreeIdx], currentModeIndices[bestTreeIdx]);
     ++currentModeIndices[bestTreeIdx];
   }
 }
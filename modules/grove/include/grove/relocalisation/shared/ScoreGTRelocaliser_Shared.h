@@ -6,22 +6,26 @@
 #ifndef H_GROVE_SCOREGTRELOCALISER_SHARED
 #define H_GROVE_SCOREGTRELOCALISER_SHARED
 
-#include "../../scoreforests/ScorePrediction.h"
+#include "../../scoreforests/ScoreModeIndices.h"
 
 namespace grove {
 
 /**
  * \brief Sets a SCoRe prediction for the specified keypoint that contains a single cluster consisting of the ground truth position of the keypoint in world space.
  *
+ * \note  The output predictions image serves as the mode pool for the output mode indices image.
+ *
  * \param x                 The x coordinate of the keypoint.
  * \param y                 The y coordinate of the keypoint.
- * \param imgSize           The dimensions of the keypoints and outputPredictions images.
+ * \param imgSize           The dimensions of the keypoints, outputPredictions and outputModeIndices images.
  * \param keypoints         A pointer to an image containing the keypoints extracted from the RGB-D image.
  * \param cameraToWorld     The ground truth transformation from camera space to world space.
  * \param outputPredictions A pointer to the image in which to store the output SCoRe predictions.
+ * \param outputModeIndices A pointer to the image in which to store the indices (in the output predictions) of the modes associated with the keypoints.
  */
 _CPU_AND_GPU_CODE_
-inline void set_ground_truth_prediction_for_keypoint(int x, int y, const Vector2i& imgSize, const Keypoint3DColour *keypoints, const Matrix4f& cameraToWorld, ScorePrediction *outputPredictions)
+inline void set_ground_truth_prediction_for_keypoint(int x, int y, const Vector2i& imgSize, const Keypoint3DColour *keypoints, const Matrix4f& cameraToWorld,
+                                                     ScorePrediction *outputPredictions, ScoreModeIndices *outputModeIndices)
 {
   const int offset = y * imgSize.x + x;
   const Keypoint3DColour& keypoint = keypoints[offset];
@@ -35,6 +39,10 @@ inline void set_ground_truth_prediction_for_keypoint(int x, int y, const Vector2
   outputCluster.nbInliers = 1;
   outputCluster.positionInvCovariance.setIdentity();
   outputCluster.determinant = 1.0f;
+
+  ScoreModeIndices& outputModeIndicesForKeypoint = outputModeIndices[offset];
+  outputModeIndicesForKeypoint.size = 1;
+  outputModeIndicesForKeypoint.elts[0] = make_pooled_mode_index(offset, 0);
 }
 
 }
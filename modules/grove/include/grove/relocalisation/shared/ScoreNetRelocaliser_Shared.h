@@ -6,40 +6,207 @@
 #ifndef H_GROVE_SCORENETRELOCALISER_SHARED
 #define H_GROVE_SCORENETRELOCALISER_SHARED
 
-#include "../../scoreforests/ScorePrediction.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "../../scoreforests/ScoreModeIndices.h"
 
 namespace grove {
 
+//#################### CONSTANTS ####################
+
+/** The value used to mark an unoccupied slot in a bucket remapping table (bucket indices are always non-negative). */
+enum { EMPTY_BUCKET_SLOT = -1 };
+
+//#################### FUNCTIONS ####################
+
+/**
+ * \brief Atomically replaces the value at the specified address with a new value if it is currently equal to an expected value.
+ *
+ * \note  This acts as a full memory barrier on the CPU.
+ *
+ * \param address   The address of the value.
+ * \param expected  The value that must be at the address for the replacement to happen.
+ * \param desired   The value with which to replace it.
+ * \return          The value that was at the address before the call (the replacement happened iff this is equal to expected).
+ */
+_CPU_AND_GPU_CODE_
+inline int atomic_compare_and_swap(int *address, int expected, int desired)
+{
+#if defined(__CUDACC__)
+  return atomicCAS(address, expected, desired);
+#elif defined(_MSC_VER)
+  return _InterlockedCompareExchange(reinterpret_cast<volatile long*>(address), desired, expected);
+#else
+  return __sync_val_compare_and_swap(address, expected, desired);
+#endif
+}
+
+/**
+ * \brief Computes the slot at which to start looking for the specified bucket in a bucket remapping table.
+ *
+ * \note  Neighbouring buckets have consecutive indices, so we mix the bits of the index (using the MurmurHash3
+ *        finaliser) to prevent them from forming long runs of occupied slots.
+ *
+ * \param bucketIdx The bucket index.
+ * \param slotMask  The number of slots in the table minus one (the number of slots must be a power of two).
+ * \return          The slot at which to start looking for the bucket.
+ */
+_CPU_AND_GPU_CODE_
+inline uint32_t compute_bucket_slot(int bucketIdx, uint32_t slotMask)
+{
+  uint32_t h = static_cast<uint32_t>(bucketIdx);
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h & slotMask;
+}
+
+/**
+ * \brief Chooses an example reservoir to reuse for a bucket once all of the reservoirs have been allocated.
+ *
+ * \param key                 The value from which to make the choice (either the allocation index of the bucket or the bucket index itself).
+ * \param reservoirCount      The number of example reservoirs.
+ * \param reuseRandomWhenFull Whether to choose the reservoir pseudo-randomly (as opposed to cycling through the reservoirs in order).
+ * \param reuseSeed           The seed used to make pseudo-random choices.
+ * \return                    The index of the reservoir to reuse.
+ */
+_CPU_AND_GPU_CODE_
+inline int choose_reservoir_to_reuse(uint32_t key, uint32_t reservoirCount, bool reuseRandomWhenFull, uint32_t reuseSeed)
+{
+  return static_cast<int>((reuseRandomWhenFull ? compute_bucket_slot(static_cast<int>(key ^ reuseSeed), 0xffffffffu) : key) % reservoirCount);
+}
+
+/**
+ * \brief Looks up the example reservoir associated with a bucket in a bucket remapping table, associating a reservoir with the bucket first if necessary.
+ *
+ * The table is a lock-free, open-addressing hash table with linear probing, which can safely be used by many threads at once.
+ * A thread that finds an unoccupied slot claims it for its bucket using an atomic compare-and-swap, and then allocates the next
+ * reservoir (or, once all of the reservoirs have been allocated, chooses one to reuse). Any other threads looking for the same
+ * bucket wait until the claiming thread has published the reservoir index. Entries are never removed (except by clearing the
+ * whole table), so an unoccupied slot on a bucket's probe sequence means that the bucket is not in the table.
+ *
+ * To bound the cost of probing, at most half of the slots are ever occupied. After that, new buckets are not added to the table,
+ * and the reservoirs they reuse are instead chosen from their bucket indices (so that a bucket always maps to the same reservoir).
+ *
+ * \param bucketIdx           The (non-negative) bucket index.
+ * \param slotBuckets         The bucket index stored in each slot (or EMPTY_BUCKET_SLOT, if the slot is unoccupied).
+ * \param slotReservoirs      The reservoir index stored in each slot (or -1, if it has not yet been published).
+ * \param slotCount           The number of slots in the table (a power of two that is at least twice the number of reservoirs).
+ * \param bucketCount         A pointer to the number of buckets that have been added to the table.
+ * \param reservoirCount      The number of example reservoirs.
+ * \param allowAllocation     Whether or not to associate a reservoir with the bucket if it is not already in the table.
+ * \param reuseRandomWhenFull Whether to choose reservoirs to reuse pseudo-randomly (as opposed to cycling through them in order).
+ * \param reuseSeed           The seed used to choose reservoirs to reuse pseudo-randomly.
+ * \return                    The index of the reservoir associated with the bucket, or 0 if there is none and allocation is not allowed.
+ */
+_CPU_AND_GPU_CODE_
+inline int remap_bucket_index(int bucketIdx, int *slotBuckets, int *slotReservoirs, uint32_t slotCount, int *bucketCount,
+                              uint32_t reservoirCount, bool allowAllocation, bool reuseRandomWhenFull, uint32_t reuseSeed)
+{
+  const uint32_t slotMask = slotCount - 1;
+  const uint32_t maxBucketCount = slotCount / 2;
+  const volatile int *publishedReservoirs = slotReservoirs;
+
+  uint32_t slot = compute_bucket_slot(bucketIdx, slotMask);
+  for(uint32_t probeCount = 0; probeCount < slotCount; ++probeCount, slot = (slot + 1) & slotMask)
+  {
+    int slotBucket = static_cast<const volatile int *>(slotBuckets)[slot];
+
+    // If the slot is unoccupied, the bucket is not yet in the table.
+    if(slotBucket == EMPTY_BUCKET_SLOT)
+    {
+      if(!allowAllocation) return 0;
+
+      // If the table is already as full as we allow it to get, don't add the bucket.
+      if(static_cast<uint32_t>(*static_cast<volatile int *>(bucketCount)) >= maxBucketCount) break;
+
+      // Otherwise, try to claim the slot for the bucket. If we succeed, allocate a reservoir for the bucket and publish its index.
+      slotBucket = atomic_compare_and_swap(&slotBuckets[slot], EMPTY_BUCKET_SLOT, bucketIdx);
+      if(slotBucket == EMPTY_BUCKET_SLOT)
+      {
+        int allocationIdx;
+#if defined(__CUDACC__)
+        allocationIdx = atomicAdd(bucketCount, 1);
+#else
+      #ifdef WITH_OPENMP3
+        #pragma omp atomic capture
+      #elif WITH_OPENMP
+        #pragma omp critical
+      #endif
+        allocationIdx = (*bucketCount)++;
+#endif
+
+        const int reservoirIdx = static_cast<uint32_t>(allocationIdx) < reservoirCount
+          ? allocationIdx
+          : choose_reservoir_to_reuse(allocationIdx, reservoirCount, reuseRandomWhenFull, reuseSeed);
+
+        atomic_compare_and_swap(&slotReservoirs[slot], -1, reservoirIdx);
+        return reservoirIdx;
+      }
+
+      // If another thread claimed the slot first, fall through and check which bucket it claimed it for.
+    }
+
+    // If the slot contains the bucket, wait for its reservoir index to be published (if necessary), and then return it.
+    if(slotBucket == bucketIdx)
+    {
+      int reservoirIdx;
+      while((reservoirIdx = publishedReservoirs[slot]) == -1) {}
+      return reservoirIdx;
+    }
+  }
+
+  // If we get here, the bucket is not in the table, and the table is too full to add it. Since all of the reservoirs have already been allocated
+  // (there are at least twice as many slots as reservoirs), choose one to reuse based on the bucket index.
+  return allowAllocation ? choose_reservoir_to_reuse(bucketIdx, reservoirCount, reuseRandomWhenFull, reuseSeed) : 0;
+}
+
 /**
- * \brief Sets a SCoRe prediction for the specified keypoint that contains all of the clusters in the keypoint's bucket (example reservoir).
+ * \brief Sets the modes associated with the specified keypoint to all of the clusters in the keypoint's bucket (example reservoir).
  *
  * \param x                 The x coordinate of the keypoint.
  * \param y                 The y coordinate of the keypoint.
- * \param imgSize           The dimensions of the bucketIndices and outputPredictions images.
+ * \param imgSize           The dimensions of the bucketIndices and outputModeIndices images.
  * \param bucketIndices     A pointer to an image containing the bucket (example reservoir) indices associated with the keypoints.
  * \param predictionsBlock  A pointer to the storage area holding all of the SCoRe predictions associated with the example reservoirs.
- * \param outputPredictions A pointer to the image in which to store the output SCoRe predictions.
+ * \param outputModeIndices A pointer to the image in which to store the indices (in the predictions block) of the modes associated with the keypoints.
  */
 _CPU_AND_GPU_CODE_
 inline void set_bucket_prediction_for_keypoint(int x, int y, const Vector2i& imgSize, const ORUtils::VectorX<int,1> *bucketIndices,
-                                               const ScorePrediction *predictionsBlock, ScorePrediction *outputPredictions)
+                                               const ScorePrediction *predictionsBlock, ScoreModeIndices *outputModeIndices)
 {
   const int offset = y * imgSize.x + x;
-  outputPredictions[offset] = predictionsBlock[bucketIndices[offset][0]];
+  const int bucketIdx = bucketIndices[offset][0];
+  const int modeCount = predictionsBlock[bucketIdx].size;
+
+  ScoreModeIndices& outputModeIndicesForKeypoint = outputModeIndices[offset];
+  outputModeIndicesForKeypoint.size = modeCount;
+  for(int modeIdx = 0; modeIdx < modeCount; ++modeIdx)
+  {
+    outputModeIndicesForKeypoint.elts[modeIdx] = make_pooled_mode_index(bucketIdx, modeIdx);
+  }
 }
 
 /**
  * \brief Sets a SCoRe prediction for the specified keypoint that contains a single cluster consisting of the world space point predicted by the network for the keypoint.
  *
+ * \note  The output predictions image serves as the mode pool for the output mode indices image.
+ *
  * \param x                 The x coordinate of the keypoint.
  * \param y                 The y coordinate of the keypoint.
- * \param imgSize           The dimensions of the keypoints and outputPredictions images.
+ * \param imgSize           The dimensions of the keypoints, outputPredictions and outputModeIndices images.
  * \param keypoints         A pointer to an image containing the keypoints extracted from the RGB-D image.
  * \param scoreNetOutput    A pointer to a memory block containing the output tensor produced by the SCoRe network.
  * \param outputPredictions A pointer to the image in which to store the output SCoRe predictions.
+ * \param outputModeIndices A pointer to the image in which to store the indices (in the output predictions) of the modes associated with the keypoints.
  */
 _CPU_AND_GPU_CODE_
-inline void set_net_prediction_for_keypoint(int x, int y, const Vector2i& imgSize, const Keypoint3DColour *keypoints, const float *scoreNetOutput, ScorePrediction *outputPredictions)
+inline void set_net_prediction_for_keypoint(int x, int y, const Vector2i& imgSize, const Keypoint3DColour *keypoints, const float *scoreNetOutput,
+                                            ScorePrediction *outputPredictions, ScoreModeIndices *outputModeIndices)
 {
   const int planeOffset = imgSize.x * imgSize.y;
   const int pixelOffset = y * imgSize.x + x;
@@ -54,6 +221,10 @@ inline void set_net_prediction_for_keypoint(int x, int y, const Vector2i& imgSiz
   outputCluster.nbInliers = 1;
   outputCluster.positionInvCovariance.setIdentity();
   outputCluster.determinant = 1.0f;
+
+  ScoreModeIndices& outputModeIndicesForKeypoint = outputModeIndices[pixelOffset];
+  outputModeIndicesForKeypoint.size = 1;
+  outputModeIndicesForKeypoint.elts[0] = make_pooled_mode_index(pixelOffset, 0);
 }
 
 }
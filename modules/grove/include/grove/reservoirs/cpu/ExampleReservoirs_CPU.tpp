@@ -61,7 +61,9 @@ void ExampleReservoirs_CPU<ExampleType>::add_examples_sub(const ExampleImage_CPt
 
   const ExampleType *examplesPtr = examples->GetData(MEMORYDEVICE_CPU);
   int *reservoirAddCalls = this->m_reservoirAddCalls->GetData(MEMORYDEVICE_CPU);
+  unsigned char *reservoirDirtyFlags = this->m_reservoirDirtyFlags->GetData(MEMORYDEVICE_CPU);
   const ORUtils::VectorX<int,ReservoirIndexCount> *reservoirIndicesPtr = reservoirIndices->GetData(MEMORYDEVICE_CPU);
+  int *reservoirInsertionCounts = this->m_reservoirInsertionCounts->GetData(MEMORYDEVICE_CPU);
   int *reservoirSizes = this->m_reservoirSizes->GetData(MEMORYDEVICE_CPU);
   ExampleType *reservoirs = this->m_reservoirs->GetData(MEMORYDEVICE_CPU);
   CPURNG *rngs = m_rngs->GetData(MEMORYDEVICE_CPU);
@@ -78,7 +80,7 @@ void ExampleReservoirs_CPU<ExampleType>::add_examples_sub(const ExampleImage_CPt
 
       add_example_to_reservoirs(
         examplesPtr[linearIdx], reservoirIndicesPtr[linearIdx].v, ReservoirIndexCount, reservoirs,
-        reservoirSizes, reservoirAddCalls, this->m_reservoirCapacity, rngs[linearIdx]
+        reservoirSizes, reservoirAddCalls, reservoirDirtyFlags, reservoirInsertionCounts, this->m_reservoirCapacity, rngs[linearIdx]
       );
     }
   }
@@ -92,6 +94,18 @@ void ExampleReservoirs_CPU<ExampleType>::load_from_disk_sub(const std::string& i
   ORUtils::MemoryBlockPersister::LoadMemoryBlock((inputPath / "reservoirRngs.bin").string(), *m_rngs, MEMORYDEVICE_CPU);
 }
 
+template <typename ExampleType>
+void ExampleReservoirs_CPU<ExampleType>::mark_reservoirs_clustered_sub(uint32_t reservoirStart, uint32_t reservoirCount)
+{
+  unsigned char *reservoirDirtyFlags = this->m_reservoirDirtyFlags->GetData(MEMORYDEVICE_CPU);
+  int *reservoirInsertionCounts = this->m_reservoirInsertionCounts->GetData(MEMORYDEVICE_CPU);
+
+  for(int reservoirIdx = static_cast<int>(reservoirStart), reservoirEnd = static_cast<int>(reservoirStart + reservoirCount); reservoirIdx < reservoirEnd; ++reservoirIdx)
+  {
+    mark_reservoir_clustered(reservoirIdx, reservoirDirtyFlags, reservoirInsertionCounts);
+  }
+}
+
 template <typename ExampleType>
 void ExampleReservoirs_CPU<ExampleType>::reinit_rngs()
 {
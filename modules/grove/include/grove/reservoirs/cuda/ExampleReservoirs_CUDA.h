@@ -58,6 +58,9 @@ private:
   /** Override */
   virtual void load_from_disk_sub(const std::string& inputFolder);
 
+  /** Override */
+  virtual void mark_reservoirs_clustered_sub(uint32_t reservoirStart, uint32_t reservoirCount);
+
   /**
    * \brief Reinitialises the random number generators using known seeds.
    */
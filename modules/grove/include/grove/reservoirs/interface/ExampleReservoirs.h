@@ -78,6 +78,15 @@ protected:
   /** The number of times the insertion of an example has been attempted for each reservoir. Has an element for each reservoir (i.e. row in m_reservoirs). */
   ORIntMemoryBlock_Ptr m_reservoirAddCalls;
 
+  /**
+   * Flags indicating whether any of the existing examples in each reservoir have been replaced since the reservoir was last
+   * marked as clustered (in which case its clusters can no longer be updated incrementally). Has an element for each reservoir.
+   */
+  ORUCharMemoryBlock_Ptr m_reservoirDirtyFlags;
+
+  /** The number of examples that have been written into each reservoir since it was last marked as clustered. Has an element for each reservoir. */
+  ORIntMemoryBlock_Ptr m_reservoirInsertionCounts;
+
   /** The current size of each reservoir. Has an element for each reservoir (i.e. row in m_reservoirs). */
   ORIntMemoryBlock_Ptr m_reservoirSizes;
 
@@ -120,6 +129,14 @@ private:
    */
   virtual void load_from_disk_sub(const std::string& inputFolder) = 0;
 
+  /**
+   * \brief Clears the dirty flags and insertion counts of a contiguous range of reservoirs, on the device on which the reservoirs are stored.
+   *
+   * \param reservoirStart  The index of the first reservoir in the range.
+   * \param reservoirCount  The number of reservoirs in the range.
+   */
+  virtual void mark_reservoirs_clustered_sub(uint32_t reservoirStart, uint32_t reservoirCount) = 0;
+
   /**
    * \brief An overridable hook function that is called at the end of save_to_disk to allow subclasses to perform additional saving steps.
    *
@@ -163,6 +180,24 @@ public:
    */
   uint32_t get_reservoir_capacity() const;
 
+  /**
+   * \brief Gets the dirty flag for each example reservoir.
+   *
+   * \note  A reservoir is dirty if at least one of the examples it contained when it was last marked as clustered has since
+   *        been replaced. If a reservoir is not dirty, the examples written into it since then are the last n examples it
+   *        contains, where n is its insertion count.
+   *
+   * \return  A memory block containing the dirty flag for each example reservoir.
+   */
+  ORUCharMemoryBlock_CPtr get_reservoir_dirty_flags() const;
+
+  /**
+   * \brief Gets the number of examples that have been written into each example reservoir since it was last marked as clustered.
+   *
+   * \return  A memory block containing the insertion count for each example reservoir.
+   */
+  ORIntMemoryBlock_CPtr get_reservoir_insertion_counts() const;
+
   /**
    * \brief Gets the example reservoirs.
    *
@@ -196,6 +231,18 @@ public:
    */
   void load_from_disk(const std::string& inputFolder);
 
+  /**
+   * \brief Clears the dirty flags and insertion counts of a contiguous range of reservoirs whose clusters are now up to date.
+   *
+   * \note  This is done on the device on which the reservoirs are stored, so it does not require any copying between the CPU and GPU.
+   *
+   * \param reservoirStart  The index of the first reservoir in the range.
+   * \param reservoirCount  The number of reservoirs in the range.
+   *
+   * \throws std::invalid_argument If the range extends beyond the last reservoir.
+   */
+  void mark_reservoirs_clustered(uint32_t reservoirStart, uint32_t reservoirCount);
+
   /**
    * \brief Clears the reservoirs, discards all examples and reinitialises the random number generators.
    */
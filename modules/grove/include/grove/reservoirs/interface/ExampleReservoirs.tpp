@@ -5,6 +5,8 @@
 
 #include "ExampleReservoirs.h"
 
+#include <algorithm>
+
 #include <boost/filesystem.hpp>
 namespace bf = boost::filesystem;
 
@@ -25,6 +27,8 @@ ExampleReservoirs<ExampleType>::ExampleReservoirs(uint32_t reservoirCount, uint3
   // One row per reservoir, width equal to the capacity.
   m_reservoirs = mbf.make_image<ExampleType>(Vector2i(reservoirCapacity, reservoirCount));
   m_reservoirAddCalls = mbf.make_block<int>(reservoirCount);
+  m_reservoirDirtyFlags = mbf.make_block<uchar>(reservoirCount);
+  m_reservoirInsertionCounts = mbf.make_block<int>(reservoirCount);
   m_reservoirSizes = mbf.make_block<int>(reservoirCount);
 }
 
@@ -63,6 +67,18 @@ uint32_t ExampleReservoirs<ExampleType>::get_reservoir_capacity() const
   return m_reservoirCapacity;
 }
 
+template <typename ExampleType>
+ORUCharMemoryBlock_CPtr ExampleReservoirs<ExampleType>::get_reservoir_dirty_flags() const
+{
+  return m_reservoirDirtyFlags;
+}
+
+template <typename ExampleType>
+ORIntMemoryBlock_CPtr ExampleReservoirs<ExampleType>::get_reservoir_insertion_counts() const
+{
+  return m_reservoirInsertionCounts;
+}
+
 template <typename ExampleType>
 typename ExampleReservoirs<ExampleType>::ExampleImage_CPtr ExampleReservoirs<ExampleType>::get_reservoirs() const
 {
@@ -91,20 +107,55 @@ void ExampleReservoirs<ExampleType>::load_from_disk(const std::string& inputFold
   ORUtils::MemoryBlockPersister::LoadMemoryBlock((inputPath / "reservoirAddCalls.bin").string(), *m_reservoirAddCalls, MEMORYDEVICE_CPU);
   ORUtils::MemoryBlockPersister::LoadMemoryBlock((inputPath / "reservoirSizes.bin").string(), *m_reservoirSizes, MEMORYDEVICE_CPU);
 
+  // Load the dirty flags and insertion counts. Reservoirs saved before these were tracked are conservatively treated as if all
+  // of their examples had been replaced since they were last clustered, so that they will be fully re-clustered when needed.
+  const bf::path dirtyFlagsPath = inputPath / "reservoirDirtyFlags.bin";
+  const bf::path insertionCountsPath = inputPath / "reservoirInsertionCounts.bin";
+  if(bf::exists(dirtyFlagsPath) && bf::exists(insertionCountsPath))
+  {
+    ORUtils::MemoryBlockPersister::LoadMemoryBlock(dirtyFlagsPath.string(), *m_reservoirDirtyFlags, MEMORYDEVICE_CPU);
+    ORUtils::MemoryBlockPersister::LoadMemoryBlock(insertionCountsPath.string(), *m_reservoirInsertionCounts, MEMORYDEVICE_CPU);
+  }
+  else
+  {
+    std::fill_n(m_reservoirDirtyFlags->GetData(MEMORYDEVICE_CPU), m_reservoirCount, static_cast<uchar>(1));
+    std::copy(m_reservoirSizes->GetData(MEMORYDEVICE_CPU), m_reservoirSizes->GetData(MEMORYDEVICE_CPU) + m_reservoirCount, m_reservoirInsertionCounts->GetData(MEMORYDEVICE_CPU));
+  }
+
   // If we're using the GPU, copy the data across.
   m_reservoirs->UpdateDeviceFromHost();
   m_reservoirAddCalls->UpdateDeviceFromHost();
+  m_reservoirDirtyFlags->UpdateDeviceFromHost();
+  m_reservoirInsertionCounts->UpdateDeviceFromHost();
   m_reservoirSizes->UpdateDeviceFromHost();
 
   // Call the overridable hook function to allow subclasses to perform additional loading steps.
   load_from_disk_sub(inputFolder);
 }
 
+template <typename ExampleType>
+void ExampleReservoirs<ExampleType>::mark_reservoirs_clustered(uint32_t reservoirStart, uint32_t reservoirCount)
+{
+  // Check the preconditions.
+  if(reservoirStart + reservoirCount > m_reservoirCount)
+  {
+    throw std::invalid_argument("Error: reservoirStart + reservoirCount > m_reservoirCount");
+  }
+
+  // If the range is empty, early out.
+  if(reservoirCount == 0) return;
+
+  // Clear the dirty flags and insertion counts of the specified reservoirs on the device on which they are stored.
+  mark_reservoirs_clustered_sub(reservoirStart, reservoirCount);
+}
+
 template <typename ExampleType>
 void ExampleReservoirs<ExampleType>::reset()
 {
   // Note: There is no need to clear m_reservoirs - it is sufficient to simply reset the size of each reservoir to 0.
   m_reservoirAddCalls->Clear();
+  m_reservoirDirtyFlags->Clear();
+  m_reservoirInsertionCounts->Clear();
   m_reservoirSizes->Clear();
 }
 
@@ -116,11 +167,15 @@ void ExampleReservoirs<ExampleType>::save_to_disk(const std::string& outputFolde
   // If we're using the GPU, copy the data across to the CPU so that it can be saved.
   m_reservoirs->UpdateHostFromDevice();
   m_reservoirAddCalls->UpdateHostFromDevice();
+  m_reservoirDirtyFlags->UpdateHostFromDevice();
+  m_reservoirInsertionCounts->UpdateHostFromDevice();
   m_reservoirSizes->UpdateHostFromDevice();
 
   // Save the data to disk.
   ORUtils::MemoryBlockPersister::SaveImage((outputPath / "reservoirs.bin").string(), *m_reservoirs, MEMORYDEVICE_CPU);
   ORUtils::MemoryBlockPersister::SaveMemoryBlock((outputPath / "reservoirAddCalls.bin").string(), *m_reservoirAddCalls, MEMORYDEVICE_CPU);
+  ORUtils::MemoryBlockPersister::SaveMemoryBlock((outputPath / "reservoirDirtyFlags.bin").string(), *m_reservoirDirtyFlags, MEMORYDEVICE_CPU);
+  ORUtils::MemoryBlockPersister::SaveMemoryBlock((outputPath / "reservoirInsertionCounts.bin").string(), *m_reservoirInsertionCounts, MEMORYDEVICE_CPU);
   ORUtils::MemoryBlockPersister::SaveMemoryBlock((outputPath / "reservoirSizes.bin").string(), *m_reservoirSizes, MEMORYDEVICE_CPU);
 
   // Call the overridable hook function to allow subclasses to perform additional saving steps.
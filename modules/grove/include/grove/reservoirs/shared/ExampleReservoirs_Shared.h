@@ -21,20 +21,27 @@ namespace grove {
  * example. If ALWAYS_ADD_EXAMPLES is 0, then an additional random decision is made as
  * to *whether* to replace an existing example.
  *
- * \param example             The example to attempt to add to the reservoirs.
- * \param reservoirIndices    The indices of the reservoirs to which to attempt to add the example.
- * \param reservoirIndexCount The number of reservoirs to which to attempt to add the example.
- * \param reservoirs          The example reservoirs: an image in which each row allows the storage of up to reservoirCapacity examples.
- * \param reservoirSizes      The current size of each reservoir.
- * \param reservoirAddCalls   The number of times the insertion of an example has been attempted for each reservoir.
- * \param reservoirCapacity   The capacity (maximum size) of each reservoir.
- * \param randomGenerator     A random number generator.
+ * Each example that actually gets written into a reservoir increments its insertion count,
+ * and each example that replaces an existing one also marks the reservoir as dirty. These
+ * allow the relocaliser to tell which reservoirs need to be re-clustered, and whether or
+ * not their existing clusters can simply be updated with the newly-added examples.
+ *
+ * \param example                  The example to attempt to add to the reservoirs.
+ * \param reservoirIndices         The indices of the reservoirs to which to attempt to add the example.
+ * \param reservoirIndexCount      The number of reservoirs to which to attempt to add the example.
+ * \param reservoirs               The example reservoirs: an image in which each row allows the storage of up to reservoirCapacity examples.
+ * \param reservoirSizes           The current size of each reservoir.
+ * \param reservoirAddCalls        The number of times the insertion of an example has been attempted for each reservoir.
+ * \param reservoirDirtyFlags      Flags indicating whether any of the existing examples in each reservoir have been replaced since it was last clustered.
+ * \param reservoirInsertionCounts The number of examples that have been written into each reservoir since it was last clustered.
+ * \param reservoirCapacity        The capacity (maximum size) of each reservoir.
+ * \param randomGenerator          A random number generator.
  */
 template <typename ExampleType, typename RNGType>
 _CPU_AND_GPU_CODE_TEMPLATE_
 inline void add_example_to_reservoirs(const ExampleType& example, const int *reservoirIndices, uint32_t reservoirIndexCount,
-                                      ExampleType *reservoirs, int *reservoirSizes, int *reservoirAddCalls, uint32_t reservoirCapacity,
-                                      RNGType& randomGenerator)
+                                      ExampleType *reservoirs, int *reservoirSizes, int *reservoirAddCalls, unsigned char *reservoirDirtyFlags,
+                                      int *reservoirInsertionCounts, uint32_t reservoirCapacity, RNGType& randomGenerator)
 {
   // If the example is invalid, early out.
   if(!example.valid) return;
@@ -82,6 +89,16 @@ inline void add_example_to_reservoirs(const ExampleType& example, const int *res
     #endif
       ++reservoirSizes[reservoirIdx];
 #endif
+
+      // Record the insertion so that the reservoir's clusters can be brought up to date.
+#ifdef __CUDACC__
+      atomicAdd(&reservoirInsertionCounts[reservoirIdx], 1);
+#else
+    #ifdef WITH_OPENMP
+      #pragma omp atomic
+    #endif
+      ++reservoirInsertionCounts[reservoirIdx];
+#endif
     }
     else
     {
@@ -97,11 +114,37 @@ inline void add_example_to_reservoirs(const ExampleType& example, const int *res
       if(randomOffset < reservoirCapacity)
       {
         reservoirs[reservoirStartIdx + randomOffset] = example;
+
+        // Record the insertion, and mark the reservoir as dirty, since one of its existing examples has been discarded.
+        // Note that concurrent writes to the dirty flag are benign, since they all write the same value.
+        reservoirDirtyFlags[reservoirIdx] = 1;
+#ifdef __CUDACC__
+        atomicAdd(&reservoirInsertionCounts[reservoirIdx], 1);
+#else
+      #ifdef WITH_OPENMP
+        #pragma omp atomic
+      #endif
+        ++reservoirInsertionCounts[reservoirIdx];
+#endif
       }
     }
   }
 }
 
+/**
+ * \brief Marks a reservoir as clustered, by clearing its dirty flag and insertion count.
+ *
+ * \param reservoirIdx             The index of the reservoir.
+ * \param reservoirDirtyFlags      Flags indicating whether any of the existing examples in each reservoir have been replaced since it was last clustered.
+ * \param reservoirInsertionCounts The number of examples that have been written into each reservoir since it was last clustered.
+ */
+_CPU_AND_GPU_CODE_
+inline void mark_reservoir_clustered(int reservoirIdx, unsigned char *reservoirDirtyFlags, int *reservoirInsertionCounts)
+{
+  reservoirDirtyFlags[reservoirIdx] = 0;
+  reservoirInsertionCounts[reservoirIdx] = 0;
+}
+
 }
 
 #endif
@@ -120,6 +120,50 @@ inline void create_cluster_from_examples(int key, const Keypoint3DColour *exampl
   positionCovariance.inv(outputCluster.positionInvCovariance);
 }
 
+/**
+ * \brief Updates a modal cluster to account for an additional example that belongs to it.
+ *
+ * \note  The cluster's position, covariance and colour are updated in the same way as if they had been computed from scratch
+ *        from the cluster's original examples plus the new one (up to floating-point error and the rounding of the colour).
+ *
+ * \param example The example to add to the cluster.
+ * \param cluster The cluster to update (must contain at least two examples).
+ */
+_CPU_AND_GPU_CODE_
+inline void add_example_to_cluster(const Keypoint3DColour& example, Keypoint3DColourCluster& cluster)
+{
+  const float oldInlierCount = static_cast<float>(cluster.nbInliers);
+  const float newInlierCount = oldInlierCount + 1.0f;
+
+  // Recover the cluster's covariance matrix from its inverse.
+  Matrix3f positionCovariance;
+  cluster.positionInvCovariance.inv(positionCovariance);
+
+  // Update the mean and covariance of the cluster's positions using Welford's algorithm.
+  const Vector3f oldDelta = example.position - cluster.position;
+  const Vector3f positionMean = cluster.position + oldDelta / newInlierCount;
+  const Vector3f newDelta = example.position - positionMean;
+
+  for(int i = 0; i < 3; ++i)
+  {
+    for(int j = 0; j < 3; ++j)
+    {
+      float& elt = positionCovariance.m[i * 3 + j];
+      elt = ((oldInlierCount - 1.0f) * elt + oldDelta.v[i] * newDelta.v[j]) / oldInlierCount;
+    }
+  }
+
+  // Update the mean colour of the cluster.
+  const Vector3f colourMean = (cluster.colour.toFloat() * oldInlierCount + example.colour.toFloat()) / newInlierCount;
+
+  // Finally, write the updated values back into the cluster.
+  cluster.colour = colourMean.toUChar();
+  cluster.determinant = positionCovariance.det();
+  cluster.nbInliers = static_cast<int>(newInlierCount);
+  cluster.position = positionMean;
+  positionCovariance.inv(cluster.positionInvCovariance);
+}
+
 /**
  * \brief Computes the squared distance between two 3D colour keypoints.
  *
@@ -0,0 +1,118 @@
+/**
+ * grove: ScoreModeIndices.h
+ * Copyright (c) Torr Vision Group, University of Oxford, 2018. All rights reserved.
+ */
+
+#ifndef H_GROVE_SCOREMODEINDICES
+#define H_GROVE_SCOREMODEINDICES
+
+#include "ScorePrediction.h"
+
+namespace grove {
+
+//#################### TYPEDEFS ####################
+
+/**
+ * The indices of the modes associated with a keypoint. Rather than storing copies of the modes themselves, each index refers
+ * to a mode in a pool of SCoRe predictions (e.g. the predictions associated with the leaves of a forest), and encodes both the
+ * index of the prediction in the pool and the index of the mode within that prediction (see make_pooled_mode_index). This keeps
+ * the per-keypoint storage small (a few hundred bytes, rather than the few kilobytes needed to store a full ScorePrediction).
+ */
+typedef Array<int,ScorePrediction::Capacity> ScoreModeIndices;
+
+typedef ORUtils::Image<ScoreModeIndices> ScoreModeIndicesImage;
+typedef boost::shared_ptr<ScoreModeIndicesImage> ScoreModeIndicesImage_Ptr;
+typedef boost::shared_ptr<const ScoreModeIndicesImage> ScoreModeIndicesImage_CPtr;
+
+//#################### FUNCTIONS ####################
+
+/**
+ * \brief Makes the index in a mode pool of the specified mode of the specified SCoRe prediction.
+ *
+ * \param predictionIdx The index of the prediction in the pool.
+ * \param modeIdx       The index of the mode within the prediction.
+ * \return              The index of the mode in the pool.
+ */
+_CPU_AND_GPU_CODE_
+inline int make_pooled_mode_index(int predictionIdx, int modeIdx)
+{
+  return predictionIdx * ScorePrediction::Capacity + modeIdx;
+}
+
+/**
+ * \brief Looks up a mode in a mode pool.
+ *
+ * \param modePool      The mode pool (an array of SCoRe predictions).
+ * \param pooledModeIdx The index of the mode in the pool (see make_pooled_mode_index).
+ * \return              The mode.
+ */
+_CPU_AND_GPU_CODE_
+inline const Keypoint3DColourCluster& get_pooled_mode(const ScorePrediction *modePool, int pooledModeIdx)
+{
+  return modePool[pooledModeIdx / ScorePrediction::Capacity].elts[pooledModeIdx % ScorePrediction::Capacity];
+}
+
+/**
+ * \brief Attempts to find the position (in a list of mode indices) of the mode whose Mahalanobis distance to the specified 3D point is smallest.
+ *
+ * \note  This is the equivalent of find_closest_mode for a keypoint whose modes are stored in a mode pool. It considers the modes in the
+ *        same order, and computes the same energies, as find_closest_mode would for a ScorePrediction containing copies of the modes.
+ *
+ * \param pt                The 3D point (in world coordinates).
+ * \param modeIndices       The indices of the modes to consider.
+ * \param modePool          The mode pool into which the indices point.
+ * \param closestModeEnergy A location in which to store the energy associated with the closest mode (if any).
+ * \return                  The position of the closest mode in the list of mode indices, if any, or -1 if the list is empty.
+ */
+_CPU_AND_GPU_CODE_
+inline int find_closest_mode(const Vector3f& pt, const ScoreModeIndices& modeIndices, const ScorePrediction *modePool, float& closestModeEnergy)
+{
+  const float exponent = powf(2.0f * static_cast<float>(M_PI), 3);
+
+  // As in find_closest_mode for predictions, we force the selection of a mode (if there are any) regardless of what happens in the loop.
+  int closestModeIdx = modeIndices.size > 0 ? 0 : -1;
+
+  closestModeEnergy = 0.0f;
+
+  for(int i = 0; i < modeIndices.size; ++i)
+  {
+    const Keypoint3DColourCluster& currentMode = get_pooled_mode(modePool, modeIndices.elts[i]);
+
+    const Vector3f diff = pt - currentMode.position;
+    const float mahalanobisSq = dot(diff, currentMode.positionInvCovariance * diff);
+
+    const float descriptiveStatistics = expf(-0.5f * mahalanobisSq);
+    const float normalization = 1.0f / sqrtf(currentMode.determinant * exponent);
+    const float evalGaussian = normalization * descriptiveStatistics;
+
+    const float nbPts = static_cast<float>(currentMode.nbInliers);
+    const float energy = nbPts * evalGaussian;
+
+    if(energy > closestModeEnergy)
+    {
+      closestModeIdx = i;
+      closestModeEnergy = energy;
+    }
+  }
+
+  return closestModeIdx;
+}
+
+/**
+ * \brief Attempts to find the position (in a list of mode indices) of the mode whose Mahalanobis distance to the specified 3D point is smallest.
+ *
+ * \param pt          The 3D point (in world coordinates).
+ * \param modeIndices The indices of the modes to consider.
+ * \param modePool    The mode pool into which the indices point.
+ * \return            The position of the closest mode in the list of mode indices, if any, or -1 if the list is empty.
+ */
+_CPU_AND_GPU_CODE_
+inline int find_closest_mode(const Vector3f& pt, const ScoreModeIndices& modeIndices, const ScorePrediction *modePool)
+{
+  float energy;
+  return find_closest_mode(pt, modeIndices, modePool, energy);
+}
+
+}
+
+#endif
@@ -91,6 +91,53 @@ inline int find_closest_mode(const Vector3f& pt, const ScorePrediction& predicti
   return find_closest_mode(pt, prediction, energy);
 }
 
+/**
+ * \brief Attempts to update the modes of a SCoRe prediction to account for some examples that have been added to the
+ *        reservoir from which the modes were computed, without re-clustering the reservoir from scratch.
+ *
+ * Each example is added to the mode that is closest to it (see find_closest_mode). This only approximates what a full
+ * re-clustering of the reservoir would produce, so the update is refused if any example is too far from every mode,
+ * since that is a sign that the examples could change the structure of the modes (e.g. by forming a new one).
+ *
+ * \param examples          The examples that have been added to the reservoir.
+ * \param exampleCount      The number of examples that have been added to the reservoir.
+ * \param maxMahalanobisSq  The maximum squared Mahalanobis distance there can be between an example and its closest mode.
+ * \param prediction        The SCoRe prediction to update (it is left unchanged if the update is refused).
+ * \return                  true, if the prediction was successfully updated, or false otherwise.
+ */
+_CPU_AND_GPU_CODE_
+inline bool update_prediction_incrementally(const Keypoint3DColour *examples, int exampleCount, float maxMahalanobisSq, ScorePrediction& prediction)
+{
+  ScorePrediction updatedPrediction = prediction;
+
+  for(int exampleIdx = 0; exampleIdx < exampleCount; ++exampleIdx)
+  {
+    const Keypoint3DColour& example = examples[exampleIdx];
+
+    // Find the mode that is closest to the example, and check that the example is close enough to it.
+    const int closestModeIdx = find_closest_mode(example.position, updatedPrediction);
+    if(closestModeIdx == -1) return false;
+
+    Keypoint3DColourCluster& closestMode = updatedPrediction.elts[closestModeIdx];
+    const Vector3f diff = example.position - closestMode.position;
+    if(dot(diff, closestMode.positionInvCovariance * diff) > maxMahalanobisSq) return false;
+
+    // Add the example to the mode.
+    add_example_to_cluster(example, closestMode);
+
+    // Move the mode forwards as necessary to keep the modes in non-increasing order of size (as the clusterer would produce them).
+    for(int modeIdx = closestModeIdx; modeIdx > 0 && updatedPrediction.elts[modeIdx - 1].nbInliers < updatedPrediction.elts[modeIdx].nbInliers; --modeIdx)
+    {
+      const Keypoint3DColourCluster temp = updatedPrediction.elts[modeIdx - 1];
+      updatedPrediction.elts[modeIdx - 1] = updatedPrediction.elts[modeIdx];
+      updatedPrediction.elts[modeIdx] = temp;
+    }
+  }
+
+  prediction = updatedPrediction;
+  return true;
+}
+
 }
 
 #endif
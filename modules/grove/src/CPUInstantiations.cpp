@@ -5,6 +5,7 @@
 
 #include "clustering/ExampleClustererFactory.tpp"
 #include "clustering/cpu/ExampleClusterer_CPU.tpp"
+#include "clustering/cpu/GridExampleClusterer_CPU.tpp"
 #include "clustering/interface/ExampleClusterer.tpp"
 #include "features/FeatureCalculatorFactory.tpp"
 #include "features/cpu/RGBDPatchFeatureCalculator_CPU.tpp"
@@ -33,6 +34,7 @@ namespace {
 template class ExampleClusterer<Keypoint3DColour, Keypoint3DColourCluster, ScorePrediction::Capacity>;
 template class ExampleClusterer_CPU<Keypoint3DColour, Keypoint3DColourCluster, ScorePrediction::Capacity>;
 template struct ExampleClustererFactory<Keypoint3DColour, Keypoint3DColourCluster, ScorePrediction::Capacity>;
+template class GridExampleClusterer_CPU<Keypoint3DColour, Keypoint3DColourCluster, ScorePrediction::Capacity>;
 
 template shared_ptr<RGBDPatchFeatureCalculator<Keypoint2D,RGBDPatchDescriptor> >
 FeatureCalculatorFactory::make_custom_patch_feature_calculator<Keypoint2D,RGBDPatchDescriptor>(
@@ -75,6 +77,13 @@ template class DecisionForest<RGBDPatchDescriptor, FOREST_TREES>;
 template class DecisionForest_CPU<RGBDPatchDescriptor, FOREST_TREES>;
 template struct DecisionForestFactory<RGBDPatchDescriptor, FOREST_TREES>;
 
+template size_t DecisionForest_CPU<RGBDPatchDescriptor, FOREST_TREES>::find_leaves_lazily(
+  const RGBDPatchFeatureCalculator_CPU<Keypoint2D,RGBDPatchDescriptor>::FeatureEvaluator&, const Vector2i&, shared_ptr<Image<VectorX<int,FOREST_TREES> > >&
+) const;
+template size_t DecisionForest_CPU<RGBDPatchDescriptor, FOREST_TREES>::find_leaves_lazily(
+  const RGBDPatchFeatureCalculator_CPU<Keypoint3DColour,RGBDPatchDescriptor>::FeatureEvaluator&, const Vector2i&, shared_ptr<Image<VectorX<int,FOREST_TREES> > >&
+) const;
+
 template class ExampleReservoirs<Keypoint2D>;
 template class ExampleReservoirs<Keypoint3DColour>;
 template class ExampleReservoirs_CPU<Keypoint2D>;
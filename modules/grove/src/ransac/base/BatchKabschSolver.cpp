@@ -0,0 +1,278 @@
+/**
+ * grove: BatchKabschSolver.cpp
+ * Copyright (c) Torr Vision Group, University of Oxford, 2019. All rights reserved.
+ */
+
+#include "ransac/base/BatchKabschSolver.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <Eigen/Dense>
+
+#include <orx/geometry/GeometryUtil.h>
+using namespace orx;
+
+namespace grove {
+
+//#################### CONSTRUCTORS ####################
+
+BatchKabschSolver::BatchKabschSolver(float minTriangleArea)
+: m_minTriangleArea(minTriangleArea)
+{}
+
+//#################### PUBLIC MEMBER FUNCTIONS ####################
+
+int BatchKabschSolver::solve(PoseCandidate *candidates, int candidateCount)
+{
+  if(candidateCount <= 0) return 0;
+
+  const int blockCount = (candidateCount + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  const size_t paddedCount = static_cast<size_t>(blockCount) * BLOCK_SIZE;
+
+  // Make sure that the buffers are large enough to store the (padded) batch.
+  if(m_fallbackFlags.size() < paddedCount)
+  {
+    for(int i = 0; i < COORD_COUNT; ++i)
+    {
+      m_cameraCoords[i].resize(paddedCount);
+      m_worldCoords[i].resize(paddedCount);
+    }
+
+    for(int i = 0; i < 12; ++i)
+    {
+      m_poses[i].resize(paddedCount);
+    }
+
+    m_fallbackFlags.resize(paddedCount);
+    m_validFlags.resize(paddedCount);
+  }
+
+  // Gather the candidates' correspondences into the structure-of-arrays layout. The padding at the end of the last block
+  // is filled with copies of the last candidate's correspondences, so that it does not introduce any degenerate problems.
+  for(size_t i = 0; i < paddedCount; ++i)
+  {
+    const PoseCandidate& candidate = candidates[std::min(static_cast<int>(i), candidateCount - 1)];
+    for(int j = 0; j < PoseCandidate::KABSCH_CORRESPONDENCES_NEEDED; ++j)
+    {
+      for(int k = 0; k < 3; ++k)
+      {
+        m_cameraCoords[j * 3 + k][i] = candidate.pointsCamera[j][k];
+        m_worldCoords[j * 3 + k][i] = candidate.pointsWorld[j][k];
+      }
+    }
+  }
+
+  // Solve the Kabsch problems, one block at a time.
+#ifdef WITH_OPENMP
+  #pragma omp parallel for
+#endif
+  for(int blockIdx = 0; blockIdx < blockCount; ++blockIdx)
+  {
+    solve_block(blockIdx * BLOCK_SIZE);
+  }
+
+  // Scatter the estimated poses back into the candidates, compacting the candidates that passed the pre-filter to the front of the array.
+  int survivorCount = 0;
+  for(int i = 0; i < candidateCount; ++i)
+  {
+    if(!m_validFlags[i]) continue;
+
+    PoseCandidate& candidate = candidates[survivorCount++];
+    if(&candidate != &candidates[i]) candidate = candidates[i];
+
+    if(m_fallbackFlags[i])
+    {
+      // The largest eigenvalue of the key matrix was not simple, or could not be found, so use the SVD-based implementation instead.
+      Eigen::Matrix3f cameraPoints, worldPoints;
+      for(int j = 0; j < PoseCandidate::KABSCH_CORRESPONDENCES_NEEDED; ++j)
+      {
+        cameraPoints.col(j) = Eigen::Map<const Eigen::Vector3f>(candidate.pointsCamera[j].v);
+        worldPoints.col(j) = Eigen::Map<const Eigen::Vector3f>(candidate.pointsWorld[j].v);
+      }
+
+      Eigen::Map<Eigen::Matrix4f>(candidate.cameraPose.m) = GeometryUtil::estimate_rigid_transform(cameraPoints, worldPoints);
+    }
+    else
+    {
+      // Note: ORUtils matrices are stored in column-major order, so m[col * 4 + row] is the element in the specified row and column.
+      Matrix4f& M = candidate.cameraPose;
+      for(int row = 0; row < 3; ++row)
+      {
+        for(int col = 0; col < 4; ++col)
+        {
+          M.m[col * 4 + row] = m_poses[row * 4 + col][i];
+        }
+      }
+
+      M.m[3] = M.m[7] = M.m[11] = 0.0f;
+      M.m[15] = 1.0f;
+    }
+  }
+
+  return survivorCount;
+}
+
+//#################### PRIVATE MEMBER FUNCTIONS ####################
+
+void BatchKabschSolver::solve_block(int blockStart)
+{
+  // The maximum number of Newton-Raphson iterations used to find the largest eigenvalue of each key matrix. Starting from an upper bound
+  // on the eigenvalue, the iterations converge monotonically, but convergence can be slow (e.g. when the largest eigenvalue is close to
+  // the next one, as it is for candidates with mismatched correspondences), so we iterate until the step is small relative to the
+  // eigenvalue, and flag any candidate for which this has not happened within the maximum number of iterations for the SVD fallback.
+  const int maxNewtonIterations = 100;
+
+  // The tolerance (relative to the eigenvalue) on the Newton-Raphson step below which the eigenvalue is deemed to have converged.
+  const double newtonTolerance = 1e-12;
+
+  // The tolerance used to decide whether the largest eigenvalue of a key matrix is simple (relative to the scale of the problem).
+  const double eigenvectorTolerance = 1e-9;
+
+  const float *ax = &m_cameraCoords[0][blockStart], *ay = &m_cameraCoords[1][blockStart], *az = &m_cameraCoords[2][blockStart];
+  const float *bx = &m_cameraCoords[3][blockStart], *by = &m_cameraCoords[4][blockStart], *bz = &m_cameraCoords[5][blockStart];
+  const float *cx = &m_cameraCoords[6][blockStart], *cy = &m_cameraCoords[7][blockStart], *cz = &m_cameraCoords[8][blockStart];
+  const float *dx = &m_worldCoords[0][blockStart], *dy = &m_worldCoords[1][blockStart], *dz = &m_worldCoords[2][blockStart];
+  const float *ex = &m_worldCoords[3][blockStart], *ey = &m_worldCoords[4][blockStart], *ez = &m_worldCoords[5][blockStart];
+  const float *fx = &m_worldCoords[6][blockStart], *fy = &m_worldCoords[7][blockStart], *fz = &m_worldCoords[8][blockStart];
+
+  float *poses[12];
+  for(int i = 0; i < 12; ++i) poses[i] = &m_poses[i][blockStart];
+  unsigned char *fallbackFlags = &m_fallbackFlags[blockStart];
+  unsigned char *validFlags = &m_validFlags[blockStart];
+
+  const double minTwiceAreaSq = 4.0 * m_minTriangleArea * m_minTriangleArea;
+
+  for(int i = 0; i < BLOCK_SIZE; ++i)
+  {
+    // Compute the centroids of the camera points (a, b, c) and world points (d, e, f).
+    const double pcx = (static_cast<double>(ax[i]) + bx[i] + cx[i]) / 3.0;
+    const double pcy = (static_cast<double>(ay[i]) + by[i] + cy[i]) / 3.0;
+    const double pcz = (static_cast<double>(az[i]) + bz[i] + cz[i]) / 3.0;
+    const double qcx = (static_cast<double>(dx[i]) + ex[i] + fx[i]) / 3.0;
+    const double qcy = (static_cast<double>(dy[i]) + ey[i] + fy[i]) / 3.0;
+    const double qcz = (static_cast<double>(dz[i]) + ez[i] + fz[i]) / 3.0;
+
+    // Centre the points.
+    const double p0x = ax[i] - pcx, p0y = ay[i] - pcy, p0z = az[i] - pcz;
+    const double p1x = bx[i] - pcx, p1y = by[i] - pcy, p1z = bz[i] - pcz;
+    const double p2x = cx[i] - pcx, p2y = cy[i] - pcy, p2z = cz[i] - pcz;
+    const double q0x = dx[i] - qcx, q0y = dy[i] - qcy, q0z = dz[i] - qcz;
+    const double q1x = ex[i] - qcx, q1y = ey[i] - qcy, q1z = ez[i] - qcz;
+    const double q2x = fx[i] - qcx, q2y = fy[i] - qcy, q2z = fz[i] - qcz;
+
+    // Apply the geometric pre-filter, which checks that both triangles have at least the minimum area. Note that the cross product
+    // of two edges of a triangle has a length equal to twice its area, and that the centred points have the same edges.
+    const double pnx = (p1y - p0y) * (p2z - p0z) - (p1z - p0z) * (p2y - p0y);
+    const double pny = (p1z - p0z) * (p2x - p0x) - (p1x - p0x) * (p2z - p0z);
+    const double pnz = (p1x - p0x) * (p2y - p0y) - (p1y - p0y) * (p2x - p0x);
+    const double qnx = (q1y - q0y) * (q2z - q0z) - (q1z - q0z) * (q2y - q0y);
+    const double qny = (q1z - q0z) * (q2x - q0x) - (q1x - q0x) * (q2z - q0z);
+    const double qnz = (q1x - q0x) * (q2y - q0y) - (q1y - q0y) * (q2x - q0x);
+    const double pTwiceAreaSq = pnx * pnx + pny * pny + pnz * pnz;
+    const double qTwiceAreaSq = qnx * qnx + qny * qny + qnz * qnz;
+    validFlags[i] = pTwiceAreaSq >= minTwiceAreaSq && qTwiceAreaSq >= minTwiceAreaSq;
+
+    // Compute the cross-covariance matrix S of the centred points (S_uv is the sum over the points of p_u * q_v).
+    const double sxx = p0x * q0x + p1x * q1x + p2x * q2x, sxy = p0x * q0y + p1x * q1y + p2x * q2y, sxz = p0x * q0z + p1x * q1z + p2x * q2z;
+    const double syx = p0y * q0x + p1y * q1x + p2y * q2x, syy = p0y * q0y + p1y * q1y + p2y * q2y, syz = p0y * q0z + p1y * q1z + p2y * q2z;
+    const double szx = p0z * q0x + p1z * q1x + p2z * q2x, szy = p0z * q0y + p1z * q1y + p2z * q2y, szz = p0z * q0z + p1z * q1z + p2z * q2z;
+
+    // Build Horn's (symmetric, traceless) key matrix N.
+    const double n00 = sxx + syy + szz, n01 = syz - szy, n02 = szx - sxz, n03 = sxy - syx;
+    const double n11 = sxx - syy - szz, n12 = sxy + syx, n13 = szx + sxz;
+    const double n22 = -sxx + syy - szz, n23 = syz + szy;
+    const double n33 = -sxx - syy + szz;
+
+    // Compute the coefficients of the characteristic polynomial of N, i.e. l^4 + c2 * l^2 + c1 * l + c0. Since N is traceless, there is no cubic term.
+    const double c2 = -2.0 * (sxx * sxx + sxy * sxy + sxz * sxz + syx * syx + syy * syy + syz * syz + szx * szx + szy * szy + szz * szz);
+    const double detS = sxx * (syy * szz - syz * szy) - sxy * (syx * szz - syz * szx) + sxz * (syx * szy - syy * szx);
+    const double c1 = -8.0 * detS;
+
+    // The constant coefficient is the determinant of N, which we compute from the 2x2 minors of its top and bottom halves.
+    const double ns0 = n00 * n11 - n01 * n01, ns1 = n00 * n12 - n01 * n02, ns2 = n00 * n13 - n01 * n03;
+    const double ns3 = n01 * n12 - n11 * n02, ns4 = n01 * n13 - n11 * n03, ns5 = n02 * n13 - n12 * n03;
+    const double nc5 = n22 * n33 - n23 * n23, nc4 = n12 * n33 - n13 * n23, nc3 = n12 * n23 - n13 * n22;
+    const double nc2 = n02 * n33 - n03 * n23, nc1 = n02 * n23 - n03 * n22, nc0 = n02 * n13 - n03 * n12;
+    const double c0 = ns0 * nc5 - ns1 * nc4 + ns2 * nc3 + ns3 * nc2 - ns4 * nc1 + ns5 * nc0;
+
+    // Find the largest eigenvalue of N using Newton-Raphson, starting from the upper bound |P| * |Q| (the largest eigenvalue is at most
+    // the sum of the singular values of S, which is at most the sum of the |p_i| * |q_i|). Unlike the looser bound (|P|^2 + |Q|^2) / 2,
+    // this bound is invariant to the relative scale of the two sets of points, so it stays close to the eigenvalue when one triangle is
+    // much smaller than the other. If the polynomial is degenerate (e.g. because all of the points coincide), we give up straight away.
+    const double gp = p0x * p0x + p0y * p0y + p0z * p0z + p1x * p1x + p1y * p1y + p1z * p1z + p2x * p2x + p2y * p2y + p2z * p2z;
+    const double gq = q0x * q0x + q0y * q0y + q0z * q0z + q1x * q1x + q1y * q1y + q1z * q1z + q2x * q2x + q2y * q2y + q2z * q2z;
+    double lambda = sqrt(gp * gq);
+    bool converged = false;
+    for(int j = 0; j < maxNewtonIterations && lambda > 0.0; ++j)
+    {
+      const double lambdaSq = lambda * lambda;
+      const double f = (lambdaSq + c2) * lambdaSq + c1 * lambda + c0;
+      const double df = (4.0 * lambdaSq + 2.0 * c2) * lambda + c1;
+      if(!(df > 0.0)) break;
+
+      const double step = f / df;
+      lambda -= step;
+      if(fabs(step) <= newtonTolerance * lambda)
+      {
+        converged = true;
+        break;
+      }
+    }
+
+    // Compute the adjugate of N - lambda * I. Provided lambda is a simple eigenvalue, this is a multiple of q * q^T, where q is the
+    // corresponding eigenvector, so each of its rows is a multiple of q. We compute the rows from the 2x2 minors of the matrix.
+    const double m00 = n00 - lambda, m11 = n11 - lambda, m22 = n22 - lambda, m33 = n33 - lambda;
+    const double s0 = m00 * m11 - n01 * n01, s1 = m00 * n12 - n01 * n02, s2 = m00 * n13 - n01 * n03;
+    const double s3 = n01 * n12 - m11 * n02, s4 = n01 * n13 - m11 * n03, s5 = n02 * n13 - n12 * n03;
+    const double t5 = m22 * m33 - n23 * n23, t4 = n12 * m33 - n13 * n23, t3 = n12 * n23 - n13 * m22;
+    const double t2 = n02 * m33 - n03 * n23, t1 = n02 * n23 - n03 * m22;
+
+    const double a00 = m11 * t5 - n12 * t4 + n13 * t3, a01 = -n01 * t5 + n02 * t4 - n03 * t3;
+    const double a02 = n13 * s5 - n23 * s4 + m33 * s3, a03 = -n12 * s5 + m22 * s4 - n23 * s3;
+    const double a11 = m00 * t5 - n02 * t2 + n03 * t1, a12 = -n03 * s5 + n23 * s2 - m33 * s1;
+    const double a13 = n02 * s5 - m22 * s2 + n23 * s1, a22 = n03 * s4 - n13 * s2 + m33 * s0;
+    const double a23 = -n02 * s4 + n12 * s2 - n23 * s0, a33 = n02 * s3 - n12 * s1 + m22 * s0;
+
+    // Choose the row with the largest diagonal element (this is the row with the largest norm), and normalise it to get q.
+    const double d0 = fabs(a00), d1 = fabs(a11), d2 = fabs(a22), d3 = fabs(a33);
+    const bool use0 = d0 >= d1 && d0 >= d2 && d0 >= d3;
+    const bool use1 = !use0 && d1 >= d2 && d1 >= d3;
+    const bool use2 = !use0 && !use1 && d2 >= d3;
+    double qw = use0 ? a00 : use1 ? a01 : use2 ? a02 : a03;
+    double qx = use0 ? a01 : use1 ? a11 : use2 ? a12 : a13;
+    double qy = use0 ? a02 : use1 ? a12 : use2 ? a22 : a23;
+    double qz = use0 ? a03 : use1 ? a13 : use2 ? a23 : a33;
+
+    // If the eigenvalue did not converge, or the row is too small relative to the scale of the problem (in which case the eigenvalue
+    // is not simple, or the problem is degenerate), the eigenvector cannot be recovered reliably in this way, so we flag the candidate
+    // for the SVD-based fallback.
+    const double qNormSq = qw * qw + qx * qx + qy * qy + qz * qz;
+    const double scale = lambda * lambda * lambda;
+    const bool fallback = !converged || !(qNormSq > eigenvectorTolerance * eigenvectorTolerance * scale * scale);
+    fallbackFlags[i] = fallback;
+
+    const double invQNorm = fallback ? 0.0 : 1.0 / sqrt(qNormSq);
+    qw *= invQNorm; qx *= invQNorm; qy *= invQNorm; qz *= invQNorm;
+
+    // Convert q to a rotation matrix R, and compute the translation t that maps the centroid of the camera points onto that of the world points.
+    const double r00 = qw * qw + qx * qx - qy * qy - qz * qz, r01 = 2.0 * (qx * qy - qw * qz), r02 = 2.0 * (qx * qz + qw * qy);
+    const double r10 = 2.0 * (qx * qy + qw * qz), r11 = qw * qw - qx * qx + qy * qy - qz * qz, r12 = 2.0 * (qy * qz - qw * qx);
+    const double r20 = 2.0 * (qx * qz - qw * qy), r21 = 2.0 * (qy * qz + qw * qx), r22 = qw * qw - qx * qx - qy * qy + qz * qz;
+
+    poses[0][i] = static_cast<float>(r00);
+    poses[1][i] = static_cast<float>(r01);
+    poses[2][i] = static_cast<float>(r02);
+    poses[3][i] = static_cast<float>(qcx - (r00 * pcx + r01 * pcy + r02 * pcz));
+    poses[4][i] = static_cast<float>(r10);
+    poses[5][i] = static_cast<float>(r11);
+    poses[6][i] = static_cast<float>(r12);
+    poses[7][i] = static_cast<float>(qcy - (r10 * pcx + r11 * pcy + r12 * pcz));
+    poses[8][i] = static_cast<float>(r20);
+    poses[9][i] = static_cast<float>(r21);
+    poses[10][i] = static_cast<float>(r22);
+    poses[11][i] = static_cast<float>(qcz - (r20 * pcx + r21 * pcy + r22 * pcz));
+  }
+}
+
+}
@@ -6,6 +6,10 @@
 #include "ransac/cpu/PreemptiveRansac_CPU.h"
 using namespace tvgutil;
 
+#include <algorithm>
+#include <limits>
+#include <utility>
+
 #include <Eigen/Dense>
 
 #include <orx/base/MemoryBlockFactory.h>
@@ -20,6 +24,9 @@ namespace grove {
 PreemptiveRansac_CPU::PreemptiveRansac_CPU(const SettingsContainer_CPtr& settings, const std::string& settingsNamespace)
 : PreemptiveRansac(settings, settingsNamespace)
 {
+  m_energyChunkSize = settings->get_first_value<uint32_t>(settingsNamespace + "energyChunkSize", 64);                           // The number of inliers to process between early culling checks.
+  m_usePartialSelectionCulling = settings->get_first_value<bool>(settingsNamespace + "usePartialSelectionCulling", false);  // If false, fully sort the candidates after each energy computation.
+
   MemoryBlockFactory& mbf = MemoryBlockFactory::instance();
   m_rngs = mbf.make_block<CPURNG>(m_maxPoseCandidates);
   m_rngSeed = 42;
@@ -50,22 +57,135 @@ uint32_t PreemptiveRansac_CPU::count_valid_depths(const ORFloatImage *depthImage
 
 //#################### PROTECTED MEMBER FUNCTIONS ####################
 
-void PreemptiveRansac_CPU::compute_energies_and_sort()
+void PreemptiveRansac_CPU::complete_bounded_energies(std::vector<PoseCandidate>& poseCandidates) const
+{
+  const int nbPoseCandidates = static_cast<int>(std::min(poseCandidates.size(), m_nbInliersForBoundedEnergies.size()));
+
+  // The inliers are only ever appended to during a P-RANSAC run, and the poses of culled candidates never change, so we can
+  // recompute the exact energy of each candidate that was culled early over the same inliers that were used to cull it.
+#ifdef WITH_OPENMP
+  #pragma omp parallel for schedule(dynamic)
+#endif
+  for(int i = 0; i < nbPoseCandidates; ++i)
+  {
+    const uint32_t nbInliers = m_nbInliersForBoundedEnergies[i];
+    if(nbInliers > 0)
+    {
+      poseCandidates[i].energy = compute_inlier_energy_sum(poseCandidates[i], 0, nbInliers) / static_cast<float>(nbInliers);
+    }
+  }
+}
+
+void PreemptiveRansac_CPU::compute_energies_and_cull(uint32_t keepCount)
 {
+  if(!m_usePartialSelectionCulling)
+  {
+    compute_energies_and_sort();
+    return;
+  }
+
   const int nbPoseCandidates = static_cast<int>(m_poseCandidates->dataSize);
+  const uint32_t nbInliers = static_cast<uint32_t>(m_inlierRasterIndicesBlock->dataSize);
   PoseCandidate *poseCandidates = m_poseCandidates->GetData(MEMORYDEVICE_CPU);
 
-  // Compute the energies for all pose candidates.
+  // The energies currently stored in the candidates (if any) are averages over the first m_nbInliersWithValidEnergies inliers,
+  // so we only need to accumulate the energies over the remaining ones. We start by computing lower bounds on the energies
+  // that can be contributed by the suffixes of the remaining inliers, which we will use to cull candidates early.
+  const uint32_t firstNewInlierIdx = std::min(m_nbInliersWithValidEnergies, nbInliers);
+  compute_inlier_energy_suffix_bounds(firstNewInlierIdx);
+
+  // Step 1: Accumulate the energy of each candidate over the first chunk of new inliers, and use this to bound its total energy from below.
+  const uint32_t firstChunkEndIdx = std::min(firstNewInlierIdx + m_energyChunkSize, nbInliers);
+  std::vector<float> energySums(nbPoseCandidates);
+  std::vector<std::pair<float,int> > candidateOrder(nbPoseCandidates);
+
 #ifdef WITH_OPENMP
   #pragma omp parallel for
 #endif
   for(int i = 0; i < nbPoseCandidates; ++i)
   {
-    compute_pose_energy(poseCandidates[i]);
+    const float reusedEnergySum = firstNewInlierIdx > 0 ? poseCandidates[i].energy * static_cast<float>(firstNewInlierIdx) : 0.0f;
+    energySums[i] = reusedEnergySum + compute_inlier_energy_sum(poseCandidates[i], firstNewInlierIdx, firstChunkEndIdx);
+    candidateOrder[i] = std::make_pair(energySums[i] + m_inlierEnergySuffixBounds[firstChunkEndIdx - firstNewInlierIdx], i);
   }
 
-  // Sort the candidates into non-decreasing order of energy.
-  std::sort(poseCandidates, poseCandidates + nbPoseCandidates);
+  // Step 2: Fully evaluate the keepCount candidates with the lowest bounds. The worst of their energies is an upper bound on
+  //         the energy of the keepCount-th best candidate, so any candidate whose energy exceeds it can safely be culled.
+  const int nbPromisingCandidates = std::min(static_cast<int>(keepCount), nbPoseCandidates);
+  if(nbPromisingCandidates < nbPoseCandidates)
+  {
+    std::nth_element(candidateOrder.begin(), candidateOrder.begin() + nbPromisingCandidates, candidateOrder.end());
+  }
+
+#ifdef WITH_OPENMP
+  #pragma omp parallel for schedule(dynamic)
+#endif
+  for(int i = 0; i < nbPromisingCandidates; ++i)
+  {
+    const int candidateIdx = candidateOrder[i].second;
+    energySums[candidateIdx] += compute_inlier_energy_sum(poseCandidates[candidateIdx], firstChunkEndIdx, nbInliers);
+  }
+
+  float cullingThreshold = -std::numeric_limits<float>::max();
+  for(int i = 0; i < nbPromisingCandidates; ++i)
+  {
+    cullingThreshold = std::max(cullingThreshold, energySums[candidateOrder[i].second]);
+  }
+
+  // Step 3: Evaluate the remaining candidates chunk by chunk, stopping as soon as a candidate's lower bound exceeds the culling
+  //         threshold. The energy of such a candidate is then only a lower bound, but this is enough to show that it is worse
+  //         than the keepCount candidates we fully evaluated, and so will not be kept.
+  std::vector<uint8_t> energyIsBounded(nbPoseCandidates, 0);
+
+#ifdef WITH_OPENMP
+  #pragma omp parallel for schedule(dynamic)
+#endif
+  for(int i = nbPromisingCandidates; i < nbPoseCandidates; ++i)
+  {
+    const int candidateIdx = candidateOrder[i].second;
+    float energySum = energySums[candidateIdx];
+
+    uint32_t inlierIdx = firstChunkEndIdx;
+    while(inlierIdx < nbInliers && energySum + m_inlierEnergySuffixBounds[inlierIdx - firstNewInlierIdx] <= cullingThreshold)
+    {
+      const uint32_t chunkEndIdx = std::min(inlierIdx + m_energyChunkSize, nbInliers);
+      energySum += compute_inlier_energy_sum(poseCandidates[candidateIdx], inlierIdx, chunkEndIdx);
+      inlierIdx = chunkEndIdx;
+    }
+
+    energySums[candidateIdx] = energySum + m_inlierEnergySuffixBounds[inlierIdx - firstNewInlierIdx];
+    energyIsBounded[candidateIdx] = inlierIdx < nbInliers ? 1 : 0;
+  }
+
+  // Step 4: Move the keepCount best candidates to the front, with the best one first, and store their (average) energies.
+  //         We also record which positions now hold candidates whose energies are only lower bounds, so that their exact
+  //         energies can be recomputed if they are later output by get_best_poses.
+  for(int i = 0; i < nbPoseCandidates; ++i)
+  {
+    candidateOrder[i] = std::make_pair(energySums[i], i);
+  }
+
+  if(nbPromisingCandidates < nbPoseCandidates)
+  {
+    std::nth_element(candidateOrder.begin(), candidateOrder.begin() + nbPromisingCandidates, candidateOrder.end());
+  }
+
+  if(nbPromisingCandidates > 0)
+  {
+    std::iter_swap(candidateOrder.begin(), std::min_element(candidateOrder.begin(), candidateOrder.begin() + nbPromisingCandidates));
+  }
+
+  const std::vector<PoseCandidate> unorderedCandidates(poseCandidates, poseCandidates + nbPoseCandidates);
+  for(int i = 0; i < nbPoseCandidates; ++i)
+  {
+    const int candidateIdx = candidateOrder[i].second;
+    poseCandidates[i] = unorderedCandidates[candidateIdx];
+    poseCandidates[i].energy = nbInliers > 0 ? energySums[candidateIdx] / static_cast<float>(nbInliers) : 0.0f;
+    m_nbInliersForBoundedEnergies[i] = energyIsBounded[candidateIdx] ? nbInliers : 0;
+  }
+
+  // The energies of the kept candidates are exact, so they can be reused in the next round (unless their poses change in the meantime).
+  m_nbInliersWithValidEnergies = nbInliers;
 }
 
 void PreemptiveRansac_CPU::generate_pose_candidates()
@@ -73,11 +193,13 @@ void PreemptiveRansac_CPU::generate_pose_candidates()
   const Vector2i imgSize = m_keypointsImage->noDims;
   const Keypoint3DColour *keypoints = m_keypointsImage->GetData(MEMORYDEVICE_CPU);
   PoseCandidate *poseCandidates = m_poseCandidates->GetData(MEMORYDEVICE_CPU);
-  const ScorePrediction *predictions = m_predictionsImage->GetData(MEMORYDEVICE_CPU);
+  const ScoreModeIndices *modeIndices = m_modeIndicesImage->GetData(MEMORYDEVICE_CPU);
+  const ScorePrediction *modePool = m_modePool->GetData(MEMORYDEVICE_CPU);
   CPURNG *rngs = m_rngs->GetData(MEMORYDEVICE_CPU);
 
-  // Reset the number of pose candidates.
+  // Reset the number of pose candidates, and mark all of their energies as exact.
   m_poseCandidates->dataSize = 0;
+  m_nbInliersForBoundedEnergies.assign(m_maxPoseCandidates, 0);
 
   // Generate at most m_maxPoseCandidates new pose candidates.
 #ifdef WITH_OPENMP
@@ -88,7 +210,7 @@ void PreemptiveRansac_CPU::generate_pose_candidates()
     // Try to generate a valid pose candidate.
     PoseCandidate candidate;
     bool valid = generate_pose_candidate(
-      keypoints, predictions, imgSize, rngs[candidateIdx], candidate, m_maxCandidateGenerationIterations, m_useAllModesPerLeafInPoseHypothesisGeneration,
+      keypoints, modeIndices, modePool, imgSize, rngs[candidateIdx], candidate, m_maxCandidateGenerationIterations, m_useAllModesPerLeafInPoseHypothesisGeneration,
       m_checkMinDistanceBetweenSampledModes, m_minSquaredDistanceBetweenSampledModes, m_checkRigidTransformationConstraint, m_maxTranslationErrorForCorrectPose
     );
 
@@ -121,7 +243,8 @@ void PreemptiveRansac_CPU::prepare_inliers_for_optimisation()
   const uint32_t nbInliers = static_cast<uint32_t>(m_inlierRasterIndicesBlock->dataSize);
   const int nbPoseCandidates = static_cast<int>(m_poseCandidates->dataSize);
   const PoseCandidate *poseCandidates = m_poseCandidates->GetData(MEMORYDEVICE_CPU);
-  const ScorePrediction *predictions = m_predictionsImage->GetData(MEMORYDEVICE_CPU);
+  const ScoreModeIndices *modeIndices = m_modeIndicesImage->GetData(MEMORYDEVICE_CPU);
+  const ScorePrediction *modePool = m_modePool->GetData(MEMORYDEVICE_CPU);
 
 #ifdef WITH_OPENMP
   #pragma omp parallel for
@@ -131,7 +254,7 @@ void PreemptiveRansac_CPU::prepare_inliers_for_optimisation()
     for(uint32_t inlierIdx = 0; inlierIdx < nbInliers; ++inlierIdx)
     {
       prepare_inlier_for_optimisation(
-        candidateIdx, inlierIdx, keypoints, predictions, inlierRasterIndices, nbInliers,
+        candidateIdx, inlierIdx, keypoints, modeIndices, modePool, inlierRasterIndices, nbInliers,
         poseCandidates, m_poseOptimisationInlierThreshold, inlierCameraPoints, inlierModes
       );
     }
@@ -149,7 +272,7 @@ void PreemptiveRansac_CPU::sample_inliers(bool useMask)
   int *inlierRasterIndices = m_inlierRasterIndicesBlock->GetData(MEMORYDEVICE_CPU);
   int *inliersMask = m_inliersMaskImage->GetData(MEMORYDEVICE_CPU);
   const Keypoint3DColour *keypoints = m_keypointsImage->GetData(MEMORYDEVICE_CPU);
-  const ScorePrediction *predictions = m_predictionsImage->GetData(MEMORYDEVICE_CPU);
+  const ScoreModeIndices *modeIndices = m_modeIndicesImage->GetData(MEMORYDEVICE_CPU);
   CPURNG *rngs = m_rngs->GetData(MEMORYDEVICE_CPU);
 
 #ifdef WITH_OPENMP
@@ -159,8 +282,8 @@ void PreemptiveRansac_CPU::sample_inliers(bool useMask)
   {
     // Try to sample the raster index of a valid keypoint whose prediction has at least one modal cluster, using the mask if necessary.
     int rasterIdx = -1;
-    if(useMask) rasterIdx = sample_inlier<true>(keypoints, predictions, imgSize, rngs[sampleIdx], inliersMask);
-    else rasterIdx = sample_inlier<false>(keypoints, predictions, imgSize, rngs[sampleIdx]);
+    if(useMask) rasterIdx = sample_inlier<true>(keypoints, modeIndices, imgSize, rngs[sampleIdx], inliersMask);
+    else rasterIdx = sample_inlier<false>(keypoints, modeIndices, imgSize, rngs[sampleIdx]);
 
     // If we succeed, grab a unique index in the output array and store the inlier raster index into the corresponding array element.
     if(rasterIdx >= 0)
@@ -187,14 +310,72 @@ void PreemptiveRansac_CPU::update_candidate_poses()
 
 //#################### PRIVATE MEMBER FUNCTIONS ####################
 
+void PreemptiveRansac_CPU::compute_energies_and_sort()
+{
+  const int nbPoseCandidates = static_cast<int>(m_poseCandidates->dataSize);
+  PoseCandidate *poseCandidates = m_poseCandidates->GetData(MEMORYDEVICE_CPU);
+
+  // Compute the energies for all pose candidates.
+#ifdef WITH_OPENMP
+  #pragma omp parallel for
+#endif
+  for(int i = 0; i < nbPoseCandidates; ++i)
+  {
+    compute_pose_energy(poseCandidates[i]);
+  }
+
+  // Sort the candidates into non-decreasing order of energy.
+  std::sort(poseCandidates, poseCandidates + nbPoseCandidates);
+}
+
+float PreemptiveRansac_CPU::compute_inlier_energy_sum(const PoseCandidate& candidate, uint32_t inlierStartIdx, uint32_t inlierEndIdx) const
+{
+  if(inlierStartIdx >= inlierEndIdx) return 0.0f;
+
+  const int *inlierRasterIndices = m_inlierRasterIndicesBlock->GetData(MEMORYDEVICE_CPU);
+  const Keypoint3DColour *keypointsImage = m_keypointsImage->GetData(MEMORYDEVICE_CPU);
+  const ScoreModeIndices *modeIndicesImage = m_modeIndicesImage->GetData(MEMORYDEVICE_CPU);
+  const ScorePrediction *modePool = m_modePool->GetData(MEMORYDEVICE_CPU);
+
+  return compute_energy_sum_for_inliers(candidate.cameraPose, keypointsImage, modeIndicesImage, modePool, inlierRasterIndices + inlierStartIdx, inlierEndIdx - inlierStartIdx);
+}
+
+void PreemptiveRansac_CPU::compute_inlier_energy_suffix_bounds(uint32_t firstInlierIdx)
+{
+  const int *inlierRasterIndices = m_inlierRasterIndicesBlock->GetData(MEMORYDEVICE_CPU);
+  const uint32_t nbInliers = static_cast<uint32_t>(m_inlierRasterIndicesBlock->dataSize);
+  const ScoreModeIndices *modeIndicesImage = m_modeIndicesImage->GetData(MEMORYDEVICE_CPU);
+  const ScorePrediction *modePool = m_modePool->GetData(MEMORYDEVICE_CPU);
+  const int nbSuffixes = static_cast<int>(nbInliers - firstInlierIdx);
+
+  // Compute a lower bound on the energy contributed by each inlier.
+  m_inlierEnergySuffixBounds.resize(nbSuffixes + 1);
+
+#ifdef WITH_OPENMP
+  #pragma omp parallel for
+#endif
+  for(int i = 0; i < nbSuffixes; ++i)
+  {
+    m_inlierEnergySuffixBounds[i] = compute_energy_lower_bound_for_inlier(inlierRasterIndices[firstInlierIdx + i], modeIndicesImage, modePool);
+  }
+
+  // Accumulate the bounds from the back to obtain the bounds for the suffixes.
+  m_inlierEnergySuffixBounds[nbSuffixes] = 0.0f;
+  for(int i = nbSuffixes - 1; i >= 0; --i)
+  {
+    m_inlierEnergySuffixBounds[i] += m_inlierEnergySuffixBounds[i + 1];
+  }
+}
+
 void PreemptiveRansac_CPU::compute_pose_energy(PoseCandidate& candidate) const
 {
   const int *inlierRasterIndices = m_inlierRasterIndicesBlock->GetData(MEMORYDEVICE_CPU);
   const Keypoint3DColour *keypointsImage = m_keypointsImage->GetData(MEMORYDEVICE_CPU);
   const uint32_t nbInliers = static_cast<uint32_t>(m_inlierRasterIndicesBlock->dataSize);
-  const ScorePrediction *predictionsImage = m_predictionsImage->GetData(MEMORYDEVICE_CPU);
+  const ScoreModeIndices *modeIndicesImage = m_modeIndicesImage->GetData(MEMORYDEVICE_CPU);
+  const ScorePrediction *modePool = m_modePool->GetData(MEMORYDEVICE_CPU);
 
-  const float energySum = compute_energy_sum_for_inliers(candidate.cameraPose, keypointsImage, predictionsImage, inlierRasterIndices, nbInliers);
+  const float energySum = compute_energy_sum_for_inliers(candidate.cameraPose, keypointsImage, modeIndicesImage, modePool, inlierRasterIndices, nbInliers);
   candidate.energy = energySum / static_cast<float>(nbInliers);
 }
 
@@ -38,8 +38,8 @@ namespace grove {
 
 //#################### CUDA KERNELS ####################
 
-__global__ void ck_compute_energies(const Keypoint3DColour *keypoints, const ScorePrediction *predictions, const int *inlierRasterIndices,
-                                    uint32_t nbInliers, PoseCandidate *poseCandidates, int nbCandidates)
+__global__ void ck_compute_energies(const Keypoint3DColour *keypoints, const ScoreModeIndices *modeIndices, const ScorePrediction *modePool,
+                                    const int *inlierRasterIndices, uint32_t nbInliers, PoseCandidate *poseCandidates, int nbCandidates)
 {
   const int tid = threadIdx.x;
   const int threadsPerBlock = blockDim.x;
@@ -59,7 +59,7 @@ __global__ void ck_compute_energies(const Keypoint3DColour *keypoints, const Sco
   // In particular, thread tid in the block computes the sum of the energies for the inliers with array indices
   // tid + k * threadsPerBlock.
   float energySum = compute_energy_sum_for_inlier_subset(
-    currentCandidate.cameraPose, keypoints, predictions, inlierRasterIndices, nbInliers, tid, threadsPerBlock
+    currentCandidate.cameraPose, keypoints, modeIndices, modePool, inlierRasterIndices, nbInliers, tid, threadsPerBlock
   );
 
   // Then, add up the sums computed by the individual threads to compute the overall energy for the candidate.
@@ -85,7 +85,7 @@ __global__ void ck_compute_energies(const Keypoint3DColour *keypoints, const Sco
 }
 
 template <typename RNG>
-__global__ void ck_generate_pose_candidates(const Keypoint3DColour *keypoints, const ScorePrediction *predictions,
+__global__ void ck_generate_pose_candidates(const Keypoint3DColour *keypoints, const ScoreModeIndices *modeIndices, const ScorePrediction *modePool,
                                             const Vector2i imgSize, RNG *rngs, PoseCandidate *poseCandidates, int *nbPoseCandidates,
                                             uint32_t maxCandidateGenerationIterations, uint32_t maxPoseCandidates,
                                             bool useAllModesPerLeafInPoseHypothesisGeneration, bool checkMinDistanceBetweenSampledModes,
@@ -98,7 +98,7 @@ __global__ void ck_generate_pose_candidates(const Keypoint3DColour *keypoints, c
   // Try to generate a valid pose candidate.
   PoseCandidate candidate;
   bool valid = generate_pose_candidate(
-    keypoints, predictions, imgSize, rngs[candidateIdx], candidate, maxCandidateGenerationIterations, useAllModesPerLeafInPoseHypothesisGeneration,
+    keypoints, modeIndices, modePool, imgSize, rngs[candidateIdx], candidate, maxCandidateGenerationIterations, useAllModesPerLeafInPoseHypothesisGeneration,
     checkMinDistanceBetweenSampledModes, minDistanceBetweenSampledModes, checkRigidTransformationConstraint, translationErrorMaxForCorrectPose
   );
 
@@ -110,8 +110,8 @@ __global__ void ck_generate_pose_candidates(const Keypoint3DColour *keypoints, c
   }
 }
 
-__global__ void ck_prepare_inliers_for_optimisation(const Keypoint3DColour *keypoints, const ScorePrediction *predictions, const int *inlierIndices, int nbInliers,
-                                                    const PoseCandidate *poseCandidates, int nbPoseCandidates, float inlierThreshold, Vector4f *inlierCameraPoints,
+__global__ void ck_prepare_inliers_for_optimisation(const Keypoint3DColour *keypoints, const ScoreModeIndices *modeIndices, const ScorePrediction *modePool,
+                                                    const int *inlierIndices, int nbInliers,                                                    const PoseCandidate *poseCandidates, int nbPoseCandidates, float inlierThreshold, Vector4f *inlierCameraPoints,
                                                     Keypoint3DColourCluster *inlierModes)
 {
   const int candidateIdx = blockIdx.y;
@@ -120,7 +120,7 @@ __global__ void ck_prepare_inliers_for_optimisation(const Keypoint3DColour *keyp
   if(candidateIdx < nbPoseCandidates && inlierIdx < nbInliers)
   {
     prepare_inlier_for_optimisation(
-      candidateIdx, inlierIdx, keypoints, predictions, inlierIndices, nbInliers, poseCandidates, inlierThreshold, inlierCameraPoints, inlierModes
+      candidateIdx, inlierIdx, keypoints, modeIndices, modePool, inlierIndices, nbInliers, poseCandidates, inlierThreshold, inlierCameraPoints, inlierModes
     );
   }
 }
@@ -135,14 +135,14 @@ __global__ void ck_reset_candidate_energies(PoseCandidate *poseCandidates, int n
 }
 
 template <bool useMask, typename RNG>
-__global__ void ck_sample_inliers(const Keypoint3DColour *keypoints, const ScorePrediction *predictions, const Vector2i imgSize, RNG *rngs,
+__global__ void ck_sample_inliers(const Keypoint3DColour *keypoints, const ScoreModeIndices *modeIndices, const Vector2i imgSize, RNG *rngs,
                                   int *inlierRasterIndices, int *nbInliers, uint32_t ransacInliersPerIteration, int *inliersMask = NULL)
 {
   const uint32_t sampleIdx = blockIdx.x * blockDim.x + threadIdx.x;
   if(sampleIdx < ransacInliersPerIteration)
   {
     // Try to sample the raster index of a valid keypoint which prediction has at least one modal cluster, using the mask if necessary.
-    const int rasterIdx = sample_inlier<useMask>(keypoints, predictions, imgSize, rngs[sampleIdx], inliersMask);
+    const int rasterIdx = sample_inlier<useMask>(keypoints, modeIndices, imgSize, rngs[sampleIdx], inliersMask);
 
     // If we succeed, grab a unique index in the output array and store the inlier raster index into the corresponding array element.
     if(rasterIdx >= 0)
@@ -187,14 +187,15 @@ uint32_t PreemptiveRansac_CUDA::count_valid_depths(const ORFloatImage *depthImag
 
 //#################### PROTECTED MEMBER FUNCTIONS ####################
 
-void PreemptiveRansac_CUDA::compute_energies_and_sort()
+void PreemptiveRansac_CUDA::compute_energies_and_cull(uint32_t keepCount)
 {
   const int *inlierRasterIndices = m_inlierRasterIndicesBlock->GetData(MEMORYDEVICE_CUDA);
   const Keypoint3DColour *keypoints = m_keypointsImage->GetData(MEMORYDEVICE_CUDA);
   const uint32_t nbInliers = static_cast<uint32_t>(m_inlierRasterIndicesBlock->dataSize); // The number of currently sampled inlier points (used to compute the energy).
   const int nbPoseCandidates = static_cast<int>(m_poseCandidates->dataSize);              // The number of currently "valid" pose candidates.
   PoseCandidate *poseCandidates = m_poseCandidates->GetData(MEMORYDEVICE_CUDA);           // The raster indices of the current sampled inlier points.
-  const ScorePrediction *predictions = m_predictionsImage->GetData(MEMORYDEVICE_CUDA);
+  const ScoreModeIndices *modeIndices = m_modeIndicesImage->GetData(MEMORYDEVICE_CUDA);
+  const ScorePrediction *modePool = m_modePool->GetData(MEMORYDEVICE_CUDA);
 
   // Reset the energies for all pose candidates.
   {
@@ -209,11 +210,12 @@ void PreemptiveRansac_CUDA::compute_energies_and_sort()
     // Launch one block per candidate (in this way, many blocks will exit immediately in the later stages of P-RANSAC).
     dim3 blockSize(128); // Threads to compute the energy for each candidate.
     dim3 gridSize(nbPoseCandidates);
-    ck_compute_energies<<<gridSize,blockSize>>>(keypoints, predictions, inlierRasterIndices, nbInliers, poseCandidates, nbPoseCandidates);
+    ck_compute_energies<<<gridSize,blockSize>>>(keypoints, modeIndices, modePool, inlierRasterIndices, nbInliers, poseCandidates, nbPoseCandidates);
     ORcudaKernelCheck;
   }
 
-  // Sort the candidates into non-decreasing order of energy.
+  // Sort the candidates into non-decreasing order of energy. Note that this moves the keepCount best candidates to the front (as required),
+  // but also sorts the rest of the candidates. Since there are relatively few candidates, this is fast enough on the GPU.
   thrust::device_ptr<PoseCandidate> candidatesStart(poseCandidates);
   thrust::device_ptr<PoseCandidate> candidatesEnd(poseCandidates + nbPoseCandidates);
   thrust::sort(candidatesStart, candidatesEnd);
@@ -224,7 +226,8 @@ void PreemptiveRansac_CUDA::generate_pose_candidates()
   const Vector2i imgSize = m_keypointsImage->noDims;
   const Keypoint3DColour *keypoints = m_keypointsImage->GetData(MEMORYDEVICE_CUDA);
   PoseCandidate *poseCandidates = m_poseCandidates->GetData(MEMORYDEVICE_CUDA);
-  const ScorePrediction *predictions = m_predictionsImage->GetData(MEMORYDEVICE_CUDA);
+  const ScoreModeIndices *modeIndices = m_modeIndicesImage->GetData(MEMORYDEVICE_CUDA);
+  const ScorePrediction *modePool = m_modePool->GetData(MEMORYDEVICE_CUDA);
   CUDARNG *rngs = m_rngs->GetData(MEMORYDEVICE_CUDA);
 
   // Reset the number of pose candidates (we do this on the device only at this stage, and update the corresponding host value once we are done generating).
@@ -236,7 +239,7 @@ void PreemptiveRansac_CUDA::generate_pose_candidates()
   dim3 gridSize((m_maxPoseCandidates + blockSize.x - 1) / blockSize.x);
 
   ck_generate_pose_candidates<<<gridSize,blockSize>>>(
-    keypoints, predictions, imgSize, rngs, poseCandidates, nbPoseCandidates_device, m_maxCandidateGenerationIterations,
+    keypoints, modeIndices, modePool, imgSize, rngs, poseCandidates, nbPoseCandidates_device, m_maxCandidateGenerationIterations,
     m_maxPoseCandidates, m_useAllModesPerLeafInPoseHypothesisGeneration, m_checkMinDistanceBetweenSampledModes,
     m_minSquaredDistanceBetweenSampledModes, m_checkRigidTransformationConstraint, m_maxTranslationErrorForCorrectPose
   );
@@ -262,13 +265,14 @@ void PreemptiveRansac_CUDA::prepare_inliers_for_optimisation()
   const uint32_t nbInliers = static_cast<uint32_t>(m_inlierRasterIndicesBlock->dataSize);
   const int nbPoseCandidates = static_cast<int>(m_poseCandidates->dataSize);
   const PoseCandidate *poseCandidates = m_poseCandidates->GetData(MEMORYDEVICE_CUDA);
-  const ScorePrediction *predictions = m_predictionsImage->GetData(MEMORYDEVICE_CUDA);
+  const ScoreModeIndices *modeIndices = m_modeIndicesImage->GetData(MEMORYDEVICE_CUDA);
+  const ScorePrediction *modePool = m_modePool->GetData(MEMORYDEVICE_CUDA);
 
   dim3 blockSize(256);
   dim3 gridSize((nbInliers + blockSize.x - 1) / blockSize.x, nbPoseCandidates);
 
   ck_prepare_inliers_for_optimisation<<<gridSize, blockSize>>>(
-    keypoints, predictions, inlierRasterIndices, nbInliers, poseCandidates, nbPoseCandidates,
+    keypoints, modeIndices, modePool, inlierRasterIndices, nbInliers, poseCandidates, nbPoseCandidates,
     m_poseOptimisationInlierThreshold, inlierCameraPoints, inlierModes
   );
   ORcudaKernelCheck;
@@ -296,7 +300,7 @@ void PreemptiveRansac_CUDA::sample_inliers(bool useMask)
   int *inliersMask = m_inliersMaskImage->GetData(MEMORYDEVICE_CUDA);
   const Keypoint3DColour *keypoints = m_keypointsImage->GetData(MEMORYDEVICE_CUDA);
   int *nbInliers_device = m_nbInliers_device->GetData(MEMORYDEVICE_CUDA);
-  const ScorePrediction *predictions = m_predictionsImage->GetData(MEMORYDEVICE_CUDA);
+  const ScoreModeIndices *modeIndices = m_modeIndicesImage->GetData(MEMORYDEVICE_CUDA);
   CUDARNG *rngs = m_rngs->GetData(MEMORYDEVICE_CUDA);
 
   dim3 blockSize(128);
@@ -305,14 +309,14 @@ void PreemptiveRansac_CUDA::sample_inliers(bool useMask)
   if(useMask)
   {
     ck_sample_inliers<true><<<gridSize,blockSize>>>(
-      keypoints, predictions, imgSize, rngs, inlierRasterIndices, nbInliers_device, m_ransacInliersPerIteration, inliersMask
+      keypoints, modeIndices, imgSize, rngs, inlierRasterIndices, nbInliers_device, m_ransacInliersPerIteration, inliersMask
     );
     ORcudaKernelCheck;
   }
   else
   {
     ck_sample_inliers<false><<<gridSize,blockSize>>>(
-      keypoints, predictions, imgSize, rngs, inlierRasterIndices, nbInliers_device, m_ransacInliersPerIteration
+      keypoints, modeIndices, imgSize, rngs, inlierRasterIndices, nbInliers_device, m_ransacInliersPerIteration
     );
     ORcudaKernelCheck;
   }
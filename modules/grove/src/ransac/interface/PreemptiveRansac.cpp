@@ -10,6 +10,9 @@ using namespace tvgutil;
 #include <alglib/optimization.h>
 #endif
 
+#include <algorithm>
+#include <cmath>
+
 #include <boost/lexical_cast.hpp>
 #include <boost/timer/timer.hpp>
 
@@ -37,6 +40,7 @@ PreemptiveRansac::PreemptiveRansac(const SettingsContainer_CPtr& settings, const
   m_timerFirstComputeEnergy("First Energy Computation"),
   m_timerFirstTrim("First Trim"),
   m_timerTotal("P-RANSAC Total"),
+  m_nbInliersWithValidEnergies(0),
   m_poseCandidatesAfterCull(0),
   m_settings(settings)
 {
@@ -54,21 +58,35 @@ PreemptiveRansac::PreemptiveRansac(const SettingsContainer_CPtr& settings, const
   m_poseOptimisationGradientThreshold = m_settings->get_first_value<double>(settingsNamespace + "poseOptimisationGradientThreshold", 1e-6);                     // Part of the termination condition for the pose optimisation.
   m_poseOptimisationInlierThreshold = m_settings->get_first_value<float>(settingsNamespace + "poseOptimizationInlierThreshold", 0.2f);                          // In m.
   m_poseOptimisationMaxIterations = m_settings->get_first_value<uint32_t>(settingsNamespace + "poseOptimisationMaxIterations", 100);                            // Maximum number of LM iterations.
+  m_poseOptimisationRobustLossScale = m_settings->get_first_value<float>(settingsNamespace + "poseOptimisationRobustLossScale", 3.0f);                          // In m (L2) or standard deviations (Mahalanobis).
   m_poseOptimisationStepThreshold = m_settings->get_first_value<double>(settingsNamespace + "poseOptimisationStepThreshold", 0.0);                              // Part of the termination condition for the pose optimisation.
   m_poseUpdate = m_settings->get_first_value<bool>(settingsNamespace + "poseUpdate", true);                                                                     // Whether or not to optimise the poses with LM.
+  m_useNativePoseOptimiser = m_settings->get_first_value<std::string>(settingsNamespace + "poseOptimiser", "alglib") == "native";                               // Either "native" or "alglib".
   m_printTimers = m_settings->get_first_value<bool>(settingsNamespace + "printTimers", false);                                                                  // Whether or not to print the timers for each phase.
   m_ransacInliersPerIteration = m_settings->get_first_value<uint32_t>(settingsNamespace + "ransacInliersPerIteration", 500);                                    // The number of inliers sampled in each P-RANSAC iteration.
   m_useAllModesPerLeafInPoseHypothesisGeneration = m_settings->get_first_value<bool>(settingsNamespace + "useAllModesPerLeafInPoseHypothesisGeneration", true); // If false, use the first mode only (representing the largest cluster).
   m_usePredictionCovarianceForPoseOptimization = m_settings->get_first_value<bool>(settingsNamespace + "usePredictionCovarianceForPoseOptimization", true);     // If false, use L2.
 
+  // Determine the robust loss to use during pose optimisation.
+  const std::string robustLoss = m_settings->get_first_value<std::string>(settingsNamespace + "poseOptimisationRobustLoss", "none");
+  if(robustLoss == "none") m_poseOptimisationRobustLoss = RL_NONE;
+  else if(robustLoss == "huber") m_poseOptimisationRobustLoss = RL_HUBER;
+  else if(robustLoss == "cauchy") m_poseOptimisationRobustLoss = RL_CAUCHY;
+  else throw std::runtime_error("Error: Unknown robust loss '" + robustLoss + "'");
+
+  // If requested, set up the solver used to estimate the candidate poses in batches.
+  const bool useBatchKabsch = m_settings->get_first_value<bool>(settingsNamespace + "useBatchKabsch", true);                 // If false, run the SVD-based Kabsch algorithm on each candidate.
+  const float minKabschTriangleArea = m_settings->get_first_value<float>(settingsNamespace + "minKabschTriangleArea", 0.0f); // In m^2 (0 disables the pre-filter; batch solver only).
+  if(useBatchKabsch) m_batchKabschSolver.reset(new BatchKabschSolver(minKabschTriangleArea));
+
   // Each RANSAC iteration after the initial cull adds m_ransacInliersPerIteration inliers to the set, so we allocate enough space for all of them up-front.
   m_nbMaxInliers = m_ransacInliersPerIteration * static_cast<uint32_t>(std::ceil(log2(m_maxPoseCandidatesAfterCull)));
 
-  // We can only update the candidate poses if ALGLIB is available. Check and throw an exception otherwise.
+  // We can only update the candidate poses using ALGLIB if it is available. Check and throw an exception otherwise.
 #ifndef WITH_ALGLIB
-  if(m_poseUpdate)
+  if(m_poseUpdate && !m_useNativePoseOptimiser)
   {
-    throw std::runtime_error("Error: Enabling poseUpdate requires ALGLIB. Reconfigure in CMake with the WITH_ALGLIB option set to ON.");
+    throw std::runtime_error("Error: Enabling poseUpdate with the ALGLIB pose optimiser requires ALGLIB. Reconfigure in CMake with the WITH_ALGLIB option set to ON.");
   }
 #endif
 
@@ -137,7 +155,8 @@ void PreemptiveRansac::update_candidate_poses()
 
 //#################### PUBLIC MEMBER FUNCTIONS ####################
 
-boost::optional<PoseCandidate> PreemptiveRansac::estimate_pose(const Keypoint3DColourImage_CPtr& keypointsImage, const ScorePredictionsImage_CPtr& predictionsImage)
+boost::optional<PoseCandidate> PreemptiveRansac::estimate_pose(const Keypoint3DColourImage_CPtr& keypointsImage, const ScoreModeIndicesImage_CPtr& modeIndicesImage,
+                                                               const ScorePredictionsMemoryBlock_CPtr& modePool)
 {
   /*
   Note: In this function and in the virtual functions of the CPU and CUDA subclasses, we directly access and overwrite
@@ -149,9 +168,10 @@ boost::optional<PoseCandidate> PreemptiveRansac::estimate_pose(const Keypoint3DC
 
   m_timerTotal.start_sync();
 
-  // Copy the keypoints and predictions images into member variables to avoid explicitly passing them to every function.
+  // Copy the keypoints image, mode indices image and mode pool into member variables to avoid explicitly passing them to every function.
   m_keypointsImage = keypointsImage;
-  m_predictionsImage = predictionsImage;
+  m_modeIndicesImage = modeIndicesImage;
+  m_modePool = modePool;
 
   // Step 1: Generate the initial pose candidates.
   {
@@ -186,18 +206,18 @@ boost::optional<PoseCandidate> PreemptiveRansac::estimate_pose(const Keypoint3DC
       sample_inliers(useMask);
     }
 
-    // Step 2(b): Then, evaluate the candidates and sort them in non-increasing order of quality.
+    // Step 2(b): Then, evaluate the candidates and move the best ones to the front.
     {
 #ifdef ENABLE_TIMERS
-      boost::timer::auto_cpu_timer t(6, "compute energies and sort: %ws wall, %us user + %ss system = %ts CPU (%p%)\n");
+      boost::timer::auto_cpu_timer t(6, "compute energies and cull: %ws wall, %us user + %ss system = %ts CPU (%p%)\n");
 #endif
       m_timerFirstComputeEnergy.start_sync();
-      compute_energies_and_sort();
+      compute_energies_and_cull(m_maxPoseCandidatesAfterCull);
       m_timerFirstComputeEnergy.stop_sync();
     }
 
-    // Step 2(c): Finally, trim the number of candidates down to the maximum number allowed. Since we previously sorted
-    //            the candidates by quality, this has the effect of keeping only the best ones.
+    // Step 2(c): Finally, trim the number of candidates down to the maximum number allowed. Since we previously moved
+    //            the best candidates to the front, this has the effect of keeping only the best ones.
     m_poseCandidates->dataSize = m_maxPoseCandidatesAfterCull;
 
     m_timerFirstTrim.stop_nosync(); // No need to synchronize the GPU again.
@@ -246,15 +266,19 @@ boost::optional<PoseCandidate> PreemptiveRansac::estimate_pose(const Keypoint3DC
       m_timerOptimisation[iteration].start_nosync(); // No need to synchronize the GPU again.
       update_candidate_poses();
       m_timerOptimisation[iteration].stop_sync();
+
+      // The candidates' poses have changed, so their existing energies can no longer be reused.
+      m_nbInliersWithValidEnergies = 0;
     }
 
-    // Step 4(c): Compute the energy for each candidate and sort them in non-increasing order of quality.
+    // Step 4(c): Compute the energy for each candidate and move the better half of them to the front.
+    const size_t keepCount = m_poseCandidates->dataSize / 2;
     m_timerComputeEnergy[iteration].start_nosync(); // No need to synchronize the GPU again.
-    compute_energies_and_sort();
+    compute_energies_and_cull(static_cast<uint32_t>(keepCount));
     m_timerComputeEnergy[iteration].stop_sync();
 
     // Step 4(d): Remove the worse half of the candidates.
-    m_poseCandidates->dataSize /= 2;
+    m_poseCandidates->dataSize = keepCount;
 
     ++iteration;
   }
@@ -302,6 +326,9 @@ void PreemptiveRansac::get_best_poses(std::vector<PoseCandidate>& poseCandidates
   {
     poseCandidates.push_back(candidates[poseIdx]);
   }
+
+  // Make sure that the energies of any candidates that were culled using only a lower bound on their energies are exact.
+  complete_bounded_energies(poseCandidates);
 }
 
 uint32_t PreemptiveRansac::get_min_nb_required_points() const
@@ -312,6 +339,11 @@ uint32_t PreemptiveRansac::get_min_nb_required_points() const
 
 //#################### PROTECTED MEMBER FUNCTIONS ####################
 
+void PreemptiveRansac::complete_bounded_energies(std::vector<PoseCandidate>& poseCandidates) const
+{
+  // No-op by default
+}
+
 void PreemptiveRansac::compute_candidate_poses_kabsch()
 {
   // We assume that the data on the CPU is up-to-date (the CUDA subclass must ensure this).
@@ -323,6 +355,14 @@ void PreemptiveRansac::compute_candidate_poses_kabsch()
   std::cout << "Generated " << nbPoseCandidates << " candidates." << std::endl;
 #endif
 
+  // If the batch solver is enabled, use it to estimate the poses of all of the candidates at once, and then
+  // discard any candidates that failed its geometric pre-filter.
+  if(m_batchKabschSolver)
+  {
+    m_poseCandidates->dataSize = m_batchKabschSolver->solve(poseCandidates, nbPoseCandidates);
+    return;
+  }
+
   // For each candidate:
 #ifdef WITH_OPENMP
   #pragma omp parallel for
@@ -354,11 +394,12 @@ void PreemptiveRansac::reset_inliers(bool resetMask)
   }
 
   m_inlierRasterIndicesBlock->dataSize = 0;
+
+  // The energies of the candidates were computed over the old inliers, so they can no longer be reused.
+  m_nbInliersWithValidEnergies = 0;
 }
 
 bool PreemptiveRansac::update_candidate_pose(int candidateIdx) const
-#ifdef WITH_ALGLIB
-try
 {
   // Fill in the struct that will be passed to the optimiser.
   PointsForLM ptsForLM;
@@ -372,6 +413,16 @@ try
   // optimisation using shared code, but for now everything is done on the CPU.
   PoseCandidate& poseCandidate = m_poseCandidates->GetData(MEMORYDEVICE_CPU)[candidateIdx];
 
+  // Optimise the candidate's pose using the chosen optimiser.
+  return m_useNativePoseOptimiser ? update_candidate_pose_native(poseCandidate, ptsForLM) : update_candidate_pose_alglib(poseCandidate, ptsForLM);
+}
+
+//#################### PRIVATE MEMBER FUNCTIONS ####################
+
+bool PreemptiveRansac::update_candidate_pose_alglib(PoseCandidate& poseCandidate, const PointsForLM& pts) const
+#ifdef WITH_ALGLIB
+try
+{
   // Convert the candidate's current pose to a 6D twist vector that can be optimised by alglib.
   alglib::real_1d_array xi = make_twist_from_pose(poseCandidate.cameraPose);
 
@@ -385,14 +436,15 @@ try
 #endif
   alglib::minlmsetcond(state, m_poseOptimisationGradientThreshold, m_poseOptimisationEnergyThreshold, m_poseOptimisationStepThreshold, m_poseOptimisationMaxIterations);
 
-  // Run the optimiser.
+  // Run the optimiser. Note that ALGLIB's callbacks take a non-const pointer to the points, but do not modify them.
+  void *ptsForLM = const_cast<PointsForLM*>(&pts);
   if (m_usePredictionCovarianceForPoseOptimization)
   {
-    alglib::minlmoptimize(state, alglib_func_mahalanobis, alglib_jac_mahalanobis, alglib_rep, &ptsForLM);
+    alglib::minlmoptimize(state, alglib_func_mahalanobis, alglib_jac_mahalanobis, alglib_rep, ptsForLM);
   }
   else
   {
-    alglib::minlmoptimize(state, alglib_func_l2, alglib_jac_l2, alglib_rep, &ptsForLM);
+    alglib::minlmoptimize(state, alglib_func_l2, alglib_jac_l2, alglib_rep, ptsForLM);
   }
 
   // Extract the results of the optimisation.
@@ -410,16 +462,90 @@ try
 }
 catch(const alglib::ap_error& e)
 {
-  std::cout << "ALGLIB failed the optimisation for pose candidate: " << candidateIdx << ". Reason: " << e.msg << "\n";
+  std::cout << "ALGLIB failed the optimisation for a pose candidate. Reason: " << e.msg << "\n";
   return false;
 }
 #else
 {
-  throw std::runtime_error("Error: Cannot update candidate pose. Reconfigure in CMake with the WITH_ALGLIB option set to ON.");
+  throw std::runtime_error("Error: Cannot update candidate pose using ALGLIB. Reconfigure in CMake with the WITH_ALGLIB option set to ON.");
 }
 #endif
 
-//#################### PRIVATE MEMBER FUNCTIONS ####################
+bool PreemptiveRansac::update_candidate_pose_native(PoseCandidate& poseCandidate, const PointsForLM& pts) const
+{
+  typedef Eigen::Matrix<double,6,1> Vector6d;
+  typedef Eigen::Matrix<double,6,6,Eigen::RowMajor> Matrix6d;
+
+  // The bounds on the damping factor. If the damping needed to decrease the energy exceeds the upper bound,
+  // the step sizes have become so small that the candidate's pose can be considered to have converged.
+  const double minLambda = 1e-12, maxLambda = 1e12;
+
+  Eigen::Matrix4f pose = Eigen::Map<const Eigen::Matrix4f>(poseCandidate.cameraPose.m);
+
+  // Compute the initial energy and normal equations.
+  Vector6d gradient;
+  Matrix6d hessian;
+  double energy = compute_energy_robust(poseCandidate.cameraPose, pts, m_usePredictionCovarianceForPoseOptimization, m_poseOptimisationRobustLoss,
+                                        m_poseOptimisationRobustLossScale, gradient.data(), hessian.data());
+
+  double lambda = 1e-3;
+  for(uint32_t iteration = 0; iteration < m_poseOptimisationMaxIterations; ++iteration)
+  {
+    // If the gradient is small enough, the pose has converged.
+    if(gradient.lpNorm<Eigen::Infinity>() <= m_poseOptimisationGradientThreshold) break;
+
+    // Solve the damped normal equations to compute a step. The damping is scaled by the diagonal of the Hessian (as in Marquardt's
+    // original formulation), so that it is unaffected by the different units of the translational and rotational components.
+    Matrix6d dampedHessian = hessian;
+    dampedHessian.diagonal() += lambda * hessian.diagonal().cwiseMax(1e-9);
+    const Vector6d step = dampedHessian.ldlt().solve(-gradient);
+    if(!step.allFinite()) return false;
+
+    // Compute the pose that would result from taking the step, by left-multiplying the current pose by the
+    // rigid transformation corresponding to the step (the translation comes first, then the rotation).
+    Eigen::Matrix4f stepTransform = Eigen::Matrix4f::Identity();
+    const Eigen::Vector3d omega = step.tail<3>();
+    const double angle = omega.norm();
+    if(angle > 0.0) stepTransform.block<3,3>(0,0) = Eigen::AngleAxisd(angle, omega / angle).toRotationMatrix().cast<float>();
+    stepTransform.block<3,1>(0,3) = step.head<3>().cast<float>();
+    const Eigen::Matrix4f newPose = stepTransform * pose;
+
+    // Compute the energy and normal equations for the new pose.
+    Matrix4f newCameraPose;
+    Eigen::Map<Eigen::Matrix4f>(newCameraPose.m) = newPose;
+
+    Vector6d newGradient;
+    Matrix6d newHessian;
+    const double newEnergy = compute_energy_robust(newCameraPose, pts, m_usePredictionCovarianceForPoseOptimization, m_poseOptimisationRobustLoss,
+                                                   m_poseOptimisationRobustLossScale, newGradient.data(), newHessian.data());
+
+    if(newEnergy < energy)
+    {
+      // The step decreased the energy, so accept it and reduce the damping.
+      const double energyDecrease = energy - newEnergy;
+      pose = newPose;
+      energy = newEnergy;
+      gradient = newGradient;
+      hessian = newHessian;
+      lambda = std::max(lambda / 10.0, minLambda);
+
+      // Check the remaining termination conditions (these match the ones used by ALGLIB).
+      if(energyDecrease <= m_poseOptimisationEnergyThreshold * std::max(energy + energyDecrease, 1.0)) break;
+      if(step.norm() <= m_poseOptimisationStepThreshold) break;
+    }
+    else
+    {
+      // The step did not decrease the energy, so reject it and increase the damping.
+      lambda *= 10.0;
+      if(lambda > maxLambda) break;
+    }
+  }
+
+  if(!pose.allFinite()) return false;
+
+  Eigen::Map<Eigen::Matrix4f>(poseCandidate.cameraPose.m) = pose;
+  return true;
+}
 
 void PreemptiveRansac::update_host_pose_candidates() const
 {
@@ -581,6 +707,112 @@ double PreemptiveRansac::compute_energy_mahalanobis(const ORUtils::SE3Pose& cand
   return res;
 }
 
+double PreemptiveRansac::compute_energy_robust(const Matrix4f& candidateCameraPose, const PointsForLM& pts, bool useMahalanobis, RobustLoss robustLoss,
+                                               float robustLossScale, double *gradient, double *hessian)
+{
+  double res = 0.0;
+  const double scaleSq = static_cast<double>(robustLossScale) * robustLossScale;
+
+  // If we're computing the normal equations, initially reset them to zero.
+  if(gradient) std::fill_n(gradient, 6, 0.0);
+  if(hessian) std::fill_n(hessian, 36, 0.0);
+
+  // For each point under consideration:
+  for(uint32_t i = 0; i < pts.nbPoints; ++i)
+  {
+    // If the point's position in camera space is invalid, skip it.
+    if(pts.cameraPoints[i].w == 0.0f) continue;
+
+    // Compute the difference between the point's position in world space (i) as predicted by the camera
+    // pose and its position in camera space, and (ii) as predicted by the position of the chosen mode.
+    const Vector3f transformedPt = candidateCameraPose * pts.cameraPoints[i].toVector3();
+    const Vector3f diff = transformedPt - pts.predictedModes[i].position;
+
+    // Compute the squared (L2 or Mahalanobis) distance between the point and its mode.
+    Matrix3f weightMatrix;
+    if(useMahalanobis) weightMatrix = pts.predictedModes[i].positionInvCovariance;
+    else weightMatrix.setIdentity();
+
+    const Vector3f weightedDiff = weightMatrix * diff;
+    const double sqDist = dot(diff, weightedDiff);
+
+    // Apply the robust loss to the squared distance to get the error term, and compute the weight that the
+    // point should have in the reweighted problem (the derivative of the loss with respect to the squared distance).
+    double err = sqDist, weight = 1.0;
+    switch(robustLoss)
+    {
+      case RL_CAUCHY:
+      {
+        err = scaleSq * log1p(sqDist / scaleSq);
+        weight = 1.0 / (1.0 + sqDist / scaleSq);
+        break;
+      }
+      case RL_HUBER:
+      {
+        const double dist = sqrt(sqDist);
+        if(dist > robustLossScale)
+        {
+          err = 2.0 * robustLossScale * dist - scaleSq;
+          weight = robustLossScale / dist;
+        }
+        break;
+      }
+      case RL_NONE:
+      default:
+        break;
+    }
+
+    res += err;
+
+    // If we're computing the normal equations, add the point's contribution to them. The Jacobian of the transformed point with
+    // respect to a left-multiplied pose update is [I | -[p]_x], where p is the transformed point (see also compute_energy_l2).
+    if(gradient || hessian)
+    {
+      const Vector3f poseGradient[6] = {
+        Vector3f(1.0f, 0.0f, 0.0f),
+        Vector3f(0.0f, 1.0f, 0.0f),
+        Vector3f(0.0f, 0.0f, 1.0f),
+        -Vector3f(0.0f, transformedPt.z, -transformedPt.y),
+        -Vector3f(-transformedPt.z, 0.0f, transformedPt.x),
+        -Vector3f(transformedPt.y, -transformedPt.x, 0.0f),
+      };
+
+      Vector3f weightedPoseGradient[6];
+      for(int j = 0; j < 6; ++j)
+      {
+        weightedPoseGradient[j] = weightMatrix * poseGradient[j];
+      }
+
+      for(int j = 0; j < 6; ++j)
+      {
+        if(gradient) gradient[j] += weight * dot(poseGradient[j], weightedDiff);
+
+        if(hessian)
+        {
+          for(int k = j; k < 6; ++k)
+          {
+            hessian[j * 6 + k] += weight * dot(poseGradient[j], weightedPoseGradient[k]);
+          }
+        }
+      }
+    }
+  }
+
+  // Fill in the lower triangle of the Hessian, which is symmetric.
+  if(hessian)
+  {
+    for(int j = 1; j < 6; ++j)
+    {
+      for(int k = 0; k < j; ++k)
+      {
+        hessian[j * 6 + k] = hessian[k * 6 + j];
+      }
+    }
+  }
+
+  return res;
+}
+
 #ifdef WITH_ALGLIB
 ORUtils::SE3Pose PreemptiveRansac::make_pose_from_twist(const alglib::real_1d_array& xi)
 {
@@ -44,8 +44,13 @@ void ScoreRelocaliserState::load_from_disk(const std::string& inputFolder)
   // Load the rest of the data.
   const std::string dataFile = (inputPath / "scoreState.txt").string();
   std::ifstream inFile(dataFile.c_str());
-  inFile >> lastExamplesAddedStartIdx >> reservoirUpdateStartIdx;
+  inFile >> reservoirUpdateStartIdx;
   if(!inFile) throw std::runtime_error("Error: Couldn't load relocaliser data from " + dataFile);
+
+  // Older versions of the file stored the index of the first reservoir that was last clustered during training before the
+  // index we actually want. If there is a second number in the file, it is the one we want.
+  uint32_t nextIdx;
+  if(inFile >> nextIdx) reservoirUpdateStartIdx = nextIdx;
 }
 
 void ScoreRelocaliserState::reset()
@@ -63,8 +68,8 @@ void ScoreRelocaliserState::reset()
   }
 
   exampleReservoirs->reset();
-  lastExamplesAddedStartIdx = 0;
   predictionsBlock->Clear();
+  reservoirBatchSkipCounts.clear();
   reservoirUpdateStartIdx = 0;
 }
 
@@ -84,7 +89,7 @@ void ScoreRelocaliserState::save_to_disk(const std::string& outputFolder) const
   // Save the rest of the data.
   const std::string dataFile = (outputPath / "scoreState.txt").string();
   std::ofstream outFile(dataFile.c_str());
-  outFile << lastExamplesAddedStartIdx << ' ' << reservoirUpdateStartIdx;
+  outFile << reservoirUpdateStartIdx;
   if(!outFile) throw std::runtime_error("Error: Couldn't save relocaliser data in " + dataFile);
 }
 
@@ -7,27 +7,63 @@
 using namespace ORUtils;
 using namespace tvgutil;
 
+#include "features/cpu/RGBDPatchFeatureCalculator_CPU.h"
+#include "forests/cpu/DecisionForest_CPU.h"
 #include "relocalisation/shared/ScoreForestRelocaliser_Shared.h"
 
 namespace grove {
 
+//#################### TYPEDEFS ####################
+
+typedef RGBDPatchFeatureCalculator_CPU<Keypoint3DColour,RGBDPatchDescriptor> FeatureCalculator_CPU;
+typedef DecisionForest_CPU<RGBDPatchDescriptor,ScoreForestRelocaliser::FOREST_TREE_COUNT> ScoreForest_CPU;
+
 //#################### CONSTRUCTORS ####################
 
 ScoreForestRelocaliser_CPU::ScoreForestRelocaliser_CPU(const SettingsContainer_CPtr& settings, const std::string& settingsNamespace)
 : ScoreForestRelocaliser(settings, settingsNamespace, DEVICE_CPU)
-{}
+{
+  m_useLazyFeatureEvaluation = m_settings->get_first_value<bool>(settingsNamespace + "useLazyFeatureEvaluation", true);
+}
 
 //#################### PROTECTED MEMBER FUNCTIONS ####################
 
-void ScoreForestRelocaliser_CPU::merge_predictions_for_keypoints(const LeafIndicesImage_CPtr& leafIndices, ScorePredictionsImage_Ptr& outputPredictions) const
+void ScoreForestRelocaliser_CPU::compute_keypoints_and_predictions(const ORUChar4Image *colourImage, const ORFloatImage *depthImage, const Vector4f& depthIntrinsics) const
+{
+  // Note: The feature calculator and forest will always be CPU-based here, but we check just in case.
+  const FeatureCalculator_CPU *featureCalculator = dynamic_cast<const FeatureCalculator_CPU*>(m_featureCalculator.get());
+  const ScoreForest_CPU *scoreForest = dynamic_cast<const ScoreForest_CPU*>(m_scoreForest.get());
+
+  // If we're not using lazy feature evaluation, compute the full descriptors and find the leaves in the normal way.
+  if(!m_useLazyFeatureEvaluation || !featureCalculator || !scoreForest)
+  {
+    ScoreForestRelocaliser::compute_keypoints_and_predictions(colourImage, depthImage, depthIntrinsics);
+    return;
+  }
+
+  // Otherwise, extract keypoints from the RGB-D image (in camera coordinates), but don't compute descriptors for them.
+  Matrix4f identity;
+  identity.setIdentity();
+  featureCalculator->compute_keypoints(colourImage, depthImage, identity, depthIntrinsics, m_keypointsImage.get());
+
+  // Find the leaves associated with the keypoints, evaluating only those features of their descriptors that the forest needs.
+  const FeatureCalculator_CPU::FeatureEvaluator featureEvaluator(*featureCalculator, colourImage, depthImage, m_keypointsImage.get());
+  scoreForest->find_leaves_lazily(featureEvaluator, m_keypointsImage->noDims, m_leafIndicesImage);
+
+  // Merge the SCoRe predictions (sets of clusters) associated with each keypoint to create a single set of clusters per keypoint.
+  merge_predictions_for_keypoints(m_leafIndicesImage, m_modeIndicesImage);
+  m_modePool = m_relocaliserState->predictionsBlock;
+}
+
+void ScoreForestRelocaliser_CPU::merge_predictions_for_keypoints(const LeafIndicesImage_CPtr& leafIndices, ScoreModeIndicesImage_Ptr& outputModeIndices) const
 {
   const Vector2i imgSize = leafIndices->noDims;
 
-  // Make sure that the output predictions image has the right size (this is a no-op after the first time).
-  outputPredictions->ChangeDims(imgSize);
+  // Make sure that the output mode indices image has the right size (this is a no-op after the first time).
+  outputModeIndices->ChangeDims(imgSize);
 
   const LeafIndices *leafIndicesPtr = leafIndices->GetData(MEMORYDEVICE_CPU);
-  ScorePrediction *outputPredictionsPtr = outputPredictions->GetData(MEMORYDEVICE_CPU);
+  ScoreModeIndices *outputModeIndicesPtr = outputModeIndices->GetData(MEMORYDEVICE_CPU);
   const ScorePrediction *predictionsBlockPtr = m_relocaliserState->predictionsBlock->GetData(MEMORYDEVICE_CPU);
 
 #ifdef WITH_OPENMP
@@ -37,7 +73,7 @@ void ScoreForestRelocaliser_CPU::merge_predictions_for_keypoints(const LeafIndic
   {
     for(int x = 0; x < imgSize.x; ++x)
     {
-      merge_predictions_for_keypoint(x, y, leafIndicesPtr, predictionsBlockPtr, imgSize, m_maxClusterCount, outputPredictionsPtr);
+      merge_predictions_for_keypoint(x, y, leafIndicesPtr, predictionsBlockPtr, imgSize, m_maxClusterCount, outputModeIndicesPtr);
     }
   }
 }
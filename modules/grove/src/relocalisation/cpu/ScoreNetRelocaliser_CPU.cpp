@@ -19,15 +19,15 @@ ScoreNetRelocaliser_CPU::ScoreNetRelocaliser_CPU(const SettingsContainer_CPtr& s
 
 //#################### PROTECTED MEMBER FUNCTIONS ####################
 
-void ScoreNetRelocaliser_CPU::set_bucket_predictions_for_keypoints(const BucketIndicesImage_CPtr& bucketIndices, ScorePredictionsImage_Ptr& outputPredictions) const
+void ScoreNetRelocaliser_CPU::set_bucket_predictions_for_keypoints(const BucketIndicesImage_CPtr& bucketIndices, ScoreModeIndicesImage_Ptr& outputModeIndices) const
 {
   const Vector2i imgSize = bucketIndices->noDims;
 
-  // Make sure that the output predictions image has the right size (this is a no-op after the first time).
-  outputPredictions->ChangeDims(imgSize);
+  // Make sure that the output mode indices image has the right size (this is a no-op after the first time).
+  outputModeIndices->ChangeDims(imgSize);
 
   const BucketIndices *bucketIndicesPtr = bucketIndices->GetData(MEMORYDEVICE_CPU);
-  ScorePrediction *outputPredictionsPtr = outputPredictions->GetData(MEMORYDEVICE_CPU);
+  ScoreModeIndices *outputModeIndicesPtr = outputModeIndices->GetData(MEMORYDEVICE_CPU);
   const ScorePrediction *predictionsBlockPtr = m_relocaliserState->predictionsBlock->GetData(MEMORYDEVICE_CPU);
 
 #ifdef WITH_OPENMP
@@ -37,22 +37,24 @@ void ScoreNetRelocaliser_CPU::set_bucket_predictions_for_keypoints(const BucketI
   {
     for(int x = 0; x < imgSize.x; ++x)
     {
-      set_bucket_prediction_for_keypoint(x, y, imgSize, bucketIndicesPtr, predictionsBlockPtr, outputPredictionsPtr);
+      set_bucket_prediction_for_keypoint(x, y, imgSize, bucketIndicesPtr, predictionsBlockPtr, outputModeIndicesPtr);
     }
   }
 }
 
 void ScoreNetRelocaliser_CPU::set_net_predictions_for_keypoints(const Keypoint3DColourImage_CPtr& keypointsImage, const ScoreNetOutput_CPtr& scoreNetOutput,
-                                                                ScorePredictionsImage_Ptr& outputPredictions) const
+                                                                ScorePredictionsImage_Ptr& outputPredictions, ScoreModeIndicesImage_Ptr& outputModeIndices) const
 {
   const Vector2i imgSize = keypointsImage->noDims;
 
-  // Make sure that the output predictions image has the right size (this is a no-op after the first time).
+  // Make sure that the output images have the right size (this is a no-op after the first time).
   outputPredictions->ChangeDims(imgSize);
+  outputModeIndices->ChangeDims(imgSize);
 
   const Keypoint3DColour *keypointsPtr = keypointsImage->GetData(MEMORYDEVICE_CPU);
   const float *scoreNetOutputPtr = scoreNetOutput->GetData(MEMORYDEVICE_CPU);
   ScorePrediction *outputPredictionsPtr = outputPredictions->GetData(MEMORYDEVICE_CPU);
+  ScoreModeIndices *outputModeIndicesPtr = outputModeIndices->GetData(MEMORYDEVICE_CPU);
 
 #ifdef WITH_OPENMP
   #pragma omp parallel for
@@ -61,7 +63,7 @@ void ScoreNetRelocaliser_CPU::set_net_predictions_for_keypoints(const Keypoint3D
   {
     for(int x = 0; x < imgSize.x; ++x)
     {
-      set_net_prediction_for_keypoint(x, y, imgSize, keypointsPtr, scoreNetOutputPtr, outputPredictionsPtr);
+      set_net_prediction_for_keypoint(x, y, imgSize, keypointsPtr, scoreNetOutputPtr, outputPredictionsPtr, outputModeIndicesPtr);
     }
   }
 }
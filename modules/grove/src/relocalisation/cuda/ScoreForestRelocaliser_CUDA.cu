@@ -15,14 +15,14 @@ namespace grove {
 
 template <int TREE_COUNT>
 __global__ void ck_merge_predictions_for_keypoints(const ORUtils::VectorX<int,TREE_COUNT> *leafIndices, const ScorePrediction *predictionsBlock,
-                                                   Vector2i imgSize, int maxClusterCount, ScorePrediction *outputPredictions)
+                                                   Vector2i imgSize, int maxClusterCount, ScoreModeIndices *outputModeIndices)
 {
   const int x = blockIdx.x * blockDim.x + threadIdx.x;
   const int y = blockIdx.y * blockDim.y + threadIdx.y;
 
   if(x < imgSize.x && y < imgSize.y)
   {
-    merge_predictions_for_keypoint(x, y, leafIndices, predictionsBlock, imgSize, maxClusterCount, outputPredictions);
+    merge_predictions_for_keypoint(x, y, leafIndices, predictionsBlock, imgSize, maxClusterCount, outputModeIndices);
   }
 }
 
@@ -34,22 +34,22 @@ ScoreForestRelocaliser_CUDA::ScoreForestRelocaliser_CUDA(const SettingsContainer
 
 //#################### PROTECTED MEMBER FUNCTIONS ####################
 
-void ScoreForestRelocaliser_CUDA::merge_predictions_for_keypoints(const LeafIndicesImage_CPtr& leafIndices, ScorePredictionsImage_Ptr& outputPredictions) const
+void ScoreForestRelocaliser_CUDA::merge_predictions_for_keypoints(const LeafIndicesImage_CPtr& leafIndices, ScoreModeIndicesImage_Ptr& outputModeIndices) const
 {
   const Vector2i imgSize = leafIndices->noDims;
 
-  // Make sure that the output predictions image has the right size (this is a no-op after the first time).
-  outputPredictions->ChangeDims(imgSize);
+  // Make sure that the output mode indices image has the right size (this is a no-op after the first time).
+  outputModeIndices->ChangeDims(imgSize);
 
   const LeafIndices *leafIndicesPtr = leafIndices->GetData(MEMORYDEVICE_CUDA);
-  ScorePrediction *outputPredictionsPtr = outputPredictions->GetData(MEMORYDEVICE_CUDA);
+  ScoreModeIndices *outputModeIndicesPtr = outputModeIndices->GetData(MEMORYDEVICE_CUDA);
   const ScorePrediction *predictionsBlockPtr = m_relocaliserState->predictionsBlock->GetData(MEMORYDEVICE_CUDA);
 
   const dim3 blockSize(32, 32);
   const dim3 gridSize((imgSize.x + blockSize.x - 1) / blockSize.x, (imgSize.y + blockSize.y - 1) / blockSize.y);
 
   ck_merge_predictions_for_keypoints<<<gridSize, blockSize>>>(
-    leafIndicesPtr, predictionsBlockPtr, imgSize, m_maxClusterCount, outputPredictionsPtr
+    leafIndicesPtr, predictionsBlockPtr, imgSize, m_maxClusterCount, outputModeIndicesPtr
   );
   ORcudaKernelCheck;
 }
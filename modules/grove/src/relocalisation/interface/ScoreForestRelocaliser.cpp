@@ -114,8 +114,10 @@ void ScoreForestRelocaliser::make_predictions(const ORUChar4Image *colourImage)
   // Find all of the leaves in the forest that are associated with the descriptors for the keypoints.
   m_scoreForest->find_leaves(m_descriptorsImage, m_leafIndicesImage);
 
-  // Merge the SCoRe predictions (sets of clusters) associated with each keypoint to create a single SCoRe prediction per keypoint.
-  merge_predictions_for_keypoints(m_leafIndicesImage, m_predictionsImage);
+  // Merge the SCoRe predictions (sets of clusters) associated with each keypoint to create a single set of clusters per keypoint.
+  // The clusters are referred to by their indices in the predictions block, which thus serves as the mode pool.
+  merge_predictions_for_keypoints(m_leafIndicesImage, m_modeIndicesImage);
+  m_modePool = m_relocaliserState->predictionsBlock;
 }
 
 void ScoreForestRelocaliser::train_sub(const ORUChar4Image *colourImage, const ORFloatImage *depthImage,
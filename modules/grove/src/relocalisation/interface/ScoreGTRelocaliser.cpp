@@ -26,11 +26,13 @@ ScoreGTRelocaliser::ScoreGTRelocaliser(const tvgutil::SettingsContainer_CPtr& se
 void ScoreGTRelocaliser::make_predictions(const ORUChar4Image *colourImage) const
 {
   // If a ground truth pose is available for this frame, create a "ground truth" SCoRe prediction
-  // that has only one cluster (containing a single world-space point) for each keypoint.
+  // that has only one cluster (containing a single world-space point) for each keypoint. These
+  // predictions then serve as the mode pool for the keypoints.
   if(m_groundTruthTrajectory && m_groundTruthFrameIndex < m_groundTruthTrajectory->size())
   {
     const Matrix4f& cameraToWorld = (*m_groundTruthTrajectory)[m_groundTruthFrameIndex].GetInvM();
-    set_ground_truth_predictions_for_keypoints(m_keypointsImage, cameraToWorld, m_predictionsImage);
+    set_ground_truth_predictions_for_keypoints(m_keypointsImage, cameraToWorld, m_groundTruthPredictionsImage, m_modeIndicesImage);
+    m_modePool = m_groundTruthPredictionsImage;
   }
   else throw std::runtime_error("Error: Ground truth pose not available for frame " + boost::lexical_cast<std::string>(m_groundTruthFrameIndex));
 }
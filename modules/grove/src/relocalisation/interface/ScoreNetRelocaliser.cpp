@@ -6,12 +6,17 @@
 #include "relocalisation/interface/ScoreNetRelocaliser.h"
 using namespace ORUtils;
 
+#include <algorithm>
+#include <limits>
+
 #include <orx/base/MemoryBlockFactory.h>
 using namespace orx;
 
 #include <tvgutil/filesystem/PathFinder.h>
 using namespace tvgutil;
 
+#include "relocalisation/shared/ScoreNetRelocaliser_Shared.h"
+
 #define DEBUGGING 0
 
 namespace grove {
@@ -31,9 +36,16 @@ ScoreNetRelocaliser::ScoreNetRelocaliser(const tvgutil::SettingsContainer_CPtr&
   m_reservoirCount = m_settings->get_first_value<unsigned int>(settingsNamespace + "reservoirCount", 40000);
   m_sceneSizeCm = m_settings->get_first_value<int>(settingsNamespace + "sceneSizeCm", 10000);
 
+  // Allocate the bucket remapper. The number of slots must be a power of two that is at least twice the number of reservoirs.
+  size_t bucketRemapperSlotCount = 1;
+  while(bucketRemapperSlotCount < 2 * static_cast<size_t>(m_reservoirCount)) bucketRemapperSlotCount *= 2;
+  m_bucketRemapperBuckets.resize(bucketRemapperSlotCount);
+  m_bucketRemapperReservoirs.resize(bucketRemapperSlotCount);
+
   // Allocate the internal images.
   MemoryBlockFactory& mbf = MemoryBlockFactory::instance();
   m_bucketIndicesImage = mbf.make_image<BucketIndices>();
+  m_netPredictionsImage = mbf.make_image<ScorePrediction>();
 
   // Load the SCoRe network from disk.
   const std::string modelFilename = m_settings->get_first_value<std::string>(settingsNamespace + "modelFilename", (find_subdir_from_executable("resources") / "DefaultScoreNet.pt").string());
@@ -55,8 +67,14 @@ ScoreNetRelocaliser::ScoreNetRelocaliser(const tvgutil::SettingsContainer_CPtr&
 void ScoreNetRelocaliser::reset()
 {
   ScoreRelocaliser::reset();
-  m_bucketRemapper.clear();
+
   m_rng.reset(new RandomNumberGenerator(m_rngSeed));
+
+  // Clear the bucket remapper.
+  m_bucketRemapperBucketCount = 0;
+  std::fill(m_bucketRemapperBuckets.begin(), m_bucketRemapperBuckets.end(), static_cast<int>(EMPTY_BUCKET_SLOT));
+  std::fill(m_bucketRemapperReservoirs.begin(), m_bucketRemapperReservoirs.end(), -1);
+  m_bucketRemapperReuseSeed = static_cast<uint32_t>(m_rng->generate_int_from_uniform(0, std::numeric_limits<int>::max()));
 }
 
 //#################### PROTECTED MEMBER FUNCTIONS ####################
@@ -68,16 +86,19 @@ void ScoreNetRelocaliser::make_predictions(const ORUChar4Image *colourImage) con
     // Find the buckets (example reservoirs) corresponding to the keypoints.
     find_reservoirs(colourImage, false);
 
-    // Copy the clusters for each keypoint across to the SCoRe predictions image.
-    set_bucket_predictions_for_keypoints(m_bucketIndicesImage, m_predictionsImage);
+    // Record the indices of the clusters for each keypoint in the mode indices image (the clusters themselves stay in the predictions block).
+    set_bucket_predictions_for_keypoints(m_bucketIndicesImage, m_modeIndicesImage);
+    m_modePool = m_relocaliserState->predictionsBlock;
   }
   else
   {
     // Run the network on the colour image to predict a world space point for each keypoint.
     run_net(colourImage);
 
-    // For each keypoint, copy its corresponding world space point into a single cluster for the keypoint in the SCoRe predictions image.
-    set_net_predictions_for_keypoints(m_keypointsImage, m_scoreNetOutput, m_predictionsImage);
+    // For each keypoint, copy its corresponding world space point into a single cluster for the keypoint in the net predictions image,
+    // which then serves as the mode pool.
+    set_net_predictions_for_keypoints(m_keypointsImage, m_scoreNetOutput, m_netPredictionsImage, m_modeIndicesImage);
+    m_modePool = m_netPredictionsImage;
   }
 }
 
@@ -139,42 +160,13 @@ void ScoreNetRelocaliser::find_reservoirs(const ORUChar4Image *colourImage, bool
       const int bucketZ = static_cast<int>(CLAMP(ROUND(pos.z * 100 / m_bucketSizeCm + halfSceneSizeBuckets), 0, sceneSizeBuckets - 1));
       const int bucketIndex = bucketZ * sceneSizeBuckets * sceneSizeBuckets + bucketY * sceneSizeBuckets + bucketX;
 
-      // Remap the bucket index to one of the example reservoirs. Start by looking to see whether there is already
-      // a mapping from the bucket index to a reservoir. If not, and there are reservoirs spare, allocate the first
-      // available one. If there aren't any reservoirs spare, pick one to reuse.
-      int remappedBucketIndex = 0;
-
-    #ifdef WITH_OPENMP
-      #pragma omp critical
-    #endif
-      {
-        std::map<int,int>::const_iterator it = m_bucketRemapper.find(bucketIndex);
-
-        if(it != m_bucketRemapper.end())
-        {
-          remappedBucketIndex = it->second;
-        }
-        else if(allowAllocation)
-        {
-          if(m_bucketRemapper.size() < m_reservoirCount)
-          {
-            // Use the next available reservoir.
-            remappedBucketIndex = static_cast<int>(m_bucketRemapper.size());
-          }
-          else if(m_reuseRandomWhenFull)
-          {
-            // Pick the reservoir to reuse randomly.
-            remappedBucketIndex = m_rng->generate_int_from_uniform(0, static_cast<int>(m_reservoirCount - 1));
-          }
-          else
-          {
-            // Pick the reservoir to reuse deterministically.
-            remappedBucketIndex = static_cast<int>(m_bucketRemapper.size() % m_reservoirCount);
-          }
-
-          m_bucketRemapper.insert(std::make_pair(bucketIndex, remappedBucketIndex));
-        }
-      }
+      // Remap the bucket index to one of the example reservoirs. If there is not already a mapping from the bucket index to a reservoir,
+      // and allocation is allowed, allocate the first available reservoir, or pick one to reuse if there aren't any reservoirs spare.
+      // Note that the bucket remapper is a lock-free hash table, so this can safely be done by many threads at once.
+      const int remappedBucketIndex = remap_bucket_index(
+        bucketIndex, &m_bucketRemapperBuckets[0], &m_bucketRemapperReservoirs[0], static_cast<uint32_t>(m_bucketRemapperBuckets.size()),
+        &m_bucketRemapperBucketCount, m_reservoirCount, allowAllocation, m_reuseRandomWhenFull, m_bucketRemapperReuseSeed
+      );
 
       // Store the remapped bucket index in the bucket indices image.
       bucketIndices[pixelOffset][0] = remappedBucketIndex;
@@ -185,7 +177,7 @@ void ScoreNetRelocaliser::find_reservoirs(const ORUChar4Image *colourImage, bool
   m_bucketIndicesImage->UpdateDeviceFromHost();
 
 #if DEBUGGING
-  std::cout << "Buckets Used: " << m_bucketRemapper.size() << std::endl;
+  std::cout << "Buckets Used: " << m_bucketRemapperBucketCount << std::endl;
 #endif
 }
 
@@ -39,16 +39,25 @@ ScoreRelocaliser::ScoreRelocaliser(const SettingsContainer_CPtr& settings, const
   m_maxRelocalisationsToOutput = m_settings->get_first_value<uint32_t>(settingsNamespace + "maxRelocalisationsToOutput", 1);
 
   // Determine the reservoir-related parameters.
-  m_maxReservoirsToUpdate = m_settings->get_first_value<uint32_t>(settingsNamespace + "maxReservoirsToUpdate", 256);  // Update the modes associated with this number of reservoirs for each train/update call.
+  m_maxIncrementalInsertions = m_settings->get_first_value<uint32_t>(settingsNamespace + "maxIncrementalInsertions", deviceType == ORUtils::DEVICE_CPU ? 8 : 0);
+  m_maxReservoirBatchSkips = m_settings->get_first_value<uint32_t>(settingsNamespace + "maxReservoirBatchSkips", 16);  // Update a changed batch of reservoirs after it has been passed over this many times.
+  m_maxReservoirsToUpdate = m_settings->get_first_value<uint32_t>(settingsNamespace + "maxReservoirsToUpdate", 256);  // Update the modes associated with at most this number of reservoirs for each train/update call.
   m_reservoirCapacity = m_settings->get_first_value<uint32_t>(settingsNamespace + "reservoirCapacity", 1024);
   m_rngSeed = m_settings->get_first_value<uint32_t>(settingsNamespace + "rngSeed", 42);
 
   // Determine the clustering-related parameters (the defaults are tentative values that seem to work).
   m_clustererSigma = m_settings->get_first_value<float>(settingsNamespace + "clustererSigma", 0.1f);
   m_clustererTau = m_settings->get_first_value<float>(settingsNamespace + "clustererTau", 0.05f);
+  m_clustererUseGrid = m_settings->get_first_value<bool>(settingsNamespace + "clustererUseGrid", false);
   m_maxClusterCount = m_settings->get_first_value<uint32_t>(settingsNamespace + "maxClusterCount", ScorePrediction::Capacity);
   m_minClusterSize = m_settings->get_first_value<uint32_t>(settingsNamespace + "minClusterSize", 20);
 
+  // Check that the batches of reservoirs to update are non-empty.
+  if(m_maxReservoirsToUpdate == 0)
+  {
+    throw std::invalid_argument(settingsNamespace + "maxReservoirsToUpdate == 0");
+  }
+
   // Check that the maximum number of clusters to store in each leaf is within range.
   if(m_maxClusterCount > ScorePrediction::Capacity)
   {
@@ -58,9 +67,10 @@ ScoreRelocaliser::ScoreRelocaliser(const SettingsContainer_CPtr& settings, const
   // Allocate the internal images.
   MemoryBlockFactory& mbf = MemoryBlockFactory::instance();
   m_descriptorsImage = mbf.make_image<DescriptorType>();
+  m_groundTruthModeIndicesImage = mbf.make_image<ScoreModeIndices>();
   m_groundTruthPredictionsImage = mbf.make_image<ScorePrediction>();
   m_keypointsImage = mbf.make_image<ExampleType>();
-  m_predictionsImage = mbf.make_image<ScorePrediction>();
+  m_modeIndicesImage = mbf.make_image<ScoreModeIndices>();
 
   // Instantiate the sub-components.
   m_featureCalculator = FeatureCalculatorFactory::make_da_rgbd_patch_feature_calculator(deviceType);
@@ -85,7 +95,6 @@ void ScoreRelocaliser::finish_training()
 
   // Then kill the contents of the reservoirs (we won't need them any more).
   m_relocaliserState->exampleReservoirs.reset();
-  m_relocaliserState->lastExamplesAddedStartIdx = 0;
   m_relocaliserState->reservoirUpdateStartIdx = 0;
 
   // Finally, release the example clusterer.
@@ -102,9 +111,14 @@ Keypoint3DColourImage_CPtr ScoreRelocaliser::get_keypoints_image() const
   return m_keypointsImage;
 }
 
-ScorePredictionsImage_CPtr ScoreRelocaliser::get_predictions_image() const
+ScoreModeIndicesImage_CPtr ScoreRelocaliser::get_mode_indices_image() const
+{
+  return m_modeIndicesImage;
+}
+
+ScorePredictionsMemoryBlock_CPtr ScoreRelocaliser::get_mode_pool() const
 {
-  return m_predictionsImage;
+  return m_modePool;
 }
 
 ORUChar4Image_CPtr ScoreRelocaliser::get_visualisation_image(const std::string& key) const
@@ -132,15 +146,11 @@ std::vector<Relocaliser::Result> ScoreRelocaliser::relocalise(const ORUChar4Imag
   // Iff we have enough valid depth values, try to estimate the camera pose:
   if(m_preemptiveRansac->count_valid_depths(depthImage) > m_preemptiveRansac->get_min_nb_required_points())
   {
-    // Step 1: Extract keypoints from the RGB-D image and compute descriptors for them.
-    // FIXME: We only need to compute the descriptors if we're using the forest.
-    m_featureCalculator->compute_keypoints_and_features(colourImage, depthImage, depthIntrinsics, m_keypointsImage.get(), m_descriptorsImage.get());
-
-    // Step 2: Create a single SCoRe prediction (a single set of clusters) for each keypoint.
-    make_predictions(colourImage);
+    // Steps 1 and 2: Extract keypoints from the RGB-D image, and create a single SCoRe prediction (a single set of clusters) for each keypoint.
+    compute_keypoints_and_predictions(colourImage, depthImage, depthIntrinsics);
 
     // Step 3: Perform P-RANSAC to try to estimate the camera pose.
-    boost::optional<PoseCandidate> poseCandidate = m_preemptiveRansac->estimate_pose(m_keypointsImage, m_predictionsImage);
+    boost::optional<PoseCandidate> poseCandidate = m_preemptiveRansac->estimate_pose(m_keypointsImage, m_modeIndicesImage, m_modePool);
 
     // Step 4: If we succeeded in estimating a camera pose:
     if(poseCandidate)
@@ -199,7 +209,7 @@ void ScoreRelocaliser::reset()
   if(!m_exampleClusterer)
   {
     m_exampleClusterer = ExampleClustererFactory<ExampleType,ClusterType,PredictionType::Capacity>::make_clusterer(
-      m_clustererSigma, m_clustererTau, m_maxClusterCount, m_minClusterSize, m_deviceType
+      m_clustererSigma, m_clustererTau, m_maxClusterCount, m_minClusterSize, m_deviceType, m_clustererUseGrid
     );
   }
 
@@ -262,22 +272,8 @@ void ScoreRelocaliser::train(const ORUChar4Image *colourImage, const ORFloatImag
   // Call the hook function (a function that should be overridden by derived classes to perform the actual training).
   train_sub(colourImage, depthImage, depthIntrinsics, cameraPose);
 
-  // If there are any reservoirs:
-  if(m_reservoirCount > 0)
-  {
-    // Cluster some of the reservoirs.
-    const uint32_t nbReservoirsToUpdate = compute_nb_reservoirs_to_update();
-    m_exampleClusterer->cluster_examples(
-      m_relocaliserState->exampleReservoirs->get_reservoirs(), m_relocaliserState->exampleReservoirs->get_reservoir_sizes(),
-      m_relocaliserState->reservoirUpdateStartIdx, nbReservoirsToUpdate, m_relocaliserState->predictionsBlock
-    );
-
-    // Store the index of the first reservoir that was just updated so that we can tell when there are no more clusters to update.
-    m_relocaliserState->lastExamplesAddedStartIdx = m_relocaliserState->reservoirUpdateStartIdx;
-
-    // Update the index of the first reservoir to subject to clustering during the next train/update call.
-    update_reservoir_start_idx();
-  }
+  // Bring the clusters of the reservoirs that have been most affected by the new examples up to date.
+  update_stalest_reservoirs();
 }
 
 void ScoreRelocaliser::update()
@@ -292,20 +288,9 @@ void ScoreRelocaliser::update()
     throw std::runtime_error("Error: finish_training() has been called; the relocaliser cannot be updated again until reset() is called");
   }
 
-  // If we are back to the first reservoir that was updated when the last batch of examples were added to the
-  // reservoirs, there is no need to perform further updates, since we would get the same clusters. Note that
-  // this check only works if m_maxReservoirsToUpdate remains constant throughout the whole program.
-  if(m_relocaliserState->reservoirUpdateStartIdx == m_relocaliserState->lastExamplesAddedStartIdx) return;
-
-  // Otherwise, cluster the next batch of reservoirs, and update the index of the first reservoir to subject to
-  // clustering during the next train/update call.
-  const uint32_t updateCount = compute_nb_reservoirs_to_update();
-  m_exampleClusterer->cluster_examples(
-    m_relocaliserState->exampleReservoirs->get_reservoirs(), m_relocaliserState->exampleReservoirs->get_reservoir_sizes(),
-    m_relocaliserState->reservoirUpdateStartIdx, updateCount, m_relocaliserState->predictionsBlock
-  );
-
-  update_reservoir_start_idx();
+  // Bring the clusters of the stalest batch of reservoirs up to date (this is a no-op if none of the reservoirs have changed
+  // since they were last clustered, since re-clustering them would just produce the same clusters).
+  update_stalest_reservoirs();
 }
 
 void ScoreRelocaliser::update_all_clusters()
@@ -315,52 +300,64 @@ void ScoreRelocaliser::update_all_clusters()
 
   boost::lock_guard<boost::recursive_mutex> lock(m_mutex);
 
-  // Repeatedly call update until we get back to the batch of reservoirs that was updated last time train() was called.
-  while(m_relocaliserState->reservoirUpdateStartIdx != m_relocaliserState->lastExamplesAddedStartIdx)
-  {
-    update();
-  }
+  // If the reservoirs have already been released by finish_training, there is nothing to update.
+  if(!m_relocaliserState->exampleReservoirs) return;
+
+  // Repeatedly update the stalest batch of reservoirs until all of the reservoirs are up to date.
+  while(update_stalest_reservoirs()) {}
 }
 
 //#################### PROTECTED MEMBER FUNCTIONS ####################
 
+void ScoreRelocaliser::compute_keypoints_and_predictions(const ORUChar4Image *colourImage, const ORFloatImage *depthImage, const Vector4f& depthIntrinsics) const
+{
+  // Extract keypoints from the RGB-D image and compute descriptors for them.
+  // FIXME: We only need to compute the descriptors if we're using the forest.
+  m_featureCalculator->compute_keypoints_and_features(colourImage, depthImage, depthIntrinsics, m_keypointsImage.get(), m_descriptorsImage.get());
+
+  // Create a single SCoRe prediction (a single set of clusters) for each keypoint.
+  make_predictions(colourImage);
+}
+
 void ScoreRelocaliser::make_visualisation_images(const ORFloatImage *depthImage, const std::vector<Result>& results) const
 {
   if(m_groundTruthTrajectory && m_groundTruthFrameIndex < m_groundTruthTrajectory->size())
   {
     // Update the normal pixel to points image, using the ground truth world to camera transformation.
     const Matrix4f& worldToCamera = (*m_groundTruthTrajectory)[m_groundTruthFrameIndex].GetM();
-    update_pixels_to_points_image(worldToCamera, m_predictionsImage, m_pixelsToPointsImage);
+    update_pixels_to_points_image(worldToCamera, m_modeIndicesImage, m_modePool, m_pixelsToPointsImage);
 
     // If requested, also update the ground truth pixel to points image.
     if(m_settings->get_first_value<bool>(m_settingsNamespace + "makeGroundTruthPointsImage", false))
     {
       const Matrix4f& cameraToWorld = (*m_groundTruthTrajectory)[m_groundTruthFrameIndex].GetInvM();
-      set_ground_truth_predictions_for_keypoints(m_keypointsImage, cameraToWorld, m_groundTruthPredictionsImage);
-      update_pixels_to_points_image(worldToCamera, m_groundTruthPredictionsImage, m_groundTruthPixelsToPointsImage);
+      set_ground_truth_predictions_for_keypoints(m_keypointsImage, cameraToWorld, m_groundTruthPredictionsImage, m_groundTruthModeIndicesImage);
+      update_pixels_to_points_image(worldToCamera, m_groundTruthModeIndicesImage, m_groundTruthPredictionsImage, m_groundTruthPixelsToPointsImage);
     }
   }
   else if(!results.empty())
   {
     // Update the normal pixel to points image, using the "best" relocalised pose as the world to camera transformation.
     // Note: We use this pose as a default, even though it may later be either refined by ICP or discarded in favour of a different pose.
-    update_pixels_to_points_image(results[0].pose, m_predictionsImage, m_pixelsToPointsImage);
+    update_pixels_to_points_image(results[0].pose, m_modeIndicesImage, m_modePool, m_pixelsToPointsImage);
   }
 }
 
 void ScoreRelocaliser::set_ground_truth_predictions_for_keypoints(const Keypoint3DColourImage_CPtr& keypointsImage, const Matrix4f& cameraToWorld,
-                                                                  ScorePredictionsImage_Ptr& outputPredictions) const
+                                                                  ScorePredictionsImage_Ptr& outputPredictions, ScoreModeIndicesImage_Ptr& outputModeIndices) const
 {
   const Vector2i imgSize = keypointsImage->noDims;
 
-  // Make sure that the output predictions image has the right size (this is a no-op after the first time).
+  // Make sure that the output images have the right size (this is a no-op after the first time).
   outputPredictions->ChangeDims(imgSize);
+  outputModeIndices->ChangeDims(imgSize);
 
   // If necessary, copy the keypoints image across to the CPU.
   if(m_deviceType == DEVICE_CUDA) keypointsImage->UpdateHostFromDevice();
 
   const Keypoint3DColour *keypointsPtr = keypointsImage->GetData(MEMORYDEVICE_CPU);
   ScorePrediction *outputPredictionsPtr = outputPredictions->GetData(MEMORYDEVICE_CPU);
+  ScoreModeIndices *outputModeIndicesPtr = outputModeIndices->GetData(MEMORYDEVICE_CPU);
 
 #ifdef WITH_OPENMP
   #pragma omp parallel for
@@ -369,28 +366,60 @@ void ScoreRelocaliser::set_ground_truth_predictions_for_keypoints(const Keypoint
   {
     for(int x = 0; x < imgSize.x; ++x)
     {
-      set_ground_truth_prediction_for_keypoint(x, y, imgSize, keypointsPtr, cameraToWorld, outputPredictionsPtr);
+      set_ground_truth_prediction_for_keypoint(x, y, imgSize, keypointsPtr, cameraToWorld, outputPredictionsPtr, outputModeIndicesPtr);
     }
   }
 
-  // If necessary, copy the output predictions back across to the GPU.
-  if(m_deviceType == DEVICE_CUDA) outputPredictions->UpdateDeviceFromHost();
+  // If necessary, copy the output images back across to the GPU.
+  if(m_deviceType == DEVICE_CUDA)
+  {
+    outputPredictions->UpdateDeviceFromHost();
+    outputModeIndices->UpdateDeviceFromHost();
+  }
 }
 
 //#################### PRIVATE MEMBER FUNCTIONS ####################
 
-uint32_t ScoreRelocaliser::compute_nb_reservoirs_to_update() const
+bool ScoreRelocaliser::update_clusters_incrementally(uint32_t batchStart, uint32_t batchSize)
 {
-  // Either the standard number of reservoirs to update, or the number remaining before the end of the memory block.
-  return std::min(m_maxReservoirsToUpdate, m_reservoirCount - m_relocaliserState->reservoirUpdateStartIdx);
+  // The maximum squared Mahalanobis distance there can be between a new example and its closest cluster (this is the 99% quantile
+  // of the chi-squared distribution with 3 degrees of freedom, i.e. 99% of the examples drawn from a cluster should be within it).
+  const float maxMahalanobisSq = 11.34f;
+
+  const Reservoirs_Ptr& exampleReservoirs = m_relocaliserState->exampleReservoirs;
+  const uint32_t reservoirCapacity = exampleReservoirs->get_reservoir_capacity();
+  const unsigned char *dirtyFlags = exampleReservoirs->get_reservoir_dirty_flags()->GetData(MEMORYDEVICE_CPU);
+  const int *insertionCounts = exampleReservoirs->get_reservoir_insertion_counts()->GetData(MEMORYDEVICE_CPU);
+  const int *reservoirSizes = exampleReservoirs->get_reservoir_sizes()->GetData(MEMORYDEVICE_CPU);
+  const ExampleType *reservoirs = exampleReservoirs->get_reservoirs()->GetData(MEMORYDEVICE_CPU);
+  PredictionType *predictions = m_relocaliserState->predictionsBlock->GetData(MEMORYDEVICE_CPU);
+
+  for(uint32_t reservoirIdx = batchStart, batchEnd = batchStart + batchSize; reservoirIdx < batchEnd; ++reservoirIdx)
+  {
+    // If nothing has been written into the reservoir since it was last clustered, its clusters are already up to date.
+    const int insertionCount = insertionCounts[reservoirIdx];
+    if(insertionCount == 0) continue;
+
+    // If any of the reservoir's existing examples have been replaced, or too many examples have been added to it, give up.
+    if(dirtyFlags[reservoirIdx] || insertionCount > static_cast<int>(m_maxIncrementalInsertions)) return false;
+
+    // Otherwise, the new examples are the last ones in the reservoir, so try to add them to the reservoir's existing clusters.
+    const ExampleType *newExamples = reservoirs + reservoirIdx * reservoirCapacity + reservoirSizes[reservoirIdx] - insertionCount;
+    if(!update_prediction_incrementally(newExamples, insertionCount, maxMahalanobisSq, predictions[reservoirIdx])) return false;
+  }
+
+  return true;
 }
 
-void ScoreRelocaliser::update_pixels_to_points_image(const ORUtils::SE3Pose& worldToCamera, const ScorePredictionsImage_Ptr& predictionsImage,
-                                                     ORUChar4Image_Ptr& pixelsToPointsImage) const
+void ScoreRelocaliser::update_pixels_to_points_image(const ORUtils::SE3Pose& worldToCamera, const ScoreModeIndicesImage_CPtr& modeIndicesImage,
+                                                     const ScorePredictionsMemoryBlock_CPtr& modePool, ORUChar4Image_Ptr& pixelsToPointsImage) const
 {
-  // Ensure that the keypoints and SCoRe predictions are available on the CPU.
+  // Ensure that the keypoints, mode indices and mode pool are available on the CPU. Note that copying the whole of the mode pool
+  // can be expensive when it is the relocaliser's block of predictions, but this is only done when debugging.
   m_keypointsImage->UpdateHostFromDevice();
-  predictionsImage->UpdateHostFromDevice();
+  modeIndicesImage->UpdateHostFromDevice();
+  modePool->UpdateHostFromDevice();
+  const ScorePrediction *modePoolPtr = modePool->GetData(MEMORYDEVICE_CPU);
 
   // If the pixels to points image hasn't been allocated yet, allocate it now.
   if(!pixelsToPointsImage) pixelsToPointsImage.reset(new ORUChar4Image(m_keypointsImage->noDims, true, true));
@@ -405,10 +434,10 @@ void ScoreRelocaliser::update_pixels_to_points_image(const ORUtils::SE3Pose& wor
     // If the pixel has a valid keypoint, look up the position of the cluster (if any) in the corresponding prediction that is closest to it.
     const ExampleType& keypoint = m_keypointsImage->GetData(MEMORYDEVICE_CPU)[i];
     if(!keypoint.valid) continue;
-    const PredictionType& prediction = predictionsImage->GetData(MEMORYDEVICE_CPU)[i];
-    const int closestModeIdx = find_closest_mode(worldToCamera.GetInvM() * keypoint.position, prediction);
+    const ScoreModeIndices& modeIndices = modeIndicesImage->GetData(MEMORYDEVICE_CPU)[i];
+    const int closestModeIdx = find_closest_mode(worldToCamera.GetInvM() * keypoint.position, modeIndices, modePoolPtr);
     if(closestModeIdx == -1) continue;
-    const Vector3f& clusterPos = prediction.elts[closestModeIdx].position;
+    const Vector3f& clusterPos = get_pooled_mode(modePoolPtr, modeIndices.elts[closestModeIdx]).position;
 
     // Colour the pixel in the pixels to points image based on the cluster's position in world space.
     float scale = 2.0f;
@@ -427,15 +456,89 @@ void ScoreRelocaliser::update_pixels_to_points_image(const ORUtils::SE3Pose& wor
   pixelsToPointsImage->UpdateDeviceFromHost();
 }
 
-void ScoreRelocaliser::update_reservoir_start_idx()
+bool ScoreRelocaliser::update_stalest_reservoirs()
 {
-  m_relocaliserState->reservoirUpdateStartIdx += m_maxReservoirsToUpdate;
+  // If there are no reservoirs, early out.
+  if(m_reservoirCount == 0) return false;
 
-  // If we go past the end of the list of reservoirs, loop back round.
-  if(m_relocaliserState->reservoirUpdateStartIdx >= m_reservoirCount)
+  const Reservoirs_Ptr& exampleReservoirs = m_relocaliserState->exampleReservoirs;
+
+  // Make sure that the insertion counts of the reservoirs are available on the CPU.
+  ORIntMemoryBlock_CPtr insertionCounts = exampleReservoirs->get_reservoir_insertion_counts();
+  insertionCounts->UpdateHostFromDevice();
+  const int *insertionCountsPtr = insertionCounts->GetData(MEMORYDEVICE_CPU);
+
+  // Find the batch of reservoirs into which the most examples have been written since they were last clustered, and the changed
+  // batch (if any) that has been passed over most often and is now overdue for an update. We consider the batches in round-robin
+  // order, starting from the one after the batch we updated last time, so that ties are broken in favour of the batches that have
+  // been waiting longest.
+  const uint32_t batchCount = (m_reservoirCount + m_maxReservoirsToUpdate - 1) / m_maxReservoirsToUpdate;
+  const uint32_t firstBatchIdx = (m_relocaliserState->reservoirUpdateStartIdx / m_maxReservoirsToUpdate) % batchCount;
+
+  std::vector<uint32_t>& batchSkipCounts = m_relocaliserState->reservoirBatchSkipCounts;
+  if(batchSkipCounts.size() != batchCount) batchSkipCounts.assign(batchCount, 0);
+
+  std::vector<uint64_t> batchInsertionCounts(batchCount, 0);
+  uint32_t stalestBatchIdx = 0;
+  uint64_t stalestBatchInsertionCount = 0;
+  boost::optional<uint32_t> overdueBatchIdx;
+
+  for(uint32_t i = 0; i < batchCount; ++i)
+  {
+    const uint32_t batchIdx = (firstBatchIdx + i) % batchCount;
+    const uint32_t batchStart = batchIdx * m_maxReservoirsToUpdate;
+    const uint32_t batchEnd = std::min(batchStart + m_maxReservoirsToUpdate, m_reservoirCount);
+
+    uint64_t& batchInsertionCount = batchInsertionCounts[batchIdx];
+    for(uint32_t reservoirIdx = batchStart; reservoirIdx < batchEnd; ++reservoirIdx)
+    {
+      batchInsertionCount += insertionCountsPtr[reservoirIdx];
+    }
+
+    if(batchInsertionCount == 0) continue;
+
+    if(batchInsertionCount > stalestBatchInsertionCount)
+    {
+      stalestBatchIdx = batchIdx;
+      stalestBatchInsertionCount = batchInsertionCount;
+    }
+
+    if(batchSkipCounts[batchIdx] >= m_maxReservoirBatchSkips && (!overdueBatchIdx || batchSkipCounts[batchIdx] > batchSkipCounts[*overdueBatchIdx]))
+    {
+      overdueBatchIdx = batchIdx;
+    }
+  }
+
+  // If none of the reservoirs have changed since they were last clustered, there is nothing to do.
+  if(stalestBatchInsertionCount == 0) return false;
+
+  // Update the overdue batch if there is one, and the stalest batch otherwise. Every other changed batch has now been passed over once more.
+  const uint32_t chosenBatchIdx = overdueBatchIdx ? *overdueBatchIdx : stalestBatchIdx;
+  for(uint32_t batchIdx = 0; batchIdx < batchCount; ++batchIdx)
+  {
+    if(batchIdx == chosenBatchIdx) batchSkipCounts[batchIdx] = 0;
+    else if(batchInsertionCounts[batchIdx] > 0) ++batchSkipCounts[batchIdx];
+  }
+
+  const uint32_t batchStart = chosenBatchIdx * m_maxReservoirsToUpdate;
+  const uint32_t batchSize = std::min(m_maxReservoirsToUpdate, m_reservoirCount - batchStart);
+
+  // If possible, update the existing clusters of the batch's reservoirs incrementally; if not, re-cluster them from scratch.
+  const bool updatedIncrementally = m_maxIncrementalInsertions > 0 && m_deviceType == DEVICE_CPU && update_clusters_incrementally(batchStart, batchSize);
+  if(!updatedIncrementally)
   {
-    m_relocaliserState->reservoirUpdateStartIdx = 0;
+    m_exampleClusterer->cluster_examples(
+      exampleReservoirs->get_reservoirs(), exampleReservoirs->get_reservoir_sizes(), batchStart, batchSize, m_relocaliserState->predictionsBlock
+    );
   }
+
+  // Record that the batch's reservoirs are now up to date.
+  exampleReservoirs->mark_reservoirs_clustered(batchStart, batchSize);
+
+  // Start looking for the next batch to update from the batch after this one (looping back round if necessary).
+  m_relocaliserState->reservoirUpdateStartIdx = batchStart + batchSize < m_reservoirCount ? batchStart + batchSize : 0;
+
+  return true;
 }
 
 }
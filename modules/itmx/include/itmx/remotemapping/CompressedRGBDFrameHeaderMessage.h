@@ -16,6 +16,9 @@ namespace itmx {
 
 /**
  * \brief An instance of this class represents a message containing the sizes (in bytes) and dimensions of the compressed images for a single RGB-D frame.
+ *
+ * Each compressed image is divided into a number of tiles (horizontal bands of rows) that are compressed independently,
+ * so that they can be compressed and uncompressed in parallel. The header specifies the number of tiles in each image.
  */
 class CompressedRGBDFrameHeaderMessage : public MappingMessage
 {
@@ -27,12 +30,18 @@ private:
   /** The byte segment within the message data that corresponds to the dimensions of the compressed depth image. */
   Segment m_depthImageSizeSegment;
 
+  /** The byte segment within the message data that corresponds to the number of tiles in the compressed depth image. */
+  Segment m_depthTileCountSegment;
+
   /** The byte segment within the message data that corresponds to the size in bytes of the compressed RGB image. */
   Segment m_rgbImageByteSizeSegment;
 
   /** The byte segment within the message data that corresponds to the dimensions of the compressed RGB image. */
   Segment m_rgbImageSizeSegment;
 
+  /** The byte segment within the message data that corresponds to the number of tiles in the compressed RGB image. */
+  Segment m_rgbTileCountSegment;
+
   //#################### CONSTRUCTORS ####################
 public:
   /**
@@ -56,6 +65,13 @@ public:
    */
   Vector2i extract_depth_image_size() const;
 
+  /**
+   * \brief Extracts the number of tiles in the compressed depth image from the message.
+   *
+   * \return The number of tiles in the compressed depth image.
+   */
+  uint32_t extract_depth_tile_count() const;
+
   /**
    * \brief Extracts the size (in bytes) of the compressed RGB image from the message.
    *
@@ -70,6 +86,13 @@ public:
    */
   Vector2i extract_rgb_image_size() const;
 
+  /**
+   * \brief Extracts the number of tiles in the compressed RGB image from the message.
+   *
+   * \return The number of tiles in the compressed RGB image.
+   */
+  uint32_t extract_rgb_tile_count() const;
+
   /**
    * \brief Sets the size (in bytes) of the compressed depth image.
    *
@@ -84,6 +107,13 @@ public:
    */
   void set_depth_image_size(const Vector2i& depthImageSize);
 
+  /**
+   * \brief Sets the number of tiles in the compressed depth image.
+   *
+   * \param depthTileCount  The number of tiles in the compressed depth image.
+   */
+  void set_depth_tile_count(uint32_t depthTileCount);
+
   /**
    * \brief Sets the size (in bytes) of the compressed RGB image.
    *
@@ -97,6 +127,13 @@ public:
    * \param rgbImageSize  The dimensions of the compressed RGB image.
    */
   void set_rgb_image_size(const Vector2i& rgbImageSize);
+
+  /**
+   * \brief Sets the number of tiles in the compressed RGB image.
+   *
+   * \param rgbTileCount  The number of tiles in the compressed RGB image.
+   */
+  void set_rgb_tile_count(uint32_t rgbTileCount);
 };
 
 }
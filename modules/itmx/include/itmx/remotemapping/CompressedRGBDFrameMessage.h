@@ -16,6 +16,20 @@ namespace itmx {
  */
 class CompressedRGBDFrameMessage : public BaseRGBDFrameMessage
 {
+  //#################### PRIVATE VARIABLES ####################
+private:
+  /** The dimensions of the compressed depth image (as specified by the header message). */
+  Vector2i m_depthImageSize;
+
+  /** The number of tiles in the compressed depth image (as specified by the header message). */
+  uint32_t m_depthTileCount;
+
+  /** The dimensions of the compressed RGB image (as specified by the header message). */
+  Vector2i m_rgbImageSize;
+
+  /** The number of tiles in the compressed RGB image (as specified by the header message). */
+  uint32_t m_rgbTileCount;
+
   //#################### CONSTRUCTORS ####################
 public:
   /**
@@ -27,6 +41,24 @@ public:
 
   //#################### PUBLIC MEMBER FUNCTIONS ####################
 public:
+  /**
+   * \brief Makes the depth segment of the message refer to the specified compressed depth image data, rather than copying the data into the message.
+   *
+   * \note   The data must remain alive and unchanged until the message has been sent (or set_compressed_image_sizes is called).
+   *
+   * \param depthImageData  The compressed depth image data.
+   */
+  void borrow_depth_image_data(const std::vector<uint8_t>& depthImageData);
+
+  /**
+   * \brief Makes the RGB segment of the message refer to the specified compressed RGB image data, rather than copying the data into the message.
+   *
+   * \note   The data must remain alive and unchanged until the message has been sent (or set_compressed_image_sizes is called).
+   *
+   * \param rgbImageData  The compressed RGB image data.
+   */
+  void borrow_rgb_image_data(const std::vector<uint8_t>& rgbImageData);
+
   /**
    * \brief Extracts the compressed depth image data from the message and writes it into the specified destination vector.
    *
@@ -42,7 +74,64 @@ public:
   void extract_rgb_image_data(std::vector<uint8_t>& rgbImageData) const;
 
   /**
-   * \brief Sets the segment sizes for the depth and RGB images according to the compressed message header. Resizes the raw data storage accordingly.
+   * \brief Gets a pointer to the compressed depth image data in the message (this avoids the need to copy the data out of the message).
+   *
+   * \return  A pointer to the compressed depth image data in the message.
+   */
+  const uint8_t *get_depth_image_data_ptr() const;
+
+  /**
+   * \brief Gets the size (in bytes) of the compressed depth image data in the message.
+   *
+   * \return  The size (in bytes) of the compressed depth image data in the message.
+   */
+  size_t get_depth_image_data_size() const;
+
+  /**
+   * \brief Gets the dimensions of the compressed depth image.
+   *
+   * \return The dimensions of the compressed depth image.
+   */
+  const Vector2i& get_depth_image_size() const;
+
+  /**
+   * \brief Gets the number of tiles in the compressed depth image.
+   *
+   * \return The number of tiles in the compressed depth image.
+   */
+  uint32_t get_depth_tile_count() const;
+
+  /**
+   * \brief Gets a pointer to the compressed RGB image data in the message (this avoids the need to copy the data out of the message).
+   *
+   * \return  A pointer to the compressed RGB image data in the message.
+   */
+  const uint8_t *get_rgb_image_data_ptr() const;
+
+  /**
+   * \brief Gets the size (in bytes) of the compressed RGB image data in the message.
+   *
+   * \return  The size (in bytes) of the compressed RGB image data in the message.
+   */
+  size_t get_rgb_image_data_size() const;
+
+  /**
+   * \brief Gets the dimensions of the compressed RGB image.
+   *
+   * \return The dimensions of the compressed RGB image.
+   */
+  const Vector2i& get_rgb_image_size() const;
+
+  /**
+   * \brief Gets the number of tiles in the compressed RGB image.
+   *
+   * \return The number of tiles in the compressed RGB image.
+   */
+  uint32_t get_rgb_tile_count() const;
+
+  /**
+   * \brief Sets the segment sizes (and the image dimensions and tile counts) for the depth and RGB images according to the compressed message header.
+   *        Resizes the raw data storage accordingly, and stops borrowing any image data.
    *
    * \param headerMsg The header message corresponding to this message, which specifies the size of the compressed depth and RGB segments.
    */
@@ -6,6 +6,13 @@
 #ifndef H_ITMX_DEPTHCOMPRESSIONTYPE
 #define H_ITMX_DEPTHCOMPRESSIONTYPE
 
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/trim.hpp>
+
 namespace itmx {
 
 /**
@@ -20,8 +27,52 @@ enum DepthCompressionType
 
   /** The depth images will be compressed using lossless PNG compression (requires OpenCV). */
   DEPTH_COMPRESSION_PNG = 1,
+
+  /** The depth images will be compressed using lossless predictive coding (see PredictiveDepthCodec), with each frame coded independently. */
+  DEPTH_COMPRESSION_PREDICTIVE = 2,
+
+  /** The depth images will be compressed using lossless predictive coding, with each frame potentially coded relative to the previous one. */
+  DEPTH_COMPRESSION_PREDICTIVE_TEMPORAL = 3,
 };
 
+//#################### STREAM OPERATORS ####################
+
+inline std::ostream& operator<<(std::ostream& os, DepthCompressionType rhs)
+{
+  switch(rhs)
+  {
+    case DEPTH_COMPRESSION_NONE:                os << "none"; break;
+    case DEPTH_COMPRESSION_PNG:                 os << "png"; break;
+    case DEPTH_COMPRESSION_PREDICTIVE:          os << "predictive"; break;
+    case DEPTH_COMPRESSION_PREDICTIVE_TEMPORAL: os << "predictivetemporal"; break;
+    default:
+    {
+      // This should never happen.
+      throw std::runtime_error("Error: Unknown depth compression type");
+    }
+  }
+
+  return os;
+}
+
+inline std::istream& operator>>(std::istream& is, DepthCompressionType& rhs)
+{
+  std::string temp;
+  is >> temp;
+  if(!is) return is;
+
+  boost::trim(temp);
+  boost::to_lower(temp);
+
+  if(temp == "none") rhs = DEPTH_COMPRESSION_NONE;
+  else if(temp == "png") rhs = DEPTH_COMPRESSION_PNG;
+  else if(temp == "predictive") rhs = DEPTH_COMPRESSION_PREDICTIVE;
+  else if(temp == "predictivetemporal") rhs = DEPTH_COMPRESSION_PREDICTIVE_TEMPORAL;
+  else throw std::runtime_error("Error: Unknown depth compression type '" + temp + "'");
+
+  return is;
+}
+
 }
 
 #endif
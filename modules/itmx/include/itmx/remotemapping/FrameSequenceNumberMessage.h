@@ -0,0 +1,27 @@
+/**
+ * itmx: FrameSequenceNumberMessage.h
+ * Copyright (c) Torr Vision Group, University of Oxford, 2019. All rights reserved.
+ */
+
+#ifndef H_ITMX_FRAMESEQUENCENUMBERMESSAGE
+#define H_ITMX_FRAMESEQUENCENUMBERMESSAGE
+
+#include <boost/cstdint.hpp>
+
+#include <tvgutil/net/SimpleMessage.h>
+
+namespace itmx {
+
+//#################### TYPES ####################
+
+/**
+ * \brief An instance of this type represents a message containing the sequence number of an RGB-D frame sent using the windowed frame transport.
+ *
+ * The client sends one of these just before each frame it sends. The server sends one back to acknowledge the frames it has received:
+ * acknowledgements are cumulative, i.e. an acknowledgement of frame n also acknowledges all of the frames before it.
+ */
+typedef tvgutil::SimpleMessage<int32_t> FrameSequenceNumberMessage;
+
+}
+
+#endif
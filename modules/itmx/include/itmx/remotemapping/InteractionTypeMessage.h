@@ -30,6 +30,17 @@ enum InteractionType
 
   /** An interaction in which the client sends a new rendering request to the server. */
   IT_UPDATERENDERINGREQUEST = 3,
+
+  /** An interaction in which the client sends a single RGB-D frame (preceded by its sequence number) to the server without waiting for it to be acknowledged. */
+  IT_SENDFRAMEWINDOWED = 4,
+
+  /**
+   * An interaction in which the client asks the server to push the images it renders for the client across as soon as they have
+   * been rendered. After this, the server tags each message it sends to the client with its type (see ServerMessageType), and no
+   * longer acknowledges rendering requests. A subscribed client may only send frames via the windowed frame transport and update
+   * its rendering request.
+   */
+  IT_SUBSCRIBERENDEREDIMAGES = 5,
 };
 
 //#################### TYPES ####################
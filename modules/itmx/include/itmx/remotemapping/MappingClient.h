@@ -6,7 +6,11 @@
 #ifndef H_ITMX_MAPPINGCLIENT
 #define H_ITMX_MAPPINGCLIENT
 
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+
 #include <tvgutil/boost/WrappedAsio.h>
+#include <tvgutil/containers/LockFreePooledQueue.h>
 #include <tvgutil/containers/PooledQueue.h>
 
 #include "RGBDCalibrationMessage.h"
@@ -17,29 +21,88 @@ namespace itmx {
 
 /**
  * \brief An instance of this class represents a client that can be used to communicate with a remote mapping server.
+ *
+ * Frames are sent to the server using a sliding window: each frame is tagged with a sequence number, and up to a fixed
+ * number of frames can be in flight at once, so that the rate at which frames can be sent is bounded by the bandwidth
+ * of the connection rather than its round-trip time. The server acknowledges frames cumulatively. When the window is
+ * full, the message sender stops consuming frames from the frame message queue until an acknowledgement arrives, so
+ * that backpressure is applied to the code pushing frames onto the queue (in accordance with its pool empty strategy).
+ * The frame message queue can either be a PooledQueue or a LockFreePooledQueue (which avoids taking a lock on each push
+ * and pop, but does not support the random replacement pool empty strategy): see the constructor.
+ *
+ * The client subscribes to the images the server renders for it, which the server then pushes across as soon as they
+ * have been rendered. A separate message receiver thread reads everything the server sends (frame acknowledgements and
+ * rendered images), so the two directions of the connection never wait for each other: sending frames or rendering
+ * requests never involves waiting for a response, and retrieving the latest remote image never touches the network.
  */
 class MappingClient
 {
   //#################### TYPEDEFS ####################
 public:
+  typedef boost::shared_ptr<tvgutil::pooled_queue::PushHandlerBase<RGBDFrameMessage_Ptr> > FrameMessagePushHandler_Ptr;
+
+private:
+  typedef tvgutil::LockFreePooledQueue<RGBDFrameMessage_Ptr> LockFreeRGBDFrameMessageQueue;
   typedef tvgutil::PooledQueue<RGBDFrameMessage_Ptr> RGBDFrameMessageQueue;
 
   //#################### PRIVATE VARIABLES ####################
 private:
+  /** A condition variable used to wait for frame acknowledgements to arrive (or for the connection to fail). */
+  boost::condition_variable m_frameAcked;
+
+  /** The mutex used to synchronise access to the frame acknowledgement state. */
+  boost::mutex m_frameAckMutex;
+
   /** A frame compressor, used to compress frame messages to reduce the network bandwidth they consume. */
   RGBDFrameCompressor_Ptr m_frameCompressor;
 
-  /** A queue containing the RGB-D frame messages to be sent to the server. */
-  RGBDFrameMessageQueue m_frameMessageQueue;
+  /** A queue containing the RGB-D frame messages to be sent to the server (null if the lock-free queue is being used instead). */
+  boost::shared_ptr<RGBDFrameMessageQueue> m_frameMessageQueue;
+
+  /** The maximum number of frames that can have been sent to the server without yet being acknowledged. */
+  size_t m_frameWindowSize;
+
+  /** The I/O service used for the connection to the server. */
+  boost::asio::io_service m_ioService;
+
+  /** The sequence number of the last frame to have been acknowledged by the server (-1 if no frame has been acknowledged yet). */
+  int32_t m_lastAckedFrameSequenceNumber;
+
+  /** A lock-free queue containing the RGB-D frame messages to be sent to the server (null if the ordinary queue is being used instead). */
+  boost::shared_ptr<LockFreeRGBDFrameMessageQueue> m_lockFreeFrameMessageQueue;
+
+  /** The thread that reads the messages (frame acknowledgements and rendered images) that the server sends to the client. */
+  boost::shared_ptr<boost::thread> m_messageReceiverThread;
+
+  /** The thread that sends frame messages from the message queue across to the server. */
+  boost::shared_ptr<boost::thread> m_messageSenderThread;
+
+  /** The sequence number to give the next frame sent to the server. */
+  int32_t m_nextFrameSequenceNumber;
+
+  /** Whether or not the connection to the server is still ok (set to false by the message receiver if it fails to read from the server). */
+  bool m_receiverConnectionOk;
+
+  /** The image containing the latest remote scene rendering retrieved from the server (null until one has been retrieved). */
+  ORUChar4Image_Ptr m_remoteImage;
 
-  /** A mutex used to synchronise interactions with the server to avoid overlaps. */
-  mutable boost::mutex m_interactionMutex;
+  /** The image into which the message receiver uncompresses the next remote scene rendering (before swapping it with the latest one). */
+  ORUChar4Image_Ptr m_remoteImageBackBuffer;
 
-  /** The image in which remote scene renderings retrieved from the server are stored. */
-  mutable ORUChar4Image_Ptr m_remoteImage;
+  /** A frame compressor used by the message receiver to uncompress the remote scene renderings retrieved from the server. */
+  RGBDFrameCompressor_Ptr m_remoteImageCompressor;
 
-  /** The TCP stream used as a wrapper around the connection to the server. */
-  mutable boost::asio::ip::tcp::iostream m_stream;
+  /** The mutex used to synchronise access to the latest remote scene rendering. */
+  mutable boost::mutex m_remoteImageMutex;
+
+  /** Whether or not the message sender thread should terminate. */
+  boost::atomic<bool> m_shouldTerminate;
+
+  /** The socket used to communicate with the server. */
+  boost::asio::ip::tcp::socket m_sock;
+
+  /** A mutex used to prevent the messages written to the server by different threads from becoming interleaved. */
+  boost::mutex m_writeMutex;
 
   //#################### CONSTRUCTORS ####################
 public:
@@ -49,26 +112,48 @@ public:
    * \param host              The mapping host to which to connect.
    * \param port              The port on the mapping host to which to connect.
    * \param poolEmptyStrategy A strategy specifying what should happen when a push is attempted while the frame message queue's pool is empty.
+   * \param frameWindowSize   The maximum number of frames that can be in flight (i.e. sent but not yet acknowledged) at once (1 gives stop-and-wait behaviour).
+   * \param useLockFreeQueue  Whether or not to use a lock-free queue for the frame messages (this does not support the random replacement pool empty strategy).
+   * \throws std::runtime_error If a lock-free queue is requested with the random replacement pool empty strategy, or if the client cannot connect to the server.
+   */
+  explicit MappingClient(const std::string& host = "localhost", const std::string& port = "7851", tvgutil::pooled_queue::PoolEmptyStrategy poolEmptyStrategy = tvgutil::pooled_queue::PES_DISCARD,
+                         size_t frameWindowSize = 4, bool useLockFreeQueue = false);
+
+  //#################### DESTRUCTOR ####################
+public:
+  /**
+   * \brief Destroys the mapping client.
    */
-  explicit MappingClient(const std::string& host = "localhost", const std::string& port = "7851", tvgutil::pooled_queue::PoolEmptyStrategy poolEmptyStrategy = tvgutil::pooled_queue::PES_DISCARD);
+  ~MappingClient();
+
+  //#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+private:
+  // Deliberately private and unimplemented.
+  MappingClient(const MappingClient&);
+  MappingClient& operator=(const MappingClient&);
 
   //#################### PUBLIC MEMBER FUNCTIONS ####################
 public:
   /**
    * \brief Starts the push of a frame message so that it can be sent to the server.
    */
-  RGBDFrameMessageQueue::PushHandler_Ptr begin_push_frame_message();
+  FrameMessagePushHandler_Ptr begin_push_frame_message();
 
   /**
-   * \brief Gets the image in which remote scene renderings retrieved from the server are stored.
+   * \brief Gets the latest remote scene rendering that the server has pushed across to the client.
+   *
+   * This never blocks on the network: the renderings are received in the background by the message receiver thread.
+   * The image returned is never modified by the client after it has been returned.
    *
-   * \return  The image in which remote scene renderings retrieved from the server are stored.
+   * \return  The latest remote scene rendering that the server has pushed across to the client (null if none has arrived yet).
    */
   ORUChar4Image_CPtr get_remote_image() const;
 
   /**
    * \brief Sends a calibration message to the server.
    *
+   * The client's frame window size is filled in automatically, so that the server knows how often it must acknowledge frames.
+   *
    * \param msg The message to send.
    */
   void send_calibration_message(const RGBDCalibrationMessage& msg);
@@ -76,6 +161,9 @@ public:
   /**
    * \brief Sends a request to the server to render a visualisation of the scene for the client.
    *
+   * The server will push each image it renders in response to the latest request back to the client (see get_remote_image).
+   * This does not wait for a response from the server.
+   *
    * \param imgSize       The size of image to render.
    * \param pose          The pose (in the client's coordinate system) from which the server should render the scene.
    * \param visualisation The type of visualisation to render.
@@ -84,6 +172,62 @@ public:
 
   //#################### PRIVATE MEMBER FUNCTIONS ####################
 private:
+  /**
+   * \brief Gets the first frame message in the frame message queue.
+   *
+   * Note: This will block until the queue is non-empty.
+   *
+   * \return The first frame message in the frame message queue.
+   */
+  RGBDFrameMessage_Ptr peek_frame_message();
+
+  /**
+   * \brief Pops the first frame message from the frame message queue.
+   */
+  void pop_frame_message();
+
+  /**
+   * \brief Uncompresses a remote scene rendering that has been received from the server and makes it the latest one.
+   *
+   * \note  If the rendering cannot be uncompressed, a warning is printed and the rendering is dropped.
+   *
+   * \param headerMsg             The header message for the compressed rendering.
+   * \param frameMsg              The compressed rendering.
+   * \param uncompressedFrameMsg  A frame message into which the rendering can be uncompressed (this will be resized if necessary).
+   */
+  void publish_remote_image(const CompressedRGBDFrameHeaderMessage& headerMsg, const CompressedRGBDFrameMessage& frameMsg, RGBDFrameMessage_Ptr& uncompressedFrameMsg);
+
+  /**
+   * \brief Attempts to read a message from the server (scattering it directly into any segments it has borrowed from external memory).
+   *
+   * \param msg The message into which to read.
+   * \return    true, if reading succeeded, or false otherwise.
+   */
+  bool read_message(tvgutil::Message& msg);
+
+  /**
+   * \brief Attempts to write a message to the server.
+   *
+   * \param msg The message to write.
+   * \return    true, if writing succeeded, or false otherwise.
+   */
+  bool write_message(const tvgutil::Message& msg);
+
+  /**
+   * \brief Attempts to write a sequence of messages to the server using a single gather-write (so that their bytes,
+   *        including any segments they have borrowed from external memory, need not first be copied into a contiguous buffer).
+   *
+   * \param messages      The messages to write (in order).
+   * \param messageCount  The number of messages to write.
+   * \return              true, if writing succeeded, or false otherwise.
+   */
+  bool write_messages(const tvgutil::Message *const *messages, size_t messageCount);
+
+  /**
+   * \brief Reads the messages (frame acknowledgements and rendered images) that the server sends to the client.
+   */
+  void run_message_receiver();
+
   /**
    * \brief Sends frame messages from the message queue across to the server.
    */
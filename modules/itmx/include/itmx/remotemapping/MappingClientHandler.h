@@ -6,6 +6,9 @@
 #ifndef H_ITMX_MAPPINGCLIENTHANDLER
 #define H_ITMX_MAPPINGCLIENTHANDLER
 
+#include <deque>
+#include <vector>
+
 #include <ITMLib/Objects/Camera/ITMRGBDCalib.h>
 
 #include <tvgutil/containers/PooledQueue.h>
@@ -19,11 +22,72 @@ namespace itmx {
 
 /**
  * \brief An instance of this class can be used to manage the connection to a mapping client.
+ *
+ * Incoming frames pass through a staged ingest pipeline. The client thread receives each compressed frame into one of a fixed
+ * number of ingest slots and hands it over to the decode stage, which uncompresses frames in parallel on the global task scheduler
+ * (or one at a time, in order, if the depth images are coded relative to the previous frame). Decoded frames are reassembled into
+ * their original order by a frame publisher thread, which pushes them onto the frame message queue, from which they are consumed
+ * by the server. A frame only leaves its ingest slot once it is on the queue, so if the queue is full, the publisher holds on to
+ * the frame until the server makes space for it. If all of the ingest slots are in use, the client thread stops reading from the
+ * client until one is freed, so a slow decode stage or a slow server applies backpressure to the client via TCP rather than
+ * causing frames to be dropped. (The only frames that are dropped are any that are still in the ingest pipeline when the
+ * client disconnects and that the server has no space for at that point: such drops are counted, see get_ingest_counters.)
+ *
+ * If the client subscribes to rendered images, a separate pusher thread sends each image the server renders for the client
+ * across as soon as the server notifies the handler that it is ready (see notify_rendered_image). The pushing is latest-wins:
+ * if several images are rendered whilst an earlier one is being sent, only the most recent of them is sent afterwards.
  */
 class MappingClientHandler : public tvgutil::ClientHandler
 {
+  //#################### NESTED TYPES ####################
+public:
+  /**
+   * \brief An instance of this struct contains the counters that track the frames passing through the handler's ingest pipeline.
+   */
+  struct IngestCounters
+  {
+    /** The number of frames that have been decoded. */
+    size_t m_decodedFrameCount;
+
+    /** The number of frames that have been discarded because they could not be decoded. */
+    size_t m_discardedFrameCount;
+
+    /** The number of decoded frames that were dropped because the frame message queue was still full when the client disconnected. */
+    size_t m_droppedFrameCount;
+
+    /** The number of frames that have been received from the client. */
+    size_t m_receivedFrameCount;
+
+    IngestCounters()
+    : m_decodedFrameCount(0), m_discardedFrameCount(0), m_droppedFrameCount(0), m_receivedFrameCount(0)
+    {}
+  };
+
+private:
+  /**
+   * \brief An instance of this struct holds a frame as it passes through the ingest pipeline.
+   */
+  struct IngestSlot
+  {
+    /** Whether or not the decode stage has finished with the frame. */
+    bool m_decoded;
+
+    /** Whether or not the frame was successfully decoded. */
+    bool m_decodeSucceeded;
+
+    /** The decoded frame. */
+    RGBDFrameMessage_Ptr m_decodedFrameMessage;
+
+    /** The compressed frame. */
+    boost::shared_ptr<CompressedRGBDFrameMessage> m_frameMessage;
+
+    /** The header of the compressed frame. */
+    CompressedRGBDFrameHeaderMessage m_headerMessage;
+  };
+
   //#################### TYPEDEFS ####################
 private:
+  typedef boost::shared_ptr<IngestSlot> IngestSlot_Ptr;
   typedef tvgutil::PooledQueue<RGBDFrameMessage_Ptr> RGBDFrameMessageQueue;
   typedef boost::shared_ptr<RGBDFrameMessageQueue> RGBDFrameMessageQueue_Ptr;
 
@@ -32,27 +96,69 @@ private:
   /** The calibration parameters of the camera associated with the client. */
   ITMLib::ITMRGBDCalib m_calib;
 
-  /** A dummy frame message to consume messages that cannot be pushed onto the queue. */
-  RGBDFrameMessage_Ptr m_dummyFrameMessage;
+  /** The number of decode tasks that are currently running on the task scheduler. */
+  size_t m_activeDecoderCount;
+
+  /** The queue of frames (denoted by their frame numbers) that have been received but not yet decoded. */
+  std::deque<size_t> m_decodeQueue;
 
-  /** The frame compressor for the client. */
-  RGBDFrameCompressor_Ptr m_frameCompressor;
+  /** The frame compressors that are currently available for use by the decode stage. */
+  std::vector<RGBDFrameCompressor_Ptr> m_frameDecoders;
 
-  /** A place in which to store compressed RGB-D frame messages. */
-  boost::shared_ptr<CompressedRGBDFrameMessage> m_frameMessage;
+  /** The maximum number of frames that can be decoded at once. */
+  size_t m_frameDecoderCount;
+
+  /** The thread that pushes the decoded frames onto the frame message queue (in order). */
+  boost::shared_ptr<boost::thread> m_framePublisherThread;
 
   /** A queue containing the RGB-D frame messages received from the client. */
   RGBDFrameMessageQueue_Ptr m_frameMessageQueue;
 
-  /** A place in which to store compressed RGB-D frame header messages. */
-  CompressedRGBDFrameHeaderMessage m_headerMessage;
-
   /** A flag indicating whether or not the images associated with the first message in the queue have already been read. */
   bool m_imagesDirty;
 
+  /** The counters that track the frames passing through the ingest pipeline. */
+  IngestCounters m_ingestCounters;
+
+  /** The mutex used to synchronise access to the state of the ingest pipeline. */
+  mutable boost::mutex m_ingestMutex;
+
+  /** A condition variable used to wait for the ingest pipeline to make progress (i.e. for a frame to be received, decoded or published, or a decode task to finish). */
+  boost::condition_variable m_ingestProgressed;
+
+  /** The slots that hold the frames passing through the ingest pipeline (frame n is held in slot n % m_ingestSlots.size()). */
+  std::vector<IngestSlot_Ptr> m_ingestSlots;
+
+  /**
+   * The maximum number of frames received via the windowed frame transport that can be left unacknowledged whilst the client
+   * still has more data in flight. This is derived from the window size the client sends in its calibration message.
+   */
+  size_t m_maxUnacknowledgedFrameCount;
+
+  /** The frame number of the next frame to be pushed onto the frame message queue (all earlier frames have left the ingest pipeline). */
+  size_t m_nextFrameToPublish;
+
+  /** The frame number to give the next frame received from the client. */
+  size_t m_nextFrameToReceive;
+
   /** A flag indicating whether or not the pose associated with the first message in the queue has already been read. */
   bool m_poseDirty;
 
+  /** A condition variable used to wake up the rendered image pusher when a new image has been rendered (or when it should stop). */
+  boost::condition_variable m_renderedImageNotified;
+
+  /** A flag indicating whether or not an image has been rendered for the client since the rendered image pusher last sent one. */
+  bool m_renderedImagePending;
+
+  /** The thread that pushes rendered images across to the client (only used if the client has subscribed to rendered images). */
+  boost::shared_ptr<boost::thread> m_renderedImagePusherThread;
+
+  /** The mutex used to synchronise communication with the rendered image pusher. */
+  boost::mutex m_renderedImagePusherMutex;
+
+  /** The sequence number of the most recent frame received via the windowed frame transport that has not yet been acknowledged (if any). */
+  boost::optional<int32_t> m_pendingFrameAck;
+
   /** An optional image into which to render the scene for the client. */
   ORUChar4Image_Ptr m_renderedImage;
 
@@ -65,12 +171,33 @@ private:
   /** The synchronisation mutex for the rendering request. */
   boost::mutex m_renderingRequestMutex;
 
+  /** The frame compressor used to compress the server-rendered images sent back to the client. */
+  RGBDFrameCompressor_Ptr m_renderingResponseCompressor;
+
+  /** A place in which to store compressed RGB-D frame messages that can be used to send server-rendered images back to the client. */
+  boost::shared_ptr<CompressedRGBDFrameMessage> m_renderingResponseFrameMessage;
+
+  /** A place in which to store compressed RGB-D frame header messages that can be used to send server-rendered images back to the client. */
+  CompressedRGBDFrameHeaderMessage m_renderingResponseHeaderMessage;
+
   /** A place in which to store uncompressed RGB-D frame messages that can be used to send server-rendered images back to the client. */
   RGBDFrameMessage_Ptr m_renderingResponseMessage;
 
   /** The scene ID that is associated with the client. */
   std::string m_sceneID;
 
+  /** Whether or not the frame publisher should stop (once it has published any remaining frames for which there is space on the frame message queue). */
+  bool m_shouldStopPublishingFrames;
+
+  /** Whether or not the rendered image pusher should stop. */
+  bool m_shouldStopPushingRenderedImages;
+
+  /** The number of frames received via the windowed frame transport since an acknowledgement was last sent to the client. */
+  size_t m_unacknowledgedFrameCount;
+
+  /** A mutex used to prevent the messages written to the client by the handler and the rendered image pusher from becoming interleaved. */
+  boost::mutex m_writeMutex;
+
   //#################### CONSTRUCTORS ####################
 public:
   /**
@@ -105,6 +232,13 @@ public:
    */
   const RGBDFrameMessageQueue_Ptr& get_frame_message_queue();
 
+  /**
+   * \brief Gets the counters that track the frames passing through the handler's ingest pipeline.
+   *
+   * \return  The counters that track the frames passing through the handler's ingest pipeline.
+   */
+  IngestCounters get_ingest_counters() const;
+
   /**
    * \brief Gets the image (if any) that the server has rendered for the client.
    *
@@ -147,6 +281,14 @@ public:
    */
   const Vector2i& get_rgb_image_size() const;
 
+  /**
+   * \brief Notifies the handler that a new image has been rendered for the client.
+   *
+   * If the client has subscribed to rendered images, the image will be pushed across to it as soon as possible.
+   * This does not block (other than briefly, to synchronise with the rendered image pusher).
+   */
+  void notify_rendered_image();
+
   /** Override */
   virtual void run_iter();
 
@@ -176,6 +318,46 @@ public:
    * \param sceneID The scene ID that is associated with the client.
    */
   void set_scene_id(const std::string& sceneID);
+
+  //#################### PRIVATE MEMBER FUNCTIONS ####################
+private:
+  /**
+   * \brief Compresses the image that the server has rendered for the client, ready for it to be sent back to the client.
+   *
+   * \return true, if an image has been rendered for the client and it was compressed, or false if no image has been rendered for the client.
+   */
+  bool compress_rendered_image();
+
+  /**
+   * \brief Reads a compressed RGB-D frame (a header message followed by a frame message) from the client, and hands it over to the decode stage.
+   *
+   * This will block until there is a free ingest slot into which to read the frame.
+   *
+   * \return true, if the frame was successfully read, or false otherwise.
+   */
+  bool read_frame();
+
+  /**
+   * \brief Decodes frames from the decode queue until it is empty (this is run as a task on the global task scheduler).
+   */
+  void run_frame_decoder();
+
+  /**
+   * \brief Pushes the decoded frames onto the frame message queue (in order), waiting for space on the queue whenever it is full.
+   */
+  void run_frame_publisher();
+
+  /**
+   * \brief Pushes the images that the server renders for the client across to the client as soon as they have been rendered.
+   */
+  void run_rendered_image_pusher();
+
+  /**
+   * \brief Sends the client an acknowledgement of the most recent frame received via the windowed frame transport, if it has not yet been acknowledged.
+   *
+   * \return true, if no acknowledgement was needed or it was successfully sent, or false otherwise.
+   */
+  bool write_pending_frame_ack();
 };
 
 }
@@ -58,6 +58,14 @@ public:
    */
   void get_images(int clientID, ORUChar4Image *rgb, ORShortImage *rawDepth);
 
+  /**
+   * \brief Gets the ingest counters (received, decoded, discarded and dropped frames) for the specified client.
+   *
+   * \param clientID  The ID of the client whose ingest counters we want to get.
+   * \return          The ingest counters for the specified client, if the client is currently active, or zeroed counters otherwise.
+   */
+  MappingClientHandler::IngestCounters get_ingest_counters(int clientID) const;
+
   /**
    * \brief Attempts to get the next pose from the specified client.
    *
@@ -117,6 +125,15 @@ public:
    */
   bool has_more_images(int clientID) const;
 
+  /**
+   * \brief Notifies the server that a new image has been rendered for the specified client.
+   *
+   * If the client has subscribed to rendered images, the image will be pushed across to it as soon as possible.
+   *
+   * \param clientID  The ID of the client for which the image has been rendered.
+   */
+  void notify_rendered_image(int clientID) const;
+
   /**
    * \brief Sets the scene ID that is associated with the specified client.
    *
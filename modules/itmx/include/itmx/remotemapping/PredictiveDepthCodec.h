@@ -0,0 +1,62 @@
+/**
+ * itmx: PredictiveDepthCodec.h
+ * Copyright (c) Torr Vision Group, University of Oxford, 2019. All rights reserved.
+ */
+
+#ifndef H_ITMX_PREDICTIVEDEPTHCODEC
+#define H_ITMX_PREDICTIVEDEPTHCODEC
+
+#include <cstddef>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+namespace itmx {
+
+/**
+ * \brief This class provides a fast, lossless codec for 16-bit depth images.
+ *
+ * Each pixel is predicted from its already-coded neighbours using the median edge detector (MED) predictor from LOCO-I/JPEG-LS,
+ * and the prediction residuals are coded using adaptive Golomb-Rice codes (with a few contexts based on the local gradient).
+ * Since depth images are generally piecewise smooth, most of the residuals are small and can be coded in a few bits.
+ *
+ * Optionally, the codec can also exploit temporal coherence: if a reference image (generally the previous frame) is supplied,
+ * the difference between the image and the reference is coded instead of the image itself whenever this looks cheaper.
+ * The decoder must then be supplied with exactly the same reference image.
+ *
+ * The codec only ever looks at the rows of the image it is given, so images can be split into bands of rows that are
+ * compressed and uncompressed independently (and in parallel).
+ */
+class PredictiveDepthCodec
+{
+  //#################### PUBLIC STATIC MEMBER FUNCTIONS ####################
+public:
+  /**
+   * \brief Compresses a depth image.
+   *
+   * \param depth           The depth image (width * height pixels, stored in row-major order).
+   * \param reference       An optional reference image of the same size (may be NULL).
+   * \param width           The width of the image.
+   * \param height          The height of the image.
+   * \param bytes           The buffer into which to write the compressed image (this will be resized as necessary).
+   */
+  static void compress(const short *depth, const short *reference, int width, int height, std::vector<uint8_t>& bytes);
+
+  /**
+   * \brief Uncompresses a depth image.
+   *
+   * \param bytes           The compressed image.
+   * \param byteCount       The size of the compressed image (in bytes).
+   * \param reference       The reference image that was used to compress the image, if any (may be NULL).
+   * \param width           The width of the image.
+   * \param height          The height of the image.
+   * \param depth           The location into which to write the uncompressed image (must have space for width * height pixels).
+   *
+   * \throws std::runtime_error If the compressed image is corrupt, or needs a reference image that has not been supplied.
+   */
+  static void uncompress(const uint8_t *bytes, size_t byteCount, const short *reference, int width, int height, short *depth);
+};
+
+}
+
+#endif
@@ -27,6 +27,9 @@ private:
   /** The type of compression applied to the depth images. */
   Segment m_depthCompressionTypeSegment;
 
+  /** The maximum number of frames that the client can send via the windowed frame transport without them being acknowledged. */
+  Segment m_frameWindowSizeSegment;
+
   /** The type of compression applied to the RGB images. */
   Segment m_rgbCompressionTypeSegment;
 
@@ -53,6 +56,13 @@ public:
    */
   DepthCompressionType extract_depth_compression_type() const;
 
+  /**
+   * \brief Extracts the maximum number of frames that the client can send via the windowed frame transport without them being acknowledged.
+   *
+   * \return  The client's frame window size.
+   */
+  uint32_t extract_frame_window_size() const;
+
   /**
    * \brief Extracts the type of compression applied to the RGB images.
    *
@@ -74,6 +84,13 @@ public:
    */
   void set_depth_compression_type(DepthCompressionType depthCompressionType);
 
+  /**
+   * \brief Sets the maximum number of frames that the client can send via the windowed frame transport without them being acknowledged.
+   *
+   * \param frameWindowSize The client's frame window size.
+   */
+  void set_frame_window_size(uint32_t frameWindowSize);
+
   /**
    * \brief Sets the type of compression applied to the RGB images.
    *
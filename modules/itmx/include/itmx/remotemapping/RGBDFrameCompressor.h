@@ -16,6 +16,13 @@ namespace itmx {
 
 /**
  * \brief An instance of this class can be used to compress or decompress RGB-D frame messages.
+ *
+ * Each image is divided into a number of tiles (horizontal bands of rows) that are compressed independently. The tiles
+ * of the depth and RGB images are all compressed (and uncompressed) concurrently using the global task scheduler, and
+ * the intermediate buffers used for each tile are reused across frames.
+ *
+ * When using temporal predictive depth compression, each depth frame may be coded relative to the previous one, so a
+ * compressor on the receiving end of a stream must be given the compressed frames in the same order they were produced.
  */
 class RGBDFrameCompressor
 {
@@ -38,18 +45,24 @@ public:
    * \param depthImageSize        The size of the depth images to be compressed.
    * \param rgbCompressionType    The type of compression to apply to the RGB images.
    * \param depthCompressionType  The type of compression to apply to the depth images.
+   * \param tileCount             The maximum number of tiles into which to divide each image when compressing it (0 means one per task scheduler thread).
+   *                              Note that this has no effect on uncompression, since compressed frames specify the number of tiles they contain.
    *
    * \throws std::invalid_argument  If the specified compression types cannot be used (e.g. when building without OpenCV).
    */
   RGBDFrameCompressor(const Vector2i& rgbImageSize, const Vector2i& depthImageSize,
                       RGBCompressionType rgbCompressionType = RGB_COMPRESSION_NONE,
-                      DepthCompressionType depthCompressionType = DEPTH_COMPRESSION_NONE);
+                      DepthCompressionType depthCompressionType = DEPTH_COMPRESSION_NONE,
+                      size_t tileCount = 0);
 
   //#################### PUBLIC MEMBER FUNCTIONS ####################
 public:
   /**
    * \brief Compresses an RGB-D frame message.
    *
+   * \note   To avoid copying the compressed images, the compressed frame borrows them from the compressor's internal buffers,
+   *         so it must be sent before the next call to this function.
+   *
    * \param uncompressedFrame  The message to compress.
    * \param compressedHeader   Will contain the header data for the compressed RGB-D frame.
    * \param compressedFrame    Will contain the compressed RGB-D frame data.
@@ -59,32 +72,58 @@ public:
   /**
    * \brief Uncompresses an RGB-D frame message.
    *
+   * The images are uncompressed directly into the uncompressed message (e.g. a pooled, preallocated message), without any intermediate copies.
+   *
    * \param compressedFrame    The compressed frame message.
    * \param uncompressedFrame  Will contain the uncompressed message.
+   *
+   * \throws std::runtime_error If the compressed message is corrupt, or its images differ in size from those of the uncompressed message.
    */
   void uncompress_rgbd_frame(const CompressedRGBDFrameMessage& compressedFrame, RGBDFrameMessage& uncompressedFrame);
 
   //#################### PRIVATE MEMBER FUNCTIONS ####################
 private:
   /**
-   * \brief Compresses the uncompressed depth image on which we are currently working.
+   * \brief Compresses the specified tile of the uncompressed depth image on which we are currently working.
+   *
+   * \param tileIndex The index of the tile to compress.
    */
-  void compress_depth_image();
+  void compress_depth_tile(int tileIndex);
 
   /**
-   * \brief Compresses the uncompressed RGB image on which we are currently working.
+   * \brief Compresses the specified tile of the uncompressed RGB image on which we are currently working.
+   *
+   * \param tileIndex The index of the tile to compress.
    */
-  void compress_rgb_image();
+  void compress_rgb_tile(int tileIndex);
 
   /**
-   * \brief Uncompresses the compressed depth image on which we are currently working.
+   * \brief Runs the specified job of a compression pass (the depth tiles are numbered first, followed by the RGB tiles).
+   *
+   * \param jobIndex  The index of the job to run.
    */
-  void uncompress_depth_image();
+  void run_compression_job(int jobIndex);
 
   /**
-   * \brief Uncompresses the compressed RGB image on which we are currently working.
+   * \brief Runs the specified job of an uncompression pass (the depth tiles are numbered first, followed by the RGB tiles).
+   *
+   * \param jobIndex  The index of the job to run.
+   */
+  void run_uncompression_job(int jobIndex);
+
+  /**
+   * \brief Uncompresses the specified tile of the compressed depth image on which we are currently working.
+   *
+   * \param tileIndex The index of the tile to uncompress.
+   */
+  void uncompress_depth_tile(int tileIndex);
+
+  /**
+   * \brief Uncompresses the specified tile of the compressed RGB image on which we are currently working.
+   *
+   * \param tileIndex The index of the tile to uncompress.
    */
-  void uncompress_rgb_image();
+  void uncompress_rgb_tile(int tileIndex);
 };
 
 //#################### TYPEDEFS ####################
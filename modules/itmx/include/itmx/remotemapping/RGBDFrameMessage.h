@@ -61,6 +61,20 @@ public:
    */
   void extract_rgb_image(ORUChar4Image *rgbImage) const;
 
+  /**
+   * \brief Gets a pointer to the depth image data in the message (this can be used to read or write the image in place, without copying it).
+   *
+   * \return  A pointer to the depth image data in the message.
+   */
+  short *get_depth_image_ptr();
+
+  /**
+   * \brief Gets a pointer to the depth image data in the message (this can be used to read the image in place, without copying it).
+   *
+   * \return  A pointer to the depth image data in the message.
+   */
+  const short *get_depth_image_ptr() const;
+
   /**
    * \brief Gets the size of the frame's depth image.
    *
@@ -68,6 +82,20 @@ public:
    */
   const Vector2i& get_depth_image_size() const;
 
+  /**
+   * \brief Gets a pointer to the RGB image data in the message (this can be used to read or write the image in place, without copying it).
+   *
+   * \return  A pointer to the RGB image data in the message.
+   */
+  Vector4u *get_rgb_image_ptr();
+
+  /**
+   * \brief Gets a pointer to the RGB image data in the message (this can be used to read the image in place, without copying it).
+   *
+   * \return  A pointer to the RGB image data in the message.
+   */
+  const Vector4u *get_rgb_image_ptr() const;
+
   /**
    * \brief Gets the size of the frame's RGB image.
    *
@@ -0,0 +1,42 @@
+/**
+ * itmx: ServerMessageTypeMessage.h
+ * Copyright (c) Torr Vision Group, University of Oxford, 2019. All rights reserved.
+ */
+
+#ifndef H_ITMX_SERVERMESSAGETYPEMESSAGE
+#define H_ITMX_SERVERMESSAGETYPEMESSAGE
+
+#include <tvgutil/net/SimpleMessage.h>
+
+namespace itmx {
+
+//#################### ENUMERATIONS ####################
+
+/**
+ * \brief The values of this enumeration denote the different types of message that a mapping server can send to a mapping client
+ *        that has subscribed to rendered images (see IT_SUBSCRIBERENDEREDIMAGES).
+ *
+ * Once a client has subscribed, the server precedes each message it sends to that client with a message containing its type, so
+ * that the client can receive frame acknowledgements and rendered images on the same connection without waiting for either.
+ *
+ * \note  Do not change the enum values without making sure that all clients have been updated accordingly.
+ */
+enum ServerMessageType
+{
+  /** An acknowledgement of the frames received via the windowed frame transport (followed by a frame sequence number message). */
+  SMT_FRAMEACK = 0,
+
+  /** An image rendered for the client (followed by a compressed RGB-D frame header message and a compressed RGB-D frame message). */
+  SMT_RENDEREDIMAGE = 1,
+};
+
+//#################### TYPES ####################
+
+/**
+ * \brief An instance of this type represents a message containing the type of the next message that a mapping server is sending to a mapping client.
+ */
+typedef tvgutil::SimpleMessage<ServerMessageType> ServerMessageTypeMessage;
+
+}
+
+#endif
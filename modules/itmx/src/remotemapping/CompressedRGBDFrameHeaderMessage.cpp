@@ -15,9 +15,15 @@ CompressedRGBDFrameHeaderMessage::CompressedRGBDFrameHeaderMessage()
 {
   m_depthImageByteSizeSegment = std::make_pair(0, sizeof(uint32_t));
   m_depthImageSizeSegment = std::make_pair(end_of(m_depthImageByteSizeSegment), sizeof(Vector2i));
-  m_rgbImageByteSizeSegment = std::make_pair(end_of(m_depthImageSizeSegment), sizeof(uint32_t));
+  m_depthTileCountSegment = std::make_pair(end_of(m_depthImageSizeSegment), sizeof(uint32_t));
+  m_rgbImageByteSizeSegment = std::make_pair(end_of(m_depthTileCountSegment), sizeof(uint32_t));
   m_rgbImageSizeSegment = std::make_pair(end_of(m_rgbImageByteSizeSegment), sizeof(Vector2i));
-  m_data.resize(end_of(m_rgbImageSizeSegment));
+  m_rgbTileCountSegment = std::make_pair(end_of(m_rgbImageSizeSegment), sizeof(uint32_t));
+  m_data.resize(end_of(m_rgbTileCountSegment));
+
+  // By default, each image consists of a single tile.
+  set_depth_tile_count(1);
+  set_rgb_tile_count(1);
 }
 
 //#################### PUBLIC MEMBER FUNCTIONS ####################
@@ -32,6 +38,11 @@ Vector2i CompressedRGBDFrameHeaderMessage::extract_depth_image_size() const
   return read_simple<Vector2i>(m_depthImageSizeSegment);
 }
 
+uint32_t CompressedRGBDFrameHeaderMessage::extract_depth_tile_count() const
+{
+  return read_simple<uint32_t>(m_depthTileCountSegment);
+}
+
 uint32_t CompressedRGBDFrameHeaderMessage::extract_rgb_image_byte_size() const
 {
   return read_simple<uint32_t>(m_rgbImageByteSizeSegment);
@@ -42,6 +53,11 @@ Vector2i CompressedRGBDFrameHeaderMessage::extract_rgb_image_size() const
   return read_simple<Vector2i>(m_rgbImageSizeSegment);
 }
 
+uint32_t CompressedRGBDFrameHeaderMessage::extract_rgb_tile_count() const
+{
+  return read_simple<uint32_t>(m_rgbTileCountSegment);
+}
+
 void CompressedRGBDFrameHeaderMessage::set_depth_image_byte_size(uint32_t depthImageByteSize)
 {
   write_simple(depthImageByteSize, m_depthImageByteSizeSegment);
@@ -52,6 +68,11 @@ void CompressedRGBDFrameHeaderMessage::set_depth_image_size(const Vector2i& dept
   write_simple(depthImageSize, m_depthImageSizeSegment);
 }
 
+void CompressedRGBDFrameHeaderMessage::set_depth_tile_count(uint32_t depthTileCount)
+{
+  write_simple(depthTileCount, m_depthTileCountSegment);
+}
+
 void CompressedRGBDFrameHeaderMessage::set_rgb_image_byte_size(uint32_t rgbImageByteSize)
 {
   write_simple(rgbImageByteSize, m_rgbImageByteSizeSegment);
@@ -62,4 +83,9 @@ void CompressedRGBDFrameHeaderMessage::set_rgb_image_size(const Vector2i& rgbIma
   write_simple(rgbImageSize, m_rgbImageSizeSegment);
 }
 
+void CompressedRGBDFrameHeaderMessage::set_rgb_tile_count(uint32_t rgbTileCount)
+{
+  write_simple(rgbTileCount, m_rgbTileCountSegment);
+}
+
 }
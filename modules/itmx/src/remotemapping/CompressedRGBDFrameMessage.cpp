@@ -23,20 +23,88 @@ CompressedRGBDFrameMessage::CompressedRGBDFrameMessage(const CompressedRGBDFrame
 
 //#################### PUBLIC MEMBER FUNCTIONS ####################
 
+void CompressedRGBDFrameMessage::borrow_depth_image_data(const std::vector<uint8_t>& depthImageData)
+{
+  if(depthImageData.size() != m_depthImageSegment.second)
+  {
+    throw std::runtime_error("Error: The compressed source depth image has a different size to that of the depth segment in the message");
+  }
+
+  borrow_segment(m_depthImageSegment, reinterpret_cast<const char*>(depthImageData.data()));
+}
+
+void CompressedRGBDFrameMessage::borrow_rgb_image_data(const std::vector<uint8_t>& rgbImageData)
+{
+  if(rgbImageData.size() != m_rgbImageSegment.second)
+  {
+    throw std::runtime_error("Error: The compressed source RGB image has a different size to that of the RGB segment in the message");
+  }
+
+  borrow_segment(m_rgbImageSegment, reinterpret_cast<const char*>(rgbImageData.data()));
+}
+
 void CompressedRGBDFrameMessage::extract_depth_image_data(std::vector<uint8_t>& depthImageData) const
 {
   depthImageData.resize(m_depthImageSegment.second);
-  memcpy(reinterpret_cast<char*>(depthImageData.data()), &m_data[m_depthImageSegment.first], m_depthImageSegment.second);
+  memcpy(reinterpret_cast<char*>(depthImageData.data()), get_segment_ptr(m_depthImageSegment), m_depthImageSegment.second);
 }
 
 void CompressedRGBDFrameMessage::extract_rgb_image_data(std::vector<uint8_t>& rgbImageData) const
 {
   rgbImageData.resize(m_rgbImageSegment.second);
-  memcpy(reinterpret_cast<char*>(rgbImageData.data()), &m_data[m_rgbImageSegment.first], m_rgbImageSegment.second);
+  memcpy(reinterpret_cast<char*>(rgbImageData.data()), get_segment_ptr(m_rgbImageSegment), m_rgbImageSegment.second);
+}
+
+const uint8_t *CompressedRGBDFrameMessage::get_depth_image_data_ptr() const
+{
+  return reinterpret_cast<const uint8_t*>(get_segment_ptr(m_depthImageSegment));
+}
+
+size_t CompressedRGBDFrameMessage::get_depth_image_data_size() const
+{
+  return m_depthImageSegment.second;
+}
+
+const Vector2i& CompressedRGBDFrameMessage::get_depth_image_size() const
+{
+  return m_depthImageSize;
+}
+
+uint32_t CompressedRGBDFrameMessage::get_depth_tile_count() const
+{
+  return m_depthTileCount;
+}
+
+const uint8_t *CompressedRGBDFrameMessage::get_rgb_image_data_ptr() const
+{
+  return reinterpret_cast<const uint8_t*>(get_segment_ptr(m_rgbImageSegment));
+}
+
+size_t CompressedRGBDFrameMessage::get_rgb_image_data_size() const
+{
+  return m_rgbImageSegment.second;
+}
+
+const Vector2i& CompressedRGBDFrameMessage::get_rgb_image_size() const
+{
+  return m_rgbImageSize;
+}
+
+uint32_t CompressedRGBDFrameMessage::get_rgb_tile_count() const
+{
+  return m_rgbTileCount;
 }
 
 void CompressedRGBDFrameMessage::set_compressed_image_sizes(const CompressedRGBDFrameHeaderMessage& headerMsg)
 {
+  // Note that the segments are about to change, so any image data that has been borrowed can no longer be used.
+  release_borrowed_segments();
+
+  m_depthImageSize = headerMsg.extract_depth_image_size();
+  m_depthTileCount = headerMsg.extract_depth_tile_count();
+  m_rgbImageSize = headerMsg.extract_rgb_image_size();
+  m_rgbTileCount = headerMsg.extract_rgb_tile_count();
+
   m_depthImageSegment = std::make_pair(end_of(m_poseSegment), headerMsg.extract_depth_image_byte_size());
   m_rgbImageSegment = std::make_pair(end_of(m_depthImageSegment), headerMsg.extract_rgb_image_byte_size());
   m_data.resize(end_of(m_rgbImageSegment));
@@ -49,7 +117,7 @@ void CompressedRGBDFrameMessage::set_depth_image_data(const std::vector<uint8_t>
     throw std::runtime_error("Error: The compressed source depth image has a different size to that of the depth segment in the message");
   }
 
-  memcpy(&m_data[m_depthImageSegment.first], reinterpret_cast<const char*>(depthImageData.data()), m_depthImageSegment.second);
+  memcpy(get_segment_ptr(m_depthImageSegment), reinterpret_cast<const char*>(depthImageData.data()), m_depthImageSegment.second);
 }
 
 void CompressedRGBDFrameMessage::set_rgb_image_data(const std::vector<uint8_t>& rgbImageData)
@@ -59,7 +127,7 @@ void CompressedRGBDFrameMessage::set_rgb_image_data(const std::vector<uint8_t>&
     throw std::runtime_error("Error: The compressed source RGB image has a different size to that of the RGB segment in the message");
   }
 
-  memcpy(&m_data[m_rgbImageSegment.first], reinterpret_cast<const char*>(rgbImageData.data()), m_rgbImageSegment.second);
+  memcpy(get_segment_ptr(m_rgbImageSegment), reinterpret_cast<const char*>(rgbImageData.data()), m_rgbImageSegment.second);
 }
 
 }
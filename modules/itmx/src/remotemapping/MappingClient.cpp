@@ -5,6 +5,8 @@
 
 #include "remotemapping/MappingClient.h"
 
+#include <algorithm>
+#include <iostream>
 #include <stdexcept>
 
 #include <tvgutil/boost/WrappedAsio.h>
@@ -12,86 +14,94 @@
 using boost::asio::ip::tcp;
 using namespace tvgutil;
 
+#include "remotemapping/FrameSequenceNumberMessage.h"
 #include "remotemapping/InteractionTypeMessage.h"
 #include "remotemapping/RenderingRequestMessage.h"
+#include "remotemapping/ServerMessageTypeMessage.h"
 
 namespace itmx {
 
 //#################### CONSTRUCTORS ####################
 
-MappingClient::MappingClient(const std::string& host, const std::string& port, pooled_queue::PoolEmptyStrategy poolEmptyStrategy)
-: m_frameMessageQueue(poolEmptyStrategy), m_stream(host, port)
+MappingClient::MappingClient(const std::string& host, const std::string& port, pooled_queue::PoolEmptyStrategy poolEmptyStrategy, size_t frameWindowSize,
+                             bool useLockFreeQueue)
+: m_frameWindowSize(std::max<size_t>(frameWindowSize, 1)),
+  m_lastAckedFrameSequenceNumber(-1),
+  m_nextFrameSequenceNumber(0),
+  m_receiverConnectionOk(true),
+  m_shouldTerminate(false),
+  m_sock(m_ioService)
 {
-  if(!m_stream) throw std::runtime_error("Error: Could not connect to server");
+  // Construct the frame message queue. Note that the lock-free queue will throw if the random replacement strategy is requested.
+  if(useLockFreeQueue) m_lockFreeFrameMessageQueue.reset(new LockFreeRGBDFrameMessageQueue(poolEmptyStrategy));
+  else m_frameMessageQueue.reset(new RGBDFrameMessageQueue(poolEmptyStrategy));
+
+  boost::system::error_code err;
+  tcp::resolver resolver(m_ioService);
+  boost::asio::connect(m_sock, resolver.resolve(tcp::resolver::query(host, port), err), err);
+  if(err) throw std::runtime_error("Error: Could not connect to server");
+
+  // Since each message is written straight to the socket (rather than being buffered), disable Nagle's algorithm
+  // so that small messages (e.g. an interaction type followed by a request) are not held back waiting for acks.
+  m_sock.set_option(tcp::no_delay(true));
 }
 
-//#################### PUBLIC MEMBER FUNCTIONS ####################
-
-MappingClient::RGBDFrameMessageQueue::PushHandler_Ptr MappingClient::begin_push_frame_message()
-{
-  return m_frameMessageQueue.begin_push();
-}
+//#################### DESTRUCTOR ####################
 
-ORUChar4Image_CPtr MappingClient::get_remote_image() const
+MappingClient::~MappingClient()
 {
-  AckMessage ackMsg;
-  InteractionTypeMessage interactionTypeMsg(IT_HASRENDEREDIMAGE);
-
-  boost::lock_guard<boost::mutex> lock(m_interactionMutex);
-
-  // Ask the server whether it has ever rendered an RGB-D image for this client.
-  if(m_stream.write(interactionTypeMsg.get_data_ptr(), interactionTypeMsg.get_size()))
+  if(m_messageSenderThread)
   {
-    SimpleMessage<bool> flag;
-    if(m_stream.read(flag.get_data_ptr(), flag.get_size()) && m_stream.write(ackMsg.get_data_ptr(), ackMsg.get_size()) && flag.extract_value())
+    // Tell the message sender to terminate, and push a dummy frame message onto the queue to wake it up if it's waiting for a frame.
+    // Note that the push cannot block, even if the pool empty strategy is PES_WAIT, since the pool can only be empty if the queue
+    // is non-empty, in which case the message sender isn't waiting and will pop a message (freeing up a pool element) shortly.
+    // We also wake it up in case it's waiting for a frame acknowledgement.
+    m_shouldTerminate = true;
+    begin_push_frame_message();
     {
-      // If it has, ask it to send across the RGB-D image it has rendered for this client.
-      interactionTypeMsg.set_value(IT_GETRENDEREDIMAGE);
-      if(m_stream.write(interactionTypeMsg.get_data_ptr(), interactionTypeMsg.get_size()))
-      {
-        // Read the compressed RGB-D frame it sends across.
-        CompressedRGBDFrameHeaderMessage headerMsg;
-        if(m_stream.read(headerMsg.get_data_ptr(), headerMsg.get_size()))
-        {
-          CompressedRGBDFrameMessage frameMsg(headerMsg);
-          if(m_stream.read(frameMsg.get_data_ptr(), frameMsg.get_size()))
-          {
-            // Send an acknowledgement that we've received the frame.
-            m_stream.write(ackMsg.get_data_ptr(), ackMsg.get_size());
-
-            // Uncompress the frame.
-            // FIXME: Avoid creating a new uncompressed frame every time.
-            const Vector2i rgbImageSize = headerMsg.extract_rgb_image_size();
-            const Vector2i depthImageSize = headerMsg.extract_depth_image_size();
-            RGBDFrameMessage uncompressedFrameMsg(rgbImageSize, depthImageSize);
-            m_frameCompressor->uncompress_rgbd_frame(frameMsg, uncompressedFrameMsg);
-
-            // Extract the colour image from the frame and use it to update the remote image for this client.
-            if(!m_remoteImage) m_remoteImage.reset(new ORUChar4Image(rgbImageSize, true, false));
-            m_remoteImage->ChangeDims(rgbImageSize);
-            uncompressedFrameMsg.extract_rgb_image(m_remoteImage.get());
-
-            return m_remoteImage;
-          }
-        }
-      }
+      boost::lock_guard<boost::mutex> lock(m_frameAckMutex);
+      m_frameAcked.notify_all();
     }
+    m_messageSenderThread->join();
   }
 
-  // If anything went wrong, return a blank image.
-  return ORUChar4Image_CPtr();
+  if(m_messageReceiverThread)
+  {
+    // Shut down the connection to wake up the message receiver (which will generally be blocked waiting for the server), and wait for it to terminate.
+    boost::system::error_code err;
+    m_sock.shutdown(tcp::socket::shutdown_both, err);
+    m_messageReceiverThread->join();
+  }
+}
+
+//#################### PUBLIC MEMBER FUNCTIONS ####################
+
+MappingClient::FrameMessagePushHandler_Ptr MappingClient::begin_push_frame_message()
+{
+  if(m_lockFreeFrameMessageQueue) return m_lockFreeFrameMessageQueue->begin_push();
+  else return m_frameMessageQueue->begin_push();
+}
+
+ORUChar4Image_CPtr MappingClient::get_remote_image() const
+{
+  boost::lock_guard<boost::mutex> lock(m_remoteImageMutex);
+  return m_remoteImage;
 }
 
 void MappingClient::send_calibration_message(const RGBDCalibrationMessage& msg)
 {
   bool connectionOk = true;
 
+  // Tell the server the size of our frame window, so that it can acknowledge frames often enough to stop the window filling up.
+  RGBDCalibrationMessage windowedMsg(msg);
+  windowedMsg.set_frame_window_size(static_cast<uint32_t>(m_frameWindowSize));
+
   // Send the message to the server.
-  connectionOk = connectionOk && m_stream.write(msg.get_data_ptr(), msg.get_size());
+  connectionOk = connectionOk && write_message(windowedMsg);
 
   // Wait for an acknowledgement (note that this is blocking, unless the connection fails).
   AckMessage ackMsg;
-  connectionOk = connectionOk && m_stream.read(ackMsg.get_data_ptr(), ackMsg.get_size());
+  connectionOk = connectionOk && read_message(ackMsg);
 
   // Throw if the message was not successfully sent and acknowledged.
   if(!connectionOk) throw std::runtime_error("Error: Failed to send calibration message");
@@ -101,18 +111,24 @@ void MappingClient::send_calibration_message(const RGBDCalibrationMessage& msg)
   const ITMLib::ITMRGBDCalib calib = msg.extract_calib();
   const Vector2i rgbImageSize = calib.intrinsics_rgb.imgSize;
   const Vector2i depthImageSize = calib.intrinsics_d.imgSize;
-  m_frameMessageQueue.initialise(capacity, boost::bind(&RGBDFrameMessage::make, rgbImageSize, depthImageSize));
+  const boost::function<RGBDFrameMessage_Ptr()> maker = boost::bind(&RGBDFrameMessage::make, rgbImageSize, depthImageSize);
+  if(m_lockFreeFrameMessageQueue) m_lockFreeFrameMessageQueue->initialise(capacity, maker);
+  else m_frameMessageQueue->initialise(capacity, maker);
 
-  // Set up the RGB-D frame compressor.
+  // Set up the RGB-D frame compressors (note that we need a separate one for the remote scene renderings, since these are uncompressed by the message receiver).
   m_frameCompressor.reset(new RGBDFrameCompressor(rgbImageSize, depthImageSize, msg.extract_rgb_compression_type(), msg.extract_depth_compression_type()));
+  m_remoteImageCompressor.reset(new RGBDFrameCompressor(rgbImageSize, Vector2i(1,1), msg.extract_rgb_compression_type(), msg.extract_depth_compression_type()));
+
+  // Ask the server to push the images it renders for us across as soon as they have been rendered.
+  if(!write_message(InteractionTypeMessage(IT_SUBSCRIBERENDEREDIMAGES))) throw std::runtime_error("Error: Failed to subscribe to rendered images");
 
-  // Start the message sender thread.
-  boost::thread messageSender(&MappingClient::run_message_sender, this);
+  // Start the message receiver and sender threads.
+  m_messageReceiverThread.reset(new boost::thread(&MappingClient::run_message_receiver, this));
+  m_messageSenderThread.reset(new boost::thread(&MappingClient::run_message_sender, this));
 }
 
 void MappingClient::update_rendering_request(const Vector2i& imgSize, const ORUtils::SE3Pose& pose, int visualisationType)
 {
-  AckMessage ackMsg;
   InteractionTypeMessage interactionTypeMsg(IT_UPDATERENDERINGREQUEST);
 
   RenderingRequestMessage requestMsg;
@@ -120,53 +136,197 @@ void MappingClient::update_rendering_request(const Vector2i& imgSize, const ORUt
   requestMsg.set_pose(pose);
   requestMsg.set_visualisation_type(visualisationType);
 
-  boost::lock_guard<boost::mutex> lock(m_interactionMutex);
-
-  // First send the interaction type message, then send the rendering request message,
-  // then wait for an acknowledgement from the server. We chain all of these with &&
-  // so as to early out in case of failure.
-  m_stream.write(interactionTypeMsg.get_data_ptr(), interactionTypeMsg.get_size()) &&
-  m_stream.write(requestMsg.get_data_ptr(), requestMsg.get_size()) && 
-  m_stream.read(ackMsg.get_data_ptr(), ackMsg.get_size());
+  // Send the interaction type message, followed by the rendering request message. Since we have subscribed to rendered images,
+  // the server does not acknowledge the request: it simply pushes the images it renders in response to it across when ready.
+  boost::lock_guard<boost::mutex> lock(m_writeMutex);
+  const Message *messages[] = { &interactionTypeMsg, &requestMsg };
+  write_messages(messages, sizeof(messages) / sizeof(const Message*));
 }
 
 //#################### PRIVATE MEMBER FUNCTIONS ####################
 
+RGBDFrameMessage_Ptr MappingClient::peek_frame_message()
+{
+  if(m_lockFreeFrameMessageQueue) return m_lockFreeFrameMessageQueue->peek();
+  else return m_frameMessageQueue->peek();
+}
+
+void MappingClient::pop_frame_message()
+{
+  if(m_lockFreeFrameMessageQueue) m_lockFreeFrameMessageQueue->pop();
+  else m_frameMessageQueue->pop();
+}
+
+void MappingClient::publish_remote_image(const CompressedRGBDFrameHeaderMessage& headerMsg, const CompressedRGBDFrameMessage& frameMsg, RGBDFrameMessage_Ptr& uncompressedFrameMsg)
+{
+  // Uncompress the rendering (which the server sends to us as the colour image of an RGB-D frame).
+  const Vector2i rgbImageSize = headerMsg.extract_rgb_image_size();
+  const Vector2i depthImageSize = headerMsg.extract_depth_image_size();
+  if(!uncompressedFrameMsg || uncompressedFrameMsg->get_rgb_image_size() != rgbImageSize || uncompressedFrameMsg->get_depth_image_size() != depthImageSize)
+  {
+    uncompressedFrameMsg.reset(new RGBDFrameMessage(rgbImageSize, depthImageSize));
+  }
+
+  // If the rendering can't be uncompressed (e.g. because its data is corrupt), drop it rather than letting the exception
+  // escape and terminate the receiver thread (the previous rendering, if any, remains the latest one).
+  try
+  {
+    m_remoteImageCompressor->uncompress_rgbd_frame(frameMsg, *uncompressedFrameMsg);
+  }
+  catch(std::exception& e)
+  {
+    std::cerr << "Warning: Could not uncompress a rendering from the mapping server: " << e.what() << '\n';
+    return;
+  }
+
+  // Extract the colour image into the back buffer. If the image that was last swapped out of the front buffer is
+  // still being used by the caller of get_remote_image, we can't overwrite it, so we make a new one instead.
+  if(!m_remoteImageBackBuffer || !m_remoteImageBackBuffer.unique()) m_remoteImageBackBuffer.reset(new ORUChar4Image(rgbImageSize, true, false));
+  m_remoteImageBackBuffer->ChangeDims(rgbImageSize);
+  uncompressedFrameMsg->extract_rgb_image(m_remoteImageBackBuffer.get());
+
+  // Make the new rendering the latest one (any older rendering that has not yet been retrieved is simply superseded).
+  boost::lock_guard<boost::mutex> lock(m_remoteImageMutex);
+  m_remoteImage.swap(m_remoteImageBackBuffer);
+}
+
+bool MappingClient::read_message(Message& msg)
+{
+  boost::system::error_code err;
+  boost::asio::read(m_sock, msg.get_mutable_buffers(), err);
+  return !err;
+}
+
+void MappingClient::run_message_receiver()
+{
+  ServerMessageTypeMessage messageTypeMsg;
+  FrameSequenceNumberMessage ackMsg;
+  CompressedRGBDFrameHeaderMessage headerMsg;
+  CompressedRGBDFrameMessage frameMsg(headerMsg);
+  RGBDFrameMessage_Ptr uncompressedFrameMsg;
+
+  bool connectionOk = true;
+
+  while(connectionOk && read_message(messageTypeMsg))
+  {
+    switch(messageTypeMsg.extract_value())
+    {
+      case SMT_FRAMEACK:
+      {
+        // Record the acknowledgement, and wake up the message sender in case it's waiting for room in the window.
+        if((connectionOk = read_message(ackMsg)))
+        {
+          boost::lock_guard<boost::mutex> lock(m_frameAckMutex);
+          m_lastAckedFrameSequenceNumber = ackMsg.extract_value();
+          m_frameAcked.notify_all();
+        }
+        break;
+      }
+      case SMT_RENDEREDIMAGE:
+      {
+        // Read the compressed rendering, and then uncompress it and make it the latest one.
+        connectionOk = read_message(headerMsg);
+        if(connectionOk)
+        {
+          frameMsg.set_compressed_image_sizes(headerMsg);
+          connectionOk = read_message(frameMsg);
+        }
+
+        if(connectionOk) publish_remote_image(headerMsg, frameMsg, uncompressedFrameMsg);
+        break;
+      }
+      default:
+      {
+        std::cerr << "Warning: Received a message of unknown type from the mapping server\n";
+        connectionOk = false;
+        break;
+      }
+    }
+  }
+
+  // If we get here, the connection has failed (or is being shut down), so make sure the message sender stops waiting for acknowledgements.
+  boost::lock_guard<boost::mutex> lock(m_frameAckMutex);
+  m_receiverConnectionOk = false;
+  m_frameAcked.notify_all();
+}
+
 void MappingClient::run_message_sender()
 {
-  AckMessage ackMsg;
   CompressedRGBDFrameHeaderMessage headerMsg;
   CompressedRGBDFrameMessage frameMsg(headerMsg);
-  InteractionTypeMessage interactionTypeMsg(IT_SENDFRAME);
+  InteractionTypeMessage interactionTypeMsg(IT_SENDFRAMEWINDOWED);
+  FrameSequenceNumberMessage sequenceNumberMsg;
 
   bool connectionOk = true;
 
   while(connectionOk)
   {
     // Read the first frame message from the queue (this will block until a message is available).
-    RGBDFrameMessage_Ptr msg = m_frameMessageQueue.peek();
+    RGBDFrameMessage_Ptr msg = peek_frame_message();
+
+    // If the client is being destroyed, stop sending frames. Note that we must still pop the message from the queue, since the
+    // destructor may be blocked trying to push a dummy message onto it (if the pool is empty, that can only succeed once we pop).
+    if(m_shouldTerminate)
+    {
+      pop_frame_message();
+      break;
+    }
 
     // Compress the frame. The compressed frame is split into two messages - a header message,
     // which tells the server how large a frame to expect, and a separate message containing
     // the actual frame data.
     m_frameCompressor->compress_rgbd_frame(*msg, headerMsg, frameMsg);
 
+    // If the window is full, wait until the message receiver has seen the server acknowledge enough frames for there to be room
+    // to send this one. Note that whilst we're waiting, we don't consume any more frames from the queue, which applies backpressure
+    // to the code pushing frames onto it.
+    const int32_t sequenceNumber = m_nextFrameSequenceNumber;
     {
-      boost::lock_guard<boost::mutex> lock(m_interactionMutex);
-
-      // First send the interaction type message, then send the frame header message, then send
-      // the frame message itself, then wait for an acknowledgement from the server. We chain
-      // all of these with && so as to early out in case of failure.
-      connectionOk = connectionOk
-        && m_stream.write(interactionTypeMsg.get_data_ptr(), interactionTypeMsg.get_size())
-        && m_stream.write(headerMsg.get_data_ptr(), headerMsg.get_size())
-        && m_stream.write(frameMsg.get_data_ptr(), frameMsg.get_size())
-        && m_stream.read(ackMsg.get_data_ptr(), ackMsg.get_size());
+      boost::unique_lock<boost::mutex> lock(m_frameAckMutex);
+      while(m_lastAckedFrameSequenceNumber < sequenceNumber - static_cast<int32_t>(m_frameWindowSize) && m_receiverConnectionOk && !m_shouldTerminate)
+      {
+        m_frameAcked.wait(lock);
+      }
+
+      connectionOk = m_receiverConnectionOk && !m_shouldTerminate;
     }
 
+    // Send the interaction type message, then the sequence number of the frame, then the frame header message, then
+    // the frame message itself (without waiting for an acknowledgement). We send all of these using a single gather-write,
+    // so that the compressed images (which the frame message borrows from the compressor) are never copied on the way out.
+    if(connectionOk)
+    {
+      boost::lock_guard<boost::mutex> lock(m_writeMutex);
+      sequenceNumberMsg.set_value(sequenceNumber);
+      const Message *messages[] = { &interactionTypeMsg, &sequenceNumberMsg, &headerMsg, &frameMsg };
+      connectionOk = write_messages(messages, sizeof(messages) / sizeof(const Message*));
+    }
+
+    ++m_nextFrameSequenceNumber;
+
     // Remove the frame message that we have just sent from the queue.
-    m_frameMessageQueue.pop();
+    pop_frame_message();
   }
 }
 
+bool MappingClient::write_message(const Message& msg)
+{
+  const Message *messages[] = { &msg };
+  return write_messages(messages, 1);
+}
+
+bool MappingClient::write_messages(const Message *const *messages, size_t messageCount)
+{
+  std::vector<boost::asio::const_buffer> buffers;
+  for(size_t i = 0; i < messageCount; ++i)
+  {
+    const std::vector<boost::asio::const_buffer> messageBuffers = messages[i]->get_const_buffers();
+    buffers.insert(buffers.end(), messageBuffers.begin(), messageBuffers.end());
+  }
+
+  boost::system::error_code err;
+  boost::asio::write(m_sock, buffers, err);
+  return !err;
+}
+
 }
@@ -5,31 +5,47 @@
 
 #include "remotemapping/MappingClientHandler.h"
 
+#include <tvgutil/misc/TaskScheduler.h>
 #include <tvgutil/net/AckMessage.h>
 using namespace tvgutil;
 
-#ifdef WITH_OPENCV
-#include "ocv/OpenCVUtil.h"
-#endif
-
+#include "remotemapping/FrameSequenceNumberMessage.h"
 #include "remotemapping/InteractionTypeMessage.h"
 #include "remotemapping/RenderingRequestMessage.h"
 #include "remotemapping/RGBDCalibrationMessage.h"
+#include "remotemapping/ServerMessageTypeMessage.h"
 
 //#define DEBUGGING 1
 
 namespace itmx {
 
+//#################### LOCAL CONSTANTS ####################
+
+/**
+ * The interval at which the ingest pipeline re-checks conditions that are not signalled by the pipeline itself (i.e. whether
+ * the server has made space on the frame message queue, and whether the server is terminating) whilst it is waiting.
+ */
+static const boost::chrono::milliseconds INGEST_POLL_INTERVAL(5);
+
 //#################### CONSTRUCTORS ####################
 
 MappingClientHandler::MappingClientHandler(int clientID, const boost::shared_ptr<boost::asio::ip::tcp::socket>& sock,
                                            const boost::shared_ptr<const boost::atomic<bool> >& shouldTerminate)
 : ClientHandler(clientID, sock, shouldTerminate),
+  m_activeDecoderCount(0),
+  m_frameDecoderCount(0),
   m_frameMessageQueue(new RGBDFrameMessageQueue(tvgutil::pooled_queue::PES_DISCARD)),
   m_imagesDirty(false),
-  m_poseDirty(false)
+  m_maxUnacknowledgedFrameCount(1),
+  m_nextFrameToPublish(0),
+  m_nextFrameToReceive(0),
+  m_poseDirty(false),
+  m_renderedImagePending(false),
+  m_shouldStopPublishingFrames(false),
+  m_shouldStopPushingRenderedImages(false),
+  m_unacknowledgedFrameCount(0)
 {
-  m_frameMessage.reset(new CompressedRGBDFrameMessage(m_headerMessage));
+  m_renderingResponseFrameMessage.reset(new CompressedRGBDFrameMessage(m_renderingResponseHeaderMessage));
 }
 
 //#################### PUBLIC MEMBER FUNCTIONS ####################
@@ -49,6 +65,12 @@ const MappingClientHandler::RGBDFrameMessageQueue_Ptr& MappingClientHandler::get
   return m_frameMessageQueue;
 }
 
+MappingClientHandler::IngestCounters MappingClientHandler::get_ingest_counters() const
+{
+  boost::lock_guard<boost::mutex> lock(m_ingestMutex);
+  return m_ingestCounters;
+}
+
 ExclusiveHandle_Ptr<ORUChar4Image_Ptr>::Type MappingClientHandler::get_rendered_image()
 {
   return make_exclusive_handle(m_renderedImage, m_renderedImageMutex);
@@ -74,6 +96,13 @@ bool MappingClientHandler::images_dirty() const
   return m_imagesDirty;
 }
 
+void MappingClientHandler::notify_rendered_image()
+{
+  boost::lock_guard<boost::mutex> lock(m_renderedImagePusherMutex);
+  m_renderedImagePending = true;
+  m_renderedImageNotified.notify_one();
+}
+
 bool MappingClientHandler::pose_dirty() const
 {
   return m_poseDirty;
@@ -87,8 +116,24 @@ void MappingClientHandler::run_iter()
   // First, try to read an interaction type message.
   if((m_connectionOk = read_message(interactionTypeMsg)))
   {
-    // If that succeeds, determine the type of interaction the client wants to have with the server and proceed accordingly.
-    switch(interactionTypeMsg.extract_value())
+    const InteractionType interactionType = interactionTypeMsg.extract_value();
+
+    // If the client wants to do anything other than send another frame via the windowed frame transport, first acknowledge any
+    // frames that it has sent via that transport that have not yet been acknowledged (the client expects such acknowledgements
+    // to precede our response to the interaction).
+    if(interactionType != IT_SENDFRAMEWINDOWED && !(m_connectionOk = write_pending_frame_ack())) return;
+
+    // Once the client has subscribed to rendered images, everything we send it must be tagged with its type, so it can no longer
+    // have any of the interactions that expect an untagged response.
+    if(m_renderedImagePusherThread && interactionType != IT_SENDFRAMEWINDOWED && interactionType != IT_UPDATERENDERINGREQUEST)
+    {
+      std::cerr << "Warning: Client " << m_clientID << " attempted an unsupported interaction after subscribing to rendered images\n";
+      m_connectionOk = false;
+      return;
+    }
+
+    // Determine the type of interaction the client wants to have with the server and proceed accordingly.
+    switch(interactionType)
     {
       case IT_GETRENDEREDIMAGE:
       {
@@ -96,32 +141,17 @@ void MappingClientHandler::run_iter()
         std::cout << "Receiving get rendered image request from client" << std::endl;
 #endif
 
-        // Try to grab the rendered image to send across to the client, locking the associated mutex for the duration of the process.
-        // If no image has been rendered for the client, early out.
-        ExclusiveHandle_Ptr<ORUChar4Image_Ptr>::Type imageHandle = get_rendered_image();
-        if(!imageHandle->get())
+        // Try to compress the rendered image to send across to the client. If no image has been rendered for the client, early out.
+        if(!compress_rendered_image())
         {
           std::cerr << "Warning: Client " << m_clientID << " attempted to read a non-existent server-rendered image and is probably deadlocked.\n";
           m_connectionOk = false;
           break;
         }
 
-        // Prepare the rendering response message (we reuse an uncompressed RGB-D frame for this to avoid creating a new message type).
-        if(!m_renderingResponseMessage || m_renderingResponseMessage->get_rgb_image_size() != imageHandle->get()->noDims)
-        {
-          m_renderingResponseMessage.reset(new RGBDFrameMessage(imageHandle->get()->noDims, Vector2i(1,1)));
-        }
-
-        m_renderingResponseMessage->set_frame_index(-1);
-        m_renderingResponseMessage->set_rgb_image(imageHandle->get());
-
-        // Compress the rendering response message for transmission over the network.
-        // FIXME: Consider using a separate frame compressor for rendering responses (to avoid continually resizing this one's internal images).
-        m_frameCompressor->compress_rgbd_frame(*m_renderingResponseMessage, m_headerMessage, *m_frameMessage);
-
         // Send the rendering response to the client, and wait for an acknowledgement before proceeding.
         AckMessage ackMsg;
-        m_connectionOk = m_connectionOk && write_message(m_headerMessage) && write_message(*m_frameMessage) && read_message(ackMsg);
+        m_connectionOk = write_message(m_renderingResponseHeaderMessage) && write_message(*m_renderingResponseFrameMessage) && read_message(ackMsg);
 
         break;
       }
@@ -138,39 +168,48 @@ void MappingClientHandler::run_iter()
         std::cout << "Receiving frame from client" << std::endl;
 #endif
 
-        // Try to read a frame header message.
-        if((m_connectionOk = read_message(m_headerMessage)))
-        {
-          // If that succeeds, set up the frame message accordingly.
-          m_frameMessage->set_compressed_image_sizes(m_headerMessage);
-
-          // Now, read the frame message itself.
-          if((m_connectionOk = read_message(*m_frameMessage)))
-          {
-            // If that succeeds, uncompress the images, store them on the frame message queue and send an acknowledgement to the client.
+        // Try to read the frame, and send an acknowledgement to the client if that succeeds.
+        m_connectionOk = read_frame() && write_message(AckMessage());
+        break;
+      }
+      case IT_SENDFRAMEWINDOWED:
+      {
 #if DEBUGGING
-            std::cout << "Message queue size (" << m_clientID << "): " << m_frameMessageQueue->size() << std::endl;
+        std::cout << "Receiving windowed frame from client" << std::endl;
 #endif
 
-            RGBDFrameMessageQueue::PushHandler_Ptr pushHandler = m_frameMessageQueue->begin_push();
-            boost::optional<RGBDFrameMessage_Ptr&> elt = pushHandler->get();
-            RGBDFrameMessage& msg = elt ? **elt : *m_dummyFrameMessage;
-            m_frameCompressor->uncompress_rgbd_frame(*m_frameMessage, msg);
-
-            m_connectionOk = write_message(AckMessage());
+        // Try to read the sequence number of the frame, followed by the frame itself.
+        FrameSequenceNumberMessage sequenceNumberMsg;
+        if((m_connectionOk = read_message(sequenceNumberMsg) && read_frame()))
+        {
+          m_pendingFrameAck = sequenceNumberMsg.extract_value();
+          ++m_unacknowledgedFrameCount;
+
+          // Since acknowledgements are cumulative, there's no point acknowledging the frame if the client has already sent us
+          // more data (the next frame's acknowledgement would supersede it). In that case, we defer the acknowledgement until
+          // we've finished reading the data that is available (the client doesn't wait for it unless its window is full).
+          // However, a client that streams continuously may always have more data in flight, so we still acknowledge the
+          // frames regularly, to keep the client's window from filling up and stalling it.
+          boost::system::error_code err;
+          if(m_sock->available(err) == 0 || err || m_unacknowledgedFrameCount >= m_maxUnacknowledgedFrameCount)
+          {
+            m_connectionOk = write_pending_frame_ack();
+          }
+        }
 
+        break;
+      }
+      case IT_SUBSCRIBERENDEREDIMAGES:
+      {
 #if DEBUGGING
-            std::cout << "Got message: " << msg.extract_frame_index() << std::endl;
-
-          #ifdef WITH_OPENCV
-            static ORUChar4Image_Ptr rgbImage(new ORUChar4Image(get_rgb_image_size(), true, false));
-            msg.extract_rgb_image(rgbImage.get());
-            cv::Mat3b cvRGB = OpenCVUtil::make_rgb_image(rgbImage->GetData(MEMORYDEVICE_CPU), rgbImage->noDims.x, rgbImage->noDims.y);
-            cv::imshow("RGB", cvRGB);
-            cv::waitKey(1);
-          #endif
+        std::cout << "Receiving rendered image subscription from client" << std::endl;
 #endif
-          }
+
+        // Start pushing rendered images across to the client. If an image has already been rendered for the client, push it straight away.
+        if(!m_renderedImagePusherThread)
+        {
+          if(m_renderedImage) notify_rendered_image();
+          m_renderedImagePusherThread.reset(new boost::thread(&MappingClientHandler::run_rendered_image_pusher, this));
         }
 
         break;
@@ -184,10 +223,15 @@ void MappingClientHandler::run_iter()
         // Try to read a rendering request message.
         if((m_connectionOk = read_message(renderingRequestMsg)))
         {
-          // If that succeeds, store the request so that it can be picked up by the renderer, and send an acknowledgement to the client.
-          ExclusiveHandle_Ptr<boost::optional<RenderingRequestMessage> >::Type requestHandle = get_rendering_request();
-          requestHandle->get() = renderingRequestMsg;
-          m_connectionOk = write_message(AckMessage());
+          // If that succeeds, store the request so that it can be picked up by the renderer.
+          {
+            ExclusiveHandle_Ptr<boost::optional<RenderingRequestMessage> >::Type requestHandle = get_rendering_request();
+            requestHandle->get() = renderingRequestMsg;
+          }
+
+          // If the client has not subscribed to rendered images, also send it an acknowledgement (a subscribed client
+          // doesn't wait for one, since the rendered images will be pushed across to it when they are ready).
+          if(!m_renderedImagePusherThread) m_connectionOk = write_message(AckMessage());
         }
 
         break;
@@ -202,8 +246,52 @@ void MappingClientHandler::run_iter()
 
 void MappingClientHandler::run_post()
 {
-  // Destroy the frame compressor prior to stopping the client handler (this cleanly deallocates CUDA memory and avoids a crash on exit).
-  m_frameCompressor.reset();
+  // If we've been pushing rendered images across to the client, stop. Note that we close the socket first (on an I/O thread),
+  // to abort any write the pusher is making (since the client may no longer be reading what we send it).
+  if(m_renderedImagePusherThread)
+  {
+    post_close_socket();
+
+    {
+      boost::lock_guard<boost::mutex> lock(m_renderedImagePusherMutex);
+      m_shouldStopPushingRenderedImages = true;
+      m_renderedImageNotified.notify_one();
+    }
+
+    m_renderedImagePusherThread->join();
+  }
+
+  // Wait for any frames that are still being decoded (the decode tasks refer to the handler, so it must outlive them).
+  {
+    boost::unique_lock<boost::mutex> lock(m_ingestMutex);
+    while(m_activeDecoderCount > 0) m_ingestProgressed.wait(lock);
+  }
+
+  // Stop the frame publisher. It publishes any remaining frames for which there is space on the frame message queue first,
+  // but it doesn't wait for the server to make space for the others, since the server may no longer be consuming them.
+  if(m_framePublisherThread)
+  {
+    {
+      boost::lock_guard<boost::mutex> lock(m_ingestMutex);
+      m_shouldStopPublishingFrames = true;
+      m_ingestProgressed.notify_all();
+    }
+
+    m_framePublisherThread->join();
+
+    // Count any frames that could not be published as dropped, and report them.
+    boost::lock_guard<boost::mutex> lock(m_ingestMutex);
+    m_ingestCounters.m_droppedFrameCount += m_nextFrameToReceive - m_nextFrameToPublish;
+    if(m_ingestCounters.m_droppedFrameCount > 0)
+    {
+      std::cerr << "Warning: Dropped the last " << m_ingestCounters.m_droppedFrameCount << " frames received from client " << m_clientID
+                << " because its frame message queue was full when it disconnected\n";
+    }
+  }
+
+  // Destroy the frame compressors prior to stopping the client handler (this cleanly deallocates CUDA memory and avoids a crash on exit).
+  m_frameDecoders.clear();
+  m_renderingResponseCompressor.reset();
 }
 
 void MappingClientHandler::run_pre()
@@ -221,17 +309,42 @@ void MappingClientHandler::run_pre()
     // Save the calibration parameters.
     m_calib = calibMsg.extract_calib();
 
+    // Acknowledge frames sent via the windowed frame transport once half of the client's window has been used, so that the
+    // window never fills up whilst the client is streaming (a client with a window of one frame gets every frame acknowledged).
+    m_maxUnacknowledgedFrameCount = std::max<size_t>(calibMsg.extract_frame_window_size() / 2, 1);
+
     // Initialise the frame message queue.
     const size_t capacity = 5;
     const Vector2i& rgbImageSize = get_rgb_image_size();
     const Vector2i& depthImageSize = get_depth_image_size();
     m_frameMessageQueue->initialise(capacity, boost::bind(&RGBDFrameMessage::make, rgbImageSize, depthImageSize));
 
-    // Set up the frame compressor.
-    m_frameCompressor.reset(new RGBDFrameCompressor(rgbImageSize, depthImageSize, calibMsg.extract_rgb_compression_type(), calibMsg.extract_depth_compression_type()));
+    // Set up the frame decoders. Frames can generally be decoded in parallel, each using its own frame compressor, but if the depth images
+    // are coded relative to the previous frame, they must instead be decoded one at a time, in order, using the same frame compressor.
+    const size_t ingestSlotCount = 8;
+    const DepthCompressionType depthCompressionType = calibMsg.extract_depth_compression_type();
+    const RGBCompressionType rgbCompressionType = calibMsg.extract_rgb_compression_type();
+    m_frameDecoderCount = depthCompressionType == DEPTH_COMPRESSION_PREDICTIVE_TEMPORAL ? 1 : std::min(TaskScheduler::instance().thread_count(), ingestSlotCount);
+    for(size_t i = 0; i < m_frameDecoderCount; ++i)
+    {
+      m_frameDecoders.push_back(RGBDFrameCompressor_Ptr(new RGBDFrameCompressor(rgbImageSize, depthImageSize, rgbCompressionType, depthCompressionType)));
+    }
+
+    // Set up the ingest slots.
+    for(size_t i = 0; i < ingestSlotCount; ++i)
+    {
+      IngestSlot_Ptr slot(new IngestSlot);
+      slot->m_decoded = slot->m_decodeSucceeded = false;
+      slot->m_decodedFrameMessage.reset(new RGBDFrameMessage(rgbImageSize, depthImageSize));
+      slot->m_frameMessage.reset(new CompressedRGBDFrameMessage(slot->m_headerMessage));
+      m_ingestSlots.push_back(slot);
+    }
+
+    // Start the frame publisher.
+    m_framePublisherThread.reset(new boost::thread(&MappingClientHandler::run_frame_publisher, this));
 
-    // Construct a dummy frame message to consume messages that cannot be pushed onto the queue.
-    m_dummyFrameMessage.reset(new RGBDFrameMessage(rgbImageSize, depthImageSize));
+    // Set up a separate frame compressor for the rendered images, so that they can be compressed in parallel with the frames being decoded.
+    m_renderingResponseCompressor.reset(new RGBDFrameCompressor(rgbImageSize, Vector2i(1,1), rgbCompressionType, depthCompressionType));
 
     // Signal to the client that the server is ready.
     m_connectionOk = write_message(AckMessage());
@@ -253,4 +366,206 @@ void MappingClientHandler::set_scene_id(const std::string& sceneID)
   m_sceneID = sceneID;
 }
 
+//#################### PRIVATE MEMBER FUNCTIONS ####################
+
+bool MappingClientHandler::compress_rendered_image()
+{
+  {
+    // Try to grab the rendered image, locking the associated mutex whilst we copy it. If no image has been rendered for the client, early out.
+    ExclusiveHandle_Ptr<ORUChar4Image_Ptr>::Type imageHandle = get_rendered_image();
+    const ORUChar4Image_Ptr& image = imageHandle->get();
+    if(!image) return false;
+
+    // Prepare the rendering response message (we reuse an uncompressed RGB-D frame for this to avoid creating a new message type).
+    if(!m_renderingResponseMessage || m_renderingResponseMessage->get_rgb_image_size() != image->noDims)
+    {
+      m_renderingResponseMessage.reset(new RGBDFrameMessage(image->noDims, Vector2i(1,1)));
+    }
+
+    m_renderingResponseMessage->set_frame_index(-1);
+    m_renderingResponseMessage->set_rgb_image(image);
+  }
+
+  // Compress the rendering response message for transmission over the network (we do this after releasing the rendered image, so as not to block the renderer).
+  m_renderingResponseCompressor->compress_rgbd_frame(*m_renderingResponseMessage, m_renderingResponseHeaderMessage, *m_renderingResponseFrameMessage);
+  return true;
+}
+
+bool MappingClientHandler::read_frame()
+{
+  // Wait until there is a free ingest slot into which to read the frame. Note that whilst we're waiting, we don't read anything from the
+  // client, so if the decode stage or the server can't keep up, backpressure is applied to the client rather than frames being dropped.
+  IngestSlot *slot = NULL;
+  {
+    boost::unique_lock<boost::mutex> lock(m_ingestMutex);
+    while(m_nextFrameToReceive - m_nextFrameToPublish >= m_ingestSlots.size())
+    {
+      // If the server is terminating, it may have stopped consuming frames, in which case no slot will ever be freed, so give up.
+      if(*m_shouldTerminate) return false;
+      m_ingestProgressed.wait_for(lock, INGEST_POLL_INTERVAL);
+    }
+    slot = m_ingestSlots[m_nextFrameToReceive % m_ingestSlots.size()].get();
+  }
+
+  // Try to read a frame header message.
+  if(!read_message(slot->m_headerMessage)) return false;
+
+  // If that succeeds, set up the frame message accordingly.
+  slot->m_frameMessage->set_compressed_image_sizes(slot->m_headerMessage);
+
+  // Now, read the frame message itself.
+  if(!read_message(*slot->m_frameMessage)) return false;
+
+  // If that succeeds, hand the frame over to the decode stage, starting a new decode task if fewer than the maximum number are running.
+  boost::lock_guard<boost::mutex> lock(m_ingestMutex);
+  ++m_ingestCounters.m_receivedFrameCount;
+  m_decodeQueue.push_back(m_nextFrameToReceive++);
+
+  if(m_activeDecoderCount < m_frameDecoderCount)
+  {
+    ++m_activeDecoderCount;
+    TaskScheduler::instance().submit(boost::bind(&MappingClientHandler::run_frame_decoder, this));
+  }
+
+  return true;
+}
+
+void MappingClientHandler::run_frame_decoder()
+{
+  for(;;)
+  {
+    // Get the next frame to decode and a frame compressor with which to decode it. If there are no frames left to decode, stop.
+    size_t frameNumber;
+    RGBDFrameCompressor_Ptr decoder;
+    {
+      boost::lock_guard<boost::mutex> lock(m_ingestMutex);
+      if(m_decodeQueue.empty())
+      {
+        --m_activeDecoderCount;
+        m_ingestProgressed.notify_all();
+        return;
+      }
+
+      frameNumber = m_decodeQueue.front();
+      m_decodeQueue.pop_front();
+      decoder = m_frameDecoders.back();
+      m_frameDecoders.pop_back();
+    }
+
+    // Decode the frame. Note that the slot can safely be accessed without holding the mutex, since nothing else touches it until it's marked as decoded.
+    IngestSlot& slot = *m_ingestSlots[frameNumber % m_ingestSlots.size()];
+    bool decodeSucceeded = true;
+    try
+    {
+      decoder->uncompress_rgbd_frame(*slot.m_frameMessage, *slot.m_decodedFrameMessage);
+    }
+    catch(std::exception& e)
+    {
+      std::cerr << "Warning: Could not decode a frame from client " << m_clientID << ": " << e.what() << '\n';
+      decodeSucceeded = false;
+    }
+
+#if DEBUGGING
+    std::cout << "Got message: " << slot.m_decodedFrameMessage->extract_frame_index() << std::endl;
+#endif
+
+    // Mark the frame as decoded, return the frame compressor, and wake up the frame publisher in case it's waiting for the frame.
+    boost::lock_guard<boost::mutex> lock(m_ingestMutex);
+    if(decodeSucceeded) ++m_ingestCounters.m_decodedFrameCount;
+    slot.m_decoded = true;
+    slot.m_decodeSucceeded = decodeSucceeded;
+    m_frameDecoders.push_back(decoder);
+    m_ingestProgressed.notify_all();
+  }
+}
+
+void MappingClientHandler::run_frame_publisher()
+{
+  boost::unique_lock<boost::mutex> lock(m_ingestMutex);
+  for(;;)
+  {
+    // Wait until the next frame to publish has been decoded (the frames must be published in order), or until we're told to stop.
+    // Note that when we're told to stop, all of the frames that have been received have already been decoded.
+    IngestSlot *slot = NULL;
+    for(;;)
+    {
+      if(m_nextFrameToPublish < m_nextFrameToReceive)
+      {
+        slot = m_ingestSlots[m_nextFrameToPublish % m_ingestSlots.size()].get();
+        if(slot->m_decoded) break;
+      }
+
+      if(m_shouldStopPublishingFrames) return;
+      m_ingestProgressed.wait(lock);
+    }
+
+    if(slot->m_decodeSucceeded)
+    {
+      // Try to push the frame onto the frame message queue. Rather than copying it, we swap it with the queue element (which
+      // is a frame message of the same size), leaving the slot with a frame message it can decode the next frame into.
+      RGBDFrameMessageQueue::PushHandler_Ptr pushHandler = m_frameMessageQueue->begin_push();
+      boost::optional<RGBDFrameMessage_Ptr&> elt = pushHandler->get();
+
+      // If the queue is full, keep the frame in its slot and try again shortly. The slot stays in use until the frame
+      // has been published, so if the server falls behind, the ingest slots fill up and the client thread stops
+      // reading from the client, applying backpressure to it.
+      if(!elt)
+      {
+        if(m_shouldStopPublishingFrames) return;
+        m_ingestProgressed.wait_for(lock, INGEST_POLL_INTERVAL);
+        continue;
+      }
+
+      elt->swap(slot->m_decodedFrameMessage);
+    }
+    else ++m_ingestCounters.m_discardedFrameCount;
+
+#if DEBUGGING
+    std::cout << "Message queue size (" << m_clientID << "): " << m_frameMessageQueue->size() << std::endl;
+#endif
+
+    // Free the slot, and wake up the client thread in case it's waiting for one.
+    slot->m_decoded = false;
+    ++m_nextFrameToPublish;
+    m_ingestProgressed.notify_all();
+  }
+}
+
+void MappingClientHandler::run_rendered_image_pusher()
+{
+  const ServerMessageTypeMessage messageTypeMsg(SMT_RENDEREDIMAGE);
+
+  for(;;)
+  {
+    // Wait until a new image has been rendered for the client (or until we're told to stop). Any further images that are
+    // rendered whilst we're sending this one just set the pending flag again, so only the most recent of them gets sent.
+    {
+      boost::unique_lock<boost::mutex> lock(m_renderedImagePusherMutex);
+      while(!m_renderedImagePending && !m_shouldStopPushingRenderedImages) m_renderedImageNotified.wait(lock);
+      if(m_shouldStopPushingRenderedImages) return;
+      m_renderedImagePending = false;
+    }
+
+    // Compress the latest rendered image, and push it across to the client. If the connection fails, stop.
+    if(!compress_rendered_image()) continue;
+
+    boost::lock_guard<boost::mutex> lock(m_writeMutex);
+    if(!(write_message(messageTypeMsg) && write_message(m_renderingResponseHeaderMessage) && write_message(*m_renderingResponseFrameMessage))) return;
+  }
+}
+
+bool MappingClientHandler::write_pending_frame_ack()
+{
+  if(!m_pendingFrameAck) return true;
+
+  const int32_t sequenceNumber = *m_pendingFrameAck;
+  m_pendingFrameAck.reset();
+  m_unacknowledgedFrameCount = 0;
+
+  // If the client has subscribed to rendered images, the acknowledgement must be tagged with its type (and must not be interleaved with a rendered image).
+  boost::lock_guard<boost::mutex> lock(m_writeMutex);
+  if(m_renderedImagePusherThread && !write_message(ServerMessageTypeMessage(SMT_FRAMEACK))) return false;
+  return write_message(FrameSequenceNumberMessage(sequenceNumber));
+}
+
 }
@@ -67,6 +67,12 @@ void MappingServer::get_images(int clientID, ORUChar4Image *rgb, ORShortImage *r
   clientHandler->set_images_dirty(true);
 }
 
+MappingClientHandler::IngestCounters MappingServer::get_ingest_counters(int clientID) const
+{
+  ClientHandler_Ptr clientHandler = get_client_handler(clientID);
+  return clientHandler ? clientHandler->get_ingest_counters() : MappingClientHandler::IngestCounters();
+}
+
 void MappingServer::get_pose(int clientID, ORUtils::SE3Pose& pose)
 {
   // Look up the handler for the client whose pose we want to get. If the client is no longer active, early out.
@@ -143,6 +149,12 @@ bool MappingServer::has_more_images(int clientID) const
   return !has_finished(clientID);
 }
 
+void MappingServer::notify_rendered_image(int clientID) const
+{
+  ClientHandler_Ptr clientHandler = get_client_handler(clientID);
+  if(clientHandler) clientHandler->notify_rendered_image();
+}
+
 void MappingServer::set_scene_id(int clientID, const std::string& sceneID)
 {
   ClientHandler_Ptr clientHandler = get_client_handler(clientID);
@@ -0,0 +1,406 @@
+/**
+ * itmx: PredictiveDepthCodec.cpp
+ * Copyright (c) Torr Vision Group, University of Oxford, 2019. All rights reserved.
+ */
+
+#include "remotemapping/PredictiveDepthCodec.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace itmx {
+
+//#################### LOCAL CONSTANTS ####################
+
+/** The number of contexts used by the adaptive Golomb-Rice coder. */
+static const int CONTEXT_COUNT = 4;
+
+/** The number of bits used to store a mapped residual that is too large to be Golomb-Rice coded. */
+static const int ESCAPE_BITS = 18;
+
+/** The largest Golomb-Rice parameter that will be used. */
+static const int MAX_RICE_PARAMETER = 16;
+
+/** The length of the unary prefix that signals an escaped residual (shorter prefixes are ordinary Golomb-Rice codes). */
+static const uint32_t MAX_UNARY_LENGTH = 32;
+
+/** The values that can be stored in the first byte of a compressed image to specify how it was coded. */
+enum CodingMode
+{
+  /** The image itself was coded. */
+  CM_SPATIAL = 0,
+
+  /** The difference between the image and the reference image was coded. */
+  CM_TEMPORAL = 1
+};
+
+//#################### LOCAL TYPES ####################
+
+/**
+ * \brief An instance of this class can be used to write a stream of bits (most significant bit first) to a byte buffer.
+ */
+class BitWriter
+{
+private:
+  uint64_t m_acc;
+  int m_bits;
+  std::vector<uint8_t>& m_bytes;
+
+public:
+  explicit BitWriter(std::vector<uint8_t>& bytes)
+  : m_acc(0), m_bits(0), m_bytes(bytes)
+  {}
+
+public:
+  void flush()
+  {
+    if(m_bits > 0) m_bytes.push_back(static_cast<uint8_t>(m_acc << (8 - m_bits)));
+    m_bits = 0;
+  }
+
+  void put(uint32_t value, int n)
+  {
+    // Note: Only the low m_bits bits of the accumulator are ever needed, so it doesn't matter if older bits get shifted out of the top.
+    m_acc = (m_acc << n) | value;
+    m_bits += n;
+    while(m_bits >= 8)
+    {
+      m_bits -= 8;
+      m_bytes.push_back(static_cast<uint8_t>(m_acc >> m_bits));
+    }
+  }
+};
+
+/**
+ * \brief An instance of this class can be used to read a stream of bits (most significant bit first) from a byte buffer.
+ *
+ * Reading past the end of the buffer yields zero bits; the caller can detect this afterwards using overrun().
+ */
+class BitReader
+{
+private:
+  uint64_t m_acc;
+  int m_bits;
+  size_t m_byteCount;
+  const uint8_t *m_bytes;
+  size_t m_pos;
+
+public:
+  BitReader(const uint8_t *bytes, size_t byteCount)
+  : m_acc(0), m_bits(0), m_byteCount(byteCount), m_bytes(bytes), m_pos(0)
+  {}
+
+public:
+  uint32_t get(int n)
+  {
+    const uint32_t result = peek(n);
+    m_bits -= n;
+    return result;
+  }
+
+  bool overrun() const
+  {
+    return m_pos * 8 - m_bits > m_byteCount * 8;
+  }
+
+  uint32_t peek(int n)
+  {
+    if(n == 0) return 0;
+    if(m_bits < n)
+    {
+      while(m_bits <= 56)
+      {
+        m_acc = (m_acc << 8) | (m_pos < m_byteCount ? m_bytes[m_pos] : 0);
+        m_bits += 8;
+        ++m_pos;
+      }
+    }
+
+    const uint32_t mask = n == 32 ? 0xFFFFFFFFu : (1u << n) - 1;
+    return static_cast<uint32_t>(m_acc >> (m_bits - n)) & mask;
+  }
+
+  void skip(int n)
+  {
+    m_bits -= n;
+  }
+};
+
+/**
+ * \brief An instance of this struct holds the adaptive state of a single context of the Golomb-Rice coder.
+ */
+struct RiceContext
+{
+  /** The sum of the (recent) mapped residuals coded in the context. */
+  uint32_t m_sum;
+
+  /** The number of (recent) mapped residuals coded in the context. */
+  uint32_t m_count;
+
+  RiceContext()
+  : m_sum(4), m_count(1)
+  {}
+
+  /**
+   * \brief Gets the Golomb-Rice parameter to use for the next residual (the smallest k such that count * 2^k >= sum, as in LOCO-I).
+   */
+  int parameter() const
+  {
+    int k = 0;
+    while((m_count << k) < m_sum && k < MAX_RICE_PARAMETER) ++k;
+    return k;
+  }
+
+  /**
+   * \brief Updates the context after coding the specified mapped residual (the statistics are periodically halved so as to adapt to local changes).
+   */
+  void update(uint32_t mappedResidual)
+  {
+    m_sum += mappedResidual;
+    if(++m_count == 64)
+    {
+      m_sum >>= 1;
+      m_count >>= 1;
+    }
+  }
+};
+
+/**
+ * \brief An instance of this struct provides access to the signal coded in spatial mode (the depth image itself).
+ */
+struct SpatialSignal
+{
+  const short *m_depth;
+
+  explicit SpatialSignal(const short *depth)
+  : m_depth(depth)
+  {}
+
+  int operator()(int i) const
+  {
+    return m_depth[i];
+  }
+};
+
+/**
+ * \brief An instance of this struct provides access to the signal coded in temporal mode (the difference between the depth image and the reference).
+ */
+struct TemporalSignal
+{
+  const short *m_depth;
+  const short *m_reference;
+
+  TemporalSignal(const short *depth, const short *reference)
+  : m_depth(depth), m_reference(reference)
+  {}
+
+  int operator()(int i) const
+  {
+    return m_depth[i] - m_reference[i];
+  }
+};
+
+//#################### LOCAL FUNCTIONS ####################
+
+/**
+ * \brief Gets the context to use for a pixel, based on the local gradient around it.
+ */
+inline int context_of(int a, int b, int c)
+{
+  const int gradient = abs(a - c) + abs(b - c);
+  return gradient == 0 ? 0 : gradient < 8 ? 1 : gradient < 64 ? 2 : 3;
+}
+
+/**
+ * \brief Gets the causal neighbours (left, above and above-left) of the specified pixel in a signal.
+ *
+ * Note: Neighbours outside the image are replaced with ones inside it, so that no special cases are needed elsewhere.
+ */
+template <typename Signal>
+inline void get_neighbours(const Signal& s, int x, int y, int width, int& a, int& b, int& c)
+{
+  const int i = y * width + x;
+  if(y == 0)
+  {
+    a = x > 0 ? s(i - 1) : 0;
+    b = c = a;
+  }
+  else if(x == 0)
+  {
+    b = s(i - width);
+    a = c = b;
+  }
+  else
+  {
+    a = s(i - 1);
+    b = s(i - width);
+    c = s(i - width - 1);
+  }
+}
+
+/**
+ * \brief Predicts the value of a pixel from its causal neighbours using the median edge detector (MED) predictor.
+ */
+inline int predict(int a, int b, int c)
+{
+  if(c >= std::max(a, b)) return std::min(a, b);
+  else if(c <= std::min(a, b)) return std::max(a, b);
+  else return a + b - c;
+}
+
+/**
+ * \brief Estimates the cost of coding a signal, by summing the absolute prediction residuals over a subset of its rows.
+ */
+template <typename Signal>
+uint64_t estimate_cost(const Signal& s, int width, int height)
+{
+  uint64_t cost = 0;
+  for(int y = 0; y < height; y += 4)
+  {
+    for(int x = 0; x < width; ++x)
+    {
+      int a, b, c;
+      get_neighbours(s, x, y, width, a, b, c);
+      cost += abs(s(y * width + x) - predict(a, b, c));
+    }
+  }
+  return cost;
+}
+
+/**
+ * \brief Codes a signal.
+ */
+template <typename Signal>
+void encode_signal(const Signal& s, int width, int height, BitWriter& writer)
+{
+  RiceContext contexts[CONTEXT_COUNT];
+
+  for(int y = 0; y < height; ++y)
+  {
+    for(int x = 0; x < width; ++x)
+    {
+      int a, b, c;
+      get_neighbours(s, x, y, width, a, b, c);
+
+      // Map the residual to a non-negative integer (0, -1, 1, -2, 2, ... -> 0, 1, 2, 3, 4, ...).
+      const int residual = s(y * width + x) - predict(a, b, c);
+      const uint32_t mappedResidual = residual >= 0 ? 2u * residual : 2u * static_cast<uint32_t>(-residual) - 1;
+
+      // Write the residual, using an escape code if its Golomb-Rice code would be too long.
+      RiceContext& context = contexts[context_of(a, b, c)];
+      const int k = context.parameter();
+      const uint32_t q = mappedResidual >> k;
+      if(q < MAX_UNARY_LENGTH)
+      {
+        writer.put(((1u << q) - 1) << 1, q + 1);
+        if(k > 0) writer.put(mappedResidual & ((1u << k) - 1), k);
+      }
+      else
+      {
+        writer.put(0xFFFFFFFFu, MAX_UNARY_LENGTH);
+        writer.put(mappedResidual, ESCAPE_BITS);
+      }
+
+      context.update(mappedResidual);
+    }
+  }
+
+  writer.flush();
+}
+
+/**
+ * \brief Decodes a signal, writing the corresponding depth values (the signal plus the reference, if any) into the specified depth image.
+ */
+template <typename Signal>
+void decode_signal(const Signal& s, const short *reference, int width, int height, BitReader& reader, short *depth)
+{
+  RiceContext contexts[CONTEXT_COUNT];
+
+  for(int y = 0; y < height; ++y)
+  {
+    for(int x = 0; x < width; ++x)
+    {
+      int a, b, c;
+      get_neighbours(s, x, y, width, a, b, c);
+
+      // Read the mapped residual.
+      RiceContext& context = contexts[context_of(a, b, c)];
+      const int k = context.parameter();
+
+      uint32_t prefix = reader.peek(MAX_UNARY_LENGTH);
+      uint32_t q = 0;
+      while(q < MAX_UNARY_LENGTH && (prefix & 0x80000000u))
+      {
+        prefix <<= 1;
+        ++q;
+      }
+
+      uint32_t mappedResidual;
+      if(q < MAX_UNARY_LENGTH)
+      {
+        reader.skip(q + 1);
+        mappedResidual = (q << k) | reader.get(k);
+      }
+      else
+      {
+        reader.skip(MAX_UNARY_LENGTH);
+        mappedResidual = reader.get(ESCAPE_BITS);
+      }
+
+      context.update(mappedResidual);
+
+      // Unmap the residual and reconstruct the depth value.
+      const int residual = (mappedResidual & 1) ? -static_cast<int>((mappedResidual + 1) >> 1) : static_cast<int>(mappedResidual >> 1);
+      const int i = y * width + x;
+      depth[i] = static_cast<short>((reference ? reference[i] : 0) + predict(a, b, c) + residual);
+    }
+
+    if(reader.overrun()) throw std::runtime_error("Error: The compressed depth image is truncated");
+  }
+}
+
+//#################### PUBLIC STATIC MEMBER FUNCTIONS ####################
+
+void PredictiveDepthCodec::compress(const short *depth, const short *reference, int width, int height, std::vector<uint8_t>& bytes)
+{
+  // Decide whether to code the image itself or its difference from the reference (if available), based on which looks cheaper.
+  const SpatialSignal spatialSignal(depth);
+  CodingMode mode = CM_SPATIAL;
+  if(reference)
+  {
+    const TemporalSignal temporalSignal(depth, reference);
+    if(estimate_cost(temporalSignal, width, height) < estimate_cost(spatialSignal, width, height)) mode = CM_TEMPORAL;
+  }
+
+  // Code the image. Note that we reserve enough space for a raw copy of the image up-front, since the compressed
+  // image will only be larger than this in pathological cases, and it avoids repeated reallocation otherwise.
+  bytes.clear();
+  bytes.reserve(1 + static_cast<size_t>(width) * height * sizeof(short));
+  bytes.push_back(static_cast<uint8_t>(mode));
+
+  BitWriter writer(bytes);
+  if(mode == CM_TEMPORAL) encode_signal(TemporalSignal(depth, reference), width, height, writer);
+  else encode_signal(spatialSignal, width, height, writer);
+}
+
+void PredictiveDepthCodec::uncompress(const uint8_t *bytes, size_t byteCount, const short *reference, int width, int height, short *depth)
+{
+  if(byteCount == 0) throw std::runtime_error("Error: The compressed depth image is empty");
+
+  BitReader reader(bytes + 1, byteCount - 1);
+  switch(bytes[0])
+  {
+    case CM_SPATIAL:
+      decode_signal(SpatialSignal(depth), NULL, width, height, reader, depth);
+      break;
+    case CM_TEMPORAL:
+      if(!reference) throw std::runtime_error("Error: The compressed depth image needs a reference image, but none is available");
+      decode_signal(TemporalSignal(depth, reference), reference, width, height, reader, depth);
+      break;
+    default:
+      throw std::runtime_error("Error: The compressed depth image uses an unknown coding mode");
+  }
+}
+
+}
@@ -14,14 +14,18 @@ RGBDCalibrationMessage::RGBDCalibrationMessage()
 {
   m_depthCompressionTypeSegment = std::make_pair(0, sizeof(DepthCompressionType));
   m_rgbCompressionTypeSegment = std::make_pair(end_of(m_depthCompressionTypeSegment), sizeof(RGBCompressionType));
+  m_frameWindowSizeSegment = std::make_pair(end_of(m_rgbCompressionTypeSegment), sizeof(uint32_t));
   m_calibSegment = std::make_pair(
-    end_of(m_rgbCompressionTypeSegment),
+    end_of(m_frameWindowSizeSegment),
     sizeof(Vector2f) + sizeof(ITMDisparityCalib::TrafoType) + // disparityCalib
     sizeof(Vector2i) + sizeof(Vector4f) +                     // intrinsics_d
     sizeof(Vector2i) + sizeof(Vector4f) +                     // intrinsics_rgb
     sizeof(Matrix4f)                                          // trafo_rgb_to_depth
   );
   m_data.resize(end_of(m_calibSegment));
+
+  // Default to a window size of one, which makes the server acknowledge every frame (this is safe whatever the client's actual window size).
+  set_frame_window_size(1);
 }
 
 //#################### PUBLIC MEMBER FUNCTIONS ####################
@@ -61,6 +65,11 @@ DepthCompressionType RGBDCalibrationMessage::extract_depth_compression_type() co
   return read_simple<DepthCompressionType>(m_depthCompressionTypeSegment);
 }
 
+uint32_t RGBDCalibrationMessage::extract_frame_window_size() const
+{
+  return read_simple<uint32_t>(m_frameWindowSizeSegment);
+}
+
 RGBCompressionType RGBDCalibrationMessage::extract_rgb_compression_type() const
 {
   return read_simple<RGBCompressionType>(m_rgbCompressionTypeSegment);
@@ -96,6 +105,11 @@ void RGBDCalibrationMessage::set_depth_compression_type(DepthCompressionType dep
   write_simple(depthCompressionType, m_depthCompressionTypeSegment);
 }
 
+void RGBDCalibrationMessage::set_frame_window_size(uint32_t frameWindowSize)
+{
+  write_simple(frameWindowSize, m_frameWindowSizeSegment);
+}
+
 void RGBDCalibrationMessage::set_rgb_compression_type(RGBCompressionType rgbCompressionType)
 {
   write_simple(rgbCompressionType, m_rgbCompressionTypeSegment);
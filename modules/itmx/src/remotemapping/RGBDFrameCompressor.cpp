@@ -5,6 +5,7 @@
 
 #include "remotemapping/RGBDFrameCompressor.h"
 
+#include <algorithm>
 #include <stdexcept>
 
 #ifdef WITH_OPENCV
@@ -13,8 +14,10 @@
 #include <opencv2/imgproc.hpp>
 #endif
 
-#include <orx/base/MemoryBlockFactory.h>
-using orx::MemoryBlockFactory;
+#include <tvgutil/misc/TaskScheduler.h>
+using tvgutil::TaskScheduler;
+
+#include "remotemapping/PredictiveDepthCodec.h"
 
 namespace itmx {
 
@@ -22,69 +25,222 @@ namespace itmx {
 
 struct RGBDFrameCompressor::Impl
 {
-  /** A vector containing the results of depth compression. */
+  /** A vector containing the results of depth compression (a table of tile sizes, followed by the compressed tiles). */
   std::vector<uint8_t> compressedDepthBytes;
 
-  /** A vector containing the results of RGB compression. */
+  /** The compressed depth data on which we are currently working (this points directly into the message being uncompressed). */
+  const uint8_t *compressedDepthData;
+
+  /** A vector containing the results of RGB compression (a table of tile sizes, followed by the compressed tiles). */
   std::vector<uint8_t> compressedRgbBytes;
 
+  /** The compressed RGB data on which we are currently working (this points directly into the message being uncompressed). */
+  const uint8_t *compressedRgbData;
+
   /** The type of compression algorithm to use for the depth images. */
   DepthCompressionType depthCompressionType;
 
+  /** The depth image on which we are currently working (this points directly into the frame message being compressed or uncompressed). */
+  short *depthData;
+
+  /** The size of the depth image on which we are currently working. */
+  Vector2i depthImageSize;
+
+  /** The number of tiles in the depth image on which we are currently working. */
+  size_t depthTileCount;
+
+  /** The compressed depth tiles (used during compression). */
+  std::vector<std::vector<uint8_t> > depthTileBytes;
+
+  /** The offsets of the compressed depth tiles within compressedDepthBytes (used during uncompression). */
+  std::vector<size_t> depthTileOffsets;
+
+  /** The most recent depth image to have been compressed (used as the reference image for temporal predictive coding). */
+  std::vector<short> lastCompressedDepth;
+
+  /** The size of the most recent depth image to have been compressed (or (0,0) if there isn't one). */
+  Vector2i lastCompressedDepthSize;
+
+  /** The most recent depth image to have been uncompressed (used as the reference image for temporal predictive coding). */
+  std::vector<short> lastUncompressedDepth;
+
+  /** The size of the most recent depth image to have been uncompressed (or (0,0) if there isn't one). */
+  Vector2i lastUncompressedDepthSize;
+
+  /** The maximum number of tiles into which to divide each image when compressing it (0 means one per task scheduler thread). */
+  size_t maxTileCount;
+
   /** The type of compression algorithm to use for the RGB images. */
   RGBCompressionType rgbCompressionType;
 
-  /** An image storing the temporary uncompressed depth data. */
-  ORShortImage_Ptr uncompressedDepthImage;
+  /** The RGB image on which we are currently working (this points directly into the frame message being compressed or uncompressed). */
+  Vector4u *rgbData;
+
+  /** The size of the RGB image on which we are currently working. */
+  Vector2i rgbImageSize;
+
+  /** The number of tiles in the RGB image on which we are currently working. */
+  size_t rgbTileCount;
+
+  /** The compressed RGB tiles (used during compression). */
+  std::vector<std::vector<uint8_t> > rgbTileBytes;
+
+  /** The offsets of the compressed RGB tiles within compressedRgbBytes (used during uncompression). */
+  std::vector<size_t> rgbTileOffsets;
 
 #ifdef WITH_OPENCV
-  /** An OpenCV image storing the temporary uncompressed depth data. */
-  cv::Mat uncompressedDepthMat;
+  /** OpenCV images storing the temporary uncompressed depth data for each tile. */
+  std::vector<cv::Mat> uncompressedDepthTileMats;
 #endif
 
-  /** An image storing the temporary uncompressed RGB data. */
-  ORUChar4Image_Ptr uncompressedRgbImage;
-
 #ifdef WITH_OPENCV
-  /** An OpenCV image storing the temporary uncompressed RGB data. */
-  cv::Mat uncompressedRgbMat;
+  /** OpenCV images storing the temporary uncompressed RGB data for each tile. */
+  std::vector<cv::Mat> uncompressedRgbTileMats;
 #endif
 };
 
+//#################### LOCAL FUNCTIONS ####################
+
+/**
+ * \brief Gets the part of a reference image that corresponds to the specified rows of the current depth image.
+ *
+ * \param reference     The reference image.
+ * \param referenceSize The size of the reference image.
+ * \param imgSize       The size of the current depth image.
+ * \param rowBegin      The first row of interest.
+ * \return              A pointer to the first of the rows of interest in the reference image, or NULL if the reference image cannot be used.
+ */
+static const short *get_reference_rows(const std::vector<short>& reference, const Vector2i& referenceSize, const Vector2i& imgSize, int rowBegin)
+{
+  return referenceSize == imgSize && !reference.empty() ? reference.data() + rowBegin * imgSize.x : NULL;
+}
+
+/**
+ * \brief Saves a copy of a depth image so that it can be used as the reference image for the next frame.
+ *
+ * \param depth         The depth image.
+ * \param imgSize       The size of the depth image.
+ * \param reference     The location into which to copy the image.
+ * \param referenceSize The location into which to write the size of the image.
+ */
+static void save_reference(const short *depth, const Vector2i& imgSize, std::vector<short>& reference, Vector2i& referenceSize)
+{
+  reference.assign(depth, depth + imgSize.x * imgSize.y);
+  referenceSize = imgSize;
+}
+
+/**
+ * \brief Chooses the number of tiles into which to divide an image with the specified number of rows.
+ *
+ * \param maxTileCount  The maximum number of tiles to use (0 means one per task scheduler thread).
+ * \param rows          The number of rows in the image.
+ * \return              The number of tiles into which to divide the image.
+ */
+static size_t choose_tile_count(size_t maxTileCount, int rows)
+{
+  const size_t tileCount = maxTileCount > 0 ? maxTileCount : TaskScheduler::instance().thread_count();
+  return std::max<size_t>(std::min<size_t>(tileCount, static_cast<size_t>(std::max(rows, 0))), 1);
+}
+
+/**
+ * \brief Gets the range of rows in an image that correspond to the specified tile.
+ *
+ * \param rows      The number of rows in the image.
+ * \param tileCount The number of tiles into which the image is divided.
+ * \param tileIndex The index of the tile.
+ * \param rowBegin  A location into which to write the first row in the tile.
+ * \param rowEnd    A location into which to write one past the last row in the tile.
+ */
+static void get_tile_rows(int rows, size_t tileCount, int tileIndex, int& rowBegin, int& rowEnd)
+{
+  rowBegin = static_cast<int>(static_cast<size_t>(rows) * tileIndex / tileCount);
+  rowEnd = static_cast<int>(static_cast<size_t>(rows) * (tileIndex + 1) / tileCount);
+}
+
+/**
+ * \brief Packs a set of compressed tiles into a single buffer, consisting of a table of tile sizes followed by the tiles themselves.
+ *
+ * \param tileBytes The compressed tiles.
+ * \param tileCount The number of tiles to pack.
+ * \param bytes     The buffer into which to pack the tiles (this will be resized as necessary).
+ */
+static void pack_tiles(const std::vector<std::vector<uint8_t> >& tileBytes, size_t tileCount, std::vector<uint8_t>& bytes)
+{
+  size_t totalSize = tileCount * sizeof(uint32_t);
+  for(size_t i = 0; i < tileCount; ++i) totalSize += tileBytes[i].size();
+  bytes.resize(totalSize);
+
+  uint8_t *table = &bytes[0];
+  uint8_t *dest = table + tileCount * sizeof(uint32_t);
+  for(size_t i = 0; i < tileCount; ++i)
+  {
+    const uint32_t tileSize = static_cast<uint32_t>(tileBytes[i].size());
+    memcpy(table + i * sizeof(uint32_t), &tileSize, sizeof(uint32_t));
+    if(tileSize > 0) memcpy(dest, &tileBytes[i][0], tileSize);
+    dest += tileSize;
+  }
+}
+
+/**
+ * \brief Reads the table of tile sizes at the start of a buffer of packed tiles, and computes the offsets of the tiles within the buffer.
+ *
+ * \param bytes       The buffer of packed tiles.
+ * \param byteCount   The size of the buffer (in bytes).
+ * \param tileCount   The number of tiles in the buffer.
+ * \param tileOffsets A location into which to write the offsets of the tiles (tile i occupies [tileOffsets[i], tileOffsets[i+1])).
+ *
+ * \throws std::runtime_error If the buffer is inconsistent with the specified number of tiles.
+ */
+static void unpack_tile_offsets(const uint8_t *bytes, size_t byteCount, size_t tileCount, std::vector<size_t>& tileOffsets)
+{
+  size_t offset = tileCount * sizeof(uint32_t);
+  if(byteCount < offset) throw std::runtime_error("Error: The compressed image data is too small to contain its table of tile sizes");
+
+  tileOffsets.resize(tileCount + 1);
+  for(size_t i = 0; i < tileCount; ++i)
+  {
+    uint32_t tileSize;
+    memcpy(&tileSize, &bytes[i * sizeof(uint32_t)], sizeof(uint32_t));
+    tileOffsets[i] = offset;
+    offset += tileSize;
+  }
+  tileOffsets[tileCount] = offset;
+
+  if(offset != byteCount) throw std::runtime_error("Error: The tile sizes in the compressed image data do not match the size of the data");
+}
+
 //#################### CONSTRUCTORS ####################
 
-RGBDFrameCompressor::RGBDFrameCompressor(const Vector2i& rgbImageSize, const Vector2i& depthImageSize, RGBCompressionType rgbCompressionType, DepthCompressionType depthCompressionType)
+RGBDFrameCompressor::RGBDFrameCompressor(const Vector2i& rgbImageSize, const Vector2i& depthImageSize, RGBCompressionType rgbCompressionType,
+                                         DepthCompressionType depthCompressionType, size_t tileCount)
 : m_impl(new Impl)
 {
-  MemoryBlockFactory& mbf = MemoryBlockFactory::instance();
-
+  m_impl->compressedDepthData = NULL;
+  m_impl->compressedRgbData = NULL;
   m_impl->depthCompressionType = depthCompressionType;
+  m_impl->depthData = NULL;
+  m_impl->depthImageSize = depthImageSize;
+  m_impl->depthTileCount = 0;
+  m_impl->lastCompressedDepthSize = m_impl->lastUncompressedDepthSize = Vector2i(0, 0);
+  m_impl->maxTileCount = tileCount;
   m_impl->rgbCompressionType = rgbCompressionType;
-  m_impl->uncompressedDepthImage = mbf.make_image<short>(depthImageSize);
-  m_impl->uncompressedRgbImage = mbf.make_image<Vector4u>(rgbImageSize);
+  m_impl->rgbData = NULL;
+  m_impl->rgbImageSize = rgbImageSize;
+  m_impl->rgbTileCount = 0;
 
-  // If we're using the PNG compression from OpenCV to compress depth images, allocate a temporary OpenCV image accordingly.
-  // The format of this image needs to be CV_16U to properly encode a depth image as PNG. We will use convertTo to fill
-  // this image from an ORShortImage.
+  // Check that the compression types we want to use are available. Note that the temporary OpenCV images they use are allocated
+  // per tile on demand (and then reused across frames), since the number and size of the tiles depend on the images we receive.
+#ifndef WITH_OPENCV
   if(depthCompressionType == DEPTH_COMPRESSION_PNG)
   {
-#ifdef WITH_OPENCV
-    m_impl->uncompressedDepthMat.create(depthImageSize.y, depthImageSize.x, CV_16UC1);
-#else
     throw std::invalid_argument("Error: Cannot compress depth images to PNG format. Reconfigure in CMake with the WITH_OPENCV option set to on.");
-#endif
   }
 
-  // If we're using either the JPG or PNG compression from OpenCV to compress RGB images, allocate a temporary OpenCV image accordingly.
-  // The image we allocate will have 3 channels, and we will use cvtColor to fill it.
   if(rgbCompressionType == RGB_COMPRESSION_JPG || rgbCompressionType == RGB_COMPRESSION_PNG)
   {
-#ifdef WITH_OPENCV
-    m_impl->uncompressedRgbMat.create(rgbImageSize.y, rgbImageSize.x, CV_8UC3);
-#else
     throw std::invalid_argument("Error: Cannot compress RGB images to PNG or JPG format. Reconfigure in CMake with the WITH_OPENCV option set to on.");
-#endif
   }
+#endif
 }
 
 //#################### PUBLIC MEMBER FUNCTIONS ####################
@@ -95,26 +251,53 @@ void RGBDFrameCompressor::compress_rgbd_frame(const RGBDFrameMessage& uncompress
   compressedFrame.set_frame_index(uncompressedFrame.extract_frame_index());
   compressedFrame.set_pose(uncompressedFrame.extract_pose());
 
-  // Then, extract the images from the uncompressed message.
-  m_impl->uncompressedDepthImage->ChangeDims(uncompressedFrame.get_depth_image_size());
-  m_impl->uncompressedRgbImage->ChangeDims(uncompressedFrame.get_rgb_image_size());
-  uncompressedFrame.extract_depth_image(m_impl->uncompressedDepthImage.get());
-  uncompressedFrame.extract_rgb_image(m_impl->uncompressedRgbImage.get());
+  // Then, point the compressor at the images in the uncompressed message, so that they can be compressed in place without first being copied out.
+  // Note that the tile compression functions only ever read from the images, so it is safe to cast away the constness here.
+  m_impl->depthData = const_cast<short*>(uncompressedFrame.get_depth_image_ptr());
+  m_impl->depthImageSize = uncompressedFrame.get_depth_image_size();
+  m_impl->rgbData = const_cast<Vector4u*>(uncompressedFrame.get_rgb_image_ptr());
+  m_impl->rgbImageSize = uncompressedFrame.get_rgb_image_size();
+
+  // Divide the images into tiles.
+  m_impl->depthTileCount = choose_tile_count(m_impl->maxTileCount, m_impl->depthImageSize.y);
+  m_impl->rgbTileCount = choose_tile_count(m_impl->maxTileCount, m_impl->rgbImageSize.y);
+  if(m_impl->depthTileBytes.size() < m_impl->depthTileCount) m_impl->depthTileBytes.resize(m_impl->depthTileCount);
+  if(m_impl->rgbTileBytes.size() < m_impl->rgbTileCount) m_impl->rgbTileBytes.resize(m_impl->rgbTileCount);
+#ifdef WITH_OPENCV
+  if(m_impl->uncompressedDepthTileMats.size() < m_impl->depthTileCount) m_impl->uncompressedDepthTileMats.resize(m_impl->depthTileCount);
+  if(m_impl->uncompressedRgbTileMats.size() < m_impl->rgbTileCount) m_impl->uncompressedRgbTileMats.resize(m_impl->rgbTileCount);
+#endif
+
+  // Compress all of the depth and RGB tiles concurrently.
+  const int jobCount = static_cast<int>(m_impl->depthTileCount + m_impl->rgbTileCount);
+  TaskScheduler::instance().parallel_for(0, jobCount, 1, boost::bind(&RGBDFrameCompressor::run_compression_job, this, _1));
+
+  // If we're using temporal predictive coding, keep the depth image so that the next frame can be coded relative to it.
+  if(m_impl->depthCompressionType == DEPTH_COMPRESSION_PREDICTIVE_TEMPORAL)
+  {
+    save_reference(m_impl->depthData, m_impl->depthImageSize, m_impl->lastCompressedDepth, m_impl->lastCompressedDepthSize);
+  }
 
-  // Perform the compression.
-  compress_depth_image();
-  compress_rgb_image();
+  // Pack the compressed tiles for each image into a single buffer.
+  pack_tiles(m_impl->depthTileBytes, m_impl->depthTileCount, m_impl->compressedDepthBytes);
+  pack_tiles(m_impl->rgbTileBytes, m_impl->rgbTileCount, m_impl->compressedRgbBytes);
 
   // Now, prepare the compressed header.
   compressedHeader.set_depth_image_byte_size(static_cast<uint32_t>(m_impl->compressedDepthBytes.size()));
-  compressedHeader.set_depth_image_size(m_impl->uncompressedDepthImage->noDims);
+  compressedHeader.set_depth_image_size(m_impl->depthImageSize);
+  compressedHeader.set_depth_tile_count(static_cast<uint32_t>(m_impl->depthTileCount));
   compressedHeader.set_rgb_image_byte_size(static_cast<uint32_t>(m_impl->compressedRgbBytes.size()));
-  compressedHeader.set_rgb_image_size(m_impl->uncompressedRgbImage->noDims);
+  compressedHeader.set_rgb_image_size(m_impl->rgbImageSize);
+  compressedHeader.set_rgb_tile_count(static_cast<uint32_t>(m_impl->rgbTileCount));
 
-  // Finally, prepare the compressed frame.
+  // Finally, prepare the compressed frame. Rather than copying the compressed images into the frame, we make it borrow them from our
+  // buffers, which remain unchanged until the next call to this function. They can then be sent directly using a gather-write.
   compressedFrame.set_compressed_image_sizes(compressedHeader);
-  compressedFrame.set_depth_image_data(m_impl->compressedDepthBytes);
-  compressedFrame.set_rgb_image_data(m_impl->compressedRgbBytes);
+  compressedFrame.borrow_depth_image_data(m_impl->compressedDepthBytes);
+  compressedFrame.borrow_rgb_image_data(m_impl->compressedRgbBytes);
+
+  m_impl->depthData = NULL;
+  m_impl->rgbData = NULL;
 }
 
 void RGBDFrameCompressor::uncompress_rgbd_frame(const CompressedRGBDFrameMessage& compressedFrame, RGBDFrameMessage& uncompressedFrame)
@@ -123,143 +306,226 @@ void RGBDFrameCompressor::uncompress_rgbd_frame(const CompressedRGBDFrameMessage
   uncompressedFrame.set_frame_index(compressedFrame.extract_frame_index());
   uncompressedFrame.set_pose(compressedFrame.extract_pose());
 
-  // Then, extract the compressed byte vectors.
-  compressedFrame.extract_depth_image_data(m_impl->compressedDepthBytes);
-  compressedFrame.extract_rgb_image_data(m_impl->compressedRgbBytes);
+  // Then, check that the images in the compressed message are the same size as those in the uncompressed message (we uncompress directly into the latter).
+  m_impl->depthImageSize = compressedFrame.get_depth_image_size();
+  m_impl->rgbImageSize = compressedFrame.get_rgb_image_size();
+  if(m_impl->depthImageSize != uncompressedFrame.get_depth_image_size() || m_impl->rgbImageSize != uncompressedFrame.get_rgb_image_size())
+  {
+    throw std::runtime_error("Error: The image sizes in the compressed message do not match those of the uncompressed message");
+  }
+
+  m_impl->depthTileCount = compressedFrame.get_depth_tile_count();
+  m_impl->rgbTileCount = compressedFrame.get_rgb_tile_count();
+  if(m_impl->depthTileCount == 0 || m_impl->depthTileCount > static_cast<size_t>(std::max(m_impl->depthImageSize.y, 1)) ||
+     m_impl->rgbTileCount == 0 || m_impl->rgbTileCount > static_cast<size_t>(std::max(m_impl->rgbImageSize.y, 1)))
+  {
+    throw std::runtime_error("Error: The tile counts in the compressed message are inconsistent with the image sizes");
+  }
+
+  // Find the tiles within the compressed data (which we read in place, rather than copying it out of the message).
+  m_impl->compressedDepthData = compressedFrame.get_depth_image_data_ptr();
+  m_impl->compressedRgbData = compressedFrame.get_rgb_image_data_ptr();
+  unpack_tile_offsets(m_impl->compressedDepthData, compressedFrame.get_depth_image_data_size(), m_impl->depthTileCount, m_impl->depthTileOffsets);
+  unpack_tile_offsets(m_impl->compressedRgbData, compressedFrame.get_rgb_image_data_size(), m_impl->rgbTileCount, m_impl->rgbTileOffsets);
 
-  // Perform the uncompression.
-  uncompress_depth_image();
-  uncompress_rgb_image();
+  m_impl->depthData = uncompressedFrame.get_depth_image_ptr();
+  m_impl->rgbData = uncompressedFrame.get_rgb_image_ptr();
+
+#ifdef WITH_OPENCV
+  if(m_impl->uncompressedDepthTileMats.size() < m_impl->depthTileCount) m_impl->uncompressedDepthTileMats.resize(m_impl->depthTileCount);
+  if(m_impl->uncompressedRgbTileMats.size() < m_impl->rgbTileCount) m_impl->uncompressedRgbTileMats.resize(m_impl->rgbTileCount);
+#endif
+
+  // Uncompress all of the depth and RGB tiles concurrently.
+  const int jobCount = static_cast<int>(m_impl->depthTileCount + m_impl->rgbTileCount);
+  TaskScheduler::instance().parallel_for(0, jobCount, 1, boost::bind(&RGBDFrameCompressor::run_uncompression_job, this, _1));
+
+  // If we're using temporal predictive coding, keep the depth image so that the next frame can be reconstructed relative to it.
+  if(m_impl->depthCompressionType == DEPTH_COMPRESSION_PREDICTIVE_TEMPORAL)
+  {
+    save_reference(m_impl->depthData, m_impl->depthImageSize, m_impl->lastUncompressedDepth, m_impl->lastUncompressedDepthSize);
+  }
 
-  // Finally, store the images into the uncompressed message.
-  uncompressedFrame.set_depth_image(m_impl->uncompressedDepthImage);
-  uncompressedFrame.set_rgb_image(m_impl->uncompressedRgbImage);
+  m_impl->compressedDepthData = m_impl->compressedRgbData = NULL;
+  m_impl->depthData = NULL;
+  m_impl->rgbData = NULL;
 }
 
 //#################### PRIVATE MEMBER FUNCTIONS ####################
 
-void RGBDFrameCompressor::compress_depth_image()
+void RGBDFrameCompressor::compress_depth_tile(int tileIndex)
 {
+  const Vector2i& imgSize = m_impl->depthImageSize;
+  int rowBegin, rowEnd;
+  get_tile_rows(imgSize.y, m_impl->depthTileCount, tileIndex, rowBegin, rowEnd);
+
+  short *tileData = m_impl->depthData + rowBegin * imgSize.x;
+  std::vector<uint8_t>& tileBytes = m_impl->depthTileBytes[tileIndex];
+
   if(m_impl->depthCompressionType == DEPTH_COMPRESSION_PNG)
   {
 #ifdef WITH_OPENCV
-    // If we're using PNG compresson, first wrap the InfiniTAM depth image as an OpenCV image.
-    cv::Mat depthWrapper(
-      m_impl->uncompressedDepthImage->noDims.y,
-      m_impl->uncompressedDepthImage->noDims.x,
-      CV_16SC1,
-      m_impl->uncompressedDepthImage->GetData(MEMORYDEVICE_CPU)
-    );
+    // If we're using PNG compression, first wrap the tile of the InfiniTAM depth image as an OpenCV image.
+    cv::Mat depthWrapper(rowEnd - rowBegin, imgSize.x, CV_16SC1, tileData);
 
     // Then, convert the format to CV_16U (this is necessary to properly encode the image in PNG format).
-    depthWrapper.convertTo(m_impl->uncompressedDepthMat, CV_16U);
+    cv::Mat& tileMat = m_impl->uncompressedDepthTileMats[tileIndex];
+    depthWrapper.convertTo(tileMat, CV_16U);
 
-    // Finally, compress the image, storing the compressed representation in an internal buffer.
-    cv::imencode(".png", m_impl->uncompressedDepthMat, m_impl->compressedDepthBytes);
+    // Finally, compress the tile, storing the compressed representation in the tile's buffer.
+    cv::imencode(".png", tileMat, tileBytes);
 #endif
   }
+  else if(m_impl->depthCompressionType == DEPTH_COMPRESSION_PREDICTIVE || m_impl->depthCompressionType == DEPTH_COMPRESSION_PREDICTIVE_TEMPORAL)
+  {
+    // If we're using predictive coding, compress the tile directly into its buffer (relative to the corresponding part of the previous frame, if appropriate).
+    const short *referenceData = m_impl->depthCompressionType == DEPTH_COMPRESSION_PREDICTIVE_TEMPORAL
+      ? get_reference_rows(m_impl->lastCompressedDepth, m_impl->lastCompressedDepthSize, imgSize, rowBegin)
+      : NULL;
+    PredictiveDepthCodec::compress(tileData, referenceData, imgSize.x, rowEnd - rowBegin, tileBytes);
+  }
   else
   {
-    // If we're not using PNG compression, simply copy the raw bytes of the image into the internal buffer.
-    m_impl->compressedDepthBytes.resize(m_impl->uncompressedDepthImage->dataSize * sizeof(short));
-    memcpy(m_impl->compressedDepthBytes.data(), m_impl->uncompressedDepthImage->GetData(MEMORYDEVICE_CPU), m_impl->compressedDepthBytes.size());
+    // If we're not using any compression, simply copy the raw bytes of the tile into its buffer.
+    tileBytes.resize((rowEnd - rowBegin) * imgSize.x * sizeof(short));
+    if(!tileBytes.empty()) memcpy(&tileBytes[0], tileData, tileBytes.size());
   }
 }
 
-void RGBDFrameCompressor::compress_rgb_image()
+void RGBDFrameCompressor::compress_rgb_tile(int tileIndex)
 {
+  const Vector2i& imgSize = m_impl->rgbImageSize;
+  int rowBegin, rowEnd;
+  get_tile_rows(imgSize.y, m_impl->rgbTileCount, tileIndex, rowBegin, rowEnd);
+
+  Vector4u *tileData = m_impl->rgbData + rowBegin * imgSize.x;
+  std::vector<uint8_t>& tileBytes = m_impl->rgbTileBytes[tileIndex];
+
   if(m_impl->rgbCompressionType == RGB_COMPRESSION_NONE)
   {
-    // If we're not using compression, simply copy the raw bytes of the image into an internal buffer.
-    m_impl->compressedRgbBytes.resize(m_impl->uncompressedRgbImage->dataSize * sizeof(Vector4u));
-    memcpy(m_impl->compressedRgbBytes.data(), m_impl->uncompressedRgbImage->GetData(MEMORYDEVICE_CPU), m_impl->compressedRgbBytes.size());
+    // If we're not using compression, simply copy the raw bytes of the tile into its buffer.
+    tileBytes.resize((rowEnd - rowBegin) * imgSize.x * sizeof(Vector4u));
+    if(!tileBytes.empty()) memcpy(&tileBytes[0], tileData, tileBytes.size());
   }
   else
   {
 #ifdef WITH_OPENCV
-    // Otherwise, first wrap the InfiniTAM RGB image as an OpenCV image.
-    cv::Mat rgbWrapper(
-      m_impl->uncompressedRgbImage->noDims.y,
-      m_impl->uncompressedRgbImage->noDims.x,
-      CV_8UC4,
-      m_impl->uncompressedRgbImage->GetData(MEMORYDEVICE_CPU)
-    );
-
-    // Then, make a copy of this image in which we reorder the colours and drop the alpha channel.
-    cv::cvtColor(rgbWrapper, m_impl->uncompressedRgbMat, CV_RGBA2BGR);
-
-    // Finally, compress the image using the appropriate format, storing the compressed representation in the internal buffer.
+    // Otherwise, first wrap the tile of the InfiniTAM RGB image as an OpenCV image.
+    cv::Mat rgbWrapper(rowEnd - rowBegin, imgSize.x, CV_8UC4, tileData);
+
+    // Then, make a copy of this tile in which we reorder the colours and drop the alpha channel.
+    cv::Mat& tileMat = m_impl->uncompressedRgbTileMats[tileIndex];
+    cv::cvtColor(rgbWrapper, tileMat, CV_RGBA2BGR);
+
+    // Finally, compress the tile using the appropriate format, storing the compressed representation in the tile's buffer.
     const std::string outputFormat = m_impl->rgbCompressionType == RGB_COMPRESSION_JPG ? ".jpg" : ".png";
-    cv::imencode(outputFormat, m_impl->uncompressedRgbMat, m_impl->compressedRgbBytes);
+    cv::imencode(outputFormat, tileMat, tileBytes);
 #endif
   }
 }
 
-void RGBDFrameCompressor::uncompress_depth_image()
+void RGBDFrameCompressor::run_compression_job(int jobIndex)
 {
+  const int depthTileCount = static_cast<int>(m_impl->depthTileCount);
+  if(jobIndex < depthTileCount) compress_depth_tile(jobIndex);
+  else compress_rgb_tile(jobIndex - depthTileCount);
+}
+
+void RGBDFrameCompressor::run_uncompression_job(int jobIndex)
+{
+  const int depthTileCount = static_cast<int>(m_impl->depthTileCount);
+  if(jobIndex < depthTileCount) uncompress_depth_tile(jobIndex);
+  else uncompress_rgb_tile(jobIndex - depthTileCount);
+}
+
+void RGBDFrameCompressor::uncompress_depth_tile(int tileIndex)
+{
+  const Vector2i& imgSize = m_impl->depthImageSize;
+  int rowBegin, rowEnd;
+  get_tile_rows(imgSize.y, m_impl->depthTileCount, tileIndex, rowBegin, rowEnd);
+
+  short *tileData = m_impl->depthData + rowBegin * imgSize.x;
+  const size_t tileOffset = m_impl->depthTileOffsets[tileIndex];
+  const size_t tileByteSize = m_impl->depthTileOffsets[tileIndex + 1] - tileOffset;
+
   if(m_impl->depthCompressionType == DEPTH_COMPRESSION_PNG)
   {
 #ifdef WITH_OPENCV
-    // If we're using PNG compression, first decode the image into a preallocated internal buffer.
-    m_impl->uncompressedDepthMat = cv::imdecode(m_impl->compressedDepthBytes, cv::IMREAD_ANYDEPTH, &m_impl->uncompressedDepthMat);
-
-    // Then, copy the image back into an InfiniTAM image, resizing as necessary. Note that as part of
-    // this process, we convert the format back from CV_16U (as returned by cv::imdecode) to CV_16S
-    // (the format InfiniTAM is expecting).
-    m_impl->uncompressedDepthImage->ChangeDims(Vector2i(m_impl->uncompressedDepthMat.cols, m_impl->uncompressedDepthMat.rows));
+    // If we're using PNG compression, first decode the tile into a preallocated internal buffer (note that cv::imdecode only reads the compressed data, so the const_cast is safe).
+    const cv::Mat tileBytes(1, static_cast<int>(tileByteSize), CV_8UC1, const_cast<uint8_t*>(m_impl->compressedDepthData + tileOffset));
+    cv::Mat& tileMat = m_impl->uncompressedDepthTileMats[tileIndex];
+    tileMat = cv::imdecode(tileBytes, cv::IMREAD_ANYDEPTH, &tileMat);
 
-    cv::Mat depthWrapper(
-      m_impl->uncompressedDepthImage->noDims.y,
-      m_impl->uncompressedDepthImage->noDims.x, CV_16SC1,
-      m_impl->uncompressedDepthImage->GetData(MEMORYDEVICE_CPU)
-    );
+    if(tileMat.rows != rowEnd - rowBegin || tileMat.cols != imgSize.x)
+    {
+      throw std::runtime_error("Error: The size of a compressed depth tile does not match the size of the corresponding part of the depth image");
+    }
 
-    m_impl->uncompressedDepthMat.convertTo(depthWrapper, CV_16S);
+    // Then, copy the tile back into the InfiniTAM image. Note that as part of this process, we convert the
+    // format back from CV_16U (as returned by cv::imdecode) to CV_16S (the format InfiniTAM is expecting).
+    cv::Mat depthWrapper(rowEnd - rowBegin, imgSize.x, CV_16SC1, tileData);
+    tileMat.convertTo(depthWrapper, CV_16S);
 #endif
   }
+  else if(m_impl->depthCompressionType == DEPTH_COMPRESSION_PREDICTIVE || m_impl->depthCompressionType == DEPTH_COMPRESSION_PREDICTIVE_TEMPORAL)
+  {
+    // If we're using predictive coding, uncompress the tile directly into the InfiniTAM image (relative to the corresponding part of the previous frame, if appropriate).
+    const short *referenceData = m_impl->depthCompressionType == DEPTH_COMPRESSION_PREDICTIVE_TEMPORAL
+      ? get_reference_rows(m_impl->lastUncompressedDepth, m_impl->lastUncompressedDepthSize, imgSize, rowBegin)
+      : NULL;
+    PredictiveDepthCodec::uncompress(m_impl->compressedDepthData + tileOffset, tileByteSize, referenceData, imgSize.x, rowEnd - rowBegin, tileData);
+  }
   else
   {
-    // Otherwise, first check that the size of the uncompressed image matches that of the compressed data.
-    if(m_impl->uncompressedDepthImage->dataSize * sizeof(short) != m_impl->compressedDepthBytes.size())
+    // Otherwise, first check that the size of the tile matches that of the compressed data.
+    if((rowEnd - rowBegin) * imgSize.x * sizeof(short) != tileByteSize)
     {
       throw std::runtime_error("Depth image size in the compressed message does not match the uncompressed depth image size.");
     }
 
     // If it does, simply copy the bytes across.
-    memcpy(m_impl->uncompressedDepthImage->GetData(MEMORYDEVICE_CPU), m_impl->compressedDepthBytes.data(), m_impl->compressedDepthBytes.size());
+    if(tileByteSize > 0) memcpy(tileData, m_impl->compressedDepthData + tileOffset, tileByteSize);
   }
 }
 
-void RGBDFrameCompressor::uncompress_rgb_image()
+void RGBDFrameCompressor::uncompress_rgb_tile(int tileIndex)
 {
+  const Vector2i& imgSize = m_impl->rgbImageSize;
+  int rowBegin, rowEnd;
+  get_tile_rows(imgSize.y, m_impl->rgbTileCount, tileIndex, rowBegin, rowEnd);
+
+  Vector4u *tileData = m_impl->rgbData + rowBegin * imgSize.x;
+  const size_t tileOffset = m_impl->rgbTileOffsets[tileIndex];
+  const size_t tileByteSize = m_impl->rgbTileOffsets[tileIndex + 1] - tileOffset;
+
   if(m_impl->rgbCompressionType == RGB_COMPRESSION_NONE)
   {
-    // If we're not using compression, check that the size of the uncompressed image matches that of the compressed data.
-    if(m_impl->uncompressedRgbImage->dataSize * sizeof(Vector4u) != m_impl->compressedRgbBytes.size())
+    // If we're not using compression, check that the size of the tile matches that of the compressed data.
+    if((rowEnd - rowBegin) * imgSize.x * sizeof(Vector4u) != tileByteSize)
     {
       throw std::runtime_error("RGB image size in the compressed message does not match the uncompressed RGB image size.");
     }
 
     // If it does, simply copy the bytes across.
-    memcpy(m_impl->uncompressedRgbImage->GetData(MEMORYDEVICE_CPU), m_impl->compressedRgbBytes.data(), m_impl->compressedRgbBytes.size());
+    if(tileByteSize > 0) memcpy(tileData, m_impl->compressedRgbData + tileOffset, tileByteSize);
   }
   else
   {
 #ifdef WITH_OPENCV
-    // Otherwise, first decode the image into a preallocated internal buffer.
-    m_impl->uncompressedRgbMat = cv::imdecode(m_impl->compressedRgbBytes, cv::IMREAD_COLOR, &m_impl->uncompressedRgbMat);
+    // Otherwise, first decode the tile into a preallocated internal buffer (as above, cv::imdecode only reads the compressed data).
+    const cv::Mat tileBytes(1, static_cast<int>(tileByteSize), CV_8UC1, const_cast<uint8_t*>(m_impl->compressedRgbData + tileOffset));
+    cv::Mat& tileMat = m_impl->uncompressedRgbTileMats[tileIndex];
+    tileMat = cv::imdecode(tileBytes, cv::IMREAD_COLOR, &tileMat);
 
-    // Then, copy the image back into an InfiniTAM image, resizing as necessary. Note that
-    // as part of this process, we reorder the bytes and re-add the alpha channel.
-    m_impl->uncompressedRgbImage->ChangeDims(Vector2i(m_impl->uncompressedRgbMat.cols, m_impl->uncompressedRgbMat.rows));
-
-    cv::Mat rgbWrapper(
-      m_impl->uncompressedRgbImage->noDims.y,
-      m_impl->uncompressedRgbImage->noDims.x, CV_8UC4,
-      m_impl->uncompressedRgbImage->GetData(MEMORYDEVICE_CPU)
-    );
+    if(tileMat.rows != rowEnd - rowBegin || tileMat.cols != imgSize.x)
+    {
+      throw std::runtime_error("Error: The size of a compressed RGB tile does not match the size of the corresponding part of the RGB image");
+    }
 
-    cv::cvtColor(m_impl->uncompressedRgbMat, rgbWrapper, CV_BGR2RGBA);
+    // Then, copy the tile back into the InfiniTAM image. Note that as
+    // part of this process, we reorder the bytes and re-add the alpha channel.
+    cv::Mat rgbWrapper(rowEnd - rowBegin, imgSize.x, CV_8UC4, tileData);
+    cv::cvtColor(tileMat, rgbWrapper, CV_BGR2RGBA);
 #endif
   }
 }
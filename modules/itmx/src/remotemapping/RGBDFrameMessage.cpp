@@ -38,7 +38,7 @@ void RGBDFrameMessage::extract_depth_image(ORShortImage *depthImage) const
     depthImage->ChangeDims(m_depthImageSize);
   }
 
-  memcpy(reinterpret_cast<char*>(depthImage->GetData(MEMORYDEVICE_CPU)), &m_data[m_depthImageSegment.first], m_depthImageSegment.second);
+  memcpy(reinterpret_cast<char*>(depthImage->GetData(MEMORYDEVICE_CPU)), get_segment_ptr(m_depthImageSegment), m_depthImageSegment.second);
 }
 
 void RGBDFrameMessage::extract_rgb_image(ORUChar4Image *rgbImage) const
@@ -49,7 +49,17 @@ void RGBDFrameMessage::extract_rgb_image(ORUChar4Image *rgbImage) const
     rgbImage->ChangeDims(m_rgbImageSize);
   }
 
-  memcpy(reinterpret_cast<char*>(rgbImage->GetData(MEMORYDEVICE_CPU)), &m_data[m_rgbImageSegment.first], m_rgbImageSegment.second);
+  memcpy(reinterpret_cast<char*>(rgbImage->GetData(MEMORYDEVICE_CPU)), get_segment_ptr(m_rgbImageSegment), m_rgbImageSegment.second);
+}
+
+short *RGBDFrameMessage::get_depth_image_ptr()
+{
+  return reinterpret_cast<short*>(get_segment_ptr(m_depthImageSegment));
+}
+
+const short *RGBDFrameMessage::get_depth_image_ptr() const
+{
+  return reinterpret_cast<const short*>(get_segment_ptr(m_depthImageSegment));
 }
 
 const Vector2i& RGBDFrameMessage::get_depth_image_size() const
@@ -57,6 +67,16 @@ const Vector2i& RGBDFrameMessage::get_depth_image_size() const
   return m_depthImageSize;
 }
 
+Vector4u *RGBDFrameMessage::get_rgb_image_ptr()
+{
+  return reinterpret_cast<Vector4u*>(get_segment_ptr(m_rgbImageSegment));
+}
+
+const Vector4u *RGBDFrameMessage::get_rgb_image_ptr() const
+{
+  return reinterpret_cast<const Vector4u*>(get_segment_ptr(m_rgbImageSegment));
+}
+
 const Vector2i& RGBDFrameMessage::get_rgb_image_size() const
 {
   return m_rgbImageSize;
@@ -64,12 +84,12 @@ const Vector2i& RGBDFrameMessage::get_rgb_image_size() const
 
 void RGBDFrameMessage::set_depth_image(const ORShortImage_CPtr& depthImage)
 {
-  memcpy(&m_data[m_depthImageSegment.first], reinterpret_cast<const char*>(depthImage->GetData(MEMORYDEVICE_CPU)), m_depthImageSegment.second);
+  memcpy(get_segment_ptr(m_depthImageSegment), reinterpret_cast<const char*>(depthImage->GetData(MEMORYDEVICE_CPU)), m_depthImageSegment.second);
 }
 
 void RGBDFrameMessage::set_rgb_image(const ORUChar4Image_CPtr& rgbImage)
 {
-  memcpy(&m_data[m_rgbImageSegment.first], reinterpret_cast<const char*>(rgbImage->GetData(MEMORYDEVICE_CPU)), m_rgbImageSegment.second);
+  memcpy(get_segment_ptr(m_rgbImageSegment), reinterpret_cast<const char*>(rgbImage->GetData(MEMORYDEVICE_CPU)), m_rgbImageSegment.second);
 }
 
 }
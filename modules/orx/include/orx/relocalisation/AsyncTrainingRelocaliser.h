@@ -0,0 +1,244 @@
+/**
+ * orx: AsyncTrainingRelocaliser.h
+ * Copyright (c) Torr Vision Group, University of Oxford, 2019. All rights reserved.
+ */
+
+#ifndef H_ORX_ASYNCTRAININGRELOCALISER
+#define H_ORX_ASYNCTRAININGRELOCALISER
+
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread.hpp>
+
+#include <tvgutil/containers/PooledQueue.h>
+#include <tvgutil/misc/SettingsContainer.h>
+
+#include "Relocaliser.h"
+
+namespace orx {
+
+/**
+ * \brief An instance of this class can be used to decorate a relocaliser so that it is trained and updated asynchronously.
+ *
+ * Rather than training (or updating) the decorated relocaliser on the calling thread, each call to train (or update) takes
+ * a snapshot of its inputs and pushes it onto a bounded queue, from which a worker thread then applies the training steps
+ * to the decorated relocaliser in order. What happens if the queue is full when a new snapshot is taken is determined by
+ * the pool empty strategy of the queue: either the new snapshot is discarded (the default, so that the caller never blocks),
+ * or the caller waits for space on the queue. (The other strategies are not supported, see check_pool_empty_strategy.)
+ *
+ * Relocalisation calls are made on the calling thread, and are interleaved with the training steps, so that each of them
+ * sees the decorated relocaliser as it was after a whole number of training steps (its "model version"), and waits for at
+ * most one training step to finish rather than for the whole queue to drain. Calls that depend on the full training history
+ * (e.g. save_to_disk or finish_training), or that would invalidate it (e.g. reset or load_from_disk), wait for the queue to
+ * drain first. The decorated relocaliser is only ever called by one thread at a time, so it does not need to be thread-safe.
+ */
+class AsyncTrainingRelocaliser : public Relocaliser
+{
+  //#################### TYPEDEFS ####################
+private:
+  typedef boost::chrono::steady_clock::time_point TimePoint;
+
+  //#################### ENUMERATIONS ####################
+private:
+  /**
+   * \brief The values of this enumeration denote the different types of training step that can be queued.
+   */
+  enum TrainingStepType
+  {
+    /** A call to the decorated relocaliser's train function. */
+    TST_TRAIN,
+
+    /** A call to the decorated relocaliser's update function. */
+    TST_UPDATE
+  };
+
+  //#################### NESTED TYPES ####################
+private:
+  /**
+   * \brief An instance of this struct represents a snapshot of the inputs to a training step.
+   *
+   * \note  Instances of this struct are pooled, so their images are reused from one training step to the next.
+   */
+  struct TrainingStep
+  {
+    //~~~~~~~~~~~~~~~~~~~~ PUBLIC MEMBER VARIABLES ~~~~~~~~~~~~~~~~~~~~
+
+    /** The position of the camera in the world (train only). */
+    ORUtils::SE3Pose cameraPose;
+
+    /** A copy of the colour image (train only). */
+    ORUChar4Image_Ptr colourImage;
+
+    /** A copy of the depth image (train only). */
+    ORFloatImage_Ptr depthImage;
+
+    /** The intrinsic parameters of the depth sensor (train only). */
+    Vector4f depthIntrinsics;
+
+    /** The ID of the GPU that was current on the thread that queued the training step (if relevant). */
+    int device;
+
+    /** The time at which the training step was queued. */
+    TimePoint queueTime;
+
+    /** The type of training step. */
+    TrainingStepType type;
+  };
+
+  typedef boost::shared_ptr<TrainingStep> TrainingStep_Ptr;
+  typedef tvgutil::PooledQueue<TrainingStep_Ptr> TrainingStepQueue;
+
+  //#################### PRIVATE VARIABLES ####################
+private:
+  /** The number of training steps that have been discarded because the queue was full. */
+  size_t m_discardedTrainingStepCount;
+
+  /** A mutex that is held whilst the decorated relocaliser is being called, to make sure that only one thread calls it at a time. */
+  mutable boost::mutex m_modelMutex;
+
+  /** The number of training steps that have been applied to the decorated relocaliser since it was constructed. */
+  size_t m_modelVersion;
+
+  /** The time that elapsed between the most recently applied training step being queued and it being applied. */
+  boost::chrono::milliseconds m_mostRecentTrainingLag;
+
+  /** The synchronisation mutex. */
+  mutable boost::mutex m_mutex;
+
+  /** The relocaliser to decorate. */
+  Relocaliser_Ptr m_relocaliser;
+
+  /** The timer used to profile the training steps applied to the decorated relocaliser on the worker thread. */
+  AverageTimer m_timerTraining;
+
+  /** The queue of training steps that are waiting to be applied to the decorated relocaliser. */
+  mutable TrainingStepQueue m_trainingQueue;
+
+  /** A condition variable used to wait for training steps to be applied. */
+  mutable boost::condition_variable m_trainingStepApplied;
+
+  /** A flag set in the destructor to indicate that the worker thread should terminate. */
+  boost::atomic<bool> m_workerShouldTerminate;
+
+  /** The worker thread on which the training steps are applied. */
+  boost::shared_ptr<boost::thread> m_workerThread;
+
+  //#################### CONSTRUCTORS ####################
+public:
+  /**
+   * \brief Constructs an asynchronously-trained relocaliser.
+   *
+   * \param relocaliser       The relocaliser to decorate.
+   * \param settings          The settings to use.
+   * \param settingsNamespace The namespace associated with the settings that are specific to the relocaliser.
+   */
+  AsyncTrainingRelocaliser(const Relocaliser_Ptr& relocaliser, const tvgutil::SettingsContainer_CPtr& settings, const std::string& settingsNamespace);
+
+  //#################### DESTRUCTOR ####################
+public:
+  /**
+   * \brief Destroys the relocaliser.
+   *
+   * \note  Any training steps that are still in the queue are discarded.
+   */
+  ~AsyncTrainingRelocaliser();
+
+  //#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+private:
+  // Deliberately private and unimplemented.
+  AsyncTrainingRelocaliser(const AsyncTrainingRelocaliser&);
+  AsyncTrainingRelocaliser& operator=(const AsyncTrainingRelocaliser&);
+
+  //#################### PUBLIC MEMBER FUNCTIONS ####################
+public:
+  /** Override */
+  virtual void finish_training();
+
+  /**
+   * \brief Gets the number of training steps that have been discarded because the queue was full.
+   *
+   * \return  The number of training steps that have been discarded because the queue was full.
+   */
+  size_t get_discarded_training_step_count() const;
+
+  /**
+   * \brief Gets the number of training steps that have been applied to the decorated relocaliser since it was constructed.
+   *
+   * \return  The number of training steps that have been applied to the decorated relocaliser since it was constructed.
+   */
+  size_t get_model_version() const;
+
+  /**
+   * \brief Gets the time that elapsed between the most recently applied training step being queued and it being applied.
+   *
+   * \return  The time that elapsed between the most recently applied training step being queued and it being applied.
+   */
+  boost::chrono::milliseconds get_training_lag() const;
+
+  /**
+   * \brief Gets the number of training steps that have not yet been fully applied to the decorated relocaliser.
+   *
+   * \return  The number of training steps that have not yet been fully applied to the decorated relocaliser.
+   */
+  size_t get_training_queue_size() const;
+
+  /** Override */
+  virtual ORUChar4Image_CPtr get_visualisation_image(const std::string& key) const;
+
+  /** Override */
+  virtual void load_from_disk(const std::string& inputFolder);
+
+  /** Override */
+  virtual std::vector<Result> relocalise(const ORUChar4Image *colourImage, const ORFloatImage *depthImage, const Vector4f& depthIntrinsics) const;
+
+  /** Override */
+  virtual void reset();
+
+  /** Override */
+  virtual void save_to_disk(const std::string& outputFolder) const;
+
+  /** Override */
+  virtual void train(const ORUChar4Image *colourImage, const ORFloatImage *depthImage,
+                     const Vector4f& depthIntrinsics, const ORUtils::SE3Pose& cameraPose);
+
+  /** Override */
+  virtual void update();
+
+  /**
+   * \brief Waits for all of the training steps that are currently in the queue to be applied to the decorated relocaliser.
+   */
+  void wait_for_training() const;
+
+  //#################### PRIVATE MEMBER FUNCTIONS ####################
+private:
+  /**
+   * \brief Repeatedly applies the training steps in the queue to the decorated relocaliser, until the relocaliser is destroyed.
+   */
+  void run_worker();
+
+  //#################### PRIVATE STATIC MEMBER FUNCTIONS ####################
+private:
+  /**
+   * \brief Checks that the specified pool empty strategy can safely be used for the training queue.
+   *
+   * The worker thread only pops a training step from the queue once it has been applied, so the queue must never recycle the
+   * element at its front whilst it is in use (as the random replacement strategy can), and must remain bounded (which rules
+   * out the grow strategy). As a result, only the discard and wait strategies are supported.
+   *
+   * \param poolEmptyStrategy    The pool empty strategy.
+   * \return                     The pool empty strategy, if it is supported.
+   * \throws std::runtime_error  If the pool empty strategy is not supported.
+   */
+  static tvgutil::pooled_queue::PoolEmptyStrategy check_pool_empty_strategy(tvgutil::pooled_queue::PoolEmptyStrategy poolEmptyStrategy);
+
+  /**
+   * \brief Makes an empty training step with which to populate the pool that backs the training queue.
+   *
+   * \return  An empty training step.
+   */
+  static TrainingStep_Ptr make_training_step();
+};
+
+}
+
+#endif
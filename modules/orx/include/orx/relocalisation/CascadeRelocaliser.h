@@ -6,10 +6,13 @@
 #ifndef H_ORX_CASCADERELOCALISER
 #define H_ORX_CASCADERELOCALISER
 
+#include <boost/chrono.hpp>
 #include <boost/optional.hpp>
+#include <boost/thread.hpp>
 
 #include <tvgutil/filesystem/SequentialPathGenerator.h>
 #include <tvgutil/misc/SettingsContainer.h>
+#include <tvgutil/statistics/Histogram.h>
 
 #include "Relocaliser.h"
 
@@ -17,17 +20,74 @@ namespace orx {
 
 /**
  * \brief An instance of this class represents a cascade relocaliser that gradually falls back from faster, weaker relocalisers to slower, stronger ones.
+ *
+ * By default, each relocaliser in the cascade is only run once the previous one has returned a result that is not good enough,
+ * so a hard frame pays the latencies of all of the relocalisers in turn. In speculative mode, each relocaliser instead runs on
+ * its own worker thread, and the next relocaliser in the cascade is launched early (i.e. whilst the current one is still running)
+ * if either the current one has been running for longer than a specified delay, or it has recently had to fall back on a large
+ * proportion of frames. Speculative work that turns out not to be needed (because an earlier relocaliser succeeded) is cancelled
+ * if it has not yet started; otherwise, it is allowed to finish in the background and its results are discarded. Any subsequent
+ * calls that modify the inner relocalisers (e.g. train or reset) wait for it to finish first.
  */
 class CascadeRelocaliser : public Relocaliser
 {
+  //#################### TYPEDEFS ####################
+private:
+  typedef boost::chrono::steady_clock::time_point TimePoint;
+
+  //#################### NESTED TYPES ####################
+private:
+  /**
+   * \brief An instance of this struct represents a relocalisation request that is passed to the worker threads in speculative mode.
+   */
+  struct RelocalisationRequest
+  {
+    //~~~~~~~~~~~~~~~~~~~~ PUBLIC MEMBER VARIABLES ~~~~~~~~~~~~~~~~~~~~
+
+    /** A copy of the colour image to use for relocalisation (owned by the request, since it may outlive the relocalise call). */
+    ORUChar4Image_CPtr colourImage;
+
+    /** A copy of the depth image to use for relocalisation (owned by the request, since it may outlive the relocalise call). */
+    ORFloatImage_CPtr depthImage;
+
+    /** The intrinsic parameters of the depth sensor. */
+    Vector4f depthIntrinsics;
+
+    /** The ID of the GPU that was current on the thread that made the request (if relevant). */
+    int device;
+
+    /** The ID of the request. */
+    int id;
+  };
+
+  typedef boost::shared_ptr<const RelocalisationRequest> RelocalisationRequest_CPtr;
+
   //#################### PRIVATE MEMBER VARIABLES ####################
 private:
+  /** An exponential moving average of the rate at which each relocaliser in the cascade has fallen back to the next one (speculative mode only). */
+  mutable std::vector<float> m_fallbackRates;
+
+  /** The weight given to the most recent frame when updating the fallback rates. */
+  float m_fallbackRateUpdateWeight;
+
   /** The thresholds used to decide whether or not to fall back from one relocaliser in the cascade to the next. */
   std::vector<float> m_fallbackThresholds;
 
   /** The individual relocalisers in the cascade. */
   std::vector<Relocaliser_Ptr> m_innerRelocalisers;
 
+  /** The width (in milliseconds) of the bins in the per-relocaliser latency histograms. */
+  int m_latencyHistogramBinMs;
+
+  /** The path to a file in which to save the per-relocaliser latency histograms. */
+  std::string m_latencyHistogramsOutputFile;
+
+  /** The synchronisation mutex. */
+  mutable boost::mutex m_mutex;
+
+  /** The ID of the most recent relocalisation request (speculative mode only, and only accessed by the thread calling relocalise). */
+  mutable int m_mostRecentRequestID;
+
   /** The path generator used when saving the relocalised poses. */
   mutable boost::optional<tvgutil::SequentialPathGenerator> m_posePathGenerator;
 
@@ -37,6 +97,42 @@ private:
   /** Whether or not to save the average relocalisation times. */
   bool m_saveTimes;
 
+  /** Whether or not to launch the relocalisers in the cascade speculatively. */
+  bool m_speculative;
+
+  /** The times (in milliseconds) for which each relocaliser in the cascade (but the last) can run before the next one is launched speculatively (negative values mean never). */
+  std::vector<int> m_speculationDelaysMs;
+
+  /** The fallback rate above which to launch a relocaliser in the cascade at the same time as the previous one. */
+  float m_speculationFallbackRate;
+
+  /** The ID of the most recent request that each relocaliser in the cascade has finished processing (speculative mode only). */
+  mutable std::vector<int> m_stageCompletedRequestIDs;
+
+  /** A condition variable used to wait for the relocalisers in the cascade to finish processing requests (speculative mode only). */
+  mutable boost::condition_variable m_stageFinished;
+
+  /** Histograms of the latencies (in milliseconds, binned) of the relocalisers in the cascade (only recorded when the timers are enabled). */
+  mutable std::vector<tvgutil::Histogram<int> > m_stageLatencyHistograms;
+
+  /** The requests that each relocaliser in the cascade has yet to start processing, if any (speculative mode only). */
+  mutable std::vector<RelocalisationRequest_CPtr> m_stagePendingRequests;
+
+  /** A condition variable used to wait for new relocalisation requests to become available (speculative mode only). */
+  mutable boost::condition_variable m_stageRequested;
+
+  /** The results produced by each relocaliser in the cascade for the most recent request it has finished processing (speculative mode only). */
+  mutable std::vector<std::vector<Result> > m_stageResults;
+
+  /** Flags indicating whether or not each relocaliser in the cascade is currently processing a request (speculative mode only). */
+  mutable std::vector<bool> m_stagesRunning;
+
+  /** The worker threads on which the relocalisers in the cascade run (speculative mode only). */
+  std::vector<boost::shared_ptr<boost::thread> > m_stageThreads;
+
+  /** A flag set in the destructor to indicate that the worker threads should terminate. */
+  bool m_stageThreadsShouldTerminate;
+
   /** The timer used to profile the initial relocalisations. */
   mutable AverageTimer m_timerInitialRelocalisation;
 
@@ -84,6 +180,16 @@ public:
   /** Override */
   virtual void finish_training();
 
+  /**
+   * \brief Gets a histogram of the latencies of the specified relocaliser in the cascade.
+   *
+   * \note  Latencies are only recorded when the timers are enabled.
+   *
+   * \param stageIdx  The index of the relocaliser in the cascade.
+   * \return          A histogram of its latencies, in which each label is the lower bound (in milliseconds) of a latency bin.
+   */
+  tvgutil::Histogram<int> get_stage_latency_histogram(size_t stageIdx) const;
+
   /** Override */
   virtual ORUChar4Image_CPtr get_visualisation_image(const std::string& key) const;
 
@@ -108,6 +214,67 @@ public:
 
   //#################### PRIVATE MEMBER FUNCTIONS ####################
 private:
+  /**
+   * \brief Asks the specified relocaliser in the cascade to process the specified request on its worker thread (speculative mode only).
+   *
+   * \pre   The caller must hold m_mutex.
+   *
+   * \param stageIdx  The index of the relocaliser in the cascade.
+   * \param request   The relocalisation request.
+   */
+  void launch_stage(size_t stageIdx, const RelocalisationRequest_CPtr& request) const;
+
+  /**
+   * \brief Makes a new relocalisation request that owns copies of the specified images (speculative mode only).
+   *
+   * \param colourImage     The colour image.
+   * \param depthImage      The depth image.
+   * \param depthIntrinsics The intrinsic parameters of the depth sensor.
+   * \return                The relocalisation request.
+   */
+  RelocalisationRequest_CPtr make_request(const ORUChar4Image *colourImage, const ORFloatImage *depthImage, const Vector4f& depthIntrinsics) const;
+
+  /**
+   * \brief Records the latency of a call to the specified relocaliser in the cascade in its latency histogram.
+   *
+   * \pre   The caller must hold m_mutex.
+   *
+   * \param stageIdx  The index of the relocaliser in the cascade.
+   * \param latency   The latency of the call.
+   */
+  void record_stage_latency(size_t stageIdx, const boost::chrono::steady_clock::duration& latency) const;
+
+  /**
+   * \brief Relocalises by running each relocaliser in the cascade in turn (on the calling thread) until one succeeds.
+   *
+   * \param colourImage                   The colour image.
+   * \param depthImage                    The depth image.
+   * \param depthIntrinsics               The intrinsic parameters of the depth sensor.
+   * \param initialRelocalisationResults  An output vector into which to store the results of the first relocaliser in the cascade.
+   * \return                              The results of the last relocaliser in the cascade to be run.
+   */
+  std::vector<Result> relocalise_serial(const ORUChar4Image *colourImage, const ORFloatImage *depthImage, const Vector4f& depthIntrinsics,
+                                        std::vector<Result>& initialRelocalisationResults) const;
+
+  /**
+   * \brief Relocalises by running the relocalisers in the cascade on their worker threads, launching them speculatively where appropriate.
+   *
+   * \param colourImage                   The colour image.
+   * \param depthImage                    The depth image.
+   * \param depthIntrinsics               The intrinsic parameters of the depth sensor.
+   * \param initialRelocalisationResults  An output vector into which to store the results of the first relocaliser in the cascade.
+   * \return                              The results of the first relocaliser in the cascade that succeeded (or of the last one, if none did).
+   */
+  std::vector<Result> relocalise_speculative(const ORUChar4Image *colourImage, const ORFloatImage *depthImage, const Vector4f& depthIntrinsics,
+                                             std::vector<Result>& initialRelocalisationResults) const;
+
+  /**
+   * \brief Runs the worker thread for the specified relocaliser in the cascade (speculative mode only).
+   *
+   * \param stageIdx  The index of the relocaliser in the cascade.
+   */
+  void run_stage_worker(size_t stageIdx);
+
   /**
    * \brief Saves the relocalised and refined poses in text files so that they can be used later (e.g. for evaluation).
    *
@@ -117,6 +284,22 @@ private:
    * \param refinedPose     The result of refining the relocalised pose.
    */
   void save_poses(const Matrix4f& relocalisedPose, const Matrix4f& refinedPose) const;
+
+  /**
+   * \brief Determines whether or not the cascade should fall back from the specified relocaliser to the next one.
+   *
+   * \param stageIdx  The index of the relocaliser in the cascade.
+   * \param results   The results produced by the relocaliser.
+   * \return          true, if the cascade should fall back to the next relocaliser, or false otherwise.
+   */
+  bool should_fall_back(size_t stageIdx, const std::vector<Result>& results) const;
+
+  /**
+   * \brief Waits for all of the relocalisers in the cascade to finish any requests that they are processing (including cancelled ones).
+   *
+   * \note  This is a no-op in non-speculative mode.
+   */
+  void wait_for_stages() const;
 };
 
 }
@@ -6,28 +6,127 @@
 #ifndef H_ORX_ENSEMBLERELOCALISER
 #define H_ORX_ENSEMBLERELOCALISER
 
+#include <boost/chrono.hpp>
+#include <boost/thread.hpp>
+
+#include <tvgutil/misc/SettingsContainer.h>
+
 #include "Relocaliser.h"
 
 namespace orx {
 
 /**
  * \brief An instance of this class represents an ensemble relocaliser that combines the results of several other relocalisers.
+ *
+ * The ensemble can run in one of two modes:
+ *
+ * - In serial mode, the inner relocalisers are called one after the other on the calling thread, so the latency of each
+ *   relocalisation is the sum of the latencies of the inner relocalisers.
+ * - In parallel mode, each inner relocaliser runs on its own worker thread, so the latency of each relocalisation is that
+ *   of the slowest inner relocaliser. In addition, each inner relocaliser can be given a timeout, and the ensemble as a whole
+ *   can be given a budget: once a relocaliser's timeout (or the budget) has expired, the ensemble stops waiting for it, and
+ *   returns the best results that the other relocalisers managed to produce in time.
+ *
+ * \note  In parallel mode, an inner relocaliser that has timed out is allowed to finish its relocalisation in the background
+ *        (its results are then discarded). Any subsequent calls that modify the inner relocalisers (e.g. train or reset) wait
+ *        for it to finish first, so the inner relocalisers themselves do not need to be thread-safe.
  */
 class EnsembleRelocaliser : public Relocaliser
 {
+  //#################### TYPEDEFS ####################
+private:
+  typedef boost::chrono::steady_clock::time_point TimePoint;
+
+  //#################### NESTED TYPES ####################
+private:
+  /**
+   * \brief An instance of this struct represents a relocalisation request that is passed to the worker threads in parallel mode.
+   */
+  struct RelocalisationRequest
+  {
+    //~~~~~~~~~~~~~~~~~~~~ PUBLIC MEMBER VARIABLES ~~~~~~~~~~~~~~~~~~~~
+
+    /** The colour image to use for relocalisation. */
+    const ORUChar4Image *colourImage;
+
+    /** A copy of the colour image that is owned by the request (if any). This keeps the image alive for as long as the request is in use. */
+    ORUChar4Image_CPtr colourImageCopy;
+
+    /** The depth image to use for relocalisation. */
+    const ORFloatImage *depthImage;
+
+    /** A copy of the depth image that is owned by the request (if any). This keeps the image alive for as long as the request is in use. */
+    ORFloatImage_CPtr depthImageCopy;
+
+    /** The intrinsic parameters of the depth sensor. */
+    Vector4f depthIntrinsics;
+
+    /** The ID of the GPU that was current on the thread that made the request (if relevant). */
+    int device;
+
+    /** The ID of the request. */
+    int id;
+  };
+
+  typedef boost::shared_ptr<const RelocalisationRequest> RelocalisationRequest_CPtr;
+
   //#################### PRIVATE MEMBER VARIABLES ####################
 private:
+  /** The ID of the most recent request that each inner relocaliser has finished processing (parallel mode only). */
+  mutable std::vector<int> m_completedRequestIDs;
+
+  /** The current relocalisation request (parallel mode only). */
+  mutable RelocalisationRequest_CPtr m_currentRequest;
+
   /** The individual relocalisers in the ensemble. */
   std::vector<Relocaliser_Ptr> m_innerRelocalisers;
 
+  /** The results produced by each inner relocaliser for the most recent request it has finished processing (parallel mode only). */
+  mutable std::vector<std::vector<Result> > m_innerResults;
+
+  /** The maximum time (in milliseconds) for which each inner relocaliser is allowed to run in parallel mode (0 means no limit). */
+  std::vector<int> m_innerTimeoutsMs;
+
+  /** The synchronisation mutex (parallel mode only). */
+  mutable boost::mutex m_mutex;
+
+  /** Whether or not to run the inner relocalisers in parallel. */
+  bool m_parallel;
+
+  /** The maximum time (in milliseconds) for which a relocalisation is allowed to run in parallel mode (0 means no limit). */
+  int m_relocalisationBudgetMs;
+
+  /** A condition variable used to wait for new relocalisation requests to become available (parallel mode only). */
+  mutable boost::condition_variable m_requestAvailable;
+
+  /** A condition variable used to wait for inner relocalisers to finish processing requests (parallel mode only). */
+  mutable boost::condition_variable m_resultAvailable;
+
+  /** The worker threads on which the inner relocalisers run (parallel mode only). */
+  std::vector<boost::shared_ptr<boost::thread> > m_workerThreads;
+
+  /** A flag set in the destructor to indicate that the worker threads should terminate. */
+  bool m_workersShouldTerminate;
+
   //#################### CONSTRUCTORS ####################
 public:
   /**
    * \brief Constructs an ensemble relocaliser.
    *
    * \param innerRelocalisers The individual relocalisers in the ensemble.
+   * \param settings          The settings to use.
+   * \param settingsNamespace The namespace associated with the settings that are specific to the relocaliser.
+   *
+   * \throws std::runtime_error If the ensemble would be empty.
+   */
+  EnsembleRelocaliser(const std::vector<Relocaliser_Ptr>& innerRelocalisers, const tvgutil::SettingsContainer_CPtr& settings, const std::string& settingsNamespace);
+
+  //#################### DESTRUCTOR ####################
+public:
+  /**
+   * \brief Destroys the relocaliser.
    */
-  explicit EnsembleRelocaliser(const std::vector<Relocaliser_Ptr>& innerRelocalisers);
+  ~EnsembleRelocaliser();
 
   //#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
 private:
@@ -43,7 +142,15 @@ public:
   /** Override */
   virtual ORUChar4Image_CPtr get_visualisation_image(const std::string& key) const;
 
-  /** Override */
+  /**
+   * \brief Loads the relocaliser from disk.
+   *
+   * \note  Each inner relocaliser is loaded from its own subfolder of the input folder (R0, R1, etc.).
+   *
+   * \param inputFolder The folder containing the relocaliser data.
+   *
+   * \throws std::runtime_error If loading the relocaliser fails.
+   */
   virtual void load_from_disk(const std::string& inputFolder);
 
   /** Override */
@@ -52,7 +159,15 @@ public:
   /** Override */
   virtual void reset();
 
-  /** Override */
+  /**
+   * \brief Saves the relocaliser to disk.
+   *
+   * \note  Each inner relocaliser is saved into its own subfolder of the output folder (R0, R1, etc.).
+   *
+   * \param outputFolder  The folder into which to save the relocaliser data.
+   *
+   * \throws std::runtime_error If saving the relocaliser fails.
+   */
   virtual void save_to_disk(const std::string& outputFolder) const;
 
   /** Override */
@@ -62,6 +177,51 @@ public:
   /** Override */
   virtual void update();
 
+  //#################### PRIVATE MEMBER FUNCTIONS ####################
+private:
+  /**
+   * \brief Relocalises using all of the inner relocalisers at once (on the worker threads), and collects the results of those that finish in time.
+   *
+   * \param colourImage     The colour image.
+   * \param depthImage      The depth image.
+   * \param depthIntrinsics The intrinsic parameters of the depth sensor.
+   * \return                The combined (unsorted) results of the inner relocalisers that finished in time.
+   */
+  std::vector<Result> relocalise_parallel(const ORUChar4Image *colourImage, const ORFloatImage *depthImage, const Vector4f& depthIntrinsics) const;
+
+  /**
+   * \brief Relocalises using each of the inner relocalisers in turn (on the calling thread).
+   *
+   * \param colourImage     The colour image.
+   * \param depthImage      The depth image.
+   * \param depthIntrinsics The intrinsic parameters of the depth sensor.
+   * \return                The combined (unsorted) results of the inner relocalisers.
+   */
+  std::vector<Result> relocalise_serial(const ORUChar4Image *colourImage, const ORFloatImage *depthImage, const Vector4f& depthIntrinsics) const;
+
+  /**
+   * \brief Runs the worker thread for the specified inner relocaliser (parallel mode only).
+   *
+   * \param innerRelocaliserIdx The index of the inner relocaliser.
+   */
+  void run_worker(size_t innerRelocaliserIdx);
+
+  /**
+   * \brief Waits for the specified inner relocaliser to finish processing the current relocalisation request (if any).
+   *
+   * \note  This returns immediately if the inner relocaliser has already finished processing the request, and is a no-op in serial mode.
+   *
+   * \param innerRelocaliserIdx The index of the inner relocaliser.
+   */
+  void wait_for_worker(size_t innerRelocaliserIdx) const;
+
+  /**
+   * \brief Waits for all of the inner relocalisers to finish processing the current relocalisation request (if any).
+   *
+   * \note  This is a no-op in serial mode.
+   */
+  void wait_for_workers() const;
+
   //#################### PRIVATE STATIC MEMBER FUNCTIONS ####################
 private:
   /**
@@ -72,6 +232,15 @@ private:
    * \return    true, if the left-hand result should be ordered before the right-hand result, or false otherwise.
    */
   static bool compare_results(const Result& lhs, const Result& rhs);
+
+  /**
+   * \brief Gets the subfolder of the specified folder that is associated with the specified inner relocaliser.
+   *
+   * \param folder              The folder.
+   * \param innerRelocaliserIdx The index of the inner relocaliser.
+   * \return                    The subfolder associated with the inner relocaliser.
+   */
+  static std::string get_inner_relocaliser_folder(const std::string& folder, size_t innerRelocaliserIdx);
 };
 
 }
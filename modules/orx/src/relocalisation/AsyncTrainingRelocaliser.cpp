@@ -0,0 +1,277 @@
+/**
+ * orx: AsyncTrainingRelocaliser.cpp
+ * Copyright (c) Torr Vision Group, University of Oxford, 2019. All rights reserved.
+ */
+
+#include "relocalisation/AsyncTrainingRelocaliser.h"
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/bind.hpp>
+
+#include "base/MemoryBlockFactory.h"
+
+namespace orx {
+
+//#################### CONSTRUCTORS ####################
+
+AsyncTrainingRelocaliser::AsyncTrainingRelocaliser(const Relocaliser_Ptr& relocaliser, const tvgutil::SettingsContainer_CPtr& settings, const std::string& settingsNamespace)
+: m_discardedTrainingStepCount(0),
+  m_modelVersion(0),
+  m_mostRecentTrainingLag(0),
+  m_relocaliser(relocaliser),
+  m_timerTraining("Training"),
+  m_trainingQueue(check_pool_empty_strategy(settings->get_first_value<tvgutil::pooled_queue::PoolEmptyStrategy>(settingsNamespace + "poolEmptyStrategy", tvgutil::pooled_queue::PES_DISCARD))),
+  m_workerShouldTerminate(false)
+{
+  m_timersEnabled = settings->get_first_value<bool>(settingsNamespace + "timersEnabled", false);
+
+  // Set up the pool that backs the training queue. Its capacity bounds the number of training steps that can be waiting at any one time.
+  const size_t queueCapacity = settings->get_first_value<size_t>(settingsNamespace + "queueCapacity", 8);
+  m_trainingQueue.initialise(queueCapacity, &make_training_step);
+
+  // Start the worker thread.
+  m_workerThread.reset(new boost::thread(boost::bind(&AsyncTrainingRelocaliser::run_worker, this)));
+}
+
+//#################### DESTRUCTOR ####################
+
+AsyncTrainingRelocaliser::~AsyncTrainingRelocaliser()
+{
+  // Tell the worker thread to terminate, and push a dummy training step onto the queue to wake it up if it's waiting for one.
+  // As in MappingClient, the push cannot block, since the pool can only be empty if the queue is non-empty, in which case the
+  // worker thread isn't waiting and will pop a training step (freeing up a pool element) shortly.
+  m_workerShouldTerminate = true;
+  m_trainingQueue.begin_push();
+  m_workerThread->join();
+
+  if(m_timersEnabled)
+  {
+    std::cout << "Asynchronous training steps: " << m_timerTraining.count() << ", average duration: " << m_timerTraining.average_duration() << '\n';
+    std::cout << "Discarded training steps: " << m_discardedTrainingStepCount << '\n';
+  }
+}
+
+//#################### PUBLIC MEMBER FUNCTIONS ####################
+
+void AsyncTrainingRelocaliser::finish_training()
+{
+  wait_for_training();
+
+  boost::lock_guard<boost::mutex> lock(m_modelMutex);
+  m_relocaliser->finish_training();
+}
+
+size_t AsyncTrainingRelocaliser::get_discarded_training_step_count() const
+{
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  return m_discardedTrainingStepCount;
+}
+
+size_t AsyncTrainingRelocaliser::get_model_version() const
+{
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  return m_modelVersion;
+}
+
+boost::chrono::milliseconds AsyncTrainingRelocaliser::get_training_lag() const
+{
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  return m_mostRecentTrainingLag;
+}
+
+size_t AsyncTrainingRelocaliser::get_training_queue_size() const
+{
+  return m_trainingQueue.size();
+}
+
+ORUChar4Image_CPtr AsyncTrainingRelocaliser::get_visualisation_image(const std::string& key) const
+{
+  boost::lock_guard<boost::mutex> lock(m_modelMutex);
+  return m_relocaliser->get_visualisation_image(key);
+}
+
+void AsyncTrainingRelocaliser::load_from_disk(const std::string& inputFolder)
+{
+  wait_for_training();
+
+  boost::lock_guard<boost::mutex> lock(m_modelMutex);
+  m_relocaliser->load_from_disk(inputFolder);
+}
+
+std::vector<Relocaliser::Result>
+AsyncTrainingRelocaliser::relocalise(const ORUChar4Image *colourImage, const ORFloatImage *depthImage, const Vector4f& depthIntrinsics) const
+{
+  // Note that we deliberately don't wait for the queue to drain here: we only wait for any training step that is currently
+  // being applied to finish, so that the decorated relocaliser is in a consistent state whilst we're relocalising with it.
+  boost::lock_guard<boost::mutex> lock(m_modelMutex);
+  return m_relocaliser->relocalise(colourImage, depthImage, depthIntrinsics);
+}
+
+void AsyncTrainingRelocaliser::reset()
+{
+  wait_for_training();
+
+  boost::lock_guard<boost::mutex> lock(m_modelMutex);
+  m_relocaliser->reset();
+}
+
+void AsyncTrainingRelocaliser::save_to_disk(const std::string& outputFolder) const
+{
+  wait_for_training();
+
+  boost::lock_guard<boost::mutex> lock(m_modelMutex);
+  m_relocaliser->save_to_disk(outputFolder);
+}
+
+void AsyncTrainingRelocaliser::train(const ORUChar4Image *colourImage, const ORFloatImage *depthImage,
+                                     const Vector4f& depthIntrinsics, const ORUtils::SE3Pose& cameraPose)
+{
+  TrainingStepQueue::PushHandler_Ptr pushHandler = m_trainingQueue.begin_push();
+  boost::optional<TrainingStep_Ptr&> elt = pushHandler->get();
+  if(!elt)
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    ++m_discardedTrainingStepCount;
+    return;
+  }
+
+  TrainingStep& step = **elt;
+
+  // Snapshot the input images into the training step's own images (reallocating them if the image sizes have changed),
+  // since the caller's images will generally be overwritten before the worker thread gets round to using them.
+  colourImage->UpdateHostFromDevice();
+  depthImage->UpdateHostFromDevice();
+
+  const MemoryBlockFactory& mbf = MemoryBlockFactory::instance();
+  if(!step.colourImage || step.colourImage->noDims != colourImage->noDims) step.colourImage = mbf.make_image<Vector4u>(colourImage->noDims);
+  if(!step.depthImage || step.depthImage->noDims != depthImage->noDims) step.depthImage = mbf.make_image<float>(depthImage->noDims);
+
+  step.colourImage->SetFrom(colourImage, ORUChar4Image::CPU_TO_CPU);
+  step.depthImage->SetFrom(depthImage, ORFloatImage::CPU_TO_CPU);
+  step.colourImage->UpdateDeviceFromHost();
+  step.depthImage->UpdateDeviceFromHost();
+
+  step.cameraPose = cameraPose;
+  step.depthIntrinsics = depthIntrinsics;
+  step.queueTime = boost::chrono::steady_clock::now();
+  step.type = TST_TRAIN;
+
+#ifdef WITH_CUDA
+  ORcudaSafeCall(cudaGetDevice(&step.device));
+#else
+  step.device = 0;
+#endif
+
+  // Note: The step is actually pushed onto the queue when the push handler is destroyed.
+}
+
+void AsyncTrainingRelocaliser::update()
+{
+  TrainingStepQueue::PushHandler_Ptr pushHandler = m_trainingQueue.begin_push();
+  boost::optional<TrainingStep_Ptr&> elt = pushHandler->get();
+  if(!elt)
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    ++m_discardedTrainingStepCount;
+    return;
+  }
+
+  TrainingStep& step = **elt;
+  step.queueTime = boost::chrono::steady_clock::now();
+  step.type = TST_UPDATE;
+
+#ifdef WITH_CUDA
+  ORcudaSafeCall(cudaGetDevice(&step.device));
+#else
+  step.device = 0;
+#endif
+}
+
+void AsyncTrainingRelocaliser::wait_for_training() const
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  while(!m_trainingQueue.empty()) m_trainingStepApplied.wait(lock);
+}
+
+//#################### PRIVATE MEMBER FUNCTIONS ####################
+
+void AsyncTrainingRelocaliser::run_worker()
+{
+  for(;;)
+  {
+    // Read the first training step from the queue (this will block until one is available).
+    TrainingStep_Ptr step = m_trainingQueue.peek();
+
+    // If the relocaliser is being destroyed, stop training. As in MappingClient, we must still pop the training step from
+    // the queue, since the destructor may be waiting to push a dummy training step onto it.
+    if(m_workerShouldTerminate)
+    {
+      m_trainingQueue.pop();
+      break;
+    }
+
+#ifdef WITH_CUDA
+    // Make sure that the training step is applied on the same GPU as the thread that queued it.
+    ORcudaSafeCall(cudaSetDevice(step->device));
+#endif
+
+    // Apply the training step to the decorated relocaliser. If it fails, skip it.
+    {
+      boost::lock_guard<boost::mutex> lock(m_modelMutex);
+      start_timer_sync(m_timerTraining);
+
+      try
+      {
+        if(step->type == TST_TRAIN) m_relocaliser->train(step->colourImage.get(), step->depthImage.get(), step->depthIntrinsics, step->cameraPose);
+        else m_relocaliser->update();
+      }
+      catch(std::exception& e)
+      {
+        std::cerr << "Warning: Asynchronous training step failed: " << e.what() << '\n';
+      }
+
+      stop_timer_sync(m_timerTraining);
+    }
+
+    // Record that the model has changed, and pop the training step from the queue. Note that we only pop the training step
+    // once it has been applied, so that the queue doesn't appear to be empty whilst it's being applied, and that we do so
+    // whilst holding the synchronisation mutex, so that wait_for_training cannot miss the wake-up below.
+    {
+      boost::lock_guard<boost::mutex> lock(m_mutex);
+      ++m_modelVersion;
+      m_mostRecentTrainingLag = boost::chrono::duration_cast<boost::chrono::milliseconds>(boost::chrono::steady_clock::now() - step->queueTime);
+      m_trainingQueue.pop();
+    }
+
+    // Wake up anyone waiting for training to finish.
+    m_trainingStepApplied.notify_all();
+  }
+}
+
+//#################### PRIVATE STATIC MEMBER FUNCTIONS ####################
+
+tvgutil::pooled_queue::PoolEmptyStrategy AsyncTrainingRelocaliser::check_pool_empty_strategy(tvgutil::pooled_queue::PoolEmptyStrategy poolEmptyStrategy)
+{
+  switch(poolEmptyStrategy)
+  {
+    case tvgutil::pooled_queue::PES_DISCARD:
+    case tvgutil::pooled_queue::PES_WAIT:
+      return poolEmptyStrategy;
+    default:
+    {
+      std::ostringstream oss;
+      oss << "Error: The '" << poolEmptyStrategy << "' pool empty strategy is not supported by AsyncTrainingRelocaliser (use 'discard' or 'wait')";
+      throw std::runtime_error(oss.str());
+    }
+  }
+}
+
+AsyncTrainingRelocaliser::TrainingStep_Ptr AsyncTrainingRelocaliser::make_training_step()
+{
+  return TrainingStep_Ptr(new TrainingStep);
+}
+
+}
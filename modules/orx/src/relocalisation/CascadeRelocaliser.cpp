@@ -9,10 +9,13 @@
 #include <iostream>
 #include <stdexcept>
 
+#include <boost/bind.hpp>
+
 #include <tvgutil/filesystem/PathFinder.h>
 #include <tvgutil/timing/TimeUtil.h>
 using namespace tvgutil;
 
+#include "base/MemoryBlockFactory.h"
 #include "persistence/PosePersister.h"
 
 #define DEBUGGING 0
@@ -23,6 +26,8 @@ namespace orx {
 
 CascadeRelocaliser::CascadeRelocaliser(const std::vector<Relocaliser_Ptr>& innerRelocalisers, const SettingsContainer_CPtr& settings, const std::string& settingsNamespace)
 : m_innerRelocalisers(innerRelocalisers),
+  m_mostRecentRequestID(0),
+  m_stageThreadsShouldTerminate(false),
   m_timerInitialRelocalisation("Initial Relocalisation"),
   m_timerRefinement("ICP Refinement"),
   m_timerRelocalisation("Relocalisation"),
@@ -38,15 +43,24 @@ CascadeRelocaliser::CascadeRelocaliser(const std::vector<Relocaliser_Ptr>& inner
   // Configure the cascade relocaliser based on the settings that have been passed in.
   const std::string experimentTag = settings->get_first_value<std::string>("experimentTag", TimeUtil::get_iso_timestamp());
 
+  m_fallbackRateUpdateWeight = settings->get_first_value<float>(settingsNamespace + "fallbackRateUpdateWeight", 0.2f);
+  m_latencyHistogramBinMs = settings->get_first_value<int>(settingsNamespace + "latencyHistogramBinMs", 5);
   m_savePoses = settings->get_first_value<bool>(settingsNamespace + "saveRelocalisationPoses", false);
   m_saveTimes = settings->get_first_value<bool>(settingsNamespace + "saveRelocalisationTimes", false);
+  m_speculative = settings->get_first_value<bool>(settingsNamespace + "speculative", false);
+  m_speculationFallbackRate = settings->get_first_value<float>(settingsNamespace + "speculationFallbackRate", 0.5f);
   m_timersEnabled = settings->get_first_value<bool>(settingsNamespace + "timersEnabled", false);
 
+  const int defaultSpeculationDelayMs = settings->get_first_value<int>(settingsNamespace + "speculationDelayMs", -1);
   for(size_t i = 0, size = m_innerRelocalisers.size(); i < size - 1; ++i)
   {
-    m_fallbackThresholds.push_back(settings->get_first_value<float>(settingsNamespace + "fallbackThreshold" + boost::lexical_cast<std::string>(i)));
+    const std::string suffix = boost::lexical_cast<std::string>(i);
+    m_fallbackThresholds.push_back(settings->get_first_value<float>(settingsNamespace + "fallbackThreshold" + suffix));
+    m_speculationDelaysMs.push_back(settings->get_first_value<int>(settingsNamespace + "speculationDelayMs" + suffix, defaultSpeculationDelayMs));
   }
 
+  m_stageLatencyHistograms.resize(m_innerRelocalisers.size());
+
   // If the user wants to save the poses:
   if(m_savePoses)
   {
@@ -68,8 +82,25 @@ CascadeRelocaliser::CascadeRelocaliser(const std::vector<Relocaliser_Ptr>& inner
     boost::filesystem::path timersOutputFolder(find_subdir_from_executable("reloc_times"));
     boost::filesystem::create_directories(timersOutputFolder);
 
-    // Construct the output filename.
+    // Construct the output filenames.
     m_timersOutputFile = (timersOutputFolder / (experimentTag + ".txt")).string();
+    m_latencyHistogramsOutputFile = (timersOutputFolder / (experimentTag + "_latencies.txt")).string();
+  }
+
+  // If we're running in speculative mode, start a worker thread for each relocaliser in the cascade.
+  if(m_speculative)
+  {
+    const size_t stageCount = m_innerRelocalisers.size();
+    m_fallbackRates.resize(stageCount, 0.0f);
+    m_stageCompletedRequestIDs.resize(stageCount, 0);
+    m_stagePendingRequests.resize(stageCount);
+    m_stageResults.resize(stageCount);
+    m_stagesRunning.resize(stageCount, false);
+
+    for(size_t i = 0; i < stageCount; ++i)
+    {
+      m_stageThreads.push_back(boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&CascadeRelocaliser::run_stage_worker, this, i))));
+    }
   }
 }
 
@@ -77,6 +108,19 @@ CascadeRelocaliser::CascadeRelocaliser(const std::vector<Relocaliser_Ptr>& inner
 
 CascadeRelocaliser::~CascadeRelocaliser()
 {
+  // Stop the worker threads (if any), waiting for any relocalisers that are still running to finish first.
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_stageThreadsShouldTerminate = true;
+  }
+
+  m_stageRequested.notify_all();
+
+  for(size_t i = 0, size = m_stageThreads.size(); i < size; ++i)
+  {
+    m_stageThreads[i]->join();
+  }
+
   if(m_timersEnabled)
   {
     std::cout << "Training calls: " << m_timerTraining.count() << ", average duration: " << m_timerTraining.average_duration() << '\n';
@@ -84,6 +128,11 @@ CascadeRelocaliser::~CascadeRelocaliser()
     std::cout << "Initial Relocalisation calls: " << m_timerInitialRelocalisation.count() << ", average duration: " << m_timerInitialRelocalisation.average_duration() << '\n';
     std::cout << "ICP Refinement calls: " << m_timerRefinement.count() << ", average duration: " << m_timerRefinement.average_duration() << '\n';
     std::cout << "Total Relocalisation calls: " << m_timerRelocalisation.count() << ", average duration: " << m_timerRelocalisation.average_duration() << '\n';
+
+    for(size_t i = 0, size = m_stageLatencyHistograms.size(); i < size; ++i)
+    {
+      std::cout << "Relocaliser " << i << " calls: " << m_stageLatencyHistograms[i].get_count() << ", latencies (ms): " << m_stageLatencyHistograms[i] << '\n';
+    }
   }
 
   if(m_saveTimes)
@@ -97,6 +146,19 @@ CascadeRelocaliser::~CascadeRelocaliser()
         << m_timerInitialRelocalisation.average_duration().count() << ' '
         << m_timerRefinement.average_duration().count() << ' '
         << m_timerRelocalisation.average_duration().count() << '\n';
+
+    // Output the per-relocaliser latency histograms, one bin per line (relocaliser index, bin lower bound in ms, count).
+    std::cout << "Saving relocalisation latency histograms in: " << m_latencyHistogramsOutputFile << '\n';
+    std::ofstream histogramsOut(m_latencyHistogramsOutputFile.c_str());
+
+    for(size_t i = 0, size = m_stageLatencyHistograms.size(); i < size; ++i)
+    {
+      const std::map<int,size_t>& bins = m_stageLatencyHistograms[i].get_bins();
+      for(std::map<int,size_t>::const_iterator it = bins.begin(), iend = bins.end(); it != iend; ++it)
+      {
+        histogramsOut << i << ' ' << it->first << ' ' << it->second << '\n';
+      }
+    }
   }
 }
 
@@ -104,20 +166,32 @@ CascadeRelocaliser::~CascadeRelocaliser()
 
 void CascadeRelocaliser::finish_training()
 {
+  wait_for_stages();
+
   for(size_t i = 0, size = m_innerRelocalisers.size(); i < size; ++i)
   {
     m_innerRelocalisers[i]->finish_training();
   }
 }
 
+Histogram<int> CascadeRelocaliser::get_stage_latency_histogram(size_t stageIdx) const
+{
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  return m_stageLatencyHistograms[stageIdx];
+}
+
 ORUChar4Image_CPtr CascadeRelocaliser::get_visualisation_image(const std::string& key) const
 {
+  wait_for_stages();
+
   // FIXME: Returning the image from the first relocaliser will do for now, but longer-term we should do this properly.
   return m_innerRelocalisers[0]->get_visualisation_image(key);
 }
 
 void CascadeRelocaliser::load_from_disk(const std::string& inputFolder)
 {
+  wait_for_stages();
+
   for(size_t i = 0, size = m_innerRelocalisers.size(); i < size; ++i)
   {
     m_innerRelocalisers[i]->load_from_disk(inputFolder);
@@ -134,35 +208,13 @@ CascadeRelocaliser::relocalise(const ORUChar4Image *colourImage, const ORFloatIm
 #endif
 
   start_timer_sync(m_timerRelocalisation);
-  start_timer_nosync(m_timerInitialRelocalisation); // No need to synchronize the GPU again.
-
-  // Try to relocalise using the first relocaliser in the cascade.
-  std::vector<Result> initialRelocalisationResults = m_innerRelocalisers[0]->relocalise(colourImage, depthImage, depthIntrinsics);
-  std::vector<Result> relocalisationResults = initialRelocalisationResults;
-
-  stop_timer_sync(m_timerInitialRelocalisation);
-  start_timer_nosync(m_timerRefinement); // No need to synchronize the GPU again.
-
-#if DEBUGGING
-  static std::vector<int> relocalisationCounts(m_innerRelocalisers.size());
-#endif
-
-  // For each other relocaliser in the cascade:
-  for(size_t i = 1, size = m_innerRelocalisers.size(); i < size; ++i)
-  {
-    // If either there is no current best relocalisation result or it's not good enough:
-    if(relocalisationResults.empty() || relocalisationResults[0].score > m_fallbackThresholds[i-1])
-    {
-#if DEBUGGING
-      std::cout << "Using inner relocaliser " << i << " to relocalise: " << relocalisationCounts[i]++ << ".\n";
-#endif
 
-      // Try to relocalise using the new relocaliser.
-      relocalisationResults = m_innerRelocalisers[i]->relocalise(colourImage, depthImage, depthIntrinsics);
-    }
-  }
+  // Run the cascade, either speculatively or one relocaliser at a time.
+  std::vector<Result> initialRelocalisationResults;
+  std::vector<Result> relocalisationResults = m_speculative
+    ? relocalise_speculative(colourImage, depthImage, depthIntrinsics, initialRelocalisationResults)
+    : relocalise_serial(colourImage, depthImage, depthIntrinsics, initialRelocalisationResults);
 
-  stop_timer_sync(m_timerRefinement);
   stop_timer_nosync(m_timerRelocalisation); // No need to synchronize the GPU again.
 
   // Save the best initial and refined poses if needed.
@@ -195,6 +247,11 @@ CascadeRelocaliser::relocalise(const ORUChar4Image *colourImage, const ORFloatIm
 
 void CascadeRelocaliser::reset()
 {
+  wait_for_stages();
+
+  // Forget the fallback history of the relocalisers, since it will no longer be relevant.
+  std::fill(m_fallbackRates.begin(), m_fallbackRates.end(), 0.0f);
+
   for(size_t i = 0, size = m_innerRelocalisers.size(); i < size; ++i)
   {
     m_innerRelocalisers[i]->reset();
@@ -203,6 +260,8 @@ void CascadeRelocaliser::reset()
 
 void CascadeRelocaliser::save_to_disk(const std::string& outputFolder) const
 {
+  wait_for_stages();
+
   for(size_t i = 0, size = m_innerRelocalisers.size(); i < size; ++i)
   {
     m_innerRelocalisers[i]->save_to_disk(outputFolder);
@@ -212,6 +271,8 @@ void CascadeRelocaliser::save_to_disk(const std::string& outputFolder) const
 void CascadeRelocaliser::train(const ORUChar4Image *colourImage, const ORFloatImage *depthImage,
                                const Vector4f& depthIntrinsics, const ORUtils::SE3Pose& cameraPose)
 {
+  wait_for_stages();
+
   start_timer_sync(m_timerTraining);
 
   for(size_t i = 0, size = m_innerRelocalisers.size(); i < size; ++i)
@@ -224,6 +285,8 @@ void CascadeRelocaliser::train(const ORUChar4Image *colourImage, const ORFloatIm
 
 void CascadeRelocaliser::update()
 {
+  wait_for_stages();
+
   start_timer_sync(m_timerUpdate);
 
   for(size_t i = 0, size = m_innerRelocalisers.size(); i < size; ++i)
@@ -236,6 +299,241 @@ void CascadeRelocaliser::update()
 
 //#################### PRIVATE MEMBER FUNCTIONS ####################
 
+void CascadeRelocaliser::launch_stage(size_t stageIdx, const RelocalisationRequest_CPtr& request) const
+{
+  m_stagePendingRequests[stageIdx] = request;
+  m_stageRequested.notify_all();
+}
+
+CascadeRelocaliser::RelocalisationRequest_CPtr
+CascadeRelocaliser::make_request(const ORUChar4Image *colourImage, const ORFloatImage *depthImage, const Vector4f& depthIntrinsics) const
+{
+  boost::shared_ptr<RelocalisationRequest> request(new RelocalisationRequest);
+
+  // Copy the colour and depth images we want to use for relocalisation across to the CPU.
+  colourImage->UpdateHostFromDevice();
+  depthImage->UpdateHostFromDevice();
+
+  // Make copies of the images that are owned by the request, since speculative relocalisations may outlive the caller's images.
+  const MemoryBlockFactory& mbf = MemoryBlockFactory::instance();
+  ORUChar4Image_Ptr colourImageCopy = mbf.make_image<Vector4u>(colourImage->noDims);
+  ORFloatImage_Ptr depthImageCopy = mbf.make_image<float>(depthImage->noDims);
+
+  colourImageCopy->SetFrom(colourImage, ORUChar4Image::CPU_TO_CPU);
+  depthImageCopy->SetFrom(depthImage, ORFloatImage::CPU_TO_CPU);
+  colourImageCopy->UpdateDeviceFromHost();
+  depthImageCopy->UpdateDeviceFromHost();
+
+  request->colourImage = colourImageCopy;
+  request->depthImage = depthImageCopy;
+  request->depthIntrinsics = depthIntrinsics;
+  request->id = ++m_mostRecentRequestID;
+
+#ifdef WITH_CUDA
+  ORcudaSafeCall(cudaGetDevice(&request->device));
+#else
+  request->device = 0;
+#endif
+
+  return request;
+}
+
+void CascadeRelocaliser::record_stage_latency(size_t stageIdx, const boost::chrono::steady_clock::duration& latency) const
+{
+  if(!m_timersEnabled) return;
+
+  const int latencyMs = static_cast<int>(boost::chrono::duration_cast<boost::chrono::milliseconds>(latency).count());
+  m_stageLatencyHistograms[stageIdx].add(latencyMs / m_latencyHistogramBinMs * m_latencyHistogramBinMs);
+}
+
+std::vector<Relocaliser::Result>
+CascadeRelocaliser::relocalise_serial(const ORUChar4Image *colourImage, const ORFloatImage *depthImage, const Vector4f& depthIntrinsics,
+                                      std::vector<Result>& initialRelocalisationResults) const
+{
+  start_timer_nosync(m_timerInitialRelocalisation); // No need to synchronize the GPU again.
+
+  // Try to relocalise using the first relocaliser in the cascade.
+  TimePoint startTime = boost::chrono::steady_clock::now();
+  initialRelocalisationResults = m_innerRelocalisers[0]->relocalise(colourImage, depthImage, depthIntrinsics);
+  std::vector<Result> relocalisationResults = initialRelocalisationResults;
+
+  stop_timer_sync(m_timerInitialRelocalisation);
+  start_timer_nosync(m_timerRefinement); // No need to synchronize the GPU again.
+
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    record_stage_latency(0, boost::chrono::steady_clock::now() - startTime);
+  }
+
+#if DEBUGGING
+  static std::vector<int> relocalisationCounts(m_innerRelocalisers.size());
+#endif
+
+  // For each other relocaliser in the cascade:
+  for(size_t i = 1, size = m_innerRelocalisers.size(); i < size; ++i)
+  {
+    // If either there is no current best relocalisation result or it's not good enough:
+    if(should_fall_back(i - 1, relocalisationResults))
+    {
+#if DEBUGGING
+      std::cout << "Using inner relocaliser " << i << " to relocalise: " << relocalisationCounts[i]++ << ".\n";
+#endif
+
+      // Try to relocalise using the new relocaliser.
+      startTime = boost::chrono::steady_clock::now();
+      relocalisationResults = m_innerRelocalisers[i]->relocalise(colourImage, depthImage, depthIntrinsics);
+
+      boost::lock_guard<boost::mutex> lock(m_mutex);
+      record_stage_latency(i, boost::chrono::steady_clock::now() - startTime);
+    }
+  }
+
+  stop_timer_sync(m_timerRefinement);
+
+  return relocalisationResults;
+}
+
+std::vector<Relocaliser::Result>
+CascadeRelocaliser::relocalise_speculative(const ORUChar4Image *colourImage, const ORFloatImage *depthImage, const Vector4f& depthIntrinsics,
+                                           std::vector<Result>& initialRelocalisationResults) const
+{
+  const size_t stageCount = m_innerRelocalisers.size();
+  RelocalisationRequest_CPtr request = make_request(colourImage, depthImage, depthIntrinsics);
+
+  start_timer_nosync(m_timerInitialRelocalisation);
+
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+
+  // Launch the first relocaliser in the cascade.
+  std::vector<TimePoint> launchTimes(stageCount, TimePoint::max());
+  launchTimes[0] = boost::chrono::steady_clock::now();
+  launch_stage(0, request);
+  size_t launchedStageCount = 1;
+
+  std::vector<Result> relocalisationResults;
+  size_t stageIdx = 0;
+  for(;;)
+  {
+    // Launch the next relocaliser(s) in the cascade early if the last one to have been launched is likely to fall back,
+    // either because it has often done so recently or because it has already been running for too long. If there is a
+    // relocaliser that we may want to launch later on, note the time at which we would want to do so.
+    TimePoint speculationTime = TimePoint::max();
+    while(launchedStageCount < stageCount)
+    {
+      const size_t prevStageIdx = launchedStageCount - 1;
+      const TimePoint now = boost::chrono::steady_clock::now();
+
+      bool launch = m_fallbackRates[prevStageIdx] >= m_speculationFallbackRate;
+      if(!launch && m_speculationDelaysMs[prevStageIdx] >= 0)
+      {
+        speculationTime = launchTimes[prevStageIdx] + boost::chrono::milliseconds(m_speculationDelaysMs[prevStageIdx]);
+        launch = speculationTime <= now;
+      }
+
+      if(!launch) break;
+
+      launchTimes[launchedStageCount] = now;
+      launch_stage(launchedStageCount++, request);
+      speculationTime = TimePoint::max();
+    }
+
+    // If the current relocaliser has not yet finished, wait for it to do so (or until it's time to launch the next one).
+    if(m_stageCompletedRequestIDs[stageIdx] != request->id)
+    {
+      if(speculationTime == TimePoint::max()) m_stageFinished.wait(lock);
+      else m_stageFinished.wait_until(lock, speculationTime);
+      continue;
+    }
+
+    relocalisationResults = m_stageResults[stageIdx];
+
+    if(stageIdx == 0)
+    {
+      initialRelocalisationResults = relocalisationResults;
+      stop_timer_nosync(m_timerInitialRelocalisation);
+      start_timer_nosync(m_timerRefinement);
+    }
+
+    // If this is the last relocaliser in the cascade, we're done.
+    if(stageIdx + 1 == stageCount) break;
+
+    // Otherwise, update its fallback rate, and stop if it succeeded.
+    const bool fallBack = should_fall_back(stageIdx, relocalisationResults);
+    m_fallbackRates[stageIdx] += m_fallbackRateUpdateWeight * ((fallBack ? 1.0f : 0.0f) - m_fallbackRates[stageIdx]);
+    if(!fallBack) break;
+
+    // If we get here, we need to fall back to the next relocaliser, so launch it if it hasn't already been launched speculatively.
+    ++stageIdx;
+    if(launchedStageCount == stageIdx)
+    {
+      launchTimes[stageIdx] = boost::chrono::steady_clock::now();
+      launch_stage(launchedStageCount++, request);
+    }
+  }
+
+  // Cancel any speculatively-launched relocalisers that turned out not to be needed and have not yet started. Any that have
+  // already started will finish in the background, and their results will be ignored.
+  for(size_t i = stageIdx + 1; i < launchedStageCount; ++i)
+  {
+    if(m_stagePendingRequests[i] == request) m_stagePendingRequests[i].reset();
+  }
+
+  lock.unlock();
+  m_stageFinished.notify_all();
+
+  stop_timer_nosync(m_timerRefinement);
+
+  return relocalisationResults;
+}
+
+void CascadeRelocaliser::run_stage_worker(size_t stageIdx)
+{
+  for(;;)
+  {
+    // Wait for a relocalisation request (or for termination to be requested).
+    RelocalisationRequest_CPtr request;
+    {
+      boost::unique_lock<boost::mutex> lock(m_mutex);
+      while(!m_stageThreadsShouldTerminate && !m_stagePendingRequests[stageIdx]) m_stageRequested.wait(lock);
+
+      // If we were asked to terminate, do so.
+      if(m_stageThreadsShouldTerminate) return;
+
+      request = m_stagePendingRequests[stageIdx];
+      m_stagePendingRequests[stageIdx].reset();
+      m_stagesRunning[stageIdx] = true;
+    }
+
+#ifdef WITH_CUDA
+    // Make sure that the relocaliser runs on the same GPU as the thread that made the request.
+    ORcudaSafeCall(cudaSetDevice(request->device));
+#endif
+
+    // Try to relocalise using the relocaliser. If it fails, treat it as if it produced no results.
+    const TimePoint startTime = boost::chrono::steady_clock::now();
+    std::vector<Result> results;
+    try
+    {
+      results = m_innerRelocalisers[stageIdx]->relocalise(request->colourImage.get(), request->depthImage.get(), request->depthIntrinsics);
+    }
+    catch(std::exception& e)
+    {
+      std::cerr << "Warning: Inner relocaliser " << stageIdx << " failed to relocalise: " << e.what() << '\n';
+    }
+
+    // Store the results, and inform any waiting threads that they are available.
+    {
+      boost::lock_guard<boost::mutex> lock(m_mutex);
+      record_stage_latency(stageIdx, boost::chrono::steady_clock::now() - startTime);
+      m_stageResults[stageIdx].swap(results);
+      m_stageCompletedRequestIDs[stageIdx] = request->id;
+      m_stagesRunning[stageIdx] = false;
+    }
+
+    m_stageFinished.notify_all();
+  }
+}
+
 void CascadeRelocaliser::save_poses(const Matrix4f& relocalisedPose, const Matrix4f& refinedPose) const
 {
   // FIXME: This is the same as ICPRefiningRelocaliser::save_poses - the commonality should be factored out.
@@ -246,4 +544,21 @@ void CascadeRelocaliser::save_poses(const Matrix4f& relocalisedPose, const Matri
   m_posePathGenerator->increment_index();
 }
 
+
+bool CascadeRelocaliser::should_fall_back(size_t stageIdx, const std::vector<Result>& results) const
+{
+  return results.empty() || results[0].score > m_fallbackThresholds[stageIdx];
+}
+
+void CascadeRelocaliser::wait_for_stages() const
+{
+  if(!m_speculative) return;
+
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  for(size_t i = 0, size = m_innerRelocalisers.size(); i < size; ++i)
+  {
+    while(m_stagePendingRequests[i] || m_stagesRunning[i]) m_stageFinished.wait(lock);
+  }
+}
+
 }
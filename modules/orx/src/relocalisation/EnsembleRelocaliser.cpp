@@ -5,24 +5,80 @@
 
 #include "relocalisation/EnsembleRelocaliser.h"
 
+#include <iostream>
+#include <stdexcept>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+namespace bf = boost::filesystem;
+
+#include "base/MemoryBlockFactory.h"
+
 namespace orx {
 
 //#################### CONSTRUCTORS ####################
 
-EnsembleRelocaliser::EnsembleRelocaliser(const std::vector<Relocaliser_Ptr>& innerRelocalisers)
-: m_innerRelocalisers(innerRelocalisers)
+EnsembleRelocaliser::EnsembleRelocaliser(const std::vector<Relocaliser_Ptr>& innerRelocalisers, const tvgutil::SettingsContainer_CPtr& settings, const std::string& settingsNamespace)
+: m_innerRelocalisers(innerRelocalisers), m_workersShouldTerminate(false)
 {
   // Check that the ensemble contains at least one relocaliser.
   if(innerRelocalisers.empty())
   {
     throw std::runtime_error("Error: Cannot create an empty ensemble relocaliser");
   }
+
+  // Configure the ensemble relocaliser based on the settings that have been passed in.
+  m_parallel = settings->get_first_value<bool>(settingsNamespace + "parallel", false);
+  m_relocalisationBudgetMs = settings->get_first_value<int>(settingsNamespace + "relocalisationBudgetMs", 0);
+
+  // Look up the timeouts for the inner relocalisers. A timeout can be specified for each inner relocaliser individually
+  // (in the same namespace as the rest of its settings), or for all of them at once.
+  const int defaultInnerTimeoutMs = settings->get_first_value<int>(settingsNamespace + "innerTimeoutMs", 0);
+  for(size_t i = 0, size = m_innerRelocalisers.size(); i < size; ++i)
+  {
+    const std::string innerRelocaliserNamespace = settingsNamespace + "R" + boost::lexical_cast<std::string>(i) + ".";
+    m_innerTimeoutsMs.push_back(settings->get_first_value<int>(innerRelocaliserNamespace + "timeoutMs", defaultInnerTimeoutMs));
+  }
+
+  // If we're running in parallel mode, start a worker thread for each inner relocaliser.
+  if(m_parallel)
+  {
+    m_completedRequestIDs.resize(m_innerRelocalisers.size(), 0);
+    m_innerResults.resize(m_innerRelocalisers.size());
+
+    for(size_t i = 0, size = m_innerRelocalisers.size(); i < size; ++i)
+    {
+      m_workerThreads.push_back(boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&EnsembleRelocaliser::run_worker, this, i))));
+    }
+  }
+}
+
+//#################### DESTRUCTOR ####################
+
+EnsembleRelocaliser::~EnsembleRelocaliser()
+{
+  // Set the flag that informs the worker threads that they should terminate, and wake any that are waiting for requests.
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_workersShouldTerminate = true;
+  }
+
+  m_requestAvailable.notify_all();
+
+  // Wait for the worker threads to terminate gracefully (any that are still relocalising will finish doing so first).
+  for(size_t i = 0, size = m_workerThreads.size(); i < size; ++i)
+  {
+    m_workerThreads[i]->join();
+  }
 }
 
 //#################### PUBLIC MEMBER FUNCTIONS ####################
 
 void EnsembleRelocaliser::finish_training()
 {
+  wait_for_workers();
+
   for(size_t i = 0, size = m_innerRelocalisers.size(); i < size; ++i)
   {
     m_innerRelocalisers[i]->finish_training();
@@ -31,27 +87,31 @@ void EnsembleRelocaliser::finish_training()
 
 ORUChar4Image_CPtr EnsembleRelocaliser::get_visualisation_image(const std::string& key) const
 {
+  // Only the first inner relocaliser is used, so there's no need to wait for any of the others (which may still be
+  // working on a request for which they timed out).
+  wait_for_worker(0);
+
   // FIXME: Returning the image from the first relocaliser will do for now, but longer-term we should do this properly.
   return m_innerRelocalisers[0]->get_visualisation_image(key);
 }
 
 void EnsembleRelocaliser::load_from_disk(const std::string& inputFolder)
 {
-  // TODO: Not yet supported.
-  throw std::runtime_error("Error: Cannot yet load an ensemble relocaliser from disk");
+  wait_for_workers();
+
+  for(size_t i = 0, size = m_innerRelocalisers.size(); i < size; ++i)
+  {
+    m_innerRelocalisers[i]->load_from_disk(get_inner_relocaliser_folder(inputFolder, i));
+  }
 }
 
 std::vector<Relocaliser::Result>
 EnsembleRelocaliser::relocalise(const ORUChar4Image *colourImage, const ORFloatImage *depthImage, const Vector4f& depthIntrinsics) const
 {
-  std::vector<Result> combinedRelocalisationResults;
-
-  // Try to relocalise with each of the inner relocalisers in turn, and aggregate the results.
-  for(size_t i = 0, size = m_innerRelocalisers.size(); i < size; ++i)
-  {
-    std::vector<Result> relocalisationResults = m_innerRelocalisers[i]->relocalise(colourImage, depthImage, depthIntrinsics);
-    std::copy(relocalisationResults.begin(), relocalisationResults.end(), std::back_inserter(combinedRelocalisationResults));
-  }
+  // Try to relocalise with each of the inner relocalisers, and aggregate the results.
+  std::vector<Result> combinedRelocalisationResults = m_parallel
+    ? relocalise_parallel(colourImage, depthImage, depthIntrinsics)
+    : relocalise_serial(colourImage, depthImage, depthIntrinsics);
 
   // Sort the results in ascending order of score, and return them.
   // FIXME: This assumes that the scores produced by different relocalisers are comparable, which may not necessarily be the case.
@@ -62,6 +122,8 @@ EnsembleRelocaliser::relocalise(const ORUChar4Image *colourImage, const ORFloatI
 
 void EnsembleRelocaliser::reset()
 {
+  wait_for_workers();
+
   for(size_t i = 0, size = m_innerRelocalisers.size(); i < size; ++i)
   {
     m_innerRelocalisers[i]->reset();
@@ -70,13 +132,19 @@ void EnsembleRelocaliser::reset()
 
 void EnsembleRelocaliser::save_to_disk(const std::string& outputFolder) const
 {
-  // TODO: Not yet supported.
-  throw std::runtime_error("Error: Cannot yet save an ensemble relocaliser to disk");
+  wait_for_workers();
+
+  for(size_t i = 0, size = m_innerRelocalisers.size(); i < size; ++i)
+  {
+    m_innerRelocalisers[i]->save_to_disk(get_inner_relocaliser_folder(outputFolder, i));
+  }
 }
 
 void EnsembleRelocaliser::train(const ORUChar4Image *colourImage, const ORFloatImage *depthImage,
                                const Vector4f& depthIntrinsics, const ORUtils::SE3Pose& cameraPose)
 {
+  wait_for_workers();
+
   for(size_t i = 0, size = m_innerRelocalisers.size(); i < size; ++i)
   {
     m_innerRelocalisers[i]->train(colourImage, depthImage, depthIntrinsics, cameraPose);
@@ -85,12 +153,194 @@ void EnsembleRelocaliser::train(const ORUChar4Image *colourImage, const ORFloatI
 
 void EnsembleRelocaliser::update()
 {
+  wait_for_workers();
+
   for(size_t i = 0, size = m_innerRelocalisers.size(); i < size; ++i)
   {
     m_innerRelocalisers[i]->update();
   }
 }
 
+//#################### PRIVATE MEMBER FUNCTIONS ####################
+
+std::vector<Relocaliser::Result>
+EnsembleRelocaliser::relocalise_parallel(const ORUChar4Image *colourImage, const ORFloatImage *depthImage, const Vector4f& depthIntrinsics) const
+{
+  const TimePoint startTime = boost::chrono::steady_clock::now();
+  const size_t innerRelocaliserCount = m_innerRelocalisers.size();
+
+  // Determine the time by which each inner relocaliser must finish for its results to be used.
+  std::vector<TimePoint> deadlines(innerRelocaliserCount, TimePoint::max());
+  bool deadlineSet = false;
+  for(size_t i = 0; i < innerRelocaliserCount; ++i)
+  {
+    int timeoutMs = m_innerTimeoutsMs[i];
+    if(m_relocalisationBudgetMs > 0 && (timeoutMs <= 0 || m_relocalisationBudgetMs < timeoutMs)) timeoutMs = m_relocalisationBudgetMs;
+
+    if(timeoutMs > 0)
+    {
+      deadlines[i] = startTime + boost::chrono::milliseconds(timeoutMs);
+      deadlineSet = true;
+    }
+  }
+
+  // Make the relocalisation request. If any of the inner relocalisers might time out, we will return before they finish,
+  // so in that case we give the request its own copies of the input images (the caller's images may not outlive the call).
+  boost::shared_ptr<RelocalisationRequest> request(new RelocalisationRequest);
+  if(deadlineSet)
+  {
+    colourImage->UpdateHostFromDevice();
+    depthImage->UpdateHostFromDevice();
+
+    const MemoryBlockFactory& mbf = MemoryBlockFactory::instance();
+    ORUChar4Image_Ptr colourImageCopy = mbf.make_image<Vector4u>(colourImage->noDims);
+    ORFloatImage_Ptr depthImageCopy = mbf.make_image<float>(depthImage->noDims);
+
+    colourImageCopy->SetFrom(colourImage, ORUChar4Image::CPU_TO_CPU);
+    depthImageCopy->SetFrom(depthImage, ORFloatImage::CPU_TO_CPU);
+    colourImageCopy->UpdateDeviceFromHost();
+    depthImageCopy->UpdateDeviceFromHost();
+
+    request->colourImage = colourImageCopy.get();
+    request->colourImageCopy = colourImageCopy;
+    request->depthImage = depthImageCopy.get();
+    request->depthImageCopy = depthImageCopy;
+  }
+  else
+  {
+    request->colourImage = colourImage;
+    request->depthImage = depthImage;
+  }
+
+  request->depthIntrinsics = depthIntrinsics;
+
+#ifdef WITH_CUDA
+  ORcudaSafeCall(cudaGetDevice(&request->device));
+#else
+  request->device = 0;
+#endif
+
+  // Pass the request to the worker threads.
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  request->id = m_currentRequest ? m_currentRequest->id + 1 : 1;
+  m_currentRequest = request;
+  m_requestAvailable.notify_all();
+
+  // Wait until each inner relocaliser has either finished processing the request or run out of time.
+  for(;;)
+  {
+    const TimePoint now = boost::chrono::steady_clock::now();
+    TimePoint nextDeadline = TimePoint::max();
+    bool waiting = false;
+
+    for(size_t i = 0; i < innerRelocaliserCount; ++i)
+    {
+      if(m_completedRequestIDs[i] != request->id && deadlines[i] > now)
+      {
+        waiting = true;
+        nextDeadline = std::min(nextDeadline, deadlines[i]);
+      }
+    }
+
+    if(!waiting) break;
+
+    if(nextDeadline == TimePoint::max()) m_resultAvailable.wait(lock);
+    else m_resultAvailable.wait_until(lock, nextDeadline);
+  }
+
+  // Combine the results of the inner relocalisers that finished in time.
+  std::vector<Result> combinedRelocalisationResults;
+  for(size_t i = 0; i < innerRelocaliserCount; ++i)
+  {
+    if(m_completedRequestIDs[i] == request->id)
+    {
+      std::copy(m_innerResults[i].begin(), m_innerResults[i].end(), std::back_inserter(combinedRelocalisationResults));
+    }
+  }
+
+  return combinedRelocalisationResults;
+}
+
+std::vector<Relocaliser::Result>
+EnsembleRelocaliser::relocalise_serial(const ORUChar4Image *colourImage, const ORFloatImage *depthImage, const Vector4f& depthIntrinsics) const
+{
+  std::vector<Result> combinedRelocalisationResults;
+
+  // Try to relocalise with each of the inner relocalisers in turn, and aggregate the results.
+  for(size_t i = 0, size = m_innerRelocalisers.size(); i < size; ++i)
+  {
+    std::vector<Result> relocalisationResults = m_innerRelocalisers[i]->relocalise(colourImage, depthImage, depthIntrinsics);
+    std::copy(relocalisationResults.begin(), relocalisationResults.end(), std::back_inserter(combinedRelocalisationResults));
+  }
+
+  return combinedRelocalisationResults;
+}
+
+void EnsembleRelocaliser::run_worker(size_t innerRelocaliserIdx)
+{
+  int lastRequestID = 0;
+
+  for(;;)
+  {
+    // Wait for a new relocalisation request (or for termination to be requested). Note that if several requests are made
+    // while the inner relocaliser is busy, it skips straight to the most recent one.
+    RelocalisationRequest_CPtr request;
+    {
+      boost::unique_lock<boost::mutex> lock(m_mutex);
+      while(!m_workersShouldTerminate && (!m_currentRequest || m_currentRequest->id == lastRequestID)) m_requestAvailable.wait(lock);
+
+      // If we were asked to terminate, do so.
+      if(m_workersShouldTerminate) return;
+
+      request = m_currentRequest;
+      lastRequestID = request->id;
+    }
+
+#ifdef WITH_CUDA
+    // Make sure that the inner relocaliser runs on the same GPU as the thread that made the request.
+    ORcudaSafeCall(cudaSetDevice(request->device));
+#endif
+
+    // Try to relocalise using the inner relocaliser. If it fails, treat it as if it produced no results.
+    std::vector<Result> results;
+    try
+    {
+      results = m_innerRelocalisers[innerRelocaliserIdx]->relocalise(request->colourImage, request->depthImage, request->depthIntrinsics);
+    }
+    catch(std::exception& e)
+    {
+      std::cerr << "Warning: Inner relocaliser " << innerRelocaliserIdx << " failed to relocalise: " << e.what() << '\n';
+    }
+
+    // Store the results, and inform the thread that made the request that they are available.
+    {
+      boost::lock_guard<boost::mutex> lock(m_mutex);
+      m_innerResults[innerRelocaliserIdx].swap(results);
+      m_completedRequestIDs[innerRelocaliserIdx] = request->id;
+    }
+
+    m_resultAvailable.notify_all();
+  }
+}
+
+void EnsembleRelocaliser::wait_for_worker(size_t innerRelocaliserIdx) const
+{
+  if(!m_parallel) return;
+
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  if(!m_currentRequest) return;
+
+  while(m_completedRequestIDs[innerRelocaliserIdx] != m_currentRequest->id) m_resultAvailable.wait(lock);
+}
+
+void EnsembleRelocaliser::wait_for_workers() const
+{
+  for(size_t i = 0, size = m_innerRelocalisers.size(); i < size; ++i)
+  {
+    wait_for_worker(i);
+  }
+}
+
 //#################### PRIVATE STATIC MEMBER FUNCTIONS ####################
 
 bool EnsembleRelocaliser::compare_results(const Result& lhs, const Result& rhs)
@@ -98,4 +348,9 @@ bool EnsembleRelocaliser::compare_results(const Result& lhs, const Result& rhs)
   return lhs.score < rhs.score;
 }
 
+std::string EnsembleRelocaliser::get_inner_relocaliser_folder(const std::string& folder, size_t innerRelocaliserIdx)
+{
+  return (bf::path(folder) / ("R" + boost::lexical_cast<std::string>(innerRelocaliserIdx))).string();
+}
+
 }
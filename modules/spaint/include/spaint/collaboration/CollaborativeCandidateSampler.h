@@ -0,0 +1,166 @@
+/**
+ * spaint: CollaborativeCandidateSampler.h
+ * Copyright (c) Torr Vision Group, University of Oxford, 2019. All rights reserved.
+ */
+
+#ifndef H_SPAINT_COLLABORATIVECANDIDATESAMPLER
+#define H_SPAINT_COLLABORATIVECANDIDATESAMPLER
+
+#include <deque>
+#include <map>
+
+#include <boost/optional.hpp>
+
+#include <itmx/base/ITMObjectPtrTypes.h>
+
+#include <tvgutil/containers/FenwickTree.h>
+#include <tvgutil/numbers/RandomNumberGenerator.h>
+
+#include "CollaborativePoseOptimiser.h"
+#include "CollaborativeRelocalisation.h"
+
+namespace spaint {
+
+/**
+ * \brief An instance of this class can be used to sample candidate relocalisations for a collaborative reconstruction
+ *        in proportion to an estimate of how likely they are to be successful and useful.
+ *
+ * For each ordered scene pair (i,j), the sampler maintains a weight for every frame in scene j's trajectory, which is
+ * reduced whenever that frame, or a nearby frame with a similar pose, is tried (so that new views are preferred over
+ * ones that are similar to those already tried). A frame's weight is also reduced provisionally as soon as it is scheduled,
+ * so that it is not sampled again whilst its attempt is still in progress. The weights for each scene pair are stored in a Fenwick tree, so that
+ * a frame can be sampled, and the weights updated, in O(log n) time, where n is the length of the trajectory. The scene
+ * pair itself is sampled in proportion to a weight that combines the pair's past success rate, the state of the relative
+ * transform clusters held by the collaborative pose optimiser, and the mean weight of its frames.
+ */
+class CollaborativeCandidateSampler
+{
+  //#################### TYPEDEFS ####################
+public:
+  typedef std::pair<std::string,std::string> SceneIDPair;
+
+  //#################### NESTED TYPES ####################
+private:
+  /**
+   * \brief An instance of this struct holds the sampling state for an ordered scene pair (i,j).
+   */
+  struct PairState
+  {
+    //~~~~~~~~~~~~~~~~~~~~ PUBLIC MEMBER VARIABLES ~~~~~~~~~~~~~~~~~~~~
+
+    /** The number of relocalisations of frames of scene j against scene i that have been attempted. */
+    size_t attemptCount;
+
+    /** The sampling weights of the frames in scene j's trajectory. */
+    tvgutil::FenwickTree<double> frameWeights;
+
+    /** The number of relocalisations of frames of scene j against scene i that have been verified. */
+    size_t verifiedCount;
+
+    //~~~~~~~~~~~~~~~~~~~~ CONSTRUCTORS ~~~~~~~~~~~~~~~~~~~~
+
+    PairState()
+    : attemptCount(0), verifiedCount(0)
+    {}
+  };
+
+  //#################### PRIVATE VARIABLES ####################
+private:
+  /** The factor by which to multiply the weight of a frame whose relocalisation was attempted but not verified. */
+  double m_failedAttemptFactor;
+
+  /** The number of frames in the trajectory of each scene. */
+  std::map<std::string,size_t> m_frameCounts;
+
+  /** The number of frames either side of a tried frame whose poses are compared with its pose when reducing the weights of similar views. */
+  int m_noveltyWindow;
+
+  /** The sampling state for each ordered scene pair. */
+  std::map<SceneIDPair,PairState> m_pairStates;
+
+  /** The collaborative pose optimiser whose relative transform clusters are used when weighting the scene pairs. */
+  CollaborativePoseOptimiser_CPtr m_poseOptimiser;
+
+  /** The factor by which to multiply the weight of a frame when its relocalisation is scheduled (before the outcome is known). */
+  double m_scheduledAttemptFactor;
+
+  /** The factor by which to multiply the weights of frames whose poses are similar to that of a tried frame. */
+  double m_similarViewFactor;
+
+  /** The factor by which to multiply the weight of a frame whose relocalisation was attempted and verified. */
+  double m_verifiedAttemptFactor;
+
+  //#################### CONSTRUCTORS ####################
+public:
+  /**
+   * \brief Constructs a collaborative candidate sampler.
+   *
+   * \param poseOptimiser     The collaborative pose optimiser whose relative transform clusters should be used when weighting the scene pairs.
+   * \param settings          The settings to use.
+   * \param settingsNamespace The namespace associated with the settings that are specific to the sampler.
+   */
+  CollaborativeCandidateSampler(const CollaborativePoseOptimiser_CPtr& poseOptimiser, const Settings_CPtr& settings, const std::string& settingsNamespace);
+
+  //#################### PUBLIC MEMBER FUNCTIONS ####################
+public:
+  /**
+   * \brief Adds a frame to the end of the trajectory of the specified scene.
+   *
+   * \param sceneID The ID of the scene.
+   */
+  void add_frame(const std::string& sceneID);
+
+  /**
+   * \brief Gets the expected success rate of relocalising frames of scene j against scene i, based on the results of previous attempts.
+   *
+   * \param sceneI  The ID of scene i.
+   * \param sceneJ  The ID of scene j.
+   * \return        The expected success rate (the mean of a Beta posterior with a uniform prior over the success rate).
+   */
+  double get_expected_success_rate(const std::string& sceneI, const std::string& sceneJ) const;
+
+  /**
+   * \brief Records the outcome of an attempted relocalisation, so that it can be taken into account when sampling future candidates.
+   *
+   * \note  The outcome factor is applied on top of the provisional reduction made when the relocalisation was scheduled (see record_scheduled).
+   *
+   * \param attempt     The attempted relocalisation (it is deemed to have been verified iff its relative pose has been set).
+   * \param trajectoryJ The trajectory of scene j (i.e. the scene whose frame was relocalised).
+   */
+  void record_attempt(const CollaborativeRelocalisation& attempt, const std::deque<ORUtils::SE3Pose>& trajectoryJ);
+
+  /**
+   * \brief Records that a relocalisation has been scheduled, provisionally reducing the weight of its frame so that
+   *        the frame is less likely to be sampled again before the outcome of the attempt is known.
+   *
+   * \param candidate The scheduled relocalisation.
+   */
+  void record_scheduled(const CollaborativeRelocalisation& candidate);
+
+  /**
+   * \brief Attempts to sample a scene pair (i,j), and a frame of scene j to relocalise against scene i.
+   *
+   * \param rng The random number generator to use.
+   * \return    The sampled scene pair and frame index, if any frames can be sampled, or boost::none otherwise.
+   */
+  boost::optional<std::pair<SceneIDPair,int> > sample(tvgutil::RandomNumberGenerator& rng) const;
+
+  //#################### PRIVATE MEMBER FUNCTIONS ####################
+private:
+  /**
+   * \brief Computes the weight with which the specified scene pair should be sampled.
+   *
+   * \param sceneIDs  The scene pair.
+   * \param pairState The sampling state for the scene pair.
+   * \return          The weight with which the scene pair should be sampled.
+   */
+  double compute_pair_weight(const SceneIDPair& sceneIDs, const PairState& pairState) const;
+};
+
+//#################### TYPEDEFS ####################
+
+typedef boost::shared_ptr<CollaborativeCandidateSampler> CollaborativeCandidateSampler_Ptr;
+
+}
+
+#endif
@@ -6,7 +6,6 @@
 #ifndef H_SPAINT_COLLABORATIVECOMPONENT
 #define H_SPAINT_COLLABORATIVECOMPONENT
 
-#include <boost/atomic.hpp>
 #include <boost/thread.hpp>
 #include <boost/timer/timer.hpp>
 
@@ -16,6 +15,7 @@
 
 #include "CollaborativeContext.h"
 #include "../collaboration/CollaborationMode.h"
+#include "../collaboration/CollaborativeCandidateSampler.h"
 #include "../collaboration/CollaborativeRelocalisation.h"
 #include "../visualisation/VisualisationGenerator.h"
 
@@ -26,10 +26,67 @@ namespace spaint {
  */
 class CollaborativeComponent
 {
+  //#################### TYPEDEFS ####################
+private:
+  /** A key that identifies a candidate relocalisation, namely the IDs of its scene pair (i,j) and the index of the frame from scene j that is to be relocalised. */
+  typedef std::pair<std::pair<std::string,std::string>,int> CandidateKey;
+
+  //#################### NESTED TYPES ####################
+private:
+  /**
+   * \brief An instance of this struct holds the images and render states that a relocalisation worker uses when rendering synthetic views of the scenes.
+   *
+   * \note  These are allocated the first time a worker needs them for a particular target scene, and then reused for all subsequent attempts against that scene.
+   */
+  struct RenderBuffers
+  {
+    //~~~~~~~~~~~~~~~~~~~~ PUBLIC MEMBER VARIABLES ~~~~~~~~~~~~~~~~~~~~
+
+    /** An image into which to render synthetic depth images. */
+    ORFloatImage_Ptr depthImage;
+
+    /** The render state used when rendering synthetic depth images. */
+    VoxelRenderState_Ptr depthRenderState;
+
+    /** An image into which to render synthetic colour images. */
+    ORUChar4Image_Ptr rgbImage;
+
+    /** The render state used when rendering synthetic colour images. */
+    VoxelRenderState_Ptr rgbRenderState;
+  };
+
+  /**
+   * \brief An instance of this struct represents a worker thread on which scheduled relocalisations are attempted.
+   */
+  struct RelocalisationWorker
+  {
+    //~~~~~~~~~~~~~~~~~~~~ PUBLIC MEMBER VARIABLES ~~~~~~~~~~~~~~~~~~~~
+
+    /** The render buffers used by the worker, indexed by the ID of the target scene of the relocalisation. */
+    std::map<std::string,RenderBuffers> renderBuffers;
+
+    /** The worker thread itself. */
+    boost::shared_ptr<boost::thread> thread;
+
+    /** A visualisation generator that is specific to the worker. We avoid sharing one between threads for thread-safety reasons. */
+    VisualisationGenerator_CPtr visualisationGenerator;
+  };
+
+  typedef boost::shared_ptr<RelocalisationWorker> RelocalisationWorker_Ptr;
+
   //#################### PRIVATE VARIABLES ####################
 private:
-  /** The best relocalisation candidate, as chosen by the scheduler. This will be the next relocalisation attempted. */
-  boost::shared_ptr<CollaborativeRelocalisation> m_bestCandidate;
+  /** Whether or not to schedule relocalisations whenever a worker is free (in live mode), rather than only every 50 frames. */
+  bool m_adaptiveScheduling;
+
+  /** The number of relocalisation attempts that have been completed so far. */
+  size_t m_attemptCount;
+
+  /** The number of relocalisation workers that are currently attempting a relocalisation. */
+  size_t m_busyWorkerCount;
+
+  /** The sampler used to generate candidate relocalisations when informed candidate selection is enabled (null otherwise). */
+  CollaborativeCandidateSampler_Ptr m_candidateSampler;
 
   /** The timer used to compute the time spent collaborating. */
   boost::optional<boost::timer::cpu_timer> m_collaborationTimer;
@@ -40,41 +97,41 @@ private:
   /** The shared context needed for collaborative SLAM. */
   CollaborativeContext_Ptr m_context;
 
-  /** Render states used when rendering synthetic depth images during relocalisation. */
-  std::map<std::string, VoxelRenderState_Ptr> m_depthRenderStates;
-
   /** The current frame index (in practice, the number of times that run_collaborative_pose_estimation has been called). */
   int m_frameIndex;
 
+  /** The keys of the candidate relocalisations that have been scheduled and have not yet been finished by a relocalisation worker. */
+  std::set<CandidateKey> m_inFlightCandidateKeys;
+
   /** The mode in which the collaboration reconstruction should run. */
   CollaborationMode m_mode;
 
   /** The mutex used to synchronise scheduling and relocalisation. */
   boost::mutex m_mutex;
 
-  /** A condition variable used to tell the relocalisation thread when a candidate relocalisation has been scheduled. */
+  /** A condition variable used to tell the relocalisation workers when a candidate relocalisation has been scheduled. */
   boost::condition_variable m_readyToRelocalise;
 
   /** Whether or not the current reconstruction is consistent (i.e. all scenes are connected to the primary one). */
   bool m_reconstructionIsConsistent;
 
-  /** The thread on which relocalisations should be attempted. */
-  boost::thread m_relocalisationThread;
+  /** Mutexes used to make sure that the relocaliser of each scene is only used by one relocalisation worker at a time. */
+  std::map<std::string,boost::shared_ptr<boost::mutex> > m_relocaliserMutexes;
 
   /** The results of every relocalisation that has been attempted. */
   std::deque<CollaborativeRelocalisation> m_results;
 
-  /** Render states used when rendering synthetic colour images during relocalisation. */
-  std::map<std::string, VoxelRenderState_Ptr> m_rgbRenderStates;
-
   /** A random number generator. */
   mutable tvgutil::RandomNumberGenerator m_rng;
 
+  /** The candidate relocalisations that have been scheduled, but not yet picked up by a relocalisation worker. */
+  std::deque<CollaborativeRelocalisation> m_scheduledCandidates;
+
   /** Whether or not to stop at the first consistent reconstruction. */
   bool m_stopAtFirstConsistentReconstruction;
 
-  /** A flag used to ensure that the relocalisation thread terminates cleanly when the collaborative component is destroyed. */
-  boost::atomic<bool> m_stopRelocalisationThread;
+  /** A flag used to ensure that the relocalisation workers terminate cleanly when the collaborative component is destroyed. */
+  bool m_stopRelocalisationWorkers;
 
   /** Whether or not to compute the time spent collaborating. */
   bool m_timeCollaboration;
@@ -85,8 +142,11 @@ private:
   /** The indices of the frames that have already been tried when attempting to relocalise one scene against another. */
   std::map<std::pair<std::string,std::string>,std::set<int> > m_triedFrameIndices;
 
-  /** A visualisation generator that is specific to this collaborative component. We avoid sharing one with other components for thread-safety reasons. */
-  VisualisationGenerator_CPtr m_visualisationGenerator;
+  /** The number of relocalisation attempts that have been verified so far. */
+  size_t m_verifiedCount;
+
+  /** The workers on which scheduled relocalisations are attempted. */
+  std::vector<RelocalisationWorker_Ptr> m_workers;
 
   //#################### CONSTRUCTORS ####################
 public:
@@ -114,6 +174,14 @@ public:
 
   //#################### PRIVATE MEMBER FUNCTIONS ####################
 private:
+  /**
+   * \brief Attempts the specified candidate relocalisation, using the render buffers and visualisation generator of the specified worker.
+   *
+   * \param candidate The candidate relocalisation to attempt (its results will be written into it).
+   * \param worker    The relocalisation worker on which the attempt is being made.
+   */
+  void attempt_relocalisation(CollaborativeRelocalisation& candidate, RelocalisationWorker& worker);
+
   /**
    * \brief Randomly generates at most the specified number of candidate relocalisations.
    *
@@ -125,6 +193,16 @@ private:
    */
   std::list<CollaborativeRelocalisation> generate_random_candidates(size_t desiredCandidateCount) const;
 
+  /**
+   * \brief Uses the candidate sampler to generate at most the specified number of candidate relocalisations.
+   *
+   * \note  The candidates are sampled in proportion to an estimate of how likely they are to be successful and useful (see CollaborativeCandidateSampler).
+   *
+   * \param desiredCandidateCount The desired number of candidates to generate (at most this number will be generated).
+   * \return                      The generated candidate relocalisations (if any).
+   */
+  std::list<CollaborativeRelocalisation> generate_informed_candidates(size_t desiredCandidateCount) const;
+
   /**
    * \brief Randomly picks a scene pair (i,j), and then tries to generate a candidate relocalisation of the next untried frame (if any) of scene j against scene i.
    *
@@ -146,9 +224,11 @@ private:
   void output_results() const;
 
   /**
-   * \brief Runs the relocalisation thread, repeatedly attempting scheduled relocalisations until the collaborative component is destroyed.
+   * \brief Runs a relocalisation worker, repeatedly attempting scheduled relocalisations until the collaborative component is destroyed.
+   *
+   * \param worker  The relocalisation worker to run.
    */
-  void run_relocalisation();
+  void run_relocalisation(RelocalisationWorker& worker);
 
   /**
    * \brief Scores all of the specified candidate relocalisations to allow one of them to be chosen for a relocalisation attempt.
@@ -158,9 +238,10 @@ private:
   void score_candidates(std::list<CollaborativeRelocalisation>& candidates) const;
 
   /**
-   * \brief Tries to schedule a candidate relocalisation.
+   * \brief Tries to schedule a candidate relocalisation for each relocalisation worker that is not already busy or about to become so.
    *
-   * \note  If an existing relocalisation attempt is in progress, this will early out and do nothing.
+   * \note  If all of the workers are busy (or have already had relocalisations scheduled for them), this will early out and do nothing.
+   * \note  Candidates that duplicate a relocalisation that is already scheduled or in progress are skipped.
    */
   void try_schedule_relocalisation();
 
@@ -170,6 +251,16 @@ private:
    * \return  true, if at least one of the scenes is still being reconstructed, or false otherwise.
    */
   bool update_trajectories();
+
+  //#################### PRIVATE STATIC MEMBER FUNCTIONS ####################
+private:
+  /**
+   * \brief Makes the key that identifies the specified candidate relocalisation.
+   *
+   * \param candidate The candidate relocalisation.
+   * \return          The key that identifies the candidate relocalisation.
+   */
+  static CandidateKey make_candidate_key(const CollaborativeRelocalisation& candidate);
 };
 
 //#################### TYPEDEFS ####################
@@ -6,25 +6,39 @@
 #ifndef H_SPAINT_SLAMCOMPONENT
 #define H_SPAINT_SLAMCOMPONENT
 
+#include <boost/optional.hpp>
+#include <boost/thread.hpp>
+
 #include <ITMLib/Core/ITMDenseMapper.h>
 #include <ITMLib/Core/ITMDenseSurfelMapper.h>
 
 #include <itmx/remotemapping/MappingClient.h>
 #include <itmx/trackers/FallibleTracker.h>
 
+#include <tvgutil/timing/AverageTimer.h>
+
 #include "SLAMContext.h"
 
 namespace spaint {
 
 /**
  * \brief An instance of this pipeline component can be used to perform simultaneous localisation and mapping (SLAM).
+ *
+ * By default, each frame is processed serially: the input images are acquired and preprocessed into a view, and then
+ * the frame is tracked, relocalised, fused, rendered, etc. In pipelined mode, the input images and view are instead
+ * double-buffered: whilst the current frame is being tracked, fused and rendered on the calling thread, the next frame
+ * is acquired and preprocessed into the back buffers on a prefetching thread, and the buffers are swapped at the start
+ * of the next call to process_frame. The prefetcher only ever runs one frame ahead, so frames are still processed in
+ * exactly the same order (and with the same inputs) as in serial mode.
  */
 class SLAMComponent
 {
   //#################### TYPEDEFS ####################
 private:
+  typedef tvgutil::AverageTimer<boost::chrono::microseconds> AverageTimer;
   typedef boost::shared_ptr<ITMLib::ITMDenseMapper<SpaintVoxel,ITMVoxelIndex> > DenseMapper_Ptr;
   typedef boost::shared_ptr<ITMLib::ITMDenseSurfelMapper<SpaintSurfel> > DenseSurfelMapper_Ptr;
+  typedef boost::chrono::steady_clock::time_point TimePoint;
   typedef ITMLib::ITMTrackingState::TrackingResult TrackingResult;
 
   //#################### ENUMERATIONS ####################
@@ -53,6 +67,53 @@ public:
     TRACK_VOXELS
   };
 
+private:
+  /**
+   * \brief The values of this enumeration denote the states that the prefetcher can be in (pipelined mode only).
+   */
+  enum PrefetchState
+  {
+    /** The prefetcher has finished trying to acquire the next frame. */
+    PREFETCH_COMPLETE,
+
+    /** The prefetcher has not yet been asked to acquire a frame. */
+    PREFETCH_NONE,
+
+    /** The prefetcher has been asked to acquire the next frame, and is doing so (or will do so shortly). */
+    PREFETCH_REQUESTED
+  };
+
+  //#################### NESTED TYPES ####################
+private:
+  /**
+   * \brief An instance of this struct represents a set of buffers into which an input frame can be acquired.
+   */
+  struct InputFrame
+  {
+    //~~~~~~~~~~~~~~~~~~~~ PUBLIC MEMBER VARIABLES ~~~~~~~~~~~~~~~~~~~~
+
+    /** Whether or not, once the frame was acquired, the current sub-engine of a composite image source engine (if any) had run out of images. */
+    bool currentSubengineExhausted;
+
+    /** The status of the input once the last attempt to acquire a frame into the buffers was made. */
+    SLAMState::InputStatus inputStatus;
+
+    /** The raw depth image. */
+    ORShortImage_Ptr rawDepthImage;
+
+    /** The RGB image. */
+    ORUChar4Image_Ptr rgbImage;
+
+    /** The view built from the RGB and raw depth images. */
+    View_Ptr view;
+
+    //~~~~~~~~~~~~~~~~~~~~ CONSTRUCTORS ~~~~~~~~~~~~~~~~~~~~
+
+    InputFrame()
+    : currentSubengineExhausted(false), inputStatus(SLAMState::IS_IDLE)
+    {}
+  };
+
   //#################### PRIVATE VARIABLES ####################
 private:
   /** The shared context needed for SLAM. */
@@ -73,6 +134,9 @@ private:
   /** Whether or not to let the relocaliser know when no more calls will be made to its train or update functions. */
   bool m_finishTrainingEnabled;
 
+  /** The time at which the first frame started to be processed (if any). */
+  boost::optional<TimePoint> m_firstFrameStartTime;
+
   /** The number of frames for which fusion has been run. */
   size_t m_fusedFramesCount;
 
@@ -95,6 +159,9 @@ private:
    */
   size_t m_initialFramesToFuse;
 
+  /** The time at which the most recent frame finished being processed (if any). */
+  boost::optional<TimePoint> m_lastFrameEndTime;
+
   /** The engine used to perform low-level image processing operations. */
   LowLevelEngine_Ptr m_lowLevelEngine;
 
@@ -104,6 +171,33 @@ private:
   /** The ID of the scene (if any) whose pose is to be mirrored. */
   std::string m_mirrorSceneID;
 
+  /** Whether or not to acquire and preprocess the next frame whilst the current one is being processed. */
+  bool m_pipelined;
+
+  /** A condition variable used to wait for the prefetcher to finish trying to acquire the next frame (pipelined mode only). */
+  mutable boost::condition_variable m_prefetchCompleted;
+
+  /** The ID of the GPU that was current on the thread that constructed the component (if relevant). */
+  int m_prefetchDevice;
+
+  /** The back buffers into which the prefetcher acquires the next frame (pipelined mode only). */
+  InputFrame m_prefetchedFrame;
+
+  /** The mutex used to synchronise with the prefetcher (pipelined mode only). */
+  mutable boost::mutex m_prefetchMutex;
+
+  /** A condition variable used to wait for the next frame to be requested from the prefetcher (pipelined mode only). */
+  boost::condition_variable m_prefetchRequested;
+
+  /** The state of the prefetcher (pipelined mode only). */
+  PrefetchState m_prefetchState;
+
+  /** The thread on which the prefetcher runs (pipelined mode only). */
+  boost::shared_ptr<boost::thread> m_prefetchThread;
+
+  /** A flag set in the destructor to indicate that the prefetcher should terminate. */
+  bool m_prefetchThreadShouldTerminate;
+
   /** Whether or not to relocalise and train after processing every frame, for evaluation purposes. */
   bool m_relocaliseEveryFrame;
 
@@ -122,6 +216,30 @@ private:
   /** The namespace associated with the settings that are specific to SLAM components. */
   std::string m_settingsNamespace;
 
+  /** The timer used to profile the acquisition and preprocessing of frames. */
+  AverageTimer m_timerAcquisition;
+
+  /** The timer used to profile fiducial detection. */
+  AverageTimer m_timerFiducials;
+
+  /** The timer used to profile the processing of whole frames (including, in pipelined mode, any time spent waiting for the prefetcher). */
+  AverageTimer m_timerFrame;
+
+  /** The timer used to profile fusion (including pushing frames to the mapping client, if any). */
+  AverageTimer m_timerFusion;
+
+  /** The timer used to profile relocalisation (including training the relocaliser). */
+  AverageTimer m_timerRelocalisation;
+
+  /** The timer used to profile the rendering needed to prepare for tracking the next frame. */
+  AverageTimer m_timerRendering;
+
+  /** Whether or not the timers are enabled, and the per-stage latencies and throughput are printed on destruction. */
+  bool m_timersEnabled;
+
+  /** The timer used to profile tracking. */
+  AverageTimer m_timerTracking;
+
   /** The tracker. */
   Tracker_Ptr m_tracker;
 
@@ -153,6 +271,19 @@ public:
   SLAMComponent(const SLAMContext_Ptr& context, const std::string& sceneID, const ImageSourceEngine_Ptr& imageSourceEngine, const std::string& trackerConfig,
                 MappingMode mappingMode = MAP_VOXELS_ONLY, TrackingMode trackingMode = TRACK_VOXELS, bool detectFiducials = false);
 
+  //#################### DESTRUCTOR ####################
+public:
+  /**
+   * \brief Destroys the SLAM component.
+   */
+  ~SLAMComponent();
+
+  //#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+private:
+  // Deliberately private and unimplemented.
+  SLAMComponent(const SLAMComponent&);
+  SLAMComponent& operator=(const SLAMComponent&);
+
   //#################### PUBLIC MEMBER FUNCTIONS ####################
 public:
   /**
@@ -196,6 +327,8 @@ public:
 
   /**
    * \brief Resets the reconstructed scene.
+   *
+   * \note  In pipelined mode, any frame that was prefetched before the reset is discarded.
    */
   void reset_scene();
 
@@ -234,6 +367,23 @@ public:
 
   //#################### PRIVATE MEMBER FUNCTIONS ####################
 private:
+  /**
+   * \brief Tries to acquire the next frame from the image source engine into the specified buffers, and to preprocess it into a view.
+   *
+   * \note  In pipelined mode, this is only ever called on the prefetching thread.
+   *
+   * \param frame The buffers into which to acquire the frame. Its input status is updated to reflect whether or not a frame was acquired.
+   */
+  void acquire_frame(InputFrame& frame);
+
+  /**
+   * \brief Waits for the prefetcher (if any) to finish acquiring a frame, and then discards that frame, so that the next call
+   *        to process_frame acquires a fresh frame (pipelined mode only).
+   *
+   * \note  This is used when the scene is reset, since a frame that was prefetched beforehand is stale.
+   */
+  void discard_prefetched_frame();
+
   /**
    * \brief Loads the ground truth trajectory for the relocaliser.
    *
@@ -253,6 +403,11 @@ private:
    */
   void process_relocalisation();
 
+  /**
+   * \brief Repeatedly acquires frames into the back buffers when asked to do so (pipelined mode only).
+   */
+  void run_prefetcher();
+
   /**
    * \brief Decorates the specified relocaliser with one that uses an ICP tracker to refine the results.
    *
@@ -275,6 +430,36 @@ private:
    * \brief Sets up the tracker.
    */
   void setup_tracker();
+
+  /**
+   * \brief Starts the specified timer (if the timers are enabled).
+   *
+   * \param timer The timer to start.
+   */
+  void start_timer(AverageTimer& timer) const;
+
+  /**
+   * \brief Stops the specified timer (if the timers are enabled).
+   *
+   * \param timer The timer to stop.
+   */
+  void stop_timer(AverageTimer& timer) const;
+
+  /**
+   * \brief Exchanges the specified buffers with those into which the prefetcher has acquired the next frame, and asks
+   *        the prefetcher to start acquiring the frame after that (pipelined mode only).
+   *
+   * \note  If the prefetcher did not manage to acquire a frame, the buffers are not exchanged, but the input status
+   *        of the specified buffers is still updated to reflect that of the prefetcher.
+   *
+   * \param frame The buffers containing the current frame.
+   */
+  void swap_with_prefetched_frame(InputFrame& frame);
+
+  /**
+   * \brief Waits for the prefetcher (if any) to finish acquiring a frame, so that the image source engine and view builder can safely be used.
+   */
+  void wait_for_prefetcher() const;
 };
 
 //#################### TYPEDEFS ####################
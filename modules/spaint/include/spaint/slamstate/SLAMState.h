@@ -301,6 +301,13 @@ public:
    */
   void set_view(ITMLib::ITMView *view);
 
+  /**
+   * \brief Sets the current view of the scene, sharing ownership of it with the caller.
+   *
+   * \param view  The new current view of the scene.
+   */
+  void set_view(const View_Ptr& view);
+
   /**
    * \brief Sets the voxel scene.
    *
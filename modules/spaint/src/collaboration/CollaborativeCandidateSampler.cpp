@@ -0,0 +1,169 @@
+/**
+ * spaint: CollaborativeCandidateSampler.cpp
+ * Copyright (c) Torr Vision Group, University of Oxford, 2019. All rights reserved.
+ */
+
+#include "collaboration/CollaborativeCandidateSampler.h"
+using namespace ORUtils;
+
+#include <algorithm>
+
+#include <orx/geometry/GeometryUtil.h>
+using namespace orx;
+
+using namespace tvgutil;
+
+namespace spaint {
+
+//#################### CONSTRUCTORS ####################
+
+CollaborativeCandidateSampler::CollaborativeCandidateSampler(const CollaborativePoseOptimiser_CPtr& poseOptimiser, const Settings_CPtr& settings, const std::string& settingsNamespace)
+: m_poseOptimiser(poseOptimiser)
+{
+  m_failedAttemptFactor = settings->get_first_value<double>(settingsNamespace + "failedAttemptFactor", 0.1);
+  m_noveltyWindow = settings->get_first_value<int>(settingsNamespace + "noveltyWindow", 15);
+  m_scheduledAttemptFactor = settings->get_first_value<double>(settingsNamespace + "scheduledAttemptFactor", 0.5);
+  m_similarViewFactor = settings->get_first_value<double>(settingsNamespace + "similarViewFactor", 0.5);
+  m_verifiedAttemptFactor = settings->get_first_value<double>(settingsNamespace + "verifiedAttemptFactor", 0.5);
+}
+
+//#################### PUBLIC MEMBER FUNCTIONS ####################
+
+void CollaborativeCandidateSampler::add_frame(const std::string& sceneID)
+{
+  // If this is the first frame we've seen for the scene, start tracking the weights of the frames of each of the
+  // other scenes when they are relocalised against this one (initially, all of these frames are equally weighted).
+  if(m_frameCounts.find(sceneID) == m_frameCounts.end())
+  {
+    for(std::map<std::string,size_t>::const_iterator it = m_frameCounts.begin(), iend = m_frameCounts.end(); it != iend; ++it)
+    {
+      FenwickTree<double>& frameWeights = m_pairStates[std::make_pair(sceneID, it->first)].frameWeights;
+      for(size_t i = 0; i < it->second; ++i) frameWeights.push_back(1.0);
+    }
+
+    m_frameCounts[sceneID] = 0;
+  }
+
+  // Add the new frame to each of the scene pairs in which it will be relocalised against another scene.
+  for(std::map<std::string,size_t>::const_iterator it = m_frameCounts.begin(), iend = m_frameCounts.end(); it != iend; ++it)
+  {
+    if(it->first != sceneID) m_pairStates[std::make_pair(it->first, sceneID)].frameWeights.push_back(1.0);
+  }
+
+  ++m_frameCounts[sceneID];
+}
+
+double CollaborativeCandidateSampler::get_expected_success_rate(const std::string& sceneI, const std::string& sceneJ) const
+{
+  std::map<SceneIDPair,PairState>::const_iterator it = m_pairStates.find(std::make_pair(sceneI, sceneJ));
+  const size_t attemptCount = it != m_pairStates.end() ? it->second.attemptCount : 0;
+  const size_t verifiedCount = it != m_pairStates.end() ? it->second.verifiedCount : 0;
+  return (verifiedCount + 1.0) / (attemptCount + 2.0);
+}
+
+void CollaborativeCandidateSampler::record_attempt(const CollaborativeRelocalisation& attempt, const std::deque<SE3Pose>& trajectoryJ)
+{
+  std::map<SceneIDPair,PairState>::iterator it = m_pairStates.find(std::make_pair(attempt.m_sceneI, attempt.m_sceneJ));
+  if(it == m_pairStates.end()) return;
+
+  PairState& pairState = it->second;
+  const bool verified = attempt.m_relativePose != boost::none;
+
+  // Update the success statistics for the scene pair.
+  ++pairState.attemptCount;
+  if(verified) ++pairState.verifiedCount;
+
+  // Further reduce the weight of the tried frame (which was provisionally reduced when it was scheduled), according to the outcome of the attempt.
+  FenwickTree<double>& frameWeights = pairState.frameWeights;
+  const int frameCount = static_cast<int>(std::min(frameWeights.size(), trajectoryJ.size()));
+  const int frameIndex = attempt.m_frameIndexJ;
+  if(frameIndex < 0 || frameIndex >= frameCount) return;
+
+  frameWeights.set(frameIndex, frameWeights.get(frameIndex) * (verified ? m_verifiedAttemptFactor : m_failedAttemptFactor));
+
+  // Reduce the weights of any nearby frames whose poses are similar to that of the tried frame, so as to prefer novel views.
+  const SE3Pose& triedPose = trajectoryJ[frameIndex];
+  for(int i = std::max(frameIndex - m_noveltyWindow, 0), iend = std::min(frameIndex + m_noveltyWindow, frameCount - 1); i <= iend; ++i)
+  {
+    if(i != frameIndex && GeometryUtil::poses_are_similar(trajectoryJ[i], triedPose, 5 * M_PI / 180))
+    {
+      frameWeights.set(i, frameWeights.get(i) * m_similarViewFactor);
+    }
+  }
+}
+
+void CollaborativeCandidateSampler::record_scheduled(const CollaborativeRelocalisation& candidate)
+{
+  std::map<SceneIDPair,PairState>::iterator it = m_pairStates.find(std::make_pair(candidate.m_sceneI, candidate.m_sceneJ));
+  if(it == m_pairStates.end()) return;
+
+  // Provisionally reduce the weight of the scheduled frame, so that it is less likely to be sampled again whilst it is being tried.
+  FenwickTree<double>& frameWeights = it->second.frameWeights;
+  const int frameIndex = candidate.m_frameIndexJ;
+  if(frameIndex < 0 || frameIndex >= static_cast<int>(frameWeights.size())) return;
+
+  frameWeights.set(frameIndex, frameWeights.get(frameIndex) * m_scheduledAttemptFactor);
+}
+
+boost::optional<std::pair<CollaborativeCandidateSampler::SceneIDPair,int> > CollaborativeCandidateSampler::sample(RandomNumberGenerator& rng) const
+{
+  // Compute the cumulative weights of the scene pairs from which frames can be sampled.
+  std::vector<double> cumulativePairWeights;
+  std::vector<std::map<SceneIDPair,PairState>::const_iterator> pairs;
+  double totalPairWeight = 0.0;
+  for(std::map<SceneIDPair,PairState>::const_iterator it = m_pairStates.begin(), iend = m_pairStates.end(); it != iend; ++it)
+  {
+    const double pairWeight = compute_pair_weight(it->first, it->second);
+    if(pairWeight > 0.0)
+    {
+      totalPairWeight += pairWeight;
+      cumulativePairWeights.push_back(totalPairWeight);
+      pairs.push_back(it);
+    }
+  }
+
+  if(pairs.empty()) return boost::none;
+
+  // Sample a scene pair in proportion to its weight. There are only O(k^2) scene pairs (for k scenes), so a linear scan suffices here.
+  const double pairTarget = rng.generate_real_from_uniform<double>(0.0, totalPairWeight);
+  const size_t pairIndex = std::min<size_t>(std::upper_bound(cumulativePairWeights.begin(), cumulativePairWeights.end(), pairTarget) - cumulativePairWeights.begin(), pairs.size() - 1);
+  const std::map<SceneIDPair,PairState>::const_iterator& pair = pairs[pairIndex];
+
+  // Sample a frame from the scene pair in proportion to its weight (this takes O(log n) time, for n frames).
+  const FenwickTree<double>& frameWeights = pair->second.frameWeights;
+  const size_t frameIndex = frameWeights.find(rng.generate_real_from_uniform<double>(0.0, frameWeights.total()));
+
+  return std::make_pair(pair->first, static_cast<int>(frameIndex));
+}
+
+//#################### PRIVATE MEMBER FUNCTIONS ####################
+
+double CollaborativeCandidateSampler::compute_pair_weight(const SceneIDPair& sceneIDs, const PairState& pairState) const
+{
+  // If there are no frames that can be sampled for the pair, early out.
+  const size_t frameCount = pairState.frameWeights.size();
+  const double totalFrameWeight = frameCount > 0 ? pairState.frameWeights.total() : 0.0;
+  if(totalFrameWeight <= 0.0) return 0.0;
+
+  // Start from the expected success rate of the pair, based on the outcomes of previous attempts.
+  double weight = get_expected_success_rate(sceneIDs.first, sceneIDs.second);
+
+  // Boost pairs that may attach a new node to the connected part of the pose graph, and penalise pairs both of whose scenes are already connected to it.
+  const bool hasGlobalPoseI = m_poseOptimiser->try_get_estimated_global_pose(sceneIDs.first) != boost::none;
+  const bool hasGlobalPoseJ = m_poseOptimiser->try_get_estimated_global_pose(sceneIDs.second) != boost::none;
+  if(hasGlobalPoseI != hasGlobalPoseJ) weight *= 2.0;
+  else if(hasGlobalPoseI && hasGlobalPoseJ) weight *= 0.25;
+
+  // Boost pairs whose largest relative transform cluster is close to becoming confident, and penalise pairs whose largest cluster
+  // is already confident (these will only add to an existing confident edge), increasingly so as the cluster continues to grow.
+  boost::optional<CollaborativePoseOptimiser::SE3PoseCluster> largestCluster = m_poseOptimiser->try_get_largest_cluster(sceneIDs.first, sceneIDs.second);
+  const int largestClusterSize = largestCluster ? static_cast<int>(largestCluster->size()) : 0;
+  const int confidenceThreshold = CollaborativePoseOptimiser::confidence_threshold();
+  if(largestClusterSize >= confidenceThreshold) weight /= 2.0 + largestClusterSize - confidenceThreshold;
+  else weight *= 1.0 + static_cast<double>(largestClusterSize) / confidenceThreshold;
+
+  // Finally, scale the weight by the mean weight of the pair's frames, so that pairs whose frames have mostly been tried are sampled less often.
+  return weight * totalFrameWeight / frameCount;
+}
+
+}
@@ -9,6 +9,7 @@ using namespace ORUtils;
 using namespace itmx;
 
 #include <algorithm>
+#include <sstream>
 
 #include <boost/bind.hpp>
 using boost::bind;
@@ -28,21 +29,45 @@ namespace spaint {
 //#################### CONSTRUCTORS ####################
 
 CollaborativeComponent::CollaborativeComponent(const CollaborativeContext_Ptr& context, CollaborationMode mode)
-: m_context(context),
+: m_attemptCount(0),
+  m_busyWorkerCount(0),
+  m_context(context),
   m_frameIndex(0),
   m_mode(mode),
   m_reconstructionIsConsistent(false),
   m_rng(12345),
-  m_stopRelocalisationThread(false),
-  m_visualisationGenerator(new VisualisationGenerator(context->get_settings()))
+  m_stopRelocalisationWorkers(false),
+  m_verifiedCount(0)
 {
   const Settings_CPtr& settings = context->get_settings();
   const std::string settingsNamespace = "CollaborativeComponent.";
+  m_adaptiveScheduling = settings->get_first_value<bool>(settingsNamespace + "adaptiveScheduling", false);
   m_considerPoorRelocalisations = settings->get_first_value<bool>(settingsNamespace + "considerPoorRelocalisations", mode == CM_LIVE);
   m_stopAtFirstConsistentReconstruction = settings->get_first_value<bool>(settingsNamespace + "stopAtFirstConsistentReconstruction", false);
   m_timeCollaboration = settings->get_first_value<bool>(settingsNamespace + "timeCollaboration", false);
 
-  m_relocalisationThread = boost::thread(boost::bind(&CollaborativeComponent::run_relocalisation, this));
+  // If requested, generate candidate relocalisations using a sampler that takes into account the outcomes of previous attempts,
+  // the novelty of the views involved and the state of the pose graph, rather than picking scenes and frames uniformly at random.
+  if(settings->get_first_value<bool>(settingsNamespace + "informedCandidateSelection", false))
+  {
+    m_candidateSampler.reset(new CollaborativeCandidateSampler(context->get_collaborative_pose_optimiser(), settings, "CollaborativeCandidateSampler."));
+  }
+
+  // Set up the relocalisation workers. Each worker has its own visualisation generator and render buffers, so that
+  // the workers can render synthetic images of the scenes concurrently. Note that we create all of the workers
+  // before starting any of their threads, so that the worker vector is never modified whilst they're running.
+  const size_t workerCount = std::max<size_t>(settings->get_first_value<size_t>(settingsNamespace + "relocalisationWorkerCount", 1), 1);
+  for(size_t i = 0; i < workerCount; ++i)
+  {
+    RelocalisationWorker_Ptr worker(new RelocalisationWorker);
+    worker->visualisationGenerator.reset(new VisualisationGenerator(settings));
+    m_workers.push_back(worker);
+  }
+
+  for(size_t i = 0; i < workerCount; ++i)
+  {
+    m_workers[i]->thread.reset(new boost::thread(boost::bind(&CollaborativeComponent::run_relocalisation, this, boost::ref(*m_workers[i]))));
+  }
 
   const std::string globalPosesSpecifier = settings->get_first_value<std::string>("globalPosesSpecifier", "");
   m_context->get_collaborative_pose_optimiser()->start(globalPosesSpecifier);
@@ -52,9 +77,16 @@ CollaborativeComponent::CollaborativeComponent(const CollaborativeContext_Ptr& c
 
 CollaborativeComponent::~CollaborativeComponent()
 {
-  m_stopRelocalisationThread = true;
-  m_readyToRelocalise.notify_one();
-  m_relocalisationThread.join();
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_stopRelocalisationWorkers = true;
+  }
+
+  m_readyToRelocalise.notify_all();
+  for(size_t i = 0, size = m_workers.size(); i < size; ++i)
+  {
+    m_workers[i]->thread->join();
+  }
 
   // If we're computing the time spent collaborating:
   if(m_collaborationTimer)
@@ -64,6 +96,11 @@ CollaborativeComponent::~CollaborativeComponent()
 
     // Output the time spent collaborating.
     std::cout << "Time spent collaborating: " << m_collaborationTimer->format(3) << '\n';
+
+    // Output the number of relocalisation attempts that were needed per verified relocalisation.
+    std::cout << "Relocalisation attempts: " << m_attemptCount << ", verified: " << m_verifiedCount;
+    if(m_verifiedCount > 0) std::cout << " (" << static_cast<double>(m_attemptCount) / m_verifiedCount << " attempts per verified relocalisation)";
+    std::cout << '\n';
   }
 
 #if DEBUGGING
@@ -78,7 +115,9 @@ void CollaborativeComponent::run_collaborative_pose_estimation()
   bool fusionMayStillRun = update_trajectories();
   if(!fusionMayStillRun) m_mode = CM_BATCH;
 
-  if(m_frameIndex > 0 && (!fusionMayStillRun || (m_mode == CM_LIVE && m_frameIndex % 50 == 0)))
+  // In live mode, we try to schedule relocalisations either every 50 frames or, if adaptive scheduling is enabled, on every
+  // frame (in which case scheduling will early out cheaply on frames on which none of the relocalisation workers are free).
+  if(m_frameIndex > 0 && (!fusionMayStillRun || (m_mode == CM_LIVE && (m_adaptiveScheduling || m_frameIndex % 50 == 0))))
   {
     // Start the collaboration timer if required.
     if(m_timeCollaboration && !m_collaborationTimer)
@@ -101,7 +140,24 @@ void CollaborativeComponent::run_collaborative_pose_estimation()
         }
       }
 
-      if(m_reconstructionIsConsistent) std::cout << "The reconstruction became consistent at frame: " << m_frameIndex << '\n';
+      if(m_reconstructionIsConsistent)
+      {
+        std::cout << "The reconstruction became consistent at frame: " << m_frameIndex << '\n';
+
+        // If we're computing the time spent collaborating, also output the time taken to reach the first consistent
+        // reconstruction, and the number of relocalisation attempts that were completed along the way.
+        if(m_collaborationTimer)
+        {
+          size_t attemptCount;
+          {
+            boost::lock_guard<boost::mutex> lock(m_mutex);
+            attemptCount = m_attemptCount;
+          }
+
+          const double elapsedSeconds = m_collaborationTimer->elapsed().wall / 1000000000.0;
+          std::cout << "Time to first consistent reconstruction: " << elapsedSeconds << "s (" << attemptCount << " relocalisation attempts)\n";
+        }
+      }
     }
 
     // If the reconstruction is consistent and we're stopping at the first consistent reconstruction:
@@ -127,6 +183,188 @@ void CollaborativeComponent::run_collaborative_pose_estimation()
 
 //#################### PRIVATE MEMBER FUNCTIONS ####################
 
+void CollaborativeComponent::attempt_relocalisation(CollaborativeRelocalisation& candidate, RelocalisationWorker& worker)
+{
+  // Render synthetic images of the source scene from the relevant pose and copy them across to the GPU for use by the relocaliser.
+  // The synthetic images have the size of the images in the target scene and are generated using the target scene's intrinsics.
+  const SLAMState_CPtr slamStateI = m_context->get_slam_state(candidate.m_sceneI);
+  const SLAMState_CPtr slamStateJ = m_context->get_slam_state(candidate.m_sceneJ);
+  const View_CPtr viewI = slamStateI->get_view();
+
+  // Reuse the worker's render buffers for the target scene, (re)allocating the images only if they haven't been allocated yet or have the wrong size.
+  RenderBuffers& buffers = worker.renderBuffers[candidate.m_sceneI];
+  if(!buffers.depthImage || buffers.depthImage->noDims != slamStateI->get_depth_image_size())
+  {
+    buffers.depthImage.reset(new ORFloatImage(slamStateI->get_depth_image_size(), true, true));
+  }
+
+  if(!buffers.rgbImage || buffers.rgbImage->noDims != slamStateI->get_rgb_image_size())
+  {
+    buffers.rgbImage.reset(new ORUChar4Image(slamStateI->get_rgb_image_size(), true, true));
+  }
+
+  const ORFloatImage_Ptr& depth = buffers.depthImage;
+  const ORUChar4Image_Ptr& rgb = buffers.rgbImage;
+
+  VoxelRenderState_Ptr& renderStateD = buffers.depthRenderState;
+  worker.visualisationGenerator->generate_depth_from_voxels(
+    depth, slamStateJ->get_voxel_scene(), candidate.m_localPoseJ, viewI->calib.intrinsics_d,
+    renderStateD, DepthVisualiser::DT_ORTHOGRAPHIC
+  );
+
+  VoxelRenderState_Ptr& renderStateRGB = buffers.rgbRenderState;
+  worker.visualisationGenerator->generate_voxel_visualisation(
+    rgb, slamStateJ->get_voxel_scene(), candidate.m_localPoseJ, viewI->calib.intrinsics_rgb,
+    renderStateRGB, VisualisationGenerator::VT_SCENE_COLOUR, boost::none
+  );
+
+  depth->UpdateDeviceFromHost();
+  rgb->UpdateDeviceFromHost();
+
+#ifdef WITH_OPENCV
+  // Make OpenCV copies of the synthetic images we're trying to relocalise (these may be needed later).
+  cv::Mat3b cvSourceRGB = OpenCVUtil::make_rgb_image(rgb->GetData(MEMORYDEVICE_CPU), rgb->noDims.x, rgb->noDims.y);
+  cv::Mat1b cvSourceDepth = OpenCVUtil::make_greyscale_image(depth->GetData(MEMORYDEVICE_CPU), depth->noDims.x, depth->noDims.y, OpenCVUtil::ROW_MAJOR, 100.0f);
+
+  #if DEBUGGING
+  // If we're debugging, show the synthetic images of the source scene to the user.
+  cv::imshow("Source Depth", cvSourceDepth);
+  cv::imshow("Source RGB", cvSourceRGB);
+  #endif
+#endif
+
+  // Attempt to relocalise the synthetic images using the relocaliser for the target scene. Since relocalisers are not
+  // in general thread-safe, we make sure that no other worker is using the same relocaliser at the same time.
+  boost::shared_ptr<boost::mutex> relocaliserMutex;
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    boost::shared_ptr<boost::mutex>& mutex = m_relocaliserMutexes[candidate.m_sceneI];
+    if(!mutex) mutex.reset(new boost::mutex);
+    relocaliserMutex = mutex;
+  }
+
+  std::vector<Relocaliser::Result> results;
+  {
+    boost::lock_guard<boost::mutex> lock(*relocaliserMutex);
+    Relocaliser_CPtr relocaliserI = m_context->get_relocaliser(candidate.m_sceneI);
+    results = relocaliserI->relocalise(rgb.get(), depth.get(), candidate.m_depthIntrinsicsI);
+  }
+
+  boost::optional<Relocaliser::Result> result = results.empty() ? boost::none : boost::optional<Relocaliser::Result>(results[0]);
+
+  // If the relocaliser returned a result, store the initial relocalisation quality for later examination.
+  if(result) candidate.m_initialRelocalisationQuality = result->quality;
+
+  // If relocalisation succeeded, verify the result by thresholding the difference between the
+  // source depth image and a rendered depth image of the target scene at the relevant pose.
+  bool verified = false;
+  if(result && (result->quality == Relocaliser::RELOCALISATION_GOOD || m_considerPoorRelocalisations))
+  {
+#ifdef WITH_OPENCV
+    // Render synthetic images of the target scene from the relevant pose.
+    worker.visualisationGenerator->generate_depth_from_voxels(
+      depth, slamStateI->get_voxel_scene(), result->pose.GetM(), viewI->calib.intrinsics_d,
+      renderStateD, DepthVisualiser::DT_ORTHOGRAPHIC
+    );
+
+    worker.visualisationGenerator->generate_voxel_visualisation(
+      rgb, slamStateI->get_voxel_scene(), result->pose.GetM(), viewI->calib.intrinsics_rgb,
+      renderStateRGB, VisualisationGenerator::VT_SCENE_COLOUR, boost::none
+    );
+
+    // Make OpenCV copies of the synthetic images of the target scene.
+    cv::Mat3b cvTargetRGB = OpenCVUtil::make_rgb_image(rgb->GetData(MEMORYDEVICE_CPU), rgb->noDims.x, rgb->noDims.y);
+    cv::Mat1b cvTargetDepth = OpenCVUtil::make_greyscale_image(depth->GetData(MEMORYDEVICE_CPU), depth->noDims.x, depth->noDims.y, OpenCVUtil::ROW_MAJOR, 100.0f);
+
+  #if DEBUGGING
+    // If we're debugging, show the synthetic images of the target scene to the user.
+    cv::imshow("Target RGB", cvTargetRGB);
+    cv::imshow("Target Depth", cvTargetDepth);
+  #endif
+
+    // Compute a binary mask showing which pixels are valid in both the source and target depth images.
+    cv::Mat cvSourceMask;
+    cv::inRange(cvSourceDepth, cv::Scalar(0,0,0), cv::Scalar(0,0,0), cvSourceMask);
+    cv::bitwise_not(cvSourceMask, cvSourceMask);
+
+    cv::Mat cvTargetMask;
+    cv::inRange(cvTargetDepth, cv::Scalar(0,0,0), cv::Scalar(0,0,0), cvTargetMask);
+    cv::bitwise_not(cvTargetMask, cvTargetMask);
+
+    cv::Mat cvCombinedMask;
+    cv::bitwise_and(cvSourceMask, cvTargetMask, cvCombinedMask);
+
+    // Compute the difference between the source and target depth images, and mask it using the combined mask.
+    cv::Mat cvDepthDiff, cvMaskedDepthDiff;
+    cv::absdiff(cvSourceDepth, cvTargetDepth, cvDepthDiff);
+    cvDepthDiff.copyTo(cvMaskedDepthDiff, cvCombinedMask);
+  #if DEBUGGING
+    cv::imshow("Masked Depth Difference", cvMaskedDepthDiff);
+  #endif
+
+    // Determine the average depth difference for valid pixels in the source and target depth images.
+    candidate.m_meanDepthDiff = cv::mean(cvMaskedDepthDiff);
+  #if DEBUGGING
+    std::cout << "\nMean Depth Difference: " << candidate.m_meanDepthDiff << std::endl;
+  #endif
+
+    // Compute the fraction of the target depth image that is valid.
+    candidate.m_targetValidFraction = static_cast<float>(cv::countNonZero(cvTargetMask == 255)) / (cvTargetMask.size().width * cvTargetMask.size().height);
+  #if DEBUGGING
+    std::cout << "Valid Target Pixels: " << cv::countNonZero(cvTargetMask == 255) << std::endl;
+  #endif
+
+    // Decide whether or not to verify the relocalisation, based on the average depth difference and the fraction of the target depth image that is valid.
+    verified = is_verified(candidate);
+#else
+    // If we didn't build with OpenCV, we can't do any verification, so just mark the relocalisation as verified and hope for the best.
+    verified = true;
+#endif
+  }
+
+  // If relocalisation succeeded and we successfully verified the result, add a sample of the
+  // relative transform between the source and target scenes to the pose graph optimiser.
+  if(verified)
+  {
+    // cjTwi^-1 * cjTwj = wiTcj * cjTwj = wiTwj
+    candidate.m_relativePose = ORUtils::SE3Pose(result->pose.GetInvM() * candidate.m_localPoseJ.GetM());
+    m_context->get_collaborative_pose_optimiser()->add_relative_transform_sample(candidate.m_sceneI, candidate.m_sceneJ, *candidate.m_relativePose, m_mode);
+  }
+
+  // Report the outcome of the attempt. Note that we write the whole message to the console at once, since several workers may be reporting at the same time.
+  std::ostringstream oss;
+  oss << "Attempting to relocalise frame " << candidate.m_frameIndexJ << " of " << candidate.m_sceneJ << " against " << candidate.m_sceneI << "..."
+      << (verified ? "succeeded!" : "failed :(") << '\n';
+  std::cout << oss.str() << std::flush;
+
+#if defined(WITH_OPENCV) && DEBUGGING
+  cv::waitKey(1);
+#endif
+}
+
+std::list<CollaborativeRelocalisation> CollaborativeComponent::generate_informed_candidates(size_t desiredCandidateCount) const
+{
+  std::list<CollaborativeRelocalisation> candidates;
+
+  for(size_t i = 0; i < desiredCandidateCount; ++i)
+  {
+    // Sample a scene pair (i,j), and a frame of scene j to relocalise against scene i. If nothing can be sampled, early out.
+    boost::optional<std::pair<CollaborativeCandidateSampler::SceneIDPair,int> > sample = m_candidateSampler->sample(m_rng);
+    if(!sample) break;
+
+    const std::string& sceneI = sample->first.first;
+    const std::string& sceneJ = sample->first.second;
+    const int frameIndexJ = sample->second;
+
+    // Add a candidate to relocalise the selected frame of scene j against scene i.
+    const Vector4f& depthIntrinsicsI = m_context->get_slam_state(sceneI)->get_intrinsics().projectionParamsSimple.all;
+    const ORUtils::SE3Pose& localPoseJ = m_trajectories.find(sceneJ)->second[frameIndexJ];
+    candidates.push_back(CollaborativeRelocalisation(sceneI, depthIntrinsicsI, sceneJ, frameIndexJ, localPoseJ));
+  }
+
+  return candidates;
+}
+
 std::list<CollaborativeRelocalisation> CollaborativeComponent::generate_random_candidates(size_t desiredCandidateCount) const
 {
   static bool batchThisTime = true;
@@ -356,164 +594,40 @@ void CollaborativeComponent::output_results() const
   }
 }
 
-void CollaborativeComponent::run_relocalisation()
+void CollaborativeComponent::run_relocalisation(RelocalisationWorker& worker)
 {
-  while(!m_stopRelocalisationThread)
+  for(;;)
   {
-    // Wait for a relocalisation to be scheduled.
-    {
-      boost::unique_lock<boost::mutex> lock(m_mutex);
-      while(!m_bestCandidate)
-      {
-        m_readyToRelocalise.wait(lock);
-
-        // If the collaborative component is terminating, stop attempting relocalisations and let the thread terminate.
-        if(m_stopRelocalisationThread) return;
-      }
-    }
-
-    std::cout << "Attempting to relocalise frame " << m_bestCandidate->m_frameIndexJ << " of " << m_bestCandidate->m_sceneJ << " against " << m_bestCandidate->m_sceneI << "...";
-
-    // Render synthetic images of the source scene from the relevant pose and copy them across to the GPU for use by the relocaliser.
-    // The synthetic images have the size of the images in the target scene and are generated using the target scene's intrinsics.
-    const SLAMState_CPtr slamStateI = m_context->get_slam_state(m_bestCandidate->m_sceneI);
-    const SLAMState_CPtr slamStateJ = m_context->get_slam_state(m_bestCandidate->m_sceneJ);
-    const View_CPtr viewI = slamStateI->get_view();
-
-    ORFloatImage_Ptr depth(new ORFloatImage(slamStateI->get_depth_image_size(), true, true));
-    ORUChar4Image_Ptr rgb(new ORUChar4Image(slamStateI->get_rgb_image_size(), true, true));
-
-    VoxelRenderState_Ptr& renderStateD = m_depthRenderStates[m_bestCandidate->m_sceneI];
-    m_visualisationGenerator->generate_depth_from_voxels(
-      depth, slamStateJ->get_voxel_scene(), m_bestCandidate->m_localPoseJ, viewI->calib.intrinsics_d,
-      renderStateD, DepthVisualiser::DT_ORTHOGRAPHIC
-    );
-
-    VoxelRenderState_Ptr& renderStateRGB = m_rgbRenderStates[m_bestCandidate->m_sceneI];
-    m_visualisationGenerator->generate_voxel_visualisation(
-      rgb, slamStateJ->get_voxel_scene(), m_bestCandidate->m_localPoseJ, viewI->calib.intrinsics_rgb,
-      renderStateRGB, VisualisationGenerator::VT_SCENE_COLOUR, boost::none
-    );
-
-    depth->UpdateDeviceFromHost();
-    rgb->UpdateDeviceFromHost();
-
-#ifdef WITH_OPENCV
-    // Make OpenCV copies of the synthetic images we're trying to relocalise (these may be needed later).
-    cv::Mat3b cvSourceRGB = OpenCVUtil::make_rgb_image(rgb->GetData(MEMORYDEVICE_CPU), rgb->noDims.x, rgb->noDims.y);
-    cv::Mat1b cvSourceDepth = OpenCVUtil::make_greyscale_image(depth->GetData(MEMORYDEVICE_CPU), depth->noDims.x, depth->noDims.y, OpenCVUtil::ROW_MAJOR, 100.0f);
-
-  #if DEBUGGING
-    // If we're debugging, show the synthetic images of the source scene to the user.
-    cv::imshow("Source Depth", cvSourceDepth);
-    cv::imshow("Source RGB", cvSourceRGB);
-  #endif
-#endif
+    boost::optional<CollaborativeRelocalisation> candidate;
 
-    // Attempt to relocalise the synthetic images using the relocaliser for the target scene.
-    Relocaliser_CPtr relocaliserI = m_context->get_relocaliser(m_bestCandidate->m_sceneI);
-    std::vector<Relocaliser::Result> results = relocaliserI->relocalise(rgb.get(), depth.get(), m_bestCandidate->m_depthIntrinsicsI);
-    boost::optional<Relocaliser::Result> result = results.empty() ? boost::none : boost::optional<Relocaliser::Result>(results[0]);
-
-    // If the relocaliser returned a result, store the initial relocalisation quality for later examination.
-    if(result) m_bestCandidate->m_initialRelocalisationQuality = result->quality;
-
-    // If relocalisation succeeded, verify the result by thresholding the difference between the
-    // source depth image and a rendered depth image of the target scene at the relevant pose.
-    bool verified = false;
-    if(result && (result->quality == Relocaliser::RELOCALISATION_GOOD || m_considerPoorRelocalisations))
+    // Wait for a relocalisation to be scheduled, and claim it for this worker.
     {
-#ifdef WITH_OPENCV
-      // Render synthetic images of the target scene from the relevant pose.
-      m_visualisationGenerator->generate_depth_from_voxels(
-        depth, slamStateI->get_voxel_scene(), result->pose.GetM(), viewI->calib.intrinsics_d,
-        renderStateD, DepthVisualiser::DT_ORTHOGRAPHIC
-      );
-
-      m_visualisationGenerator->generate_voxel_visualisation(
-        rgb, slamStateI->get_voxel_scene(), result->pose.GetM(), viewI->calib.intrinsics_rgb,
-        renderStateRGB, VisualisationGenerator::VT_SCENE_COLOUR, boost::none
-      );
-
-      // Make OpenCV copies of the synthetic images of the target scene.
-      cv::Mat3b cvTargetRGB = OpenCVUtil::make_rgb_image(rgb->GetData(MEMORYDEVICE_CPU), rgb->noDims.x, rgb->noDims.y);
-      cv::Mat1b cvTargetDepth = OpenCVUtil::make_greyscale_image(depth->GetData(MEMORYDEVICE_CPU), depth->noDims.x, depth->noDims.y, OpenCVUtil::ROW_MAJOR, 100.0f);
-
-    #if DEBUGGING
-      // If we're debugging, show the synthetic images of the target scene to the user.
-      cv::imshow("Target RGB", cvTargetRGB);
-      cv::imshow("Target Depth", cvTargetDepth);
-    #endif
-
-      // Compute a binary mask showing which pixels are valid in both the source and target depth images.
-      cv::Mat cvSourceMask;
-      cv::inRange(cvSourceDepth, cv::Scalar(0,0,0), cv::Scalar(0,0,0), cvSourceMask);
-      cv::bitwise_not(cvSourceMask, cvSourceMask);
-
-      cv::Mat cvTargetMask;
-      cv::inRange(cvTargetDepth, cv::Scalar(0,0,0), cv::Scalar(0,0,0), cvTargetMask);
-      cv::bitwise_not(cvTargetMask, cvTargetMask);
-
-      cv::Mat cvCombinedMask;
-      cv::bitwise_and(cvSourceMask, cvTargetMask, cvCombinedMask);
-
-      // Compute the difference between the source and target depth images, and mask it using the combined mask.
-      cv::Mat cvDepthDiff, cvMaskedDepthDiff;
-      cv::absdiff(cvSourceDepth, cvTargetDepth, cvDepthDiff);
-      cvDepthDiff.copyTo(cvMaskedDepthDiff, cvCombinedMask);
-    #if DEBUGGING
-      cv::imshow("Masked Depth Difference", cvMaskedDepthDiff);
-    #endif
-
-      // Determine the average depth difference for valid pixels in the source and target depth images.
-      m_bestCandidate->m_meanDepthDiff = cv::mean(cvMaskedDepthDiff);
-    #if DEBUGGING
-      std::cout << "\nMean Depth Difference: " << m_bestCandidate->m_meanDepthDiff << std::endl;
-    #endif
-
-      // Compute the fraction of the target depth image that is valid.
-      m_bestCandidate->m_targetValidFraction = static_cast<float>(cv::countNonZero(cvTargetMask == 255)) / (cvTargetMask.size().width * cvTargetMask.size().height);
-    #if DEBUGGING
-      std::cout << "Valid Target Pixels: " << cv::countNonZero(cvTargetMask == 255) << std::endl;
-    #endif
-
-      // Decide whether or not to verify the relocalisation, based on the average depth difference and the fraction of the target depth image that is valid.
-      verified = is_verified(*m_bestCandidate);
-#else
-      // If we didn't build with OpenCV, we can't do any verification, so just mark the relocalisation as verified and hope for the best.
-      verified = true;
-#endif
-    }
+      boost::unique_lock<boost::mutex> lock(m_mutex);
+      while(m_scheduledCandidates.empty() && !m_stopRelocalisationWorkers) m_readyToRelocalise.wait(lock);
 
-    // If relocalisation succeeded and we successfully verified the result, add a sample of the
-    // relative transform between the source and target scenes to the pose graph optimiser.
-    if(verified)
-    {
-      // cjTwi^-1 * cjTwj = wiTcj * cjTwj = wiTwj
-      m_bestCandidate->m_relativePose = ORUtils::SE3Pose(result->pose.GetInvM() * m_bestCandidate->m_localPoseJ.GetM());
-      m_context->get_collaborative_pose_optimiser()->add_relative_transform_sample(m_bestCandidate->m_sceneI, m_bestCandidate->m_sceneJ, *m_bestCandidate->m_relativePose, m_mode);
-      std::cout << "succeeded!" << std::endl;
+      // If the collaborative component is terminating, stop attempting relocalisations and let the thread terminate.
+      if(m_stopRelocalisationWorkers) return;
 
-#if defined(WITH_OPENCV) && DEBUGGING
-      cv::waitKey(1);
-#endif
+      candidate = m_scheduledCandidates.front();
+      m_scheduledCandidates.pop_front();
+      ++m_busyWorkerCount;
     }
-    else
-    {
-      std::cout << "failed :(" << std::endl;
 
-#if defined(WITH_OPENCV) && DEBUGGING
-      cv::waitKey(1);
-#endif
-    }
+    attempt_relocalisation(*candidate, worker);
 
-    // Record the results of the relocalisation we just tried if desired, and prepare for another relocalisation.
+    // Record the results of the relocalisation we just tried if desired, and make the worker available for another relocalisation.
     {
       boost::unique_lock<boost::mutex> lock(m_mutex);
 #if DEBUGGING
-      m_results.push_back(*m_bestCandidate);
+      m_results.push_back(*candidate);
 #endif
-      m_bestCandidate.reset();
+      ++m_attemptCount;
+      if(candidate->m_relativePose) ++m_verifiedCount;
+
+      // If we're using informed candidate selection, let the sampler take the outcome of the attempt into account.
+      if(m_candidateSampler) m_candidateSampler->record_attempt(*candidate, m_trajectories[candidate->m_sceneJ]);
+      m_inFlightCandidateKeys.erase(make_candidate_key(*candidate));
+      --m_busyWorkerCount;
     }
 
     // In live mode, allow a bit of extra time for training before running the next relocalisation.
@@ -560,7 +674,31 @@ void CollaborativeComponent::score_candidates(std::list<CollaborativeRelocalisat
       }
     }
 
-    candidate.m_candidateScore = newNodeBoost - confidencePenalty - homogeneityPenalty;
+    // If we're using informed candidate selection, boost candidates whose views are likely to be covered by scene i, i.e. those
+    // whose poses, when mapped into scene i's coordinate system using the current estimate (if any) of the relative transform
+    // between the scenes, are similar to a pose on scene i's trajectory.
+    float coverageBoost = 0.0f;
+
+    if(m_candidateSampler)
+    {
+      boost::optional<std::pair<ORUtils::SE3Pose,size_t> > relativeTransform = poseOptimiser->try_get_relative_transform(candidate.m_sceneI, candidate.m_sceneJ);
+      if(relativeTransform)
+      {
+        // cjTwj * wiTwj^-1 = cjTwj * wjTwi = cjTwi
+        const ORUtils::SE3Pose poseInI(candidate.m_localPoseJ.GetM() * relativeTransform->first.GetInvM());
+        const std::deque<ORUtils::SE3Pose>& trajectoryI = m_trajectories.find(candidate.m_sceneI)->second;
+        for(std::deque<ORUtils::SE3Pose>::const_iterator kt = trajectoryI.begin(), kend = trajectoryI.end(); kt != kend; ++kt)
+        {
+          if(GeometryUtil::poses_are_similar(poseInI, *kt, 30 * M_PI / 180, 0.5f))
+          {
+            coverageBoost = 1.0f;
+            break;
+          }
+        }
+      }
+    }
+
+    candidate.m_candidateScore = newNodeBoost + coverageBoost - confidencePenalty - homogeneityPenalty;
   }
 }
 
@@ -569,13 +707,16 @@ void CollaborativeComponent::try_schedule_relocalisation()
   {
     boost::unique_lock<boost::mutex> lock(m_mutex);
 
-    // If an existing relocalisation attempt is in progress, early out.
-    if(m_bestCandidate) return;
+    // Determine how many of the relocalisation workers are free, i.e. neither busy nor already due to pick up a scheduled
+    // relocalisation. If none of them are, early out.
+    const size_t pendingCount = m_busyWorkerCount + m_scheduledCandidates.size();
+    if(pendingCount >= m_workers.size()) return;
+    const size_t freeWorkerCount = m_workers.size() - pendingCount;
 
 #if 1
-    // Randomly generate a list of candidate relocalisations.
-    const size_t desiredCandidateCount = 10;
-    std::list<CollaborativeRelocalisation> candidates = generate_random_candidates(desiredCandidateCount);
+    // Generate a list of candidate relocalisations (10 per free worker), either using the candidate sampler (if we're using informed candidate selection) or randomly.
+    const size_t desiredCandidateCount = 10 * freeWorkerCount;
+    std::list<CollaborativeRelocalisation> candidates = m_candidateSampler ? generate_informed_candidates(desiredCandidateCount) : generate_random_candidates(desiredCandidateCount);
 #else
     // Generate the frames from the source scene in order, for evaluation purposes.
     std::list<CollaborativeRelocalisation> candidates = generate_sequential_candidate();
@@ -599,18 +740,31 @@ void CollaborativeComponent::try_schedule_relocalisation()
     std::cout << "END CANDIDATES\n";
 #endif
 
-    // Schedule the best candidate for relocalisation.
-    m_bestCandidate.reset(new CollaborativeRelocalisation(candidates.back()));
-
-    // If we're in batch mode, record the index of the frame we're trying in case we want to avoid frames with similar poses later.
-    if(m_mode == CM_BATCH)
+    // Schedule the best candidates for relocalisation, one for each free worker, skipping any that duplicate a relocalisation
+    // that is already scheduled or in progress (since the candidates are generated randomly, the same one can be generated
+    // more than once, both within a single call and across calls made whilst earlier attempts are still running).
+    size_t scheduledCount = 0;
+    for(std::list<CollaborativeRelocalisation>::const_reverse_iterator it = candidates.rbegin(), iend = candidates.rend(); it != iend && scheduledCount < freeWorkerCount; ++it)
     {
-      std::set<int>& triedFrameIndices = m_triedFrameIndices[std::make_pair(m_bestCandidate->m_sceneI, m_bestCandidate->m_sceneJ)];
-      triedFrameIndices.insert(m_bestCandidate->m_frameIndexJ);
+      const CollaborativeRelocalisation& candidate = *it;
+      if(!m_inFlightCandidateKeys.insert(make_candidate_key(candidate)).second) continue;
+
+      m_scheduledCandidates.push_back(candidate);
+      ++scheduledCount;
+
+      // If we're using informed candidate selection, let the sampler know that the candidate's frame is being tried.
+      if(m_candidateSampler) m_candidateSampler->record_scheduled(candidate);
+
+      // If we're in batch mode, record the index of the frame we're trying in case we want to avoid frames with similar poses later.
+      if(m_mode == CM_BATCH)
+      {
+        std::set<int>& triedFrameIndices = m_triedFrameIndices[std::make_pair(candidate.m_sceneI, candidate.m_sceneJ)];
+        triedFrameIndices.insert(candidate.m_frameIndexJ);
+      }
     }
   }
 
-  m_readyToRelocalise.notify_one();
+  m_readyToRelocalise.notify_all();
 }
 
 bool CollaborativeComponent::update_trajectories()
@@ -627,7 +781,10 @@ bool CollaborativeComponent::update_trajectories()
     TrackingState_CPtr trackingState = slamState->get_tracking_state();
     if(inputStatus == SLAMState::IS_ACTIVE && trackingState->trackerResult == ITMTrackingState::TRACKING_GOOD)
     {
+      // Note that the trajectories (and the candidate sampler) are also accessed by the relocalisation workers, so we must hold the mutex here.
+      boost::lock_guard<boost::mutex> lock(m_mutex);
       m_trajectories[sceneIDs[i]].push_back(*trackingState->pose_d);
+      if(m_candidateSampler) m_candidateSampler->add_frame(sceneIDs[i]);
     }
 
     if(inputStatus != SLAMState::IS_TERMINATED) fusionMayStillRun = true;
@@ -636,4 +793,11 @@ bool CollaborativeComponent::update_trajectories()
   return fusionMayStillRun;
 }
 
+//#################### PRIVATE STATIC MEMBER FUNCTIONS ####################
+
+CollaborativeComponent::CandidateKey CollaborativeComponent::make_candidate_key(const CollaborativeRelocalisation& candidate)
+{
+  return std::make_pair(std::make_pair(candidate.m_sceneI, candidate.m_sceneJ), candidate.m_frameIndexJ);
+}
+
 }
@@ -27,6 +27,8 @@ using namespace ORUtils;
 #include <itmx/remotemapping/RGBDCalibrationMessage.h>
 using namespace itmx;
 
+#include <orx/relocalisation/AsyncTrainingRelocaliser.h>
+
 #include <tvgutil/misc/SettingsContainer.h>
 using namespace tvgutil;
 
@@ -51,10 +53,20 @@ SLAMComponent::SLAMComponent(const SLAMContext_Ptr& context, const std::string&
   m_imageSourceEngine(imageSourceEngine),
   m_initialFramesToFuse(50), // FIXME: This value should be passed in rather than hard-coded.
   m_mappingMode(mappingMode),
+  m_prefetchDevice(0),
+  m_prefetchState(PREFETCH_NONE),
+  m_prefetchThreadShouldTerminate(false),
   m_relocaliserTrainingCount(0),
   m_relocaliserTrainingSkip(0),
   m_sceneID(sceneID),
   m_settingsNamespace("SLAMComponent."),
+  m_timerAcquisition("Acquisition"),
+  m_timerFiducials("Fiducials"),
+  m_timerFrame("Frame"),
+  m_timerFusion("Fusion"),
+  m_timerRelocalisation("Relocalisation"),
+  m_timerRendering("Rendering"),
+  m_timerTracking("Tracking"),
   m_trackerConfig(trackerConfig),
   m_trackingMode(trackingMode)
 {
@@ -118,6 +130,64 @@ SLAMComponent::SLAMComponent(const SLAMContext_Ptr& context, const std::string&
 
   // Set up the fiducial detector (if any).
   setup_fiducial_detector();
+
+  // Determine whether or not the frames should be processed in a pipelined way, and whether or not the stages of the pipeline should be timed.
+  m_pipelined = settings->get_first_value<bool>(m_settingsNamespace + "pipelined", false);
+  m_timersEnabled = settings->get_first_value<bool>(m_settingsNamespace + "timersEnabled", false);
+
+  // If we're pipelining, set up the back buffers into which the next frame will be prefetched, and start the prefetcher.
+  if(m_pipelined)
+  {
+    m_prefetchedFrame.rgbImage.reset(new ORUChar4Image(rgbImageSize, true, true));
+    m_prefetchedFrame.rawDepthImage.reset(new ORShortImage(depthImageSize, true, true));
+
+#ifdef WITH_CUDA
+    // Make sure that the prefetcher uses the same GPU as the rest of the component.
+    ORcudaSafeCall(cudaGetDevice(&m_prefetchDevice));
+#endif
+
+    m_prefetchThread.reset(new boost::thread(boost::bind(&SLAMComponent::run_prefetcher, this)));
+  }
+}
+
+//#################### DESTRUCTOR ####################
+
+SLAMComponent::~SLAMComponent()
+{
+  // Stop the prefetcher (if any).
+  if(m_prefetchThread)
+  {
+    {
+      boost::lock_guard<boost::mutex> lock(m_prefetchMutex);
+      m_prefetchThreadShouldTerminate = true;
+    }
+
+    m_prefetchRequested.notify_one();
+    m_prefetchThread->join();
+  }
+
+  // If the timers are enabled, print the per-stage latencies and the overall throughput.
+  if(m_timersEnabled)
+  {
+    std::cout << "SLAMComponent (" << m_sceneID << (m_pipelined ? ", pipelined" : ", serial") << ") Timings:\n"
+              << m_timerAcquisition << '\n'
+              << m_timerTracking << '\n'
+              << m_timerRelocalisation << '\n'
+              << m_timerFusion << '\n'
+              << m_timerRendering << '\n'
+              << m_timerFiducials << '\n'
+              << m_timerFrame << '\n';
+
+    if(m_firstFrameStartTime && m_lastFrameEndTime)
+    {
+      const double seconds = boost::chrono::duration_cast<boost::chrono::duration<double> >(*m_lastFrameEndTime - *m_firstFrameStartTime).count();
+      std::cout << "Throughput: " << m_timerFrame.count() << " frames in " << seconds << "s";
+      if(seconds > 0.0) std::cout << " (" << m_timerFrame.count() / seconds << " fps)";
+      std::cout << '\n';
+    }
+
+    std::cout << std::flush;
+  }
 }
 
 //#################### PUBLIC MEMBER FUNCTIONS ####################
@@ -134,6 +204,9 @@ const std::string& SLAMComponent::get_scene_id() const
 
 void SLAMComponent::load_models(const std::string& inputDir)
 {
+  // Make sure that the prefetcher (if any) is not using the view builder.
+  wait_for_prefetcher();
+
   // Reset the scene.
   reset_scene();
 
@@ -174,25 +247,40 @@ bool SLAMComponent::process_frame()
 {
   const SLAMState_Ptr& slamState = m_context->get_slam_state(m_sceneID);
 
-  if(m_imageSourceEngine->hasImagesNow())
-  {
-    slamState->set_input_status(SLAMState::IS_ACTIVE);
-  }
-  else
-  {
-    const SLAMState::InputStatus inputStatus = m_imageSourceEngine->hasMoreImages() ? SLAMState::IS_IDLE : SLAMState::IS_TERMINATED;
+  const TimePoint frameStartTime = boost::chrono::steady_clock::now();
+  start_timer(m_timerFrame);
+
+  // Try to get the next frame. In pipelined mode, this is the frame that the prefetcher has already acquired into
+  // the back buffers (which are then swapped with the front ones); otherwise, we acquire it directly into the front
+  // buffers, i.e. the input images and view in the SLAM state.
+  InputFrame frame;
+  frame.rawDepthImage = slamState->get_input_raw_depth_image();
+  frame.rgbImage = slamState->get_input_rgb_image();
+  frame.view = slamState->get_view();
 
+  if(m_pipelined) swap_with_prefetched_frame(frame);
+  else acquire_frame(frame);
+
+  if(frame.inputStatus != SLAMState::IS_ACTIVE)
+  {
     // If finish training is enabled and no more images are expected, let the relocaliser know that no more calls will be made to its train or update functions.
-    if(m_finishTrainingEnabled && inputStatus == SLAMState::IS_TERMINATED && slamState->get_input_status() != SLAMState::IS_TERMINATED)
+    if(m_finishTrainingEnabled && frame.inputStatus == SLAMState::IS_TERMINATED && slamState->get_input_status() != SLAMState::IS_TERMINATED)
     {
       m_context->get_relocaliser(m_sceneID)->finish_training();
     }
 
-    slamState->set_input_status(inputStatus);
+    slamState->set_input_status(frame.inputStatus);
 
     return false;
   }
 
+  slamState->set_input_status(SLAMState::IS_ACTIVE);
+  slamState->set_input_raw_depth_image(frame.rawDepthImage);
+  slamState->set_input_rgb_image(frame.rgbImage);
+  slamState->set_view(frame.view);
+
+  if(!m_firstFrameStartTime) m_firstFrameStartTime = frameStartTime;
+
   const ORShortImage_Ptr& inputRawDepthImage = slamState->get_input_raw_depth_image();
   const ORUChar4Image_Ptr& inputRGBImage = slamState->get_input_rgb_image();
   const SurfelRenderState_Ptr& liveSurfelRenderState = slamState->get_live_surfel_render_state();
@@ -202,12 +290,7 @@ bool SLAMComponent::process_frame()
   const View_Ptr& view = slamState->get_view();
   const SpaintVoxelScene_Ptr& voxelScene = slamState->get_voxel_scene();
 
-  // Get the next frame.
-  ITMView *newView = view.get();
-  m_imageSourceEngine->getImages(inputRGBImage.get(), inputRawDepthImage.get());
-  const bool useBilateralFilter = m_trackingMode == TRACK_SURFELS;
-  m_viewBuilder->UpdateView(&newView, inputRGBImage.get(), inputRawDepthImage.get(), useBilateralFilter);
-  slamState->set_view(newView);
+  start_timer(m_timerTracking);
 
   // If there's an active input mask of the right size, apply it to the depth image.
   ORFloatImage_Ptr maskedDepthImage;
@@ -240,6 +323,9 @@ bool SLAMComponent::process_frame()
   // If there was an active input mask, restore the original depth image after tracking.
   if(maskedDepthImage) view->depth->Swap(*maskedDepthImage);
 
+  stop_timer(m_timerTracking);
+  start_timer(m_timerRelocalisation);
+
   // Determine the tracking quality, taking into account the failure mode being used.
   switch(m_context->get_settings()->behaviourOnFailure)
   {
@@ -268,6 +354,9 @@ bool SLAMComponent::process_frame()
     }
   }
 
+  stop_timer(m_timerRelocalisation);
+  start_timer(m_timerFusion);
+
   // Decide whether or not fusion should be run.
   bool runFusion = m_fusionEnabled;
   if(trackingState->trackerResult == ITMTrackingState::TRACKING_FAILED ||
@@ -295,7 +384,7 @@ bool SLAMComponent::process_frame()
     if(mappingClient)
     {
       // Send the current frame to the remote mapping server.
-      MappingClient::RGBDFrameMessageQueue::PushHandler_Ptr pushHandler = mappingClient->begin_push_frame_message();
+      MappingClient::FrameMessagePushHandler_Ptr pushHandler = mappingClient->begin_push_frame_message();
       boost::optional<RGBDFrameMessage_Ptr&> elt = pushHandler->get();
       if(elt)
       {
@@ -320,6 +409,9 @@ bool SLAMComponent::process_frame()
     *trackingState->pose_d = oldPose;
   }
 
+  stop_timer(m_timerFusion);
+  start_timer(m_timerRendering);
+
   // Render from the live camera position to prepare for tracking in the next frame.
   prepare_for_tracking(m_trackingMode);
 
@@ -329,10 +421,15 @@ bool SLAMComponent::process_frame()
     m_context->get_surfel_visualisation_engine()->FindSurfaceSuper(surfelScene.get(), trackingState->pose_d, &view->calib.intrinsics_d, USR_RENDER, liveSurfelRenderState.get());
   }
 
-  // If we're using a composite image source engine, the current sub-engine has run out of images and we're not using global poses, disable fusion.
-  CompositeImageSourceEngine_CPtr compositeImageSourceEngine = boost::dynamic_pointer_cast<const CompositeImageSourceEngine>(m_imageSourceEngine);
+  stop_timer(m_timerRendering);
+
+  // If we're using a composite image source engine, the current sub-engine had run out of images once the frame was acquired
+  // and we're not using global poses, disable fusion. Note that we check the state recorded at acquisition time rather than
+  // querying the image source engine, since in pipelined mode the prefetcher may already be reading the next frame from it.
   const bool usingGlobalPoses = m_context->get_settings()->get_first_value<std::string>("globalPosesSpecifier", "") != "";
-  if(compositeImageSourceEngine && !compositeImageSourceEngine->getCurrentSubengine()->hasMoreImages() && !usingGlobalPoses) m_fusionEnabled = false;
+  if(frame.currentSubengineExhausted && !usingGlobalPoses) m_fusionEnabled = false;
+
+  start_timer(m_timerFiducials);
 
   // If we're using a fiducial detector and the user wants to detect fiducials and the tracking is good, try to detect fiducial markers
   // in the current view of the scene and update the current set of fiducials that we're maintaining accordingly.
@@ -342,6 +439,8 @@ bool SLAMComponent::process_frame()
     slamState->update_fiducials(fiducialDetector->detect_fiducials(view, *trackingState->pose_d));
   }
 
+  stop_timer(m_timerFiducials);
+
 #ifdef WITH_VICON
   // If we're using a Vicon fiducial detector to calibrate the Vicon system, and a stable pose for the Vicon origin has newly been determined,
   // store the relative transformation from world space to Vicon space.
@@ -360,11 +459,18 @@ bool SLAMComponent::process_frame()
   }
 #endif
 
+  stop_timer(m_timerFrame);
+  m_lastFrameEndTime = boost::chrono::steady_clock::now();
+
   return true;
 }
 
 void SLAMComponent::reset_scene()
 {
+  // Make sure that the prefetcher (if any) is not using the SLAM state, and discard any frame it acquired
+  // before the reset, since that frame should not be fused into the new scene.
+  discard_prefetched_frame();
+
   // Reset the scene.
   const SLAMState_Ptr& slamState = m_context->get_slam_state(m_sceneID);
   m_denseVoxelMapper->ResetScene(slamState->get_voxel_scene().get());
@@ -387,6 +493,9 @@ void SLAMComponent::reset_scene()
 
 void SLAMComponent::save_models(const std::string& outputDir) const
 {
+  // Make sure that the prefetcher (if any) is not in the middle of acquiring a frame whilst we save the models.
+  wait_for_prefetcher();
+
   // If reconstruction hasn't started yet, early out.
   SLAMState_CPtr slamState = m_context->get_slam_state(m_sceneID);
   if(!slamState->get_view()) return;
@@ -435,6 +544,9 @@ void SLAMComponent::set_fusion_enabled(bool fusionEnabled)
 
 void SLAMComponent::set_mapping_client(const MappingClient_Ptr& mappingClient)
 {
+  // Make sure that the prefetcher (if any) is not using the image source engine.
+  wait_for_prefetcher();
+
   m_context->get_mapping_client(m_sceneID) = mappingClient;
 
   // If we're using a mapping client, send an initial calibration message across to the server.
@@ -445,12 +557,13 @@ void SLAMComponent::set_mapping_client(const MappingClient_Ptr& mappingClient)
     RGBDCalibrationMessage calibMsg;
     calibMsg.set_calib(m_imageSourceEngine->getCalib());
 
-    // TODO: Allow these to be configured from the command line.
+    // TODO: Allow the RGB compression type to be configured from the command line.
+    const Settings_CPtr& settings = m_context->get_settings();
 #ifdef WITH_OPENCV
-    calibMsg.set_depth_compression_type(DEPTH_COMPRESSION_PNG);
+    calibMsg.set_depth_compression_type(settings->get_first_value<DepthCompressionType>("MappingClient.depthCompressionType", DEPTH_COMPRESSION_PNG));
     calibMsg.set_rgb_compression_type(RGB_COMPRESSION_JPG);
 #else
-    calibMsg.set_depth_compression_type(DEPTH_COMPRESSION_NONE);
+    calibMsg.set_depth_compression_type(settings->get_first_value<DepthCompressionType>("MappingClient.depthCompressionType", DEPTH_COMPRESSION_NONE));
     calibMsg.set_rgb_compression_type(RGB_COMPRESSION_NONE);
 #endif
 
@@ -461,6 +574,46 @@ void SLAMComponent::set_mapping_client(const MappingClient_Ptr& mappingClient)
 
 //#################### PRIVATE MEMBER FUNCTIONS ####################
 
+void SLAMComponent::acquire_frame(InputFrame& frame)
+{
+  if(m_imageSourceEngine->hasImagesNow())
+  {
+    start_timer(m_timerAcquisition);
+
+    // Read the images and preprocess them into a view.
+    m_imageSourceEngine->getImages(frame.rgbImage.get(), frame.rawDepthImage.get());
+
+    ITMView *newView = frame.view.get();
+    const bool useBilateralFilter = m_trackingMode == TRACK_SURFELS;
+    m_viewBuilder->UpdateView(&newView, frame.rgbImage.get(), frame.rawDepthImage.get(), useBilateralFilter);
+    if(newView != frame.view.get()) frame.view.reset(newView);
+
+    // Record whether or not the current sub-engine of a composite image source engine (if any) has now run out of images.
+    CompositeImageSourceEngine_CPtr compositeImageSourceEngine = boost::dynamic_pointer_cast<const CompositeImageSourceEngine>(m_imageSourceEngine);
+    frame.currentSubengineExhausted = compositeImageSourceEngine && !compositeImageSourceEngine->getCurrentSubengine()->hasMoreImages();
+
+    frame.inputStatus = SLAMState::IS_ACTIVE;
+
+    stop_timer(m_timerAcquisition);
+  }
+  else
+  {
+    frame.currentSubengineExhausted = false;
+    frame.inputStatus = m_imageSourceEngine->hasMoreImages() ? SLAMState::IS_IDLE : SLAMState::IS_TERMINATED;
+  }
+}
+
+void SLAMComponent::discard_prefetched_frame()
+{
+  if(!m_prefetchThread) return;
+
+  boost::unique_lock<boost::mutex> lock(m_prefetchMutex);
+  while(m_prefetchState == PREFETCH_REQUESTED) m_prefetchCompleted.wait(lock);
+
+  // Return the prefetcher to its initial state, so that the next call to swap_with_prefetched_frame asks it for a new frame.
+  m_prefetchState = PREFETCH_NONE;
+}
+
 std::vector<SE3Pose> SLAMComponent::load_ground_truth_relocalisation_trajectory() const
 {
   std::vector<SE3Pose> groundTruthTrajectory;
@@ -607,6 +760,34 @@ Relocaliser_Ptr SLAMComponent::refine_with_icp(const Relocaliser_Ptr& relocalise
   ));
 }
 
+void SLAMComponent::run_prefetcher()
+{
+#ifdef WITH_CUDA
+  ORcudaSafeCall(cudaSetDevice(m_prefetchDevice));
+#endif
+
+  for(;;)
+  {
+    // Wait until either the next frame is requested or the component is being destroyed.
+    {
+      boost::unique_lock<boost::mutex> lock(m_prefetchMutex);
+      while(m_prefetchState != PREFETCH_REQUESTED && !m_prefetchThreadShouldTerminate) m_prefetchRequested.wait(lock);
+      if(m_prefetchThreadShouldTerminate) return;
+    }
+
+    // Acquire the next frame into the back buffers. Whilst a frame has been requested, only the prefetcher touches them.
+    acquire_frame(m_prefetchedFrame);
+
+    // Signal that the frame is ready.
+    {
+      boost::lock_guard<boost::mutex> lock(m_prefetchMutex);
+      m_prefetchState = PREFETCH_COMPLETE;
+    }
+
+    m_prefetchCompleted.notify_one();
+  }
+}
+
 void SLAMComponent::setup_fiducial_detector()
 {
   const SpaintVoxelScene_CPtr scene = m_context->get_slam_state(m_sceneID)->get_voxel_scene();
@@ -646,7 +827,8 @@ void SLAMComponent::setup_relocaliser()
   m_relocaliseEveryFrame = settings->get_first_value<bool>(m_settingsNamespace + "relocaliseEveryFrame", false);
   m_relocaliserTrainingSkip = settings->get_first_value<size_t>(m_settingsNamespace + "relocaliserTrainingSkip", 0);
 
-  m_context->get_relocaliser(m_sceneID) = RelocaliserFactory::make_relocaliser(
+  Relocaliser_Ptr& relocaliser = m_context->get_relocaliser(m_sceneID);
+  relocaliser = RelocaliserFactory::make_relocaliser(
     m_relocaliserType,
     m_imageSourceEngine->getDepthImageSize(),
     m_relocaliseEveryFrame,
@@ -654,6 +836,12 @@ void SLAMComponent::setup_relocaliser()
     boost::bind(&SLAMComponent::load_ground_truth_relocalisation_trajectory, this),
     settings
   );
+
+  // If requested, train the relocaliser asynchronously, so that training it doesn't add to the latency of the main loop.
+  if(settings->get_first_value<bool>(m_settingsNamespace + "asyncRelocaliserTraining", false))
+  {
+    relocaliser.reset(new AsyncTrainingRelocaliser(relocaliser, settings, "AsyncTrainingRelocaliser."));
+  }
 }
 
 void SLAMComponent::setup_tracker()
@@ -670,4 +858,46 @@ void SLAMComponent::setup_tracker()
   );
 }
 
+void SLAMComponent::start_timer(AverageTimer& timer) const
+{
+  if(m_timersEnabled) timer.start_sync();
+}
+
+void SLAMComponent::stop_timer(AverageTimer& timer) const
+{
+  if(m_timersEnabled) timer.stop_sync();
+}
+
+void SLAMComponent::swap_with_prefetched_frame(InputFrame& frame)
+{
+  boost::unique_lock<boost::mutex> lock(m_prefetchMutex);
+
+  // If this is the first frame, the prefetcher won't have been asked for anything yet, so ask it now.
+  if(m_prefetchState == PREFETCH_NONE)
+  {
+    m_prefetchState = PREFETCH_REQUESTED;
+    m_prefetchRequested.notify_one();
+  }
+
+  // Wait for the prefetcher to finish trying to acquire the frame.
+  while(m_prefetchState != PREFETCH_COMPLETE) m_prefetchCompleted.wait(lock);
+
+  // If it succeeded, swap the back buffers with the front ones, so that the caller gets the new frame and the
+  // prefetcher can reuse the buffers of the frame we just finished processing. If not, leave the buffers alone.
+  if(m_prefetchedFrame.inputStatus == SLAMState::IS_ACTIVE) std::swap(frame, m_prefetchedFrame);
+  else frame.inputStatus = m_prefetchedFrame.inputStatus;
+
+  // Ask the prefetcher to start acquiring the frame after this one whilst the caller processes this one.
+  m_prefetchState = PREFETCH_REQUESTED;
+  m_prefetchRequested.notify_one();
+}
+
+void SLAMComponent::wait_for_prefetcher() const
+{
+  if(!m_prefetchThread) return;
+
+  boost::unique_lock<boost::mutex> lock(m_prefetchMutex);
+  while(m_prefetchState == PREFETCH_REQUESTED) m_prefetchCompleted.wait(lock);
+}
+
 }
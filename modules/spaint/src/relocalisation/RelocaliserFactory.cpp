@@ -90,7 +90,7 @@ Relocaliser_Ptr RelocaliserFactory::make_relocaliser(std::string relocaliserType
       );
     }
 
-    ensembleRelocaliser.reset(new EnsembleRelocaliser(innerRelocalisers));
+    ensembleRelocaliser.reset(new EnsembleRelocaliser(innerRelocalisers, settings, relocaliserNamespace));
 
     Relocaliser_Ptr innerRelocaliser;
     if(deviceCount > 1)
@@ -178,6 +178,11 @@ void SLAMState::set_view(ITMLib::ITMView *view)
   if(m_view.get() != view) m_view.reset(view);
 }
 
+void SLAMState::set_view(const View_Ptr& view)
+{
+  m_view = view;
+}
+
 void SLAMState::set_voxel_scene(const SpaintVoxelScene_Ptr& voxelScene)
 {
   m_voxelScene = voxelScene;
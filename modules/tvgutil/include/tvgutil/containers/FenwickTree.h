@@ -0,0 +1,220 @@
+/**
+ * tvgutil: FenwickTree.h
+ * Copyright (c) Torr Vision Group, University of Oxford, 2019. All rights reserved.
+ */
+
+#ifndef H_TVGUTIL_FENWICKTREE
+#define H_TVGUTIL_FENWICKTREE
+
+#include <stdexcept>
+#include <vector>
+
+namespace tvgutil {
+
+/**
+ * \brief An instance of an instantiation of this class template represents a Fenwick tree (binary indexed tree) over a sequence of non-negative values.
+ *
+ * A Fenwick tree allows individual values to be updated, and prefix sums of the values to be computed, in O(log n) time.
+ * It can also be used to find the element whose cumulative range contains a given target value in O(log n) time, which
+ * makes it possible to sample elements of the sequence with probabilities proportional to their values (e.g. weights)
+ * without having to recompute a cumulative distribution every time one of the weights changes. Values can be appended
+ * to the end of the sequence (again in O(log n) time), so the sequence can grow over time.
+ *
+ * \tparam T  The value type (an arithmetic type).
+ */
+template <typename T>
+class FenwickTree
+{
+  //#################### PRIVATE VARIABLES ####################
+private:
+  /**
+   * The tree itself. This is indexed from 1 (element 0 is unused): element k stores the sum of the values
+   * whose (1-based) indices lie in the half-open range (k - lowbit(k), k], where lowbit(k) = k & -k.
+   */
+  std::vector<T> m_tree;
+
+  /** The values themselves (indexed from 0). */
+  std::vector<T> m_values;
+
+  //#################### CONSTRUCTORS ####################
+public:
+  /**
+   * \brief Constructs an empty Fenwick tree.
+   */
+  FenwickTree()
+  : m_tree(1, T())
+  {}
+
+  //#################### PUBLIC MEMBER FUNCTIONS ####################
+public:
+  /**
+   * \brief Adds the specified amount to the value with the specified index.
+   *
+   * \param i                   The index of the value.
+   * \param delta               The amount to add to it.
+   * \throws std::out_of_range  If the index is out of range.
+   */
+  void add(size_t i, T delta)
+  {
+    if(i >= m_values.size()) throw std::out_of_range("Fenwick tree index out of range");
+
+    m_values[i] += delta;
+    for(size_t k = i + 1, treeSize = m_tree.size(); k < treeSize; k += lowbit(k))
+    {
+      m_tree[k] += delta;
+    }
+  }
+
+  /**
+   * \brief Clears the Fenwick tree.
+   */
+  void clear()
+  {
+    m_tree.assign(1, T());
+    m_values.clear();
+  }
+
+  /**
+   * \brief Finds the index of the element whose cumulative range contains the specified target value.
+   *
+   * Given a target value t, this finds the smallest index i such that the sum of the values with indices <= i is > t.
+   * Elements whose values are zero are never found. If t is chosen uniformly at random from [0,total()), the index of
+   * each element will be returned with a probability that is proportional to its value.
+   *
+   * \param target              The target value.
+   * \return                    The index of the element whose cumulative range contains the target value.
+   * \throws std::runtime_error If the values in the tree do not have a positive sum.
+   */
+  size_t find(T target) const
+  {
+    const size_t size = m_values.size();
+    if(!(total() > T())) throw std::runtime_error("Cannot search a Fenwick tree whose values do not have a positive sum");
+
+    // Descend the implicit tree, skipping each range whose sum does not exceed the remaining target.
+    size_t step = 1;
+    while(step * 2 <= size) step *= 2;
+
+    size_t pos = 0;
+    T remaining = target;
+    for(; step > 0; step /= 2)
+    {
+      if(pos + step <= size && m_tree[pos + step] <= remaining)
+      {
+        pos += step;
+        remaining -= m_tree[pos];
+      }
+    }
+
+    // If the target was >= the total (e.g. due to rounding error), return the last element with a positive value.
+    if(pos >= size)
+    {
+      pos = size - 1;
+      while(pos > 0 && !(m_values[pos] > T())) --pos;
+    }
+
+    return pos;
+  }
+
+  /**
+   * \brief Gets the value with the specified index.
+   *
+   * \param i                   The index of the value.
+   * \return                    The value.
+   * \throws std::out_of_range  If the index is out of range.
+   */
+  T get(size_t i) const
+  {
+    if(i >= m_values.size()) throw std::out_of_range("Fenwick tree index out of range");
+    return m_values[i];
+  }
+
+  /**
+   * \brief Computes the sum of the first n values in the tree.
+   *
+   * \param n                   The number of values to sum.
+   * \return                    The sum of the first n values in the tree.
+   * \throws std::out_of_range  If n is greater than the number of values in the tree.
+   */
+  T prefix_sum(size_t n) const
+  {
+    if(n > m_values.size()) throw std::out_of_range("Fenwick tree prefix length out of range");
+
+    T sum = T();
+    for(size_t k = n; k > 0; k -= lowbit(k))
+    {
+      sum += m_tree[k];
+    }
+
+    return sum;
+  }
+
+  /**
+   * \brief Appends the specified value to the end of the sequence.
+   *
+   * \param value The value to append.
+   */
+  void push_back(T value)
+  {
+    m_values.push_back(value);
+
+    // The new tree element covers the range (k - lowbit(k), k], so its sum is the new value plus the sums
+    // of the existing tree elements that together cover the range (k - lowbit(k), k - 1].
+    const size_t k = m_values.size();
+    T sum = value;
+    for(size_t j = k - 1; j > k - lowbit(k); j -= lowbit(j))
+    {
+      sum += m_tree[j];
+    }
+
+    m_tree.push_back(sum);
+  }
+
+  /**
+   * \brief Sets the value with the specified index.
+   *
+   * \param i                   The index of the value.
+   * \param value               The new value.
+   * \throws std::out_of_range  If the index is out of range.
+   */
+  void set(size_t i, T value)
+  {
+    add(i, value - get(i));
+  }
+
+  /**
+   * \brief Gets the number of values in the tree.
+   *
+   * \return  The number of values in the tree.
+   */
+  size_t size() const
+  {
+    return m_values.size();
+  }
+
+  /**
+   * \brief Computes the sum of all of the values in the tree.
+   *
+   * \return  The sum of all of the values in the tree.
+   */
+  T total() const
+  {
+    return prefix_sum(m_values.size());
+  }
+
+  //#################### PRIVATE STATIC MEMBER FUNCTIONS ####################
+private:
+  /**
+   * \brief Computes the value of the least significant set bit of the specified (non-zero) index.
+   *
+   * \param k The index.
+   * \return  The value of the least significant set bit of k.
+   */
+  static size_t lowbit(size_t k)
+  {
+    return k & (~k + 1);
+  }
+};
+
+}
+
+#endif
@@ -0,0 +1,401 @@
+/**
+ * tvgutil: LockFreePooledQueue.h
+ * Copyright (c) Torr Vision Group, University of Oxford, 2019. All rights reserved.
+ */
+
+#ifndef H_TVGUTIL_LOCKFREEPOOLEDQUEUE
+#define H_TVGUTIL_LOCKFREEPOOLEDQUEUE
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/functional/value_factory.hpp>
+#include <boost/optional.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "LockFreeRing.h"
+#include "PooledQueue.h"
+
+namespace tvgutil {
+
+/**
+ * \brief An instance of an instantiation of this class template represents a queue that is backed by a pool of reusable
+ *        elements, and that (unlike PooledQueue) does not take a lock on any of its fast paths.
+ *
+ * Both the pool and the queue itself are stored in bounded lock-free rings. The ring type determines how many threads may
+ * use the queue concurrently: with SPSCRing, exactly one thread may push and exactly one thread may peek/pop; with MPMCRing,
+ * any number of threads may do either. The interface is modelled on that of PooledQueue, but the two are not fully interchangeable:
+ *
+ * - With the 'grow' strategy, the pool can only grow up to the maximum capacity specified in initialise(). Any push that
+ *   would need to grow it beyond that is discarded.
+ * - The 'replace random' strategy is not supported. Elements can only be removed from the front of a lock-free ring, and the
+ *   front element is the one that the consumer may currently be peeking at, so a pusher cannot safely reclaim it.
+ *
+ * A thread that has to block (when peeking/popping an empty queue, or when pushing with the 'wait' strategy) spins briefly
+ * and then sleeps on a condition variable. The associated mutex is only ever taken by threads that are actually waiting,
+ * or that need to wake them up.
+ */
+template <typename T, template <typename> class Ring = MPMCRing>
+class LockFreePooledQueue
+{
+  //#################### NESTED TYPES ####################
+public:
+  /**
+   * \brief An instance of this class can be used to handle the process of pushing an element onto the queue.
+   */
+  class PushHandler : public pooled_queue::PushHandlerBase<T>
+  {
+    //~~~~~~~~~~~~~~~~~~~~ PRIVATE VARIABLES ~~~~~~~~~~~~~~~~~~~~
+  private:
+    /** A pointer to the pooled queue on which push was called. */
+    LockFreePooledQueue<T,Ring> *m_base;
+
+    /** The element that is to be pushed onto the queue (if any). */
+    boost::optional<T> m_elt;
+
+    //~~~~~~~~~~~~~~~~~~~~ CONSTRUCTORS ~~~~~~~~~~~~~~~~~~~~
+  public:
+    /**
+     * \brief Constructs a push handler.
+     *
+     * \param base  A pointer to the pooled queue on which push was called.
+     * \param elt   The element that is to be pushed onto the queue (if any).
+     */
+    PushHandler(LockFreePooledQueue<T,Ring> *base, const boost::optional<T>& elt)
+    : m_base(base), m_elt(elt)
+    {}
+
+    //~~~~~~~~~~~~~~~~~~~~ DESTRUCTOR ~~~~~~~~~~~~~~~~~~~~
+  public:
+    /**
+     * \brief Completes the push by pushing the element (if any) onto the queue.
+     */
+    ~PushHandler()
+    {
+      if(m_elt) m_base->end_push(*m_elt);
+    }
+
+    //~~~~~~~~~~~~~~~~~~~~ COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ~~~~~~~~~~~~~~~~~~~~
+  private:
+    // Deliberately private and unimplemented.
+    PushHandler(const PushHandler&);
+    PushHandler& operator=(const PushHandler&);
+
+    //~~~~~~~~~~~~~~~~~~~~ PUBLIC MEMBER FUNCTIONS ~~~~~~~~~~~~~~~~~~~~
+  public:
+    /** Override */
+    virtual boost::optional<T&> get()
+    {
+      return m_elt ? boost::optional<T&>(*m_elt) : boost::none;
+    }
+  };
+
+private:
+  /**
+   * \brief An instance of this class allows threads to block until a condition becomes true, without requiring the
+   *        threads that make the condition true to take a lock unless somebody is actually waiting.
+   */
+  class Signal
+  {
+    //~~~~~~~~~~~~~~~~~~~~ PRIVATE VARIABLES ~~~~~~~~~~~~~~~~~~~~
+  private:
+    /** The condition variable on which waiting threads sleep. */
+    boost::condition_variable m_cond;
+
+    /** The mutex associated with the condition variable. */
+    boost::mutex m_mutex;
+
+    /** The number of threads that are currently sleeping (or about to sleep) on the condition variable. */
+    boost::atomic<int> m_waiterCount;
+
+    //~~~~~~~~~~~~~~~~~~~~ CONSTRUCTORS ~~~~~~~~~~~~~~~~~~~~
+  public:
+    /**
+     * \brief Constructs a signal.
+     */
+    Signal()
+    : m_waiterCount(0)
+    {}
+
+    //~~~~~~~~~~~~~~~~~~~~ PUBLIC MEMBER FUNCTIONS ~~~~~~~~~~~~~~~~~~~~
+  public:
+    /**
+     * \brief Wakes up any threads that are waiting on the signal, so that they can re-check their conditions.
+     *
+     * Note: This must be called after the change that might make a waiting thread's condition true.
+     */
+    void notify()
+    {
+      // Make sure that the change made by the caller is visible before we check for waiters (this pairs
+      // with the fence in wait_until, and ensures that we can never miss a thread that is going to sleep).
+      boost::atomic_thread_fence(boost::memory_order_seq_cst);
+      if(m_waiterCount.load(boost::memory_order_relaxed) > 0)
+      {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        m_cond.notify_all();
+      }
+    }
+
+    /**
+     * \brief Blocks until the specified predicate returns true.
+     *
+     * \param pred  The predicate (this is evaluated repeatedly, and will generally attempt an operation on a ring).
+     */
+    template <typename Pred>
+    void wait_until(Pred pred)
+    {
+      // Spin briefly in case the condition becomes true quickly (this is the common case when the queue is busy),
+      // and then yield a few times to give the thread that will make it true a chance to run on the same core.
+      const int spinCount = 100, yieldCount = 10;
+      for(int i = 0; i < spinCount; ++i)
+      {
+        if(pred()) return;
+      }
+
+      for(int i = 0; i < yieldCount; ++i)
+      {
+        boost::this_thread::yield();
+        if(pred()) return;
+      }
+
+      // Otherwise, register as a waiter and sleep until the condition becomes true.
+      boost::unique_lock<boost::mutex> lock(m_mutex);
+      m_waiterCount.fetch_add(1, boost::memory_order_relaxed);
+      boost::atomic_thread_fence(boost::memory_order_seq_cst);
+      while(!pred()) m_cond.wait(lock);
+      m_waiterCount.fetch_sub(1, boost::memory_order_relaxed);
+    }
+  };
+
+  //#################### TYPEDEFS ####################
+public:
+  typedef boost::shared_ptr<PushHandler> PushHandler_Ptr;
+
+  //#################### PRIVATE VARIABLES ####################
+private:
+  /** The number of elements that currently exist (in the pool, in the queue or in the hands of a pusher). */
+  boost::atomic<size_t> m_eltCount;
+
+  /** A function that can be used to construct new elements (by default, the default constructor for the element type). */
+  boost::function<T()> m_maker;
+
+  /** The maximum number of elements that can exist at any one time. */
+  size_t m_maxCapacity;
+
+  /** The pool of reusable elements that backs the queue. */
+  boost::shared_ptr<Ring<T> > m_pool;
+
+  /** A strategy specifying what should happen when a push is attempted while the pool is empty. */
+  pooled_queue::PoolEmptyStrategy m_poolEmptyStrategy;
+
+  /** A signal used to wait for the pool to become non-empty. */
+  Signal m_poolNonEmpty;
+
+  /** The queue itself. */
+  boost::shared_ptr<Ring<T> > m_queue;
+
+  /** A signal used to wait for the queue to become non-empty. */
+  mutable Signal m_queueNonEmpty;
+
+  //#################### CONSTRUCTORS ####################
+public:
+  /**
+   * \brief Constructs a pooled queue.
+   *
+   * \param poolEmptyStrategy A strategy specifying what should happen when a push is attempted while the pool is empty.
+   */
+  explicit LockFreePooledQueue(pooled_queue::PoolEmptyStrategy poolEmptyStrategy = pooled_queue::PES_GROW)
+  : m_eltCount(0), m_maxCapacity(0), m_poolEmptyStrategy(poolEmptyStrategy)
+  {
+    if(poolEmptyStrategy == pooled_queue::PES_REPLACE_RANDOM)
+    {
+      throw std::runtime_error("Error: The replace random pool empty strategy is not supported by lock-free pooled queues");
+    }
+  }
+
+  //#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+private:
+  // Deliberately private and unimplemented.
+  LockFreePooledQueue(const LockFreePooledQueue&);
+  LockFreePooledQueue& operator=(const LockFreePooledQueue&);
+
+  //#################### PUBLIC MEMBER FUNCTIONS ####################
+public:
+  /**
+   * \brief Starts a push operation.
+   *
+   * This works in exactly the same way as PooledQueue::begin_push (see there for details).
+   *
+   * \return  A push handler that will handle the process of pushing an element onto the queue.
+   */
+  PushHandler_Ptr begin_push()
+  {
+    using namespace pooled_queue;
+
+    T elt;
+
+    // As in PooledQueue, we start by trying to get an element from the pool into which the caller can write. If the
+    // pool is currently empty, we apply the pool empty strategy specified when the pooled queue was constructed.
+    if(!m_pool->try_pop(elt))
+    {
+      switch(m_poolEmptyStrategy)
+      {
+        case PES_DISCARD:
+        {
+          return PushHandler_Ptr(new PushHandler(this, boost::none));
+        }
+        case PES_GROW:
+        {
+          // Reserve a slot for the new element. If the rings are already at full capacity, we discard the push instead.
+          if(m_eltCount.fetch_add(1, boost::memory_order_relaxed) >= m_maxCapacity)
+          {
+            m_eltCount.fetch_sub(1, boost::memory_order_relaxed);
+            return PushHandler_Ptr(new PushHandler(this, boost::none));
+          }
+
+          elt = m_maker();
+          break;
+        }
+        case PES_WAIT:
+        {
+          m_poolNonEmpty.wait_until(boost::bind(&Ring<T>::try_pop, m_pool.get(), boost::ref(elt)));
+          break;
+        }
+        default:
+        {
+          // This can't happen, since the constructor rejects the 'replace random' strategy.
+          throw std::runtime_error("Error: Unsupported pool empty strategy");
+        }
+      }
+    }
+
+    return PushHandler_Ptr(new PushHandler(this, elt));
+  }
+
+  /**
+   * \brief Gets whether or not the queue is empty.
+   *
+   * \return  true, if the queue is empty, or false otherwise.
+   */
+  bool empty() const
+  {
+    return m_queue->size() == 0;
+  }
+
+  /**
+   * \brief Initialises the pool backing the queue.
+   *
+   * Note: This must be called before the queue is used, and must not be called concurrently with any other member function.
+   *
+   * \param capacity    The initial capacity of the pool.
+   * \param maker       A function that can be used to construct new elements (by default, the default constructor for the element type).
+   * \param maxCapacity The maximum capacity to which the pool can grow if we're using the 'grow' strategy (if this is less than
+   *                    capacity, capacity will be used). Either way, this will be rounded up to the capacity of the rings.
+   */
+  void initialise(size_t capacity, const boost::function<T()>& maker = boost::value_factory<T>(), size_t maxCapacity = 0)
+  {
+    m_maker = maker;
+    m_pool.reset(new Ring<T>(std::max(capacity, maxCapacity)));
+    m_queue.reset(new Ring<T>(m_pool->capacity()));
+    m_maxCapacity = m_pool->capacity();
+
+    for(size_t i = 0; i < capacity; ++i)
+    {
+      m_pool->try_push(maker());
+    }
+
+    m_eltCount = capacity;
+  }
+
+  /**
+   * \brief Gets a reference to the first element in the queue.
+   *
+   * Note: This will block until the queue is non-empty.
+   *
+   * \return  A reference to the first element in the queue.
+   */
+  T& peek()
+  {
+    T *elt = NULL;
+    m_queueNonEmpty.wait_until(boost::bind(&LockFreePooledQueue::try_front, this, boost::ref(elt)));
+    return *elt;
+  }
+
+  /**
+   * \brief Gets a reference to the first element in the queue.
+   *
+   * Note: This will block until the queue is non-empty.
+   *
+   * \return  A reference to the first element in the queue.
+   */
+  const T& peek() const
+  {
+    T *elt = NULL;
+    m_queueNonEmpty.wait_until(boost::bind(&LockFreePooledQueue::try_front, this, boost::ref(elt)));
+    return *elt;
+  }
+
+  /**
+   * \brief Pops the first element from the queue and returns it to the pool.
+   *
+   * Note: This will block until the queue is non-empty.
+   */
+  void pop()
+  {
+    T elt;
+    m_queueNonEmpty.wait_until(boost::bind(&Ring<T>::try_pop, m_queue.get(), boost::ref(elt)));
+    m_pool->try_push(elt);
+    m_poolNonEmpty.notify();
+  }
+
+  /**
+   * \brief Gets the size of the queue.
+   *
+   * Note: If other threads are concurrently pushing or popping, the result is only a snapshot.
+   *
+   * \return  The size of the queue.
+   */
+  size_t size() const
+  {
+    return m_queue->size();
+  }
+
+  //#################### PRIVATE MEMBER FUNCTIONS ####################
+private:
+  /**
+   * \brief Completes a push operation by pushing the specified element onto the queue.
+   *
+   * Note: This is called automatically when the push handler associated with the push is destroyed.
+   *
+   * \param elt The element to be pushed onto the queue.
+   */
+  void end_push(const T& elt)
+  {
+    // Note: The rings are large enough to hold every element that can exist, so this can only fail if something has gone badly wrong.
+    if(!m_queue->try_push(elt))
+    {
+      throw std::runtime_error("Error: Lock-free pooled queue overflowed");
+    }
+
+    m_queueNonEmpty.notify();
+  }
+
+  /**
+   * \brief Attempts to get a pointer to the first element in the queue.
+   *
+   * \param elt A location into which to write the pointer (this will be NULL if the queue is empty).
+   * \return    true, if the queue was non-empty, or false otherwise.
+   */
+  bool try_front(T*& elt) const
+  {
+    elt = m_queue->front();
+    return elt != NULL;
+  }
+};
+
+}
+
+#endif
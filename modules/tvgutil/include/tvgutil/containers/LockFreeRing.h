@@ -0,0 +1,378 @@
+/**
+ * tvgutil: LockFreeRing.h
+ * Copyright (c) Torr Vision Group, University of Oxford, 2019. All rights reserved.
+ */
+
+#ifndef H_TVGUTIL_LOCKFREERING
+#define H_TVGUTIL_LOCKFREERING
+
+#include <cstddef>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+
+namespace tvgutil {
+
+namespace lock_free_ring {
+
+/** The assumed size (in bytes) of a cache line, used to keep the indices of the rings on separate lines. */
+const size_t CACHE_LINE_SIZE = 64;
+
+/**
+ * \brief Rounds the specified capacity up to the nearest power of two (the minimum capacity of a ring is 2).
+ *
+ * \param capacity  The capacity to round up.
+ * \return          The smallest power of two that is >= capacity.
+ */
+inline size_t round_up_capacity(size_t capacity)
+{
+  size_t result = 2;
+  while(result < capacity) result <<= 1;
+  return result;
+}
+
+}
+
+/**
+ * \brief An instance of an instantiation of this class template represents a bounded, lock-free ring buffer that is
+ *        safe to use when exactly one thread pushes elements onto it and exactly one (other) thread pops them.
+ *
+ * Since each index is only ever written by a single thread, no atomic read-modify-write operations are needed:
+ * pushes and pops are wait-free and cost only a pair of acquire/release accesses.
+ */
+template <typename T>
+class SPSCRing
+{
+  //#################### PRIVATE VARIABLES ####################
+private:
+  /** The cells of the ring. */
+  std::vector<T> m_cells;
+
+  /** A mask used to wrap the (monotonically increasing) indices onto the cells of the ring. */
+  size_t m_mask;
+
+  /** Padding to keep the consumer's index on its own cache line. */
+  char m_padding0[lock_free_ring::CACHE_LINE_SIZE];
+
+  /** The index of the next cell to be popped (written only by the consumer). */
+  boost::atomic<size_t> m_head;
+
+  /** Padding to keep the producer's index on its own cache line. */
+  char m_padding1[lock_free_ring::CACHE_LINE_SIZE];
+
+  /** The index of the next cell to be pushed (written only by the producer). */
+  boost::atomic<size_t> m_tail;
+
+  /** Padding to prevent the producer's index sharing a cache line with whatever follows the ring. */
+  char m_padding2[lock_free_ring::CACHE_LINE_SIZE];
+
+  //#################### CONSTRUCTORS ####################
+public:
+  /**
+   * \brief Constructs a ring.
+   *
+   * \param capacity  The minimum number of elements that the ring must be able to hold (this will be rounded up to a power of two).
+   */
+  explicit SPSCRing(size_t capacity)
+  : m_cells(lock_free_ring::round_up_capacity(capacity)), m_mask(m_cells.size() - 1), m_head(0), m_tail(0)
+  {}
+
+  //#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+private:
+  // Deliberately private and unimplemented.
+  SPSCRing(const SPSCRing&);
+  SPSCRing& operator=(const SPSCRing&);
+
+  //#################### PUBLIC STATIC MEMBER FUNCTIONS ####################
+public:
+  /**
+   * \brief Gets whether or not the ring can safely be popped by more than one thread.
+   *
+   * \return  false, since this ring only supports a single consumer.
+   */
+  static bool supports_multiple_consumers()
+  {
+    return false;
+  }
+
+  //#################### PUBLIC MEMBER FUNCTIONS ####################
+public:
+  /**
+   * \brief Gets the number of elements that the ring can hold.
+   *
+   * \return  The number of elements that the ring can hold.
+   */
+  size_t capacity() const
+  {
+    return m_cells.size();
+  }
+
+  /**
+   * \brief Gets a pointer to the first element in the ring (if any).
+   *
+   * Note: This must only be called by the consumer thread.
+   *
+   * \return  A pointer to the first element in the ring, or NULL if the ring is empty.
+   */
+  T *front()
+  {
+    const size_t head = m_head.load(boost::memory_order_relaxed);
+    return head != m_tail.load(boost::memory_order_acquire) ? &m_cells[head & m_mask] : NULL;
+  }
+
+  /**
+   * \brief Gets the (approximate) number of elements in the ring.
+   *
+   * Note: If other threads are concurrently pushing or popping, the result is only a snapshot.
+   *
+   * \return  The (approximate) number of elements in the ring.
+   */
+  size_t size() const
+  {
+    const size_t head = m_head.load(boost::memory_order_acquire);
+    const size_t tail = m_tail.load(boost::memory_order_acquire);
+    return tail - head;
+  }
+
+  /**
+   * \brief Attempts to pop the first element from the ring.
+   *
+   * Note: This must only be called by the consumer thread.
+   *
+   * \param elt A location into which to copy the popped element, if any.
+   * \return    true, if an element was popped, or false if the ring was empty.
+   */
+  bool try_pop(T& elt)
+  {
+    const size_t head = m_head.load(boost::memory_order_relaxed);
+    if(head == m_tail.load(boost::memory_order_acquire)) return false;
+    elt = m_cells[head & m_mask];
+    m_head.store(head + 1, boost::memory_order_release);
+    return true;
+  }
+
+  /**
+   * \brief Attempts to push an element onto the back of the ring.
+   *
+   * Note: This must only be called by the producer thread.
+   *
+   * \param elt The element to push.
+   * \return    true, if the element was pushed, or false if the ring was full.
+   */
+  bool try_push(const T& elt)
+  {
+    const size_t tail = m_tail.load(boost::memory_order_relaxed);
+    if(tail - m_head.load(boost::memory_order_acquire) > m_mask) return false;
+    m_cells[tail & m_mask] = elt;
+    m_tail.store(tail + 1, boost::memory_order_release);
+    return true;
+  }
+};
+
+/**
+ * \brief An instance of an instantiation of this class template represents a bounded, lock-free ring buffer that is
+ *        safe to use with any number of threads pushing and popping elements concurrently.
+ *
+ * This is a variant of Dmitry Vyukov's bounded MPMC queue: each cell carries a sequence number that tells threads
+ * whether the cell is ready to be written or read on the current lap of the ring, so that threads only contend on
+ * a single compare-and-swap of the relevant index and never on a lock.
+ */
+template <typename T>
+class MPMCRing
+{
+  //#################### NESTED TYPES ####################
+private:
+  /**
+   * \brief An instance of this struct represents a cell in the ring.
+   */
+  struct Cell
+  {
+    /** The sequence number of the cell (specifies the index for which the cell is next ready to be pushed or popped). */
+    boost::atomic<size_t> m_sequence;
+
+    /** The element stored in the cell. */
+    T m_elt;
+  };
+
+  //#################### PRIVATE VARIABLES ####################
+private:
+  /** The cells of the ring. */
+  boost::scoped_array<Cell> m_cells;
+
+  /** A mask used to wrap the (monotonically increasing) indices onto the cells of the ring. */
+  size_t m_mask;
+
+  /** Padding to keep the consumers' index on its own cache line. */
+  char m_padding0[lock_free_ring::CACHE_LINE_SIZE];
+
+  /** The index of the next cell to be popped. */
+  boost::atomic<size_t> m_head;
+
+  /** Padding to keep the producers' index on its own cache line. */
+  char m_padding1[lock_free_ring::CACHE_LINE_SIZE];
+
+  /** The index of the next cell to be pushed. */
+  boost::atomic<size_t> m_tail;
+
+  /** Padding to prevent the producers' index sharing a cache line with whatever follows the ring. */
+  char m_padding2[lock_free_ring::CACHE_LINE_SIZE];
+
+  //#################### CONSTRUCTORS ####################
+public:
+  /**
+   * \brief Constructs a ring.
+   *
+   * \param capacity  The minimum number of elements that the ring must be able to hold (this will be rounded up to a power of two).
+   */
+  explicit MPMCRing(size_t capacity)
+  : m_head(0), m_tail(0)
+  {
+    const size_t roundedCapacity = lock_free_ring::round_up_capacity(capacity);
+    m_cells.reset(new Cell[roundedCapacity]);
+    m_mask = roundedCapacity - 1;
+
+    for(size_t i = 0; i < roundedCapacity; ++i)
+    {
+      m_cells[i].m_sequence.store(i, boost::memory_order_relaxed);
+    }
+  }
+
+  //#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+private:
+  // Deliberately private and unimplemented.
+  MPMCRing(const MPMCRing&);
+  MPMCRing& operator=(const MPMCRing&);
+
+  //#################### PUBLIC STATIC MEMBER FUNCTIONS ####################
+public:
+  /**
+   * \brief Gets whether or not the ring can safely be popped by more than one thread.
+   *
+   * \return  true, since this ring supports multiple consumers.
+   */
+  static bool supports_multiple_consumers()
+  {
+    return true;
+  }
+
+  //#################### PUBLIC MEMBER FUNCTIONS ####################
+public:
+  /**
+   * \brief Gets the number of elements that the ring can hold.
+   *
+   * \return  The number of elements that the ring can hold.
+   */
+  size_t capacity() const
+  {
+    return m_mask + 1;
+  }
+
+  /**
+   * \brief Gets a pointer to the first element in the ring (if any).
+   *
+   * Note: As with any peek operation on a concurrent queue, the element may be popped by another consumer
+   *       after this returns. It is up to the caller to ensure that this does not happen if it matters.
+   *
+   * \return  A pointer to the first element in the ring, or NULL if the ring is empty.
+   */
+  T *front()
+  {
+    const size_t head = m_head.load(boost::memory_order_relaxed);
+    Cell& cell = m_cells[head & m_mask];
+    return cell.m_sequence.load(boost::memory_order_acquire) == head + 1 ? &cell.m_elt : NULL;
+  }
+
+  /**
+   * \brief Gets the (approximate) number of elements in the ring.
+   *
+   * Note: If other threads are concurrently pushing or popping, the result is only a snapshot.
+   *
+   * \return  The (approximate) number of elements in the ring.
+   */
+  size_t size() const
+  {
+    const size_t head = m_head.load(boost::memory_order_acquire);
+    const size_t tail = m_tail.load(boost::memory_order_acquire);
+    return tail > head ? tail - head : 0;
+  }
+
+  /**
+   * \brief Attempts to pop the first element from the ring.
+   *
+   * \param elt A location into which to copy the popped element, if any.
+   * \return    true, if an element was popped, or false if the ring was empty.
+   */
+  bool try_pop(T& elt)
+  {
+    size_t head = m_head.load(boost::memory_order_relaxed);
+    Cell *cell;
+
+    for(;;)
+    {
+      cell = &m_cells[head & m_mask];
+      const size_t seq = cell->m_sequence.load(boost::memory_order_acquire);
+      const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(head + 1);
+
+      // If the cell has been filled on the current lap, try to claim it. If the claim fails, the
+      // compare-and-swap updates head to the current index, and we try again from there.
+      if(diff == 0)
+      {
+        if(m_head.compare_exchange_weak(head, head + 1, boost::memory_order_relaxed)) break;
+      }
+
+      // If the cell has not yet been filled on the current lap, the ring is empty.
+      else if(diff < 0) return false;
+
+      // Otherwise, another consumer has claimed the cell, so we reload the index and try again.
+      else head = m_head.load(boost::memory_order_relaxed);
+    }
+
+    elt = cell->m_elt;
+
+    // Mark the cell as ready to be pushed on the next lap.
+    cell->m_sequence.store(head + m_mask + 1, boost::memory_order_release);
+    return true;
+  }
+
+  /**
+   * \brief Attempts to push an element onto the back of the ring.
+   *
+   * \param elt The element to push.
+   * \return    true, if the element was pushed, or false if the ring was full.
+   */
+  bool try_push(const T& elt)
+  {
+    size_t tail = m_tail.load(boost::memory_order_relaxed);
+    Cell *cell;
+
+    for(;;)
+    {
+      cell = &m_cells[tail & m_mask];
+      const size_t seq = cell->m_sequence.load(boost::memory_order_acquire);
+      const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(tail);
+
+      // If the cell is free on the current lap, try to claim it (as in try_pop).
+      if(diff == 0)
+      {
+        if(m_tail.compare_exchange_weak(tail, tail + 1, boost::memory_order_relaxed)) break;
+      }
+
+      // If the cell has not yet been popped on the previous lap, the ring is full.
+      else if(diff < 0) return false;
+
+      // Otherwise, another producer has claimed the cell, so we reload the index and try again.
+      else tail = m_tail.load(boost::memory_order_relaxed);
+    }
+
+    cell->m_elt = elt;
+
+    // Mark the cell as ready to be popped.
+    cell->m_sequence.store(tail + 1, boost::memory_order_release);
+    return true;
+  }
+};
+
+}
+
+#endif
@@ -78,6 +78,33 @@ inline std::istream& operator>>(std::istream& is, PoolEmptyStrategy& rhs)
   return is;
 }
 
+/**
+ * \brief An instance of a class deriving from an instantiation of this class template can be used to handle the process of pushing
+ *        an element onto a pooled queue.
+ *
+ * Both PooledQueue and LockFreePooledQueue have push handlers that derive from this, so that code that only needs to push elements
+ * onto a queue can do so without needing to know which type of queue it is using.
+ */
+template <typename T>
+class PushHandlerBase
+{
+  //#################### DESTRUCTOR ####################
+public:
+  /**
+   * \brief Destroys the push handler (derived push handlers complete the push at this point).
+   */
+  virtual ~PushHandlerBase() {}
+
+  //#################### PUBLIC ABSTRACT MEMBER FUNCTIONS ####################
+public:
+  /**
+   * \brief Gets a reference to the element that is to be pushed onto the queue (if any).
+   *
+   * \return  A reference to the element that is to be pushed onto the queue (if any).
+   */
+  virtual boost::optional<T&> get() = 0;
+};
+
 }
 
 /**
@@ -91,7 +118,7 @@ public:
   /**
    * \brief An instance of this class can be used to handle the process of pushing an element onto the queue.
    */
-  class PushHandler
+  class PushHandler : public pooled_queue::PushHandlerBase<T>
   {
     //~~~~~~~~~~~~~~~~~~~~ PRIVATE VARIABLES ~~~~~~~~~~~~~~~~~~~~
   private:
@@ -131,12 +158,8 @@ public:
 
     //~~~~~~~~~~~~~~~~~~~~ PUBLIC MEMBER FUNCTIONS ~~~~~~~~~~~~~~~~~~~~
   public:
-    /**
-     * \brief Gets a reference to the element that is to be pushed onto the queue (if any).
-     *
-     * \return  A reference to the element that is to be pushed onto the queue (if any).
-     */
-    boost::optional<T&> get()
+    /** Override */
+    virtual boost::optional<T&> get()
     {
       return m_elt ? boost::optional<T&>(*m_elt) : boost::none;
     }
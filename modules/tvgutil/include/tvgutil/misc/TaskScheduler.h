@@ -0,0 +1,357 @@
+/**
+ * tvgutil: TaskScheduler.h
+ * Copyright (c) Torr Vision Group, University of Oxford, 2019. All rights reserved.
+ */
+
+#ifndef H_TVGUTIL_TASKSCHEDULER
+#define H_TVGUTIL_TASKSCHEDULER
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/future.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/utility/result_of.hpp>
+
+namespace tvgutil {
+
+/**
+ * \brief The values of this enumeration can be used to specify the priority of a task submitted to a task scheduler.
+ */
+enum TaskPriority
+{
+  /** The task should be run before any normal or low priority tasks. */
+  TP_HIGH,
+
+  /** The task should be run before any low priority tasks. */
+  TP_NORMAL,
+
+  /** The task should only be run when there are no higher priority tasks waiting. */
+  TP_LOW,
+
+  /** The number of task priorities (not a real priority). */
+  TP_COUNT
+};
+
+/**
+ * \brief An instance of this class represents a work-stealing scheduler that can be used to run CPU-bound tasks on a fixed set of threads.
+ *
+ * Unlike ThreadPool (which is intended for fire-and-forget tasks that may block, e.g. on I/O), the scheduler is intended for
+ * CPU-bound work. Each worker thread owns a set of deques of tasks (one per priority). A worker pushes the tasks it spawns
+ * onto the back of its own deques and pops them from there (for cache locality), while idle workers steal the oldest
+ * tasks from the front of other workers' deques. Tasks submitted from outside the scheduler go onto a shared queue.
+ *
+ * By default, the scheduler creates one thread per hardware thread. When it is sharing the machine with OpenMP loops,
+ * it can instead be given fewer threads (and pinned to a subset of the cores) so as to avoid oversubscription. The
+ * global instance of the scheduler can be configured in this way by calling initialise before it is first used.
+ *
+ * Note: Tasks running on the scheduler should avoid blocking on the futures of other tasks, since this ties up a worker.
+ *       Where a task needs to wait for sub-tasks, it should use parallel_for (which runs pending tasks while waiting),
+ *       or submit a follow-on task instead.
+ */
+class TaskScheduler
+{
+  //#################### TYPEDEFS ####################
+private:
+  typedef boost::function<void()> Task;
+
+  //#################### NESTED TYPES ####################
+private:
+  /**
+   * \brief An instance of this struct represents the state of a worker thread.
+   */
+  struct Worker
+  {
+    /** The index of the worker in the scheduler. */
+    size_t m_index;
+
+    /** The mutex used to synchronise access to the worker's deques. */
+    boost::mutex m_mutex;
+
+    /** The worker's deques of tasks (one per priority). */
+    std::deque<Task> m_tasks[TP_COUNT];
+  };
+
+  typedef boost::shared_ptr<Worker> Worker_Ptr;
+
+  /**
+   * \brief An instance of this struct holds the global instance of the scheduler, together with the parameters with which to construct it.
+   */
+  struct GlobalState
+  {
+    /** The CPUs (if any) to which to pin the worker threads of the global instance. */
+    std::vector<int> m_cpuAffinities;
+
+    /** The global instance of the scheduler (if it has been started). */
+    boost::shared_ptr<TaskScheduler> m_instance;
+
+    /** The mutex used to synchronise access to the global state. */
+    boost::mutex m_mutex;
+
+    /** The number of worker threads to use for the global instance (if 0, one thread per hardware thread will be used). */
+    size_t m_threadCount;
+
+    GlobalState()
+    : m_threadCount(0)
+    {}
+  };
+
+  /**
+   * \brief An instance of this struct represents the shared state of a call to parallel_for.
+   */
+  struct ParallelForState
+  {
+    /** The first exception (if any) thrown by the body of the loop. */
+    boost::exception_ptr m_exception;
+
+    /** The mutex used to synchronise access to the exception. */
+    boost::mutex m_mutex;
+
+    /** The number of chunks of the loop that have not yet finished. */
+    boost::atomic<size_t> m_remainingChunks;
+  };
+
+  //#################### PRIVATE VARIABLES ####################
+private:
+  /** The worker (if any) that corresponds to the current thread. */
+  boost::thread_specific_ptr<Worker> m_currentWorker;
+
+  /** The queues of tasks submitted from outside the scheduler (one per priority). */
+  std::deque<Task> m_externalTasks[TP_COUNT];
+
+  /** The mutex used to synchronise access to the queues of tasks submitted from outside the scheduler. */
+  boost::mutex m_externalTasksMutex;
+
+  /** The number of tasks that have been submitted but not yet started. */
+  boost::atomic<size_t> m_pendingTaskCount;
+
+  /** Whether or not the worker threads should terminate once there are no more pending tasks. */
+  boost::atomic<bool> m_shouldTerminate;
+
+  /** The number of worker threads that are currently sleeping (or about to sleep). */
+  boost::atomic<size_t> m_sleepingWorkerCount;
+
+  /** The mutex associated with the condition variable on which idle workers sleep. */
+  boost::mutex m_sleepMutex;
+
+  /** The threads in the scheduler. */
+  boost::thread_group m_threads;
+
+  /** A condition variable used to wake up idle workers when new tasks are submitted. */
+  boost::condition_variable m_workAvailable;
+
+  /** The states of the worker threads. */
+  std::vector<Worker_Ptr> m_workers;
+
+  //#################### CONSTRUCTORS ####################
+public:
+  /**
+   * \brief Constructs a task scheduler.
+   *
+   * \param threadCount   The number of worker threads to use (if 0, one thread per hardware thread will be used).
+   * \param cpuAffinities The CPUs (if any) to which to pin the worker threads (worker i will be pinned to CPU cpuAffinities[i % size]).
+   */
+  explicit TaskScheduler(size_t threadCount = 0, const std::vector<int>& cpuAffinities = std::vector<int>());
+
+  //#################### DESTRUCTOR ####################
+public:
+  /**
+   * \brief Destroys the task scheduler.
+   *
+   * \note  Any pending tasks are run before the worker threads are joined, so this can block.
+   */
+  ~TaskScheduler();
+
+  //#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+private:
+  // Deliberately private and unimplemented.
+  TaskScheduler(const TaskScheduler&);
+  TaskScheduler& operator=(const TaskScheduler&);
+
+  //#################### PUBLIC STATIC MEMBER FUNCTIONS ####################
+public:
+  /**
+   * \brief Sets the parameters with which the global instance of the task scheduler will be constructed.
+   *
+   * \note  This must be called before the global instance is first used (i.e. before the first call to instance()).
+   *        Calling it again after that with the same parameters does nothing.
+   *
+   * \param threadCount   The number of worker threads to use (if 0, one thread per hardware thread will be used).
+   * \param cpuAffinities The CPUs (if any) to which to pin the worker threads (worker i will be pinned to CPU cpuAffinities[i % size]).
+   *
+   * \throws std::runtime_error If the global instance has already been started with different parameters.
+   */
+  static void initialise(size_t threadCount, const std::vector<int>& cpuAffinities = std::vector<int>());
+
+  /**
+   * \brief Gets the global instance of the task scheduler, starting it if necessary.
+   *
+   * \note  The global instance is constructed with the parameters most recently passed to initialise (if any), or with the default parameters otherwise.
+   *
+   * \return The global instance of the task scheduler.
+   */
+  static TaskScheduler& instance();
+
+  //#################### PUBLIC MEMBER FUNCTIONS ####################
+public:
+  /**
+   * \brief Runs the specified loop body for each index in [begin,end), dividing the range into chunks that can be run in parallel.
+   *
+   * The calling thread helps to run pending tasks until the whole loop has finished, so it is safe to call this from within a task.
+   * If the loop body throws, the first exception thrown is rethrown to the caller once all of the chunks have finished.
+   *
+   * \param begin     The first index in the range.
+   * \param end       One past the last index in the range.
+   * \param grainSize The (maximum) number of indices in each chunk.
+   * \param body      The loop body (a function that takes an index).
+   * \param priority  The priority with which to run the chunks.
+   */
+  template <typename Body>
+  void parallel_for(int begin, int end, int grainSize, const Body& body, TaskPriority priority = TP_NORMAL)
+  {
+    if(end <= begin) return;
+    grainSize = std::max(grainSize, 1);
+
+    ParallelForState state;
+    state.m_remainingChunks = (end - begin + grainSize - 1) / grainSize;
+
+    for(int chunkBegin = begin; chunkBegin < end; chunkBegin += grainSize)
+    {
+      const int chunkEnd = std::min(chunkBegin + grainSize, end);
+      enqueue(boost::bind(&TaskScheduler::run_chunk<Body>, boost::cref(body), chunkBegin, chunkEnd, boost::ref(state)), priority);
+    }
+
+    // Help to run pending tasks (including the chunks of this loop) until the loop has finished.
+    while(state.m_remainingChunks > 0)
+    {
+      if(!try_run_pending_task()) boost::this_thread::yield();
+    }
+
+    if(state.m_exception) boost::rethrow_exception(state.m_exception);
+  }
+
+  /**
+   * \brief Submits a task to be run by the scheduler.
+   *
+   * If this is called from within a task running on the scheduler, the new task is pushed onto the current worker's own deque,
+   * which makes it cheap to chain follow-on tasks from within a task.
+   *
+   * \param f         The task (a function that takes no arguments).
+   * \param priority  The priority with which to run the task.
+   * \return          A future that can be used to get the task's result (or the exception it threw).
+   */
+  template <typename F>
+  boost::unique_future<typename boost::result_of<F()>::type> submit(const F& f, TaskPriority priority = TP_NORMAL)
+  {
+    typedef typename boost::result_of<F()>::type R;
+    boost::shared_ptr<boost::packaged_task<R> > task(new boost::packaged_task<R>(f));
+    boost::unique_future<R> result = task->get_future();
+    enqueue(boost::bind(&TaskScheduler::run_packaged_task<R>, task), priority);
+    return boost::move(result);
+  }
+
+  /**
+   * \brief Gets the number of worker threads in the scheduler.
+   *
+   * \return  The number of worker threads in the scheduler.
+   */
+  size_t thread_count() const;
+
+  /**
+   * \brief Attempts to run a single pending task on the calling thread.
+   *
+   * \return  true, if a task was run, or false if there were no pending tasks.
+   */
+  bool try_run_pending_task();
+
+  //#################### PRIVATE MEMBER FUNCTIONS ####################
+private:
+  /**
+   * \brief Adds a task to the appropriate queue and wakes up a sleeping worker (if any) to run it.
+   *
+   * \param task      The task.
+   * \param priority  The priority with which to run the task.
+   */
+  void enqueue(const Task& task, TaskPriority priority);
+
+  /**
+   * \brief Attempts to find a pending task to run.
+   *
+   * The highest priority task available is chosen. Within a priority, we prefer (in order) the back of the current worker's
+   * own deque, the front of the queue of externally-submitted tasks and the front of another worker's deque.
+   *
+   * \param worker  The worker (if any) that corresponds to the current thread.
+   * \param task    A location into which to write the task, if one is found.
+   * \return        true, if a task was found, or false otherwise.
+   */
+  bool find_task(Worker *worker, Task& task);
+
+  /**
+   * \brief Runs the main loop for the specified worker thread.
+   *
+   * \param worker  The worker.
+   */
+  void run_worker(const Worker_Ptr& worker);
+
+  //#################### PRIVATE STATIC MEMBER FUNCTIONS ####################
+private:
+  /**
+   * \brief Gets the global state of the scheduler.
+   *
+   * \return The global state of the scheduler.
+   */
+  static GlobalState& global_state();
+
+  /**
+   * \brief A cleanup function for the current worker pointer that does nothing (the workers are owned by the scheduler).
+   *
+   * \param worker  The worker.
+   */
+  static void no_cleanup(Worker *worker);
+
+  /**
+   * \brief Runs a chunk of a parallel loop.
+   *
+   * \param body        The loop body.
+   * \param chunkBegin  The first index in the chunk.
+   * \param chunkEnd    One past the last index in the chunk.
+   * \param state       The shared state of the loop.
+   */
+  template <typename Body>
+  static void run_chunk(const Body& body, int chunkBegin, int chunkEnd, ParallelForState& state)
+  {
+    try
+    {
+      for(int i = chunkBegin; i < chunkEnd; ++i) body(i);
+    }
+    catch(...)
+    {
+      boost::lock_guard<boost::mutex> lock(state.m_mutex);
+      if(!state.m_exception) state.m_exception = boost::current_exception();
+    }
+
+    --state.m_remainingChunks;
+  }
+
+  /**
+   * \brief Runs a packaged task (this is used to wrap tasks submitted via submit).
+   *
+   * \param task  The packaged task.
+   */
+  template <typename R>
+  static void run_packaged_task(const boost::shared_ptr<boost::packaged_task<R> >& task)
+  {
+    (*task)();
+  }
+};
+
+}
+
+#endif
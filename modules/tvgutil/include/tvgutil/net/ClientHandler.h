@@ -7,6 +7,8 @@
 #define H_TVGUTIL_CLIENTHANDLER
 
 #include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
 #include <boost/optional.hpp>
 #include <boost/thread.hpp>
 
@@ -16,9 +18,26 @@ namespace tvgutil {
 
 /**
  * \brief An instance of a class deriving from this one can be used to manage the connection to a client.
+ *
+ * By default, the server gives each client its own thread, on which it calls run_pre, then run_iter repeatedly until the
+ * connection drops, and then run_post. These functions can use the blocking read_message and write_message functions to
+ * communicate with the client. A derived class may also write to the client from another thread of its own whilst the client
+ * thread is reading, provided that it makes sure that no two writes are ever in progress at once.
+ *
+ * Alternatively, a derived class can opt in to being driven asynchronously by the server's I/O threads, by overriding
+ * is_async to return true. In that case, no thread is created for the client. Instead, the server calls start_async,
+ * and the handler then drives its own per-connection state machine using async_read_message and async_write_message,
+ * each of which invokes a continuation (the next state) once the operation has succeeded. The handler must call
+ * signal_ready once it has finished its initial setup (i.e. at the point at which run_pre would have returned),
+ * and must always have an operation outstanding until the connection finishes. If any operation fails, or the server
+ * is terminating, run_post is called and the client is treated as finished.
  */
 class ClientHandler
 {
+  //#################### TYPEDEFS ####################
+public:
+  typedef boost::function<void()> Continuation;
+
   //#################### PUBLIC VARIABLES ####################
 public:
   /** The ID used by the server to refer to the client. */
@@ -27,15 +46,32 @@ public:
   /** Whether or not the connection is still ok (effectively tracks whether or not the most recent read/write succeeded). */
   bool m_connectionOk;
 
+  /** A function to call when an asynchronous client has finished (set within the server itself). */
+  Continuation m_onFinished;
+
+  /** A function to call when an asynchronous client is ready to start its main state machine (set within the server itself). */
+  Continuation m_onReady;
+
   /** Whether or not the server should terminate (read-only, set within the server itself). */
   boost::shared_ptr<const boost::atomic<bool> > m_shouldTerminate;
 
   /** The socket used to communicate with the client. */
   boost::shared_ptr<boost::asio::ip::tcp::socket> m_sock;
 
-  /** The thread that manages communication with the client. */
+  /** The strand used to serialise the completion handlers of an asynchronous client, and to close the socket of any client (set within the server itself). */
+  boost::shared_ptr<boost::asio::io_service::strand> m_strand;
+
+  /** The thread that manages communication with the client (only used for synchronous clients). */
   boost::shared_ptr<boost::thread> m_thread;
 
+  //#################### PRIVATE VARIABLES ####################
+private:
+  /** The mutex used to synchronise the completion of blocking reads and writes. */
+  boost::mutex m_completionMutex;
+
+  /** A condition variable used to wait for blocking reads and writes to complete. */
+  boost::condition_variable m_operationCompleted;
+
   //#################### CONSTRUCTORS ####################
 public:
   /**
@@ -54,8 +90,22 @@ public:
    */
   virtual ~ClientHandler() = 0;
 
+  //#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+private:
+  // Deliberately private and unimplemented.
+  ClientHandler(const ClientHandler&);
+  ClientHandler& operator=(const ClientHandler&);
+
   //#################### PUBLIC MEMBER FUNCTIONS ####################
 public:
+  /**
+   * \brief Closes the socket used to communicate with the client, thereby aborting any outstanding operations on it.
+   *
+   * \note  Since the socket is not thread-safe, this must only be called on one of the server's I/O threads (on the
+   *        handler's strand, for an asynchronous client). Other threads should call post_close_socket instead.
+   */
+  void close_socket();
+
   /**
    * \brief Gets the ID used by the server to refer to the client.
    *
@@ -63,6 +113,21 @@ public:
    */
   int get_client_id() const;
 
+  /**
+   * \brief Gets whether or not the client should be driven asynchronously by the server's I/O threads (rather than by its own thread).
+   *
+   * \return  true, if the client should be driven asynchronously, or false otherwise.
+   */
+  virtual bool is_async() const;
+
+  /**
+   * \brief Asks one of the server's I/O threads to close the socket used to communicate with the client (on the handler's
+   *        strand), thereby aborting any outstanding operations on it.
+   *
+   * \note  This returns without waiting for the socket to be closed.
+   */
+  void post_close_socket();
+
   /**
    * \brief Runs an iteration of the main loop for the client.
    */
@@ -78,8 +143,44 @@ public:
    */
   virtual void run_pre();
 
+  /**
+   * \brief Starts the state machine of an asynchronous client.
+   *
+   * This is called on one of the server's I/O threads once the client has connected. It should start the first asynchronous
+   * operation and return immediately.
+   */
+  virtual void start_async();
+
   //#################### PROTECTED MEMBER FUNCTIONS ####################
 protected:
+  /**
+   * \brief Starts an asynchronous read of a message of type T from the socket used to communicate with the client.
+   *
+   * Note: The message (and any external memory from which it has borrowed segments) must remain alive until the read has completed.
+   *
+   * \param msg         The T into which to write the message.
+   * \param onSuccess   The continuation to invoke (on an I/O thread) if the read succeeds.
+   */
+  template <typename T>
+  void async_read_message(T& msg, const Continuation& onSuccess)
+  {
+    boost::asio::async_read(*m_sock, msg.get_mutable_buffers(), m_strand->wrap(boost::bind(&ClientHandler::async_message_handler, this, _1, onSuccess)));
+  }
+
+  /**
+   * \brief Starts an asynchronous write of a message of type T on the socket used to communicate with the client.
+   *
+   * Note: The message (and any external memory from which it has borrowed segments) must remain alive until the write has completed.
+   *
+   * \param msg         The T to write.
+   * \param onSuccess   The continuation to invoke (on an I/O thread) if the write succeeds.
+   */
+  template <typename T>
+  void async_write_message(const T& msg, const Continuation& onSuccess)
+  {
+    boost::asio::async_write(*m_sock, msg.get_const_buffers(), m_strand->wrap(boost::bind(&ClientHandler::async_message_handler, this, _1, onSuccess)));
+  }
+
   /**
    * \brief Attempts to read a message of type T from the socket used to communicate with the client.
    *
@@ -92,11 +193,15 @@ protected:
   bool read_message(T& msg)
   {
     boost::optional<boost::system::error_code> err;
-    boost::asio::async_read(*m_sock, boost::asio::buffer(msg.get_data_ptr(), msg.get_size()), boost::bind(&ClientHandler::read_message_handler, this, _1, boost::ref(err)));
-    while(!err && !*m_shouldTerminate) boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
-    return *m_shouldTerminate ? false : !*err;
+    boost::asio::async_read(*m_sock, msg.get_mutable_buffers(), boost::bind(&ClientHandler::read_message_handler, this, _1, boost::ref(err)));
+    return wait_for_completion(err);
   }
 
+  /**
+   * \brief Signals to the server that an asynchronous client is ready to start its main state machine.
+   */
+  void signal_ready();
+
   /**
    * \brief Attempts to write a message of type T on the socket used to communicate with the client.
    *
@@ -109,13 +214,20 @@ protected:
   bool write_message(const T& msg)
   {
     boost::optional<boost::system::error_code> err;
-    boost::asio::async_write(*m_sock, boost::asio::buffer(msg.get_data_ptr(), msg.get_size()), boost::bind(&ClientHandler::write_message_handler, this, _1, boost::ref(err)));
-    while(!err && !*m_shouldTerminate) boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
-    return *m_shouldTerminate ? false : !*err;
+    boost::asio::async_write(*m_sock, msg.get_const_buffers(), boost::bind(&ClientHandler::write_message_handler, this, _1, boost::ref(err)));
+    return wait_for_completion(err);
   }
 
   //#################### PRIVATE MEMBER FUNCTIONS ####################
 private:
+  /**
+   * \brief The handler called when an asynchronous read or write started by an asynchronous client finishes.
+   *
+   * \param err         The error code associated with the read or write.
+   * \param onSuccess   The continuation to invoke if the read or write succeeded.
+   */
+  void async_message_handler(const boost::system::error_code& err, const Continuation& onSuccess);
+
   /**
    * \brief The handler called when an asynchronous read of a message finishes.
    *
@@ -131,6 +243,17 @@ private:
    * \param ret A location into which to write the error code so that write_message can access it.
    */
   void write_message_handler(const boost::system::error_code& err, boost::optional<boost::system::error_code>& ret);
+
+  /**
+   * \brief Waits for a read or write started by read_message or write_message to finish.
+   *
+   * If the server starts to terminate in the meantime, the socket is closed (on an I/O thread) to abort the operation. Either way,
+   * this only returns once the operation's handler has run, so that it can never write into a dead location.
+   *
+   * \param err The location into which the operation's handler will write its error code.
+   * \return    true, if the operation succeeded, or false otherwise.
+   */
+  bool wait_for_completion(const boost::optional<boost::system::error_code>& err);
 };
 
 }
@@ -10,10 +10,17 @@
 #include <cstring>
 #include <vector>
 
+#include <boost/asio/buffer.hpp>
+
 namespace tvgutil {
 
 /**
  * \brief An instance of a class deriving from this one represents a message that can be sent across a network.
+ *
+ * By default, all of the bytes of a message are stored in its own data. However, derived classes can choose to "borrow" some
+ * of the message's segments from external memory (e.g. an image that is to be sent), in which case the bytes of those segments
+ * are read from (or written to) the external memory directly. To send or receive a message without copying its borrowed segments,
+ * use the buffer sequences returned by get_const_buffers and get_mutable_buffers (the bytes on the wire are the same either way).
  */
 class Message
 {
@@ -22,11 +29,33 @@ protected:
   /** An (offset, size) pair used to specify a byte segment within the message data. */
   typedef std::pair<size_t,size_t> Segment;
 
+  //#################### NESTED TYPES ####################
+private:
+  /**
+   * \brief An instance of this struct represents a message segment whose bytes are stored in external memory.
+   */
+  struct BorrowedSegment
+  {
+    /** A read-only pointer to the external memory. */
+    const char *m_constData;
+
+    /** A writeable pointer to the external memory (or NULL, if the memory is read-only). */
+    char *m_data;
+
+    /** The segment of the message that has been borrowed. */
+    Segment m_segment;
+  };
+
   //#################### PROTECTED VARIABLES ####################
 protected:
-  /** The message data. */
+  /** The message data (note that this includes space for any borrowed segments, but their bytes are not stored in it). */
   std::vector<char> m_data;
 
+  //#################### PRIVATE VARIABLES ####################
+private:
+  /** The segments of the message that have been borrowed from external memory (sorted by offset, and non-overlapping). */
+  std::vector<BorrowedSegment> m_borrowedSegments;
+
   //#################### DESTRUCTOR ####################
 public:
   /**
@@ -36,9 +65,18 @@ public:
 
   //#################### PUBLIC MEMBER FUNCTIONS ####################
 public:
+  /**
+   * \brief Gets a sequence of buffers that together contain the bytes of the message (in order), suitable for a gather-write.
+   *
+   * \return  The buffer sequence.
+   */
+  std::vector<boost::asio::const_buffer> get_const_buffers() const;
+
   /**
    * \brief Gets a raw pointer to the message data.
    *
+   * \note   The bytes of any borrowed segments are not stored in the message data.
+   *
    * \return  A raw pointer to the message data.
    */
   char *get_data_ptr();
@@ -46,10 +84,21 @@ public:
   /**
    * \brief Gets a raw pointer to the message data.
    *
+   * \note   The bytes of any borrowed segments are not stored in the message data.
+   *
    * \return  A raw pointer to the message data.
    */
   const char *get_data_ptr() const;
 
+  /**
+   * \brief Gets a sequence of buffers into which the bytes of the message can be read (in order), suitable for a scatter-read.
+   *
+   * \return  The buffer sequence.
+   *
+   * \throws std::runtime_error If any of the message's segments have been borrowed from read-only memory.
+   */
+  std::vector<boost::asio::mutable_buffer> get_mutable_buffers();
+
   /**
    * \brief Gets the size of the message.
    *
@@ -57,8 +106,57 @@ public:
    */
   size_t get_size() const;
 
+  /**
+   * \brief Stops borrowing any message segments from external memory, so that all of the bytes of the message are once again stored in its own data.
+   *
+   * \note   The contents of the external memory are not copied into the message data.
+   */
+  void release_borrowed_segments();
+
   //#################### PROTECTED MEMBER FUNCTIONS ####################
 protected:
+  /**
+   * \brief Borrows the specified message segment from read-only external memory.
+   *
+   * The message can then be sent, but not received into, until the segment is released.
+   *
+   * \param segment The segment to borrow (any existing borrowing of exactly this segment will be replaced).
+   * \param data    The external memory (which must remain valid until the segment is released).
+   *
+   * \throws std::invalid_argument If the segment lies outside the message, or overlaps a different borrowed segment.
+   */
+  void borrow_segment(const Segment& segment, const char *data);
+
+  /**
+   * \brief Borrows the specified message segment from writeable external memory.
+   *
+   * \param segment The segment to borrow (any existing borrowing of exactly this segment will be replaced).
+   * \param data    The external memory (which must remain valid until the segment is released).
+   *
+   * \throws std::invalid_argument If the segment lies outside the message, or overlaps a different borrowed segment.
+   */
+  void borrow_segment(const Segment& segment, char *data);
+
+  /**
+   * \brief Gets a pointer to the bytes of the specified message segment (which may be in external memory if the segment has been borrowed).
+   *
+   * \param segment The segment.
+   * \return        A pointer to the bytes of the segment.
+   *
+   * \throws std::runtime_error If the segment straddles the boundary of a borrowed segment, or has been borrowed from read-only memory.
+   */
+  char *get_segment_ptr(const Segment& segment);
+
+  /**
+   * \brief Gets a pointer to the bytes of the specified message segment (which may be in external memory if the segment has been borrowed).
+   *
+   * \param segment The segment.
+   * \return        A pointer to the bytes of the segment.
+   *
+   * \throws std::runtime_error If the segment straddles the boundary of a borrowed segment.
+   */
+  const char *get_segment_ptr(const Segment& segment) const;
+
   /**
    * \brief Reads a simple value from the specified byte segment in the message.
    *
@@ -68,7 +166,7 @@ protected:
   template <typename T>
   T read_simple(const Segment& segment) const
   {
-    return *reinterpret_cast<const T*>(&m_data[segment.first]);
+    return *reinterpret_cast<const T*>(get_segment_ptr(segment));
   }
 
   /**
@@ -80,7 +178,7 @@ protected:
   template <typename T>
   void write_simple(const T& value, const Segment& segment)
   {
-    memcpy(&m_data[segment.first], reinterpret_cast<const char*>(&value), segment.second);
+    memcpy(get_segment_ptr(segment), reinterpret_cast<const char*>(&value), segment.second);
   }
 
   //#################### PROTECTED STATIC MEMBER FUNCTIONS ####################
@@ -92,6 +190,29 @@ protected:
    * \return        The end offset of the segment.
    */
   static size_t end_of(const Segment& segment);
+
+  //#################### PRIVATE MEMBER FUNCTIONS ####################
+private:
+  /**
+   * \brief Borrows the specified message segment from external memory.
+   *
+   * \param segment   The segment to borrow.
+   * \param constData A read-only pointer to the external memory.
+   * \param data      A writeable pointer to the external memory (or NULL, if the memory is read-only).
+   *
+   * \throws std::invalid_argument If the segment lies outside the message, or overlaps a different borrowed segment.
+   */
+  void borrow_segment_sub(const Segment& segment, const char *constData, char *data);
+
+  /**
+   * \brief Finds the borrowed segment (if any) that contains the specified segment.
+   *
+   * \param segment The segment.
+   * \return        The borrowed segment containing it, or NULL if it does not overlap any borrowed segment.
+   *
+   * \throws std::runtime_error If the segment straddles the boundary of a borrowed segment.
+   */
+  const BorrowedSegment *find_borrowed_segment(const Segment& segment) const;
 };
 
 }
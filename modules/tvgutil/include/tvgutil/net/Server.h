@@ -6,6 +6,7 @@
 #ifndef H_TVGUTIL_SERVER
 #define H_TVGUTIL_SERVER
 
+#include <iostream>
 #include <map>
 #include <set>
 #include <vector>
@@ -50,6 +51,9 @@ private:
   /** The server's TCP acceptor. */
   boost::shared_ptr<boost::asio::ip::tcp::acceptor> m_acceptor;
 
+  /** The strand used to serialise operations on the acceptor. */
+  boost::shared_ptr<boost::asio::io_service::strand> m_acceptorStrand;
+
   /** A thread that keeps the map of clients clean by removing any clients that have terminated. */
   boost::shared_ptr<boost::thread> m_cleanerThread;
 
@@ -68,6 +72,12 @@ private:
   /** The server's I/O service. */
   boost::asio::io_service m_ioService;
 
+  /** The number of threads that should be used to run the I/O service. */
+  size_t m_ioThreadCount;
+
+  /** The threads that run the I/O service (these run the completion handlers for all of the server's asynchronous operations). */
+  boost::thread_group m_ioThreads;
+
   /** The mode in which the server should run. */
   Mode m_mode;
 
@@ -80,12 +90,12 @@ private:
   /** The port on which the server should listen for connections. */
   int m_port;
 
-  /** The server thread. */
-  boost::shared_ptr<boost::thread> m_serverThread;
-
   /** Whether or not the server should terminate. */
   boost::shared_ptr<boost::atomic<bool> > m_shouldTerminate;
 
+  /** The handlers for clients that have connected but are not yet ready to start their main loops/state machines. */
+  std::map<int, ClientHandler_Ptr> m_startingClientHandlers;
+
   /** The set of clients that have finished but whose handlers have not yet been removed from the client handlers map. */
   std::set<int> m_uncleanClients;
 
@@ -97,16 +107,21 @@ public:
   /**
    * \brief Constructs a server.
    *
-   * \param mode  The mode in which the server should run.
-   * \param port  The port on which the server should listen for connections.
+   * \param mode          The mode in which the server should run.
+   * \param port          The port on which the server should listen for connections.
+   * \param ioThreadCount The number of threads that should be used to run the server's I/O service.
    */
-  explicit Server(Mode mode = SM_MULTI_CLIENT, int port = 7851)
-  : m_mode(mode),
+  explicit Server(Mode mode = SM_MULTI_CLIENT, int port = 7851, size_t ioThreadCount = 2)
+  : m_ioThreadCount(ioThreadCount),
+    m_mode(mode),
     m_nextClientID(0),
     m_port(port),
     m_shouldTerminate(new boost::atomic<bool>(false)),
     m_worker(new boost::asio::io_service::work(m_ioService))
-  {}
+  {
+    // Note: The strand must be constructed here rather than in the initialiser list, since it depends on the I/O service.
+    m_acceptorStrand.reset(new boost::asio::io_service::strand(m_ioService));
+  }
 
   //#################### DESTRUCTOR ####################
 public:
@@ -162,7 +177,21 @@ public:
    */
   void start()
   {
-    m_serverThread.reset(new boost::thread(boost::bind(&Server::run_server, this)));
+    // Set up the TCP acceptor and start listening for connections.
+    tcp::endpoint endpoint(tcp::v4(), m_port);
+    m_acceptor.reset(new tcp::acceptor(m_ioService, endpoint));
+
+    std::cout << "Listening for connections...\n";
+    accept_client();
+
+    // Spawn a thread to keep the map of clients clean by removing any clients that have terminated.
+    m_cleanerThread.reset(new boost::thread(&Server::run_cleaner, this));
+
+    // Start the threads that will run the I/O service.
+    for(size_t i = 0; i < m_ioThreadCount; ++i)
+    {
+      m_ioThreads.create_thread(boost::bind(&Server::run_io_service, this));
+    }
   }
 
   /**
@@ -172,17 +201,35 @@ public:
   {
     *m_shouldTerminate = true;
 
-    if(m_serverThread) m_serverThread->join();
+    // Stop accepting new clients.
+    if(m_acceptor) m_acceptorStrand->post(boost::bind(&Server::close_acceptor, this));
+
+    // Abort any outstanding operations of the asynchronous clients (the synchronous clients will notice that the server is
+    // terminating and abort their own operations). Note that the cleaner thread waits for all of the clients to finish (and
+    // joins the threads of the synchronous clients), so this must happen before we stop the I/O service, since the handlers
+    // for the aborted operations run on the I/O threads.
+    {
+      boost::lock_guard<boost::mutex> lock(m_mutex);
+      stop_clients(m_startingClientHandlers);
+      stop_clients(m_clientHandlers);
+    }
 
-    if(m_cleanerThread)
+    if(m_cleanerThread && m_cleanerThread->joinable())
     {
       // Make sure that the cleaner thread can terminate when there are no clients remaining to wake it up.
-      m_uncleanClients.insert(-1);
+      {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        m_uncleanClients.insert(-1);
+      }
       m_clientsHaveFinished.notify_one();
 
       m_cleanerThread->join();
     }
 
+    // Allow the I/O service to stop once it has run out of work, and wait for the threads running it to terminate.
+    m_worker.reset();
+    m_ioThreads.join_all();
+
     // Note: It's essential that we destroy the acceptor before the I/O service, or there will be a crash.
     m_acceptor.reset();
   }
@@ -214,20 +261,12 @@ protected:
   //#################### PRIVATE MEMBER FUNCTIONS ####################
 private:
   /**
-   * \brief Accepts a client.
-   *
-   * This will block until either a client connects or the server terminates.
+   * \brief Starts an asynchronous accept of the next client to connect.
    */
   void accept_client()
   {
-    // FIXME: It would be better to have accept_client_handler call accept_client after accepting a connection.
-    //        This would allow us to get rid of the sleep loop.
     boost::shared_ptr<tcp::socket> sock(new tcp::socket(m_ioService));
-    m_acceptor->async_accept(*sock, boost::bind(&Server::accept_client_handler, this, sock, _1));
-    while(!*m_shouldTerminate && m_ioService.poll() == 0)
-    {
-      boost::this_thread::sleep_for(boost::chrono::milliseconds(5));
-    }
+    m_acceptor->async_accept(*sock, m_acceptorStrand->wrap(boost::bind(&Server::accept_client_handler, this, sock, _1)));
   }
 
   /**
@@ -238,6 +277,12 @@ private:
    */
   void accept_client_handler(const boost::shared_ptr<boost::asio::ip::tcp::socket>& sock, const boost::system::error_code& err)
   {
+    // If the server is terminating (in which case the acceptor will have been closed), early out without accepting any more clients.
+    if(*m_shouldTerminate || !m_acceptor->is_open()) return;
+
+    // Otherwise, make sure that we will accept the next client to connect, whatever happens to this one.
+    accept_client();
+
     // If an error occurred, early out.
     if(err) return;
 
@@ -249,13 +294,98 @@ private:
       return;
     }
 
-    // If a client successfully connects, start a thread for it.
     std::cout << "Accepted client connection" << std::endl;
     boost::lock_guard<boost::mutex> lock(m_mutex);
-    ClientHandler_Ptr clientHandler(new ClientHandlerType(m_nextClientID, sock, m_shouldTerminate));
-    boost::shared_ptr<boost::thread> clientThread(new boost::thread(boost::bind(&Server::handle_client, this, clientHandler)));
-    clientHandler->m_thread = clientThread;
-    ++m_nextClientID;
+
+    // If the server started terminating in the meantime, early out (this check must happen while holding the lock,
+    // since terminate relies on no new clients being started once it has locked the mutex).
+    if(*m_shouldTerminate)
+    {
+      sock->close();
+      return;
+    }
+
+    const int clientID = m_nextClientID++;
+    ClientHandler_Ptr clientHandler(new ClientHandlerType(clientID, sock, m_shouldTerminate));
+    clientHandler->m_strand.reset(new boost::asio::io_service::strand(m_ioService));
+    m_startingClientHandlers.insert(std::make_pair(clientID, clientHandler));
+
+    if(clientHandler->is_async())
+    {
+      // If the client is asynchronous, start its state machine on its strand. The server will be notified
+      // (via the client's callbacks) when it is ready to start its main state machine and when it finishes.
+      std::cout << "Starting client: " << clientID << '\n';
+      clientHandler->m_onReady = boost::bind(&Server::client_ready, this, clientID);
+      clientHandler->m_onFinished = boost::bind(&Server::client_finished, this, clientID);
+      clientHandler->m_strand->post(boost::bind(&ClientHandlerType::start_async, clientHandler));
+    }
+    else
+    {
+      // Otherwise, start a thread for it.
+      boost::shared_ptr<boost::thread> clientThread(new boost::thread(boost::bind(&Server::handle_client, this, clientHandler)));
+      clientHandler->m_thread = clientThread;
+    }
+  }
+
+  /**
+   * \brief Called when a client is ready to start its main loop/state machine.
+   *
+   * \param clientID  The ID of the client.
+   */
+  void client_ready(int clientID)
+  {
+    // Move the client handler into the map of handlers for active clients.
+    {
+      boost::lock_guard<boost::mutex> lock(m_mutex);
+      typename std::map<int, ClientHandler_Ptr>::iterator it = m_startingClientHandlers.find(clientID);
+      if(it == m_startingClientHandlers.end()) return;
+      m_clientHandlers.insert(*it);
+      m_startingClientHandlers.erase(it);
+    }
+
+    // Signal to other threads that the client is ready.
+#if DEBUGGING
+    std::cout << "Client ready: " << clientID << '\n';
+#endif
+    m_clientReady.notify_all();
+  }
+
+  /**
+   * \brief Called when a client has finished.
+   *
+   * \param clientID  The ID of the client.
+   */
+  void client_finished(int clientID)
+  {
+    // Add the client to the finished clients set so that it can be cleaned up.
+    {
+      boost::lock_guard<boost::mutex> lock(m_mutex);
+      std::cout << "Stopping client: " << clientID << '\n';
+
+      // If the client finished before it became ready, move its handler into the map of client handlers so that the cleaner can destroy it.
+      typename std::map<int, ClientHandler_Ptr>::iterator it = m_startingClientHandlers.find(clientID);
+      if(it != m_startingClientHandlers.end())
+      {
+        m_clientHandlers.insert(*it);
+        m_startingClientHandlers.erase(it);
+      }
+
+      m_finishedClients.insert(clientID);
+      m_uncleanClients.insert(clientID);
+      m_clientsHaveFinished.notify_one();
+    }
+
+    // Wake up any threads that are waiting for the client to become ready.
+    m_clientReady.notify_all();
+  }
+
+  /**
+   * \brief Closes the TCP acceptor, thereby aborting any outstanding accept.
+   */
+  void close_acceptor()
+  {
+    boost::system::error_code err;
+    m_acceptor->close(err);
   }
 
   /**
@@ -271,17 +401,9 @@ private:
     // Run the pre-loop code for the client.
     clientHandler->run_pre();
 
-    // Add the client handler to the map of handlers for active clients.
-    {
-      boost::lock_guard<boost::mutex> lock(m_mutex);
-      m_clientHandlers.insert(std::make_pair(clientID, clientHandler));
-    }
-
-    // Signal to other threads that we're ready to start running the main loop for the client.
-#if DEBUGGING
-    std::cout << "Client ready: " << clientID << '\n';
-#endif
-    m_clientReady.notify_one();
+    // Move the client handler into the map of handlers for active clients, and signal to other
+    // threads that we're ready to start running the main loop for the client.
+    client_ready(clientID);
 
     // Run the main loop for the client. Loop until either (a) the connection drops, or (b) the server itself is terminating.
     while(clientHandler->m_connectionOk && !*m_shouldTerminate)
@@ -293,13 +415,7 @@ private:
     clientHandler->run_post();
 
     // Once the client's finished, add it to the finished clients set so that it can be cleaned up.
-    {
-      boost::lock_guard<boost::mutex> lock(m_mutex);
-      std::cout << "Stopping client: " << clientID << '\n';
-      m_finishedClients.insert(clientID);
-      m_uncleanClients.insert(clientID);
-      m_clientsHaveFinished.notify_one();
-    }
+    client_finished(clientID);
   }
 
   /**
@@ -309,26 +425,39 @@ private:
   {
     boost::unique_lock<boost::mutex> lock(m_mutex);
 
-    bool canTerminate = *m_shouldTerminate && m_clientHandlers.empty();
+    bool canTerminate = *m_shouldTerminate && m_clientHandlers.empty() && m_startingClientHandlers.empty();
     while(!canTerminate)
     {
       // Wait for clients to finish.
       while(m_uncleanClients.empty()) m_clientsHaveFinished.wait(lock);
 
       // Clean up any clients that have finished.
+      std::vector<boost::shared_ptr<boost::thread> > clientThreads;
       for(std::set<int>::const_iterator it = m_uncleanClients.begin(), iend = m_uncleanClients.end(); it != iend; ++it)
       {
-        if(m_clientHandlers.find(*it) != m_clientHandlers.end())
+        typename std::map<int, ClientHandler_Ptr>::iterator jt = m_clientHandlers.find(*it);
+        if(jt != m_clientHandlers.end())
         {
           std::cout << "Cleaning up client: " << *it << std::endl;
-          m_clientHandlers.erase(*it);
+          if(jt->second->m_thread) clientThreads.push_back(jt->second->m_thread);
+          m_clientHandlers.erase(jt);
         }
       }
 
       m_uncleanClients.clear();
 
+      // Wait for the threads of any synchronous clients we cleaned up to exit (they will have finished by this point, so this won't
+      // take long), so that no client thread can outlive the server. The lock must be released whilst doing so, since the threads
+      // may still need it on their way out.
+      if(!clientThreads.empty())
+      {
+        lock.unlock();
+        for(size_t i = 0, size = clientThreads.size(); i < size; ++i) clientThreads[i]->join();
+        lock.lock();
+      }
+
       // Update the flag.
-      canTerminate = *m_shouldTerminate && m_clientHandlers.empty();
+      canTerminate = *m_shouldTerminate && m_clientHandlers.empty() && m_startingClientHandlers.empty();
     }
 
 #if DEBUGGING
@@ -337,27 +466,29 @@ private:
   }
 
   /**
-   * \brief Runs the server.
+   * \brief Runs the I/O service (this is the main function of each of the I/O threads).
    */
-  void run_server()
+  void run_io_service()
   {
-    // Spawn a thread to keep the map of clients clean by removing any clients that have terminated.
-    m_cleanerThread.reset(new boost::thread(&Server::run_cleaner, this));
+    m_ioService.run();
 
-    // Set up the TCP acceptor and listen for connections.
-    tcp::endpoint endpoint(tcp::v4(), m_port);
-    m_acceptor.reset(new tcp::acceptor(m_ioService, endpoint));
-
-    std::cout << "Listening for connections...\n";
+#if DEBUGGING
+    std::cout << "I/O thread terminating" << std::endl;
+#endif
+  }
 
-    while(!*m_shouldTerminate)
+  /**
+   * \brief Stops any asynchronous clients whose handlers are in the specified map by closing their sockets (on their strands).
+   *
+   * \param clientHandlers  The map of client handlers.
+   */
+  void stop_clients(const std::map<int, ClientHandler_Ptr>& clientHandlers)
+  {
+    for(typename std::map<int, ClientHandler_Ptr>::const_iterator it = clientHandlers.begin(), iend = clientHandlers.end(); it != iend; ++it)
     {
-      accept_client();
+      const ClientHandler_Ptr& clientHandler = it->second;
+      if(clientHandler->is_async()) clientHandler->m_strand->post(boost::bind(&ClientHandlerType::close_socket, clientHandler));
     }
-
-#if DEBUGGING
-    std::cout << "Server thread terminating" << std::endl;
-#endif
   }
 };
 
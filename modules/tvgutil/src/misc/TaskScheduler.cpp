@@ -0,0 +1,248 @@
+/**
+ * tvgutil: TaskScheduler.cpp
+ * Copyright (c) Torr Vision Group, University of Oxford, 2019. All rights reserved.
+ */
+
+#include "misc/TaskScheduler.h"
+
+#include <stdexcept>
+
+#if defined(_WIN32)
+  #include <windows.h>
+#elif defined(__linux__)
+  #include <pthread.h>
+#endif
+
+namespace tvgutil {
+
+//#################### LOCAL FUNCTIONS ####################
+
+/**
+ * \brief Attempts to pin the specified thread to the specified CPU.
+ *
+ * Note: Pinning is currently only supported on Windows and Linux. On other platforms, this is a no-op.
+ *
+ * \param thread  The thread.
+ * \param cpu     The CPU to which to pin it.
+ */
+static void pin_thread_to_cpu(boost::thread& thread, int cpu)
+{
+#if defined(_WIN32)
+  SetThreadAffinityMask(thread.native_handle(), static_cast<DWORD_PTR>(1) << cpu);
+#elif defined(__linux__)
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpus);
+#endif
+}
+
+//#################### CONSTRUCTORS ####################
+
+TaskScheduler::TaskScheduler(size_t threadCount, const std::vector<int>& cpuAffinities)
+: m_currentWorker(&TaskScheduler::no_cleanup), m_pendingTaskCount(0), m_shouldTerminate(false), m_sleepingWorkerCount(0)
+{
+  if(threadCount == 0) threadCount = std::max(boost::thread::hardware_concurrency(), 1u);
+
+  // Note: All of the workers must exist before any of the threads start, since the threads steal from each other.
+  for(size_t i = 0; i < threadCount; ++i)
+  {
+    Worker_Ptr worker(new Worker);
+    worker->m_index = i;
+    m_workers.push_back(worker);
+  }
+
+  for(size_t i = 0; i < threadCount; ++i)
+  {
+    boost::thread *thread = m_threads.create_thread(boost::bind(&TaskScheduler::run_worker, this, m_workers[i]));
+    if(!cpuAffinities.empty()) pin_thread_to_cpu(*thread, cpuAffinities[i % cpuAffinities.size()]);
+  }
+}
+
+//#################### DESTRUCTOR ####################
+
+TaskScheduler::~TaskScheduler()
+{
+  // Tell the workers to terminate once they have run all of the pending tasks, and wake up any that are sleeping.
+  {
+    boost::lock_guard<boost::mutex> lock(m_sleepMutex);
+    m_shouldTerminate = true;
+  }
+  m_workAvailable.notify_all();
+
+  // Wait for all threads to terminate.
+  m_threads.join_all();
+}
+
+//#################### PUBLIC STATIC MEMBER FUNCTIONS ####################
+
+void TaskScheduler::initialise(size_t threadCount, const std::vector<int>& cpuAffinities)
+{
+  GlobalState& state = global_state();
+  boost::lock_guard<boost::mutex> lock(state.m_mutex);
+
+  // If the global instance has already been started, it can't be reconfigured, so we check that the parameters are unchanged.
+  if(state.m_instance)
+  {
+    if(threadCount != state.m_threadCount || cpuAffinities != state.m_cpuAffinities)
+    {
+      throw std::runtime_error("Error: The global task scheduler cannot be reconfigured once it has been started");
+    }
+
+    return;
+  }
+
+  state.m_threadCount = threadCount;
+  state.m_cpuAffinities = cpuAffinities;
+}
+
+TaskScheduler& TaskScheduler::instance()
+{
+  GlobalState& state = global_state();
+  boost::lock_guard<boost::mutex> lock(state.m_mutex);
+  if(!state.m_instance) state.m_instance.reset(new TaskScheduler(state.m_threadCount, state.m_cpuAffinities));
+  return *state.m_instance;
+}
+
+//#################### PUBLIC MEMBER FUNCTIONS ####################
+
+size_t TaskScheduler::thread_count() const
+{
+  return m_workers.size();
+}
+
+bool TaskScheduler::try_run_pending_task()
+{
+  Task task;
+  if(!find_task(m_currentWorker.get(), task)) return false;
+  task();
+  return true;
+}
+
+//#################### PRIVATE MEMBER FUNCTIONS ####################
+
+void TaskScheduler::enqueue(const Task& task, TaskPriority priority)
+{
+  // Note: We increment the pending task count before adding the task, so that it can never drop below zero.
+  ++m_pendingTaskCount;
+
+  Worker *worker = m_currentWorker.get();
+  if(worker)
+  {
+    boost::lock_guard<boost::mutex> lock(worker->m_mutex);
+    worker->m_tasks[priority].push_back(task);
+  }
+  else
+  {
+    boost::lock_guard<boost::mutex> lock(m_externalTasksMutex);
+    m_externalTasks[priority].push_back(task);
+  }
+
+  // If any workers are asleep, wake one of them up to run the task. The fence pairs with the one in run_worker,
+  // and ensures that either we see the sleeping worker, or the worker sees the incremented pending task count.
+  boost::atomic_thread_fence(boost::memory_order_seq_cst);
+  if(m_sleepingWorkerCount > 0)
+  {
+    boost::lock_guard<boost::mutex> lock(m_sleepMutex);
+    m_workAvailable.notify_one();
+  }
+}
+
+bool TaskScheduler::find_task(Worker *worker, Task& task)
+{
+  if(m_pendingTaskCount == 0) return false;
+
+  const size_t workerCount = m_workers.size();
+  const size_t startIndex = worker ? worker->m_index + 1 : 0;
+
+  for(int priority = 0; priority < TP_COUNT; ++priority)
+  {
+    // First, try the back of the current worker's own deque (this is the task that was most recently spawned,
+    // and so is the one whose data are most likely to still be in the cache).
+    if(worker)
+    {
+      boost::lock_guard<boost::mutex> lock(worker->m_mutex);
+      std::deque<Task>& tasks = worker->m_tasks[priority];
+      if(!tasks.empty())
+      {
+        task.swap(tasks.back());
+        tasks.pop_back();
+        --m_pendingTaskCount;
+        return true;
+      }
+    }
+
+    // Next, try the front of the queue of externally-submitted tasks.
+    {
+      boost::lock_guard<boost::mutex> lock(m_externalTasksMutex);
+      std::deque<Task>& tasks = m_externalTasks[priority];
+      if(!tasks.empty())
+      {
+        task.swap(tasks.front());
+        tasks.pop_front();
+        --m_pendingTaskCount;
+        return true;
+      }
+    }
+
+    // Finally, try to steal the oldest task from another worker (starting from the next worker along, so as to spread out the stealing).
+    for(size_t i = 0; i < workerCount; ++i)
+    {
+      Worker& victim = *m_workers[(startIndex + i) % workerCount];
+      if(&victim == worker) continue;
+
+      boost::lock_guard<boost::mutex> lock(victim.m_mutex);
+      std::deque<Task>& tasks = victim.m_tasks[priority];
+      if(!tasks.empty())
+      {
+        task.swap(tasks.front());
+        tasks.pop_front();
+        --m_pendingTaskCount;
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+void TaskScheduler::run_worker(const Worker_Ptr& worker)
+{
+  m_currentWorker.reset(worker.get());
+
+  for(;;)
+  {
+    Task task;
+    if(find_task(worker.get(), task))
+    {
+      task();
+      continue;
+    }
+
+    // If there are no pending tasks, sleep until either some arrive or the scheduler is destroyed.
+    boost::unique_lock<boost::mutex> lock(m_sleepMutex);
+    ++m_sleepingWorkerCount;
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    while(m_pendingTaskCount == 0 && !m_shouldTerminate) m_workAvailable.wait(lock);
+    --m_sleepingWorkerCount;
+
+    if(m_pendingTaskCount == 0 && m_shouldTerminate) break;
+  }
+
+  m_currentWorker.release();
+}
+
+//#################### PRIVATE STATIC MEMBER FUNCTIONS ####################
+
+TaskScheduler::GlobalState& TaskScheduler::global_state()
+{
+  static GlobalState s_state;
+  return s_state;
+}
+
+void TaskScheduler::no_cleanup(Worker *worker)
+{
+  // No-op (the workers are owned by the scheduler)
+}
+
+}
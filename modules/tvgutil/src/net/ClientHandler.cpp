@@ -5,8 +5,23 @@
 
 #include "net/ClientHandler.h"
 
+#include <stdexcept>
+
 namespace tvgutil {
 
+//#################### LOCAL FUNCTIONS ####################
+
+/**
+ * \brief Closes the specified socket, ignoring any error that occurs (e.g. if the socket has already been closed).
+ *
+ * \param sock  The socket to close.
+ */
+static void close_socket_ignoring_errors(const boost::shared_ptr<boost::asio::ip::tcp::socket>& sock)
+{
+  boost::system::error_code err;
+  sock->close(err);
+}
+
 //#################### CONSTRUCTORS ####################
 
 ClientHandler::ClientHandler(int clientID, const boost::shared_ptr<boost::asio::ip::tcp::socket>& sock,
@@ -23,11 +38,29 @@ ClientHandler::~ClientHandler() {}
 
 //#################### PUBLIC MEMBER FUNCTIONS ####################
 
+void ClientHandler::close_socket()
+{
+  close_socket_ignoring_errors(m_sock);
+}
+
 int ClientHandler::get_client_id() const
 {
   return m_clientID;
 }
 
+bool ClientHandler::is_async() const
+{
+  return false;
+}
+
+void ClientHandler::post_close_socket()
+{
+  // Note: The closing function holds its own pointer to the socket, so the socket stays alive even if the handler is destroyed first.
+  //       If the handler is not being run by a server (and so has no strand), there are no I/O threads, so we close the socket directly.
+  if(m_strand) m_strand->post(boost::bind(&close_socket_ignoring_errors, m_sock));
+  else close_socket();
+}
+
 void ClientHandler::run_iter()
 {
   // No-op by default
@@ -43,18 +76,76 @@ void ClientHandler::run_pre()
   // No-op by default
 }
 
+void ClientHandler::start_async()
+{
+  // Asynchronous clients must override this to start their state machines.
+  throw std::runtime_error("Error: Asynchronous client handlers must override start_async");
+}
+
+//#################### PROTECTED MEMBER FUNCTIONS ####################
+
+void ClientHandler::signal_ready()
+{
+  if(m_onReady) m_onReady();
+}
+
 //#################### PRIVATE MEMBER FUNCTIONS ####################
 
+void ClientHandler::async_message_handler(const boost::system::error_code& err, const Continuation& onSuccess)
+{
+  if(!err && !*m_shouldTerminate)
+  {
+    // If the operation succeeded, move on to the next state.
+    onSuccess();
+  }
+  else
+  {
+    // Otherwise, the connection is finished, so run the post-loop code for the client and let the server know.
+    // Note: We copy the finishing function before calling it, since the server may destroy the handler as a result.
+    m_connectionOk = false;
+    run_post();
+    Continuation onFinished = m_onFinished;
+    if(onFinished) onFinished();
+  }
+}
+
 void ClientHandler::read_message_handler(const boost::system::error_code& err, boost::optional<boost::system::error_code>& ret)
 {
-  // Store any error message so that it can be examined by read_message.
+  // Store any error message so that it can be examined by read_message. Note that we wake up all of the waiting
+  // threads, since a handler can have one thread reading from the client whilst another thread writes to it.
+  boost::lock_guard<boost::mutex> lock(m_completionMutex);
   ret = err;
+  m_operationCompleted.notify_all();
 }
 
 void ClientHandler::write_message_handler(const boost::system::error_code& err, boost::optional<boost::system::error_code>& ret)
 {
-  // Store any error message so that it can be examined by write_message.
+  // Store any error message so that it can be examined by write_message. Note that we wake up all of the waiting
+  // threads, since a handler can have one thread reading from the client whilst another thread writes to it.
+  boost::lock_guard<boost::mutex> lock(m_completionMutex);
   ret = err;
+  m_operationCompleted.notify_all();
+}
+
+bool ClientHandler::wait_for_completion(const boost::optional<boost::system::error_code>& err)
+{
+  boost::unique_lock<boost::mutex> lock(m_completionMutex);
+  while(!err)
+  {
+    // If the server is terminating, ask an I/O thread to close the socket to abort the operation (closing it directly
+    // from this thread would race with the I/O thread that is performing the operation), and then wait for its handler to run.
+    if(*m_shouldTerminate)
+    {
+      post_close_socket();
+      while(!err) m_operationCompleted.wait(lock);
+      break;
+    }
+
+    // Otherwise, wait for the operation to complete, periodically waking up to check whether the server is terminating.
+    m_operationCompleted.wait_for(lock, boost::chrono::milliseconds(100));
+  }
+
+  return *m_shouldTerminate ? false : !*err;
 }
 
 }
@@ -5,6 +5,8 @@
 
 #include "net/Message.h"
 
+#include <stdexcept>
+
 namespace tvgutil {
 
 //#################### DESTRUCTOR ####################
@@ -13,6 +15,26 @@ Message::~Message() {}
 
 //#################### PUBLIC MEMBER FUNCTIONS ####################
 
+std::vector<boost::asio::const_buffer> Message::get_const_buffers() const
+{
+  std::vector<boost::asio::const_buffer> buffers;
+  buffers.reserve(2 * m_borrowedSegments.size() + 1);
+
+  // Interleave the parts of the message data that lie between the borrowed segments with the borrowed segments themselves.
+  size_t offset = 0;
+  for(size_t i = 0, size = m_borrowedSegments.size(); i < size; ++i)
+  {
+    const BorrowedSegment& b = m_borrowedSegments[i];
+    if(b.m_segment.first > offset) buffers.push_back(boost::asio::const_buffer(m_data.data() + offset, b.m_segment.first - offset));
+    buffers.push_back(boost::asio::const_buffer(b.m_constData, b.m_segment.second));
+    offset = end_of(b.m_segment);
+  }
+
+  if(offset < m_data.size()) buffers.push_back(boost::asio::const_buffer(m_data.data() + offset, m_data.size() - offset));
+
+  return buffers;
+}
+
 char *Message::get_data_ptr()
 {
   return &m_data[0];
@@ -23,11 +45,62 @@ const char *Message::get_data_ptr() const
   return &m_data[0];
 }
 
+std::vector<boost::asio::mutable_buffer> Message::get_mutable_buffers()
+{
+  std::vector<boost::asio::mutable_buffer> buffers;
+  buffers.reserve(2 * m_borrowedSegments.size() + 1);
+
+  size_t offset = 0;
+  for(size_t i = 0, size = m_borrowedSegments.size(); i < size; ++i)
+  {
+    const BorrowedSegment& b = m_borrowedSegments[i];
+    if(!b.m_data) throw std::runtime_error("Error: Cannot receive into a message segment that has been borrowed from read-only memory");
+    if(b.m_segment.first > offset) buffers.push_back(boost::asio::mutable_buffer(m_data.data() + offset, b.m_segment.first - offset));
+    buffers.push_back(boost::asio::mutable_buffer(b.m_data, b.m_segment.second));
+    offset = end_of(b.m_segment);
+  }
+
+  if(offset < m_data.size()) buffers.push_back(boost::asio::mutable_buffer(m_data.data() + offset, m_data.size() - offset));
+
+  return buffers;
+}
+
 size_t Message::get_size() const
 {
   return m_data.size();
 }
 
+void Message::release_borrowed_segments()
+{
+  m_borrowedSegments.clear();
+}
+
+//#################### PROTECTED MEMBER FUNCTIONS ####################
+
+void Message::borrow_segment(const Segment& segment, const char *data)
+{
+  borrow_segment_sub(segment, data, NULL);
+}
+
+void Message::borrow_segment(const Segment& segment, char *data)
+{
+  borrow_segment_sub(segment, data, data);
+}
+
+char *Message::get_segment_ptr(const Segment& segment)
+{
+  const BorrowedSegment *b = find_borrowed_segment(segment);
+  if(!b) return m_data.data() + segment.first;
+  if(!b->m_data) throw std::runtime_error("Error: Cannot write to a message segment that has been borrowed from read-only memory");
+  return b->m_data + (segment.first - b->m_segment.first);
+}
+
+const char *Message::get_segment_ptr(const Segment& segment) const
+{
+  const BorrowedSegment *b = find_borrowed_segment(segment);
+  return b ? b->m_constData + (segment.first - b->m_segment.first) : m_data.data() + segment.first;
+}
+
 //#################### PROTECTED STATIC MEMBER FUNCTIONS ####################
 
 size_t Message::end_of(const Segment& segment)
@@ -35,4 +108,59 @@ size_t Message::end_of(const Segment& segment)
   return segment.first + segment.second;
 }
 
+//#################### PRIVATE MEMBER FUNCTIONS ####################
+
+void Message::borrow_segment_sub(const Segment& segment, const char *constData, char *data)
+{
+  if(end_of(segment) > m_data.size()) throw std::invalid_argument("Error: Cannot borrow a segment that lies outside the message");
+
+  // Empty segments have no bytes, so there is nothing to borrow.
+  if(segment.second == 0) return;
+
+  BorrowedSegment b;
+  b.m_constData = constData;
+  b.m_data = data;
+  b.m_segment = segment;
+
+  // Find the first borrowed segment that does not start before this one.
+  std::vector<BorrowedSegment>::iterator it = m_borrowedSegments.begin();
+  while(it != m_borrowedSegments.end() && it->m_segment.first < segment.first) ++it;
+
+  // If this segment has already been borrowed, just replace the existing borrowing.
+  if(it != m_borrowedSegments.end() && it->m_segment == segment)
+  {
+    *it = b;
+    return;
+  }
+
+  // Otherwise, check that the segment does not overlap either of its neighbours, and then insert it.
+  if((it != m_borrowedSegments.begin() && end_of((it - 1)->m_segment) > segment.first) ||
+     (it != m_borrowedSegments.end() && it->m_segment.first < end_of(segment)))
+  {
+    throw std::invalid_argument("Error: Cannot borrow a segment that overlaps a segment that has already been borrowed");
+  }
+
+  m_borrowedSegments.insert(it, b);
+}
+
+const Message::BorrowedSegment *Message::find_borrowed_segment(const Segment& segment) const
+{
+  // Note: Messages generally only borrow a handful of segments, so a linear search is fine here.
+  for(size_t i = 0, size = m_borrowedSegments.size(); i < size; ++i)
+  {
+    const BorrowedSegment& b = m_borrowedSegments[i];
+    if(segment.first < end_of(b.m_segment) && end_of(segment) > b.m_segment.first)
+    {
+      if(segment.first < b.m_segment.first || end_of(segment) > end_of(b.m_segment))
+      {
+        throw std::runtime_error("Error: A message segment straddles the boundary of a borrowed segment");
+      }
+
+      return &b;
+    }
+  }
+
+  return NULL;
+}
+
 }
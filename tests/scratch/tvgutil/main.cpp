@@ -1,5 +1,5 @@
 //###
-#if 1
+#if 0
 
 #include <iostream>
 
@@ -44,3 +44,83 @@ int main()
 }
 
 #endif
+
+//###
+#if 1
+
+#include <iostream>
+
+#include <boost/make_shared.hpp>
+#include <boost/thread.hpp>
+
+#include <tvgutil/containers/LockFreePooledQueue.h>
+#include <tvgutil/containers/PooledQueue.h>
+#include <tvgutil/timing/Timer.h>
+using namespace tvgutil;
+using namespace tvgutil::pooled_queue;
+
+typedef boost::shared_ptr<int> Int_Ptr;
+
+Int_Ptr make_int()
+{
+  return boost::make_shared<int>(0);
+}
+
+template <typename Queue>
+void produce(Queue *queue, int count)
+{
+  for(int i = 0; i < count; ++i)
+  {
+    typename Queue::PushHandler_Ptr pushHandler = queue->begin_push();
+    boost::optional<Int_Ptr&> elt = pushHandler->get();
+    if(elt) **elt = i;
+  }
+}
+
+template <typename Queue>
+void run_benchmark(const std::string& name, int producerCount, int countPerProducer)
+{
+  Queue queue(PES_WAIT);
+  queue.initialise(8, &make_int);
+
+  Timer<boost::chrono::microseconds> timer(name);
+
+  boost::thread_group producers;
+  for(int i = 0; i < producerCount; ++i)
+  {
+    producers.create_thread(boost::bind(&produce<Queue>, &queue, countPerProducer));
+  }
+
+  for(int i = 0, count = producerCount * countPerProducer; i < count; ++i)
+  {
+    queue.peek();
+    queue.pop();
+  }
+
+  producers.join_all();
+  timer.stop();
+
+  const double seconds = timer.duration().count() / 1000000.0;
+  std::cout << name << " (" << producerCount << " producer(s)): " << producerCount * countPerProducer / seconds << " elements/s\n";
+}
+
+int main()
+{
+  const int countPerProducer = 1000000;
+
+  // A single producer and a single consumer, as on the capture -> SLAM -> mapping client path.
+  run_benchmark<PooledQueue<Int_Ptr> >("Mutex", 1, countPerProducer);
+  run_benchmark<LockFreePooledQueue<Int_Ptr,SPSCRing> >("SPSC ring", 1, countPerProducer);
+  run_benchmark<LockFreePooledQueue<Int_Ptr,MPMCRing> >("MPMC ring", 1, countPerProducer);
+
+  // Multiple producers contending for the same queue.
+  for(int producerCount = 2; producerCount <= 8; producerCount *= 2)
+  {
+    run_benchmark<PooledQueue<Int_Ptr> >("Mutex", producerCount, countPerProducer / producerCount);
+    run_benchmark<LockFreePooledQueue<Int_Ptr,MPMCRing> >("MPMC ring", producerCount, countPerProducer / producerCount);
+  }
+
+  return 0;
+}
+
+#endif
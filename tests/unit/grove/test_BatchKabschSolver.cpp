@@ -0,0 +1,119 @@
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include <grove/ransac/base/BatchKabschSolver.h>
+using namespace grove;
+
+#include <orx/geometry/GeometryUtil.h>
+using namespace orx;
+
+#include <tvgutil/numbers/RandomNumberGenerator.h>
+using namespace tvgutil;
+
+//#################### CONSTANTS ####################
+
+// The number of pose candidates to solve for in each test (enough for several blocks of the batch solver).
+const int CANDIDATE_COUNT = 4096;
+
+//#################### HELPER FUNCTIONS ####################
+
+Eigen::Vector3f make_point(float halfSize, RandomNumberGenerator& rng)
+{
+  return Eigen::Vector3f(
+    rng.generate_real_from_uniform<float>(-halfSize, halfSize),
+    rng.generate_real_from_uniform<float>(-halfSize, halfSize),
+    rng.generate_real_from_uniform<float>(-halfSize, halfSize)
+  );
+}
+
+Eigen::Matrix3f make_rotation(RandomNumberGenerator& rng)
+{
+  Eigen::Quaternionf q(rng.generate_from_gaussian(0.0f, 1.0f), rng.generate_from_gaussian(0.0f, 1.0f), rng.generate_from_gaussian(0.0f, 1.0f), rng.generate_from_gaussian(0.0f, 1.0f));
+  q.normalize();
+  return q.toRotationMatrix();
+}
+
+/**
+ * \brief Makes a set of pose candidates, solves for their poses using the batch solver, and checks the results against the SVD-based solver.
+ *
+ * \param cameraScale The scale of the camera triangles relative to that of the world triangles.
+ * \param noiseSigma  The standard deviation of the noise added to the world points.
+ * \param outliers    Whether or not the world points should be generated independently of the camera points (i.e. be mismatched).
+ * \param seed        The seed for the random number generator.
+ */
+void check_against_svd(float cameraScale, float noiseSigma, bool outliers, unsigned int seed)
+{
+  RandomNumberGenerator rng(seed);
+
+  std::vector<PoseCandidate> candidates(CANDIDATE_COUNT);
+  for(int i = 0; i < CANDIDATE_COUNT; ++i)
+  {
+    const Eigen::Matrix3f R = make_rotation(rng);
+    const Eigen::Vector3f t = make_point(2.0f, rng);
+    for(int j = 0; j < PoseCandidate::KABSCH_CORRESPONDENCES_NEEDED; ++j)
+    {
+      const Eigen::Vector3f cameraPoint = cameraScale * (make_point(1.0f, rng) + Eigen::Vector3f(0.0f, 0.0f, 2.0f));
+      Eigen::Vector3f worldPoint = outliers ? make_point(3.0f, rng) : Eigen::Vector3f(R * cameraPoint + t);
+      for(int k = 0; k < 3; ++k)
+      {
+        worldPoint[k] += rng.generate_from_gaussian(0.0f, noiseSigma);
+        candidates[i].pointsCamera[j][k] = cameraPoint[k];
+        candidates[i].pointsWorld[j][k] = worldPoint[k];
+      }
+    }
+  }
+
+  BatchKabschSolver solver;
+  BOOST_REQUIRE_EQUAL(solver.solve(&candidates[0], CANDIDATE_COUNT), CANDIDATE_COUNT);
+
+  int wrongCount = 0;
+  for(int i = 0; i < CANDIDATE_COUNT; ++i)
+  {
+    Eigen::Matrix3f cameraPoints, worldPoints;
+    for(int j = 0; j < PoseCandidate::KABSCH_CORRESPONDENCES_NEEDED; ++j)
+    {
+      cameraPoints.col(j) = Eigen::Map<const Eigen::Vector3f>(candidates[i].pointsCamera[j].v);
+      worldPoints.col(j) = Eigen::Map<const Eigen::Vector3f>(candidates[i].pointsWorld[j].v);
+    }
+
+    const Eigen::Matrix4f expected = GeometryUtil::estimate_rigid_transform(cameraPoints, worldPoints);
+    const Eigen::Matrix4f actual = Eigen::Map<const Eigen::Matrix4f>(candidates[i].cameraPose.m);
+
+    // Compare the rotations, and the translations relative to the scale of the world points.
+    const float rotationError = (actual.block<3,3>(0,0) - expected.block<3,3>(0,0)).cwiseAbs().maxCoeff();
+    const float translationError = (actual.block<3,1>(0,3) - expected.block<3,1>(0,3)).norm();
+    if(rotationError > 1e-3f || translationError > 1e-2f) ++wrongCount;
+  }
+
+  BOOST_CHECK_EQUAL(wrongCount, 0);
+}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(test_BatchKabschSolver)
+
+BOOST_AUTO_TEST_CASE(exact_test)
+{
+  check_against_svd(1.0f, 0.0f, false, 12345);
+}
+
+BOOST_AUTO_TEST_CASE(noisy_test)
+{
+  check_against_svd(1.0f, 0.05f, false, 23456);
+}
+
+BOOST_AUTO_TEST_CASE(outlier_test)
+{
+  check_against_svd(1.0f, 0.0f, true, 34567);
+}
+
+BOOST_AUTO_TEST_CASE(small_scale_test)
+{
+  check_against_svd(0.01f, 0.0f, true, 45678);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,155 @@
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#include <grove/clustering/ExampleClustererFactory.h>
+#include <grove/scoreforests/Keypoint3DColourCluster.h>
+#include <grove/scoreforests/ScorePrediction.h>
+using namespace grove;
+
+#include <tvgutil/numbers/RandomNumberGenerator.h>
+using namespace tvgutil;
+
+//#################### TYPEDEFS ####################
+
+typedef ExampleClustererFactory<Keypoint3DColour,Keypoint3DColourCluster,ScorePrediction::Capacity> ClustererFactory;
+typedef ClustererFactory::Clusterer_Ptr Clusterer_Ptr;
+
+//#################### CONSTANTS ####################
+
+// The settings used by ScoreRelocaliser (by default) when clustering and incrementally updating the reservoirs.
+const float CLUSTERER_SIGMA = 0.1f;
+const float CLUSTERER_TAU = 0.05f;
+const float MAX_MAHALANOBIS_SQ = 11.34f;
+const uint32_t MIN_CLUSTER_SIZE = 20;
+
+//#################### HELPER FUNCTIONS ####################
+
+Keypoint3DColour make_example(const Vector3f& centre, float sigma, RandomNumberGenerator& rng)
+{
+  Keypoint3DColour example;
+  for(int i = 0; i < 3; ++i)
+  {
+    example.position[i] = rng.generate_from_gaussian(centre[i], sigma);
+    example.colour[i] = static_cast<unsigned char>(rng.generate_int_from_uniform(0, 255));
+  }
+  example.valid = true;
+  return example;
+}
+
+void fill_reservoir(Keypoint3DColourImage& reservoirs, RandomNumberGenerator& rng)
+{
+  const Vector3f modeCentres[] = { Vector3f(0.5f, 1.0f, 2.0f), Vector3f(2.5f, 0.5f, 1.0f), Vector3f(1.5f, 2.5f, 3.0f) };
+
+  // Fill the reservoir with examples drawn from a few compact modes of different sizes (the first mode gets half of the examples,
+  // the second a third and the last a sixth), so that the order of the modes produced by the clusterer is well defined.
+  Keypoint3DColour *reservoirsPtr = reservoirs.GetData(MEMORYDEVICE_CPU);
+  for(int exampleIdx = 0, exampleCount = reservoirs.noDims.width; exampleIdx < exampleCount; ++exampleIdx)
+  {
+    const int r = exampleIdx % 6;
+    const int modeIdx = r < 3 ? 0 : r < 5 ? 1 : 2;
+    reservoirsPtr[exampleIdx] = make_example(modeCentres[modeIdx], 0.02f, rng);
+  }
+}
+
+ScorePrediction cluster_reservoir(const Keypoint3DColourImage_CPtr& reservoirs, int reservoirSize)
+{
+  Clusterer_Ptr clusterer = ClustererFactory::make_clusterer(CLUSTERER_SIGMA, CLUSTERER_TAU, ScorePrediction::Capacity, MIN_CLUSTER_SIZE, ORUtils::DEVICE_CPU);
+
+  ORUtils::MemoryBlock<int> *reservoirSizes = new ORUtils::MemoryBlock<int>(1, true, false);
+  reservoirSizes->GetData(MEMORYDEVICE_CPU)[0] = reservoirSize;
+
+  ScorePredictionsMemoryBlock_Ptr predictions(new ScorePredictionsMemoryBlock(1, true, false));
+  clusterer->cluster_examples(reservoirs, ORIntMemoryBlock_CPtr(reservoirSizes), 0, 1, predictions);
+  return predictions->GetData(MEMORYDEVICE_CPU)[0];
+}
+
+int count_inliers(const ScorePrediction& prediction)
+{
+  int inlierCount = 0;
+  for(int i = 0; i < prediction.size; ++i)
+  {
+    inlierCount += prediction.elts[i].nbInliers;
+  }
+  return inlierCount;
+}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(test_ScorePrediction)
+
+BOOST_AUTO_TEST_CASE(update_prediction_incrementally_test)
+{
+  const int reservoirCapacity = 512;
+  const float positionTolerance = 0.005f;
+
+  for(int insertionCount = 1; insertionCount <= 16; insertionCount *= 2)
+  {
+    RandomNumberGenerator rng(12345 + insertionCount);
+    Keypoint3DColourImage *reservoirs = new Keypoint3DColourImage(Vector2i(reservoirCapacity, 1), true, false);
+    fill_reservoir(*reservoirs, rng);
+    const Keypoint3DColourImage_CPtr reservoirsPtr(reservoirs);
+
+    // Cluster the reservoir without its last insertionCount examples, and then incrementally add those examples to the modes.
+    ScorePrediction incrementalPrediction = cluster_reservoir(reservoirsPtr, reservoirCapacity - insertionCount);
+    const int initialInlierCount = count_inliers(incrementalPrediction);
+    const Keypoint3DColour *newExamples = reservoirs->GetData(MEMORYDEVICE_CPU) + reservoirCapacity - insertionCount;
+    BOOST_REQUIRE(update_prediction_incrementally(newExamples, insertionCount, MAX_MAHALANOBIS_SQ, incrementalPrediction));
+
+    // Re-cluster the whole reservoir from scratch, and check that each of the resulting modes has an incrementally-updated mode close to it.
+    const ScorePrediction fullPrediction = cluster_reservoir(reservoirsPtr, reservoirCapacity);
+    BOOST_CHECK_EQUAL(incrementalPrediction.size, fullPrediction.size);
+    BOOST_CHECK_EQUAL(count_inliers(incrementalPrediction), initialInlierCount + insertionCount);
+
+    for(int i = 0; i < fullPrediction.size; ++i)
+    {
+      float minDistSq = INFINITY;
+      for(int j = 0; j < incrementalPrediction.size; ++j)
+      {
+        const Vector3f diff = fullPrediction.elts[i].position - incrementalPrediction.elts[j].position;
+        minDistSq = std::min(minDistSq, dot(diff, diff));
+      }
+
+      BOOST_CHECK_LE(sqrtf(minDistSq), positionTolerance);
+    }
+
+    // Check that the incrementally-updated modes are still in non-increasing order of size.
+    for(int i = 1; i < incrementalPrediction.size; ++i)
+    {
+      BOOST_CHECK_GE(incrementalPrediction.elts[i - 1].nbInliers, incrementalPrediction.elts[i].nbInliers);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(update_prediction_incrementally_refusal_test)
+{
+  const int reservoirCapacity = 512;
+
+  RandomNumberGenerator rng(12345);
+  Keypoint3DColourImage *reservoirs = new Keypoint3DColourImage(Vector2i(reservoirCapacity, 1), true, false);
+  fill_reservoir(*reservoirs, rng);
+  const Keypoint3DColourImage_CPtr reservoirsPtr(reservoirs);
+
+  const ScorePrediction originalPrediction = cluster_reservoir(reservoirsPtr, reservoirCapacity);
+  BOOST_REQUIRE_GT(originalPrediction.size, 0);
+
+  // An example that is far from all of the existing modes could start a new mode, so the update should be refused.
+  Keypoint3DColour newExamples[2];
+  newExamples[0] = make_example(originalPrediction.elts[0].position, 0.001f, rng);
+  newExamples[1] = make_example(Vector3f(10.0f, 10.0f, 10.0f), 0.02f, rng);
+
+  ScorePrediction prediction = originalPrediction;
+  BOOST_CHECK(!update_prediction_incrementally(newExamples, 2, MAX_MAHALANOBIS_SQ, prediction));
+
+  // The prediction should have been left unchanged (even though the first example could have been added to it).
+  BOOST_CHECK_EQUAL(prediction.size, originalPrediction.size);
+  BOOST_CHECK_EQUAL(count_inliers(prediction), count_inliers(originalPrediction));
+  for(int i = 0; i < prediction.size; ++i)
+  {
+    BOOST_CHECK(prediction.elts[i].position == originalPrediction.elts[i].position);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
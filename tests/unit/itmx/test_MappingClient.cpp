@@ -0,0 +1,471 @@
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+
+#include <boost/chrono.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <itmx/remotemapping/MappingClient.h>
+#include <itmx/remotemapping/MappingServer.h>
+using namespace itmx;
+using namespace tvgutil;
+
+using boost::asio::ip::tcp;
+
+//#################### HELPER CLASSES ####################
+
+/**
+ * \brief An instance of this class represents a TCP proxy that forwards a single connection to a server running on
+ *        the local machine, delaying all of the data it forwards by a fixed amount so as to simulate network latency.
+ */
+class DelayProxy
+{
+  //#################### NESTED TYPES ####################
+private:
+  /**
+   * \brief An instance of this struct represents a chunk of data that has been read from one socket and is waiting to be written to the other.
+   */
+  struct Chunk
+  {
+    /** The data in the chunk (an empty chunk denotes the end of the stream). */
+    std::vector<char> m_data;
+
+    /** The time at which the chunk should be written. */
+    boost::chrono::steady_clock::time_point m_dueTime;
+  };
+
+  /**
+   * \brief An instance of this struct represents the data flowing in one direction through the proxy.
+   */
+  struct Channel
+  {
+    /** The chunks that have been read but not yet written. */
+    std::deque<Chunk> m_chunks;
+
+    /** A condition variable used to wait for chunks to arrive. */
+    boost::condition_variable m_chunksAvailable;
+
+    /** The mutex used to synchronise access to the chunks. */
+    boost::mutex m_mutex;
+  };
+
+  //#################### PRIVATE VARIABLES ####################
+private:
+  boost::asio::io_service m_ioService;
+  boost::shared_ptr<tcp::acceptor> m_acceptor;
+  Channel m_clientToServer, m_serverToClient;
+  boost::chrono::milliseconds m_latency;
+  int m_serverPort;
+  boost::thread_group m_threads;
+
+  //#################### CONSTRUCTORS ####################
+public:
+  DelayProxy(int port, int serverPort, boost::chrono::milliseconds latency)
+  : m_acceptor(new tcp::acceptor(m_ioService, tcp::endpoint(tcp::v4(), port))), m_latency(latency), m_serverPort(serverPort)
+  {
+    m_threads.create_thread(boost::bind(&DelayProxy::run, this));
+  }
+
+  //#################### DESTRUCTOR ####################
+public:
+  ~DelayProxy()
+  {
+    m_threads.join_all();
+  }
+
+  //#################### PRIVATE MEMBER FUNCTIONS ####################
+private:
+  void read_chunks(const boost::shared_ptr<tcp::socket>& sock, Channel *channel)
+  {
+    Chunk chunk;
+    boost::system::error_code err;
+    do
+    {
+      chunk.m_data.resize(65536);
+      chunk.m_data.resize(sock->read_some(boost::asio::buffer(chunk.m_data), err));
+      chunk.m_dueTime = boost::chrono::steady_clock::now() + m_latency;
+
+      boost::lock_guard<boost::mutex> lock(channel->m_mutex);
+      channel->m_chunks.push_back(chunk);
+      channel->m_chunksAvailable.notify_one();
+    } while(!chunk.m_data.empty());
+  }
+
+  void run()
+  {
+    boost::shared_ptr<tcp::socket> clientSock(new tcp::socket(m_ioService));
+    m_acceptor->accept(*clientSock);
+
+    boost::shared_ptr<tcp::socket> serverSock(new tcp::socket(m_ioService));
+    serverSock->connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), m_serverPort));
+    serverSock->set_option(tcp::no_delay(true));
+    clientSock->set_option(tcp::no_delay(true));
+
+    boost::thread_group threads;
+    threads.create_thread(boost::bind(&DelayProxy::read_chunks, this, clientSock, &m_clientToServer));
+    threads.create_thread(boost::bind(&DelayProxy::write_chunks, this, serverSock, &m_clientToServer));
+    threads.create_thread(boost::bind(&DelayProxy::read_chunks, this, serverSock, &m_serverToClient));
+    threads.create_thread(boost::bind(&DelayProxy::write_chunks, this, clientSock, &m_serverToClient));
+    threads.join_all();
+  }
+
+  void write_chunks(const boost::shared_ptr<tcp::socket>& sock, Channel *channel)
+  {
+    for(;;)
+    {
+      Chunk chunk;
+      {
+        boost::unique_lock<boost::mutex> lock(channel->m_mutex);
+        while(channel->m_chunks.empty()) channel->m_chunksAvailable.wait(lock);
+        chunk = channel->m_chunks.front();
+        channel->m_chunks.pop_front();
+      }
+
+      boost::this_thread::sleep_until(chunk.m_dueTime);
+
+      // If we've reached the end of the stream, pass on the fact that the connection has been closed and stop.
+      boost::system::error_code err;
+      if(chunk.m_data.empty())
+      {
+        sock->shutdown(tcp::socket::shutdown_send, err);
+        break;
+      }
+
+      boost::asio::write(*sock, boost::asio::buffer(chunk.m_data), err);
+    }
+  }
+};
+
+//#################### HELPER FUNCTIONS ####################
+
+/**
+ * \brief Consumes frames from the specified client of a mapping server, checking that they arrive in the order in which they were sent.
+ *
+ * \param server          The mapping server.
+ * \param clientID        The ID of the client whose frames should be consumed.
+ * \param frameSize       The size of the client's frames.
+ * \param frameCount      The number of frames to consume.
+ * \param consumedCount   A location into which to write the number of frames consumed.
+ * \param outOfOrderCount A location into which to write the number of frames that arrived out of order.
+ */
+void consume_frames(MappingServer *server, int clientID, Vector2i frameSize, int frameCount, int *consumedCount, int *outOfOrderCount)
+{
+  ORUChar4Image rgbImage(frameSize, true, false);
+  ORShortImage depthImage(frameSize, true, false);
+
+  const boost::chrono::steady_clock::time_point deadline = boost::chrono::steady_clock::now() + boost::chrono::seconds(30);
+  while(*consumedCount < frameCount && boost::chrono::steady_clock::now() < deadline)
+  {
+    if(server->has_images_now(clientID))
+    {
+      server->get_images(clientID, &rgbImage, &depthImage);
+      if(depthImage.GetData(MEMORYDEVICE_CPU)[0] != *consumedCount) ++*outOfOrderCount;
+      ++*consumedCount;
+    }
+    else boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+  }
+}
+
+/**
+ * \brief Measures the rate (in frames per second) at which a mapping client can send frames to a mapping server across a connection with the specified latency.
+ *
+ * \param frameWindowSize The maximum number of frames the client can have in flight at once.
+ * \param latency         The one-way latency to simulate.
+ * \param port            The port on which to run the server (the proxy runs on the next port up).
+ * \return                The rate (in frames per second) at which the client can send frames to the server.
+ */
+double measure_frame_rate(size_t frameWindowSize, boost::chrono::milliseconds latency, int port)
+{
+  const int frameCount = 50;
+  const Vector2i imgSize(160, 120);
+
+  MappingServer server(MappingServer::SM_SINGLE_CLIENT, port);
+  server.start();
+
+  double framesPerSecond = 0.0;
+
+  {
+    DelayProxy proxy(port + 1, port, latency);
+
+    {
+      // Note: We use the wait strategy so that each push blocks until the client has room to send the frame.
+      MappingClient client("localhost", boost::lexical_cast<std::string>(port + 1), pooled_queue::PES_WAIT, frameWindowSize);
+
+      ITMLib::ITMRGBDCalib calib;
+      calib.intrinsics_rgb.imgSize = calib.intrinsics_d.imgSize = imgSize;
+
+      RGBDCalibrationMessage calibMsg;
+      calibMsg.set_calib(calib);
+      calibMsg.set_depth_compression_type(DEPTH_COMPRESSION_NONE);
+      calibMsg.set_rgb_compression_type(RGB_COMPRESSION_NONE);
+      client.send_calibration_message(calibMsg);
+
+      boost::chrono::steady_clock::time_point t0 = boost::chrono::steady_clock::now();
+      for(int i = 0; i < frameCount; ++i)
+      {
+        MappingClient::FrameMessagePushHandler_Ptr pushHandler = client.begin_push_frame_message();
+        boost::optional<RGBDFrameMessage_Ptr&> elt = pushHandler->get();
+        if(elt) (*elt)->set_frame_index(i);
+      }
+
+      const double seconds = boost::chrono::duration_cast<boost::chrono::duration<double> >(boost::chrono::steady_clock::now() - t0).count();
+      framesPerSecond = frameCount / seconds;
+    }
+
+    // Once the client has disconnected, the proxy will close its connection to the server.
+  }
+
+  server.terminate();
+  return framesPerSecond;
+}
+
+/**
+ * \brief Sends the specified number of frames from a mapping client to a mapping server.
+ *
+ * The depth image of each frame is filled with a gradient offset by the index of the frame, so that the server can check the order of the frames.
+ *
+ * \param client      The mapping client.
+ * \param frameSize   The size of the frames to send.
+ * \param frameCount  The number of frames to send.
+ */
+void send_frames(MappingClient *client, Vector2i frameSize, int frameCount)
+{
+  ORShortImage_Ptr depthImage(new ORShortImage(frameSize, true, false));
+  for(int i = 0; i < frameCount; ++i)
+  {
+    short *depth = depthImage->GetData(MEMORYDEVICE_CPU);
+    for(int y = 0; y < frameSize.y; ++y)
+    {
+      for(int x = 0; x < frameSize.x; ++x)
+      {
+        depth[y * frameSize.x + x] = static_cast<short>(i + x + y);
+      }
+    }
+
+    MappingClient::FrameMessagePushHandler_Ptr pushHandler = client->begin_push_frame_message();
+    boost::optional<RGBDFrameMessage_Ptr&> elt = pushHandler->get();
+    if(elt)
+    {
+      (*elt)->set_frame_index(i);
+      (*elt)->set_depth_image(depthImage);
+    }
+  }
+}
+
+/**
+ * \brief Simulates the renderer of a mapping server, by repeatedly "rendering" an image for its first client in response to the client's
+ *        latest rendering request, and notifying the server each time an image is ready.
+ *
+ * Each image is filled with a colour derived from the visualisation type of the request, so that the client can tell which request it answers.
+ *
+ * \param server        The mapping server.
+ * \param shouldStop    Whether or not the simulated renderer should stop.
+ * \param renderCount   A location into which to write the number of images rendered.
+ */
+void simulate_renderer(MappingServer *server, const boost::atomic<bool> *shouldStop, boost::atomic<int> *renderCount)
+{
+  const int clientID = 0;
+
+  while(!*shouldStop)
+  {
+    const boost::optional<RenderingRequestMessage> request = server->get_rendering_request(clientID);
+    if(request)
+    {
+      {
+        ExclusiveHandle_Ptr<ORUChar4Image_Ptr>::Type imageHandle = server->get_rendered_image(clientID);
+        if(!imageHandle) break;
+
+        ORUChar4Image_Ptr& image = imageHandle->get();
+        if(!image) image.reset(new ORUChar4Image(request->extract_image_size(), true, false));
+        image->ChangeDims(request->extract_image_size());
+
+        const unsigned char value = static_cast<unsigned char>(request->extract_visualisation_type());
+        Vector4u *pixels = image->GetData(MEMORYDEVICE_CPU);
+        std::fill(pixels, pixels + image->dataSize, Vector4u(value, value, value, 255));
+      }
+
+      server->notify_rendered_image(clientID);
+      ++*renderCount;
+    }
+
+    // Simulate the time taken to render the scene.
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(5));
+  }
+}
+
+/**
+ * \brief Streams frames from a mapping client to a mapping server until told to stop.
+ *
+ * \param client      The mapping client.
+ * \param shouldStop  Whether or not the streaming should stop.
+ * \param frameCount  A location into which to write the number of frames streamed.
+ */
+void stream_frames(MappingClient *client, const boost::atomic<bool> *shouldStop, boost::atomic<int> *frameCount)
+{
+  for(int i = 0; !*shouldStop; ++i)
+  {
+    MappingClient::FrameMessagePushHandler_Ptr pushHandler = client->begin_push_frame_message();
+    boost::optional<RGBDFrameMessage_Ptr&> elt = pushHandler->get();
+    if(elt) (*elt)->set_frame_index(i);
+    ++*frameCount;
+  }
+}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(test_MappingClient)
+
+BOOST_AUTO_TEST_CASE(windowed_transport_test)
+{
+  const boost::chrono::milliseconds latency(10);
+
+  // Note: A window size of 1 corresponds to the original stop-and-wait protocol.
+  const double stopAndWaitFPS = measure_frame_rate(1, latency, 7871);
+  const double windowedFPS = measure_frame_rate(8, latency, 7873);
+
+  std::cout << "Frame rate with " << latency.count() << "ms latency: stop-and-wait " << stopAndWaitFPS << " fps, windowed " << windowedFPS << " fps" << std::endl;
+    BOOST_CHECK_GT(windowedFPS, stopAndWaitFPS);
+}
+
+BOOST_AUTO_TEST_CASE(multi_client_ingest_test)
+{
+  const int port = 7877;
+  const int clientCount = 3, frameCount = 100;
+  const Vector2i frameSize(320, 240);
+
+  MappingServer server(MappingServer::SM_MULTI_CLIENT, port);
+  server.start();
+
+  std::vector<boost::shared_ptr<MappingClient> > clients;
+  std::vector<MappingClientHandler::IngestCounters> counters(clientCount);
+  std::vector<int> consumedCounts(clientCount, 0), outOfOrderCounts(clientCount, 0);
+  double seconds = 0.0;
+
+  // Connect the clients one at a time, so that their IDs are known. Every other client uses a lock-free frame message queue.
+  for(int clientID = 0; clientID < clientCount; ++clientID)
+  {
+    const size_t frameWindowSize = 4;
+    const bool useLockFreeQueue = clientID % 2 == 1;
+    boost::shared_ptr<MappingClient> client(new MappingClient("localhost", boost::lexical_cast<std::string>(port), pooled_queue::PES_WAIT, frameWindowSize, useLockFreeQueue));
+
+    ITMLib::ITMRGBDCalib calib;
+    calib.intrinsics_rgb.imgSize = calib.intrinsics_d.imgSize = frameSize;
+
+    RGBDCalibrationMessage calibMsg;
+    calibMsg.set_calib(calib);
+    calibMsg.set_depth_compression_type(DEPTH_COMPRESSION_PREDICTIVE);
+    calibMsg.set_rgb_compression_type(RGB_COMPRESSION_NONE);
+    client->send_calibration_message(calibMsg);
+
+    clients.push_back(client);
+  }
+
+  // Stream frames from all of the clients at once, whilst consuming them on the server as a mapping engine would.
+  {
+    const boost::chrono::steady_clock::time_point t0 = boost::chrono::steady_clock::now();
+
+    boost::thread_group threads;
+    for(int clientID = 0; clientID < clientCount; ++clientID)
+    {
+      threads.create_thread(boost::bind(&send_frames, clients[clientID].get(), frameSize, frameCount));
+      threads.create_thread(boost::bind(&consume_frames, &server, clientID, frameSize, frameCount, &consumedCounts[clientID], &outOfOrderCounts[clientID]));
+    }
+    threads.join_all();
+
+    seconds = boost::chrono::duration_cast<boost::chrono::duration<double> >(boost::chrono::steady_clock::now() - t0).count();
+  }
+
+  // Read the ingest counters before the clients disconnect.
+  for(int clientID = 0; clientID < clientCount; ++clientID)
+  {
+    counters[clientID] = server.get_ingest_counters(clientID);
+  }
+
+  clients.clear();
+  server.terminate();
+
+  std::cout << "Multi-client ingest: " << clientCount << " clients, " << clientCount * frameCount / seconds << " fps in total" << std::endl;
+
+  // Every frame from every client should have been received, decoded and consumed, in order, without any being discarded.
+  for(int clientID = 0; clientID < clientCount; ++clientID)
+  {
+      BOOST_CHECK_EQUAL(counters[clientID].m_receivedFrameCount, static_cast<size_t>(frameCount));
+      BOOST_CHECK_EQUAL(counters[clientID].m_decodedFrameCount, static_cast<size_t>(frameCount));
+      BOOST_CHECK_EQUAL(counters[clientID].m_discardedFrameCount, static_cast<size_t>(0));
+      BOOST_CHECK_EQUAL(consumedCounts[clientID], frameCount);
+      BOOST_CHECK_EQUAL(outOfOrderCounts[clientID], 0);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(rendered_image_push_test)
+{
+  const int port = 7875;
+  const int requestCount = 20;
+  const Vector2i frameSize(320, 240), renderSize(160, 120);
+
+  MappingServer server(MappingServer::SM_SINGLE_CLIENT, port);
+  server.start();
+
+  boost::chrono::duration<double> totalLatency(0.0), maxLatency(0.0);
+  int answeredCount = 0;
+  boost::atomic<int> frameCount(0), renderCount(0);
+
+  {
+    MappingClient client("localhost", boost::lexical_cast<std::string>(port), pooled_queue::PES_WAIT);
+
+    ITMLib::ITMRGBDCalib calib;
+    calib.intrinsics_rgb.imgSize = calib.intrinsics_d.imgSize = frameSize;
+
+    RGBDCalibrationMessage calibMsg;
+    calibMsg.set_calib(calib);
+    calibMsg.set_depth_compression_type(DEPTH_COMPRESSION_NONE);
+    calibMsg.set_rgb_compression_type(RGB_COMPRESSION_NONE);
+    client.send_calibration_message(calibMsg);
+
+    // Stream frames to the server as fast as possible, whilst the server renders images for the client in the background.
+    boost::atomic<bool> shouldStop(false);
+    boost::thread_group threads;
+    threads.create_thread(boost::bind(&simulate_renderer, &server, &shouldStop, &renderCount));
+    threads.create_thread(boost::bind(&stream_frames, &client, &shouldStop, &frameCount));
+
+    // Repeatedly change the rendering request, and measure how long it takes for an image that answers the new request to be pushed across.
+    for(int i = 1; i <= requestCount; ++i)
+    {
+      const boost::chrono::steady_clock::time_point t0 = boost::chrono::steady_clock::now();
+      client.update_rendering_request(renderSize, ORUtils::SE3Pose(), i);
+
+      boost::chrono::steady_clock::duration elapsed;
+      while((elapsed = boost::chrono::steady_clock::now() - t0) < boost::chrono::seconds(5))
+      {
+        ORUChar4Image_CPtr image = client.get_remote_image();
+        if(image && image->noDims == renderSize && image->GetData(MEMORYDEVICE_CPU)[0].x == i)
+        {
+          const boost::chrono::duration<double> latency = boost::chrono::duration_cast<boost::chrono::duration<double> >(elapsed);
+          totalLatency += latency;
+          maxLatency = std::max(maxLatency, latency);
+          ++answeredCount;
+          break;
+        }
+
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+      }
+    }
+
+    shouldStop = true;
+    threads.join_all();
+  }
+
+  server.terminate();
+
+  std::cout << "Render latency under concurrent frame streaming: mean " << 1000 * totalLatency.count() / std::max(answeredCount, 1)
+            << "ms, max " << 1000 * maxLatency.count() << "ms (" << frameCount.load() << " frames streamed, " << renderCount.load() << " images rendered)" << std::endl;
+
+  // Every request should have been answered, and frames should have continued to stream whilst the images were being rendered.
+    BOOST_CHECK_EQUAL(answeredCount, requestCount);
+    BOOST_CHECK_GT(frameCount.load(), requestCount);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,150 @@
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+#include <itmx/remotemapping/PredictiveDepthCodec.h>
+using namespace itmx;
+
+//#################### HELPER FUNCTIONS ####################
+
+/**
+ * \brief Makes a synthetic depth image containing a noisy slanted plane, a box in front of it and a few holes.
+ *
+ * \param width   The width of the image.
+ * \param height  The height of the image.
+ * \param shift   The amount by which to shift the box horizontally (to simulate motion between frames).
+ * \return        The depth image.
+ */
+std::vector<short> make_depth_image(int width, int height, int shift)
+{
+  std::vector<short> depth(width * height);
+  for(int y = 0; y < height; ++y)
+  {
+    for(int x = 0; x < width; ++x)
+    {
+      short& d = depth[y * width + x];
+      d = static_cast<short>(1500 + 2 * x + y + rand() % 3);
+      if(x >= width / 4 + shift && x < width / 2 + shift && y >= height / 4 && y < height / 2) d = static_cast<short>(800 + rand() % 3);
+      if((x / 8 + y / 8) % 7 == 0 && x % 8 < 3) d = 0;
+    }
+  }
+  return depth;
+}
+
+/**
+ * \brief Compresses and then uncompresses a depth image, and checks that the result exactly matches the original.
+ *
+ * \param depth     The depth image.
+ * \param reference An optional reference image (may be NULL).
+ * \param width     The width of the image.
+ * \param height    The height of the image.
+ * \return          The size of the compressed image (in bytes).
+ */
+size_t check_round_trip(const std::vector<short>& depth, const short *reference, int width, int height)
+{
+  std::vector<uint8_t> bytes;
+  PredictiveDepthCodec::compress(depth.data(), reference, width, height, bytes);
+
+  std::vector<short> result(depth.size(), -1);
+  PredictiveDepthCodec::uncompress(bytes.data(), bytes.size(), reference, width, height, result.data());
+    BOOST_CHECK(result == depth);
+
+  return bytes.size();
+}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(test_PredictiveDepthCodec)
+
+BOOST_AUTO_TEST_CASE(round_trip_test)
+{
+  const int width = 640, height = 480;
+  const std::vector<short> depth = make_depth_image(width, height, 0);
+  const size_t compressedSize = check_round_trip(depth, NULL, width, height);
+
+  // The image is piecewise smooth, so it should compress well.
+    BOOST_CHECK_LT(compressedSize, depth.size() * sizeof(short) / 3);
+}
+
+BOOST_AUTO_TEST_CASE(temporal_test)
+{
+  const int width = 640, height = 480;
+  const std::vector<short> previous = make_depth_image(width, height, 0);
+  std::vector<short> current = previous;
+  for(int y = height / 4; y < height / 2; ++y)
+  {
+    for(int x = width / 2; x < width / 2 + 4; ++x) current[y * width + x] = 700;
+  }
+
+  // Coding a frame that is almost identical to its reference should be much cheaper than coding it independently.
+  const size_t spatialSize = check_round_trip(current, NULL, width, height);
+  const size_t temporalSize = check_round_trip(current, previous.data(), width, height);
+    BOOST_CHECK_LT(temporalSize, spatialSize / 4);
+
+  // Uncompressing a temporally-coded frame without its reference should fail.
+  std::vector<uint8_t> bytes;
+  PredictiveDepthCodec::compress(current.data(), previous.data(), width, height, bytes);
+  std::vector<short> result(current.size());
+    BOOST_CHECK_THROW(PredictiveDepthCodec::uncompress(bytes.data(), bytes.size(), NULL, width, height, result.data()), std::runtime_error);
+
+  // Coding a frame relative to an unrelated reference should fall back to coding it independently.
+  const std::vector<short> unrelated(current.size(), 5000);
+  const size_t fallbackSize = check_round_trip(current, unrelated.data(), width, height);
+    BOOST_CHECK_EQUAL(fallbackSize, spatialSize);
+}
+
+BOOST_AUTO_TEST_CASE(extreme_values_test)
+{
+  // Alternate between the extreme values a short can take, so as to exercise the escape codes.
+  const int width = 37, height = 11;
+  std::vector<short> depth(width * height), reference(width * height);
+  for(int i = 0; i < width * height; ++i)
+  {
+    depth[i] = (i * 7) % 3 == 0 ? -32768 : (i % 5 == 0 ? 32767 : static_cast<short>(rand()));
+    reference[i] = i % 2 == 0 ? 32767 : -32768;
+  }
+
+  check_round_trip(depth, NULL, width, height);
+  check_round_trip(depth, reference.data(), width, height);
+  check_round_trip(std::vector<short>(width * height, 0), NULL, width, height);
+  check_round_trip(std::vector<short>(1, 1234), NULL, 1, 1);
+  check_round_trip(std::vector<short>(), NULL, 0, 0);
+}
+
+BOOST_AUTO_TEST_CASE(band_test)
+{
+  // Check that bands of rows can be compressed and uncompressed independently of the rest of the image.
+  const int width = 64, height = 48, rowBegin = 17, rowEnd = 30;
+  const std::vector<short> depth = make_depth_image(width, height, 0);
+  const std::vector<short> reference = make_depth_image(width, height, 2);
+
+  std::vector<uint8_t> bytes;
+  PredictiveDepthCodec::compress(depth.data() + rowBegin * width, reference.data() + rowBegin * width, width, rowEnd - rowBegin, bytes);
+
+  std::vector<short> result(depth.size(), -1);
+  PredictiveDepthCodec::uncompress(bytes.data(), bytes.size(), reference.data() + rowBegin * width, width, rowEnd - rowBegin, result.data() + rowBegin * width);
+    BOOST_CHECK(std::equal(depth.begin() + rowBegin * width, depth.begin() + rowEnd * width, result.begin() + rowBegin * width));
+    BOOST_CHECK_EQUAL(result[rowBegin * width - 1], -1);
+    BOOST_CHECK_EQUAL(result[rowEnd * width], -1);
+}
+
+BOOST_AUTO_TEST_CASE(corrupt_input_test)
+{
+  const int width = 64, height = 48;
+  const std::vector<short> depth = make_depth_image(width, height, 0);
+  std::vector<uint8_t> bytes;
+  PredictiveDepthCodec::compress(depth.data(), NULL, width, height, bytes);
+
+  std::vector<short> result(depth.size());
+    BOOST_CHECK_THROW(PredictiveDepthCodec::uncompress(bytes.data(), 0, NULL, width, height, result.data()), std::runtime_error);
+    BOOST_CHECK_THROW(PredictiveDepthCodec::uncompress(bytes.data(), bytes.size() / 2, NULL, width, height, result.data()), std::runtime_error);
+
+  std::vector<uint8_t> badMode = bytes;
+  badMode[0] = 23;
+    BOOST_CHECK_THROW(PredictiveDepthCodec::uncompress(badMode.data(), badMode.size(), NULL, width, height, result.data()), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
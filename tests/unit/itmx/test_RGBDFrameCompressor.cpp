@@ -0,0 +1,214 @@
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <boost/timer/timer.hpp>
+
+#include <itmx/remotemapping/RGBDFrameCompressor.h>
+using namespace itmx;
+
+//#################### HELPER FUNCTIONS ####################
+
+/**
+ * \brief Makes an uncompressed RGB-D frame message containing smoothly-varying (but noisy) synthetic images.
+ *
+ * \param rgbImageSize    The size of the RGB image.
+ * \param depthImageSize  The size of the depth image.
+ * \return                The frame message.
+ */
+RGBDFrameMessage_Ptr make_frame(const Vector2i& rgbImageSize, const Vector2i& depthImageSize)
+{
+  ORShortImage_Ptr depthImage(new ORShortImage(depthImageSize, true, false));
+  short *depth = depthImage->GetData(MEMORYDEVICE_CPU);
+  for(int y = 0; y < depthImageSize.y; ++y)
+  {
+    for(int x = 0; x < depthImageSize.x; ++x)
+    {
+      depth[y * depthImageSize.x + x] = static_cast<short>(1000 + 2 * x + 3 * y + rand() % 4);
+    }
+  }
+
+  ORUChar4Image_Ptr rgbImage(new ORUChar4Image(rgbImageSize, true, false));
+  Vector4u *rgb = rgbImage->GetData(MEMORYDEVICE_CPU);
+  for(int y = 0; y < rgbImageSize.y; ++y)
+  {
+    for(int x = 0; x < rgbImageSize.x; ++x)
+    {
+      rgb[y * rgbImageSize.x + x] = Vector4u(static_cast<unsigned char>(x), static_cast<unsigned char>(y), static_cast<unsigned char>(x + y + rand() % 4), 255);
+    }
+  }
+
+  RGBDFrameMessage_Ptr frame(new RGBDFrameMessage(rgbImageSize, depthImageSize));
+  frame->set_frame_index(23);
+  frame->set_depth_image(depthImage);
+  frame->set_rgb_image(rgbImage);
+  return frame;
+}
+
+/**
+ * \brief Compresses and then uncompresses a frame, and checks that the result matches the original to within the specified tolerance.
+ *
+ * \param rgbCompressionType    The type of compression to apply to the RGB image.
+ * \param depthCompressionType  The type of compression to apply to the depth image.
+ * \param tileCount             The maximum number of tiles into which to divide each image.
+ * \param rgbTolerance          The maximum mean absolute error to allow in the RGB image.
+ */
+void check_round_trip(RGBCompressionType rgbCompressionType, DepthCompressionType depthCompressionType, size_t tileCount, double rgbTolerance)
+{
+  const Vector2i rgbImageSize(640, 480), depthImageSize(640, 480);
+  const int frameCount = 20;
+
+  RGBDFrameCompressor_Ptr compressor;
+  try
+  {
+    compressor.reset(new RGBDFrameCompressor(rgbImageSize, depthImageSize, rgbCompressionType, depthCompressionType, tileCount));
+  }
+  catch(std::invalid_argument&)
+  {
+    // If the compression types are not available in this build (e.g. because we're building without OpenCV), skip them.
+    return;
+  }
+
+  RGBDFrameMessage_Ptr frame = make_frame(rgbImageSize, depthImageSize);
+  RGBDFrameMessage uncompressedFrame(rgbImageSize, depthImageSize);
+  CompressedRGBDFrameHeaderMessage headerMsg;
+  CompressedRGBDFrameMessage compressedFrame(headerMsg);
+
+  // Time the compression and uncompression of the frame (the buffers used are reused across frames, as in a real stream).
+  double compressionSeconds = 0.0, uncompressionSeconds = 0.0;
+  for(int i = 0; i < frameCount; ++i)
+  {
+    boost::timer::cpu_timer timer;
+    compressor->compress_rgbd_frame(*frame, headerMsg, compressedFrame);
+    compressionSeconds += timer.elapsed().wall / 1e9;
+
+    timer.start();
+    compressor->uncompress_rgbd_frame(compressedFrame, uncompressedFrame);
+    uncompressionSeconds += timer.elapsed().wall / 1e9;
+  }
+
+  std::cout << "RGB " << rgbCompressionType << ", depth " << depthCompressionType << ", " << headerMsg.extract_rgb_tile_count() << " tile(s): "
+            << frameCount / compressionSeconds << " frames/s compressing, " << frameCount / uncompressionSeconds << " frames/s uncompressing, "
+            << compressedFrame.get_size() << " bytes/frame" << std::endl;
+
+  // Check that the frame survived the round trip.
+    BOOST_CHECK_EQUAL(uncompressedFrame.extract_frame_index(), 23);
+
+  ORShortImage expectedDepth(depthImageSize, true, false), actualDepth(depthImageSize, true, false);
+  frame->extract_depth_image(&expectedDepth);
+  uncompressedFrame.extract_depth_image(&actualDepth);
+  int depthMismatches = 0;
+  for(size_t i = 0; i < expectedDepth.dataSize; ++i)
+  {
+    if(expectedDepth.GetData(MEMORYDEVICE_CPU)[i] != actualDepth.GetData(MEMORYDEVICE_CPU)[i]) ++depthMismatches;
+  }
+    BOOST_CHECK_EQUAL(depthMismatches, 0);
+
+  ORUChar4Image expectedRgb(rgbImageSize, true, false), actualRgb(rgbImageSize, true, false);
+  frame->extract_rgb_image(&expectedRgb);
+  uncompressedFrame.extract_rgb_image(&actualRgb);
+  double rgbError = 0.0;
+  for(size_t i = 0; i < expectedRgb.dataSize; ++i)
+  {
+    const Vector4u& e = expectedRgb.GetData(MEMORYDEVICE_CPU)[i];
+    const Vector4u& a = actualRgb.GetData(MEMORYDEVICE_CPU)[i];
+    for(int k = 0; k < 4; ++k) rgbError += abs(static_cast<int>(e[k]) - static_cast<int>(a[k]));
+  }
+  rgbError /= expectedRgb.dataSize * 4;
+    BOOST_CHECK_LE(rgbError, rgbTolerance);
+}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(test_RGBDFrameCompressor)
+
+BOOST_AUTO_TEST_CASE(round_trip_test)
+{
+  const size_t tileCounts[] = { 1, 0 };
+  for(size_t i = 0; i < sizeof(tileCounts) / sizeof(size_t); ++i)
+  {
+    check_round_trip(RGB_COMPRESSION_NONE, DEPTH_COMPRESSION_NONE, tileCounts[i], 0.0);
+    check_round_trip(RGB_COMPRESSION_PNG, DEPTH_COMPRESSION_PNG, tileCounts[i], 0.0);
+    check_round_trip(RGB_COMPRESSION_JPG, DEPTH_COMPRESSION_PNG, tileCounts[i], 5.0);
+    check_round_trip(RGB_COMPRESSION_NONE, DEPTH_COMPRESSION_PREDICTIVE, tileCounts[i], 0.0);
+    check_round_trip(RGB_COMPRESSION_NONE, DEPTH_COMPRESSION_PREDICTIVE_TEMPORAL, tileCounts[i], 0.0);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(tiling_test)
+{
+  // Check that frames with more tiles than rows are handled correctly.
+  const Vector2i rgbImageSize(8, 3), depthImageSize(1, 1);
+  RGBDFrameCompressor compressor(rgbImageSize, depthImageSize, RGB_COMPRESSION_NONE, DEPTH_COMPRESSION_NONE, 16);
+
+  RGBDFrameMessage_Ptr frame = make_frame(rgbImageSize, depthImageSize);
+  CompressedRGBDFrameHeaderMessage headerMsg;
+  CompressedRGBDFrameMessage compressedFrame(headerMsg);
+  compressor.compress_rgbd_frame(*frame, headerMsg, compressedFrame);
+    BOOST_CHECK_EQUAL(headerMsg.extract_depth_tile_count(), 1);
+    BOOST_CHECK_EQUAL(headerMsg.extract_rgb_tile_count(), 3);
+
+  RGBDFrameMessage uncompressedFrame(rgbImageSize, depthImageSize);
+  compressor.uncompress_rgbd_frame(compressedFrame, uncompressedFrame);
+
+  ORUChar4Image expectedRgb(rgbImageSize, true, false), actualRgb(rgbImageSize, true, false);
+  frame->extract_rgb_image(&expectedRgb);
+  uncompressedFrame.extract_rgb_image(&actualRgb);
+    BOOST_CHECK(memcmp(expectedRgb.GetData(MEMORYDEVICE_CPU), actualRgb.GetData(MEMORYDEVICE_CPU), expectedRgb.dataSize * sizeof(Vector4u)) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(zero_copy_test)
+{
+  const Vector2i rgbImageSize(64, 48), depthImageSize(64, 48);
+  RGBDFrameCompressor compressor(rgbImageSize, depthImageSize, RGB_COMPRESSION_NONE, DEPTH_COMPRESSION_NONE, 4);
+
+  RGBDFrameMessage_Ptr frame = make_frame(rgbImageSize, depthImageSize);
+  CompressedRGBDFrameHeaderMessage headerMsg;
+  CompressedRGBDFrameMessage compressedFrame(headerMsg);
+  compressor.compress_rgbd_frame(*frame, headerMsg, compressedFrame);
+
+  // Count the bytes that had to be copied into the compressed frame message itself (the compressed images should instead be borrowed from the compressor).
+  const char *begin = compressedFrame.get_data_ptr(), *end = begin + compressedFrame.get_size();
+  const std::vector<boost::asio::const_buffer> buffers = compressedFrame.get_const_buffers();
+  size_t copiedBytes = 0;
+  std::string wireBytes;
+  for(size_t i = 0, size = buffers.size(); i < size; ++i)
+  {
+    const char *p = boost::asio::buffer_cast<const char*>(buffers[i]);
+    const size_t n = boost::asio::buffer_size(buffers[i]);
+    if(p >= begin && p < end) copiedBytes += n;
+    wireBytes.append(p, n);
+  }
+
+  std::cout << "Bytes copied into the compressed frame message: " << copiedBytes << " of " << compressedFrame.get_size() << std::endl;
+    BOOST_CHECK_EQUAL(copiedBytes, compressedFrame.get_size() - compressedFrame.get_depth_image_data_size() - compressedFrame.get_rgb_image_data_size());
+
+  // Check that the bytes on the wire are the same as they would have been had the compressed images been copied into the message.
+  std::vector<uint8_t> depthImageData, rgbImageData;
+  compressedFrame.extract_depth_image_data(depthImageData);
+  compressedFrame.extract_rgb_image_data(rgbImageData);
+
+  CompressedRGBDFrameMessage copiedFrame(headerMsg);
+  copiedFrame.set_frame_index(compressedFrame.extract_frame_index());
+  copiedFrame.set_pose(compressedFrame.extract_pose());
+  copiedFrame.set_depth_image_data(depthImageData);
+  copiedFrame.set_rgb_image_data(rgbImageData);
+    BOOST_CHECK(wireBytes == std::string(copiedFrame.get_data_ptr(), copiedFrame.get_size()));
+
+  // Check that the received frame is uncompressed straight into the preallocated storage of the target frame message.
+  RGBDFrameMessage uncompressedFrame(rgbImageSize, depthImageSize);
+  const short *depthStorage = uncompressedFrame.get_depth_image_ptr();
+  compressor.uncompress_rgbd_frame(copiedFrame, uncompressedFrame);
+    BOOST_CHECK_EQUAL(uncompressedFrame.get_depth_image_ptr(), depthStorage);
+    BOOST_CHECK(memcmp(depthStorage, frame->get_depth_image_ptr(), depthImageSize.x * depthImageSize.y * sizeof(short)) == 0);
+
+  // Check that uncompressing into a frame message of the wrong size fails.
+  RGBDFrameMessage wrongSizeFrame(rgbImageSize, Vector2i(32, 24));
+    BOOST_CHECK_THROW(compressor.uncompress_rgbd_frame(copiedFrame, wrongSizeFrame), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,68 @@
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread.hpp>
+
+#include <orx/relocalisation/Relocaliser.h>
+
+//#################### HELPER TYPES ####################
+
+/**
+ * \brief An instance of this class represents a CPU-only relocaliser that takes a fixed amount of time to relocalise (and to train).
+ */
+class SleepingRelocaliser : public orx::Relocaliser
+{
+  //#################### PRIVATE VARIABLES ####################
+private:
+  /** The folder from which the relocaliser was most recently loaded. */
+  std::string m_loadFolder;
+
+  /** The folder to which the relocaliser was most recently saved. */
+  mutable std::string m_saveFolder;
+
+  /** The score of the single result produced by the relocaliser. */
+  float m_score;
+
+  /** The time (in milliseconds) for which the relocaliser sleeps before producing its result. */
+  int m_sleepMs;
+
+  /** The number of times the relocaliser has been trained. */
+  boost::atomic<int> m_trainCount;
+
+  /** The time (in milliseconds) for which the relocaliser sleeps when it is trained. */
+  int m_trainSleepMs;
+
+  //#################### CONSTRUCTORS ####################
+public:
+  SleepingRelocaliser(int sleepMs, float score, int trainSleepMs = 0)
+  : m_score(score), m_sleepMs(sleepMs), m_trainCount(0), m_trainSleepMs(trainSleepMs)
+  {}
+
+  //#################### PUBLIC MEMBER FUNCTIONS ####################
+public:
+  const std::string& get_load_folder() const { return m_loadFolder; }
+  const std::string& get_save_folder() const { return m_saveFolder; }
+  int get_train_count() const { return m_trainCount; }
+
+  virtual void load_from_disk(const std::string& inputFolder) { m_loadFolder = inputFolder; }
+
+  virtual std::vector<Result> relocalise(const ORUChar4Image *colourImage, const ORFloatImage *depthImage, const Vector4f& depthIntrinsics) const
+  {
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(m_sleepMs));
+
+    Result result;
+    result.quality = RELOCALISATION_GOOD;
+    result.score = m_score;
+    return std::vector<Result>(1, result);
+  }
+
+  virtual void reset() {}
+  virtual void save_to_disk(const std::string& outputFolder) const { m_saveFolder = outputFolder; }
+
+  virtual void train(const ORUChar4Image *colourImage, const ORFloatImage *depthImage, const Vector4f& depthIntrinsics, const ORUtils::SE3Pose& cameraPose)
+  {
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(m_trainSleepMs));
+    ++m_trainCount;
+  }
+};
+
+typedef boost::shared_ptr<SleepingRelocaliser> SleepingRelocaliser_Ptr;
@@ -0,0 +1,119 @@
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
+
+#include <boost/lexical_cast.hpp>
+
+#include <orx/base/MemoryBlockFactory.h>
+#include <orx/relocalisation/AsyncTrainingRelocaliser.h>
+using namespace orx;
+using namespace tvgutil;
+
+#include "SleepingRelocaliser.h"
+
+//#################### HELPER FUNCTIONS ####################
+
+SettingsContainer_Ptr make_settings(size_t queueCapacity)
+{
+  SettingsContainer_Ptr settings(new SettingsContainer);
+  settings->add_value("AsyncTrainingRelocaliser.queueCapacity", boost::lexical_cast<std::string>(queueCapacity));
+  return settings;
+}
+
+int timed_train(AsyncTrainingRelocaliser& relocaliser)
+{
+  // Make sure that the snapshots of the images that the relocaliser makes are CPU-only (like the images themselves).
+  MemoryBlockFactory::instance().set_device_type(ORUtils::DEVICE_CPU);
+
+  ORUChar4Image colourImage(Vector2i(4,4), true, false);
+  ORFloatImage depthImage(Vector2i(4,4), true, false);
+
+  boost::chrono::steady_clock::time_point startTime = boost::chrono::steady_clock::now();
+  relocaliser.train(&colourImage, &depthImage, Vector4f(1,1,0,0), ORUtils::SE3Pose());
+  return static_cast<int>(boost::chrono::duration_cast<boost::chrono::milliseconds>(boost::chrono::steady_clock::now() - startTime).count());
+}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(test_AsyncTrainingRelocaliser)
+
+BOOST_AUTO_TEST_CASE(test_training_latency)
+{
+  SleepingRelocaliser_Ptr innerRelocaliser(new SleepingRelocaliser(0, 1.0f, 100));
+  AsyncTrainingRelocaliser relocaliser(innerRelocaliser, make_settings(8), "AsyncTrainingRelocaliser.");
+
+  // Training calls should return without waiting for the (slow) inner relocaliser to be trained.
+  const int trainCount = 3;
+  for(int i = 0; i < trainCount; ++i)
+  {
+    BOOST_CHECK_LT(timed_train(relocaliser), 50);
+  }
+
+  BOOST_CHECK_GT(relocaliser.get_training_queue_size(), static_cast<size_t>(0));
+  BOOST_CHECK_LT(relocaliser.get_model_version(), static_cast<size_t>(trainCount));
+
+  // Once training has finished, all of the training steps should have been applied, in the background.
+  relocaliser.wait_for_training();
+  BOOST_CHECK_EQUAL(relocaliser.get_training_queue_size(), static_cast<size_t>(0));
+  BOOST_CHECK_EQUAL(relocaliser.get_model_version(), static_cast<size_t>(trainCount));
+  BOOST_CHECK_EQUAL(innerRelocaliser->get_train_count(), trainCount);
+  BOOST_CHECK_GE(relocaliser.get_training_lag().count(), 100);
+}
+
+BOOST_AUTO_TEST_CASE(test_relocalisation_during_training)
+{
+  SleepingRelocaliser_Ptr innerRelocaliser(new SleepingRelocaliser(0, 1.0f, 100));
+  AsyncTrainingRelocaliser relocaliser(innerRelocaliser, make_settings(8), "AsyncTrainingRelocaliser.");
+
+  for(int i = 0; i < 5; ++i) timed_train(relocaliser);
+
+  // Relocalisation should only have to wait for the training step currently being applied, not for the whole queue.
+  ORUChar4Image colourImage(Vector2i(4,4), true, false);
+  ORFloatImage depthImage(Vector2i(4,4), true, false);
+
+  boost::chrono::steady_clock::time_point startTime = boost::chrono::steady_clock::now();
+  std::vector<Relocaliser::Result> results = relocaliser.relocalise(&colourImage, &depthImage, Vector4f(1,1,0,0));
+  const int elapsedMs = static_cast<int>(boost::chrono::duration_cast<boost::chrono::milliseconds>(boost::chrono::steady_clock::now() - startTime).count());
+
+  BOOST_CHECK_EQUAL(results.size(), 1);
+  BOOST_CHECK_LT(elapsedMs, 300);
+  BOOST_CHECK_LT(relocaliser.get_model_version(), static_cast<size_t>(5));
+
+  // Saving should wait for the whole queue to drain.
+  relocaliser.save_to_disk("async");
+  BOOST_CHECK_EQUAL(innerRelocaliser->get_train_count(), 5);
+  BOOST_CHECK_EQUAL(innerRelocaliser->get_save_folder(), "async");
+}
+
+BOOST_AUTO_TEST_CASE(test_bounded_queue)
+{
+  SleepingRelocaliser_Ptr innerRelocaliser(new SleepingRelocaliser(0, 1.0f, 100));
+  AsyncTrainingRelocaliser relocaliser(innerRelocaliser, make_settings(2), "AsyncTrainingRelocaliser.");
+
+  // With the default (discard) strategy, training steps that don't fit in the queue are dropped rather than blocking the caller.
+  for(int i = 0; i < 5; ++i)
+  {
+    BOOST_CHECK_LT(timed_train(relocaliser), 50);
+  }
+
+  BOOST_CHECK_LE(relocaliser.get_training_queue_size(), static_cast<size_t>(2));
+  BOOST_CHECK_EQUAL(relocaliser.get_discarded_training_step_count(), static_cast<size_t>(3));
+
+  relocaliser.wait_for_training();
+  BOOST_CHECK_EQUAL(innerRelocaliser->get_train_count(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_unsupported_pool_empty_strategies)
+{
+  SleepingRelocaliser_Ptr innerRelocaliser(new SleepingRelocaliser(0, 1.0f, 100));
+
+  // Strategies that would recycle a training step whilst it's being applied, or let the queue grow without bound, should be rejected.
+  const std::string strategies[] = { "grow", "replacerandom" };
+  for(size_t i = 0; i < sizeof(strategies) / sizeof(std::string); ++i)
+  {
+    SettingsContainer_Ptr settings = make_settings(2);
+    settings->add_value("AsyncTrainingRelocaliser.poolEmptyStrategy", strategies[i]);
+    BOOST_CHECK_THROW(AsyncTrainingRelocaliser(innerRelocaliser, settings, "AsyncTrainingRelocaliser."), std::runtime_error);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,136 @@
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
+
+#include <orx/base/MemoryBlockFactory.h>
+#include <orx/relocalisation/CascadeRelocaliser.h>
+using namespace orx;
+using namespace tvgutil;
+
+#include "SleepingRelocaliser.h"
+
+//#################### HELPER FUNCTIONS ####################
+
+std::vector<Relocaliser_Ptr> make_inner_relocalisers(int sleepMs1, float score1, int sleepMs2, float score2)
+{
+  std::vector<Relocaliser_Ptr> innerRelocalisers;
+  innerRelocalisers.push_back(Relocaliser_Ptr(new SleepingRelocaliser(sleepMs1, score1)));
+  innerRelocalisers.push_back(Relocaliser_Ptr(new SleepingRelocaliser(sleepMs2, score2)));
+  return innerRelocalisers;
+}
+
+SettingsContainer_Ptr make_settings(bool speculative)
+{
+  SettingsContainer_Ptr settings(new SettingsContainer);
+  settings->add_value("CascadeRelocaliser.fallbackThreshold0", "0.5");
+  settings->add_value("CascadeRelocaliser.speculative", speculative ? "true" : "false");
+  return settings;
+}
+
+std::vector<Relocaliser::Result> timed_relocalise(const CascadeRelocaliser& relocaliser, int& elapsedMs)
+{
+  // Make sure that the internal copies of the images that the cascade makes are CPU-only (like the images themselves).
+  MemoryBlockFactory::instance().set_device_type(ORUtils::DEVICE_CPU);
+
+  ORUChar4Image colourImage(Vector2i(4,4), true, false);
+  ORFloatImage depthImage(Vector2i(4,4), true, false);
+
+  boost::chrono::steady_clock::time_point startTime = boost::chrono::steady_clock::now();
+  std::vector<Relocaliser::Result> results = relocaliser.relocalise(&colourImage, &depthImage, Vector4f(1,1,0,0));
+  elapsedMs = static_cast<int>(boost::chrono::duration_cast<boost::chrono::milliseconds>(boost::chrono::steady_clock::now() - startTime).count());
+
+  return results;
+}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(test_CascadeRelocaliser)
+
+BOOST_AUTO_TEST_CASE(test_speculation_delay)
+{
+  // Both cascades have to fall back from the first relocaliser to the second.
+  CascadeRelocaliser serialRelocaliser(make_inner_relocalisers(100, 1.0f, 100, 0.1f), make_settings(false), "CascadeRelocaliser.");
+
+  SettingsContainer_Ptr settings = make_settings(true);
+  settings->add_value("CascadeRelocaliser.speculationDelayMs0", "20");
+  CascadeRelocaliser speculativeRelocaliser(make_inner_relocalisers(100, 1.0f, 100, 0.1f), settings, "CascadeRelocaliser.");
+
+  int serialMs = 0, speculativeMs = 0;
+  std::vector<Relocaliser::Result> serialResults = timed_relocalise(serialRelocaliser, serialMs);
+  std::vector<Relocaliser::Result> speculativeResults = timed_relocalise(speculativeRelocaliser, speculativeMs);
+
+  // Both modes should produce the results of the second relocaliser.
+  BOOST_REQUIRE_EQUAL(serialResults.size(), 1);
+  BOOST_REQUIRE_EQUAL(speculativeResults.size(), 1);
+  BOOST_CHECK_EQUAL(serialResults[0].score, 0.1f);
+  BOOST_CHECK_EQUAL(speculativeResults[0].score, 0.1f);
+
+  // The second relocaliser should have been launched 20ms into the first one in speculative mode.
+  BOOST_CHECK_GE(serialMs, 200);
+  BOOST_CHECK_LT(speculativeMs, 170);
+}
+
+BOOST_AUTO_TEST_CASE(test_speculation_fallback_rate)
+{
+  SettingsContainer_Ptr settings = make_settings(true);
+  settings->add_value("CascadeRelocaliser.fallbackRateUpdateWeight", "1");
+  CascadeRelocaliser relocaliser(make_inner_relocalisers(100, 1.0f, 100, 0.1f), settings, "CascadeRelocaliser.");
+
+  // The first frame has no fallback history, so the relocalisers run one after the other.
+  int elapsedMs = 0;
+  std::vector<Relocaliser::Result> results = timed_relocalise(relocaliser, elapsedMs);
+  BOOST_REQUIRE_EQUAL(results.size(), 1);
+  BOOST_CHECK_EQUAL(results[0].score, 0.1f);
+  BOOST_CHECK_GE(elapsedMs, 200);
+
+  // Since the first relocaliser fell back on the first frame, both relocalisers are launched together on the second.
+  results = timed_relocalise(relocaliser, elapsedMs);
+  BOOST_REQUIRE_EQUAL(results.size(), 1);
+  BOOST_CHECK_EQUAL(results[0].score, 0.1f);
+  BOOST_CHECK_LT(elapsedMs, 170);
+}
+
+BOOST_AUTO_TEST_CASE(test_speculation_cancelled)
+{
+  // The first relocaliser succeeds, so the speculatively-launched second one is not needed.
+  SettingsContainer_Ptr settings = make_settings(true);
+  settings->add_value("CascadeRelocaliser.speculationDelayMs0", "20");
+  CascadeRelocaliser relocaliser(make_inner_relocalisers(50, 0.1f, 200, 0.2f), settings, "CascadeRelocaliser.");
+
+  for(int i = 0; i < 2; ++i)
+  {
+    int elapsedMs = 0;
+    std::vector<Relocaliser::Result> results = timed_relocalise(relocaliser, elapsedMs);
+    BOOST_REQUIRE_EQUAL(results.size(), 1);
+    BOOST_CHECK_EQUAL(results[0].score, 0.1f);
+    BOOST_CHECK_LT(elapsedMs, 150);
+
+    // Training must wait for the speculative relocalisation to finish in the background.
+    relocaliser.train(NULL, NULL, Vector4f(1,1,0,0), ORUtils::SE3Pose());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_latency_histograms)
+{
+  SettingsContainer_Ptr settings = make_settings(true);
+  settings->add_value("CascadeRelocaliser.latencyHistogramBinMs", "20");
+  settings->add_value("CascadeRelocaliser.timersEnabled", "true");
+  CascadeRelocaliser relocaliser(make_inner_relocalisers(50, 1.0f, 10, 0.1f), settings, "CascadeRelocaliser.");
+
+  const int frameCount = 3;
+  for(int i = 0; i < frameCount; ++i)
+  {
+    int elapsedMs = 0;
+    timed_relocalise(relocaliser, elapsedMs);
+  }
+
+  Histogram<int> histogram0 = relocaliser.get_stage_latency_histogram(0);
+  Histogram<int> histogram1 = relocaliser.get_stage_latency_histogram(1);
+  BOOST_CHECK_EQUAL(histogram0.get_count(), frameCount);
+  BOOST_CHECK_EQUAL(histogram1.get_count(), frameCount);
+
+  // The first relocaliser sleeps for 50ms, so none of its latencies should fall into a bin below 40ms.
+  const std::map<int,size_t>& bins0 = histogram0.get_bins();
+  BOOST_CHECK(bins0.begin()->first >= 40);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,153 @@
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <orx/base/MemoryBlockFactory.h>
+#include <orx/relocalisation/EnsembleRelocaliser.h>
+using namespace orx;
+using namespace tvgutil;
+
+#include "SleepingRelocaliser.h"
+
+//#################### HELPER FUNCTIONS ####################
+
+std::vector<Relocaliser_Ptr> make_inner_relocalisers(int sleepMs1, int sleepMs2, int sleepMs3)
+{
+  std::vector<Relocaliser_Ptr> innerRelocalisers;
+  innerRelocalisers.push_back(Relocaliser_Ptr(new SleepingRelocaliser(sleepMs1, 3.0f)));
+  innerRelocalisers.push_back(Relocaliser_Ptr(new SleepingRelocaliser(sleepMs2, 1.0f)));
+  innerRelocalisers.push_back(Relocaliser_Ptr(new SleepingRelocaliser(sleepMs3, 2.0f)));
+  return innerRelocalisers;
+}
+
+SettingsContainer_Ptr make_settings(bool parallel)
+{
+  SettingsContainer_Ptr settings(new SettingsContainer);
+  settings->add_value("EnsembleRelocaliser.parallel", parallel ? "true" : "false");
+  return settings;
+}
+
+std::vector<Relocaliser::Result> timed_relocalise(const EnsembleRelocaliser& relocaliser, int& elapsedMs)
+{
+  // Make sure that any internal copies of the images that the ensemble makes are CPU-only (like the images themselves).
+  MemoryBlockFactory::instance().set_device_type(ORUtils::DEVICE_CPU);
+
+  ORUChar4Image colourImage(Vector2i(4,4), true, false);
+  ORFloatImage depthImage(Vector2i(4,4), true, false);
+
+  boost::chrono::steady_clock::time_point startTime = boost::chrono::steady_clock::now();
+  std::vector<Relocaliser::Result> results = relocaliser.relocalise(&colourImage, &depthImage, Vector4f(1,1,0,0));
+  elapsedMs = static_cast<int>(boost::chrono::duration_cast<boost::chrono::milliseconds>(boost::chrono::steady_clock::now() - startTime).count());
+
+  return results;
+}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(test_EnsembleRelocaliser)
+
+BOOST_AUTO_TEST_CASE(test_empty_ensemble)
+{
+  BOOST_CHECK_THROW(EnsembleRelocaliser(std::vector<Relocaliser_Ptr>(), make_settings(false), "EnsembleRelocaliser."), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_parallel_latency)
+{
+  EnsembleRelocaliser serialRelocaliser(make_inner_relocalisers(100, 100, 100), make_settings(false), "EnsembleRelocaliser.");
+  EnsembleRelocaliser parallelRelocaliser(make_inner_relocalisers(100, 100, 100), make_settings(true), "EnsembleRelocaliser.");
+
+  int serialMs = 0, parallelMs = 0;
+  std::vector<Relocaliser::Result> serialResults = timed_relocalise(serialRelocaliser, serialMs);
+  std::vector<Relocaliser::Result> parallelResults = timed_relocalise(parallelRelocaliser, parallelMs);
+
+  // Both modes should produce the same results, sorted in ascending order of score.
+  BOOST_REQUIRE_EQUAL(serialResults.size(), 3);
+  BOOST_REQUIRE_EQUAL(parallelResults.size(), 3);
+  for(size_t i = 0; i < 3; ++i)
+  {
+    BOOST_CHECK_EQUAL(serialResults[i].score, static_cast<float>(i + 1));
+    BOOST_CHECK_EQUAL(parallelResults[i].score, static_cast<float>(i + 1));
+  }
+
+  // The serial latency is the sum of the inner latencies, whereas the parallel latency is (roughly) their maximum.
+  BOOST_CHECK_GE(serialMs, 300);
+  BOOST_CHECK_LT(parallelMs, 250);
+
+  // Repeated relocalisations should reuse the worker threads.
+  parallelResults = timed_relocalise(parallelRelocaliser, parallelMs);
+  BOOST_CHECK_EQUAL(parallelResults.size(), 3);
+  BOOST_CHECK_LT(parallelMs, 250);
+}
+
+BOOST_AUTO_TEST_CASE(test_inner_timeout)
+{
+  // Give the slow relocaliser (whose result has the best score) a timeout it cannot meet.
+  SettingsContainer_Ptr settings = make_settings(true);
+  settings->add_value("EnsembleRelocaliser.R1.timeoutMs", "50");
+
+  EnsembleRelocaliser relocaliser(make_inner_relocalisers(10, 500, 10), settings, "EnsembleRelocaliser.");
+
+  int elapsedMs = 0;
+  std::vector<Relocaliser::Result> results = timed_relocalise(relocaliser, elapsedMs);
+
+  BOOST_REQUIRE_EQUAL(results.size(), 2);
+  BOOST_CHECK_EQUAL(results[0].score, 2.0f);
+  BOOST_CHECK_EQUAL(results[1].score, 3.0f);
+  BOOST_CHECK_LT(elapsedMs, 400);
+}
+
+BOOST_AUTO_TEST_CASE(test_visualisation_image_after_timeout)
+{
+  // Give the slow relocaliser (which is not the first one) a timeout it cannot meet.
+  SettingsContainer_Ptr settings = make_settings(true);
+  settings->add_value("EnsembleRelocaliser.R1.timeoutMs", "50");
+
+  EnsembleRelocaliser relocaliser(make_inner_relocalisers(10, 500, 10), settings, "EnsembleRelocaliser.");
+
+  int elapsedMs = 0;
+  timed_relocalise(relocaliser, elapsedMs);
+
+  // Getting the visualisation image only needs the first relocaliser, so it should not wait for the slow one to finish.
+  boost::chrono::steady_clock::time_point startTime = boost::chrono::steady_clock::now();
+  relocaliser.get_visualisation_image("");
+  elapsedMs += static_cast<int>(boost::chrono::duration_cast<boost::chrono::milliseconds>(boost::chrono::steady_clock::now() - startTime).count());
+
+  BOOST_CHECK_LT(elapsedMs, 400);
+}
+
+BOOST_AUTO_TEST_CASE(test_relocalisation_budget)
+{
+  SettingsContainer_Ptr settings = make_settings(true);
+  settings->add_value("EnsembleRelocaliser.relocalisationBudgetMs", "100");
+
+  EnsembleRelocaliser relocaliser(make_inner_relocalisers(10, 500, 500), settings, "EnsembleRelocaliser.");
+
+  int elapsedMs = 0;
+  std::vector<Relocaliser::Result> results = timed_relocalise(relocaliser, elapsedMs);
+
+  BOOST_REQUIRE_EQUAL(results.size(), 1);
+  BOOST_CHECK_EQUAL(results[0].score, 3.0f);
+  BOOST_CHECK_LT(elapsedMs, 400);
+}
+
+BOOST_AUTO_TEST_CASE(test_save_and_load)
+{
+  std::vector<Relocaliser_Ptr> innerRelocalisers = make_inner_relocalisers(0, 0, 0);
+  EnsembleRelocaliser relocaliser(innerRelocalisers, make_settings(true), "EnsembleRelocaliser.");
+
+  relocaliser.save_to_disk("ensemble");
+  relocaliser.load_from_disk("ensemble");
+
+  // Each inner relocaliser should have been saved to, and loaded from, its own subfolder.
+  for(size_t i = 0; i < innerRelocalisers.size(); ++i)
+  {
+    SleepingRelocaliser_Ptr innerRelocaliser = boost::static_pointer_cast<SleepingRelocaliser>(innerRelocalisers[i]);
+    const std::string expectedFolder = (boost::filesystem::path("ensemble") / ("R" + boost::lexical_cast<std::string>(i))).string();
+    BOOST_CHECK_EQUAL(innerRelocaliser->get_save_folder(), expectedFolder);
+    BOOST_CHECK_EQUAL(innerRelocaliser->get_load_folder(), expectedFolder);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
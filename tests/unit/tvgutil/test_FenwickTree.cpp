@@ -0,0 +1,77 @@
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+#include <tvgutil/containers/FenwickTree.h>
+using namespace tvgutil;
+
+BOOST_AUTO_TEST_SUITE(test_FenwickTree)
+
+BOOST_AUTO_TEST_CASE(prefix_sum_test)
+{
+  FenwickTree<int> tree;
+  std::vector<int> values;
+  for(int i = 0; i < 37; ++i)
+  {
+    tree.push_back(i % 5);
+    values.push_back(i % 5);
+  }
+
+  tree.set(3, 10);
+  values[3] = 10;
+  tree.add(16, 7);
+  values[16] += 7;
+
+  BOOST_CHECK_EQUAL(tree.size(), values.size());
+
+  int sum = 0;
+  for(size_t n = 0; n <= values.size(); ++n)
+  {
+    BOOST_CHECK_EQUAL(tree.prefix_sum(n), sum);
+    if(n < values.size())
+    {
+      BOOST_CHECK_EQUAL(tree.get(n), values[n]);
+      sum += values[n];
+    }
+  }
+
+  BOOST_CHECK_EQUAL(tree.total(), sum);
+  BOOST_CHECK_THROW(tree.get(values.size()), std::out_of_range);
+  BOOST_CHECK_THROW(tree.prefix_sum(values.size() + 1), std::out_of_range);
+
+  tree.clear();
+  BOOST_CHECK_EQUAL(tree.size(), 0);
+  BOOST_CHECK_EQUAL(tree.total(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(find_test)
+{
+  FenwickTree<double> tree;
+  BOOST_CHECK_THROW(tree.find(0.0), std::runtime_error);
+
+  // Cumulative ranges: [0,1) -> 0, (element 1 has no range), [1,3) -> 2, [3,3.5) -> 3, (element 4 has no range), [3.5,7.5) -> 5.
+  const double values[] = { 1.0, 0.0, 2.0, 0.5, 0.0, 4.0 };
+  for(size_t i = 0; i < sizeof(values) / sizeof(double); ++i)
+  {
+    tree.push_back(values[i]);
+  }
+
+  BOOST_CHECK_EQUAL(tree.find(0.0), 0);
+  BOOST_CHECK_EQUAL(tree.find(0.99), 0);
+  BOOST_CHECK_EQUAL(tree.find(1.0), 2);
+  BOOST_CHECK_EQUAL(tree.find(2.99), 2);
+  BOOST_CHECK_EQUAL(tree.find(3.0), 3);
+  BOOST_CHECK_EQUAL(tree.find(3.5), 5);
+  BOOST_CHECK_EQUAL(tree.find(7.49), 5);
+
+  // Targets beyond the total should yield the last element with a positive value.
+  tree.set(5, 0.0);
+  BOOST_CHECK_EQUAL(tree.find(100.0), 3);
+
+  // Elements whose values have been zeroed should never be found.
+  tree.set(2, 0.0);
+  BOOST_CHECK_EQUAL(tree.find(1.0), 3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,130 @@
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
+
+#include <boost/make_shared.hpp>
+
+#include <tvgutil/containers/LockFreePooledQueue.h>
+using namespace tvgutil;
+using namespace tvgutil::pooled_queue;
+
+typedef boost::shared_ptr<int> Int_Ptr;
+
+//#################### HELPER FUNCTIONS ####################
+
+Int_Ptr make_int()
+{
+  return boost::make_shared<int>(0);
+}
+
+template <typename Queue>
+void push_value(Queue& queue, int value)
+{
+  typename Queue::PushHandler_Ptr pushHandler = queue.begin_push();
+  boost::optional<Int_Ptr&> elt = pushHandler->get();
+  if(elt) **elt = value;
+}
+
+template <typename Queue>
+void produce(Queue *queue, int count)
+{
+  for(int i = 0; i < count; ++i) push_value(*queue, i);
+}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(test_LockFreePooledQueue)
+
+BOOST_AUTO_TEST_CASE(ring_test)
+{
+  SPSCRing<int> spsc(3);
+  MPMCRing<int> mpmc(3);
+    BOOST_CHECK_EQUAL(spsc.capacity(), 4);
+    BOOST_CHECK_EQUAL(mpmc.capacity(), 4);
+
+  for(int i = 0; i < 4; ++i)
+  {
+      BOOST_CHECK(spsc.try_push(i));
+      BOOST_CHECK(mpmc.try_push(i));
+  }
+    BOOST_CHECK(!spsc.try_push(4));
+    BOOST_CHECK(!mpmc.try_push(4));
+    BOOST_CHECK_EQUAL(*spsc.front(), 0);
+    BOOST_CHECK_EQUAL(*mpmc.front(), 0);
+
+  // Wrap around the rings several times to check that the indices are handled correctly.
+  for(int i = 4; i < 20; ++i)
+  {
+    int a, b;
+      BOOST_CHECK(spsc.try_pop(a));
+      BOOST_CHECK(mpmc.try_pop(b));
+      BOOST_CHECK_EQUAL(a, i - 4);
+      BOOST_CHECK_EQUAL(b, i - 4);
+      BOOST_CHECK(spsc.try_push(i));
+      BOOST_CHECK(mpmc.try_push(i));
+  }
+
+  int elt;
+  while(spsc.try_pop(elt)) {}
+  while(mpmc.try_pop(elt)) {}
+    BOOST_CHECK_EQUAL(spsc.size(), 0);
+    BOOST_CHECK_EQUAL(mpmc.size(), 0);
+    BOOST_CHECK(spsc.front() == NULL);
+    BOOST_CHECK(mpmc.front() == NULL);
+}
+
+BOOST_AUTO_TEST_CASE(discard_test)
+{
+  LockFreePooledQueue<Int_Ptr,SPSCRing> queue(PES_DISCARD);
+  queue.initialise(2, &make_int);
+  for(int i = 0; i < 3; ++i) push_value(queue, i);
+    BOOST_CHECK_EQUAL(queue.size(), 2);
+    BOOST_CHECK_EQUAL(*queue.peek(), 0);
+  queue.pop();
+    BOOST_CHECK_EQUAL(*queue.peek(), 1);
+  queue.pop();
+    BOOST_CHECK(queue.empty());
+}
+
+BOOST_AUTO_TEST_CASE(grow_test)
+{
+  LockFreePooledQueue<Int_Ptr,MPMCRing> queue(PES_GROW);
+  queue.initialise(1, &make_int, 4);
+  for(int i = 0; i < 6; ++i) push_value(queue, i);
+
+  // The pool can grow up to its maximum capacity, after which pushes are discarded.
+    BOOST_CHECK_EQUAL(queue.size(), 4);
+  for(int i = 0; i < 4; ++i)
+  {
+      BOOST_CHECK_EQUAL(*queue.peek(), i);
+    queue.pop();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(replace_random_test)
+{
+  // The 'replace random' strategy is not supported, since the only element a pusher could reclaim is the one the consumer may be using.
+    BOOST_CHECK_THROW((LockFreePooledQueue<Int_Ptr,SPSCRing>(PES_REPLACE_RANDOM)), std::runtime_error);
+    BOOST_CHECK_THROW((LockFreePooledQueue<Int_Ptr,MPMCRing>(PES_REPLACE_RANDOM)), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(concurrency_test)
+{
+  // Check that all elements arrive in order when a producer and a consumer run concurrently with a very small pool.
+  const int count = 100000;
+  LockFreePooledQueue<Int_Ptr,SPSCRing> queue(PES_WAIT);
+  queue.initialise(2, &make_int);
+  boost::thread producer(boost::bind(&produce<LockFreePooledQueue<Int_Ptr,SPSCRing> >, &queue, count));
+
+  bool inOrder = true;
+  for(int i = 0; i < count; ++i)
+  {
+    if(*queue.peek() != i) inOrder = false;
+    queue.pop();
+  }
+
+  producer.join();
+    BOOST_CHECK(inOrder);
+    BOOST_CHECK(queue.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,171 @@
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
+
+#include <stdexcept>
+#include <string>
+
+#include <boost/asio.hpp>
+#include <boost/cstdint.hpp>
+
+#include <tvgutil/net/Message.h>
+using namespace tvgutil;
+
+//#################### HELPER CLASSES ####################
+
+/**
+ * \brief An instance of this class represents a message containing a small header, a large payload and a small trailer.
+ */
+class PayloadMessage : public Message
+{
+  //#################### PRIVATE VARIABLES ####################
+private:
+  Segment m_headerSegment;
+  Segment m_payloadSegment;
+  Segment m_trailerSegment;
+
+  //#################### CONSTRUCTORS ####################
+public:
+  explicit PayloadMessage(size_t payloadSize)
+  {
+    m_headerSegment = std::make_pair(0, sizeof(int32_t));
+    m_payloadSegment = std::make_pair(end_of(m_headerSegment), payloadSize);
+    m_trailerSegment = std::make_pair(end_of(m_payloadSegment), sizeof(int32_t));
+    m_data.resize(end_of(m_trailerSegment));
+  }
+
+  //#################### PUBLIC MEMBER FUNCTIONS ####################
+public:
+  void borrow_header(char *data)                { borrow_segment(m_headerSegment, data); }
+  void borrow_overlapping(char *data)           { borrow_segment(std::make_pair(m_payloadSegment.first - 1, 2), data); }
+  void borrow_payload(const char *data)         { borrow_segment(m_payloadSegment, data); }
+  void borrow_payload(char *data)               { borrow_segment(m_payloadSegment, data); }
+  int32_t extract_header() const                { return read_simple<int32_t>(m_headerSegment); }
+  std::string extract_payload() const           { return std::string(get_segment_ptr(m_payloadSegment), m_payloadSegment.second); }
+  int32_t extract_trailer() const               { return read_simple<int32_t>(m_trailerSegment); }
+  void set_header(int32_t header)               { write_simple(header, m_headerSegment); }
+  void set_payload(const std::string& payload)  { memcpy(get_segment_ptr(m_payloadSegment), payload.data(), m_payloadSegment.second); }
+  void set_trailer(int32_t trailer)             { write_simple(trailer, m_trailerSegment); }
+};
+
+//#################### HELPER FUNCTIONS ####################
+
+/**
+ * \brief Gets the bytes that would be sent across the network for the specified message.
+ *
+ * \param msg The message.
+ * \return    The bytes that would be sent for the message.
+ */
+std::string get_wire_bytes(const Message& msg)
+{
+  std::vector<boost::asio::const_buffer> buffers = msg.get_const_buffers();
+  std::string result(boost::asio::buffer_size(buffers), '\0');
+  boost::asio::buffer_copy(boost::asio::buffer(&result[0], result.size()), buffers);
+  return result;
+}
+
+/**
+ * \brief Counts the number of bytes that are staged through a message's own data (rather than being borrowed from external memory) when it is sent.
+ *
+ * \param msg The message.
+ * \return    The number of bytes of the message that are stored in its own data.
+ */
+size_t count_owned_bytes(const Message& msg)
+{
+  const char *begin = msg.get_data_ptr(), *end = begin + msg.get_size();
+
+  size_t result = 0;
+  std::vector<boost::asio::const_buffer> buffers = msg.get_const_buffers();
+  for(size_t i = 0, size = buffers.size(); i < size; ++i)
+  {
+    const char *p = boost::asio::buffer_cast<const char*>(buffers[i]);
+    if(p >= begin && p < end) result += boost::asio::buffer_size(buffers[i]);
+  }
+
+  return result;
+}
+
+/**
+ * \brief A completion handler for asynchronous reads and writes that does nothing (the test checks the results separately).
+ */
+void ignore_completion(const boost::system::error_code&, size_t) {}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(test_Message)
+
+BOOST_AUTO_TEST_CASE(wire_compatibility_test)
+{
+  const std::string payload = "The quick brown fox jumps over the lazy dog";
+
+  PayloadMessage ownedMsg(payload.size());
+  ownedMsg.set_header(23);
+  ownedMsg.set_payload(payload);
+  ownedMsg.set_trailer(9);
+
+  PayloadMessage borrowedMsg(payload.size());
+  borrowedMsg.set_header(23);
+  borrowedMsg.borrow_payload(payload.data());
+  borrowedMsg.set_trailer(9);
+
+  // The bytes on the wire should be the same whether or not the payload is borrowed, but only the header and trailer should be copied.
+    BOOST_CHECK_EQUAL(ownedMsg.get_const_buffers().size(), 1);
+    BOOST_CHECK_EQUAL(borrowedMsg.get_const_buffers().size(), 3);
+    BOOST_CHECK_EQUAL(get_wire_bytes(borrowedMsg), get_wire_bytes(ownedMsg));
+    BOOST_CHECK_EQUAL(borrowedMsg.extract_payload(), payload);
+    BOOST_CHECK_EQUAL(count_owned_bytes(ownedMsg), ownedMsg.get_size());
+    BOOST_CHECK_EQUAL(count_owned_bytes(borrowedMsg), 2 * sizeof(int32_t));
+
+  // A message whose payload has been borrowed from read-only memory cannot be received into, or have its payload changed.
+    BOOST_CHECK_THROW(borrowedMsg.get_mutable_buffers(), std::runtime_error);
+    BOOST_CHECK_THROW(borrowedMsg.set_payload(payload), std::runtime_error);
+
+  // Once the payload has been released, the message should revert to using its own (uninitialised) data.
+  borrowedMsg.release_borrowed_segments();
+    BOOST_CHECK_EQUAL(borrowedMsg.get_const_buffers().size(), 1);
+    BOOST_CHECK_EQUAL(borrowedMsg.extract_header(), 23);
+}
+
+BOOST_AUTO_TEST_CASE(scatter_gather_test)
+{
+  const std::string payload(100000, 'x');
+
+  PayloadMessage sentMsg(payload.size());
+  sentMsg.borrow_payload(payload.data());
+  sentMsg.set_header(7);
+  sentMsg.set_trailer(8);
+
+  // Receive the message into one whose header and payload have both been borrowed from external storage.
+  std::string payloadStorage(payload.size(), ' ');
+  int32_t headerStorage = 0;
+  PayloadMessage receivedMsg(payload.size());
+  receivedMsg.borrow_payload(&payloadStorage[0]);
+  receivedMsg.borrow_header(reinterpret_cast<char*>(&headerStorage));
+
+  // Send the message across a real socket, so as to check that the gather-write and scatter-read both work.
+  boost::asio::io_service ioService;
+  boost::asio::local::stream_protocol::socket writer(ioService), reader(ioService);
+  boost::asio::local::connect_pair(writer, reader);
+  boost::asio::async_write(writer, sentMsg.get_const_buffers(), &ignore_completion);
+  boost::asio::async_read(reader, receivedMsg.get_mutable_buffers(), &ignore_completion);
+  ioService.run();
+
+    BOOST_CHECK_EQUAL(headerStorage, 7);
+    BOOST_CHECK_EQUAL(receivedMsg.extract_header(), 7);
+    BOOST_CHECK(payloadStorage == payload);
+    BOOST_CHECK_EQUAL(receivedMsg.extract_trailer(), 8);
+    BOOST_CHECK_EQUAL(count_owned_bytes(receivedMsg), sizeof(int32_t));
+}
+
+BOOST_AUTO_TEST_CASE(invalid_borrowing_test)
+{
+  char storage[10];
+  PayloadMessage msg(10);
+  msg.borrow_payload(storage);
+
+  // Borrowing exactly the same segment again is fine, but borrowing an overlapping one is not.
+  msg.borrow_payload(storage);
+    BOOST_CHECK_THROW(msg.borrow_overlapping(storage), std::invalid_argument);
+    BOOST_CHECK_EQUAL(msg.get_const_buffers().size(), 3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,152 @@
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <tvgutil/net/ClientHandler.h>
+#include <tvgutil/net/Server.h>
+#include <tvgutil/net/SimpleMessage.h>
+using namespace tvgutil;
+
+typedef SimpleMessage<int32_t> IntMessage;
+
+//#################### HELPER CLASSES ####################
+
+/**
+ * \brief An instance of this class echoes the messages it receives back to its client, using a dedicated thread.
+ */
+class EchoClientHandler : public ClientHandler
+{
+public:
+  EchoClientHandler(int clientID, const boost::shared_ptr<boost::asio::ip::tcp::socket>& sock, const boost::shared_ptr<const boost::atomic<bool> >& shouldTerminate)
+  : ClientHandler(clientID, sock, shouldTerminate)
+  {}
+
+public:
+  virtual void run_iter()
+  {
+    IntMessage msg;
+    m_connectionOk = read_message(msg) && write_message(msg);
+  }
+};
+
+/**
+ * \brief An instance of this class echoes the messages it receives back to its client, using an asynchronous state machine.
+ */
+class AsyncEchoClientHandler : public ClientHandler
+{
+private:
+  IntMessage m_msg;
+
+public:
+  AsyncEchoClientHandler(int clientID, const boost::shared_ptr<boost::asio::ip::tcp::socket>& sock, const boost::shared_ptr<const boost::atomic<bool> >& shouldTerminate)
+  : ClientHandler(clientID, sock, shouldTerminate)
+  {}
+
+public:
+  virtual bool is_async() const
+  {
+    return true;
+  }
+
+  virtual void start_async()
+  {
+    signal_ready();
+    read_next();
+  }
+
+private:
+  void read_next()
+  {
+    async_read_message(m_msg, boost::bind(&AsyncEchoClientHandler::write_back, this));
+  }
+
+  void write_back()
+  {
+    async_write_message(m_msg, boost::bind(&AsyncEchoClientHandler::read_next, this));
+  }
+};
+
+/**
+ * \brief An instance of this struct records the results of a simulated client.
+ */
+struct ClientResult
+{
+  boost::chrono::microseconds m_acceptLatency;
+  bool m_ok;
+
+  ClientResult()
+  : m_acceptLatency(0), m_ok(false)
+  {}
+};
+
+//#################### HELPER FUNCTIONS ####################
+
+void run_client(int port, int roundTrips, ClientResult *result)
+{
+  boost::chrono::high_resolution_clock::time_point t0 = boost::chrono::high_resolution_clock::now();
+  boost::asio::ip::tcp::iostream stream("localhost", boost::lexical_cast<std::string>(port));
+
+  bool ok = !!stream;
+  for(int i = 0; i < roundTrips && ok; ++i)
+  {
+    IntMessage msg(i), reply;
+    ok = stream.write(msg.get_data_ptr(), msg.get_size()) && stream.read(reply.get_data_ptr(), reply.get_size()) && reply.extract_value() == i;
+
+    // The accept latency is measured up to the point at which the first reply arrives (since that is when the server is actually servicing the client).
+    if(i == 0) result->m_acceptLatency = boost::chrono::duration_cast<boost::chrono::microseconds>(boost::chrono::high_resolution_clock::now() - t0);
+  }
+
+  result->m_ok = ok;
+}
+
+template <typename ClientHandlerType>
+void run_loopback_test(const std::string& name, int port)
+{
+  const int clientCount = 32, roundTrips = 200;
+
+  Server<ClientHandlerType> server(Server<ClientHandlerType>::SM_MULTI_CLIENT, port, 4);
+  server.start();
+
+  std::vector<ClientResult> results(clientCount);
+  boost::chrono::high_resolution_clock::time_point t0 = boost::chrono::high_resolution_clock::now();
+
+  boost::thread_group clients;
+  for(int i = 0; i < clientCount; ++i)
+  {
+    clients.create_thread(boost::bind(&run_client, port, roundTrips, &results[i]));
+  }
+  clients.join_all();
+
+  const double seconds = boost::chrono::duration_cast<boost::chrono::duration<double> >(boost::chrono::high_resolution_clock::now() - t0).count();
+  server.terminate();
+
+  boost::chrono::microseconds totalAcceptLatency(0), maxAcceptLatency(0);
+  for(int i = 0; i < clientCount; ++i)
+  {
+      BOOST_CHECK(results[i].m_ok);
+    totalAcceptLatency += results[i].m_acceptLatency;
+    maxAcceptLatency = std::max(maxAcceptLatency, results[i].m_acceptLatency);
+  }
+
+  std::cout << name << ": mean accept latency " << totalAcceptLatency / clientCount << ", max accept latency " << maxAcceptLatency
+            << ", throughput " << clientCount * roundTrips / seconds << " round trips/s" << std::endl;
+}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(test_Server)
+
+BOOST_AUTO_TEST_CASE(async_loopback_test)
+{
+  run_loopback_test<AsyncEchoClientHandler>("Asynchronous", 7862);
+}
+
+BOOST_AUTO_TEST_CASE(sync_loopback_test)
+{
+  run_loopback_test<EchoClientHandler>("Synchronous", 7861);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,129 @@
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
+
+#include <stdexcept>
+#include <vector>
+
+#include <tvgutil/misc/TaskScheduler.h>
+using namespace tvgutil;
+
+//#################### HELPER FUNCTIONS ####################
+
+int add(int a, int b)
+{
+  return a + b;
+}
+
+void append(std::vector<int> *order, int value)
+{
+  order->push_back(value);
+}
+
+void fail()
+{
+  throw std::runtime_error("Failed");
+}
+
+void fill(std::vector<int> *values, int i)
+{
+  (*values)[i] = i * i;
+}
+
+void fill_nested(TaskScheduler *scheduler, std::vector<int> *values, int i)
+{
+  scheduler->parallel_for(i * 100, (i + 1) * 100, 7, boost::bind(&fill, values, _1));
+}
+
+void throw_if_odd(int i)
+{
+  if(i % 2 == 1) throw std::runtime_error("Odd");
+}
+
+void wait_for(boost::shared_future<void> f)
+{
+  f.wait();
+}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(test_TaskScheduler)
+
+BOOST_AUTO_TEST_CASE(initialise_test)
+{
+  // Note: This is the only test that uses the global instance, so it hasn't been started yet.
+  TaskScheduler::initialise(2);
+  TaskScheduler::initialise(3);
+    BOOST_CHECK_EQUAL(TaskScheduler::instance().thread_count(), 3);
+
+  // Once the global instance has been started, it can be "reinitialised" with the same parameters, but not reconfigured.
+  TaskScheduler::initialise(3);
+    BOOST_CHECK_THROW(TaskScheduler::initialise(2), std::runtime_error);
+    BOOST_CHECK_THROW(TaskScheduler::initialise(3, std::vector<int>(1, 0)), std::runtime_error);
+    BOOST_CHECK_EQUAL(TaskScheduler::instance().thread_count(), 3);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_for_test)
+{
+  TaskScheduler scheduler(4);
+  std::vector<int> values(1000, -1);
+  scheduler.parallel_for(0, 1000, 16, boost::bind(&fill, &values, _1));
+
+  bool ok = true;
+  for(int i = 0; i < 1000; ++i) ok = ok && values[i] == i * i;
+    BOOST_CHECK(ok);
+
+  // Check that loops can be nested inside other loops without deadlocking.
+  std::fill(values.begin(), values.end(), -1);
+  scheduler.parallel_for(0, 10, 1, boost::bind(&fill_nested, &scheduler, &values, _1));
+
+  ok = true;
+  for(int i = 0; i < 1000; ++i) ok = ok && values[i] == i * i;
+    BOOST_CHECK(ok);
+
+  BOOST_CHECK_THROW(scheduler.parallel_for(0, 100, 10, &throw_if_odd), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(priority_test)
+{
+  // Block the only worker until all the tasks have been submitted, and then check that they run in priority order.
+  TaskScheduler scheduler(1);
+  boost::promise<void> gate;
+  boost::shared_future<void> gateFuture(gate.get_future());
+  scheduler.submit(boost::bind(&wait_for, gateFuture));
+
+  std::vector<int> order;
+  scheduler.submit(boost::bind(&append, &order, 2), TP_LOW);
+  scheduler.submit(boost::bind(&append, &order, 1), TP_NORMAL);
+  boost::unique_future<void> last = scheduler.submit(boost::bind(&append, &order, 0), TP_HIGH);
+  gate.set_value();
+
+  // Note: The low priority task runs last, so once it's finished, the others must have finished too.
+  scheduler.submit(boost::bind(&append, &order, 3), TP_LOW).wait();
+
+    BOOST_CHECK_EQUAL(order.size(), 4);
+    BOOST_CHECK_EQUAL(order[0], 0);
+    BOOST_CHECK_EQUAL(order[1], 1);
+    BOOST_CHECK_EQUAL(order[2], 2);
+    BOOST_CHECK_EQUAL(order[3], 3);
+}
+
+BOOST_AUTO_TEST_CASE(submit_test)
+{
+  TaskScheduler scheduler(2);
+
+  std::vector<boost::shared_future<int> > results;
+  for(int i = 0; i < 100; ++i)
+  {
+    results.push_back(boost::shared_future<int>(scheduler.submit(boost::bind(&add, i, 1))));
+  }
+
+  for(int i = 0; i < 100; ++i)
+  {
+      BOOST_CHECK_EQUAL(results[i].get(), i + 1);
+  }
+
+  boost::unique_future<void> failure = scheduler.submit(&fail);
+    BOOST_CHECK_THROW(failure.get(), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()